@@ -14,6 +14,9 @@
 class MeshmoonCommonPlugin;
 
 class MeshmoonSpaceLoader;
+class MeshmoonSceneValidator;
+class MeshmoonSceneRule;
+class MeshmoonAssetReloader;
 
 class MeshmoonLayers;
 class MeshmoonLayerProcessor;
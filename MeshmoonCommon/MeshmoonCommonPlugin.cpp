@@ -11,22 +11,47 @@
 
 #include "MeshmoonCommonPlugin.h"
 #include "Framework.h"
+#include "ConsoleAPI.h"
+#include "SceneAPI.h"
+#include "Scene.h"
+#include "Entity.h"
+#include "LoggingFunctions.h"
 
 #include "common/loaders/MeshmoonSpaceLoader.h"
+#include "common/loaders/MeshmoonSceneValidator.h"
+#include "common/MeshmoonAssetReloader.h"
+#include "common/layers/MeshmoonLayers.h"
+
+#include <kNet/PolledTimer.h>
+
+#include <vector>
 
 MeshmoonCommonPlugin::MeshmoonCommonPlugin() :
     IModule("MeshmoonCommonPlugin"),
-    spaceLoader_(0)
+    spaceLoader_(0),
+    assetReloader_(0)
 {
 }
 
 MeshmoonCommonPlugin::~MeshmoonCommonPlugin()
 {
     SAFE_DELETE(spaceLoader_);
+    SAFE_DELETE(assetReloader_);
 }
 
 void MeshmoonCommonPlugin::Initialize()
 {
+    assetReloader_ = new MeshmoonAssetReloader(Fw());
+
+    // Benchmarks are only for development builds and profiling sessions.
+    if (Fw()->HasCommandLineParameter("--rocketDevCommands"))
+    {
+        Fw()->Console()->RegisterCommand("benchmarkSceneValidator", "Compares incremental and full scene validation. Usage: benchmarkSceneValidator(entities=50000,layers=20)",
+            this, SLOT(BenchmarkSceneValidator(const QString&, const QString&)), SLOT(BenchmarkSceneValidator()));
+        Fw()->Console()->RegisterCommand("benchmarkLayerLookup", "Compares indexed and linear layer lookups for simulated connections. Usage: benchmarkLayerLookup(layers=5000,connections=2000)",
+            this, SLOT(BenchmarkLayerLookup(const QString&, const QString&)), SLOT(BenchmarkLayerLookup()));
+    }
+
     if (Fw()->HasCommandLineParameter("--meshmoonLoadSpaces"))
     {
         QStringList source = Fw()->CommandLineParameters("--meshmoonLoadSpaces");
@@ -35,6 +60,150 @@ void MeshmoonCommonPlugin::Initialize()
     }
 }
 
+void MeshmoonCommonPlugin::BenchmarkSceneValidator()
+{
+    BenchmarkSceneValidator("50000", "20");
+}
+
+void MeshmoonCommonPlugin::BenchmarkSceneValidator(const QString &entities, const QString &layers)
+{
+    const int numEntities = qMax(1, entities.toInt());
+    const int numLayers = qBound(1, layers.toInt(), numEntities);
+    const QString sceneName = "MeshmoonSceneValidatorBenchmark";
+
+    ScenePtr scene = Fw()->Scene()->CreateScene(sceneName, false, false);
+    if (!scene)
+    {
+        LogError("[MeshmoonCommonPlugin]: Failed to create benchmark scene.");
+        return;
+    }
+
+    MeshmoonSceneValidator validator(Fw());
+    validator.SetScene(scene.get());
+
+    float incrementalMsecs = 0.f;
+    float fullMsecs = 0.f;
+    kNet::PolledTimer timer;
+
+    const int perLayer = numEntities / numLayers;
+    for(int layer = 0; layer < numLayers; ++layer)
+    {
+        const int count = (layer == numLayers - 1 ? numEntities - perLayer * layer : perLayer);
+        for(int i = 0; i < count; ++i)
+        {
+            // Layers after the first one are temporary, as when loaded from Meshmoon layers.
+            EntityPtr ent = scene->CreateEntity(0, QStringList() << "EC_Name", AttributeChange::LocalOnly, true, true, layer > 0);
+            if (ent)
+                ent->SetName((layer == 0 && i == 0) ? MeshmoonSceneValidator::RocketEnvironmentEntityName : QString("Entity%1").arg(i));
+        }
+
+        timer.Start();
+        validator.Validate();
+        incrementalMsecs += timer.MSecsElapsed();
+
+        timer.Start();
+        MeshmoonSceneValidator::Validate(scene.get());
+        fullMsecs += timer.MSecsElapsed();
+    }
+
+    const MeshmoonSceneValidator::Stats &stats = validator.Statistics();
+    LogInfo(QString("[MeshmoonCommonPlugin]: Validated %1 entities in %2 layers").arg(numEntities).arg(numLayers));
+    LogInfo(QString("    Incremental : %1 msecs, %2 entities checked, %3 rule runs").arg(incrementalMsecs, 0, 'f', 2).arg(stats.checkedEntities).arg(stats.ruleRuns));
+    LogInfo(QString("    Full        : %1 msecs, %2 entities checked").arg(fullMsecs, 0, 'f', 2).arg(static_cast<qint64>(numEntities) * (numLayers + 1) / 2));
+
+    validator.SetScene(0);
+    scene.reset();
+    Fw()->Scene()->RemoveScene(sceneName);
+}
+
+void MeshmoonCommonPlugin::BenchmarkLayerLookup()
+{
+    BenchmarkLayerLookup("5000", "2000");
+}
+
+void MeshmoonCommonPlugin::BenchmarkLayerLookup(const QString &layers, const QString &connections)
+{
+    const int numLayers = qMax(1, layers.toInt());
+    const int numConnections = qMax(1, connections.toInt());
+    // Layer visibility changes per connection, each looked up by id and every fourth by name as well.
+    const int lookupsPerConnection = 16;
+
+    MeshmoonLayers meshmoonLayers(Fw());
+    kNet::PolledTimer timer;
+
+    Meshmoon::SceneLayerList generated;
+    for(int i = 0; i < numLayers; ++i)
+    {
+        Meshmoon::SceneLayer layer(static_cast<u32>(i + 1), false, QString("Layer%1").arg(i), "");
+        layer.txmlUrl = QUrl(QString("http://benchmark.invalid/layers/%1.txml").arg(i));
+        generated << layer;
+    }
+    timer.Start();
+    meshmoonLayers.Add(generated);
+    const float addMsecs = timer.MSecsElapsed();
+
+    const Meshmoon::SceneLayerList &list = meshmoonLayers.Layers();
+    qsrand(1);
+    QList<u32> ids;
+    QStringList names;
+    for(int c = 0; c < numConnections; ++c)
+    {
+        for(int i = 0; i < lookupsPerConnection; ++i)
+        {
+            const int index = qrand() % numLayers;
+            ids << list[index].id;
+            if (i % 4 == 0)
+                names << list[index].name;
+        }
+    }
+
+    timer.Start();
+    std::vector<const Meshmoon::SceneLayer*> indexed;
+    indexed.reserve(ids.size() + names.size());
+    foreach(u32 id, ids)
+        indexed.push_back(meshmoonLayers.FindLayer(id));
+    foreach(const QString &name, names)
+        indexed.push_back(meshmoonLayers.FindLayer(name));
+    const float indexedMsecs = timer.MSecsElapsed();
+
+    timer.Start();
+    std::vector<const Meshmoon::SceneLayer*> scanned;
+    scanned.reserve(indexed.size());
+    foreach(u32 id, ids)
+    {
+        const Meshmoon::SceneLayer *found = 0;
+        for(int i = 0, len = list.size(); i < len && !found; ++i)
+            if (list[i].id == id)
+                found = &list[i];
+        scanned.push_back(found);
+    }
+    foreach(const QString &name, names)
+    {
+        const Meshmoon::SceneLayer *found = 0;
+        for(int i = 0, len = list.size(); i < len && !found; ++i)
+            if (list[i].name == name)
+                found = &list[i];
+        scanned.push_back(found);
+    }
+    const float scanMsecs = timer.MSecsElapsed();
+
+    int mismatches = 0;
+    for(size_t i = 0; i < indexed.size(); ++i)
+        if (indexed[i] != scanned[i])
+            ++mismatches;
+
+    timer.Start();
+    meshmoonLayers.Remove(list[numLayers / 2].id);
+    const float removeMsecs = timer.MSecsElapsed();
+
+    LogInfo(QString("[MeshmoonCommonPlugin]: %1 layers, %2 connections, %3 lookups").arg(numLayers).arg(numConnections).arg(static_cast<int>(indexed.size())));
+    LogInfo(QString("    Add         : %1 msecs, remove one %2 msecs").arg(addMsecs, 0, 'f', 2).arg(removeMsecs, 0, 'f', 2));
+    LogInfo(QString("    Indexed     : %1 msecs").arg(indexedMsecs, 0, 'f', 2));
+    LogInfo(QString("    Linear scan : %1 msecs").arg(scanMsecs, 0, 'f', 2));
+    if (mismatches > 0)
+        LogError(QString("[MeshmoonCommonPlugin]: %1 indexed lookups differ from the linear scan.").arg(mismatches));
+}
+
 extern "C"
 {
     DLLEXPORT void TundraPluginMain(Framework *fw)
@@ -23,9 +23,26 @@ public:
     MeshmoonCommonPlugin();
     virtual ~MeshmoonCommonPlugin();
 
+    /// Returns the asset reload synchronization between the server and clients.
+    MeshmoonAssetReloader *AssetReloader() const { return assetReloader_; }
+
+private slots:
+    /// Compares incremental scene validation against full validation of the scene.
+    /** Creates @c entities entities in @c layers batches to a local scene, the incremental validator
+        is run after each batch as after a streamed layer load. */
+    void BenchmarkSceneValidator(const QString &entities, const QString &layers);
+    void BenchmarkSceneValidator();
+
+    /// Compares indexed layer lookups against linear scans of the layer list.
+    /** Adds @c layers generated layers to a MeshmoonLayers and has each of @c connections simulated
+        connections look up layers by id and name, as when clients toggle layer visibility. */
+    void BenchmarkLayerLookup(const QString &layers, const QString &connections);
+    void BenchmarkLayerLookup();
+
 private:
     /// IModule override.
     void Initialize();
 
     MeshmoonSpaceLoader *spaceLoader_;
+    MeshmoonAssetReloader *assetReloader_;
 };
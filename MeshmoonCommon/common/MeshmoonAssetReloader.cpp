@@ -0,0 +1,525 @@
+/**
+    @author Adminotech Ltd.
+
+    Copyright Adminotech Ltd.
+    All rights reserved.
+
+    @file
+    @brief   */
+
+#include "StableHeaders.h"
+
+#include "MeshmoonAssetReloader.h"
+
+#include "Framework.h"
+#include "LoggingFunctions.h"
+#include "ConsoleAPI.h"
+#include "AssetAPI.h"
+#include "AssetCache.h"
+#include "IAsset.h"
+#include "IAssetTransfer.h"
+
+#include "TundraLogicModule.h"
+#include "Server.h"
+#include "Client.h"
+#include "UserConnection.h"
+
+#include <kNet/MessageConnection.h>
+#include <kNet/Network.h>
+
+#include <QCryptographicHash>
+#include <QFile>
+#include <QFileInfo>
+#include <QStringList>
+
+/// @cond PRIVATE
+
+using namespace Meshmoon::Network;
+
+namespace
+{
+    /// Block size for hashing files.
+    const qint64 HashBlockBytes = 256 * 1024;
+}
+
+MeshmoonAssetReloader::ClientCost::ClientCost() :
+    batches(0),
+    reloaded(0),
+    unchanged(0),
+    notLoaded(0),
+    failed(0),
+    bytes(0),
+    lastMsecs(0),
+    totalMsecs(0),
+    maxMsecs(0)
+{
+}
+
+MeshmoonAssetReloader::MeshmoonAssetReloader(Framework *framework) :
+    framework_(framework),
+    LC("[MeshmoonAssetReloader]: "),
+    windowMsecs_(500),
+    maxDelayMsecs_(2000),
+    nextBatchId_(1),
+    checkPermissions_(false),
+    nextRequestId_(1)
+{
+    flushTimer_.setSingleShot(true);
+    connect(&flushTimer_, SIGNAL(timeout()), SLOT(FlushPending()));
+
+    TundraLogic::Server *server = Server();
+    if (server)
+    {
+        connect(server, SIGNAL(MessageReceived(UserConnection *, kNet::packet_id_t, kNet::message_id_t, const char*, size_t)),
+            this, SLOT(OnServerMessageReceived(UserConnection *, kNet::packet_id_t, kNet::message_id_t, const char*, size_t)));
+        connect(server, SIGNAL(UserDisconnected(u32, UserConnection*)), this, SLOT(OnUserDisconnected(u32, UserConnection*)));
+    }
+    TundraLogic::Client *client = Client();
+    if (client)
+    {
+        connect(client, SIGNAL(NetworkMessageReceived(kNet::packet_id_t, kNet::message_id_t, const char*, size_t)),
+            this, SLOT(OnClientMessageReceived(kNet::packet_id_t, kNet::message_id_t, const char*, size_t)));
+        connect(client, SIGNAL(Disconnected()), this, SLOT(OnClientDisconnected()));
+    }
+    if (!server && !client)
+        LogError(LC + "TundraLogicModule not available, asset reloads are not synchronized.");
+
+    framework_->Console()->RegisterCommand("reloadAssets", "Reloads ';' separated asset refs on the server and all clients. Assets are hashed from the local cache, "
+        "clients with the same content skip them. Optionally repeats the request to test coalescing. Usage: reloadAssets(refs,repeat=1)",
+        this, SLOT(ReloadAssets(const QString&, const QString&)), SLOT(ReloadAssets(const QString&)));
+    framework_->Console()->RegisterCommand("assetReloadStats", "Prints asset reload statistics, on the server the reload cost reported by each client.",
+        this, SLOT(PrintReloadStats()));
+}
+
+MeshmoonAssetReloader::~MeshmoonAssetReloader()
+{
+}
+
+TundraLogic::Server *MeshmoonAssetReloader::Server() const
+{
+    TundraLogic::TundraLogicModule *tundraLogic = framework_->Module<TundraLogic::TundraLogicModule>();
+    return (tundraLogic ? tundraLogic->GetServer().get() : 0);
+}
+
+TundraLogic::Client *MeshmoonAssetReloader::Client() const
+{
+    TundraLogic::TundraLogicModule *tundraLogic = framework_->Module<TundraLogic::TundraLogicModule>();
+    return (tundraLogic ? tundraLogic->GetClient().get() : 0);
+}
+
+QByteArray MeshmoonAssetReloader::ContentHash(const QByteArray &data)
+{
+    return QCryptographicHash::hash(data, QCryptographicHash::Sha1);
+}
+
+bool MeshmoonAssetReloader::ContentHash(const QString &path, QByteArray &hash, qint64 &size)
+{
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly))
+        return false;
+
+    QCryptographicHash sha1(QCryptographicHash::Sha1);
+    size = 0;
+    while(!file.atEnd())
+    {
+        const QByteArray block = file.read(HashBlockBytes);
+        if (block.isEmpty())
+            break;
+        sha1.addData(block);
+        size += block.size();
+    }
+    hash = sha1.result();
+    return true;
+}
+
+void MeshmoonAssetReloader::SetCoalesceWindow(int windowMsecs, int maxDelayMsecs)
+{
+    windowMsecs_ = qMax(windowMsecs, 0);
+    maxDelayMsecs_ = qMax(maxDelayMsecs, windowMsecs_);
+}
+
+void MeshmoonAssetReloader::SetUserPermissions(const Meshmoon::UserPermissions &permissions)
+{
+    permissions_[permissions.connectionId] = permissions.level;
+    checkPermissions_ = true;
+}
+
+bool MeshmoonAssetReloader::RequestReload(const AssetReloadEntryList &assets)
+{
+    if (assets.empty())
+        return true;
+
+    TundraLogic::TundraLogicModule *tundraLogic = framework_->Module<TundraLogic::TundraLogicModule>();
+    if (tundraLogic && tundraLogic->IsServer())
+    {
+        Enqueue(assets);
+        return true;
+    }
+
+    TundraLogic::Client *client = Client();
+    kNet::MessageConnection *connection = (client ? client->GetConnection() : 0);
+    if (!connection)
+    {
+        LogError(LC + "RequestReload: Not connected to a server.");
+        return false;
+    }
+
+    std::vector<MsgAssetReload> chunks = MsgAssetReload::Chunks(assets, nextRequestId_++);
+    for(size_t i = 0; i < chunks.size(); ++i)
+        connection->Send(chunks[i]);
+    return true;
+}
+
+void MeshmoonAssetReloader::Enqueue(const AssetReloadEntryList &assets)
+{
+    ++stats_.requests;
+    for(size_t i = 0; i < assets.size(); ++i)
+    {
+        const AssetReloadEntry &asset = assets[i];
+        if (asset.assetRef.trimmed().isEmpty())
+            continue;
+        if (pending_.contains(asset.assetRef))
+            ++stats_.coalesced;
+        // Latest upload wins.
+        pending_[asset.assetRef] = asset;
+    }
+    if (pending_.isEmpty())
+        return;
+
+    // Each request extends the window, up to the max delay from the first pending request.
+    if (!flushTimer_.isActive())
+        pendingTimer_.Start();
+    const int elapsed = (int)pendingTimer_.MSecsElapsed();
+    flushTimer_.start(qBound(0, maxDelayMsecs_ - elapsed, windowMsecs_));
+}
+
+void MeshmoonAssetReloader::FlushPending()
+{
+    if (pending_.isEmpty())
+        return;
+
+    AssetReloadEntryList assets;
+    assets.reserve(pending_.size());
+    foreach(const AssetReloadEntry &asset, pending_)
+        assets.push_back(asset);
+    pending_.clear();
+
+    const u32 batchId = nextBatchId_++;
+    std::vector<MsgAssetReload> chunks = MsgAssetReload::Chunks(assets, batchId);
+    ++stats_.batches;
+
+    int numClients = 0;
+    TundraLogic::Server *server = Server();
+    UserConnectionList clients = (server ? server->AuthenticatedUsers() : UserConnectionList());
+    for(UserConnectionList::const_iterator iter = clients.begin(); iter != clients.end(); ++iter)
+    {
+        UserConnectionPtr client = (*iter);
+        if (!client.get() || client->ConnectionType() != "knet")
+            continue;
+        for(size_t i = 0; i < chunks.size(); ++i)
+            client->Send(chunks[i]);
+        stats_.chunks += (uint)chunks.size();
+        ++numClients;
+    }
+    LogInfo(LC + QString("Sending reload batch %1 with %2 assets in %3 chunks to %4 clients")
+        .arg(batchId).arg(assets.size()).arg(chunks.size()).arg(numClients));
+
+    // Reload the servers own copies, eg. scripts that only run on the server.
+    for(size_t i = 0; i < chunks.size(); ++i)
+        Apply(chunks[i], false);
+}
+
+void MeshmoonAssetReloader::OnServerMessageReceived(UserConnection *connection, kNet::packet_id_t, kNet::message_id_t id, const char *data, size_t numBytes)
+{
+    if (id == MsgAssetReload::messageID && connection)
+    {
+        MsgAssetReload msg(data, numBytes);
+
+        // Reloading makes the server and every client refetch the assets, including server scripts.
+        const Meshmoon::PermissionLevel level = permissions_.value(connection->ConnectionId(), Meshmoon::Basic);
+        if (checkPermissions_ && level < Meshmoon::Elevated)
+        {
+            // Every chunk is rejected, the request is denied once.
+            if (msg.chunkIndex == 0)
+            {
+                ++stats_.denied;
+                LogWarning(LC + QString("Rejecting asset reload request %1 from client %2 with permission level %3")
+                    .arg(msg.batchId).arg(connection->ConnectionId()).arg(Meshmoon::PermissionLevelToString(level)));
+                MsgAssetReloadDenied denied;
+                denied.requestId = msg.batchId;
+                connection->Send(denied);
+            }
+            return;
+        }
+        Enqueue(msg.assets);
+    }
+    else if (id == MsgAssetReloadReport::messageID && connection)
+    {
+        MsgAssetReloadReport report(data, numBytes);
+        ClientCost &cost = clientCosts_[connection->ConnectionId()];
+        Accumulate(cost, report);
+        LogDebug(LC + QString("Client %1 reloaded batch %2: %3 reloaded, %4 unchanged, %5 not loaded, %6 failed, %7 in %8 msecs")
+            .arg(connection->ConnectionId()).arg(report.batchId).arg(report.reloaded).arg(report.unchanged).arg(report.notLoaded)
+            .arg(report.failed).arg(QString::fromStdString(kNet::FormatBytes((u64)report.bytes))).arg(report.msecs));
+    }
+}
+
+void MeshmoonAssetReloader::OnClientMessageReceived(kNet::packet_id_t, kNet::message_id_t id, const char *data, size_t numBytes)
+{
+    if (id == MsgAssetReload::messageID)
+    {
+        MsgAssetReload msg(data, numBytes);
+        Apply(msg, true);
+    }
+    else if (id == MsgAssetReloadDenied::messageID)
+    {
+        MsgAssetReloadDenied msg(data, numBytes);
+        if (msg.requestId != 0 && msg.requestId < nextRequestId_)
+            LogError(LC + QString("Server rejected asset reload request %1, permission level Elevated is required.").arg(msg.requestId));
+    }
+}
+
+void MeshmoonAssetReloader::OnUserDisconnected(u32 connectionId, UserConnection * /*connection*/)
+{
+    clientCosts_.remove(connectionId);
+    permissions_.remove(connectionId);
+}
+
+void MeshmoonAssetReloader::OnClientDisconnected()
+{
+    // Transfers may still finish, unknown ones are ignored.
+    nextRequestId_ = 1;
+    transfers_.clear();
+    batches_.clear();
+}
+
+bool MeshmoonAssetReloader::Matches(const AssetReloadEntry &asset, const QString &path) const
+{
+    if (asset.hash.isEmpty() || path.isEmpty())
+        return false;
+    // Size mismatch is known without reading the file.
+    if (asset.size > 0 && QFileInfo(path).size() != (qint64)asset.size)
+        return false;
+
+    QByteArray hash;
+    qint64 size = 0;
+    if (!ContentHash(path, hash, size))
+        return false;
+    return (hash == asset.hash);
+}
+
+void MeshmoonAssetReloader::Apply(const MsgAssetReload &chunk, bool sendReport)
+{
+    Batch &batch = batches_[chunk.batchId];
+    if (batch.chunksReceived == 0)
+    {
+        batch.timer.Start();
+        batch.report.batchId = chunk.batchId;
+        batch.chunkCount = qMax<u16>(chunk.chunkCount, 1);
+        batch.sendReport = sendReport;
+    }
+    batch.chunksReceived++;
+
+    AssetAPI *assetAPI = framework_->Asset();
+    AssetCache *cache = assetAPI->Cache();
+    for(size_t i = 0; i < chunk.assets.size(); ++i)
+    {
+        const AssetReloadEntry &entry = chunk.assets[i];
+        AssetPtr asset = assetAPI->GetAsset(entry.assetRef);
+        if (!asset.get())
+        {
+            // Not in use here. If requested later the asset is fetched from the source.
+            batch.report.notLoaded++;
+            continue;
+        }
+
+        // Cached copy is what was last downloaded. Live edited assets compare the same way, reloading would discard the edits.
+        QString path = (cache ? cache->FindInCache(asset->Name()) : "");
+        if (path.isEmpty())
+            path = asset->DiskSource();
+        if (Matches(entry, path))
+        {
+            batch.report.unchanged++;
+            continue;
+        }
+
+        AssetTransferPtr transfer = assetAPI->RequestAsset(asset->Name(), asset->Type(), true);
+        if (!transfer.get())
+        {
+            LogWarning(LC + "Failed to request reload of " + asset->Name());
+            batch.report.failed++;
+            continue;
+        }
+
+        QList<u32> &waiting = transfers_[transfer.get()];
+        if (waiting.isEmpty())
+        {
+            connect(transfer.get(), SIGNAL(Downloaded(IAssetTransfer*)), this, SLOT(OnTransferDownloaded(IAssetTransfer*)), Qt::UniqueConnection);
+            connect(transfer.get(), SIGNAL(Succeeded(AssetPtr)), this, SLOT(OnTransferSucceeded(AssetPtr)), Qt::UniqueConnection);
+            connect(transfer.get(), SIGNAL(Failed(IAssetTransfer*, QString)), this, SLOT(OnTransferFailed(IAssetTransfer*, QString)), Qt::UniqueConnection);
+        }
+        waiting << chunk.batchId;
+        batch.pending++;
+    }
+
+    CompleteIfDone(chunk.batchId);
+}
+
+void MeshmoonAssetReloader::OnTransferDownloaded(IAssetTransfer *transfer)
+{
+    QHash<IAssetTransfer*, QList<u32> >::const_iterator iter = transfers_.find(transfer);
+    if (iter == transfers_.end())
+        return;
+    // Shared transfer is counted for the first batch only.
+    QHash<u32, Batch>::iterator batch = batches_.find(iter.value().first());
+    if (batch != batches_.end())
+        batch.value().report.bytes += (u32)transfer->rawAssetData.size();
+}
+
+void MeshmoonAssetReloader::OnTransferSucceeded(AssetPtr /*asset*/)
+{
+    TransferFinished(dynamic_cast<IAssetTransfer*>(sender()), true);
+}
+
+void MeshmoonAssetReloader::OnTransferFailed(IAssetTransfer *transfer, QString reason)
+{
+    LogWarning(LC + "Asset reload failed: " + reason);
+    TransferFinished(transfer, false);
+}
+
+void MeshmoonAssetReloader::TransferFinished(IAssetTransfer *transfer, bool succeeded)
+{
+    QHash<IAssetTransfer*, QList<u32> >::iterator iter = transfers_.find(transfer);
+    if (iter == transfers_.end())
+        return;
+    const QList<u32> batchIds = iter.value();
+    transfers_.erase(iter);
+    disconnect(transfer, 0, this, 0);
+
+    foreach(u32 batchId, batchIds)
+    {
+        QHash<u32, Batch>::iterator batch = batches_.find(batchId);
+        if (batch == batches_.end())
+            continue;
+        batch.value().pending--;
+        if (succeeded)
+            batch.value().report.reloaded++;
+        else
+            batch.value().report.failed++;
+        CompleteIfDone(batchId);
+    }
+}
+
+void MeshmoonAssetReloader::CompleteIfDone(u32 batchId)
+{
+    QHash<u32, Batch>::iterator iter = batches_.find(batchId);
+    if (iter == batches_.end())
+        return;
+    Batch &batch = iter.value();
+    if (batch.pending > 0 || batch.chunksReceived < batch.chunkCount)
+        return;
+
+    batch.report.msecs = (u32)batch.timer.MSecsElapsed();
+    Accumulate(localCost_, batch.report);
+    if (batch.sendReport)
+    {
+        TundraLogic::Client *client = Client();
+        kNet::MessageConnection *connection = (client ? client->GetConnection() : 0);
+        if (connection)
+            connection->Send(batch.report);
+    }
+    LogInfo(LC + QString("Reload batch %1 done in %2 msecs: %3 reloaded (%4), %5 unchanged, %6 not loaded, %7 failed")
+        .arg(batchId).arg(batch.report.msecs).arg(batch.report.reloaded).arg(QString::fromStdString(kNet::FormatBytes((u64)batch.report.bytes)))
+        .arg(batch.report.unchanged).arg(batch.report.notLoaded).arg(batch.report.failed));
+    batches_.erase(iter);
+}
+
+void MeshmoonAssetReloader::Accumulate(ClientCost &cost, const MsgAssetReloadReport &report)
+{
+    cost.batches++;
+    cost.reloaded += report.reloaded;
+    cost.unchanged += report.unchanged;
+    cost.notLoaded += report.notLoaded;
+    cost.failed += report.failed;
+    cost.bytes += report.bytes;
+    cost.lastMsecs = report.msecs;
+    cost.totalMsecs += report.msecs;
+    cost.maxMsecs = qMax(cost.maxMsecs, (uint)report.msecs);
+}
+
+QVariantMap MeshmoonAssetReloader::ClientMetrics(u32 connectionId) const
+{
+    QVariantMap metrics;
+    QHash<u32, ClientCost>::const_iterator iter = clientCosts_.find(connectionId);
+    if (iter == clientCosts_.end())
+        return metrics;
+
+    const ClientCost &cost = iter.value();
+    metrics["batches"] = cost.batches;
+    metrics["reloaded"] = cost.reloaded;
+    metrics["unchanged"] = cost.unchanged;
+    metrics["notLoaded"] = cost.notLoaded;
+    metrics["failed"] = cost.failed;
+    metrics["bytes"] = (qulonglong)cost.bytes;
+    metrics["lastMsecs"] = cost.lastMsecs;
+    metrics["averageMsecs"] = (cost.batches > 0 ? (double)cost.totalMsecs / cost.batches : 0.0);
+    metrics["maxMsecs"] = cost.maxMsecs;
+    return metrics;
+}
+
+void MeshmoonAssetReloader::ReloadAssets(const QString &assetRefs)
+{
+    ReloadAssets(assetRefs, "1");
+}
+
+void MeshmoonAssetReloader::ReloadAssets(const QString &assetRefs, const QString &repeat)
+{
+    AssetAPI *assetAPI = framework_->Asset();
+    AssetReloadEntryList assets;
+    foreach(const QString &ref, assetRefs.split(";", QString::SkipEmptyParts))
+    {
+        AssetReloadEntry entry(assetAPI->ResolveAssetRef("", ref.trimmed()));
+        const QString path = (assetAPI->Cache() ? assetAPI->Cache()->FindInCache(entry.assetRef) : "");
+        qint64 size = 0;
+        if (!path.isEmpty() && ContentHash(path, entry.hash, size))
+            entry.size = (u32)size;
+        assets.push_back(entry);
+    }
+    if (assets.empty())
+    {
+        LogError(LC + "reloadAssets: No asset refs given.");
+        return;
+    }
+
+    const int count = qMax(repeat.trimmed().toInt(), 1);
+    for(int i = 0; i < count; ++i)
+        if (!RequestReload(assets))
+            return;
+    LogInfo(LC + QString("Requested reload of %1 assets %2 times").arg(assets.size()).arg(count));
+}
+
+void MeshmoonAssetReloader::PrintReloadStats()
+{
+    TundraLogic::TundraLogicModule *tundraLogic = framework_->Module<TundraLogic::TundraLogicModule>();
+    if (tundraLogic && tundraLogic->IsServer())
+    {
+        LogInfo(LC + QString("Requests %1, denied %2, coalesced assets %3, batches %4, chunks sent %5, pending %6")
+            .arg(stats_.requests).arg(stats_.denied).arg(stats_.coalesced).arg(stats_.batches).arg(stats_.chunks).arg(pending_.size()));
+        for(QHash<u32, ClientCost>::const_iterator iter = clientCosts_.begin(); iter != clientCosts_.end(); ++iter)
+        {
+            const ClientCost &cost = iter.value();
+            LogInfo(QString("    Client %1: %2 batches, %3 reloaded (%4), %5 unchanged, %6 not loaded, %7 failed, avg %8 msecs, max %9 msecs")
+                .arg(iter.key()).arg(cost.batches).arg(cost.reloaded).arg(QString::fromStdString(kNet::FormatBytes(cost.bytes)))
+                .arg(cost.unchanged).arg(cost.notLoaded).arg(cost.failed)
+                .arg(cost.batches > 0 ? (double)cost.totalMsecs / cost.batches : 0.0, 0, 'f', 1).arg(cost.maxMsecs));
+        }
+    }
+
+    const ClientCost &cost = localCost_;
+    LogInfo(LC + QString("Local: %1 batches, %2 reloaded (%3), %4 unchanged, %5 not loaded, %6 failed, avg %7 msecs, max %8 msecs")
+        .arg(cost.batches).arg(cost.reloaded).arg(QString::fromStdString(kNet::FormatBytes(cost.bytes)))
+        .arg(cost.unchanged).arg(cost.notLoaded).arg(cost.failed)
+        .arg(cost.batches > 0 ? (double)cost.totalMsecs / cost.batches : 0.0, 0, 'f', 1).arg(cost.maxMsecs));
+}
+
+/// @endcond
@@ -0,0 +1,175 @@
+/**
+    @author Adminotech Ltd.
+
+    Copyright Adminotech Ltd.
+    All rights reserved.
+
+    @file
+    @brief   */
+
+#pragma once
+
+#include "MeshmoonCommonPluginApi.h"
+
+#include "FrameworkFwd.h"
+#include "AssetFwd.h"
+#include "TundraProtocolModuleFwd.h"
+#include "CoreTypes.h"
+
+#include "common/MeshmoonCommon.h"
+
+#include <QObject>
+#include <QHash>
+#include <QMap>
+#include <QList>
+#include <QTimer>
+#include <QVariantMap>
+
+#include <kNet/PolledTimer.h>
+
+/// @cond PRIVATE
+
+/// Reloads changed assets on the server and all clients.
+/** A client requests a reload with MsgAssetReload. The server coalesces requests arriving within
+    a short window into one batch, reloads its own copies and sends the batch in chunks to all clients.
+    Assets carry the SHA-1 and size of their new content: a server or client skips the ones its cached
+    copy already matches and the ones it has not loaded. Clients report the cost of each batch back
+    to the server with MsgAssetReloadReport. */
+class MESHMOON_COMMON_API MeshmoonAssetReloader : public QObject
+{
+Q_OBJECT
+
+public:
+    explicit MeshmoonAssetReloader(Framework *framework);
+    ~MeshmoonAssetReloader();
+
+    /// Returns SHA-1 of @c data.
+    static QByteArray ContentHash(const QByteArray &data);
+
+    /// Calculates SHA-1 and size of file @c path.
+    /** @return False if the file cannot be read. */
+    static bool ContentHash(const QString &path, QByteArray &hash, qint64 &size);
+
+    /// Requests @c assets to be reloaded on the server and all clients.
+    /** On a server the assets are queued directly. Assets without a hash are always reloaded.
+        @return False if not connected to a server. */
+    bool RequestReload(const Meshmoon::Network::AssetReloadEntryList &assets);
+
+    /// Sets the server coalescing window in milliseconds. Requests arriving within it are sent as one batch,
+    /// but no request is delayed more than @c maxDelayMsecs.
+    void SetCoalesceWindow(int windowMsecs, int maxDelayMsecs);
+
+    /// Sets the permission level of a connected user. Server only.
+    /** Called by the server side authentication. Once a level has been set for any user, reload requests from
+        clients below Meshmoon::Elevated are rejected with MsgAssetReloadDenied. Until then every client may request
+        reloads, the in-tree server has no authentication that would set levels. Forgotten when the user disconnects. */
+    void SetUserPermissions(const Meshmoon::UserPermissions &permissions);
+
+    /// Returns reload cost reported by client @c connectionId. Server only.
+    /** Keys: batches, reloaded, unchanged, notLoaded, failed, bytes, lastMsecs, averageMsecs, maxMsecs. */
+    QVariantMap ClientMetrics(u32 connectionId) const;
+
+public slots:
+    /// Requests reload of ';' separated @c assetRefs, hashed from the local cached copies.
+    /** Sends the request @c repeat times in a row to exercise the server side coalescing. */
+    void ReloadAssets(const QString &assetRefs, const QString &repeat);
+    void ReloadAssets(const QString &assetRefs);
+
+    /// Prints reload statistics, on the server per client.
+    void PrintReloadStats();
+
+private slots:
+    void OnServerMessageReceived(UserConnection *connection, kNet::packet_id_t, kNet::message_id_t id, const char *data, size_t numBytes);
+    void OnClientMessageReceived(kNet::packet_id_t, kNet::message_id_t id, const char *data, size_t numBytes);
+    void OnUserDisconnected(u32 connectionId, UserConnection *connection);
+    void OnClientDisconnected();
+
+    void FlushPending();
+
+    void OnTransferDownloaded(IAssetTransfer *transfer);
+    void OnTransferSucceeded(AssetPtr asset);
+    void OnTransferFailed(IAssetTransfer *transfer, QString reason);
+
+private:
+    /// Reload batch being applied locally.
+    struct Batch
+    {
+        u16 chunksReceived;
+        u16 chunkCount;
+        int pending;            ///< Reloads that have not finished yet.
+        bool sendReport;        ///< Report is sent to the server when done.
+        Meshmoon::Network::MsgAssetReloadReport report;
+        kNet::PolledTimer timer;
+
+        Batch() : chunksReceived(0), chunkCount(1), pending(0), sendReport(false) {}
+    };
+
+    /// Reload cost reported by a client.
+    struct ClientCost
+    {
+        uint batches;
+        uint reloaded;
+        uint unchanged;
+        uint notLoaded;
+        uint failed;
+        u64 bytes;
+        uint lastMsecs;
+        u64 totalMsecs;
+        uint maxMsecs;
+
+        ClientCost();
+    };
+
+    struct Stats
+    {
+        uint requests;          ///< Reload requests received by the server.
+        uint denied;            ///< Reload requests rejected for missing permissions.
+        uint coalesced;         ///< Requested assets that were already pending.
+        uint batches;           ///< Batches sent by the server.
+        uint chunks;            ///< Chunks sent by the server, per client.
+
+        Stats() : requests(0), denied(0), coalesced(0), batches(0), chunks(0) {}
+    };
+
+    void Enqueue(const Meshmoon::Network::AssetReloadEntryList &assets);
+
+    /// Reloads the assets of @c chunk that do not match their content hash.
+    void Apply(const Meshmoon::Network::MsgAssetReload &chunk, bool sendReport);
+
+    /// Returns true if the file at @c path has the content of @c asset.
+    bool Matches(const Meshmoon::Network::AssetReloadEntry &asset, const QString &path) const;
+
+    /// Sends or logs the report of batch @c batchId if all of its chunks have been received and reloaded.
+    void CompleteIfDone(u32 batchId);
+
+    /// Adds @c report to @c cost.
+    static void Accumulate(ClientCost &cost, const Meshmoon::Network::MsgAssetReloadReport &report);
+
+    void TransferFinished(IAssetTransfer *transfer, bool succeeded);
+
+    TundraLogic::Server *Server() const;
+    TundraLogic::Client *Client() const;
+
+    Framework *framework_;
+    QString LC;
+
+    // Server state.
+    QMap<QString, Meshmoon::Network::AssetReloadEntry> pending_;
+    QTimer flushTimer_;
+    kNet::PolledTimer pendingTimer_;
+    int windowMsecs_;
+    int maxDelayMsecs_;
+    u32 nextBatchId_;
+    QHash<u32, ClientCost> clientCosts_;
+    QHash<u32, Meshmoon::PermissionLevel> permissions_;
+    bool checkPermissions_;     ///< Server side authentication has set permission levels.
+    Stats stats_;
+
+    // Local reload state.
+    QHash<u32, Batch> batches_;
+    QHash<IAssetTransfer*, QList<u32> > transfers_;
+    u32 nextRequestId_;         ///< Id of the next reload request sent to the server, ids below it may be denied.
+    ClientCost localCost_;
+};
+
+/// @endcond
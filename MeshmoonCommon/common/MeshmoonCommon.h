@@ -11,6 +11,7 @@
 
 #include "MeshmoonCommonPluginApi.h"
 
+#include "CoreTypes.h"
 #include "SceneFwd.h"
 #include "kNetFwd.h"
 #include "CoreStringUtils.h"
@@ -26,6 +27,7 @@
 #include <QPair>
 #include <QColor>
 #include <QUrl>
+#include <QVariantMap>
 
 #include <kNet/DataDeserializer.h>
 #include <kNet/DataSerializer.h>
@@ -172,6 +174,28 @@ namespace Meshmoon
     
     /// @endcond
 
+    /// Meshmoon scene layer load statistics.
+    struct MESHMOON_COMMON_API SceneLayerStats
+    {
+        uint rawBytes;          ///< Size of the raw txml data when it was last loaded.
+        uint cachedBytes;       ///< Size of the compressed txml kept in memory while streaming.
+        uint entities;          ///< Number of entities created on the last load.
+
+        uint loads;             ///< How many times the layer has been loaded.
+        uint unloads;           ///< How many times the layer has been unloaded.
+        uint fetches;           ///< How many times the layer txml has been re-fetched.
+
+        float lastLoadMsecs;    ///< Time spent on the last load.
+        float lastUnloadMsecs;  ///< Time spent on the last unload.
+        float lastFetchMsecs;   ///< Time spent waiting for the last re-fetch.
+        float totalLoadMsecs;   ///< Time spent on all loads.
+
+        SceneLayerStats();
+
+        void Reset();
+        QVariantMap ToVariantMap() const;
+    };
+
     /// Meshmoon scene layer
     struct MESHMOON_COMMON_API SceneLayer
     {
@@ -183,12 +207,16 @@ namespace Meshmoon
 
         QUrl txmlUrl;
         QByteArray sceneData;
+        QByteArray sceneDataCache; ///< Compressed scene data, kept when sceneData is released after a streamed load.
         float3 centerPosition;
+        float loadRadius;    ///< Streaming load radius around centerPosition. 0 means the layer is always loaded.
 
         bool downloaded;
         bool loaded;
 
-        QList<EntityWeakPtr> entities;
+        std::vector<entity_id_t> entityIds; ///< Ids of the entities created from this layer.
+
+        SceneLayerStats stats;
 
         SceneLayer();
         SceneLayer(uint _id, bool _visible, const QString &_name, const QString &_icon);
@@ -218,6 +246,7 @@ namespace Meshmoon
         Q_PROPERTY(bool visible READ IsVisible)
         Q_PROPERTY(bool defaultVisible READ IsDefaultVisible)
         Q_PROPERTY(float3 position READ Position)
+        Q_PROPERTY(float loadRadius READ LoadRadius)
 
     public:
         Layer();
@@ -226,6 +255,7 @@ namespace Meshmoon
         void Set(u32 id, const QString &name, const QString &iconUrl, const QString &url, bool defaultVisible, float3 position = float3::zero);
         void SetId(u32 id);
         void SetPosition(float3 position);
+        void SetLoadRadius(float radius);
         void SetSceneData(const QByteArray &data);
         
         Meshmoon::SceneLayer ToSceneLayer(u32 id) const;
@@ -244,6 +274,7 @@ namespace Meshmoon
         bool IsVisible() const;
         bool IsDefaultVisible() const;
         float3 Position() const;
+        float LoadRadius() const;
         
         bool IsValid() const;
         QString toString() const;
@@ -259,6 +290,7 @@ namespace Meshmoon
         bool visible_;
         bool defaultVisible_;
         float3 position_;
+        float loadRadius_;
         
         bool sceneLoaded_;
         QByteArray sceneData_;
@@ -332,7 +364,28 @@ namespace Meshmoon
         static const bool defaultInOrder = true;
         static const u32 defaultPriority = 100;
 
-        /// Network message informing that a asset ref should be reloaded from source.
+        /// Asset that should be reloaded from source, with the content hash and size of the new source data.
+        struct MESHMOON_COMMON_API AssetReloadEntry
+        {
+            QString assetRef;
+            u32 size;           ///< Size of the new content in bytes, 0 if not known.
+            QByteArray hash;    ///< SHA-1 of the new content, empty if not known and the asset is always reloaded.
+
+            AssetReloadEntry() : size(0) {}
+            AssetReloadEntry(const QString &assetRef_, const QByteArray &hash_ = QByteArray(), u32 size_ = 0) :
+                assetRef(assetRef_), size(size_), hash(hash_) {}
+
+            inline size_t Size() const
+            {
+                // 2 bytes u16 string length + N bytes UTF8, 4 bytes u32 size, 1 byte u8 hash length + N bytes hash
+                return 2 + assetRef.toUtf8().size() + 4 + 1 + qMin(hash.size(), 255);
+            }
+        };
+        typedef std::vector<AssetReloadEntry> AssetReloadEntryList;
+
+        /// Network message informing that asset refs should be reloaded from source.
+        /** Sent by a client to the server, which coalesces the requests and sends them to all clients.
+            Large ref sets are split into chunks of the same batch, each chunk can be processed on its own. */
         struct MESHMOON_COMMON_API MsgAssetReload
         {
             MsgAssetReload();
@@ -343,35 +396,64 @@ namespace Meshmoon
             enum { messageID = 400 };
             static inline const char * const Name() { return "AdminoAssetReload"; }
 
+            /// Maximum serialized size of a chunk.
+            static const size_t cMaxChunkBytes = 16 * 1024;
+
             bool reliable;
             bool inOrder;
             u32 priority;
 
-            std::vector<QString> assetReferences;
+            u32 batchId;        ///< Server assigned batch id. In client requests a client assigned request id, echoed back in MsgAssetReloadDenied.
+            u16 chunkIndex;
+            u16 chunkCount;
+            AssetReloadEntryList assets;
 
             inline size_t Size() const
             {
-                size_t stringLen = 0;
-                // 2 bytes u16 string length + N bytes UTF8 QByteArray size
-                for(size_t i = 0; i < assetReferences.size(); ++i)
-                    stringLen += 2 + assetReferences[i].toUtf8().size()*1;
-                // 1 byte u8 vector size + combined string size (with 1 byte as separators)
-                return 1 + stringLen;
+                // 4 bytes u32 batch id, 2 + 2 bytes u16 chunk index and count, 2 bytes u16 vector size
+                size_t size = 4 + 2 + 2 + 2;
+                for(size_t i = 0; i < assets.size(); ++i)
+                    size += assets[i].Size();
+                return size;
             }
 
             inline void SerializeTo(kNet::DataSerializer &dst) const
             {
-                dst.Add<u8>((u8)assetReferences.size());
-                for(size_t i = 0; i < assetReferences.size(); ++i)
-                    WriteUtf8String(dst, assetReferences[i]);
+                dst.Add<u32>(batchId);
+                dst.Add<u16>(chunkIndex);
+                dst.Add<u16>(chunkCount);
+                dst.Add<u16>((u16)assets.size());
+                for(size_t i = 0; i < assets.size(); ++i)
+                {
+                    const AssetReloadEntry &asset = assets[i];
+                    WriteUtf8String(dst, asset.assetRef);
+                    dst.Add<u32>(asset.size);
+                    const u8 hashLength = (u8)qMin(asset.hash.size(), 255);
+                    dst.Add<u8>(hashLength);
+                    if (hashLength > 0)
+                        dst.AddArray<u8>((const u8*)asset.hash.constData(), hashLength);
+                }
             }
 
             inline void DeserializeFrom(kNet::DataDeserializer &src)
             {
-                assetReferences.resize(src.Read<u8>());
-                for(size_t i = 0; i < assetReferences.size(); ++i)
-                    assetReferences[i] = ReadUtf8String(src);
+                batchId = src.Read<u32>();
+                chunkIndex = src.Read<u16>();
+                chunkCount = src.Read<u16>();
+                assets.resize(src.Read<u16>());
+                for(size_t i = 0; i < assets.size(); ++i)
+                {
+                    AssetReloadEntry &asset = assets[i];
+                    asset.assetRef = ReadUtf8String(src);
+                    asset.size = src.Read<u32>();
+                    asset.hash.resize(src.Read<u8>());
+                    if (!asset.hash.isEmpty())
+                        src.ReadArray<u8>((u8*)asset.hash.data(), asset.hash.size());
+                }
             }
+
+            /// Splits @c assets into messages of at most cMaxChunkBytes.
+            static std::vector<MsgAssetReload> Chunks(const AssetReloadEntryList &assets, u32 batchId);
         };
 
         /// Network message informing about user permissions.
@@ -489,6 +571,90 @@ namespace Meshmoon
             {
             }
         };
+
+        /// Network message reporting the cost of a reload batch from a client to the server.
+        struct MESHMOON_COMMON_API MsgAssetReloadReport
+        {
+            MsgAssetReloadReport();
+            MsgAssetReloadReport(const char *data, size_t numBytes);
+
+            void InitToDefault();
+
+            enum { messageID = 405 };
+            static inline const char * const Name() { return "AdminoAssetReloadReport"; }
+
+            bool reliable;
+            bool inOrder;
+            u32 priority;
+
+            u32 batchId;
+            u16 reloaded;       ///< Assets that were downloaded and reloaded.
+            u16 unchanged;      ///< Assets skipped because the local copy matched the content hash.
+            u16 notLoaded;      ///< Assets skipped because they were not loaded.
+            u16 failed;         ///< Reloads that failed.
+            u32 bytes;          ///< Downloaded bytes.
+            u32 msecs;          ///< Time from receiving the first chunk to the last reload finishing.
+
+            inline size_t Size() const
+            {
+                return 4 + 2 + 2 + 2 + 2 + 4 + 4;
+            }
+
+            inline void SerializeTo(kNet::DataSerializer &dst) const
+            {
+                dst.Add<u32>(batchId);
+                dst.Add<u16>(reloaded);
+                dst.Add<u16>(unchanged);
+                dst.Add<u16>(notLoaded);
+                dst.Add<u16>(failed);
+                dst.Add<u32>(bytes);
+                dst.Add<u32>(msecs);
+            }
+
+            inline void DeserializeFrom(kNet::DataDeserializer &src)
+            {
+                batchId = src.Read<u32>();
+                reloaded = src.Read<u16>();
+                unchanged = src.Read<u16>();
+                notLoaded = src.Read<u16>();
+                failed = src.Read<u16>();
+                bytes = src.Read<u32>();
+                msecs = src.Read<u32>();
+            }
+        };
+
+        /// Network message rejecting a client's MsgAssetReload request for missing permissions.
+        struct MESHMOON_COMMON_API MsgAssetReloadDenied
+        {
+            MsgAssetReloadDenied();
+            MsgAssetReloadDenied(const char *data, size_t numBytes);
+
+            void InitToDefault();
+
+            enum { messageID = 406 };
+            static inline const char * const Name() { return "AdminoAssetReloadDenied"; }
+
+            bool reliable;
+            bool inOrder;
+            u32 priority;
+
+            u32 requestId;      ///< MsgAssetReload::batchId of the rejected request.
+
+            inline size_t Size() const
+            {
+                return 4;
+            }
+
+            inline void SerializeTo(kNet::DataSerializer &dst) const
+            {
+                dst.Add<u32>(requestId);
+            }
+
+            inline void DeserializeFrom(kNet::DataDeserializer &src)
+            {
+                requestId = src.Read<u32>();
+            }
+        };
     }
 
     /// @endcond
@@ -5,8 +5,44 @@
 
 namespace Meshmoon
 {
+    SceneLayerStats::SceneLayerStats()
+    {
+        Reset();
+    }
+
+    void SceneLayerStats::Reset()
+    {
+        rawBytes = 0;
+        cachedBytes = 0;
+        entities = 0;
+        loads = 0;
+        unloads = 0;
+        fetches = 0;
+        lastLoadMsecs = 0.f;
+        lastUnloadMsecs = 0.f;
+        lastFetchMsecs = 0.f;
+        totalLoadMsecs = 0.f;
+    }
+
+    QVariantMap SceneLayerStats::ToVariantMap() const
+    {
+        QVariantMap map;
+        map["rawBytes"] = rawBytes;
+        map["cachedBytes"] = cachedBytes;
+        map["entities"] = entities;
+        map["loads"] = loads;
+        map["unloads"] = unloads;
+        map["fetches"] = fetches;
+        map["lastLoadMsecs"] = lastLoadMsecs;
+        map["lastUnloadMsecs"] = lastUnloadMsecs;
+        map["lastFetchMsecs"] = lastFetchMsecs;
+        map["totalLoadMsecs"] = totalLoadMsecs;
+        return map;
+    }
+
     SceneLayer::SceneLayer() :
         centerPosition(float3::zero),
+        loadRadius(0.f),
         defaultVisible(false),
         downloaded(false),
         loaded(false),
@@ -17,6 +53,7 @@ namespace Meshmoon
 
     SceneLayer::SceneLayer(uint _id, bool _visible, const QString &_name, const QString &_icon) :
         centerPosition(float3::zero),
+        loadRadius(0.f),
         defaultVisible(false),
         downloaded(false),
         loaded(false),
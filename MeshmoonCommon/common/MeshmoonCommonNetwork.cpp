@@ -34,6 +34,38 @@ namespace Meshmoon
             reliable = defaultReliable;
             inOrder = defaultInOrder;
             priority = defaultPriority;
+            batchId = 0;
+            chunkIndex = 0;
+            chunkCount = 1;
+        }
+
+        std::vector<MsgAssetReload> MsgAssetReload::Chunks(const AssetReloadEntryList &assets, u32 batchId)
+        {
+            std::vector<MsgAssetReload> chunks;
+            MsgAssetReload chunk;
+            chunk.batchId = batchId;
+            size_t chunkBytes = chunk.Size();
+            for(size_t i = 0; i < assets.size(); ++i)
+            {
+                const size_t entryBytes = assets[i].Size();
+                if (!chunk.assets.empty() && (chunkBytes + entryBytes > cMaxChunkBytes || chunk.assets.size() >= 0xFFFF))
+                {
+                    chunks.push_back(chunk);
+                    chunk.assets.clear();
+                    chunkBytes = chunk.Size();
+                }
+                chunk.assets.push_back(assets[i]);
+                chunkBytes += entryBytes;
+            }
+            if (!chunk.assets.empty())
+                chunks.push_back(chunk);
+
+            for(size_t i = 0; i < chunks.size(); ++i)
+            {
+                chunks[i].chunkIndex = (u16)i;
+                chunks[i].chunkCount = (u16)chunks.size();
+            }
+            return chunks;
         }
         
         // MsgUserPermissions
@@ -119,5 +151,55 @@ namespace Meshmoon
             inOrder = defaultInOrder;
             priority = defaultPriority;
         }
+
+        // MsgAssetReloadReport
+
+        MsgAssetReloadReport::MsgAssetReloadReport()
+        {
+            InitToDefault();
+        }
+
+        MsgAssetReloadReport::MsgAssetReloadReport(const char *data, size_t numBytes)
+        {
+            InitToDefault();
+            kNet::DataDeserializer dd(data, numBytes);
+            DeserializeFrom(dd);
+        }
+
+        void MsgAssetReloadReport::InitToDefault()
+        {
+            reliable = defaultReliable;
+            inOrder = defaultInOrder;
+            priority = defaultPriority;
+            batchId = 0;
+            reloaded = 0;
+            unchanged = 0;
+            notLoaded = 0;
+            failed = 0;
+            bytes = 0;
+            msecs = 0;
+        }
+
+        // MsgAssetReloadDenied
+
+        MsgAssetReloadDenied::MsgAssetReloadDenied()
+        {
+            InitToDefault();
+        }
+
+        MsgAssetReloadDenied::MsgAssetReloadDenied(const char *data, size_t numBytes)
+        {
+            InitToDefault();
+            kNet::DataDeserializer dd(data, numBytes);
+            DeserializeFrom(dd);
+        }
+
+        void MsgAssetReloadDenied::InitToDefault()
+        {
+            reliable = defaultReliable;
+            inOrder = defaultInOrder;
+            priority = defaultPriority;
+            requestId = 0;
+        }
     }
 }
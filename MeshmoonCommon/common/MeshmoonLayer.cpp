@@ -18,6 +18,7 @@ namespace Meshmoon
         visible_(false),
         defaultVisible_(false),
         position_(float3::zero),
+        loadRadius_(0.f),
         sceneLoaded_(false)
     {
     }
@@ -48,6 +49,11 @@ namespace Meshmoon
         position_ = position;
     }
     
+    void Layer::SetLoadRadius(float radius)
+    {
+        loadRadius_ = radius;
+    }
+
     void Layer::SetSceneData(const QByteArray &data)
     {
         sceneData_ = data;
@@ -64,6 +70,7 @@ namespace Meshmoon
         l.txmlUrl = PresignedUrl();
         l.sceneData = sceneData_;
         l.centerPosition = Position();
+        l.loadRadius = LoadRadius();
         l.downloaded = true;
         l.loaded = false;
         return l;
@@ -121,6 +128,11 @@ namespace Meshmoon
         return position_;
     }
     
+    float Layer::LoadRadius() const
+    {
+        return loadRadius_;
+    }
+
     bool Layer::IsValid() const
     {
         return (id_ > 0 && !name_.isEmpty());
@@ -248,6 +248,10 @@ namespace Meshmoon
             else
                 LogWarning(LC + "Found layer description without 'Position': " + layer->toString());
 
+            // Optional streaming radius, layers without it are always loaded.
+            if (layerData.contains("LoadRadius"))
+                layer->SetLoadRadius(Max(0.f, layerData.value("LoadRadius").toFloat()));
+
             if (layer->IsValid())
                 layers << layer;
         }
@@ -17,6 +17,7 @@
 #include "IRenderer.h"
 #include "CoreJsonUtils.h"
 #include "UniqueIdGenerator.h"
+#include "Math/MathFunc.h"
 
 #include "SceneAPI.h"
 #include "Scene.h"
@@ -141,6 +142,10 @@ Meshmoon::SceneLayerList MeshmoonLayerProcessor::DeserializeFrom(const QByteArra
             else
                 LogError(LC + "Found layer description without 'Position': " + layer.toString());
 
+            // Optional streaming radius, layers without it are always loaded.
+            if (layerData.contains("LoadRadius"))
+                layer.loadRadius = Max(0.f, layerData.value("LoadRadius").toFloat());
+
             out << layer;
         }
     }
@@ -383,10 +388,11 @@ bool MeshmoonLayerProcessor::LoadSceneLayer(Meshmoon::SceneLayer &layer) const
     const bool adjustPlaceables = !layer.centerPosition.IsZero();
     uint adjustedPositions = 0;
 
-    layer.entities.clear();
+    layer.entityIds.clear();
+    layer.entityIds.reserve(createdEnts.size());
     foreach(Entity *createdEntity, createdEnts)
     {
-        layer.entities << createdEntity->shared_from_this();
+        layer.entityIds.push_back(createdEntity->Id());
         
         // Set layer group and/or desc identifier (don't overwrite existing, app logic might depend on these)
         if (createdEntity->Group().trimmed().isEmpty())
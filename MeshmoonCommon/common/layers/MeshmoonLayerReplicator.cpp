@@ -0,0 +1,293 @@
+/**
+    @author Adminotech Ltd.
+
+    Copyright Adminotech Ltd.
+    All rights reserved.
+
+    @file
+    @brief   */
+
+#include "StableHeaders.h"
+
+#include "MeshmoonLayerReplicator.h"
+
+#include "Framework.h"
+#include "FrameAPI.h"
+#include "LoggingFunctions.h"
+#include "IRenderer.h"
+#include "Scene.h"
+#include "Entity.h"
+#include "IComponent.h"
+#include "EC_Placeable.h"
+#include "Math/MathFunc.h"
+
+#include "TundraLogicModule.h"
+#include "Server.h"
+#include "UserConnection.h"
+#include "SyncState.h"
+
+#include <algorithm>
+
+/// @cond PRIVATE
+
+namespace
+{
+    /// Rough per message overheads used for estimating entity replication cost.
+    const uint EntityCreateOverheadBytes = 16;
+    const uint ComponentOverheadBytes = 8;
+    const uint AttributeEstimateBytes = 12;
+
+    /// Max seconds of unused budget that can accumulate, limits bursts after idle periods.
+    const float MaxBurstSeconds = 0.25f;
+}
+
+MeshmoonLayerReplicator::ConnectionState::ConnectionState() :
+    budget(0.f),
+    replicatedEntities(0),
+    replicatedBytes(0),
+    fullyVisibleLayers(0),
+    lastTimeToVisibleMsecs(0.f),
+    totalTimeToVisibleMsecs(0.f),
+    maxTimeToVisibleMsecs(0.f)
+{
+}
+
+MeshmoonLayerReplicator::MeshmoonLayerReplicator(Framework *framework) :
+    framework_(framework),
+    LC("[MeshmoonLayers]: "),
+    bytesPerSecond_(256 * 1024)
+{
+}
+
+MeshmoonLayerReplicator::~MeshmoonLayerReplicator()
+{
+}
+
+void MeshmoonLayerReplicator::SetBandwidthBudget(uint bytesPerSecond)
+{
+    bytesPerSecond_ = bytesPerSecond;
+}
+
+uint MeshmoonLayerReplicator::BandwidthBudget() const
+{
+    return bytesPerSecond_;
+}
+
+void MeshmoonLayerReplicator::RemoveConnection(u32 connectionId)
+{
+    connections_.remove(connectionId);
+    UpdateConnection();
+}
+
+void MeshmoonLayerReplicator::Clear()
+{
+    connections_.clear();
+    UpdateConnection();
+}
+
+uint MeshmoonLayerReplicator::QueueDepth(u32 connectionId) const
+{
+    QHash<u32, ConnectionState>::const_iterator iter = connections_.find(connectionId);
+    if (iter == connections_.end())
+        return 0;
+
+    uint depth = 0;
+    foreach(const PendingLayer &layer, iter->layers)
+        depth += static_cast<uint>(layer.entities.size());
+    return depth;
+}
+
+uint MeshmoonLayerReplicator::TotalQueueDepth() const
+{
+    uint depth = 0;
+    foreach(u32 connectionId, connections_.keys())
+        depth += QueueDepth(connectionId);
+    return depth;
+}
+
+QVariantMap MeshmoonLayerReplicator::Metrics(u32 connectionId) const
+{
+    QVariantMap metrics;
+    QHash<u32, ConnectionState>::const_iterator iter = connections_.find(connectionId);
+    if (iter == connections_.end())
+        return metrics;
+
+    const ConnectionState &state = iter.value();
+    metrics["queueDepth"] = QueueDepth(connectionId);
+    metrics["pendingLayers"] = state.layers.size();
+    metrics["replicatedEntities"] = state.replicatedEntities;
+    metrics["replicatedBytes"] = state.replicatedBytes;
+    metrics["fullyVisibleLayers"] = state.fullyVisibleLayers;
+    metrics["lastTimeToVisibleMsecs"] = state.lastTimeToVisibleMsecs;
+    metrics["averageTimeToVisibleMsecs"] = (state.fullyVisibleLayers > 0 ? state.totalTimeToVisibleMsecs / state.fullyVisibleLayers : 0.f);
+    metrics["maxTimeToVisibleMsecs"] = state.maxTimeToVisibleMsecs;
+    return metrics;
+}
+
+bool MeshmoonLayerReplicator::Enqueue(UserConnection *connection, const Meshmoon::SceneLayer &layer, bool visible)
+{
+    SceneSyncState *sceneState = (connection ? connection->syncState.get() : 0);
+    if (!sceneState)
+        return false;
+
+    const u32 connectionId = connection->ConnectionId();
+    ConnectionState &state = connections_[connectionId];
+
+    // Cancel any queued show of this layer, the entities not yet marked stay pending.
+    for (int i=0; i<state.layers.size(); ++i)
+    {
+        if (state.layers[i].layerId == layer.id)
+        {
+            state.layers.removeAt(i);
+            break;
+        }
+    }
+
+    Scene *scene = framework_->Renderer() ? framework_->Renderer()->MainCameraScene() : 0;
+    if (!scene)
+        return false;
+
+    if (!visible || bytesPerSecond_ == 0)
+    {
+        for (size_t i=0; i<layer.entityIds.size(); ++i)
+        {
+            const entity_id_t id = layer.entityIds[i];
+            if (!scene->EntityById(id).get())
+                continue;
+            if (visible)
+                sceneState->MarkPendingEntityDirty(id);
+            else
+                sceneState->MarkEntityPending(id);
+        }
+        UpdateConnection();
+        return true;
+    }
+
+    // Prioritize by distance to the clients avatar, if it has one.
+    EntityPtr avatar = scene->EntityByName("Avatar" + QString::number(connectionId));
+    EC_Placeable *avatarPlaceable = (avatar.get() ? avatar->Component<EC_Placeable>().get() : 0);
+    const float3 origin = (avatarPlaceable ? avatarPlaceable->WorldPosition() : layer.centerPosition);
+
+    PendingLayer pending;
+    pending.layerId = layer.id;
+    pending.entities.reserve(layer.entityIds.size());
+    for (size_t i=0; i<layer.entityIds.size(); ++i)
+    {
+        EntityPtr ent = scene->EntityById(layer.entityIds[i]);
+        if (!ent.get())
+            continue;
+        EC_Placeable *placeable = ent->Component<EC_Placeable>().get();
+
+        PendingEntity pe;
+        pe.id = ent->Id();
+        // Entities without a position (scripts, environment etc.) go first.
+        pe.priority = (placeable ? placeable->WorldPosition().DistanceSq(origin) : -1.f);
+        pending.entities.push_back(pe);
+    }
+    std::sort(pending.entities.begin(), pending.entities.end());
+
+    state.layers << pending;
+    UpdateConnection();
+    return true;
+}
+
+uint MeshmoonLayerReplicator::EstimateCost(Entity *entity) const
+{
+    uint bytes = EntityCreateOverheadBytes;
+    const Entity::ComponentMap &components = entity->Components();
+    for (Entity::ComponentMap::const_iterator iter = components.begin(); iter != components.end(); ++iter)
+    {
+        if (!iter->second.get() || !iter->second->IsReplicated())
+            continue;
+        bytes += ComponentOverheadBytes + static_cast<uint>(iter->second->Attributes().size()) * AttributeEstimateBytes;
+    }
+    return bytes;
+}
+
+bool MeshmoonLayerReplicator::Process(u32 connectionId, ConnectionState &state, float frametime)
+{
+    TundraLogicModule *tundraLogic = framework_->Module<TundraLogicModule>();
+    UserConnectionPtr connection = (tundraLogic && tundraLogic->GetServer().get() ? tundraLogic->GetServer()->GetUserConnection(connectionId) : UserConnectionPtr());
+    SceneSyncState *sceneState = (connection.get() ? connection->syncState.get() : 0);
+    if (!sceneState)
+        return false;
+    Scene *scene = framework_->Renderer() ? framework_->Renderer()->MainCameraScene() : 0;
+    if (!scene)
+        return false;
+
+    const float maxBudget = bytesPerSecond_ * MaxBurstSeconds;
+    state.budget = Min(state.budget + bytesPerSecond_ * frametime, maxBudget);
+
+    while(!state.layers.isEmpty() && state.budget > 0.f)
+    {
+        PendingLayer &layer = state.layers.first();
+        while(!layer.entities.empty() && state.budget > 0.f)
+        {
+            const entity_id_t id = layer.entities.back().id;
+            layer.entities.pop_back();
+
+            EntityPtr ent = scene->EntityById(id);
+            if (!ent.get())
+                continue;
+
+            const uint cost = EstimateCost(ent.get());
+            sceneState->MarkPendingEntityDirty(id);
+            state.budget -= cost;
+            state.replicatedEntities++;
+            state.replicatedBytes += cost;
+        }
+        if (layer.entities.empty())
+        {
+            Complete(connectionId, state, layer);
+            state.layers.removeFirst();
+        }
+    }
+    return true;
+}
+
+void MeshmoonLayerReplicator::Complete(u32 connectionId, ConnectionState &state, const PendingLayer &layer)
+{
+    const float msecs = layer.timer.MSecsElapsed();
+    state.fullyVisibleLayers++;
+    state.lastTimeToVisibleMsecs = msecs;
+    state.totalTimeToVisibleMsecs += msecs;
+    state.maxTimeToVisibleMsecs = Max(state.maxTimeToVisibleMsecs, msecs);
+
+    LogDebug(LC + QString("Layer %1 fully visible for connection %2 in %3 msecs").arg(layer.layerId).arg(connectionId).arg(msecs, 0, 'f', 1));
+    emit LayerFullyVisible(connectionId, layer.layerId, msecs);
+}
+
+void MeshmoonLayerReplicator::OnUpdate(float frametime)
+{
+    QList<u32> removed;
+    for (QHash<u32, ConnectionState>::iterator iter = connections_.begin(); iter != connections_.end(); ++iter)
+    {
+        if (iter->layers.isEmpty())
+            continue;
+        if (!Process(iter.key(), iter.value(), frametime))
+            removed << iter.key();
+    }
+    foreach(u32 connectionId, removed)
+        connections_.remove(connectionId);
+
+    UpdateConnection();
+}
+
+void MeshmoonLayerReplicator::UpdateConnection()
+{
+    bool work = false;
+    for (QHash<u32, ConnectionState>::const_iterator iter = connections_.begin(); iter != connections_.end(); ++iter)
+    {
+        if (!iter->layers.isEmpty())
+        {
+            work = true;
+            break;
+        }
+    }
+    if (work)
+        connect(framework_->Frame(), SIGNAL(Updated(float)), this, SLOT(OnUpdate(float)), Qt::UniqueConnection);
+    else
+        disconnect(framework_->Frame(), SIGNAL(Updated(float)), this, SLOT(OnUpdate(float)));
+}
+
+/// @endcond
@@ -0,0 +1,126 @@
+/**
+    @author Adminotech Ltd.
+
+    Copyright Adminotech Ltd.
+    All rights reserved.
+
+    @file
+    @brief   */
+
+#pragma once
+
+#include "MeshmoonCommonPluginApi.h"
+
+#include "FrameworkFwd.h"
+#include "SceneFwd.h"
+#include "TundraProtocolModuleFwd.h"
+#include "CoreTypes.h"
+
+#include "common/MeshmoonCommon.h"
+
+#include <QObject>
+#include <QHash>
+#include <QList>
+#include <QVariantMap>
+
+#include <kNet/PolledTimer.h>
+
+#include <vector>
+
+/// @cond PRIVATE
+
+/// Streams layer entities to clients in prioritized batches.
+/** Showing a layer for a client marks its entities dirty in the clients SceneSyncState
+    nearest first (relative to the clients avatar), limited by a per connection bandwidth budget.
+    Hiding is applied immediately and cancels any queued show of the same layer. */
+class MESHMOON_COMMON_API MeshmoonLayerReplicator : public QObject
+{
+Q_OBJECT
+
+public:
+    explicit MeshmoonLayerReplicator(Framework *framework);
+    ~MeshmoonLayerReplicator();
+
+    /// Queues or applies visibility change of @c layer for @c connection.
+    /** @return False if the connection has no sync state. */
+    bool Enqueue(UserConnection *connection, const Meshmoon::SceneLayer &layer, bool visible);
+
+    /// Sets per connection bandwidth budget in bytes per second. 0 disables rate limiting.
+    void SetBandwidthBudget(uint bytesPerSecond);
+    uint BandwidthBudget() const;
+
+    /// Drops all queued work for @c connectionId.
+    void RemoveConnection(u32 connectionId);
+
+    /// Drops all queued work.
+    void Clear();
+
+    /// Returns number of entities waiting to be replicated to @c connectionId.
+    uint QueueDepth(u32 connectionId) const;
+
+    /// Returns number of entities waiting to be replicated to all connections.
+    uint TotalQueueDepth() const;
+
+    /// Returns replication metrics for @c connectionId.
+    /** Keys: queueDepth, pendingLayers, replicatedEntities, replicatedBytes, fullyVisibleLayers,
+        lastTimeToVisibleMsecs, averageTimeToVisibleMsecs, maxTimeToVisibleMsecs. */
+    QVariantMap Metrics(u32 connectionId) const;
+
+signals:
+    /// Emitted when all entities of a layer have been marked for replication to a client.
+    void LayerFullyVisible(u32 connectionId, u32 layerId, float msecs);
+
+private slots:
+    void OnUpdate(float frametime);
+
+private:
+    struct PendingEntity
+    {
+        entity_id_t id;
+        float priority; ///< Squared distance to the clients avatar, smaller is more important.
+
+        bool operator < (const PendingEntity &other) const { return priority > other.priority; } ///< Farthest first, so the nearest can be popped from the back.
+    };
+
+    struct PendingLayer
+    {
+        u32 layerId;
+        std::vector<PendingEntity> entities;
+        kNet::PolledTimer timer;
+    };
+
+    struct ConnectionState
+    {
+        QList<PendingLayer> layers;
+        float budget;
+
+        uint replicatedEntities;
+        uint replicatedBytes;
+        uint fullyVisibleLayers;
+        float lastTimeToVisibleMsecs;
+        float totalTimeToVisibleMsecs;
+        float maxTimeToVisibleMsecs;
+
+        ConnectionState();
+    };
+
+    /// Returns estimated replication cost of @c entity in bytes.
+    uint EstimateCost(Entity *entity) const;
+
+    /// Applies queued work for @c connection within its budget. Returns false if the connection is gone.
+    bool Process(u32 connectionId, ConnectionState &state, float frametime);
+
+    /// Marks layer complete and updates metrics.
+    void Complete(u32 connectionId, ConnectionState &state, const PendingLayer &layer);
+
+    /// Updates frame update connection based on queued work.
+    void UpdateConnection();
+
+    Framework *framework_;
+    QString LC;
+
+    uint bytesPerSecond_;
+    QHash<u32, ConnectionState> connections_;
+};
+
+/// @endcond
@@ -11,6 +11,7 @@
 
 #include "MeshmoonLayers.h"
 #include "MeshmoonLayerProcessor.h"
+#include "MeshmoonLayerReplicator.h"
 
 #include "Framework.h"
 #include "LoggingFunctions.h"
@@ -25,19 +26,54 @@
 #include "SyncState.h"
 
 #include "EC_Script.h"
+#include "EC_Placeable.h"
+#include "FrameAPI.h"
+#include "Math/MathFunc.h"
+
+#include "MeshmoonHttpPlugin.h"
+#include "MeshmoonHttpClient.h"
+#include "MeshmoonHttpRequest.h"
 
 #include <QNetworkReply>
 
+namespace
+{
+    /// How often observer distances are checked, in seconds.
+    const float StreamingUpdateInterval = 0.25f;
+}
+
+MeshmoonLayers::StreamingState::StreamingState() :
+    enabled(false),
+    defaultLoadRadius(0.f),
+    unloadHysteresis(25.f),
+    frameBudgetMsecs(8.f),
+    tUpdate(0.f)
+{
+}
+
 MeshmoonLayers::MeshmoonLayers(Framework *framework) :
     framework_(framework),
     processor_(new MeshmoonLayerProcessor(framework)),
+    replicator_(new MeshmoonLayerReplicator(framework)),
     LC("[MeshmoonLayers]: ")
 {
+    connect(replicator_, SIGNAL(LayerFullyVisible(u32, u32, float)), this, SIGNAL(LayerFullyVisible(u32, u32, float)));
+
+    // Connected users stream layers around their avatars, their replication state is dropped on disconnect.
+    TundraLogicModule *tundraLogic = framework_->Module<TundraLogicModule>();
+    if (tundraLogic && tundraLogic->IsServer())
+    {
+        connect(tundraLogic->GetServer().get(), SIGNAL(UserConnected(u32, UserConnection*, UserConnectedResponseData*)),
+            SLOT(OnUserConnected(u32, UserConnection*)));
+        connect(tundraLogic->GetServer().get(), SIGNAL(UserDisconnected(u32, UserConnection*)),
+            SLOT(OnUserDisconnected(u32, UserConnection*)));
+    }
 }
 
 MeshmoonLayers::~MeshmoonLayers()
 {
     SAFE_DELETE(processor_);
+    SAFE_DELETE(replicator_);
 }
 
 const Meshmoon::SceneLayerList &MeshmoonLayers::Layers() const
@@ -47,43 +83,74 @@ const Meshmoon::SceneLayerList &MeshmoonLayers::Layers() const
 
 Meshmoon::SceneLayer MeshmoonLayers::Layer(u32 id) const
 {
-    for (int i=0,len=layers_.size(); i<len; ++i)
-    {
-        const Meshmoon::SceneLayer &existing = layers_[i];
-        if (existing.id == id)
-            return existing;
-    }
-    return Meshmoon::SceneLayer();
+    const Meshmoon::SceneLayer *layer = FindLayer(id);
+    return (layer ? *layer : Meshmoon::SceneLayer());
 }
 
 Meshmoon::SceneLayer MeshmoonLayers::Layer(const QString &name) const
 {
+    const Meshmoon::SceneLayer *layer = FindLayer(name);
+    return (layer ? *layer : Meshmoon::SceneLayer());
+}
+
+const Meshmoon::SceneLayer *MeshmoonLayers::FindLayer(u32 id) const
+{
+    int index = IndexOf(id);
+    return (index >= 0 ? &layers_[index] : 0);
+}
+
+const Meshmoon::SceneLayer *MeshmoonLayers::FindLayer(const QString &name) const
+{
+    QHash<QString, int>::const_iterator iter = nameIndex_.find(name);
+    return (iter != nameIndex_.end() ? &layers_[iter.value()] : 0);
+}
+
+int MeshmoonLayers::IndexOf(u32 id) const
+{
+    QHash<u32, int>::const_iterator iter = idIndex_.find(id);
+    return (iter != idIndex_.end() ? iter.value() : -1);
+}
+
+void MeshmoonLayers::RebuildIndex()
+{
+    idIndex_.clear();
+    nameIndex_.clear();
+    urlIndex_.clear();
     for (int i=0,len=layers_.size(); i<len; ++i)
-    {
-        const Meshmoon::SceneLayer &existing = layers_[i];
-        if (existing.name == name)
-            return existing;
-    }
-    return Meshmoon::SceneLayer();
+        AddToIndex(i);
+}
+
+void MeshmoonLayers::AddToIndex(int index)
+{
+    // First one wins on duplicate names, same as the old linear lookup.
+    const Meshmoon::SceneLayer &layer = layers_[index];
+    idIndex_.insert(layer.id, index);
+    if (!nameIndex_.contains(layer.name))
+        nameIndex_.insert(layer.name, index);
+    urlIndex_.insert(layer.txmlUrl.toString(QUrl::RemoveQuery), index);
 }
 
 void MeshmoonLayers::RemoveAll()
 {
     layers_.clear();
+    RebuildIndex();
+    streaming_.loadQueue.clear();
+    streaming_.fetching.clear();
+    streaming_.fetchTimers.clear();
 }
 
 bool MeshmoonLayers::Remove(u32 id)
 {
-    for (int i=0,len=layers_.size(); i<len; ++i)
-    {
-        const Meshmoon::SceneLayer &existing = layers_[i];
-        if (existing.id == id)
-        {
-            layers_.removeAt(i);
-            return true;
-        }
-    }
-    return false;
+    int index = IndexOf(id);
+    if (index < 0)
+        return false;
+
+    layers_.removeAt(index);
+    RebuildIndex();
+    streaming_.loadQueue.removeAll(id);
+    streaming_.fetching.remove(id);
+    streaming_.fetchTimers.remove(id);
+    return true;
 }
 
 bool MeshmoonLayers::Add(const Meshmoon::SceneLayer &layer)
@@ -91,6 +158,7 @@ bool MeshmoonLayers::Add(const Meshmoon::SceneLayer &layer)
     if (Exists(layer))
         return false;
     layers_ << layer;
+    AddToIndex(layers_.size() - 1);
     return true;
 }
 
@@ -109,15 +177,12 @@ bool MeshmoonLayers::Add(const Meshmoon::SceneLayerList &layers)
 bool MeshmoonLayers::Exists(const Meshmoon::SceneLayer &layer) const
 {
     const QString baseUrl = layer.txmlUrl.toString(QUrl::RemoveQuery);
-    for (int i=0,len=layers_.size(); i<len; ++i)
+    QHash<QString, int>::const_iterator iter = urlIndex_.find(baseUrl);
+    if (iter != urlIndex_.end())
     {
-        const Meshmoon::SceneLayer &existing = layers_[i];
-        if (baseUrl.compare(existing.txmlUrl.toString(QUrl::RemoveQuery), Qt::CaseSensitive) == 0)
-        {
-            LogWarning(LC + QString("Layer '%1' already has txml URL of %2. Skipping layer '%3'.")
-                .arg(existing.name).arg(baseUrl).arg(layer.name));
-            return true;
-        }
+        LogWarning(LC + QString("Layer '%1' already has txml URL of %2. Skipping layer '%3'.")
+            .arg(layers_[iter.value()].name).arg(baseUrl).arg(layer.name));
+        return true;
     }
     return false;
 }
@@ -128,9 +193,10 @@ bool MeshmoonLayers::CheckLayerDownload(QNetworkReply *reply)
         return false;
 
     QString replyUrl = reply->url().toString();
-    for (int i=0,len=layers_.size(); i<len; ++i)
+    QHash<QString, int>::const_iterator iter = urlIndex_.find(reply->url().toString(QUrl::RemoveQuery));
+    if (iter != urlIndex_.end())
     {
-        Meshmoon::SceneLayer &layer = layers_[i];
+        Meshmoon::SceneLayer &layer = layers_[iter.value()];
         if (replyUrl == layer.txmlUrl.toString())
         {
             layer.downloaded = true;
@@ -181,19 +247,49 @@ void MeshmoonLayers::Load()
         Meshmoon::SceneLayer &layer = layers_[i];
         if (layer.loaded)
             continue;
+        // Streamed layers are loaded by proximity in OnStreamingUpdate.
+        if (streaming_.enabled && LoadRadius(layer) > 0.f)
+            continue;
 
-        layer.loaded = true;
-        if (processor_->LoadSceneLayer(layer))
-            emit LayerLoaded(layer);        
+        LoadLayer(layer);
     }
     LogInfo(" ");
 
     emit LayersLoaded();
 }
 
+bool MeshmoonLayers::LoadLayer(Meshmoon::SceneLayer &layer)
+{
+    kNet::PolledTimer timer;
+
+    layer.loaded = true;
+    layer.stats.rawBytes = static_cast<uint>(layer.sceneData.size());
+    if (!processor_->LoadSceneLayer(layer))
+        return false;
+
+    layer.stats.entities = static_cast<uint>(layer.entityIds.size());
+    layer.stats.loads++;
+    layer.stats.lastLoadMsecs = timer.MSecsElapsed();
+    layer.stats.totalLoadMsecs += layer.stats.lastLoadMsecs;
+
+    // Streamed layers can be loaded again later. Keep a compressed copy of the raw txml,
+    // it is a fraction of the raw size and much faster to restore than a re-fetch.
+    if (streaming_.enabled && LoadRadius(layer) > 0.f)
+    {
+        if (layer.sceneDataCache.isEmpty())
+            layer.sceneDataCache = qCompress(layer.sceneData);
+        layer.stats.cachedBytes = static_cast<uint>(layer.sceneDataCache.size());
+        layer.sceneData.clear();
+    }
+
+    emit LayerLoaded(layer);
+    return true;
+}
+
 bool MeshmoonLayers::UnloadAll()
 {
     LogInfo(LC + QString("Unloading %1 scene layers").arg(layers_.size()));
+    streaming_.loadQueue.clear();
     for (int i=0,len=layers_.size(); i<len; ++i)
         Unload(layers_[i]);
     return true;
@@ -201,16 +297,17 @@ bool MeshmoonLayers::UnloadAll()
 
 bool MeshmoonLayers::Unload(u32 id)
 {
-    Meshmoon::SceneLayer layer = Layer(id);
-    if (!layer.IsValid())
+    int index = IndexOf(id);
+    if (index < 0)
         return false;
         
-    LogInfo(LC + QString("Unloading layer with id %1").arg(layer.id));
-    Unload(layer);
+    LogInfo(LC + QString("Unloading layer with id %1").arg(id));
+    streaming_.loadQueue.removeAll(id);
+    Unload(layers_[index]);
     return true;
 }
 
-bool MeshmoonLayers::Unload(const Meshmoon::SceneLayer &layer)
+bool MeshmoonLayers::Unload(Meshmoon::SceneLayer &layer)
 {
     Scene *scene = framework_->Renderer()->MainCameraScene();
     if (!scene)
@@ -219,14 +316,15 @@ bool MeshmoonLayers::Unload(const Meshmoon::SceneLayer &layer)
         return false;
     }
 
-    LogInfo(LC + QString("  %1 with %2 entities").arg(layer.name).arg(layer.entities.size()));
+    kNet::PolledTimer timer;
+    LogInfo(LC + QString("  %1 with %2 entities").arg(layer.name).arg(layer.entityIds.size()));
 
-    foreach(EntityWeakPtr layerEnt, layer.entities)
+    for (size_t ei=0; ei<layer.entityIds.size(); ++ei)
     {
-        Entity *ent = layerEnt.lock().get();
+        const entity_id_t entId = layer.entityIds[ei];
+        Entity *ent = scene->EntityById(entId).get();
         if (ent)
         {
-            entity_id_t entId = ent->Id();
 
             // Unload script and its assets
             std::vector<shared_ptr<EC_Script> > scripts = ent->ComponentsOfType<EC_Script>();
@@ -250,10 +348,14 @@ bool MeshmoonLayers::Unload(const Meshmoon::SceneLayer &layer)
 
             // Remove entity from scene
             ent = 0;
-            layerEnt.reset();
             scene->RemoveEntity(entId, AttributeChange::Replicate);
         }
     }
+    layer.entityIds.clear();
+    layer.loaded = false;
+
+    layer.stats.unloads++;
+    layer.stats.lastUnloadMsecs = timer.MSecsElapsed();
 
     emit LayerRemoved(layer);
     return true;
@@ -269,23 +371,12 @@ bool MeshmoonLayers::UpdateClientLayerState(UserConnection *connection, u32 laye
         return false;
     }
 
-    Meshmoon::SceneLayer layer = Layer(layerId);
-    if (layer.IsValid())
+    const Meshmoon::SceneLayer *layer = FindLayer(layerId);
+    if (layer)
     {
-        SceneSyncState *sceneState = connection->syncState.get();
-        if (sceneState)
+        if (replicator_->Enqueue(connection, *layer, visible))
         {
-            foreach(EntityWeakPtr ent, layer.entities)
-            {
-                if (!ent.expired())
-                {
-                    if (visible)
-                        sceneState->MarkPendingEntityDirty(ent.lock()->Id());
-                    else
-                        sceneState->MarkEntityPending(ent.lock()->Id());
-                }
-            }
-            emit LayerVisibilityChanged(connection, layer, visible);
+            emit LayerVisibilityChanged(connection, *layer, visible);
             return true;
         }
         else
@@ -311,3 +402,328 @@ bool MeshmoonLayers::UpdateClientLayerState(u32 connectionId, u32 layerId, bool
     LogError(LC + QString("UpdateClientLayerState: Failed to find user connection %1").arg(connectionId));
     return false;
 }
+
+void MeshmoonLayers::SetClientReplicationBudget(uint bytesPerSecond)
+{
+    replicator_->SetBandwidthBudget(bytesPerSecond);
+}
+
+QVariantMap MeshmoonLayers::ClientReplicationMetrics(u32 connectionId) const
+{
+    return replicator_->Metrics(connectionId);
+}
+
+uint MeshmoonLayers::ClientReplicationQueueDepth() const
+{
+    return replicator_->TotalQueueDepth();
+}
+
+void MeshmoonLayers::SetStreamingEnabled(bool enabled)
+{
+    if (streaming_.enabled == enabled)
+        return;
+    streaming_.enabled = enabled;
+    streaming_.tUpdate = 0.f;
+
+    if (enabled)
+    {
+        connect(framework_->Frame(), SIGNAL(Updated(float)), this, SLOT(OnStreamingUpdate(float)), Qt::UniqueConnection);
+        LogInfo(LC + QString("Layer streaming enabled: default radius %1 hysteresis %2 budget %3 msecs")
+            .arg(streaming_.defaultLoadRadius).arg(streaming_.unloadHysteresis).arg(streaming_.frameBudgetMsecs));
+    }
+    else
+    {
+        // Queue everything that is not loaded and keep processing the queue until it is empty.
+        streaming_.loadQueue.clear();
+        for (int i=0,len=layers_.size(); i<len; ++i)
+            if (!layers_[i].loaded)
+                streaming_.loadQueue << layers_[i].id;
+        if (streaming_.loadQueue.isEmpty())
+            disconnect(framework_->Frame(), SIGNAL(Updated(float)), this, SLOT(OnStreamingUpdate(float)));
+        LogInfo(LC + "Layer streaming disabled");
+    }
+}
+
+bool MeshmoonLayers::IsStreamingEnabled() const
+{
+    return streaming_.enabled;
+}
+
+void MeshmoonLayers::SetStreamingParameters(float defaultLoadRadius, float unloadHysteresis, float frameBudgetMsecs)
+{
+    streaming_.defaultLoadRadius = Max(0.f, defaultLoadRadius);
+    streaming_.unloadHysteresis = Max(0.f, unloadHysteresis);
+    streaming_.frameBudgetMsecs = Max(0.f, frameBudgetMsecs);
+    streaming_.tUpdate = 0.f;
+}
+
+bool MeshmoonLayers::SetLayerLoadRadius(u32 id, float radius)
+{
+    int index = IndexOf(id);
+    if (index < 0)
+    {
+        LogError(LC + QString("SetLayerLoadRadius: Layer with id %1 does not exist").arg(id));
+        return false;
+    }
+    layers_[index].loadRadius = Max(0.f, radius);
+    streaming_.tUpdate = 0.f;
+    return true;
+}
+
+void MeshmoonLayers::AddStreamingObserver(entity_id_t id)
+{
+    if (!streaming_.observers.contains(id))
+        streaming_.observers << id;
+    streaming_.tUpdate = 0.f;
+}
+
+void MeshmoonLayers::RemoveStreamingObserver(entity_id_t id)
+{
+    streaming_.observers.removeAll(id);
+    streaming_.tUpdate = 0.f;
+}
+
+void MeshmoonLayers::OnUserConnected(u32 connectionId, UserConnection * /*connection*/)
+{
+    if (!streaming_.userAvatars.contains(connectionId))
+        streaming_.userAvatars.insert(connectionId, 0);
+    streaming_.tUpdate = 0.f;
+}
+
+void MeshmoonLayers::OnUserDisconnected(u32 connectionId, UserConnection * /*connection*/)
+{
+    // Per connection replication queues and metrics.
+    replicator_->RemoveConnection(connectionId);
+
+    const entity_id_t avatarId = streaming_.userAvatars.take(connectionId);
+    if (avatarId != 0)
+        RemoveStreamingObserver(avatarId);
+}
+
+void MeshmoonLayers::UpdateUserObservers()
+{
+    if (streaming_.userAvatars.isEmpty())
+        return;
+    Scene *scene = framework_->Renderer() ? framework_->Renderer()->MainCameraScene() : 0;
+    if (!scene)
+        return;
+
+    for(QHash<u32, entity_id_t>::iterator iter = streaming_.userAvatars.begin(); iter != streaming_.userAvatars.end(); ++iter)
+    {
+        if (iter.value() != 0 && scene->EntityById(iter.value()).get())
+            continue;
+        if (iter.value() != 0)
+        {
+            RemoveStreamingObserver(iter.value());
+            iter.value() = 0;
+        }
+        // Tundra avatar application naming.
+        EntityPtr avatar = scene->EntityByName(QString("Avatar%1").arg(iter.key()));
+        if (avatar.get())
+        {
+            iter.value() = avatar->Id();
+            AddStreamingObserver(avatar->Id());
+        }
+    }
+}
+
+float MeshmoonLayers::LoadRadius(const Meshmoon::SceneLayer &layer) const
+{
+    return (layer.loadRadius > 0.f ? layer.loadRadius : streaming_.defaultLoadRadius);
+}
+
+void MeshmoonLayers::ObserverPositions(QList<float3> &positions) const
+{
+    Scene *scene = framework_->Renderer() ? framework_->Renderer()->MainCameraScene() : 0;
+    if (!scene)
+        return;
+
+    if (!streaming_.observers.isEmpty())
+    {
+        foreach(entity_id_t id, streaming_.observers)
+        {
+            EntityPtr ent = scene->EntityById(id);
+            EC_Placeable *placeable = (ent.get() ? ent->Component<EC_Placeable>().get() : 0);
+            if (placeable)
+                positions << placeable->WorldPosition();
+        }
+        return;
+    }
+
+    Entity *camera = framework_->Renderer()->MainCamera();
+    EC_Placeable *placeable = (camera ? camera->Component<EC_Placeable>().get() : 0);
+    if (placeable)
+        positions << placeable->WorldPosition();
+}
+
+bool MeshmoonLayers::EnsureSceneData(Meshmoon::SceneLayer &layer)
+{
+    if (!layer.sceneData.isEmpty())
+        return true;
+    if (!layer.sceneDataCache.isEmpty())
+    {
+        layer.sceneData = qUncompress(layer.sceneDataCache);
+        if (!layer.sceneData.isEmpty())
+            return true;
+        layer.sceneDataCache.clear();
+        layer.stats.cachedBytes = 0;
+    }
+    if (streaming_.fetching.contains(layer.id))
+        return false;
+
+    MeshmoonHttpPlugin *http = framework_->Module<MeshmoonHttpPlugin>();
+    MeshmoonHttpRequestPtr request = (http ? http->Client()->Get(layer.txmlUrl.toString()) : MeshmoonHttpRequestPtr());
+    if (!request.get())
+    {
+        LogError(LC + "Failed to re-fetch scene layer txml: " + layer.toString());
+        return false;
+    }
+    request->setProperty("layerId", static_cast<uint>(layer.id));
+    connect(request.get(), SIGNAL(Finished(MeshmoonHttpRequest*, int, const QString&)),
+        this, SLOT(OnLayerFetched(MeshmoonHttpRequest*, int, const QString&)));
+
+    streaming_.fetching << layer.id;
+    streaming_.fetchTimers[layer.id] = kNet::PolledTimer();
+    return false;
+}
+
+void MeshmoonLayers::OnLayerFetched(MeshmoonHttpRequest *request, int statusCode, const QString &error)
+{
+    const u32 id = static_cast<u32>(request->property("layerId").toUInt());
+    streaming_.fetching.remove(id);
+    
+    int index = IndexOf(id);
+    if (index < 0)
+        return;
+
+    Meshmoon::SceneLayer &layer = layers_[index];
+    layer.stats.fetches++;
+    layer.stats.lastFetchMsecs = streaming_.fetchTimers.take(id).MSecsElapsed();
+    if (statusCode != 200)
+    {
+        LogError(LC + QString("Failed to re-fetch scene layer %1: %2").arg(layer.toString()).arg(error));
+        streaming_.loadQueue.removeAll(id);
+        return;
+    }
+    layer.sceneData = request->ResponseBodyBytes();
+}
+
+void MeshmoonLayers::OnStreamingUpdate(float frametime)
+{
+    if (streaming_.enabled)
+    {
+        streaming_.tUpdate -= frametime;
+        if (streaming_.tUpdate <= 0.f)
+        {
+            UpdateUserObservers();
+            streaming_.tUpdate = StreamingUpdateInterval;
+
+            QList<float3> positions;
+            ObserverPositions(positions);
+
+            for (int i=0,len=layers_.size(); i<len; ++i)
+            {
+                Meshmoon::SceneLayer &layer = layers_[i];
+                const float radius = LoadRadius(layer);
+                if (radius <= 0.f)
+                {
+                    if (!layer.loaded && !streaming_.loadQueue.contains(layer.id))
+                        streaming_.loadQueue << layer.id;
+                    continue;
+                }
+
+                float distanceSq = FLOAT_INF;
+                foreach(const float3 &pos, positions)
+                    distanceSq = Min(distanceSq, pos.DistanceSq(layer.centerPosition));
+
+                // Hysteresis: load when inside radius, unload only after moving past radius + hysteresis.
+                const float unloadRadius = radius + streaming_.unloadHysteresis;
+                if (!layer.loaded && distanceSq <= radius * radius)
+                {
+                    if (!streaming_.loadQueue.contains(layer.id))
+                        streaming_.loadQueue << layer.id;
+                }
+                else if (distanceSq > unloadRadius * unloadRadius)
+                {
+                    streaming_.loadQueue.removeAll(layer.id);
+                    if (layer.loaded)
+                    {
+                        LogInfo(LC + QString("Streaming out layer %1").arg(layer.toString()));
+                        if (Unload(layer))
+                            emit LayerStreamedOut(layer);
+                    }
+                }
+            }
+        }
+    }
+
+    if (streaming_.loadQueue.isEmpty())
+    {
+        if (!streaming_.enabled)
+            disconnect(framework_->Frame(), SIGNAL(Updated(float)), this, SLOT(OnStreamingUpdate(float)));
+        return;
+    }
+
+    // Process the load queue within the frame budget. Layers waiting for a re-fetch are skipped.
+    kNet::PolledTimer timer;
+    int processed = 0;
+    for (int qi=0; qi<streaming_.loadQueue.size();)
+    {
+        if (processed > 0 && timer.MSecsElapsed() >= streaming_.frameBudgetMsecs)
+            break;
+
+        int index = IndexOf(streaming_.loadQueue[qi]);
+        if (index < 0 || layers_[index].loaded)
+        {
+            streaming_.loadQueue.removeAt(qi);
+            continue;
+        }
+        Meshmoon::SceneLayer &layer = layers_[index];
+        if (!EnsureSceneData(layer))
+        {
+            ++qi;
+            continue;
+        }
+        streaming_.loadQueue.removeAt(qi);
+        LoadLayer(layer);
+        ++processed;
+    }
+}
+
+QVariantMap MeshmoonLayers::LayerStats(u32 id) const
+{
+    int index = IndexOf(id);
+    if (index < 0)
+        return QVariantMap();
+
+    const Meshmoon::SceneLayer &layer = layers_[index];
+    QVariantMap stats = layer.stats.ToVariantMap();
+    stats["loaded"] = layer.loaded;
+    stats["queued"] = streaming_.loadQueue.contains(id);
+    stats["sceneDataBytes"] = layer.sceneData.size();
+    stats["sceneDataCacheBytes"] = layer.sceneDataCache.size();
+    stats["loadRadius"] = LoadRadius(layer);
+    return stats;
+}
+
+uint MeshmoonLayers::SceneDataMemoryUsage() const
+{
+    uint bytes = 0;
+    for (int i=0,len=layers_.size(); i<len; ++i)
+        bytes += static_cast<uint>(layers_[i].sceneData.size() + layers_[i].sceneDataCache.size());
+    return bytes;
+}
+
+void MeshmoonLayers::LogStats() const
+{
+    LogInfo(LC + QString("%1 layers, %2 KB of scene data in memory, %3 queued for load")
+        .arg(layers_.size()).arg(SceneDataMemoryUsage() / 1024.0, 0, 'f', 1).arg(streaming_.loadQueue.size()));
+    for (int i=0,len=layers_.size(); i<len; ++i)
+    {
+        const Meshmoon::SceneLayer &layer = layers_[i];
+        LogInfo(LC + QString("  %1 %2 entities=%3 raw=%4 KB cached=%5 KB loads=%6 unloads=%7 fetches=%8 last load=%9 msecs")
+            .arg(layer.toString()).arg(layer.loaded ? "loaded" : "unloaded").arg(layer.stats.entities)
+            .arg(layer.stats.rawBytes / 1024.0, 0, 'f', 1).arg(layer.sceneDataCache.size() / 1024.0, 0, 'f', 1)
+            .arg(layer.stats.loads).arg(layer.stats.unloads).arg(layer.stats.fetches).arg(layer.stats.lastLoadMsecs, 0, 'f', 2));
+    }
+}
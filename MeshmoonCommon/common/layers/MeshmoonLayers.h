@@ -13,13 +13,18 @@
 
 #include "FrameworkFwd.h"
 #include "TundraProtocolModuleFwd.h"
+#include "MeshmoonHttpPluginFwd.h"
 #include "common/MeshmoonCommon.h"
 
 #include <QObject>
 #include <QString>
 #include <QNetworkReply>
+#include <QSet>
+
+#include <kNet/PolledTimer.h>
 
 class MeshmoonLayerProcessor;
+class MeshmoonLayerReplicator;
 
 /// Provides per user layer management for scripting.
 /** MeshmoonLayers is exposed to scripting as 'meshmoonserver.layers'.
@@ -53,6 +58,14 @@ public:
         @return True if added, false if already existed and the layer was ignored. */    
     bool Exists(const Meshmoon::SceneLayer &layer) const;
 
+    /// Returns layer by id or null if not found.
+    /** The returned pointer is valid until layers are added or removed. Prefer this over Layer() in C++ to avoid copying. */
+    const Meshmoon::SceneLayer *FindLayer(u32 id) const;
+
+    /// Returns layer by name or null if not found.
+    /** If several layers share the name, the first added one is returned. @see FindLayer(u32). */
+    const Meshmoon::SceneLayer *FindLayer(const QString &name) const;
+
     /// Check if this reply is for a known layer scene data.
     bool CheckLayerDownload(QNetworkReply *reply);
 
@@ -67,6 +80,16 @@ public:
     /** @note Does not remove the layer from the state, use Remove for that if desirable. */
     bool Unload(u32 id);
 
+    /// Enables or disables proximity based layer streaming.
+    /** When enabled, layers with a load radius are loaded when a streaming observer
+        comes within the radius of the layers center position and unloaded when all
+        observers are further than the radius plus the unload hysteresis. Loads are queued
+        and processed within the frame budget, see SetStreamingParameters.
+        Layers with zero load radius are always loaded. Disabling streaming queues all
+        unloaded layers for loading. */
+    void SetStreamingEnabled(bool enabled);
+    bool IsStreamingEnabled() const;
+
     /// @endcond
 
 public slots:
@@ -101,6 +124,46 @@ public slots:
         @return False if connection or layer does not exist. */
     bool UpdateClientLayerState(UserConnection *connection, u32 layerId, bool visible);
 
+    /// Sets per client bandwidth budget for showing layers, in bytes per second.
+    /** Entities of a shown layer are replicated nearest first within this budget. 0 replicates the whole layer at once. */
+    void SetClientReplicationBudget(uint bytesPerSecond);
+
+    /// Returns layer replication metrics for client @c connectionId.
+    /** Keys: queueDepth, pendingLayers, replicatedEntities, replicatedBytes, fullyVisibleLayers,
+        lastTimeToVisibleMsecs, averageTimeToVisibleMsecs, maxTimeToVisibleMsecs. */
+    QVariantMap ClientReplicationMetrics(u32 connectionId) const;
+
+    /// Returns number of layer entities waiting to be replicated to all clients.
+    uint ClientReplicationQueueDepth() const;
+
+    /// Sets streaming parameters.
+    /** @param Load radius for layers that do not define one, 0 keeps them always loaded.
+        @param Extra distance over the load radius before a layer is unloaded.
+        @param Time budget in milliseconds for processing the load queue per frame. At least one layer is loaded per frame. */
+    void SetStreamingParameters(float defaultLoadRadius, float unloadHysteresis, float frameBudgetMsecs);
+
+    /// Sets load radius for layer @c id. 0 means the layer is always loaded.
+    bool SetLayerLoadRadius(u32 id, float radius);
+
+    /// Adds entity @c id as a streaming observer.
+    /** Layers are streamed around the world positions of the observer entities.
+        On a server the avatar of each connected user is an observer automatically.
+        If no observers have been added, the main camera is used. */
+    void AddStreamingObserver(entity_id_t id);
+    
+    /// Removes entity @c id from streaming observers.
+    void RemoveStreamingObserver(entity_id_t id);
+
+    /// Returns load statistics of layer @c id.
+    /** @see Meshmoon::SceneLayerStats for the available keys. */
+    QVariantMap LayerStats(u32 id) const;
+
+    /// Returns the sum of raw and cached layer scene data currently kept in memory, in bytes.
+    uint SceneDataMemoryUsage() const;
+
+    /// Logs load statistics of all layers.
+    void LogStats() const;
+
 signals:
     /// Emitted when a layer is loaded to the server.
     /** @note You cannot assume layers are loaded when a script starts execution.
@@ -108,25 +171,87 @@ signals:
     void LayerLoaded(const Meshmoon::SceneLayer &layer);
 
     /// Emitted when a layers visibility changes for a particular client.
+    /** @note When showing a layer its entities are replicated over time, see LayerFullyVisible. */
     void LayerVisibilityChanged(UserConnection *connection, const Meshmoon::SceneLayer &layer, bool visible);
+
+    /// Emitted when all entities of a shown layer have been queued for replication to client @c connectionId.
+    void LayerFullyVisible(u32 connectionId, u32 layerId, float msecs);
     
     /// Emitted when layer is removed.
     void LayerRemoved(const Meshmoon::SceneLayer &layer);
+
+    /// Emitted when a streamed layer is unloaded because all observers moved out of its range.
+    /** @note LayerRemoved is emitted as well. The layer is loaded again once an observer comes back to its range. */
+    void LayerStreamedOut(const Meshmoon::SceneLayer &layer);
     
     /// Emitted when all layers have been loaded to the server.
     /** @note You cannot assume layers are loaded when a script starts execution.
         @see AllDownloaded and AllLoaded. */
     void LayersLoaded();
 
+private slots:
+    void OnStreamingUpdate(float frametime);
+    void OnUserConnected(u32 connectionId, UserConnection *connection);
+    void OnUserDisconnected(u32 connectionId, UserConnection *connection);
+    void OnLayerFetched(MeshmoonHttpRequest *request, int statusCode, const QString &error);
+
 private:
     QString LC;
 
     Framework *framework_;
     MeshmoonLayerProcessor *processor_;
+    MeshmoonLayerReplicator *replicator_;
 
     Meshmoon::SceneLayerList layers_;
 
+    /// Lookup tables into layers_, rebuilt on removal.
+    QHash<u32, int> idIndex_;
+    QHash<QString, int> nameIndex_;
+    QHash<QString, int> urlIndex_; ///< txml URL without query.
+
+    /// Returns index of layer @c id or -1.
+    int IndexOf(u32 id) const;
+
+    void AddToIndex(int index);
+    void RebuildIndex();
+
+    /// Loads @c layer to the active scene and updates its stats.
+    /** If streaming is enabled the raw scene data is released after load. */
+    bool LoadLayer(Meshmoon::SceneLayer &layer);
+
     /// Unloads layer by notifying all clients about it being removed.
-    bool Unload(const Meshmoon::SceneLayer &layer);
+    bool Unload(Meshmoon::SceneLayer &layer);
+
+    /// Returns effective load radius for @c layer.
+    float LoadRadius(const Meshmoon::SceneLayer &layer) const;
+
+    /// Fills @c positions with current observer world positions.
+    void ObserverPositions(QList<float3> &positions) const;
+
+    /// Adds avatars of connected users that have appeared as observers.
+    /** Avatars are created by the avatar application after the user has connected, and recreated
+        eg. on avatar changes, so they are looked up by name until found. */
+    void UpdateUserObservers();
+
+    /// Restores scene data from cache or starts a re-fetch. Returns true if data is available now.
+    bool EnsureSceneData(Meshmoon::SceneLayer &layer);
+
+    struct StreamingState
+    {
+        bool enabled;
+        float defaultLoadRadius;
+        float unloadHysteresis;
+        float frameBudgetMsecs;
+        float tUpdate;
+
+        QList<u32> loadQueue;
+        QSet<u32> fetching;
+        QList<entity_id_t> observers;
+        QHash<u32, entity_id_t> userAvatars; ///< Connected users and their avatar observer, 0 if not found yet.
+        QHash<u32, kNet::PolledTimer> fetchTimers;
+
+        StreamingState();
+    };
+    StreamingState streaming_;
 };
 Q_DECLARE_METATYPE(MeshmoonLayers*)
@@ -3,58 +3,65 @@
 
 #include "MeshmoonSceneValidator.h"
 #include "Framework.h"
+#include "LoggingFunctions.h"
+#include "SceneAPI.h"
 #include "Scene.h"
+#include "Entity.h"
+#include "IComponent.h"
+#include "IAttribute.h"
+#include "EC_Name.h"
+
+#include <kNet/PolledTimer.h>
+
+#include <QTimer>
+#include <QVector>
+#include <QtAlgorithms>
 
 QString MeshmoonSceneValidator::RocketEnvironmentEntityName = "RocketEnvironment";
 
-void MeshmoonSceneValidator::Validate(Scene *scene)
-{
-    if (!scene)
-    {
-        LogError("[MeshmoonSceneValidator]: Passed in scene is null!");
-        return;
-    }
+/// @cond PRIVATE
 
-    /** Rocket environment entity. We only want one of these to go the clients.
-        Prioritize as follows:
+namespace
+{
+    /// Keeps one "RocketEnvironment" entity in the scene.
+    /** We only want one of these to go the clients. Prioritize as follows:
           1) Replicated non-temporary entity (from the main scene)
           2) Replicated temporary entity (from a layer)
         Anything but the first found entity will be removed from scene. */
-    EntityList rocketEnvEnts = scene->FindEntitiesByName(RocketEnvironmentEntityName);
-    if (rocketEnvEnts.size() > 1)
+    class RocketEnvironmentRule : public MeshmoonSceneRule
     {
-        LogInfo(QString("[MeshmoonSceneValidator]: Found %1 %2 Entities:").arg(rocketEnvEnts.size()).arg(RocketEnvironmentEntityName));
-        for(EntityList::const_iterator it = rocketEnvEnts.begin(); it != rocketEnvEnts.end(); ++it)
+    public:
+        explicit RocketEnvironmentRule(Framework *framework) :
+            framework_(framework),
+            typesResolved_(false)
         {
-            const EntityPtr ent = (*it);
-            LogInfo("    " + QString::number(ent->Id()) + QString(" temporary=%1 replicated=%2 sky=%3 water=%4 fog=%5 envlight=%6 shadowsetup=%7 components=%8")
-                .arg(ent->IsTemporary() ? "true" : "false").arg(ent->IsReplicated() ? "true" : "false")
-                .arg(ent->Component("EC_Sky") || ent->Component("EC_SkyX") || ent->Component("EC_MeshmoonSky") ? "true" : "false")
-                .arg(ent->Component("EC_WaterPlane") || ent->Component("EC_Hydrax") || ent->Component("EC_MeshmoonWater") ? "true" : "false")
-                .arg(ent->Component("EC_Fog") ? "true" : "false").arg(ent->Component("EC_EnvironmentLight") ? "true" : "false")
-                .arg(ent->Component("EC_SceneShadowSetup") ? "true" : "false").arg(ent->NumComponents()));
         }
 
-        // 1) Replicated non-temporary with the most components 
-        Entity *keep = 0;
-        for(EntityList::const_iterator it = rocketEnvEnts.begin(); it != rocketEnvEnts.end(); ++it)
+        QString Name() const
         {
-            const EntityPtr ent = (*it);
-            if (!ent->IsTemporary() && ent->IsReplicated())
-            {
-                // Only pick this one if it has more components than the previous one.
-                if (keep && ent->NumComponents() < keep->NumComponents())
-                    continue;
-                keep = ent.get();
-            }
+            return "RocketEnvironment";
+        }
+
+        bool Tracks(Entity *entity)
+        {
+            return (entity->Name() == MeshmoonSceneValidator::RocketEnvironmentEntityName);
         }
-        // 2) Replicated temporary with the most components 
-        if (!keep)
+
+        void Validate(Scene *scene, const EntityList &rocketEnvEnts, const EntityList & /*changed*/)
         {
+            if (rocketEnvEnts.size() <= 1)
+                return;
+
+            LogInfo(QString("[MeshmoonSceneValidator]: Found %1 %2 Entities:").arg(rocketEnvEnts.size()).arg(MeshmoonSceneValidator::RocketEnvironmentEntityName));
+            for(EntityList::const_iterator it = rocketEnvEnts.begin(); it != rocketEnvEnts.end(); ++it)
+                LogInfo("    " + Describe(it->get()));
+
+            // 1) Replicated non-temporary with the most components
+            Entity *keep = 0;
             for(EntityList::const_iterator it = rocketEnvEnts.begin(); it != rocketEnvEnts.end(); ++it)
             {
                 const EntityPtr ent = (*it);
-                if (ent->IsReplicated())
+                if (!ent->IsTemporary() && ent->IsReplicated())
                 {
                     // Only pick this one if it has more components than the previous one.
                     if (keep && ent->NumComponents() < keep->NumComponents())
@@ -62,18 +69,27 @@ void MeshmoonSceneValidator::Validate(Scene *scene)
                     keep = ent.get();
                 }
             }
-        }
-        // Report
-        if (keep)
-        {
-            LogInfo("Preserving " + QString::number(keep->Id()) + QString(" temporary=%1 replicated=%2 sky=%3 water=%4 fog=%5 envlight=%6 shadowsetup=%7 components=%8")
-                .arg(keep->IsTemporary() ? "true" : "false").arg(keep->IsReplicated() ? "true" : "false")
-                .arg(keep->Component("EC_Sky") || keep->Component("EC_SkyX") || keep->Component("EC_MeshmoonSky") ? "true" : "false")
-                .arg(keep->Component("EC_WaterPlane") || keep->Component("EC_Hydrax") || keep->Component("EC_MeshmoonWater") ? "true" : "false")
-                .arg(keep->Component("EC_Fog") ? "true" : "false").arg(keep->Component("EC_EnvironmentLight") ? "true" : "false")
-                .arg(keep->Component("EC_SceneShadowSetup") ? "true" : "false").arg(keep->NumComponents()));
-
-            Entity::ComponentMap comps = keep->Components();
+            // 2) Replicated temporary with the most components
+            if (!keep)
+            {
+                for(EntityList::const_iterator it = rocketEnvEnts.begin(); it != rocketEnvEnts.end(); ++it)
+                {
+                    const EntityPtr ent = (*it);
+                    if (ent->IsReplicated())
+                    {
+                        // Only pick this one if it has more components than the previous one.
+                        if (keep && ent->NumComponents() < keep->NumComponents())
+                            continue;
+                        keep = ent.get();
+                    }
+                }
+            }
+            if (!keep)
+                return;
+
+            // Report
+            LogInfo("Preserving " + Describe(keep));
+            const Entity::ComponentMap &comps = keep->Components();
             for(Entity::ComponentMap::const_iterator it = comps.begin(); it != comps.end(); ++it)
             {
                 ComponentPtr comp = it->second;
@@ -82,24 +98,260 @@ void MeshmoonSceneValidator::Validate(Scene *scene)
             }
 
             bool warned = false;
-            for(EntityList::iterator it = rocketEnvEnts.begin(); it != rocketEnvEnts.end(); ++it)
+            const entity_id_t keepId = keep->Id();
+            for(EntityList::const_iterator it = rocketEnvEnts.begin(); it != rocketEnvEnts.end(); ++it)
             {
                 EntityPtr ent = (*it);
-                if (ent->Id() != keep->Id())
+                if (ent->Id() == keepId)
+                    continue;
+                if (!warned)
                 {
-                    if (!warned)
-                    {
-                        LogWarning("[MeshmoonSceneValidator]: Deleting extraneous " + RocketEnvironmentEntityName + " Entities.");
-                        LogWarning("Having multiple environment entities may cause problems on the clients.");
-                        warned = true;
-                    }
-                    LogWarning(QString::number(ent->Id()) +  (ent->IsTemporary() ? " This Entity is temporary, so it probably originated from a loaded Meshmoon Layer." : ""));
+                    LogWarning("[MeshmoonSceneValidator]: Deleting extraneous " + MeshmoonSceneValidator::RocketEnvironmentEntityName + " Entities.");
+                    LogWarning("Having multiple environment entities may cause problems on the clients.");
+                    warned = true;
+                }
+                LogWarning(QString::number(ent->Id()) +  (ent->IsTemporary() ? " This Entity is temporary, so it probably originated from a loaded Meshmoon Layer." : ""));
+
+                entity_id_t id = ent->Id();
+                ent.reset();
+                scene->RemoveEntity(id);
+            }
+        }
+
+    private:
+        enum EnvironmentType
+        {
+            Sky = 0,
+            Water,
+            Fog,
+            EnvironmentLight,
+            ShadowSetup,
+            NumEnvironmentTypes
+        };
 
-                    entity_id_t id = ent->Id();
-                    ent.reset();
-                    scene->RemoveEntity(id);
+        /// Resolves the environment component type ids once, the components are registered by other plugins.
+        void ResolveTypes()
+        {
+            if (typesResolved_)
+                return;
+            typesResolved_ = true;
+
+            const char *typeNames[NumEnvironmentTypes][3] = {
+                { "EC_Sky", "EC_SkyX", "EC_MeshmoonSky" },
+                { "EC_WaterPlane", "EC_Hydrax", "EC_MeshmoonWater" },
+                { "EC_Fog", 0, 0 },
+                { "EC_EnvironmentLight", 0, 0 },
+                { "EC_SceneShadowSetup", 0, 0 }
+            };
+            for(int type = 0; type < NumEnvironmentTypes; ++type)
+            {
+                for(int i = 0; i < 3; ++i)
+                {
+                    if (!typeNames[type][i])
+                        continue;
+                    const u32 typeId = framework_->Scene()->ComponentTypeIdForTypeName(typeNames[type][i]);
+                    if (typeId != 0 && typeId != 0xffffffff)
+                        typeIds_[type] << typeId;
                 }
             }
         }
+
+        bool Has(Entity *ent, EnvironmentType type)
+        {
+            foreach(u32 typeId, typeIds_[type])
+                if (ent->Component(typeId).get())
+                    return true;
+            return false;
+        }
+
+        QString Describe(Entity *ent)
+        {
+            ResolveTypes();
+            return QString::number(ent->Id()) + QString(" temporary=%1 replicated=%2 sky=%3 water=%4 fog=%5 envlight=%6 shadowsetup=%7 components=%8")
+                .arg(ent->IsTemporary() ? "true" : "false").arg(ent->IsReplicated() ? "true" : "false")
+                .arg(Has(ent, Sky) ? "true" : "false").arg(Has(ent, Water) ? "true" : "false")
+                .arg(Has(ent, Fog) ? "true" : "false").arg(Has(ent, EnvironmentLight) ? "true" : "false")
+                .arg(Has(ent, ShadowSetup) ? "true" : "false").arg(ent->NumComponents());
+        }
+
+        Framework *framework_;
+        bool typesResolved_;
+        QList<u32> typeIds_[NumEnvironmentTypes];
+    };
+}
+
+MeshmoonSceneValidator::MeshmoonSceneValidator(Framework *framework) :
+    framework_(framework),
+    LC("[MeshmoonSceneValidator]: "),
+    validateScheduled_(false)
+{
+    AddRule(new RocketEnvironmentRule(framework));
+}
+
+MeshmoonSceneValidator::~MeshmoonSceneValidator()
+{
+    for(int i = 0; i < rules_.size(); ++i)
+        SAFE_DELETE(rules_[i].rule);
+    rules_.clear();
+}
+
+void MeshmoonSceneValidator::Validate(Scene *scene)
+{
+    if (!scene)
+    {
+        LogError("[MeshmoonSceneValidator]: Passed in scene is null!");
+        return;
+    }
+
+    MeshmoonSceneValidator validator(scene->GetFramework());
+    validator.SetScene(scene);
+    validator.Validate();
+}
+
+void MeshmoonSceneValidator::SetScene(Scene *scene)
+{
+    if (scene_ == scene)
+        return;
+    if (scene_)
+        disconnect(scene_, 0, this, 0);
+
+    scene_ = scene;
+    for(int i = 0; i < rules_.size(); ++i)
+        rules_[i].tracked.clear();
+    dirty_.clear();
+    if (!scene_)
+        return;
+
+    connect(scene_, SIGNAL(EntityCreated(Entity*, AttributeChange::Type)), SLOT(OnEntityCreated(Entity*, AttributeChange::Type)));
+    connect(scene_, SIGNAL(EntityRemoved(Entity*, AttributeChange::Type)), SLOT(OnEntityRemoved(Entity*, AttributeChange::Type)));
+    connect(scene_, SIGNAL(ComponentAdded(Entity*, IComponent*, AttributeChange::Type)), SLOT(OnComponentChanged(Entity*, IComponent*, AttributeChange::Type)));
+    connect(scene_, SIGNAL(ComponentRemoved(Entity*, IComponent*, AttributeChange::Type)), SLOT(OnComponentChanged(Entity*, IComponent*, AttributeChange::Type)));
+    connect(scene_, SIGNAL(AttributeChanged(IComponent*, IAttribute*, AttributeChange::Type)), SLOT(OnAttributeChanged(IComponent*, IAttribute*, AttributeChange::Type)));
+    MarkAllDirty();
+}
+
+void MeshmoonSceneValidator::AddRule(MeshmoonSceneRule *rule)
+{
+    if (!rule)
+        return;
+    RuleState state;
+    state.rule = rule;
+    rules_ << state;
+
+    // The new rule has not seen any of the existing entities.
+    MarkAllDirty();
+}
+
+void MeshmoonSceneValidator::MarkAllDirty()
+{
+    if (!scene_)
+        return;
+    const Scene::EntityMap &entities = scene_->Entities();
+    dirty_.reserve(dirty_.size() + (int)entities.size());
+    for(Scene::EntityMap::const_iterator iter = entities.begin(); iter != entities.end(); ++iter)
+        dirty_.insert(iter->first);
+}
+
+void MeshmoonSceneValidator::ScheduleValidate()
+{
+    if (validateScheduled_)
+        return;
+    validateScheduled_ = true;
+    QTimer::singleShot(0, this, SLOT(RunScheduledValidate()));
+}
+
+void MeshmoonSceneValidator::RunScheduledValidate()
+{
+    validateScheduled_ = false;
+    Validate();
+}
+
+void MeshmoonSceneValidator::Validate()
+{
+    if (!scene_ || dirty_.isEmpty())
+        return;
+
+    kNet::PolledTimer timer;
+    timer.Start();
+
+    // Rules can remove entities, which must not modify the set being iterated.
+    const QSet<entity_id_t> dirty = dirty_;
+    dirty_.clear();
+
+    QVector<EntityList> changed(rules_.size());
+    foreach(entity_id_t id, dirty)
+    {
+        EntityPtr entity = scene_->EntityById(id);
+        for(int i = 0; i < rules_.size(); ++i)
+        {
+            RuleState &state = rules_[i];
+            if (entity.get() && state.rule->Tracks(entity.get()))
+            {
+                state.tracked[id] = entity;
+                changed[i].push_back(entity);
+            }
+            else
+                state.tracked.remove(id);
+        }
+    }
+
+    int ruleRuns = 0;
+    for(int i = 0; i < rules_.size(); ++i)
+    {
+        if (changed[i].empty())
+            continue;
+
+        // Rules see the tracked entities in id order like FindEntitiesByName returns them, not in hash order.
+        RuleState &state = rules_[i];
+        QList<entity_id_t> ids = state.tracked.keys();
+        qSort(ids);
+        EntityList tracked;
+        foreach(entity_id_t id, ids)
+        {
+            EntityPtr entity = state.tracked.value(id).lock();
+            if (entity.get())
+                tracked.push_back(entity);
+        }
+        state.rule->Validate(scene_, tracked, changed[i]);
+        ++ruleRuns;
     }
+
+    const float msecs = timer.MSecsElapsed();
+    stats_.runs++;
+    stats_.checkedEntities += dirty.size();
+    stats_.ruleRuns += ruleRuns;
+    stats_.lastMsecs = msecs;
+    stats_.totalMsecs += msecs;
+    LogDebug(LC + QString("Checked %1 changed entities, ran %2/%3 rules in %4 msecs").arg(dirty.size()).arg(ruleRuns).arg(rules_.size()).arg(msecs, 0, 'f', 2));
+}
+
+void MeshmoonSceneValidator::OnEntityCreated(Entity *entity, AttributeChange::Type /*change*/)
+{
+    if (entity)
+        dirty_.insert(entity->Id());
+}
+
+void MeshmoonSceneValidator::OnEntityRemoved(Entity *entity, AttributeChange::Type /*change*/)
+{
+    if (!entity)
+        return;
+    const entity_id_t id = entity->Id();
+    dirty_.remove(id);
+    for(int i = 0; i < rules_.size(); ++i)
+        rules_[i].tracked.remove(id);
 }
+
+void MeshmoonSceneValidator::OnComponentChanged(Entity *entity, IComponent * /*component*/, AttributeChange::Type /*change*/)
+{
+    if (entity)
+        dirty_.insert(entity->Id());
+}
+
+void MeshmoonSceneValidator::OnAttributeChanged(IComponent *component, IAttribute * /*attribute*/, AttributeChange::Type /*change*/)
+{
+    // Only renames can change what the rules track, everything else is ignored as cheaply as possible.
+    if (component && component->TypeId() == EC_Name::TypeIdStatic() && component->ParentEntity())
+        dirty_.insert(component->ParentEntity()->Id());
+}
+
+/// @endcond
@@ -4,7 +4,7 @@
     Copyright 2013 Admino Technologies Ltd.
     All rights reserved.
 
-    @file   
+    @file
     @brief   */
 
 #pragma once
@@ -14,17 +14,106 @@
 #include "MeshmoonCommonFwd.h"
 #include "FrameworkFwd.h"
 #include "SceneFwd.h"
+#include "AttributeChangeType.h"
+
+#include <QObject>
+#include <QPointer>
+#include <QHash>
+#include <QSet>
+#include <QList>
 
 /// @cond PRIVATE
 
-class MESHMOON_COMMON_API MeshmoonSceneValidator
+/// Scene rule validated by MeshmoonSceneValidator.
+/** A rule tracks the entities it is interested in. It is run only when its tracked entities
+    have been added or changed since the last validation. */
+class MESHMOON_COMMON_API MeshmoonSceneRule
 {
 public:
+    virtual ~MeshmoonSceneRule() {}
+
+    /// Name of the rule for logging.
+    virtual QString Name() const = 0;
+
+    /// Returns if @c entity should be tracked by this rule.
+    /** Called for each added or changed entity, keep it cheap. */
+    virtual bool Tracks(Entity *entity) = 0;
+
+    /// Validates @c scene.
+    /** @param tracked All entities tracked by this rule.
+        @param changed Tracked entities that were added or changed since the last run. */
+    virtual void Validate(Scene *scene, const EntityList &tracked, const EntityList &changed) = 0;
+};
+
+/// Incremental Meshmoon scene validator.
+/** Entities are marked dirty as they are created, renamed or their components change, validation
+    only checks the dirty entities against the rules. Rules whose tracked entities did not change
+    are not run. By default removes extra "RocketEnvironment" entities, see AddRule for adding more rules. */
+class MESHMOON_COMMON_API MeshmoonSceneValidator : public QObject
+{
+Q_OBJECT
+
+public:
+    explicit MeshmoonSceneValidator(Framework *framework);
+    ~MeshmoonSceneValidator();
+
     /// Rocket Environment Entity name.
     static QString RocketEnvironmentEntityName;
 
-    /// Validates Meshmoon scene.
+    /// Validates all entities of Meshmoon @c scene with the default rules.
     static void Validate(Scene *scene);
+
+    /// Starts tracking @c scene, all existing entities are checked on the next Validate.
+    void SetScene(Scene *scene);
+
+    /// Adds @c rule, the validator takes ownership. All entities are checked against it on the next Validate.
+    void AddRule(MeshmoonSceneRule *rule);
+
+    struct Stats
+    {
+        uint runs;
+        uint checkedEntities;   ///< Dirty entities checked against the rules.
+        uint ruleRuns;
+        float lastMsecs;
+        float totalMsecs;
+
+        Stats() : runs(0), checkedEntities(0), ruleRuns(0), lastMsecs(0.f), totalMsecs(0.f) {}
+    };
+    const Stats &Statistics() const { return stats_; }
+
+public slots:
+    /// Validates the entities that changed since the last run.
+    void Validate();
+
+    /// Validates on the next main loop iteration, multiple calls before it are coalesced.
+    void ScheduleValidate();
+
+private slots:
+    void RunScheduledValidate();
+
+    void OnEntityCreated(Entity *entity, AttributeChange::Type change);
+    void OnEntityRemoved(Entity *entity, AttributeChange::Type change);
+    void OnComponentChanged(Entity *entity, IComponent *component, AttributeChange::Type change);
+    void OnAttributeChanged(IComponent *component, IAttribute *attribute, AttributeChange::Type change);
+
+private:
+    struct RuleState
+    {
+        MeshmoonSceneRule *rule;
+        QHash<entity_id_t, EntityWeakPtr> tracked;
+
+        RuleState() : rule(0) {}
+    };
+
+    void MarkAllDirty();
+
+    Framework *framework_;
+    QString LC;
+    QPointer<Scene> scene_;
+    QList<RuleState> rules_;
+    QSet<entity_id_t> dirty_;
+    bool validateScheduled_;
+    Stats stats_;
 };
 
 /// @endcond
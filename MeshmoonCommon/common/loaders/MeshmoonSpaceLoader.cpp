@@ -5,6 +5,7 @@
 #include "IRenderer.h"
 #include "UniqueIdGenerator.h"
 #include "LoggingFunctions.h"
+#include "Math/MathFunc.h"
 
 #include "common/layers/MeshmoonLayers.h"
 #include "common/loaders/MeshmoonSceneValidator.h"
@@ -21,8 +22,12 @@ MeshmoonSpaceLoader::MeshmoonSpaceLoader(Framework *framework, const QString &so
     LC("[MeshmoonSpaceLoader]: "),
     framework_(framework),
     source_(source),
-    layers_(new MeshmoonLayers(framework))
+    layers_(new MeshmoonLayers(framework)),
+    validator_(new MeshmoonSceneValidator(framework))
 {
+    // Layers loaded later, eg. by streaming, are validated incrementally.
+    connect(layers_, SIGNAL(LayerLoaded(const Meshmoon::SceneLayer&)), validator_, SLOT(ScheduleValidate()));
+
     MeshmoonHttpPlugin *http = framework_->Module<MeshmoonHttpPlugin>();
     if (http)
     {
@@ -36,6 +41,7 @@ MeshmoonSpaceLoader::MeshmoonSpaceLoader(Framework *framework, const QString &so
 MeshmoonSpaceLoader::~MeshmoonSpaceLoader()
 {
     SAFE_DELETE(layers_);
+    SAFE_DELETE(validator_);
     Clear();
 }
 
@@ -77,13 +83,24 @@ void MeshmoonSpaceLoader::CheckCompleted()
             layers << spaces_[si]->LayerByIndex(li)->ToSceneLayer(generator.AllocateReplicated());
     }
     
-    // Add prepared layers and load them.
+    // Track entities as the layers add them, validation then only checks what changed.
+    if (framework_->Renderer())
+        validator_->SetScene(framework_->Renderer()->MainCameraScene());
+
+    // Add prepared layers and load them. With --meshmoonLayerStreaming <radius> layers
+    // are streamed in and out around the main camera instead of loading everything at once.
     layers_->Add(layers);
+    if (framework_->HasCommandLineParameter("--meshmoonLayerStreaming"))
+    {
+        QStringList params = framework_->CommandLineParameters("--meshmoonLayerStreaming");
+        float defaultRadius = (!params.isEmpty() ? params.first().toFloat() : 0.f);
+        layers_->SetStreamingParameters(defaultRadius, Max(10.f, defaultRadius * 0.1f), 8.f);
+        layers_->SetStreamingEnabled(true);
+    }
     layers_->Load();
 
     // Validate. Removes extra "RocketEnvironmentEntity" etc.
-    if (framework_->Renderer())
-        MeshmoonSceneValidator::Validate(framework_->Renderer()->MainCameraScene());
+    validator_->Validate();
     
     // Clear state
     Clear();
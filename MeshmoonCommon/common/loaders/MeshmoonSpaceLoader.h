@@ -45,6 +45,7 @@ private:
     QString source_;
     
     MeshmoonLayers *layers_;
+    MeshmoonSceneValidator *validator_;
     Meshmoon::SpaceList spaces_;
 };
 
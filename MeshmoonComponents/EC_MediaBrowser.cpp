@@ -112,7 +112,10 @@ EC_MediaBrowser::EC_MediaBrowser(Scene *scene) :
     permissionRun_(false),
     vlcLogging_(false),
     updateDelta_(0.0f),
+    lastInteraction_(-1.0f),
     volume_(-1),
+    resumeMsec_(-1),
+    resumePlaying_(false),
     ipcProcess(0),
     ipcSocket(0),
     size(QSize(0,0)),
@@ -240,6 +243,13 @@ void EC_MediaBrowser::OnIpcData()
                 if (applyMaterial)
                     ApplyMaterial(true);
 
+                // Continue from the position the player was hibernated at.
+                if (resumeMsec_ >= 0 && state_.seekable && (state_.state == MediaPlayerProtocol::Playing || state_.state == MediaPlayerProtocol::Paused))
+                {
+                    Seek(resumeMsec_);
+                    resumeMsec_ = -1;
+                }
+
                 UpdateWidgetState();
                 break;
             }
@@ -310,9 +320,10 @@ void EC_MediaBrowser::LoadSource(const QString &source)
         // Set looping boolean
         SendLooping();
 
-        // Play now if enabled
-        if (playOnLoad.Get())
+        // Play now if enabled or if playing when hibernated.
+        if (playOnLoad.Get() || resumePlaying_)
             Play();
+        resumePlaying_ = false;
     }
     else
         Init();
@@ -539,6 +550,8 @@ void EC_MediaBrowser::Reset(bool immediateShutdown)
     ResetInput();
 
     state_ = MediaPlayerProtocol::PlayerState();
+    resumeMsec_ = -1;
+    resumePlaying_ = false;
         
     disconnect(framework->Ui()->MainWindow(), SIGNAL(WindowResizeEvent(int, int)), this, SLOT(OnWindowResized(int, int)));
 }
@@ -1393,7 +1406,13 @@ void EC_MediaBrowser::SetRunPermission(bool permitted)
     if (permissionRun_)
         Init();
     else
-        Reset(false); /// @todo Leave the current texture on the object.
+    {
+        // Hibernate: close the process but leave the last frame texture and material on the target.
+        resumePlaying_ = (state_.state == MediaPlayerProtocol::Playing || state_.state == MediaPlayerProtocol::Buffering);
+        resumeMsec_ = (state_.seekable && state_.mediaTimeMsec > 0 ? state_.mediaTimeMsec : -1);
+        ResetPlayer(false);
+        ResetInput();
+    }
     ApplyMaterial(true);
 }
 
@@ -1459,6 +1478,7 @@ void EC_MediaBrowser::OnMouseEventReceived(MouseEvent *mouseEvent)
 
     if (widget_ && !widget_->isVisible())
         FocusPlayer();
+    lastInteraction_ = framework->Frame()->WallClockTime();
         
     QPoint posPlayer((float)size.width()*result->u, (float)size.height()*result->v);
     bool isOnControls = (posPlayer.y() >= size.height() - 32);
@@ -1562,8 +1582,9 @@ void EC_MediaBrowser::OnUpdate(float frametime)
             BlitToTexture();
     }
     
-    // Resizes texture if there are changes.
-    ResizeTexture(size.width(), size.height());
+    // Resizes texture if there are changes. Hibernated player keeps its last frame as is.
+    if (permissionRun_)
+        ResizeTexture(size.width(), size.height());
 }
 
 void EC_MediaBrowser::UpdateVolume()
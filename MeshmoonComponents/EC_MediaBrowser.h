@@ -215,8 +215,13 @@ private:
 
     /// MeshmoonComponents sets permission to run this component.
     /// This limits the processes we have running at any given time.
+    /** When permission is taken away the player process is closed but the last rendered frame is left on the target.
+        Playback continues from the same position when permission is given back. */
     void SetRunPermission(bool permitted);
 
+    /// Returns wall clock time of the last input to the player, negative if never.
+    float LastInteraction() const { return lastInteraction_; }
+
     quint16 IpcPort();
     quint16 FreeIpcPort();
 
@@ -269,8 +274,12 @@ private:
     bool vlcLogging_;
 
     float updateDelta_;
+    float lastInteraction_;
     int volume_;
 
+    qint64 resumeMsec_;     ///< Position to seek to after the player resumes from hibernation, negative if none.
+    bool resumePlaying_;    ///< Playback was on when the player was hibernated.
+
     QTimer resizeTimer_;
     InputContextPtr inputContext_;
 
@@ -12,8 +12,8 @@
 #include "EC_MeshmoonAvatar.h"
 #include "MeshmoonComponents.h"
 
-#include "MeshmoonAssimpPlugin.h"
-#include "MeshmoonOpenAssetImporter.h"
+#include "MeshmoonAvatarGeometryCache.h"
+#include "MeshmoonAssimpPluginFwd.h"
 
 #include "Framework.h"
 #include "CoreDefines.h"
@@ -28,11 +28,6 @@
 #include "IAssetTransfer.h"
 #include "AssetRefListener.h"
 
-#include "OgreMeshAsset.h"
-#include "OgreSkeletonAsset.h"
-#include "OgreMeshAsset.h"
-#include "OgreSkeletonSerializer.h"
-
 #include "EC_Placeable.h"
 #include "EC_Mesh.h"
 
@@ -44,7 +39,6 @@ static const QStringList MESHMOONAVATAR_SUFFIXES = QStringList() << ".dae" << ".
 EC_MeshmoonAvatar::EC_MeshmoonAvatar(Scene* scene) :
     IComponent(scene),
     INIT_ATTRIBUTE_VALUE(appearanceRef, "Appearance ref", AssetReference("", "Binary")),
-    importer_(0),
     assetsToDownload_(0)
 {
 }
@@ -54,7 +48,7 @@ EC_MeshmoonAvatar::~EC_MeshmoonAvatar()
     assetData_.Reset();
     jsonData_.Reset();
     avatarAssetListener_.reset();
-    SAFE_DELETE(importer_);
+    ReleaseGeometry();
 }
 
 void EC_MeshmoonAvatar::AttributesChanged()
@@ -172,10 +166,12 @@ void EC_MeshmoonAvatar::OnAvatarAppearanceLoaded(AssetPtr asset)
         return;
     }
     BinaryAsset *binaryAsset = dynamic_cast<BinaryAsset*>(asset.get());
+    AssetPtr diskAsset;
     if (!binaryAsset)
     {
         // This asset might have already been with a mesh type. Load a fake binary data from disk.
         binaryAsset = new BinaryAsset(framework->Asset(), "Binary", asset->Name());
+        diskAsset = AssetPtr(binaryAsset);
         if (!binaryAsset->LoadFromFile(asset->DiskSource()))
         {
             LogError("MeshmoonAvatar: Loaded asset is not type of BinaryAsset!");
@@ -184,70 +180,16 @@ void EC_MeshmoonAvatar::OnAvatarAppearanceLoaded(AssetPtr asset)
         }
     }
 
-    // Form our generated asset references
-    QString fullRefWithoutProtocol;
-    framework->Asset()->ParseAssetRef(asset->Name(), 0, 0, 0, &fullRefWithoutProtocol);
-    if (fullRefWithoutProtocol.isEmpty())
-        fullRefWithoutProtocol = asset->Name();
-    
-    QString meshAssetName = fullRefWithoutProtocol; 
-    QString skelAssetName = fullRefWithoutProtocol;
-    
-    meshAssetName = "generated://" + meshAssetName.mid(0, meshAssetName.lastIndexOf(".")) + ".mesh";
-    skelAssetName = "generated://" + skelAssetName.mid(0, skelAssetName.lastIndexOf(".")) + ".skeleton";
-
-    // Check if this asset is already loaded
-    AssetPtr existingMesh = framework->Asset()->GetAsset(meshAssetName);
-    AssetPtr existingSkel = framework->Asset()->GetAsset(skelAssetName);
-    
     assetData_.binaryAsset = asset;
-    if (!existingMesh || !existingSkel)
-    {
-        if (existingMesh.get())
-            LogWarning("MeshmoonAvatar: Mesh already imported once, overwriting current: " + meshAssetName);
-        if (existingSkel.get())
-            LogWarning("MeshmoonAvatar: Skeleton already imported once, overwriting current: " + skelAssetName);
-            
-        assetData_.meshAsset = existingMesh.get() ? existingMesh : framework->Asset()->CreateNewAsset("OgreMesh", meshAssetName);
-        assetData_.skeletonAsset = existingSkel.get() ? existingSkel : framework->Asset()->CreateNewAsset("OgreSkeleton", skelAssetName);
-
-        try
-        {
-            SAFE_DELETE(importer_);
-            importer_ = new MeshmoonOpenAssetImporter(framework->Asset());
-            connect(importer_, SIGNAL(ImportDone(MeshmoonOpenAssetImporter*, bool, const ImportInfo&)), 
-                SLOT(OnImportCompleted(MeshmoonOpenAssetImporter*, bool, const ImportInfo&)));
-            if (!importer_->Import(&binaryAsset->data[0], binaryAsset->data.size(), binaryAsset->Name(), binaryAsset->DiskSource(), assetData_.meshAsset, assetData_.skeletonAsset))
-                throw Ogre::Exception(Ogre::Exception::ERR_INTERNAL_ERROR, "Internal Assimp importer error.", "");
-        }
-        catch(Ogre::Exception &ex)
-        {
-            LogError("MeshmoonAvatar: Failed to load avatar data from " + asset->Name() + ": " + QString::fromStdString(ex.getDescription()));
-            SAFE_DELETE(importer_);
-        }
-    }
-    else
-    {
-        assetData_.meshAsset = existingMesh;
-        assetData_.skeletonAsset = existingSkel;
-        
-        ImportInfo colladaInfo;
-        MeshmoonAssimpPlugin *assimpPlugin = framework->GetModule<MeshmoonAssimpPlugin>();
-        if (assimpPlugin)
-        {
-            if (assimpPlugin->HasImportInformation(asset->Name()))
-                colladaInfo = assimpPlugin->ImportInformation(asset->Name());
-            else
-                LogWarning("MeshmoonAvatar: Mesh and Skeleton assets already loaded but could not find materials: " + asset->Name());
-        }
-
-        OnImportCompleted(0, true, colladaInfo);
-    }
+    AcquireGeometry(binaryAsset);
 }
 
 void EC_MeshmoonAvatar::LoadAvatarAsset(QString assetUrl)
 {
-    framework->Asset()->ForgetAsset(assetUrl, false);
+    // Reuse geometry and animation files already loaded by other avatars, reload if loaded as another type.
+    AssetPtr existing = framework->Asset()->GetAsset(assetUrl);
+    if (existing.get() && !dynamic_cast<BinaryAsset*>(existing.get()))
+        framework->Asset()->ForgetAsset(existing, false);
     AssetTransferPtr transfer = framework->Asset()->RequestAsset(assetUrl, "Binary");
     connect(transfer.get(), SIGNAL(Succeeded(AssetPtr)), this, SLOT(OnTransferSucceeded(AssetPtr)), Qt::UniqueConnection);
     connect(transfer.get(), SIGNAL(Failed(IAssetTransfer*, QString)), this, SLOT(OnTransferFailed(IAssetTransfer*, QString)), Qt::UniqueConnection);
@@ -289,110 +231,80 @@ void EC_MeshmoonAvatar::OnAvatarAppearanceFailed(IAssetTransfer* /*transfer*/, Q
 
 void EC_MeshmoonAvatar::AssetsLoaded()
 {
-    QString meshAssetName = jsonData_.geometryFile;
-    QString skelAssetName = jsonData_.geometryFile;
-
-    meshAssetName = "generated://" + meshAssetName.mid(0, meshAssetName.lastIndexOf(".")) + ".mesh";
-    skelAssetName = "generated://" + skelAssetName.mid(0, skelAssetName.lastIndexOf(".")) + ".skeleton";
-
-    // Check if this asset is already loaded
-    AssetPtr existingMesh = framework->Asset()->GetAsset(meshAssetName);
-    AssetPtr existingSkel = framework->Asset()->GetAsset(skelAssetName);
-
-    // If assets are loaded, forget them to ensure correct animation data.
-    if (existingMesh)
+    BinaryAsset *binaryAsset = dynamic_cast<BinaryAsset*>(jsonData_.geometryAsset.get());
+    if (!binaryAsset)
     {
-        framework->Asset()->ForgetAsset(existingMesh, false);
-        existingMesh.reset();
+        LogError("MeshmoonAvatar: Failed to load avatar geometry: " + jsonData_.geometryFile);
+        return;
     }
-    if (existingSkel)
+    AcquireGeometry(binaryAsset, jsonData_.mainAnimation, jsonData_.animationAssets);
+}
+
+MeshmoonAvatarGeometryCache *EC_MeshmoonAvatar::GeometryCache() const
+{
+    MeshmoonComponents *module = (framework ? framework->GetModule<MeshmoonComponents>() : 0);
+    return (module ? module->AvatarGeometryCache() : 0);
+}
+
+void EC_MeshmoonAvatar::AcquireGeometry(BinaryAsset *geometry, const QString &mainAnimation, const QMap<QString, AssetPtr> &animations)
+{
+    MeshmoonAvatarGeometryCache *cache = GeometryCache();
+    if (!cache)
     {
-        framework->Asset()->ForgetAsset(existingSkel, false);
-        existingSkel.reset();
+        LogError("MeshmoonAvatar: Cannot import avatar, MeshmoonComponents module not available.");
+        return;
     }
+    connect(cache, SIGNAL(GeometryReady(const QString&, bool)), this, SLOT(OnGeometryReady(const QString&, bool)), Qt::UniqueConnection);
 
-    if (!existingMesh || !existingSkel)
+    // Acquire before releasing the old geometry, so reapplying the same appearance does not reimport it.
+    QString key = cache->Acquire(geometry, mainAnimation, animations);
+    ReleaseGeometry();
+    if (key.isEmpty())
     {
-        try
-        {
-            SAFE_DELETE(importer_);
-            importer_ = new MeshmoonOpenAssetImporter(framework->Asset());
-
-            BinaryAsset *binaryAsset = dynamic_cast<BinaryAsset*>(jsonData_.geometryAsset.get());
-            if(!binaryAsset)
-                return;
-
-            assetData_.meshAsset = existingMesh.get() ? existingMesh : framework->Asset()->CreateNewAsset("OgreMesh", meshAssetName);
-            assetData_.skeletonAsset = existingSkel.get() ? existingSkel : framework->Asset()->CreateNewAsset("OgreSkeleton", skelAssetName);
-
-            QList<AnimationAssetData> animationAssets;
-
-            // Create animation asset data list
-            QMap<QString, AssetPtr>::iterator it;
-            for(it = jsonData_.animationAssets.begin(); it != jsonData_.animationAssets.end(); ++it)
-            {
-                QString name = it.key();
-                AssetPtr asset = it.value();
-
-                BinaryAsset *binaryAsset = dynamic_cast<BinaryAsset*>(asset.get());
-                if(!binaryAsset)
-                    return;
-
-                AnimationAssetData data;
-                data.data_ = &binaryAsset->data[0];
-                data.numBytes = binaryAsset->data.size();
-                data.assetRef  = binaryAsset->Name();
-                data.diskSource = binaryAsset->DiskSource();
-                data.name = name;
-
-                animationAssets.push_back(data);
-            }
-
-            connect(importer_, SIGNAL(ImportDone(MeshmoonOpenAssetImporter*, bool, const ImportInfo&)), 
-                SLOT(OnImportCompleted(MeshmoonOpenAssetImporter*, bool, const ImportInfo&)));
-            if (!importer_->ImportWithExternalAnimations(&binaryAsset->data[0], binaryAsset->data.size(), binaryAsset->Name(), binaryAsset->DiskSource(), assetData_.meshAsset, assetData_.skeletonAsset, jsonData_.mainAnimation, animationAssets))
-                throw Ogre::Exception(Ogre::Exception::ERR_INTERNAL_ERROR, "Internal Assimp importer error.", "");
-        }
-        catch(Ogre::Exception /*&ex*/)
-        {
-            LogError("MeshmoonAvatar: Failed to load avatar data.");
-            SAFE_DELETE(importer_);
-        }
+        LogError("MeshmoonAvatar: Failed to load avatar data from " + geometry->Name());
+        return;
     }
-    else
-    {
-        assetData_.meshAsset = existingMesh;
-        assetData_.skeletonAsset = existingSkel;
+    geometryKey_ = key;
 
-        ImportInfo colladaInfo;
-        MeshmoonAssimpPlugin *assimpPlugin = framework->GetModule<MeshmoonAssimpPlugin>();
-        if (assimpPlugin)
-        {
-            if (assimpPlugin->HasImportInformation(jsonData_.geometryAsset->Name()))
-                colladaInfo = assimpPlugin->ImportInformation(jsonData_.geometryAsset->Name());
-            else
-                LogWarning("MeshmoonAvatar: Mesh and Skeleton assets already loaded but could not find materials: " + jsonData_.geometryAsset->Name());
-        }
+    // Already imported by another avatar, otherwise OnGeometryReady is called when the import finishes.
+    const MeshmoonAvatarGeometry *shared = cache->Geometry(key);
+    if (shared && shared->ready)
+        ApplyGeometry(shared->importInfo);
+}
 
-        OnImportCompleted(0, true, colladaInfo);
-    }
+void EC_MeshmoonAvatar::ReleaseGeometry()
+{
+    if (geometryKey_.isEmpty())
+        return;
+    MeshmoonAvatarGeometryCache *cache = GeometryCache();
+    if (cache)
+        cache->Release(geometryKey_);
+    geometryKey_.clear();
 }
 
-void EC_MeshmoonAvatar::OnImportCompleted(MeshmoonOpenAssetImporter* /*importer*/, bool success, const ImportInfo &colladaInfo)
+void EC_MeshmoonAvatar::OnGeometryReady(const QString &key, bool success)
 {
+    if (key.isEmpty() || key != geometryKey_)
+        return;
     if (!success)
     {
-        if (importer_)
-            importer_->deleteLater();
-        importer_ = 0;
+        // Cache has already dropped the reference.
+        geometryKey_.clear();
+        LogError("MeshmoonAvatar: Failed to import avatar data.");
         return;
     }
 
-    // Store collada info if not known.
-    MeshmoonAssimpPlugin *assimpPlugin = framework->GetModule<MeshmoonAssimpPlugin>();
-    if (assetData_.binaryAsset.get() && assimpPlugin && !assimpPlugin->HasImportInformation(assetData_.binaryAsset->Name()))
-        assimpPlugin->AddImportInformation(assetData_.binaryAsset->Name(), colladaInfo);
-        
+    const MeshmoonAvatarGeometry *shared = GeometryCache()->Geometry(key);
+    if (shared)
+        ApplyGeometry(shared->importInfo);
+}
+
+void EC_MeshmoonAvatar::ApplyGeometry(const ImportInfo &colladaInfo)
+{
+    const MeshmoonAvatarGeometry *shared = GeometryCache()->Geometry(geometryKey_);
+    if (!shared || !ParentEntity())
+        return;
+
     // Check that needed components are created.
     ComponentPtr placeable = ParentEntity()->GetOrCreateComponent(EC_Placeable::TypeNameStatic());
     EC_Mesh *mesh = dynamic_cast<EC_Mesh*>(ParentEntity()->GetOrCreateComponent(EC_Mesh::TypeNameStatic()).get());
@@ -400,8 +312,8 @@ void EC_MeshmoonAvatar::OnImportCompleted(MeshmoonOpenAssetImporter* /*importer*
     placeable->SetTemporary(true);
     mesh->SetTemporary(true);
 
-    // Assign Ogre refs and other information.
-    if (assetData_.meshAsset->IsLoaded())
+    // Assign Ogre refs and other information. Each Ogre entity of the shared mesh has its own skeleton instance and animation states.
+    if (shared->meshAsset->IsLoaded())
     {
         mesh->SetPlaceable(placeable);
         if(jsonData_.loaded)
@@ -414,12 +326,12 @@ void EC_MeshmoonAvatar::OnImportCompleted(MeshmoonOpenAssetImporter* /*importer*
         }
         else
             mesh->nodeTransformation.Set(colladaInfo.transform, AttributeChange::LocalOnly);
-        mesh->meshRef.Set(AssetReference(assetData_.meshAsset->Name(), assetData_.meshAsset->Type()), AttributeChange::LocalOnly);
+        mesh->meshRef.Set(AssetReference(shared->meshAsset->Name(), shared->meshAsset->Type()), AttributeChange::LocalOnly);
     }
-    if (assetData_.skeletonAsset->IsLoaded())
+    if (shared->skeletonAsset->IsLoaded())
     {
         ParentEntity()->GetOrCreateComponent("EC_AnimationController");
-        mesh->skeletonRef.Set(AssetReference(assetData_.skeletonAsset->Name(), assetData_.skeletonAsset->Type()), AttributeChange::LocalOnly);
+        mesh->skeletonRef.Set(AssetReference(shared->skeletonAsset->Name(), shared->skeletonAsset->Type()), AttributeChange::LocalOnly);
     }
     if (!colladaInfo.materials.empty())
     {
@@ -449,9 +361,4 @@ void EC_MeshmoonAvatar::OnImportCompleted(MeshmoonOpenAssetImporter* /*importer*
 
     // Fire signal to inform that avatar is ready to be used.
     emit AvatarReady();
-    
-    // Free importer, has lots of assimp internals allocated.
-    if (importer_)
-        importer_->deleteLater();
-    importer_ = 0;
 }
@@ -23,20 +23,16 @@
 
 /// @cond PRIVATE
 
-class MeshmoonOpenAssetImporter;
+class MeshmoonAvatarGeometryCache;
 struct ImportInfo;
 
 struct MeshmoonAvatarData
 {
     AssetPtr binaryAsset;
-    AssetPtr meshAsset;
-    AssetPtr skeletonAsset;
     
     void Reset()
     {
         binaryAsset.reset();
-        meshAsset.reset();
-        skeletonAsset.reset();
     }
 };
 
@@ -96,8 +92,8 @@ private slots:
     /// Avatar asset failed to load.
     void OnAvatarAppearanceFailed(IAssetTransfer* transfer, QString reason);
     
-    /// Avatar file was imported.
-    void OnImportCompleted(MeshmoonOpenAssetImporter *importer, bool success, const ImportInfo &colladaInfo);
+    /// Shared avatar geometry was imported.
+    void OnGeometryReady(const QString &key, bool success);
     
     /// Asset transfer succeeded
     void OnTransferSucceeded(AssetPtr asset);
@@ -120,6 +116,18 @@ private:
 
     void AssetsLoaded();
 
+    /// Acquires the shared geometry for the appearance, applies it when the import is ready.
+    void AcquireGeometry(BinaryAsset *geometry, const QString &mainAnimation = "", const QMap<QString, AssetPtr> &animations = QMap<QString, AssetPtr>());
+
+    /// Releases the currently used shared geometry.
+    void ReleaseGeometry();
+
+    /// Sets up mesh and skeleton refs from the shared geometry.
+    void ApplyGeometry(const ImportInfo &colladaInfo);
+
+    /// Returns the shared geometry cache or null if MeshmoonComponents is not loaded.
+    MeshmoonAvatarGeometryCache *GeometryCache() const;
+
     /// Ref listener for the avatar asset
     AssetRefListenerPtr avatarAssetListener_;
     
@@ -132,8 +140,8 @@ private:
     // Json data
     MeshmoonAvatarJsonData jsonData_;
     
-    /// Assimp importer for collada files.
-    MeshmoonOpenAssetImporter *importer_;
+    /// Key of the shared geometry in MeshmoonAvatarGeometryCache, empty if none.
+    QString geometryKey_;
 
     int assetsToDownload_;
 };
@@ -116,6 +116,7 @@ EC_WebBrowser::EC_WebBrowser(Scene *scene) :
     permissionRun_(false),
     updateDelta_(0.0f),
     syncDelta_(0.0f),
+    lastInteraction_(-1.0f),
     ipcProcess(0),
     ipcSocket(0)
 {
@@ -1024,7 +1025,11 @@ void EC_WebBrowser::SetRunPermission(bool permitted)
     if (permissionRun_)
         Init();
     else
-        Reset(false); /// @todo Leave the current texture on the object.
+    {
+        // Hibernate: close the process but leave the last frame texture and material on the target.
+        ResetBrowser(false);
+        ResetInput();
+    }
     ApplyMaterial(true);
 }
 
@@ -1290,6 +1295,7 @@ void EC_WebBrowser::OnMouseEventReceived(MouseEvent *mouseEvent)
 
     if (!inputState_.focus)
         FocusBrowser();
+    lastInteraction_ = framework->Frame()->WallClockTime();
 
     QPoint posBrowser((float)size.Get().x()*result->u, (float)size.Get().y()*result->v);
     switch(mouseEvent->eventType)
@@ -1425,6 +1431,7 @@ void EC_WebBrowser::OnKeyEventReceived(KeyEvent *keyEvent)
 
     PROFILE(EC_WebBrowser_OnKeyEventReceived)
     QKeyEvent *e = keyEvent->qtEvent;
+    lastInteraction_ = framework->Frame()->WallClockTime();
  
     quint8 type = 1;    // KT_KEYDOWN
     if (e->type() == QEvent::KeyRelease)
@@ -1604,8 +1611,9 @@ void EC_WebBrowser::OnUpdate(float frametime)
             Invalidate();
     }
     
-    // Resizes texture if there are changes.
-    ResizeTexture(size.Get().x(), size.Get().y(), true);
+    // Resizes texture if there are changes. Hibernated browser keeps its last frame as is.
+    if (permissionRun_)
+        ResizeTexture(size.Get().x(), size.Get().y(), true);
 }
 
 void EC_WebBrowser::OnServerMessageReceived(UserConnection *connection, kNet::packet_id_t, kNet::message_id_t id, const char* data, size_t numBytes)
@@ -159,7 +159,12 @@ protected:
     
     /// MeshmoonComponents sets permission to run this component.
     /// This limits the processes we have running at any given time.
+    /** When permission is taken away the browser process is closed but the last rendered frame is left on the target,
+        the process is started again and the page reloaded when permission is given back. */
     void SetRunPermission(bool permitted);
+
+    /// Returns wall clock time of the last input to the browser, negative if never.
+    float LastInteraction() const { return lastInteraction_; }
     
     quint16 IpcPort();
     quint16 FreeIpcPort();
@@ -225,6 +230,7 @@ private:
     
     float updateDelta_;
     float syncDelta_;
+    float lastInteraction_;
     
     ECWebBrowserNetwork::MsgMouseMove syncMoveMsg_;
 
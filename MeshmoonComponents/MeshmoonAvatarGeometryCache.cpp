@@ -0,0 +1,297 @@
+/**
+    @author Adminotech Ltd.
+
+    Copyright Adminotech Ltd.
+    All rights reserved.
+
+    @file   MeshmoonAvatarGeometryCache.cpp
+    @brief  Imported avatar geometry shared between EC_MeshmoonAvatar instances. */
+
+#include "StableHeaders.h"
+#include "DebugOperatorNew.h"
+
+#include "MeshmoonAvatarGeometryCache.h"
+#include "MeshmoonOpenAssetImporter.h"
+
+#include "Framework.h"
+#include "CoreDefines.h"
+#include "LoggingFunctions.h"
+
+#include "AssetAPI.h"
+#include "IAsset.h"
+#include "BinaryAsset.h"
+
+#include "OgreMeshAsset.h"
+#include "OgreSkeletonAsset.h"
+
+#include <OgreMesh.h>
+#include <OgreSubMesh.h>
+#include <OgreSkeleton.h>
+#include <OgreAnimation.h>
+#include <OgreAnimationTrack.h>
+#include <OgreKeyFrame.h>
+
+#include <QCryptographicHash>
+
+#include "MemoryLeakCheck.h"
+
+namespace
+{
+    size_t VertexDataBytes(const Ogre::VertexData *vertexData)
+    {
+        size_t bytes = 0;
+        if (!vertexData || !vertexData->vertexBufferBinding)
+            return bytes;
+        const Ogre::VertexBufferBinding::VertexBufferBindingMap &bindings = vertexData->vertexBufferBinding->getBindings();
+        for(Ogre::VertexBufferBinding::VertexBufferBindingMap::const_iterator iter = bindings.begin(); iter != bindings.end(); ++iter)
+            if (!iter->second.isNull())
+                bytes += iter->second->getSizeInBytes();
+        return bytes;
+    }
+
+    size_t MeshBufferBytes(const Ogre::Mesh *mesh)
+    {
+        if (!mesh)
+            return 0;
+        size_t bytes = VertexDataBytes(mesh->sharedVertexData);
+        for(ushort i = 0; i < mesh->getNumSubMeshes(); ++i)
+        {
+            const Ogre::SubMesh *submesh = mesh->getSubMesh(i);
+            if (!submesh->useSharedVertices)
+                bytes += VertexDataBytes(submesh->vertexData);
+            if (submesh->indexData && !submesh->indexData->indexBuffer.isNull())
+                bytes += submesh->indexData->indexBuffer->getSizeInBytes();
+        }
+        return bytes;
+    }
+
+    size_t SkeletonAnimationBytes(const Ogre::Skeleton *skeleton)
+    {
+        if (!skeleton)
+            return 0;
+        size_t bytes = 0;
+        for(ushort i = 0; i < skeleton->getNumAnimations(); ++i)
+        {
+            Ogre::Animation::NodeTrackIterator tracks = skeleton->getAnimation(i)->getNodeTrackIterator();
+            while(tracks.hasMoreElements())
+                bytes += tracks.getNext()->getNumKeyFrames() * sizeof(Ogre::TransformKeyFrame);
+        }
+        return bytes;
+    }
+
+    QString BaseName(const QString &assetRef)
+    {
+        QString name = assetRef.mid(assetRef.lastIndexOf("/") + 1);
+        return name.mid(0, name.lastIndexOf("."));
+    }
+}
+
+MeshmoonAvatarGeometryCache::MeshmoonAvatarGeometryCache(Framework *framework, QObject *parent) :
+    QObject(parent),
+    framework_(framework)
+{
+}
+
+MeshmoonAvatarGeometryCache::~MeshmoonAvatarGeometryCache()
+{
+    // Assets are owned by AssetAPI, only the running imports are ours.
+    for(QHash<QString, MeshmoonAvatarGeometry>::iterator iter = geometries_.begin(); iter != geometries_.end(); ++iter)
+        SAFE_DELETE(iter.value().importer);
+    geometries_.clear();
+}
+
+QString MeshmoonAvatarGeometryCache::Key(const BinaryAsset *geometry, const QString &mainAnimation, const QMap<QString, AssetPtr> &animations)
+{
+    if (!geometry || geometry->data.empty())
+        return "";
+
+    QCryptographicHash hash(QCryptographicHash::Sha1);
+    hash.addData(geometry->Name().left(geometry->Name().lastIndexOf("/") + 1).toUtf8());
+    hash.addData((const char*)&geometry->data[0], (int)geometry->data.size());
+    hash.addData(mainAnimation.toUtf8());
+
+    // QMap iterates in name order, the key does not depend on the order the animations were downloaded in.
+    for(QMap<QString, AssetPtr>::const_iterator iter = animations.begin(); iter != animations.end(); ++iter)
+    {
+        const BinaryAsset *animation = dynamic_cast<const BinaryAsset*>(iter.value().get());
+        hash.addData(iter.key().toUtf8());
+        if (animation && !animation->data.empty())
+            hash.addData((const char*)&animation->data[0], (int)animation->data.size());
+    }
+    return QString(hash.result().toHex());
+}
+
+QString MeshmoonAvatarGeometryCache::Acquire(BinaryAsset *geometry, const QString &mainAnimation, const QMap<QString, AssetPtr> &animations)
+{
+    const QString key = Key(geometry, mainAnimation, animations);
+    if (key.isEmpty())
+    {
+        LogError("[MeshmoonAvatarGeometryCache]: Cannot import avatar, geometry data is empty.");
+        return "";
+    }
+
+    QHash<QString, MeshmoonAvatarGeometry>::iterator existing = geometries_.find(key);
+    if (existing != geometries_.end())
+    {
+        existing.value().refCount++;
+        ++stats_.sharedHits;
+        return key;
+    }
+
+    QList<AnimationAssetData> animationAssets;
+    for(QMap<QString, AssetPtr>::const_iterator iter = animations.begin(); iter != animations.end(); ++iter)
+    {
+        BinaryAsset *animation = dynamic_cast<BinaryAsset*>(iter.value().get());
+        if (!animation || animation->data.empty())
+        {
+            LogError("[MeshmoonAvatarGeometryCache]: Cannot import avatar, animation is not a loaded binary asset: " + iter.key());
+            return "";
+        }
+
+        AnimationAssetData data;
+        data.data_ = &animation->data[0];
+        data.numBytes = animation->data.size();
+        data.assetRef = animation->Name();
+        data.diskSource = animation->DiskSource();
+        data.name = iter.key();
+        animationAssets.push_back(data);
+    }
+
+    // Generated refs are unique per content, so different appearances with the same file name do not overwrite each other.
+    const QString generatedBase = "generated://meshmoonavatar/" + key + "/" + BaseName(geometry->Name());
+
+    MeshmoonAvatarGeometry &created = geometries_[key];
+    created.refCount = 1;
+    created.meshAsset = framework_->Asset()->GetAsset(generatedBase + ".mesh");
+    if (!created.meshAsset)
+        created.meshAsset = framework_->Asset()->CreateNewAsset("OgreMesh", generatedBase + ".mesh");
+    created.skeletonAsset = framework_->Asset()->GetAsset(generatedBase + ".skeleton");
+    if (!created.skeletonAsset)
+        created.skeletonAsset = framework_->Asset()->CreateNewAsset("OgreSkeleton", generatedBase + ".skeleton");
+    created.importer = new MeshmoonOpenAssetImporter(framework_->Asset());
+    connect(created.importer, SIGNAL(ImportDone(MeshmoonOpenAssetImporter*, bool, const ImportInfo&)),
+        SLOT(OnImportCompleted(MeshmoonOpenAssetImporter*, bool, const ImportInfo&)));
+    ++stats_.imports;
+
+    // Copy the pointers, the entry can be removed by a synchronous ImportDone.
+    MeshmoonOpenAssetImporter *importer = created.importer;
+    AssetPtr meshAsset = created.meshAsset;
+    AssetPtr skeletonAsset = created.skeletonAsset;
+
+    bool started = false;
+    try
+    {
+        if (animationAssets.isEmpty() && mainAnimation.isEmpty())
+            started = importer->Import(&geometry->data[0], geometry->data.size(), geometry->Name(), geometry->DiskSource(), meshAsset, skeletonAsset);
+        else
+            started = importer->ImportWithExternalAnimations(&geometry->data[0], geometry->data.size(), geometry->Name(), geometry->DiskSource(),
+                meshAsset, skeletonAsset, mainAnimation, animationAssets);
+    }
+    catch(Ogre::Exception &ex)
+    {
+        LogError("[MeshmoonAvatarGeometryCache]: Failed to import avatar from " + geometry->Name() + ": " + QString::fromStdString(ex.getDescription()));
+        started = false;
+    }
+
+    QHash<QString, MeshmoonAvatarGeometry>::iterator iter = geometries_.find(key);
+    if (iter == geometries_.end())
+        return "";
+    if (!started)
+    {
+        if (iter.value().importer == importer)
+            SAFE_DELETE(iter.value().importer);
+        Forget(iter.value());
+        geometries_.erase(iter);
+        LogError("[MeshmoonAvatarGeometryCache]: Internal Assimp importer error while importing " + geometry->Name());
+        return "";
+    }
+    return key;
+}
+
+void MeshmoonAvatarGeometryCache::Release(const QString &key)
+{
+    QHash<QString, MeshmoonAvatarGeometry>::iterator iter = geometries_.find(key);
+    if (iter == geometries_.end())
+        return;
+    if (--iter.value().refCount > 0)
+        return;
+
+    // Last avatar is gone, also abandon a pending import.
+    SAFE_DELETE(iter.value().importer);
+    Forget(iter.value());
+    geometries_.erase(iter);
+    ++stats_.releases;
+}
+
+const MeshmoonAvatarGeometry *MeshmoonAvatarGeometryCache::Geometry(const QString &key) const
+{
+    QHash<QString, MeshmoonAvatarGeometry>::const_iterator iter = geometries_.find(key);
+    return (iter != geometries_.end() ? &iter.value() : 0);
+}
+
+size_t MeshmoonAvatarGeometryCache::MeshBytes() const
+{
+    size_t bytes = 0;
+    foreach(const MeshmoonAvatarGeometry &geometry, geometries_)
+    {
+        OgreMeshAsset *meshAsset = dynamic_cast<OgreMeshAsset*>(geometry.meshAsset.get());
+        if (meshAsset && !meshAsset->ogreMesh.isNull())
+            bytes += MeshBufferBytes(meshAsset->ogreMesh.get());
+    }
+    return bytes;
+}
+
+size_t MeshmoonAvatarGeometryCache::AnimationBytes() const
+{
+    size_t bytes = 0;
+    foreach(const MeshmoonAvatarGeometry &geometry, geometries_)
+    {
+        OgreSkeletonAsset *skeletonAsset = dynamic_cast<OgreSkeletonAsset*>(geometry.skeletonAsset.get());
+        if (skeletonAsset && !skeletonAsset->ogreSkeleton.isNull())
+            bytes += SkeletonAnimationBytes(skeletonAsset->ogreSkeleton.get());
+    }
+    return bytes;
+}
+
+void MeshmoonAvatarGeometryCache::OnImportCompleted(MeshmoonOpenAssetImporter *importer, bool success, const ImportInfo &info)
+{
+    QString key;
+    for(QHash<QString, MeshmoonAvatarGeometry>::iterator iter = geometries_.begin(); iter != geometries_.end(); ++iter)
+    {
+        if (iter.value().importer == importer)
+        {
+            key = iter.key();
+            break;
+        }
+    }
+
+    // Free importer, has lots of assimp internals allocated. Might be inside its own call stack.
+    if (importer)
+        importer->deleteLater();
+    if (key.isEmpty())
+        return;
+
+    MeshmoonAvatarGeometry &geometry = geometries_[key];
+    geometry.importer = 0;
+    if (!success)
+    {
+        Forget(geometry);
+        geometries_.remove(key);
+        emit GeometryReady(key, false);
+        return;
+    }
+
+    geometry.importInfo = info;
+    geometry.ready = true;
+    emit GeometryReady(key, true);
+}
+
+void MeshmoonAvatarGeometryCache::Forget(MeshmoonAvatarGeometry &geometry)
+{
+    if (geometry.meshAsset.get())
+        framework_->Asset()->ForgetAsset(geometry.meshAsset, false);
+    if (geometry.skeletonAsset.get())
+        framework_->Asset()->ForgetAsset(geometry.skeletonAsset, false);
+    geometry.meshAsset.reset();
+    geometry.skeletonAsset.reset();
+}
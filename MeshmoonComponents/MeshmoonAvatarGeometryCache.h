@@ -0,0 +1,109 @@
+/**
+    @author Adminotech Ltd.
+
+    Copyright Adminotech Ltd.
+    All rights reserved.
+
+    @file   MeshmoonAvatarGeometryCache.h
+    @brief  Imported avatar geometry shared between EC_MeshmoonAvatar instances. */
+
+#pragma once
+
+#include "MeshmoonComponentsApi.h"
+#include "AssetFwd.h"
+#include "MeshmoonAssimpPluginFwd.h"
+
+#include <QObject>
+#include <QHash>
+#include <QMap>
+#include <QString>
+
+class Framework;
+class BinaryAsset;
+
+/// @cond PRIVATE
+
+/// Imported mesh, skeleton and animations of one avatar appearance.
+struct MeshmoonAvatarGeometry
+{
+    AssetPtr meshAsset;
+    AssetPtr skeletonAsset;
+    ImportInfo importInfo;
+
+    /// Number of avatars that use this geometry, including the ones waiting for the import.
+    int refCount;
+    /// Import has finished and the assets can be used.
+    bool ready;
+    /// Running import, null when ready.
+    MeshmoonOpenAssetImporter *importer;
+
+    MeshmoonAvatarGeometry() : refCount(0), ready(false), importer(0) {}
+};
+
+/// Imported avatar geometry shared between EC_MeshmoonAvatar instances.
+/** Geometry is keyed by the content hash of the appearance: the geometry file, the main animation and
+    the external animation files. Avatars with the same appearance share the Ogre mesh, skeleton and
+    animation tracks and the appearance is imported only once. Each Ogre::Entity created from the shared
+    mesh still has its own skeleton instance and animation states, so avatars animate independently.
+    The assets are forgotten when the last avatar releases the geometry. */
+class MESHMOON_COMPONENTS_API MeshmoonAvatarGeometryCache : public QObject
+{
+    Q_OBJECT
+
+public:
+    struct Stats
+    {
+        uint imports;       ///< Imports started.
+        uint sharedHits;    ///< Acquires that reused existing or pending geometry.
+        uint releases;      ///< Geometries forgotten after the last avatar released them.
+
+        Stats() : imports(0), sharedHits(0), releases(0) {}
+    };
+
+    explicit MeshmoonAvatarGeometryCache(Framework *framework, QObject *parent = 0);
+    ~MeshmoonAvatarGeometryCache();
+
+    /// Returns the content hash key for @c geometry and external @c animations.
+    /** The directory of the geometry ref is part of the key as the importer resolves relative texture refs against it. */
+    static QString Key(const BinaryAsset *geometry, const QString &mainAnimation = "", const QMap<QString, AssetPtr> &animations = QMap<QString, AssetPtr>());
+
+    /// Acquires a reference to the geometry of @c geometry and @c animations, importing it if not already imported or pending.
+    /** @return Key of the geometry, empty if the import could not be started. GeometryReady is emitted when a pending import finishes.
+        @note Each successful Acquire must be paired with a Release. */
+    QString Acquire(BinaryAsset *geometry, const QString &mainAnimation = "", const QMap<QString, AssetPtr> &animations = QMap<QString, AssetPtr>());
+
+    /// Releases a reference to geometry with @c key, the assets are forgotten when the last reference is released.
+    void Release(const QString &key);
+
+    /// Returns geometry with @c key or null if not known.
+    const MeshmoonAvatarGeometry *Geometry(const QString &key) const;
+
+    /// Returns the number of geometries, including pending imports.
+    int Size() const { return geometries_.size(); }
+
+    /// Returns the total vertex and index buffer bytes of the imported meshes.
+    size_t MeshBytes() const;
+
+    /// Returns the total keyframe bytes of the imported skeleton animations.
+    size_t AnimationBytes() const;
+
+    const Stats &Statistics() const { return stats_; }
+    void ResetStatistics() { stats_ = Stats(); }
+
+signals:
+    /// Emitted when the import of geometry with @c key finishes.
+    /** On failure the geometry has already been removed and the references of the waiting avatars are dropped. */
+    void GeometryReady(const QString &key, bool success);
+
+private slots:
+    void OnImportCompleted(MeshmoonOpenAssetImporter *importer, bool success, const ImportInfo &info);
+
+private:
+    void Forget(MeshmoonAvatarGeometry &geometry);
+
+    Framework *framework_;
+    QHash<QString, MeshmoonAvatarGeometry> geometries_;
+    Stats stats_;
+};
+
+/// @endcond
@@ -0,0 +1,304 @@
+/**
+    @author Adminotech Ltd.
+
+    Copyright Adminotech Ltd.
+    All rights reserved.
+
+    @file   MeshmoonBrowserScheduler.cpp
+    @brief  Decides which web and media browsers may run a helper process. */
+
+#include "StableHeaders.h"
+#include "DebugOperatorNew.h"
+
+#include "MeshmoonBrowserScheduler.h"
+
+#include <QProcess>
+#include <QFile>
+#include <QStringList>
+#include <QSet>
+
+#include <algorithm>
+#include <cmath>
+
+#if defined(WIN32)
+#include "Win.h"
+#include <psapi.h>
+#elif defined(Q_OS_LINUX)
+#include <unistd.h>
+#endif
+
+#include "MemoryLeakCheck.h"
+
+namespace
+{
+    /// Orders candidate indexes by descending score.
+    struct ScoreComparer
+    {
+        const QVector<MeshmoonBrowserScheduler::Candidate> &candidates;
+
+        ScoreComparer(const QVector<MeshmoonBrowserScheduler::Candidate> &candidates_) : candidates(candidates_) {}
+
+        bool operator()(int i1, int i2) const
+        {
+            return candidates[i1].score > candidates[i2].score;
+        }
+    };
+
+    bool ReadProcessTimes(QProcess *process, double &cpuSeconds, float &memoryMB)
+    {
+        if (!process || process->state() != QProcess::Running)
+            return false;
+#if defined(WIN32)
+        PROCESS_INFORMATION *info = (PROCESS_INFORMATION*)process->pid();
+        if (!info || !info->hProcess)
+            return false;
+
+        FILETIME creationTime, exitTime, kernelTime, userTime;
+        if (!GetProcessTimes(info->hProcess, &creationTime, &exitTime, &kernelTime, &userTime))
+            return false;
+        ULARGE_INTEGER kernel, user;
+        kernel.LowPart = kernelTime.dwLowDateTime; kernel.HighPart = kernelTime.dwHighDateTime;
+        user.LowPart = userTime.dwLowDateTime; user.HighPart = userTime.dwHighDateTime;
+        cpuSeconds = (double)(kernel.QuadPart + user.QuadPart) / 1e7; // 100 nanosecond units
+
+        PROCESS_MEMORY_COUNTERS counters;
+        if (!GetProcessMemoryInfo(info->hProcess, &counters, sizeof(counters)))
+            return false;
+        memoryMB = (float)counters.WorkingSetSize / (1024.f * 1024.f);
+        return true;
+#elif defined(Q_OS_LINUX)
+        const QString procPath = "/proc/" + QString::number(process->pid());
+
+        // Fields after the parenthesized command name, utime and stime are fields 14 and 15 of the whole line.
+        QFile statFile(procPath + "/stat");
+        if (!statFile.open(QIODevice::ReadOnly))
+            return false;
+        QString stat = QString::fromLatin1(statFile.readAll());
+        QStringList fields = stat.mid(stat.lastIndexOf(")") + 1).split(" ", QString::SkipEmptyParts);
+        if (fields.size() < 13)
+            return false;
+        const double ticks = (double)sysconf(_SC_CLK_TCK);
+        cpuSeconds = (fields[11].toDouble() + fields[12].toDouble()) / (ticks > 0 ? ticks : 100.0);
+
+        QFile statmFile(procPath + "/statm");
+        if (!statmFile.open(QIODevice::ReadOnly))
+            return false;
+        QStringList pages = QString::fromLatin1(statmFile.readAll()).split(" ", QString::SkipEmptyParts);
+        if (pages.size() < 2)
+            return false;
+        memoryMB = (float)(pages[1].toDouble() * (double)sysconf(_SC_PAGESIZE) / (1024.0 * 1024.0));
+        return true;
+#else
+        Q_UNUSED(cpuSeconds);
+        Q_UNUSED(memoryMB);
+        return false;
+#endif
+    }
+}
+
+// MeshmoonBrowserScheduler::Candidate
+
+MeshmoonBrowserScheduler::Candidate::Candidate() :
+    key(0),
+    type(WebProcess),
+    screenArea(0.f),
+    visible(false),
+    audible(false),
+    controlling(false),
+    lastInteraction(-1.f),
+    running(false),
+    hasLoad(false),
+    score(0.f),
+    permitted(false)
+{
+}
+
+// MeshmoonBrowserScheduler::Budget
+
+MeshmoonBrowserScheduler::Budget::Budget() :
+    cpu(2.f),
+    memoryMB(1024.f)
+{
+    maxProcesses[WebProcess] = 5;
+    maxProcesses[MediaProcess] = 5;
+}
+
+// MeshmoonBrowserScheduler::Settings
+
+MeshmoonBrowserScheduler::Settings::Settings() :
+    runningBonus(1.5f),
+    minStateTime(5.f),
+    interactionHalfLife(15.f),
+    minScore(0.001f),
+    maxStartsPerPass(2)
+{
+}
+
+// MeshmoonBrowserScheduler
+
+MeshmoonBrowserScheduler::MeshmoonBrowserScheduler()
+{
+}
+
+void MeshmoonBrowserScheduler::Clear()
+{
+    states_.clear();
+}
+
+float MeshmoonBrowserScheduler::Score(const Candidate &candidate, float now) const
+{
+    // Off-screen browsers keep a fraction of their area so that they are ordered by how close they are to the view.
+    float score = qBound(0.f, candidate.screenArea, 1.f) * (candidate.visible ? 1.f : 0.1f);
+    if (candidate.audible)
+        score += 0.25f;
+    if (candidate.lastInteraction >= 0.f && settings_.interactionHalfLife > 0.f)
+    {
+        const float age = qMax(now - candidate.lastInteraction, 0.f);
+        score += 0.5f * powf(0.5f, age / settings_.interactionHalfLife);
+    }
+    if (candidate.controlling)
+        score += 10.f;
+    if (candidate.running)
+        score *= settings_.runningBonus;
+    return score;
+}
+
+MeshmoonBrowserScheduler::Load MeshmoonBrowserScheduler::EstimatedLoad(ProcessType type) const
+{
+    Load sum;
+    int count = 0;
+    foreach(const State &state, states_)
+    {
+        if (state.type == type && state.measured)
+        {
+            sum.cpu += state.load.cpu;
+            sum.memoryMB += state.load.memoryMB;
+            ++count;
+        }
+    }
+    if (count > 0)
+        return Load(sum.cpu / count, sum.memoryMB / count);
+
+    // Typical idle page and playing video before anything has been measured.
+    return (type == MediaProcess ? Load(0.3f, 100.f) : Load(0.25f, 150.f));
+}
+
+bool MeshmoonBrowserScheduler::SampleLoad(quintptr key, QProcess *process, float now, Load &load)
+{
+    double cpuSeconds = 0.0;
+    float memoryMB = 0.f;
+    if (!ReadProcessTimes(process, cpuSeconds, memoryMB))
+        return false;
+
+    // CPU load needs two samples, the first one only records the baseline.
+    State &state = states_[key];
+    const bool hasPrevious = (state.sampleTime >= 0.f && now > state.sampleTime && cpuSeconds >= state.cpuSeconds);
+    if (hasPrevious)
+    {
+        state.load.cpu = (float)((cpuSeconds - state.cpuSeconds) / (double)(now - state.sampleTime));
+        state.load.memoryMB = memoryMB;
+        state.measured = true;
+    }
+    state.cpuSeconds = cpuSeconds;
+    state.sampleTime = now;
+    if (!hasPrevious)
+        return false;
+
+    load = state.load;
+    return true;
+}
+
+void MeshmoonBrowserScheduler::Schedule(QVector<Candidate> &candidates, float now)
+{
+    ++stats_.passes;
+
+    // Forget browsers that are gone.
+    QSet<quintptr> seen;
+    for(int i = 0; i < candidates.size(); ++i)
+        seen.insert(candidates[i].key);
+    for(QHash<quintptr, State>::iterator iter = states_.begin(); iter != states_.end();)
+    {
+        if (!seen.contains(iter.key()))
+            iter = states_.erase(iter);
+        else
+            ++iter;
+    }
+
+    QVector<int> order;
+    order.reserve(candidates.size());
+    for(int i = 0; i < candidates.size(); ++i)
+    {
+        Candidate &candidate = candidates[i];
+        State &state = states_[candidate.key];
+        state.type = candidate.type;
+        if (!candidate.running)
+            state.sampleTime = -1.f;
+
+        candidate.score = Score(candidate, now);
+        candidate.permitted = false;
+        if (!candidate.hasLoad)
+            candidate.load = (candidate.running && state.measured ? state.load : EstimatedLoad(candidate.type));
+        order.push_back(i);
+    }
+    std::stable_sort(order.begin(), order.end(), ScoreComparer(candidates));
+
+    Load used;
+    int processes[NumProcessTypes] = { 0, 0 };
+    int starts = 0;
+
+    // Running browsers that were started recently are kept first, then the rest by score.
+    for(int pass = 0; pass < 2; ++pass)
+    {
+        foreach(int i, order)
+        {
+            Candidate &candidate = candidates[i];
+            if (candidate.permitted)
+                continue;
+
+            const bool locked = (now - states_[candidate.key].changedTime < settings_.minStateTime);
+            if (pass == 0 && !(candidate.running && locked))
+                continue;
+            if (pass == 1)
+            {
+                if (candidate.score < settings_.minScore && !candidate.controlling)
+                    continue;
+                // Recently stopped browsers are not restarted right away.
+                if (!candidate.running && (locked || starts >= settings_.maxStartsPerPass))
+                    continue;
+            }
+
+            // Always allow one process, even if its load alone is over the budget.
+            const bool first = (processes[WebProcess] + processes[MediaProcess] == 0);
+            const bool fits = processes[candidate.type] < budget_.maxProcesses[candidate.type] &&
+                (first || (used.cpu + candidate.load.cpu <= budget_.cpu && used.memoryMB + candidate.load.memoryMB <= budget_.memoryMB));
+            if (!fits)
+            {
+                if (!candidate.running && pass == 1)
+                    ++stats_.budgetLimited;
+                continue;
+            }
+
+            candidate.permitted = true;
+            used.cpu += candidate.load.cpu;
+            used.memoryMB += candidate.load.memoryMB;
+            processes[candidate.type]++;
+            if (!candidate.running)
+                ++starts;
+        }
+    }
+
+    for(int i = 0; i < candidates.size(); ++i)
+    {
+        const Candidate &candidate = candidates[i];
+        if (candidate.permitted == candidate.running)
+            continue;
+        states_[candidate.key].changedTime = now;
+        if (candidate.permitted)
+            ++stats_.starts;
+        else
+            ++stats_.stops;
+    }
+
+    stats_.peakLoad.cpu = qMax(stats_.peakLoad.cpu, used.cpu);
+    stats_.peakLoad.memoryMB = qMax(stats_.peakLoad.memoryMB, used.memoryMB);
+}
@@ -0,0 +1,143 @@
+/**
+    @author Adminotech Ltd.
+
+    Copyright Adminotech Ltd.
+    All rights reserved.
+
+    @file   MeshmoonBrowserScheduler.h
+    @brief  Decides which web and media browsers may run a helper process. */
+
+#pragma once
+
+#include <QVector>
+#include <QHash>
+
+class QProcess;
+
+/// @cond PRIVATE
+
+/// Decides which EC_WebBrowser and EC_MediaBrowser components may run a helper process.
+/** Browsers are scored by the screen area of their render target, visibility, audible playback and
+    recent interaction. The highest scoring browsers are permitted to run while the process counts
+    and the combined CPU and memory budget of the helper processes allow it. Running browsers get a
+    score bonus and cannot be stopped or started again before a minimum time has passed, so browsers
+    with nearly equal scores do not thrash their processes. */
+class MeshmoonBrowserScheduler
+{
+public:
+    enum ProcessType
+    {
+        WebProcess = 0,
+        MediaProcess,
+        NumProcessTypes
+    };
+
+    /// Load of a helper process.
+    struct Load
+    {
+        float cpu;      ///< CPU cores in use, 1.0 is one fully used core.
+        float memoryMB; ///< Resident memory in megabytes.
+
+        Load() : cpu(0.f), memoryMB(0.f) {}
+        Load(float cpu_, float memoryMB_) : cpu(cpu_), memoryMB(memoryMB_) {}
+    };
+
+    struct Candidate
+    {
+        quintptr key;           ///< Unique identifier of the browser.
+        ProcessType type;
+        float screenArea;       ///< Fraction of the main viewport covered by the render target, [0,1].
+        bool visible;           ///< Render target is in view of the main camera.
+        bool audible;           ///< Media is playing with sound, keeps running when not visible.
+        bool controlling;       ///< This client controls a synchronized browser, always runs if the budget allows.
+        float lastInteraction;  ///< Wall clock time of the last input to the browser, negative if never.
+        bool running;           ///< Currently permitted to run.
+        bool hasLoad;           ///< @c load is measured from the running process.
+        Load load;
+
+        float score;            ///< Filled by Schedule.
+        bool permitted;         ///< Filled by Schedule.
+
+        Candidate();
+    };
+
+    struct Budget
+    {
+        int maxProcesses[NumProcessTypes];
+        float cpu;          ///< Combined CPU cores of all helper processes.
+        float memoryMB;     ///< Combined resident memory of all helper processes.
+
+        Budget();
+    };
+
+    struct Settings
+    {
+        float runningBonus;         ///< Score multiplier of running browsers.
+        float minStateTime;         ///< Seconds a browser is kept in its current state before it can be stopped or started.
+        float interactionHalfLife;  ///< Seconds after which the interaction bonus has halved.
+        float minScore;             ///< Browsers scoring below this are not started.
+        int maxStartsPerPass;       ///< Limits process start spikes, eg. when teleporting.
+
+        Settings();
+    };
+
+    struct Stats
+    {
+        uint passes;
+        uint starts;
+        uint stops;
+        uint budgetLimited;     ///< Browsers that would have been started without the budget.
+        Load peakLoad;          ///< Highest combined load of the permitted browsers.
+
+        Stats() : passes(0), starts(0), stops(0), budgetLimited(0) {}
+    };
+
+    MeshmoonBrowserScheduler();
+
+    void SetBudget(const Budget &budget) { budget_ = budget; }
+    const Budget &CurrentBudget() const { return budget_; }
+
+    void SetSettings(const Settings &settings) { settings_ = settings; }
+    const Settings &CurrentSettings() const { return settings_; }
+
+    /// Scores @c candidates and fills their permitted state.
+    /** @param now Wall clock time in seconds.
+        Candidates that are not seen by the previous pass are forgotten. */
+    void Schedule(QVector<Candidate> &candidates, float now);
+
+    /// Samples the load of a running helper @c process of browser @c key.
+    /** @return False if the load cannot be measured on this platform or the process is not running, the estimate is used then. */
+    bool SampleLoad(quintptr key, QProcess *process, float now, Load &load);
+
+    /// Returns the load estimate for a browser of @c type that does not run yet.
+    /** Average of the measured loads of the type, or a default if nothing has been measured. */
+    Load EstimatedLoad(ProcessType type) const;
+
+    const Stats &Statistics() const { return stats_; }
+    void ResetStatistics() { stats_ = Stats(); }
+
+    /// Forgets all browser state.
+    void Clear();
+
+private:
+    struct State
+    {
+        ProcessType type;
+        float changedTime;      ///< Time of the last start or stop.
+        double cpuSeconds;      ///< Process CPU time at the last sample.
+        float sampleTime;       ///< Wall clock time of the last sample, negative if none.
+        bool measured;          ///< @c load has been measured.
+        Load load;              ///< Last measured load.
+
+        State() : type(WebProcess), changedTime(-1e6f), cpuSeconds(0.0), sampleTime(-1.f), measured(false) {}
+    };
+
+    float Score(const Candidate &candidate, float now) const;
+
+    Budget budget_;
+    Settings settings_;
+    QHash<quintptr, State> states_;
+    Stats stats_;
+};
+
+/// @endcond
@@ -13,6 +13,8 @@
 #include "MeshmoonComponents.h"
 
 #include "EC_MeshmoonAvatar.h"
+#include "MeshmoonAvatarGeometryCache.h"
+#include "MeshmoonBrowserScheduler.h"
 #include "EC_WebBrowser.h"
 #include "EC_MediaBrowser.h"
 #include "EC_MeshmoonTeleport.h"
@@ -26,6 +28,8 @@
 #include "Profiler.h"
 #include "SceneAPI.h"
 #include "ConfigAPI.h"
+#include "ConsoleAPI.h"
+#include "FrameAPI.h"
 
 #include "IComponentFactory.h"
 #include "TundraLogicModule.h"
@@ -42,23 +46,37 @@
 #include "OgreMaterialAsset.h"
 #include "Renderer.h"
 #include "EC_Placeable.h"
+#include "EC_Camera.h"
+#include "EC_Mesh.h"
 
 #include <OgreSubMesh.h>
+#include <OgreEntity.h>
+#include <OgreCamera.h>
+#include <OgreMeshManager.h>
+#include <OgreSkeletonManager.h>
+
+#include <kNet/Network.h>
+
+#include <QTimer>
 
 #include <algorithm>
+#include <cmath>
 
 #include "MemoryLeakCheck.h"
 
 MeshmoonComponents::MeshmoonComponents() :
     IModule("MeshmoonComponents"),
     processMonitorDelta_(0.0f),
-    numMaxWebBrowserProcesses_(5),
-    numMaxMediaPlayerProcesses_(5)
+    browserScheduler_(new MeshmoonBrowserScheduler()),
+    browserProcessScale_(1.f),
+    avatarGeometryCache_(0)
 {
 }
 
 MeshmoonComponents::~MeshmoonComponents()
 {
+    SAFE_DELETE(avatarGeometryCache_);
+    SAFE_DELETE(browserScheduler_);
 }
 
 void MeshmoonComponents::Load()
@@ -77,6 +95,16 @@ void MeshmoonComponents::Load()
 
 void MeshmoonComponents::Initialize()
 {
+    avatarGeometryCache_ = new MeshmoonAvatarGeometryCache(Fw());
+
+    if (!Fw()->IsHeadless() && Fw()->HasCommandLineParameter("--rocketDevCommands"))
+    {
+        Fw()->Console()->RegisterCommand("benchmarkAvatarSharing", "Creates local avatars with the same appearance and reports the number of imports and the imported geometry memory. Usage: benchmarkAvatarSharing(appearanceRef,count=50)",
+            this, SLOT(BenchmarkAvatarSharing(const QString&, const QString&)), SLOT(BenchmarkAvatarSharing(const QString&)));
+        Fw()->Console()->RegisterCommand("benchmarkBrowserScheduler", "Schedules stand-in web and media browsers that report synthetic load with and without hysteresis and prints process churn and budget use. Usage: benchmarkBrowserScheduler(browsers=20,seconds=300)",
+            this, SLOT(BenchmarkBrowserScheduler(const QString&, const QString&)), SLOT(BenchmarkBrowserScheduler()));
+    }
+
     // Hook to client connected signal.
     if (!Fw()->IsHeadless() && !Fw()->HasCommandLineParameter("--server"))
     {
@@ -93,61 +121,68 @@ void MeshmoonComponents::Initialize()
     }
 }
 
-template <typename BrowserType>
-struct DistanceComparer : public std::binary_function<EntityWeakPtr, EntityWeakPtr, bool>
+namespace
 {
-    const float3 cameraPos;
-    QHash<entity_id_t, float> cache;
-
-    DistanceComparer(const float3 &cameraPos_) : cameraPos(cameraPos_) {}
-
-    inline bool operator()(const EntityWeakPtr &e1, const EntityWeakPtr &e2)
+    /// Returns the fraction of the viewport of @c camera covered by the bounding box of @c target.
+    /** Targets outside the view return the unclipped area so that they are ordered by how close they are to the view,
+        @c visible tells if the target is in view. */
+    float ProjectedScreenArea(Ogre::Camera *camera, Entity *target, bool &visible)
     {
-        const bool e1Expired = e1.expired();
-        const bool e2Expired = e2.expired();
-        if (!e1Expired && e2Expired)
-            return true;
-        if (e1Expired && !e2Expired)
-            return false;
-        if (e1Expired && e2Expired)
-            return false;
-
-        const EntityPtr ent1 = e1.lock();
-        const EntityPtr ent2 = e2.lock();
-
-        float distanceToCamera1 = 0.0f;
-        if (cache.contains(ent1->Id()))
-            distanceToCamera1 = cache[ent1->Id()];
-        else
+        visible = false;
+        EC_Mesh *mesh = (target ? target->Component<EC_Mesh>().get() : 0);
+        Ogre::Entity *entity = (mesh ? mesh->OgreEntity() : 0);
+        if (!camera || !entity || !entity->isInScene())
+            return 0.f;
+
+        const Ogre::AxisAlignedBox &box = entity->getWorldBoundingBox(true);
+        if (box.isNull())
+            return 0.f;
+        visible = camera->isVisible(box);
+        if (box.isInfinite())
+            return 1.f;
+
+        const Ogre::Matrix4 viewProj = camera->getProjectionMatrix() * camera->getViewMatrix();
+        const Ogre::Vector3 *corners = box.getAllCorners();
+        float minX = 1e6f, minY = 1e6f, maxX = -1e6f, maxY = -1e6f;
+        for(int i = 0; i < 8; ++i)
         {
-            BrowserType *m1 = ent1->Component<BrowserType>().get();
-            Entity *target1 = m1 ? m1->RenderTarget().get() : 0;
-            EC_Placeable *p1 = target1 ? target1->Component<EC_Placeable>().get() : 0;
-            if (!p1)
-                return false;
-
-            distanceToCamera1 = p1->WorldPosition().DistanceSq(cameraPos);
-            cache[ent1->Id()] = distanceToCamera1;
+            Ogre::Vector4 p = viewProj * Ogre::Vector4(corners[i].x, corners[i].y, corners[i].z, 1.f);
+            // Camera is inside or right next to the target, or the target is behind the camera.
+            if (p.w <= 1e-4f)
+                return (visible ? 1.f : 0.f);
+            minX = qMin(minX, p.x / p.w); maxX = qMax(maxX, p.x / p.w);
+            minY = qMin(minY, p.y / p.w); maxY = qMax(maxY, p.y / p.w);
         }
-
-        float distanceToCamera2 = 0.0f;
-        if (cache.contains(ent2->Id()))
-            distanceToCamera2 = cache[ent2->Id()];
-        else
+        if (visible)
         {
-            BrowserType *m2 = ent2->Component<BrowserType>().get();
-            Entity *target2 = m2 ? m2->RenderTarget().get() : 0;
-            EC_Placeable *p2 = target2 ? target2->Component<EC_Placeable>().get() : 0;
-            if (!p2)
-                return true;
-
-            distanceToCamera2 = p2->WorldPosition().DistanceSq(cameraPos);
-            cache[ent2->Id()] = distanceToCamera2;
+            minX = qMax(minX, -1.f); maxX = qMin(maxX, 1.f);
+            minY = qMax(minY, -1.f); maxY = qMin(maxY, 1.f);
         }
+        if (maxX <= minX || maxY <= minY)
+            return 0.f;
+        return qMin((maxX - minX) * (maxY - minY) / 4.f, 1.f);
+    }
 
-        return (distanceToCamera1 < distanceToCamera2);
+    /// Stand-in browser of benchmarkBrowserScheduler with a synthetic helper process load.
+    struct BenchmarkBrowser
+    {
+        MeshmoonBrowserScheduler::Load load;
+        float baseArea;
+        float amplitude;
+        float period;
+        float phase;
+        bool audible;
+
+        BenchmarkBrowser() : baseArea(0.f), amplitude(0.f), period(1.f), phase(0.f), audible(false) {}
+    };
+
+    /// Deterministic pseudo random number in [0,1) for the benchmarks.
+    float BenchmarkRandom(uint &seed)
+    {
+        seed = seed * 1664525u + 1013904223u;
+        return (float)(seed >> 8) / (float)(1u << 24);
     }
-};
+}
 
 void MeshmoonComponents::Update(f64 frametime)
 {
@@ -160,68 +195,124 @@ void MeshmoonComponents::Update(f64 frametime)
         processMonitorDelta_ = 0.0f;
 
         PROFILE(MeshmoonComponents_Order_Priority)
+        ScheduleBrowsers();
+        ELIFORP(MeshmoonComponents_Order_Priority)
+    }
+}
 
-        Entity *cameraEnt = Fw()->Module<OgreRenderingModule>()->Renderer()->MainCamera();
-        EC_Placeable *cameraPlaceable = cameraEnt != 0 ? cameraEnt->Component<EC_Placeable>().get() : 0;
-        if (!cameraPlaceable)
-            return;
+void MeshmoonComponents::ScheduleBrowsers()
+{
+    if (webBrowsers.empty() && mediaBrowsers.empty())
+        return;
 
-        if (!webBrowsers.empty())
-        {
-            DistanceComparer<EC_WebBrowser> comparer(cameraPlaceable->WorldPosition());
-            webBrowsers.sort(comparer);
+    OgreRenderingModule *renderingModule = Fw()->Module<OgreRenderingModule>();
+    EC_Camera *camera = (renderingModule && renderingModule->Renderer() ? renderingModule->Renderer()->MainCameraComponent() : 0);
+    Ogre::Camera *ogreCamera = (camera ? camera->OgreCamera() : 0);
+    if (!ogreCamera)
+        return;
 
-            int idx = 0;
-            for(WeakEntityList::iterator it = webBrowsers.begin(); it != webBrowsers.end();)
-            {
-                EntityWeakPtr entIter = (*it);
-                EC_WebBrowser *browser = (!entIter.expired() ? entIter.lock()->Component<EC_WebBrowser>().get() : 0);
-                if (browser)
-                {
-                    browser->SetRunPermission(idx < numMaxWebBrowserProcesses_);
-                    ++idx;
-                    ++it;
-                }
-                else
-                    it = webBrowsers.erase(it);
-            }
-        }
+    const float now = Fw()->Frame()->WallClockTime();
+    QVector<MeshmoonBrowserScheduler::Candidate> candidates;
+    QVector<IComponent*> browsers;
 
-        if (!mediaBrowsers.empty())
+    for(WeakEntityList::iterator it = webBrowsers.begin(); it != webBrowsers.end();)
+    {
+        EntityPtr entity = (*it).lock();
+        EC_WebBrowser *browser = (entity ? entity->Component<EC_WebBrowser>().get() : 0);
+        if (!browser)
         {
-            DistanceComparer<EC_MediaBrowser> comparer(cameraPlaceable->WorldPosition());
-            mediaBrowsers.sort(comparer);
+            it = webBrowsers.erase(it);
+            continue;
+        }
+        ++it;
+
+        MeshmoonBrowserScheduler::Candidate candidate;
+        candidate.key = (quintptr)browser;
+        candidate.type = MeshmoonBrowserScheduler::WebProcess;
+        if (browser->enabled.Get())
+            candidate.screenArea = ProjectedScreenArea(ogreCamera, browser->RenderTarget().get(), candidate.visible);
+        candidate.controlling = browser->controlling_ && browser->enabled.Get();
+        candidate.lastInteraction = browser->LastInteraction();
+        candidate.running = browser->permissionRun_;
+        if (candidate.running)
+            candidate.hasLoad = browserScheduler_->SampleLoad(candidate.key, browser->ipcProcess, now, candidate.load);
+        candidates.push_back(candidate);
+        browsers.push_back(browser);
+    }
 
-            int idx = 0;
-            for(WeakEntityList::iterator it = mediaBrowsers.begin(); it != mediaBrowsers.end();)
-            {
-                EntityWeakPtr entIter = (*it);
-                EC_MediaBrowser *browser = (!entIter.expired() ? entIter.lock()->Component<EC_MediaBrowser>().get() : 0);
-                if (browser)
-                {
-                    browser->SetRunPermission(idx < numMaxMediaPlayerProcesses_);
-                    ++idx;
-                    ++it;
-                }
-                else
-                    it = webBrowsers.erase(it);
-            }
+    for(WeakEntityList::iterator it = mediaBrowsers.begin(); it != mediaBrowsers.end();)
+    {
+        EntityPtr entity = (*it).lock();
+        EC_MediaBrowser *browser = (entity ? entity->Component<EC_MediaBrowser>().get() : 0);
+        if (!browser)
+        {
+            it = mediaBrowsers.erase(it);
+            continue;
         }
+        ++it;
+
+        MeshmoonBrowserScheduler::Candidate candidate;
+        candidate.key = (quintptr)browser;
+        candidate.type = MeshmoonBrowserScheduler::MediaProcess;
+        if (browser->enabled.Get() && !browser->audioOnly.Get())
+            candidate.screenArea = ProjectedScreenArea(ogreCamera, browser->RenderTarget().get(), candidate.visible);
+        candidate.audible = browser->enabled.Get() && browser->ipcSocket && browser->state_.state == MediaPlayerProtocol::Playing;
+        candidate.lastInteraction = browser->LastInteraction();
+        candidate.running = browser->permissionRun_;
+        if (candidate.running)
+            candidate.hasLoad = browserScheduler_->SampleLoad(candidate.key, browser->ipcProcess, now, candidate.load);
+        candidates.push_back(candidate);
+        browsers.push_back(browser);
+    }
 
-        ELIFORP(MeshmoonComponents_Order_Priority)
+    browserScheduler_->Schedule(candidates, now);
+
+    for(int i = 0; i < candidates.size(); ++i)
+    {
+        if (candidates[i].type == MeshmoonBrowserScheduler::WebProcess)
+            static_cast<EC_WebBrowser*>(browsers[i])->SetRunPermission(candidates[i].permitted);
+        else
+            static_cast<EC_MediaBrowser*>(browsers[i])->SetRunPermission(candidates[i].permitted);
     }
 }
 
 void MeshmoonComponents::OnClientConnected()
 {
-    numMaxWebBrowserProcesses_ = Fw()->Config()->Read("adminotech", "clientplugin", "numprocessesweb", 5).toInt();
-    numMaxMediaPlayerProcesses_ = Fw()->Config()->Read("adminotech", "clientplugin", "numprocessesmedia", 5).toInt();
+    ApplyBrowserBudget();
+}
+
+void MeshmoonComponents::SetBrowserProcessScale(float scale)
+{
+    scale = qBound(0.f, scale, 1.f);
+    if (browserProcessScale_ == scale)
+        return;
+    browserProcessScale_ = scale;
+    ApplyBrowserBudget();
+}
+
+void MeshmoonComponents::ApplyBrowserBudget()
+{
+    MeshmoonBrowserScheduler::Budget budget;
+    budget.maxProcesses[MeshmoonBrowserScheduler::WebProcess] = Fw()->Config()->Read("adminotech", "clientplugin", "numprocessesweb", 5).toInt();
+    budget.maxProcesses[MeshmoonBrowserScheduler::MediaProcess] = Fw()->Config()->Read("adminotech", "clientplugin", "numprocessesmedia", 5).toInt();
+    budget.cpu = Fw()->Config()->Read("adminotech", "clientplugin", "browsercpubudget", 2.0).toFloat();
+    budget.memoryMB = Fw()->Config()->Read("adminotech", "clientplugin", "browsermemorybudget", 1024).toFloat();
+    if (browserProcessScale_ < 1.f)
+    {
+        for(int type = 0; type < MeshmoonBrowserScheduler::NumProcessTypes; ++type)
+            if (budget.maxProcesses[type] > 0)
+                budget.maxProcesses[type] = qMax(1, static_cast<int>(budget.maxProcesses[type] * browserProcessScale_ + 0.5f));
+        budget.cpu *= browserProcessScale_;
+        budget.memoryMB *= browserProcessScale_;
+    }
+    browserScheduler_->SetBudget(budget);
 }
 
 void MeshmoonComponents::OnClientDisconnected()
 {
     webBrowsers.clear();
     mediaBrowsers.clear();
+    browserScheduler_->Clear();
 }
 
 void MeshmoonComponents::EmitTeleportRequest(const QString &sceneId, const QString &pos, const QString &rot)
@@ -293,6 +384,203 @@ void MeshmoonComponents::OnComponentRemoved(Entity *entity, IComponent *comp)
     }
 }
 
+void MeshmoonComponents::BenchmarkAvatarSharing(const QString &appearanceRef)
+{
+    BenchmarkAvatarSharing(appearanceRef, "50");
+}
+
+void MeshmoonComponents::BenchmarkAvatarSharing(const QString &appearanceRef, const QString &count)
+{
+    Scene *scene = Fw()->Scene()->MainCameraScene();
+    if (!scene)
+    {
+        LogError("[MeshmoonComponents]: benchmarkAvatarSharing: No active scene.");
+        return;
+    }
+    if (!avatarBenchmark_.entities.isEmpty())
+    {
+        LogError("[MeshmoonComponents]: benchmarkAvatarSharing: Previous benchmark is still running.");
+        return;
+    }
+
+    const int numAvatars = qMax(count.trimmed().toInt(), 1);
+    avatarGeometryCache_->ResetStatistics();
+    avatarBenchmark_ = AvatarBenchmark();
+    avatarBenchmark_.meshUsage = Ogre::MeshManager::getSingleton().getMemoryUsage();
+    avatarBenchmark_.skeletonUsage = Ogre::SkeletonManager::getSingleton().getMemoryUsage();
+    avatarBenchmark_.timer.Start();
+
+    const int rowLength = 10;
+    const QStringList components = QStringList() << EC_Placeable::TypeNameStatic() << EC_MeshmoonAvatar::TypeNameStatic();
+    for(int i = 0; i < numAvatars; ++i)
+    {
+        EntityPtr entity = scene->CreateLocalEntity(components, AttributeChange::LocalOnly, false, true);
+        if (!entity)
+            continue;
+        avatarBenchmark_.entities << entity;
+
+        shared_ptr<EC_Placeable> placeable = entity->Component<EC_Placeable>();
+        if (placeable)
+        {
+            Transform transform = placeable->transform.Get();
+            transform.pos = float3(1.5f * (i % rowLength), 0.f, 1.5f * (i / rowLength));
+            placeable->transform.Set(transform, AttributeChange::LocalOnly);
+        }
+        EC_MeshmoonAvatarPtr avatar = entity->Component<EC_MeshmoonAvatar>();
+        if (avatar)
+        {
+            connect(avatar.get(), SIGNAL(AvatarReady()), this, SLOT(OnBenchmarkAvatarReady()), Qt::UniqueConnection);
+            avatar->appearanceRef.Set(AssetReference(appearanceRef, "Binary"), AttributeChange::LocalOnly);
+        }
+    }
+    LogInfo(QString("[MeshmoonComponents]: benchmarkAvatarSharing: Created %1 avatars with %2").arg(avatarBenchmark_.entities.size()).arg(appearanceRef));
+}
+
+void MeshmoonComponents::OnBenchmarkAvatarReady()
+{
+    if (avatarBenchmark_.entities.isEmpty())
+        return;
+    // Avatars are removed outside of the ready signal of the last avatar.
+    if (++avatarBenchmark_.ready == avatarBenchmark_.entities.size())
+        QTimer::singleShot(0, this, SLOT(FinishAvatarBenchmark()));
+}
+
+void MeshmoonComponents::FinishAvatarBenchmark()
+{
+    const float msecs = avatarBenchmark_.timer.MSecsElapsed();
+    const int numAvatars = avatarBenchmark_.entities.size();
+    const MeshmoonAvatarGeometryCache::Stats stats = avatarGeometryCache_->Statistics();
+    const size_t meshBytes = avatarGeometryCache_->MeshBytes();
+    const size_t animationBytes = avatarGeometryCache_->AnimationBytes();
+    const size_t meshUsage = Ogre::MeshManager::getSingleton().getMemoryUsage();
+    const size_t skeletonUsage = Ogre::SkeletonManager::getSingleton().getMemoryUsage();
+
+    LogInfo(QString("[MeshmoonComponents]: %1 avatars ready in %2 msec").arg(numAvatars).arg(msecs, 0, 'f', 2));
+    LogInfo(QString("    Imports             : %1 (shared %2)").arg(stats.imports).arg(stats.sharedHits));
+    LogInfo(QString("    Shared geometries   : %1").arg(avatarGeometryCache_->Size()));
+    LogInfo(QString("    Mesh buffers        : %1, unshared %2").arg(QString::fromStdString(kNet::FormatBytes((u64)meshBytes)))
+        .arg(QString::fromStdString(kNet::FormatBytes((u64)meshBytes * numAvatars))));
+    LogInfo(QString("    Animation keyframes : %1, unshared %2").arg(QString::fromStdString(kNet::FormatBytes((u64)animationBytes)))
+        .arg(QString::fromStdString(kNet::FormatBytes((u64)animationBytes * numAvatars))));
+    LogInfo(QString("    Ogre mesh usage     : %1 -> %2").arg(QString::fromStdString(kNet::FormatBytes((u64)avatarBenchmark_.meshUsage)))
+        .arg(QString::fromStdString(kNet::FormatBytes((u64)meshUsage))));
+    LogInfo(QString("    Ogre skeleton usage : %1 -> %2").arg(QString::fromStdString(kNet::FormatBytes((u64)avatarBenchmark_.skeletonUsage)))
+        .arg(QString::fromStdString(kNet::FormatBytes((u64)skeletonUsage))));
+
+    foreach(EntityWeakPtr weakEntity, avatarBenchmark_.entities)
+    {
+        EntityPtr entity = weakEntity.lock();
+        if (entity && entity->ParentScene())
+            entity->ParentScene()->RemoveEntity(entity->Id(), AttributeChange::LocalOnly);
+    }
+    avatarBenchmark_ = AvatarBenchmark();
+
+    LogInfo(QString("    Released geometries : %1, remaining %2").arg(avatarGeometryCache_->Statistics().releases).arg(avatarGeometryCache_->Size()));
+}
+
+void MeshmoonComponents::BenchmarkBrowserScheduler()
+{
+    BenchmarkBrowserScheduler("20", "300");
+}
+
+void MeshmoonComponents::BenchmarkBrowserScheduler(const QString &browsers, const QString &seconds)
+{
+    const int numBrowsers = qMax(browsers.trimmed().toInt(), 1);
+    const int numSeconds = qMax(seconds.trimmed().toInt(), 1);
+
+    MeshmoonBrowserScheduler::Settings noHysteresis;
+    noHysteresis.runningBonus = 1.f;
+    noHysteresis.minStateTime = 0.f;
+    noHysteresis.maxStartsPerPass = numBrowsers;
+
+    LogInfo(QString("[MeshmoonComponents]: benchmarkBrowserScheduler: %1 stand-in browsers for %2 seconds, budget %3 web %4 media %5 cpu %6 MB")
+        .arg(numBrowsers).arg(numSeconds)
+        .arg(browserScheduler_->CurrentBudget().maxProcesses[MeshmoonBrowserScheduler::WebProcess])
+        .arg(browserScheduler_->CurrentBudget().maxProcesses[MeshmoonBrowserScheduler::MediaProcess])
+        .arg(browserScheduler_->CurrentBudget().cpu, 0, 'f', 2).arg(browserScheduler_->CurrentBudget().memoryMB, 0, 'f', 0));
+
+    for(int run = 0; run < 2; ++run)
+    {
+        MeshmoonBrowserScheduler scheduler;
+        scheduler.SetBudget(browserScheduler_->CurrentBudget());
+        if (run == 1)
+            scheduler.SetSettings(noHysteresis);
+
+        // Same pseudo random stand-ins for both runs.
+        uint seed = 12345;
+        QVector<BenchmarkBrowser> standIns(numBrowsers);
+        QVector<MeshmoonBrowserScheduler::Candidate> candidates(numBrowsers);
+        for(int i = 0; i < numBrowsers; ++i)
+        {
+            BenchmarkBrowser &standIn = standIns[i];
+            standIn.load = MeshmoonBrowserScheduler::Load(0.1f + 0.5f * BenchmarkRandom(seed), 80.f + 170.f * BenchmarkRandom(seed));
+            standIn.baseArea = 0.05f * BenchmarkRandom(seed);
+            standIn.amplitude = 0.15f * BenchmarkRandom(seed);
+            standIn.period = 20.f + 100.f * BenchmarkRandom(seed);
+            standIn.phase = 6.28f * BenchmarkRandom(seed);
+            standIn.audible = (i % 2 == 1 && BenchmarkRandom(seed) < 0.3f);
+
+            candidates[i].key = (quintptr)(i + 1);
+            candidates[i].type = (i % 2 == 0 ? MeshmoonBrowserScheduler::WebProcess : MeshmoonBrowserScheduler::MediaProcess);
+        }
+
+        kNet::PolledTimer timer;
+        timer.Start();
+        uint violations = 0;
+        double visibleArea = 0.0, runningArea = 0.0;
+        for(int second = 0; second < numSeconds; ++second)
+        {
+            const float now = (float)second;
+            for(int i = 0; i < numBrowsers; ++i)
+            {
+                const BenchmarkBrowser &standIn = standIns[i];
+                MeshmoonBrowserScheduler::Candidate &candidate = candidates[i];
+                // Camera moves around: area follows a slow wave with some jitter between the passes.
+                const float area = standIn.baseArea + standIn.amplitude * sinf(now * 6.28f / standIn.period + standIn.phase) + 0.01f * (BenchmarkRandom(seed) - 0.5f);
+                candidate.visible = (area > 0.f);
+                candidate.screenArea = fabsf(area);
+                candidate.audible = standIn.audible;
+                if (BenchmarkRandom(seed) < 0.01f)
+                    candidate.lastInteraction = now;
+                candidate.running = candidate.permitted;
+                candidate.hasLoad = candidate.running;
+                if (candidate.hasLoad)
+                    candidate.load = MeshmoonBrowserScheduler::Load(standIn.load.cpu * (0.9f + 0.2f * BenchmarkRandom(seed)), standIn.load.memoryMB);
+            }
+
+            scheduler.Schedule(candidates, now);
+
+            MeshmoonBrowserScheduler::Load used;
+            int running = 0;
+            for(int i = 0; i < numBrowsers; ++i)
+            {
+                const MeshmoonBrowserScheduler::Candidate &candidate = candidates[i];
+                if (candidate.visible)
+                    visibleArea += candidate.screenArea;
+                if (!candidate.permitted)
+                    continue;
+                if (candidate.visible)
+                    runningArea += candidate.screenArea;
+                used.cpu += standIns[i].load.cpu;
+                used.memoryMB += standIns[i].load.memoryMB;
+                ++running;
+            }
+            if (running > 1 && (used.cpu > scheduler.CurrentBudget().cpu || used.memoryMB > scheduler.CurrentBudget().memoryMB))
+                ++violations;
+        }
+
+        const MeshmoonBrowserScheduler::Stats &stats = scheduler.Statistics();
+        LogInfo(QString("    %1").arg(run == 0 ? "With hysteresis:" : "Without hysteresis:"));
+        LogInfo(QString("        Passes            : %1 in %2 msec").arg(stats.passes).arg(timer.MSecsElapsed(), 0, 'f', 2));
+        LogInfo(QString("        Process starts    : %1").arg(stats.starts));
+        LogInfo(QString("        Process stops     : %1").arg(stats.stops));
+        LogInfo(QString("        Budget limited    : %1").arg(stats.budgetLimited));
+        LogInfo(QString("        Peak load         : %1 cpu %2 MB").arg(stats.peakLoad.cpu, 0, 'f', 2).arg(stats.peakLoad.memoryMB, 0, 'f', 0));
+        LogInfo(QString("        Over budget       : %1 seconds").arg(violations));
+        LogInfo(QString("        Visible area shown: %1%").arg(visibleArea > 0.0 ? 100.0 * runningArea / visibleArea : 100.0, 0, 'f', 1));
+    }
+}
+
 extern "C"
 {
     DLLEXPORT void TundraPluginMain(Framework *fw)
@@ -20,7 +20,11 @@
 #include <QHash>
 #include <QAbstractSocket>
 
+#include <kNet/PolledTimer.h>
+
 class OgreMeshAsset;
+class MeshmoonAvatarGeometryCache;
+class MeshmoonBrowserScheduler;
 
 /// Registers Meshmoon Entity-Components and handles logic related to them.
 /// @cond PRIVATE
@@ -35,6 +39,15 @@ public:
     /// Emits teleport request.
     void EmitTeleportRequest(const QString &sceneId, const QString &pos, const QString &rot);
 
+    /// Returns imported avatar geometry shared between EC_MeshmoonAvatar instances.
+    MeshmoonAvatarGeometryCache *AvatarGeometryCache() const { return avatarGeometryCache_; }
+
+    /// Scales the configured web and media browser process counts, eg. by a rendering quality governor.
+    /** A local runtime adjustment, the configuration is not changed. At least one process of each type
+        is allowed if the configuration allows any. @param scale In the range [0,1]. */
+    void SetBrowserProcessScale(float scale);
+    float BrowserProcessScale() const { return browserProcessScale_; }
+
 signals:
     void TeleportRequest(const QString &sceneId, const QString &pos, const QString &rot);
 
@@ -47,17 +60,47 @@ private slots:
     void OnComponentAdded(Entity *, IComponent *);
     void OnComponentRemoved(Entity *, IComponent *);
 
+    /// Creates @c count local avatars with @c appearanceRef and reports imports and geometry memory when they are ready.
+    void BenchmarkAvatarSharing(const QString &appearanceRef, const QString &count);
+    void BenchmarkAvatarSharing(const QString &appearanceRef);
+    void OnBenchmarkAvatarReady();
+    void FinishAvatarBenchmark();
+
+    /// Runs the browser scheduler with stand-in browsers that report synthetic load, with and without hysteresis.
+    void BenchmarkBrowserScheduler(const QString &browsers, const QString &seconds);
+    void BenchmarkBrowserScheduler();
+
 private:
     void Load(); ///< IModule override.
     void Initialize(); ///< IModule override.
     void Update(f64 frametime); ///< IModule override.
 
+    /// Gives run permission to the browsers picked by the scheduler.
+    void ScheduleBrowsers();
+
+    /// Sets the scheduler budget from config, scaled with browserProcessScale_.
+    void ApplyBrowserBudget();
+
     float processMonitorDelta_;
-    int numMaxWebBrowserProcesses_;
-    int numMaxMediaPlayerProcesses_;
+    MeshmoonBrowserScheduler *browserScheduler_;
+    float browserProcessScale_;
     typedef std::list<EntityWeakPtr> WeakEntityList;
     WeakEntityList webBrowsers;
     WeakEntityList mediaBrowsers;
+
+    MeshmoonAvatarGeometryCache *avatarGeometryCache_;
+
+    struct AvatarBenchmark
+    {
+        QList<EntityWeakPtr> entities;
+        int ready;
+        size_t meshUsage;
+        size_t skeletonUsage;
+        kNet::PolledTimer timer;
+
+        AvatarBenchmark() : ready(0), meshUsage(0), skeletonUsage(0) {}
+    };
+    AvatarBenchmark avatarBenchmark_;
 };
 
 inline QString QAbstractSocketErrorToString(QAbstractSocket::SocketError error)
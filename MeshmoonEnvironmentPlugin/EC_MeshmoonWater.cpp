@@ -64,7 +64,8 @@ EC_MeshmoonWater::EC_MeshmoonWater(Scene *scene) :
     renderSystemListener_(0),
     renderTargetListener_(0),
 #endif
-    activeCamera_(0)
+    activeCamera_(0),
+    reflectionResolution_(1024)
 {
     // Water type metadata
     static AttributeMetadata simulationModelMetadata, beaufortMetadata, reflectionIntensityMetadata;
@@ -417,6 +418,25 @@ void EC_MeshmoonWater::RecreateOcean()
     CreateOcean();
 }
 
+void EC_MeshmoonWater::SetReflectionResolution(uint resolution)
+{
+    resolution = Clamp<uint>(resolution, 128, 1024);
+    if (reflectionResolution_ == resolution)
+        return;
+    reflectionResolution_ = resolution;
+
+#ifdef MESHMOON_TRITON
+    // Recreate the reflection render target, the ocean itself is kept.
+    if (state_.IsCreated() && renderTargetListener_)
+    {
+        SAFE_DELETE(renderTargetListener_);
+        renderTargetListener_ = new MeshmoonWaterRenderTargetListener(this);
+        if (renderQueueListener_)
+            renderQueueListener_->SetReflectionMap();
+    }
+#endif
+}
+
 void EC_MeshmoonWater::SetVisible(bool display)
 {
     if (tritonVisible_ == display)
@@ -85,6 +85,12 @@ public:
     explicit EC_MeshmoonWater(Scene *scene);
     ~EC_MeshmoonWater();
 
+    /// Sets the reflection map resolution, clamped to [128,1024]. Default: 1024.
+    /** This is a local runtime setting for rendering performance, it is not an attribute and is not replicated.
+        Existing reflections are recreated with the new resolution. */
+    void SetReflectionResolution(uint resolution);
+    uint ReflectionResolution() const { return reflectionResolution_; }
+
     friend class MeshmoonWaterRenderQueueListener;
     friend class MeshmoonWaterRenderTargetListener;
     friend class MeshmoonWaterRenderSystemListener;
@@ -235,6 +241,7 @@ private:
     OgreWorldWeakPtr world_;
     OgreRenderer::RendererWeakPtr renderer_;
     EC_Camera *activeCamera_;
+    uint reflectionResolution_;
 };
 COMPONENT_TYPEDEFS(MeshmoonWater);
 
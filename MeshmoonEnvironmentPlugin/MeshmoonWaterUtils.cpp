@@ -87,10 +87,11 @@ MeshmoonWaterRenderTargetListener::MeshmoonWaterRenderTargetListener(EC_Meshmoon
 
         UpdateReflectionPlane();
 
+        const uint resolution = parentComponent_->ReflectionResolution();
         reflectionTexture_ = Ogre::TextureManager::getSingleton().createManual(AppendTritonResourceId("TritonReflectionMap"),
             Ogre::ResourceGroupManager::DEFAULT_RESOURCE_GROUP_NAME,
             Ogre::TEX_TYPE_2D,
-            1024, 1024,
+            resolution, resolution,
             0,
             Ogre::PF_R8G8B8,
             Ogre::TU_RENDERTARGET);
@@ -99,7 +100,7 @@ MeshmoonWaterRenderTargetListener::MeshmoonWaterRenderTargetListener(EC_Meshmoon
         flippedTexture_ = Ogre::TextureManager::getSingleton().createManual(AppendTritonResourceId("TritonFlippedReflectionMap"),
                                                                             Ogre::ResourceGroupManager::DEFAULT_RESOURCE_GROUP_NAME,
                                                                             Ogre::TEX_TYPE_2D,
-                                                                            1024, 1024,
+                                                                            resolution, resolution,
                                                                             0,
                                                                             Ogre::PF_R8G8B8,
                                                                             Ogre::TU_DYNAMIC);
@@ -579,16 +580,16 @@ void MeshmoonWaterRenderQueueListener::SetReflectionMap()
         GLuint glFlippedId = flippedTexture->getGLID();
         if (glTexId)
         {
-            // Get pixel data from reflection texture
-            uint dataSize = 1024 * 1024 * 4;
+            // Get pixel data from reflection texture. Resolution is at most 1024, the size of data_.
+            const int size = static_cast<int>(glTexture->getWidth());
             glBindTexture(GL_TEXTURE_2D, glTexId);
             glGetTexImage(GL_TEXTURE_2D, 0, GL_RGBA, GL_UNSIGNED_BYTE, data_);
             glBindTexture(GL_TEXTURE_2D, glFlippedId);
             
-            for(int i = 0; i < 1024; ++i)
+            for(int i = 0; i < size; ++i)
             {
-                int index = i * 1024 * 4;
-                glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 1023 - i, 1024, 1, GL_RGBA, GL_UNSIGNED_BYTE, &data_[index]);
+                int index = i * size * 4;
+                glTexSubImage2D(GL_TEXTURE_2D, 0, 0, size - 1 - i, size, 1, GL_RGBA, GL_UNSIGNED_BYTE, &data_[index]);
             }
             
             glBindTexture(GL_TEXTURE_2D, 0);
@@ -0,0 +1,58 @@
+/**
+    @author Admino Technologies Ltd.
+
+    Copyright 2013 Admino Technologies Ltd.
+    All rights reserved.
+
+    @file   OpenNIAcquisitionThread.cpp
+    @brief  Sensor acquisition thread for OpenNIDevice. */
+
+#include "StableHeaders.h"
+
+#include "OpenNIAcquisitionThread.h"
+#include "OpenNIDevice.h"
+
+OpenNIAcquisitionThread::OpenNIAcquisitionThread(OpenNIDevice *device) :
+    device_(device),
+    stop_(0)
+{
+}
+
+OpenNIAcquisitionThread::~OpenNIAcquisitionThread()
+{
+    Stop();
+}
+
+void OpenNIAcquisitionThread::Stop()
+{
+    stop_.fetchAndStoreOrdered(1);
+    if(isRunning())
+        wait();
+}
+
+void OpenNIAcquisitionThread::run()
+{
+    while(!static_cast<int>(stop_))
+    {
+        SensorFrame &frame = device_->frames_.WriteSlot();
+        if(device_->IsReplaying())
+        {
+            qint64 waitUsecs = 0;
+            if(!device_->AcquireReplay(frame, waitUsecs))
+            {
+                // End of a non looping stream.
+                msleep(100);
+                continue;
+            }
+            // Deliver at the recorded cadence.
+            if(waitUsecs > 0)
+                usleep(static_cast<unsigned long>(waitUsecs));
+        }
+        else if(!device_->AcquireLive(frame))
+        {
+            msleep(10);
+            continue;
+        }
+        device_->Publish(frame);
+    }
+}
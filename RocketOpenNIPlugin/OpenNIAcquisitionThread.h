@@ -0,0 +1,34 @@
+/**
+    @author Admino Technologies Ltd.
+
+    Copyright 2013 Admino Technologies Ltd.
+    All rights reserved.
+
+    @file   OpenNIAcquisitionThread.h
+    @brief  Sensor acquisition thread for OpenNIDevice. */
+
+#pragma once
+
+#include "RocketOpenNIPluginFwd.h"
+
+#include <QThread>
+#include <QAtomicInt>
+
+/// Reads sensor or replay frames and publishes them to OpenNIDevice.
+class OpenNIAcquisitionThread : public QThread
+{
+public:
+    explicit OpenNIAcquisitionThread(OpenNIDevice *device);
+    virtual ~OpenNIAcquisitionThread();
+
+    /// Requests the thread to stop and waits for it to exit.
+    void Stop();
+
+protected:
+    /// QThread override.
+    void run();
+
+private:
+    OpenNIDevice *device_;
+    QAtomicInt stop_;
+};
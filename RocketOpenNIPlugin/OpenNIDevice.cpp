@@ -2,35 +2,68 @@
 #include "StableHeaders.h"
 
 #include "OpenNIDevice.h"
+#include "OpenNIAcquisitionThread.h"
 #include "TrackingUser.h"
 
+#include <QMutexLocker>
+
+#include <cstring>
+
 OpenNIDevice::OpenNIDevice() :
     LC("[RocketOpenNIPlugin]: "),
     initialized_(false),
-    needPose_(false)
+    needPose_(false),
+    replaying_(false),
+    replayLoop_(true),
+    replayEnded_(false),
+    thread_(0),
+    frameCounter_(0),
+    replayStartUsecs_(-1),
+    replayFirstCaptureUsecs_(0),
+    replayLastCaptureUsecs_(0),
+    replayAtEnd_(false),
+    filterSettingsDirty_(false),
+    framesPublished_(0),
+    framesConsumed_(0),
+    totalAcquireMsecs_(0.f),
+    totalLatencyMsecs_(0.f),
+    maxLatencyMsecs_(0.f)
 {   
-
+    for(int i = 0; i < MAX_BONE_COUNT; ++i)
+        availableJoints_[i] = false;
+    filter_.SetSettings(filterSettings_);
 }   
 
 OpenNIDevice::~OpenNIDevice()
 {
+    // Stop acquisition before tearing down the callbacks it invokes
+    Uninitialize();
+
     // Disconnect callbacks
-    userGenerator_.UnregisterUserCallbacks(userCallbacks_);
-    userGenerator_.GetSkeletonCap().UnregisterFromCalibrationStart(calibrationStart_);
-    userGenerator_.GetSkeletonCap().UnregisterFromCalibrationComplete(calibrationComplete_);
-    userGenerator_.GetPoseDetectionCap().UnregisterFromPoseDetected(poseDetected_);
+    if(userGenerator_.IsValid())
+    {
+        userGenerator_.UnregisterUserCallbacks(userCallbacks_);
+        userGenerator_.GetSkeletonCap().UnregisterFromCalibrationStart(calibrationStart_);
+        userGenerator_.GetSkeletonCap().UnregisterFromCalibrationComplete(calibrationComplete_);
+        userGenerator_.GetPoseDetectionCap().UnregisterFromPoseDetected(poseDetected_);
+    }
+
+    StopRecording();
+    replay_.Close();
 
-    usersToDelete_.clear();
     foreach(TrackingUser *user, users_)
     {
         SAFE_DELETE(user);
         continue;
     }
+    users_.clear();
 }
 
 void OpenNIDevice::Initialize()
 {
     initialized_ = false;
+    XnStatus status = XN_STATUS_OK;
+
     // Load configuration from file
     xn::EnumerationErrors errors;
     status = context_.InitFromXmlFile(CONFIG_XML_PATH, scriptNode_, &errors);
@@ -74,54 +107,403 @@ void OpenNIDevice::Initialize()
     if (userGenerator_.GetSkeletonCap().NeedPoseForCalibration())
     {
         needPose_ = true;
-        if (userGenerator_.IsCapabilitySupported(XN_CAPABILITY_POSE_DETECTION))
+        if (!userGenerator_.IsCapabilitySupported(XN_CAPABILITY_POSE_DETECTION))
         {
             LogInfo(LC + "Pose required, but not supported.");
             return;
         }
-        status = userGenerator_.GetPoseDetectionCap().RegisterToPoseDetected(&UserPose_PoseDetected, NULL, poseDetected_);
+        status = userGenerator_.GetPoseDetectionCap().RegisterToPoseDetected(&UserPose_PoseDetected, this, poseDetected_);
         CHECK_STATUS(status, "Connect pose detected callback to user generator");
         userGenerator_.GetSkeletonCap().GetCalibrationPose(strPose_);
     }
 
     userGenerator_.GetSkeletonCap().SetSkeletonProfile(XN_SKEL_PROFILE_ALL);
 
+    // Joint availability does not change after the profile is set, query it once here
+    // instead of from the main loop while the acquisition thread is using the sensor.
+    for(int i = 0; i < MAX_BONE_COUNT; ++i)
+        availableJoints_[i] = (userGenerator_.GetSkeletonCap().IsJointAvailable((XnSkeletonJoint)(i + 1)) == TRUE);
+
     // Make it start generating data
     status = context_.StartGeneratingAll();
     CHECK_STATUS(status, "Start generating data");
 
     initialized_ = true;
+    StartAcquisition();
+}
+
+void OpenNIDevice::InitializeReplay(const QString &filePath, bool loop)
+{
+    initialized_ = false;
+    if(!replay_.Open(filePath))
+        return;
+
+    LogInfo(LC + "Replaying skeleton stream " + filePath);
+
+    replaying_ = true;
+    replayLoop_ = loop;
+    needPose_ = false;
+    for(int i = 0; i < MAX_BONE_COUNT; ++i)
+        availableJoints_[i] = true;
+
+    initialized_ = true;
+    StartAcquisition();
+}
+
+void OpenNIDevice::StartAcquisition()
+{
+    if(thread_)
+        return;
+
+    clock_.start();
+    thread_ = new OpenNIAcquisitionThread(this);
+    thread_->start(QThread::HighPriority);
+}
+
+void OpenNIDevice::Uninitialize()
+{
+    if(thread_)
+        thread_->Stop();
+    SAFE_DELETE(thread_);
+}
+
+qint64 OpenNIDevice::ClockUsecs() const
+{
+    return clock_.nsecsElapsed() / 1000;
+}
+
+void OpenNIDevice::SetFilterSettings(const SkeletonFilterSettings &settings)
+{
+    filterSettings_ = settings;
+
+    QMutexLocker lock(&filterMutex_);
+    pendingFilterSettings_ = settings;
+    filterSettingsDirty_ = true;
+}
+
+QVariantMap OpenNIDevice::FilterStats() const
+{
+    QVariantMap stats;
+    stats["samples"] = filterStats_.samples;
+    stats["jitterSamples"] = filterStats_.jitterSamples;
+    stats["rawJitterMm"] = filterStats_.rawJitterMm;
+    stats["filteredJitterMm"] = filterStats_.filteredJitterMm;
+    stats["holdErrorMm"] = filterStats_.holdErrorMm;
+    stats["predictionErrorMm"] = filterStats_.predictionErrorMm;
+    return stats;
+}
+
+bool OpenNIDevice::IsJointAvailable(int index) const
+{
+    if(index < 1 || index > MAX_BONE_COUNT)
+        return false;
+    return availableJoints_[index - 1];
+}
+
+bool OpenNIDevice::StartRecording(const QString &filePath)
+{
+    QMutexLocker lock(&recordMutex_);
+    if(!recorder_.Open(filePath))
+        return false;
+
+    LogInfo(LC + "Recording skeleton stream to " + filePath);
+    return true;
+}
+
+void OpenNIDevice::StopRecording()
+{
+    QMutexLocker lock(&recordMutex_);
+    recorder_.Close();
+}
+
+QVariantMap OpenNIDevice::AcquisitionStats() const
+{
+    QVariantMap stats;
+    stats["framesPublished"] = static_cast<int>(framesPublished_);
+    stats["framesConsumed"] = framesConsumed_;
+    stats["framesOverwritten"] = frames_.Overwritten();
+    stats["averageAcquireMsecs"] = (framesConsumed_ > 0 ? totalAcquireMsecs_ / framesConsumed_ : 0.f);
+    stats["averageLatencyMsecs"] = (framesConsumed_ > 0 ? totalLatencyMsecs_ / framesConsumed_ : 0.f);
+    stats["maxLatencyMsecs"] = maxLatencyMsecs_;
+    return stats;
+}
+
+bool OpenNIDevice::AcquireLive(SensorFrame &frame)
+{
+    XnStatus status = context_.WaitAnyUpdateAll();
+    if(status != XN_STATUS_OK)
+        return false;
+
+    const qint64 startUsecs = ClockUsecs();
+    frame.sensorTimestamp = depthGenerator_.GetTimestamp();
+    frame.captureUsecs = startUsecs;
+
+    XnUserID ids[MAX_TRACKED_USERS];
+    XnUInt16 count = MAX_TRACKED_USERS;
+    userGenerator_.GetUsers(ids, count);
+
+    xn::SkeletonCapability skeleton = userGenerator_.GetSkeletonCap();
+    XnPoint3D real[MAX_BONE_COUNT];
+    XnPoint3D projective[MAX_BONE_COUNT];
+
+    frame.numUsers = 0;
+    for(int u = 0; u < count && u < MAX_TRACKED_USERS; ++u)
+    {
+        SkeletonSnapshot &user = frame.users[frame.numUsers++];
+        user.userId = ids[u];
+
+        XnPoint3D com;
+        userGenerator_.GetCoM(ids[u], com);
+        user.centerOfMass = float3(com.X, com.Y, com.Z);
+
+        user.tracking = (skeleton.IsTracking(ids[u]) == TRUE);
+        if(!user.tracking)
+            continue;
+
+        for(int i = 0; i < MAX_BONE_COUNT; ++i)
+        {
+            XnSkeletonJointPosition joint;
+            memset(&joint, 0, sizeof(joint));
+            if(availableJoints_[i])
+                skeleton.GetSkeletonJointPosition(ids[u], (XnSkeletonJoint)(i + 1), joint);
+
+            real[i] = joint.position;
+            user.positions[i] = float3(joint.position.X, joint.position.Y, joint.position.Z);
+            user.confidence[i] = joint.fConfidence;
+        }
+
+        // Convert all joints with a single call
+        depthGenerator_.ConvertRealWorldToProjective(MAX_BONE_COUNT, real, projective);
+        for(int i = 0; i < MAX_BONE_COUNT; ++i)
+            user.projectivePositions[i] = float3(projective[i].X, projective[i].Y, projective[i].Z);
+    }
+
+    frame.acquireMsecs = static_cast<float>(ClockUsecs() - startUsecs) / 1000.f;
+    return true;
+}
+
+bool OpenNIDevice::AcquireReplay(SensorFrame &frame, qint64 &waitUsecs)
+{
+    waitUsecs = 0;
+    if(!replay_.Read(frame, replayLoop_))
+    {
+        if(!replayAtEnd_)
+        {
+            replayAtEnd_ = true;
+            QueueEvent(DeviceEvent::ReplayEnded, 0);
+        }
+        return false;
+    }
+
+    // First frame or the stream looped, restart the replay clock.
+    if(replayStartUsecs_ < 0 || frame.captureUsecs < replayLastCaptureUsecs_)
+    {
+        if(replayStartUsecs_ >= 0)
+            QueueEvent(DeviceEvent::ReplayEnded, 0);
+        replayStartUsecs_ = ClockUsecs();
+        replayFirstCaptureUsecs_ = frame.captureUsecs;
+    }
+    replayLastCaptureUsecs_ = frame.captureUsecs;
+
+    waitUsecs = (replayStartUsecs_ + (frame.captureUsecs - replayFirstCaptureUsecs_)) - ClockUsecs();
+    frame.acquireMsecs = 0.f;
+    return true;
+}
+
+void OpenNIDevice::Publish(SensorFrame &frame)
+{
+    // Replayed frames are delivered now, latency is measured from here.
+    if(replaying_)
+        frame.captureUsecs = ClockUsecs();
+    frame.frameId = ++frameCounter_;
+
+    // Record raw data so filters can be evaluated against it on replay.
+    {
+        QMutexLocker lock(&recordMutex_);
+        if(recorder_.IsOpen())
+            recorder_.Write(frame);
+    }
+
+    {
+        QMutexLocker lock(&filterMutex_);
+        if(filterSettingsDirty_)
+        {
+            filter_.SetSettings(pendingFilterSettings_);
+            filterSettingsDirty_ = false;
+        }
+    }
+    filter_.Filter(frame);
+    frame.filterStats = filter_.Stats();
+
+    frames_.Publish();
+    framesPublished_.fetchAndAddRelaxed(1);
 }
 
 void OpenNIDevice::Update()
 {
-    context_.WaitAnyUpdateAll();
+    ProcessEvents();
+
+    if(frames_.Consume())
+        ApplyFrame(frames_.ReadSlot());
+
+    // The final frame was published before the end was queued, so it has been consumed above.
+    if(replayEnded_)
+    {
+        replayEnded_ = false;
+        LogReplayStats();
+        emit ReplayFinished();
+    }
+}
+
+void OpenNIDevice::ApplyFrame(const SensorFrame &frame)
+{
+    const float latencyMsecs = static_cast<float>(ClockUsecs() - frame.captureUsecs) / 1000.f;
+    framesConsumed_++;
+    totalAcquireMsecs_ += frame.acquireMsecs;
+    totalLatencyMsecs_ += latencyMsecs;
+    if(latencyMsecs > maxLatencyMsecs_)
+        maxLatencyMsecs_ = latencyMsecs;
+    filterStats_ = frame.filterStats;
+
+    // Predict from acquisition to display time.
+    const float predictionSecs = (filterSettings_.mode != SkeletonFilterSettings::NoFilter ? (latencyMsecs + filterSettings_.displayLatencyMsecs) / 1000.f : 0.f);
+
+    if(replaying_)
+        ProcessReplayUsers(frame);
 
     foreach(TrackingUser *user, users_)
     {
         if(!user)
             continue;
 
-        user->Update();
+        const SkeletonSnapshot *snapshot = frame.User(user->Id());
+        if(snapshot)
+            user->Update(*snapshot, predictionSecs);
     }
+}
 
-    // Delete all needed users
-    foreach(int user, usersToDelete_)
-        RemoveUser(user);
-    usersToDelete_.clear();
+void OpenNIDevice::QueueEvent(DeviceEvent::Type type, int id)
+{
+    DeviceEvent e;
+    e.type = type;
+    e.userId = id;
+
+    QMutexLocker lock(&eventMutex_);
+    events_ << e;
 }
 
-void OpenNIDevice::AddUser(int id)
+void OpenNIDevice::ProcessEvents()
 {
-    LogInfo(LC + "User: " + QString::number(id) + " found.");
+    QList<DeviceEvent> events;
+    {
+        QMutexLocker lock(&eventMutex_);
+        if(events_.isEmpty())
+            return;
+        events.swap(events_);
+    }
 
-    users_.push_back(new TrackingUser(id, this));
+    foreach(const DeviceEvent &e, events)
+    {
+        switch(e.type)
+        {
+        case DeviceEvent::UserFound:
+            LogInfo(LC + "User: " + QString::number(e.userId) + " found.");
+            emit UserFound(CreateUser(e.userId));
+            break;
+        case DeviceEvent::UserLost:
+            LogInfo(LC + "User: " + QString::number(e.userId) + " lost.");
+            emit UserLost(GetUser(e.userId));
+            RemoveUser(e.userId);
+            break;
+        case DeviceEvent::PoseDetected:
+            LogInfo(LC + "Pose detected, calibration started...");
+            emit PoseDetected(GetUser(e.userId));
+            break;
+        case DeviceEvent::CalibrationStart:
+            emit CalibrationStart(GetUser(e.userId));
+            break;
+        case DeviceEvent::CalibrationComplete:
+        {
+            LogInfo(LC + "Calibration complete, start tracking user " + QString::number(e.userId));
+            TrackingUser *user = GetUser(e.userId);
+            if(user)
+                user->StartTracking();
+            emit CalibrationComplete(user);
+            break;
+        }
+        case DeviceEvent::CalibrationFailed:
+            LogInfo(LC + "Calibration failed. Trying again...");
+            break;
+        case DeviceEvent::ReplayEnded:
+            replayEnded_ = true;
+            break;
+        }
+    }
+}
 
-    if(!GetUser(id))
-        return;
+void OpenNIDevice::LogReplayStats()
+{
+    LogInfo(LC + QString("Replay finished with filter mode %1: %2 jitter samples, raw jitter %3 mm, filtered jitter %4 mm, %5 prediction samples, hold error %6 mm, prediction error %7 mm")
+        .arg(SkeletonFilterSettings::ModeToString(filterSettings_.mode)).arg(filterStats_.jitterSamples)
+        .arg(filterStats_.rawJitterMm, 0, 'f', 2).arg(filterStats_.filteredJitterMm, 0, 'f', 2).arg(filterStats_.samples)
+        .arg(filterStats_.holdErrorMm, 0, 'f', 2).arg(filterStats_.predictionErrorMm, 0, 'f', 2));
+    LogInfo(LC + QString("Replay finished: %1 frames consumed, %2 overwritten, %3 msecs average latency")
+        .arg(framesConsumed_).arg(frames_.Overwritten()).arg(framesConsumed_ > 0 ? totalLatencyMsecs_ / framesConsumed_ : 0.f, 0, 'f', 2));
+}
 
-    connect(GetUser(id), SIGNAL(Updated(int, TrackingSkeleton*)), this, SLOT(UserUpdated(int, TrackingSkeleton*)));
-    emit UserFound(GetUser(id));
+void OpenNIDevice::ProcessReplayUsers(const SensorFrame &frame)
+{
+    QSet<int> present;
+    for(int i = 0; i < frame.numUsers; ++i)
+    {
+        const SkeletonSnapshot &snapshot = frame.users[i];
+        present.insert(snapshot.userId);
+
+        TrackingUser *user = GetUser(snapshot.userId);
+        if(!user)
+        {
+            LogInfo(LC + "User: " + QString::number(snapshot.userId) + " found.");
+            user = CreateUser(snapshot.userId);
+            emit UserFound(user);
+        }
+        if(snapshot.tracking && !user->IsTracking())
+        {
+            user->StartTracking();
+            emit CalibrationComplete(user);
+        }
+    }
+
+    foreach(int id, replayUsers_)
+    {
+        if(present.contains(id))
+            continue;
+        LogInfo(LC + "User: " + QString::number(id) + " lost.");
+        emit UserLost(GetUser(id));
+        RemoveUser(id);
+    }
+    replayUsers_ = present;
+}
+
+TrackingUser *OpenNIDevice::CreateUser(int id)
+{
+    TrackingUser *user = GetUser(id);
+    if(user)
+        return user;
+
+    user = new TrackingUser(id, this);
+    users_.push_back(user);
+    connect(user, SIGNAL(Updated(int, TrackingSkeleton*)), this, SLOT(UserUpdated(int, TrackingSkeleton*)));
+    return user;
+}
+
+void OpenNIDevice::AddUser(int id)
+{
+    if(needPose_)
+        userGenerator_.GetPoseDetectionCap().StartPoseDetection(strPose_, id);
+    else
+        userGenerator_.GetSkeletonCap().RequestCalibration(id, TRUE);
+
+    QueueEvent(DeviceEvent::UserFound, id);
 }
 
 void OpenNIDevice::UserUpdated(int id, TrackingSkeleton *skeleton)
@@ -131,9 +513,7 @@ void OpenNIDevice::UserUpdated(int id, TrackingSkeleton *skeleton)
 
 void OpenNIDevice::RequestUserRemove(int id)
 {
-    LogInfo(LC + "User: " + QString::number(id) + " lost.");
-    usersToDelete_.push_back(id);
-    emit UserLost(GetUser(id));
+    QueueEvent(DeviceEvent::UserLost, id);
 }
 
 TrackingUser *OpenNIDevice::GetUser(int id)
@@ -152,8 +532,6 @@ void OpenNIDevice::RemoveUser(int id)
     if(users_.size() <= 0)
         return;
 
-    LogInfo(LC + "Pose detected.");
-
     foreach(TrackingUser *user, users_)
     {
         if(user->Id() == id)
@@ -167,59 +545,30 @@ void OpenNIDevice::RemoveUser(int id)
 
 void OpenNIDevice::RequestCalibration(int id)
 {
-    if(users_.size() <= 0)
-        return;
-
-    LogInfo(LC + "Calibration started...");
-
     userGenerator_.GetPoseDetectionCap().StopPoseDetection(id);
     userGenerator_.GetSkeletonCap().RequestCalibration(id, TRUE);
 
-    if(!users_[id - 1])
-        emit PoseDetected(NULL);
-    else
-        emit PoseDetected(users_[id - 1]);
+    QueueEvent(DeviceEvent::PoseDetected, id);
 }
 
 void OpenNIDevice::CalibrationStarted(int id)
 {
-    if(users_.size() <= 0)
-        return;
-
-    qDebug() << "Users size:" << users_.size();
-
-    if(users_.size() < id)
-        return;
-
-    if(!users_[id - 1])
-        emit CalibrationStart(NULL);
-    else
-        emit CalibrationStart(users_[id - 1]);
+    QueueEvent(DeviceEvent::CalibrationStart, id);
 }
 
 void OpenNIDevice::CalibrationFinished(XnCalibrationStatus eStatus, int id)
 {
-    if(users_.size() <= 0)
-        return;
-
     if (eStatus == XN_CALIBRATION_STATUS_OK)
     {
         // Calibration succeeded
-        LogInfo(LC + "Calibration complete, start tracking user " + QString::number(id));		
         userGenerator_.GetSkeletonCap().StartTracking(id);
-
-        users_[id - 1]->StartTracking();
-
-        if(!users_[id - 1])
-            emit CalibrationComplete(NULL);
-        else
-            emit CalibrationComplete(users_[id - 1]);
+        QueueEvent(DeviceEvent::CalibrationComplete, id);
     }
     else
     {
-        LogInfo(LC + "Calibration failed. Trying again...");
         userGenerator_.GetPoseDetectionCap().StopPoseDetection(id);
         userGenerator_.GetSkeletonCap().RequestCalibration(id, TRUE);
+        QueueEvent(DeviceEvent::CalibrationFailed, id);
     }
 }
 
@@ -3,6 +3,8 @@
 
 #include "RocketOpenNIApi.h"
 #include "RocketOpenNIPluginFwd.h"
+#include "SkeletonStream.h"
+#include "SkeletonFilter.h"
 
 #include <XnOpenNI.h>
 #include <XnCodecIDs.h>
@@ -10,6 +12,11 @@
 #include <XnPropNames.h>
 
 #include <QObject>
+#include <QMutex>
+#include <QList>
+#include <QSet>
+#include <QVariantMap>
+#include <QElapsedTimer>
 
 #define CONFIG_XML_PATH "OpenNIConfig.xml"
 
@@ -20,6 +27,12 @@
         LogInfo(LC + message + ": " + error);   \
     }   \
 
+/// OpenNI sensor device.
+/** Sensor data is acquired on a dedicated thread that publishes SensorFrame snapshots through
+    a lock-free latest value buffer. Update, called from the main loop, never waits for the sensor:
+    it handles queued user and calibration events and applies the latest frame, if any, to the users.
+    Frames can be recorded to a file and replayed in place of the sensor with InitializeReplay.
+    Joint positions are filtered in the acquisition thread and predicted to display time when applied. */
 class OPENNI_MODULE_API OpenNIDevice : public QObject
 {
     Q_OBJECT
@@ -28,15 +41,57 @@ public:
     OpenNIDevice();
     ~OpenNIDevice();
 
+    /// Initializes the sensor from CONFIG_XML_PATH and starts acquisition.
     void Initialize();
 
+    /// Initializes replay of a stream recorded with StartRecording and starts acquisition.
+    /** @param loop Restart from the beginning at the end of the stream. */
+    void InitializeReplay(const QString &filePath, bool loop = true);
+
+    /// Stops acquisition.
+    void Uninitialize();
+
+    /// Handles queued events and applies the latest sensor frame. Never blocks.
     void Update();
         
     bool Initialized() { return initialized_; }
 
     bool NeedPose() { return needPose_; };
 
-    // These are bridge methods for OpenNI callbacks
+    /// Returns if in replay mode.
+    bool IsReplaying() const { return replaying_; }
+
+    /// Starts recording acquired frames to @c filePath.
+    bool StartRecording(const QString &filePath);
+
+    /// Stops recording.
+    void StopRecording();
+
+    /// Sets skeleton filter and prediction settings.
+    /** Filtering runs in the acquisition thread, settings are applied from the next frame on. */
+    void SetFilterSettings(const SkeletonFilterSettings &settings);
+    SkeletonFilterSettings FilterSettings() const { return filterSettings_; }
+
+    /// Returns skeleton filter quality statistics.
+    /** Keys: samples, jitterSamples, rawJitterMm, filteredJitterMm, holdErrorMm, predictionErrorMm.
+        Errors are measured against a smoothed reference the filter has not seen, see SkeletonFilterStats.
+        Run with --openniReplay to compare filter settings on the same recorded stream, the statistics
+        are logged every time the replay reaches the end of the stream. */
+    Q_INVOKABLE QVariantMap FilterStats() const;
+
+    /// Returns if joint @c index (1-24) is available in the sensors skeleton profile.
+    bool IsJointAvailable(int index) const;
+
+    /// Returns acquisition statistics.
+    /** Keys: framesPublished, framesConsumed, framesOverwritten, averageAcquireMsecs,
+        averageLatencyMsecs, maxLatencyMsecs. Latency is measured from acquisition to
+        consumption on the main loop. Logged by the openniStats console command. */
+    Q_INVOKABLE QVariantMap AcquisitionStats() const;
+
+    /// Returns device clock time in microseconds, used for frame timestamps.
+    qint64 ClockUsecs() const;
+
+    // These are bridge methods for OpenNI callbacks, invoked in the acquisition thread.
     void AddUser(int id); ///< For internal use only!
     void RequestUserRemove(int id); ///< For internal use only!
 
@@ -54,6 +109,9 @@ signals:
     void CalibrationStart(TrackingUser *user);
     void CalibrationComplete(TrackingUser *user);
 
+    /// Emitted when a replay reaches the end of the stream, after the statistics have been logged.
+    void ReplayFinished();
+
 private slots:
     void UserUpdated(int id, TrackingSkeleton *skeleton);
 
@@ -65,9 +123,50 @@ protected:
     XnChar strPose_[20];
 
 private:
+    /// User and calibration events queued by the acquisition thread.
+    struct DeviceEvent
+    {
+        enum Type
+        {
+            UserFound,
+            UserLost,
+            PoseDetected,
+            CalibrationStart,
+            CalibrationComplete,
+            CalibrationFailed,
+            ReplayEnded
+        };
+
+        Type type;
+        int userId;
+    };
+
     TrackingUser *GetUser(int id);
+    TrackingUser *CreateUser(int id);
     void RemoveUser(int id);
 
+    void StartAcquisition();
+    void QueueEvent(DeviceEvent::Type type, int id);
+    void ProcessEvents();
+
+    /// Applies a consumed sensor frame to the users.
+    void ApplyFrame(const SensorFrame &frame);
+
+    /// Logs filter and acquisition statistics at the end of a replay.
+    void LogReplayStats();
+
+    /// Synthesizes user events for replayed frames.
+    void ProcessReplayUsers(const SensorFrame &frame);
+
+    /// Acquisition thread: waits for and reads the next sensor frame.
+    bool AcquireLive(SensorFrame &frame);
+
+    /// Acquisition thread: reads the next replay frame, paced by the recorded timestamps.
+    bool AcquireReplay(SensorFrame &frame, qint64 &waitUsecs);
+
+    /// Acquisition thread: records and publishes @c frame, which must be the buffers write slot.
+    void Publish(SensorFrame &frame);
+
     // New user detected
     static void XN_CALLBACK_TYPE User_NewUser(xn::UserGenerator& generator, XnUserID nId, void* pCookie);
 
@@ -96,12 +195,51 @@ private:
 
     // Users list
     QList<TrackingUser*> users_;
-    QList<int> usersToDelete_;
 
     bool initialized_;
     bool needPose_;
+    bool replaying_;
+    bool replayLoop_;
+    bool replayEnded_; ///< End of the stream was reached, statistics are logged after the final frame is consumed.
+    bool availableJoints_[MAX_BONE_COUNT];
+
+    // Acquisition
+    OpenNIAcquisitionThread *thread_;
+    QElapsedTimer clock_;
+    LatestValueBuffer<SensorFrame> frames_;
+    quint32 frameCounter_;
+
+    // Events from the acquisition thread
+    QMutex eventMutex_;
+    QList<DeviceEvent> events_;
+
+    // Record/replay, accessed by the acquisition thread
+    QMutex recordMutex_;
+    SkeletonStreamWriter recorder_;
+    SkeletonStreamReader replay_;
+    qint64 replayStartUsecs_;
+    qint64 replayFirstCaptureUsecs_;
+    qint64 replayLastCaptureUsecs_;
+    bool replayAtEnd_; ///< Acquisition thread reached the end of a non looping stream.
+    QSet<int> replayUsers_;
+
+    // Filtering. The acquisition thread picks up pending settings at the next frame.
+    SkeletonFilterSettings filterSettings_;
+    QMutex filterMutex_;
+    SkeletonFilterSettings pendingFilterSettings_;
+    bool filterSettingsDirty_;
+    SkeletonFilter filter_;
+    SkeletonFilterStats filterStats_;
+
+    // Statistics, published count is written by the acquisition thread.
+    QAtomicInt framesPublished_;
+    uint framesConsumed_;
+    float totalAcquireMsecs_;
+    float totalLatencyMsecs_;
+    float maxLatencyMsecs_;
 
     // Friend classes
     friend class TrackingSkeleton;
     friend class TrackingUser;
+    friend class OpenNIAcquisitionThread;
 };
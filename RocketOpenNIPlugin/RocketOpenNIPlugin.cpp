@@ -12,11 +12,12 @@
 #include "RocketOpenNIPlugin.h"
 #include "OpenNIDevice.h"
 
+#include "ConsoleAPI.h"
+
 RocketOpenNIPlugin::RocketOpenNIPlugin() :
     IModule("RocketOpenNIPlugin"),
     LC("[RocketOpenNIPlugin]: "),
-    device_(0),
-    elapsedTime(0)
+    device_(0)
 {
 }
 
@@ -34,7 +35,18 @@ void RocketOpenNIPlugin::Initialize()
     if(!device_)
         return;
     
-    device_->Initialize();
+    // Replay a recorded skeleton stream instead of using the sensor.
+    // Filter statistics are logged at the end of the stream, --openniReplayOnce stops there.
+    if(framework_->HasCommandLineParameter("--openniReplay"))
+    {
+        QStringList params = framework_->CommandLineParameters("--openniReplay");
+        if(!params.isEmpty())
+            device_->InitializeReplay(params.first(), !framework_->HasCommandLineParameter("--openniReplayOnce"));
+        else
+            LogError(LC + "--openniReplay requires a file path.");
+    }
+    else
+        device_->Initialize();
 
     // OpenNI device initialization failed, don't do anything.
     if(!device_->Initialized())
@@ -47,6 +59,28 @@ void RocketOpenNIPlugin::Initialize()
     connect(device_, SIGNAL(CalibrationStart(TrackingUser*)), this, SLOT(DeviceCalibrationStart(TrackingUser*)));
     connect(device_, SIGNAL(CalibrationComplete(TrackingUser*)), this, SLOT(DeviceCalibrationComplete(TrackingUser*)));
     connect(device_, SIGNAL(Updated(int, TrackingSkeleton*)), this, SLOT(UpdatedUser(int, TrackingSkeleton*)));
+
+    framework_->Console()->RegisterCommand("openniStats", "Prints OpenNI sensor acquisition and skeleton filter statistics.", this, SLOT(PrintStats()));
+
+    // Skeleton filter mode: none, oneeuro or doubleexp
+    if(framework_->HasCommandLineParameter("--openniFilter"))
+    {
+        QStringList params = framework_->CommandLineParameters("--openniFilter");
+        SkeletonFilterSettings settings = device_->FilterSettings();
+        if(!params.isEmpty())
+            settings.mode = SkeletonFilterSettings::ModeFromString(params.first());
+        device_->SetFilterSettings(settings);
+    }
+
+    // Record the acquired skeleton stream for later replay
+    if(framework_->HasCommandLineParameter("--openniRecord"))
+    {
+        QStringList params = framework_->CommandLineParameters("--openniRecord");
+        if(!params.isEmpty())
+            device_->StartRecording(params.first());
+        else
+            LogError(LC + "--openniRecord requires a file path.");
+    }
 }
 
 void RocketOpenNIPlugin::Uninitialize()
@@ -54,6 +88,7 @@ void RocketOpenNIPlugin::Uninitialize()
     if(!device_)
         return;
     
+    device_->Uninitialize();
     SAFE_DELETE(device_);
 }
 
@@ -68,22 +103,13 @@ bool RocketOpenNIPlugin::Initialized()
     return true;
 }
 
-void RocketOpenNIPlugin::Update(f64 frametime)
+void RocketOpenNIPlugin::Update(f64 UNUSED_PARAM(frametime))
 {
-    if(!device_->Initialized())
-        return;
-
-    elapsedTime += frametime;
-
-    if(elapsedTime < (1.0 / 30.0))
-        return;
-
-    if(!device_)
+    if(!device_ || !device_->Initialized())
         return;
 
+    // Sensor data is acquired in its own thread, this only picks up the latest frame and never waits.
     device_->Update();
-
-    elapsedTime = 0;
 }
 
 void RocketOpenNIPlugin::DeviceUserFound(TrackingUser *user)
@@ -116,6 +142,28 @@ void RocketOpenNIPlugin::UpdatedUser(int id, TrackingSkeleton *skeleton)
     emit UserUpdated(id, skeleton);
 }
 
+void RocketOpenNIPlugin::PrintStats()
+{
+    if(!device_ || !device_->Initialized())
+    {
+        LogWarning(LC + "OpenNI device is not initialized.");
+        return;
+    }
+
+    const QVariantMap stats = device_->AcquisitionStats();
+    LogInfo(LC + QString("Acquisition: %1 frames published, %2 consumed, %3 overwritten")
+        .arg(stats["framesPublished"].toInt()).arg(stats["framesConsumed"].toUInt()).arg(stats["framesOverwritten"].toInt()));
+    LogInfo(LC + QString("Acquisition: %1 msecs average acquire, %2 msecs average latency, %3 msecs max latency")
+        .arg(stats["averageAcquireMsecs"].toFloat(), 0, 'f', 2).arg(stats["averageLatencyMsecs"].toFloat(), 0, 'f', 2)
+        .arg(stats["maxLatencyMsecs"].toFloat(), 0, 'f', 2));
+
+    const QVariantMap filter = device_->FilterStats();
+    LogInfo(LC + QString("Filter %1: %2 jitter samples, raw jitter %3 mm, filtered jitter %4 mm, %5 prediction samples, hold error %6 mm, prediction error %7 mm")
+        .arg(SkeletonFilterSettings::ModeToString(device_->FilterSettings().mode)).arg(filter["jitterSamples"].toUInt())
+        .arg(filter["rawJitterMm"].toFloat(), 0, 'f', 2).arg(filter["filteredJitterMm"].toFloat(), 0, 'f', 2).arg(filter["samples"].toUInt())
+        .arg(filter["holdErrorMm"].toFloat(), 0, 'f', 2).arg(filter["predictionErrorMm"].toFloat(), 0, 'f', 2));
+}
+
 extern "C"
 {
     DLLEXPORT void TundraPluginMain(Framework *fw)
@@ -56,10 +56,11 @@ private slots:
 
     void UpdatedUser(int id, TrackingSkeleton *skeleton);
 
+    /// Console command, logs the device acquisition and filter statistics.
+    void PrintStats();
+
 private:
     const QString LC;
 
     OpenNIDevice *device_;
-
-    float elapsedTime; // For 30 fps updating
 };
@@ -14,9 +14,14 @@ class RocketOpenNIPlugin;
 class TrackingUser;
 class TrackingSkeleton;
 class OpenNIDevice;
+class OpenNIAcquisitionThread;
+class SkeletonStreamWriter;
+class SkeletonStreamReader;
 
 // Structs
 struct TrackingBone;
+struct SkeletonSnapshot;
+struct SensorFrame;
 
 // OpenNI classes
 namespace xn
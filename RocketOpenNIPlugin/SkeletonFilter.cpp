@@ -0,0 +1,240 @@
+/**
+    @author Admino Technologies Ltd.
+
+    Copyright 2013 Admino Technologies Ltd.
+    All rights reserved.
+
+    @file   SkeletonFilter.cpp
+    @brief  Per joint smoothing and velocity estimation for skeleton snapshots. */
+
+#include "StableHeaders.h"
+
+#include "SkeletonFilter.h"
+
+#include "Math/MathFunc.h"
+
+namespace
+{
+    /// Frame time used when sensor timestamps are missing or not increasing.
+    const float DefaultFrameTime = 1.f / 30.f;
+
+    /// Per frame velocity damping while a joint is extrapolated.
+    const float LostVelocityDamping = 0.8f;
+
+    /// Returns low pass blend factor for @c cutoff Hz at @c dt seconds.
+    float LowPassAlpha(float cutoff, float dt)
+    {
+        const float tau = 1.f / (2.f * pi * cutoff);
+        return 1.f / (1.f + tau / dt);
+    }
+
+    /// Running mean update.
+    void Accumulate(float &mean, float sample, uint samples)
+    {
+        mean += (sample - mean) / static_cast<float>(samples);
+    }
+}
+
+// SkeletonFilterSettings
+
+SkeletonFilterSettings::SkeletonFilterSettings() :
+    mode(OneEuro),
+    minCutoff(1.0f),
+    beta(0.007f),
+    derivativeCutoff(1.0f),
+    smoothing(0.5f),
+    trendSmoothing(0.5f),
+    minConfidence(0.3f),
+    displayLatencyMsecs(16.f)
+{
+}
+
+SkeletonFilterSettings::Mode SkeletonFilterSettings::ModeFromString(const QString &name)
+{
+    const QString lower = name.trimmed().toLower();
+    if(lower == "none")
+        return NoFilter;
+    if(lower == "doubleexp")
+        return DoubleExponential;
+    return OneEuro;
+}
+
+QString SkeletonFilterSettings::ModeToString(Mode mode)
+{
+    switch(mode)
+    {
+    case NoFilter:
+        return "none";
+    case DoubleExponential:
+        return "doubleexp";
+    case OneEuro:
+    default:
+        return "oneeuro";
+    }
+}
+
+// SkeletonFilter
+
+SkeletonFilter::SkeletonFilter() :
+    lastSensorTimestamp_(0)
+{
+}
+
+void SkeletonFilter::SetSettings(const SkeletonFilterSettings &settings)
+{
+    if(settings.mode != settings_.mode)
+        Reset();
+    settings_ = settings;
+}
+
+void SkeletonFilter::Reset()
+{
+    for(int i = 0; i < MAX_TRACKED_USERS; ++i)
+        users_[i] = UserState();
+    stats_ = SkeletonFilterStats();
+    lastSensorTimestamp_ = 0;
+}
+
+SkeletonFilter::UserState *SkeletonFilter::StateFor(int userId)
+{
+    UserState *unused = 0;
+    for(int i = 0; i < MAX_TRACKED_USERS; ++i)
+    {
+        if(users_[i].userId == userId)
+            return &users_[i];
+        if(!unused && users_[i].userId < 0)
+            unused = &users_[i];
+    }
+    if(unused)
+        unused->userId = userId;
+    return unused;
+}
+
+void SkeletonFilter::Filter(SensorFrame &frame)
+{
+    float dt = DefaultFrameTime;
+    if(lastSensorTimestamp_ > 0 && frame.sensorTimestamp > lastSensorTimestamp_)
+        dt = Min(static_cast<float>(frame.sensorTimestamp - lastSensorTimestamp_) / 1000000.f, 0.5f);
+    lastSensorTimestamp_ = frame.sensorTimestamp;
+
+    // Free state of users no longer in the frame.
+    for(int i = 0; i < MAX_TRACKED_USERS; ++i)
+        if(users_[i].userId >= 0 && !frame.User(users_[i].userId))
+            users_[i] = UserState();
+
+    for(int u = 0; u < frame.numUsers; ++u)
+    {
+        SkeletonSnapshot &snapshot = frame.users[u];
+        for(int i = 0; i < MAX_BONE_COUNT; ++i)
+            snapshot.velocities[i] = float3::zero;
+
+        if(!snapshot.tracking || settings_.mode == SkeletonFilterSettings::NoFilter)
+            continue;
+
+        UserState *state = StateFor(snapshot.userId);
+        if(!state)
+            continue;
+        for(int i = 0; i < MAX_BONE_COUNT; ++i)
+            FilterJoint(state->joints[i], snapshot, i, dt);
+    }
+}
+
+void SkeletonFilter::FilterJoint(JointState &joint, SkeletonSnapshot &snapshot, int index, float dt)
+{
+    const float3 raw = snapshot.positions[index];
+    const float3 rawProjective = snapshot.projectivePositions[index];
+    const float confidence = snapshot.confidence[index];
+
+    if(joint.samples == 0)
+    {
+        if(confidence < settings_.minConfidence)
+            return;
+        joint.raw = joint.previousRaw = raw;
+        joint.value = joint.previousValue = raw;
+        joint.projective = rawProjective;
+        joint.velocity = joint.trend = float3::zero;
+        joint.samples = 1;
+        return;
+    }
+
+    // Low confidence: don't trust the sensor, extrapolate from the last velocity.
+    // The velocity is damped so a joint lost for long comes to rest.
+    if(confidence < settings_.minConfidence)
+    {
+        joint.predictions = 0;
+        joint.previousValue = joint.value;
+        joint.value += joint.velocity * dt;
+        joint.velocity *= LostVelocityDamping;
+        snapshot.positions[index] = joint.value;
+        snapshot.projectivePositions[index] = joint.projective;
+        snapshot.velocities[index] = joint.velocity;
+        return;
+    }
+
+    MeasurePrediction(joint, raw, dt);
+
+    const float3 previousPreviousRaw = joint.previousRaw;
+    const float3 previousPreviousValue = joint.previousValue;
+
+    // Weight in [0,1], lower confidence smooths more.
+    const float weight = (settings_.minConfidence < 1.f ? Clamp((confidence - settings_.minConfidence) / (1.f - settings_.minConfidence), 0.1f, 1.f) : 1.f);
+
+    float alpha = 1.f;
+    if(settings_.mode == SkeletonFilterSettings::OneEuro)
+    {
+        const float3 dx = (raw - joint.value) / dt;
+        joint.velocity = joint.velocity + (dx - joint.velocity) * LowPassAlpha(settings_.derivativeCutoff, dt);
+        const float cutoff = (settings_.minCutoff + settings_.beta * joint.velocity.Length()) * weight;
+        alpha = LowPassAlpha(cutoff, dt);
+
+        joint.previousValue = joint.value;
+        joint.value = joint.value + (raw - joint.value) * alpha;
+    }
+    else if(settings_.mode == SkeletonFilterSettings::DoubleExponential)
+    {
+        alpha = (1.f - Clamp(settings_.smoothing, 0.f, 0.99f)) * weight;
+        const float gamma = 1.f - Clamp(settings_.trendSmoothing, 0.f, 0.99f);
+
+        joint.previousValue = joint.value;
+        joint.value = raw * alpha + (joint.value + joint.trend) * (1.f - alpha);
+        joint.trend = (joint.value - joint.previousValue) * gamma + joint.trend * (1.f - gamma);
+        joint.velocity = joint.trend / dt;
+    }
+
+    joint.projective = joint.projective + (rawProjective - joint.projective) * alpha;
+    joint.previousRaw = joint.raw;
+    joint.raw = raw;
+    joint.samples++;
+
+    if(joint.samples > 2)
+        MeasureJitter(joint, previousPreviousRaw, previousPreviousValue);
+
+    snapshot.positions[index] = joint.value;
+    snapshot.projectivePositions[index] = joint.projective;
+    snapshot.velocities[index] = joint.velocity;
+}
+
+void SkeletonFilter::MeasurePrediction(JointState &joint, const float3 &raw, float dt)
+{
+    // Reference for the previous frame, joint.raw, from its neighbours.
+    // After a lost joint the stale raw positions are shifted out first.
+    if(joint.predictions >= 2)
+    {
+        const float3 reference = (joint.previousRaw + joint.raw * 2.f + raw) * 0.25f;
+        stats_.samples++;
+        Accumulate(stats_.holdErrorMm, joint.held.Distance(reference), stats_.samples);
+        Accumulate(stats_.predictionErrorMm, joint.predicted.Distance(reference), stats_.samples);
+    }
+
+    // Predictions for this frame, evaluated when the next sample arrives.
+    joint.predicted = joint.value + joint.velocity * dt;
+    joint.held = joint.raw;
+    joint.predictions++;
+}
+
+void SkeletonFilter::MeasureJitter(const JointState &joint, const float3 &previousPreviousRaw, const float3 &previousPreviousValue)
+{
+    stats_.jitterSamples++;
+    Accumulate(stats_.rawJitterMm, (joint.raw - joint.previousRaw * 2.f + previousPreviousRaw).Length(), stats_.jitterSamples);
+    Accumulate(stats_.filteredJitterMm, (joint.value - joint.previousValue * 2.f + previousPreviousValue).Length(), stats_.jitterSamples);
+}
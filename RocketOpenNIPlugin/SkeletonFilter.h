@@ -0,0 +1,119 @@
+/**
+    @author Admino Technologies Ltd.
+
+    Copyright 2013 Admino Technologies Ltd.
+    All rights reserved.
+
+    @file   SkeletonFilter.h
+    @brief  Per joint smoothing and velocity estimation for skeleton snapshots. */
+
+#pragma once
+
+#include "RocketOpenNIApi.h"
+#include "SkeletonStream.h"
+#include "SkeletonFilterStats.h"
+
+#include "Math/float3.h"
+
+#include <QString>
+
+/// Skeleton filter settings.
+struct OPENNI_MODULE_API SkeletonFilterSettings
+{
+    enum Mode
+    {
+        NoFilter,
+        OneEuro,            ///< Adaptive low pass, little lag on fast motion and strong smoothing when still.
+        DoubleExponential   ///< Holt double exponential smoothing with a trend term.
+    };
+
+    Mode mode;
+
+    // One Euro, frequencies in Hz and beta per mm/s.
+    float minCutoff;
+    float beta;
+    float derivativeCutoff;
+
+    // Double exponential, in the range [0,1]. 0 follows the raw data, higher values smooth more.
+    float smoothing;
+    float trendSmoothing;
+
+    /// Joints below this confidence are not updated but extrapolated from their last velocity.
+    /** Between this and full confidence smoothing is increased linearly. */
+    float minConfidence;
+
+    /// Milliseconds to predict ahead of the time the frame is consumed, ie. time to display.
+    float displayLatencyMsecs;
+
+    SkeletonFilterSettings();
+
+    /// Returns mode for @c name: "none", "oneeuro" or "doubleexp". Returns OneEuro for unknown names.
+    static Mode ModeFromString(const QString &name);
+    /// Returns the name of @c mode as accepted by ModeFromString.
+    static QString ModeToString(Mode mode);
+};
+
+/// Filters skeleton snapshots of all users in a SensorFrame.
+/** Evaluated in the OpenNI acquisition thread before frames are published. Fills
+    SkeletonSnapshot::velocities for constant velocity prediction by the consumer. */
+class OPENNI_MODULE_API SkeletonFilter
+{
+public:
+    SkeletonFilter();
+
+    void SetSettings(const SkeletonFilterSettings &settings);
+    const SkeletonFilterSettings &Settings() const { return settings_; }
+
+    /// Filters all users of @c frame in place.
+    void Filter(SensorFrame &frame);
+
+    /// Clears all filter state.
+    void Reset();
+
+    /// Returns quality statistics accumulated since the last Reset.
+    const SkeletonFilterStats &Stats() const { return stats_; }
+
+private:
+    struct JointState
+    {
+        uint samples;
+        float3 raw;             ///< Last raw position.
+        float3 previousRaw;
+        float3 value;           ///< Filtered position.
+        float3 previousValue;
+        float3 velocity;        ///< Filtered velocity in units per second.
+        float3 trend;           ///< Double exponential trend, units per frame.
+        float3 projective;      ///< Filtered projective position.
+        float3 predicted;       ///< Position predicted on the previous frame for the current one.
+        float3 held;            ///< Raw position of the previous frame, the no filter prediction for the current one.
+        uint predictions;       ///< Consecutive predictions, reset when the joint is lost.
+
+        JointState() : samples(0), predictions(0) {}
+    };
+
+    struct UserState
+    {
+        int userId;
+        JointState joints[MAX_BONE_COUNT];
+
+        UserState() : userId(-1) {}
+    };
+
+    UserState *StateFor(int userId);
+
+    void FilterJoint(JointState &joint, SkeletonSnapshot &snapshot, int index, float dt);
+
+    /// Accumulates statistics for a new raw sample and records the next prediction, before @c joint is updated with the sample.
+    /** The prediction made for the previous frame is compared to a centered [1 2 1] smoothing of the raw
+        positions around it. The reference needs the current sample, which the filter had not seen when
+        predicting, and unlike a single raw sample it does not count sensor noise as prediction error. */
+    void MeasurePrediction(JointState &joint, const float3 &raw, float dt);
+
+    /// Accumulates jitter statistics after @c joint has been updated.
+    void MeasureJitter(const JointState &joint, const float3 &previousPreviousRaw, const float3 &previousPreviousValue);
+
+    SkeletonFilterSettings settings_;
+    SkeletonFilterStats stats_;
+    UserState users_[MAX_TRACKED_USERS];
+    quint64 lastSensorTimestamp_;
+};
@@ -0,0 +1,27 @@
+/**
+    @author Admino Technologies Ltd.
+
+    Copyright 2013 Admino Technologies Ltd.
+    All rights reserved.
+
+    @file   SkeletonFilterStats.h
+    @brief  Skeleton filter quality statistics. */
+
+#pragma once
+
+#include <QtGlobal>
+
+/// Filter quality statistics.
+/** Prediction errors are measured against a held out reference: a centered [1 2 1] smoothing of the raw
+    positions around the predicted frame, which uses a sample the filter had not seen when predicting. */
+struct SkeletonFilterStats
+{
+    uint samples;               ///< Number of prediction error samples.
+    uint jitterSamples;         ///< Number of jitter samples.
+    float rawJitterMm;          ///< Mean magnitude of the raw positions second difference.
+    float filteredJitterMm;     ///< Mean magnitude of the filtered positions second difference.
+    float holdErrorMm;          ///< Mean error of holding the last raw position until the next frame.
+    float predictionErrorMm;    ///< Mean error of the filtered and predicted position at the next frame.
+
+    SkeletonFilterStats() : samples(0), jitterSamples(0), rawJitterMm(0.f), filteredJitterMm(0.f), holdErrorMm(0.f), predictionErrorMm(0.f) {}
+};
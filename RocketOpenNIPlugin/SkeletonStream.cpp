@@ -0,0 +1,178 @@
+/**
+    @author Admino Technologies Ltd.
+
+    Copyright 2013 Admino Technologies Ltd.
+    All rights reserved.
+
+    @file   SkeletonStream.cpp
+    @brief  Skeleton snapshots, latest value buffer and record/replay streams. */
+
+#include "StableHeaders.h"
+
+#include "SkeletonStream.h"
+
+#include "LoggingFunctions.h"
+
+namespace
+{
+    const quint32 StreamMagic = 0x4C4B5352; // "RSKL"
+    const quint32 StreamVersion = 1;
+
+    QDataStream &operator << (QDataStream &stream, const float3 &v)
+    {
+        stream << v.x << v.y << v.z;
+        return stream;
+    }
+
+    QDataStream &operator >> (QDataStream &stream, float3 &v)
+    {
+        stream >> v.x >> v.y >> v.z;
+        return stream;
+    }
+}
+
+// SkeletonStreamWriter
+
+SkeletonStreamWriter::SkeletonStreamWriter()
+{
+}
+
+SkeletonStreamWriter::~SkeletonStreamWriter()
+{
+    Close();
+}
+
+bool SkeletonStreamWriter::Open(const QString &filePath)
+{
+    Close();
+
+    file_.setFileName(filePath);
+    if(!file_.open(QIODevice::WriteOnly | QIODevice::Truncate))
+    {
+        LogError("[RocketOpenNIPlugin]: Failed to open skeleton stream for writing: " + filePath);
+        return false;
+    }
+
+    stream_.setDevice(&file_);
+    stream_.setVersion(QDataStream::Qt_4_7);
+    stream_.setFloatingPointPrecision(QDataStream::SinglePrecision);
+    stream_ << StreamMagic << StreamVersion;
+    return true;
+}
+
+void SkeletonStreamWriter::Close()
+{
+    if(!file_.isOpen())
+        return;
+
+    stream_.setDevice(0);
+    file_.close();
+}
+
+bool SkeletonStreamWriter::IsOpen() const
+{
+    return file_.isOpen();
+}
+
+void SkeletonStreamWriter::Write(const SensorFrame &frame)
+{
+    if(!file_.isOpen())
+        return;
+
+    stream_ << frame.frameId << frame.sensorTimestamp << frame.captureUsecs << static_cast<qint32>(frame.numUsers);
+    for(int u = 0; u < frame.numUsers; ++u)
+    {
+        const SkeletonSnapshot &user = frame.users[u];
+        stream_ << static_cast<qint32>(user.userId) << user.tracking << user.centerOfMass;
+        if(!user.tracking)
+            continue;
+        for(int i = 0; i < MAX_BONE_COUNT; ++i)
+            stream_ << user.positions[i] << user.projectivePositions[i] << user.confidence[i];
+    }
+}
+
+// SkeletonStreamReader
+
+SkeletonStreamReader::SkeletonStreamReader() :
+    firstFramePos_(0)
+{
+}
+
+SkeletonStreamReader::~SkeletonStreamReader()
+{
+    Close();
+}
+
+bool SkeletonStreamReader::Open(const QString &filePath)
+{
+    Close();
+
+    file_.setFileName(filePath);
+    if(!file_.open(QIODevice::ReadOnly))
+    {
+        LogError("[RocketOpenNIPlugin]: Failed to open skeleton stream for reading: " + filePath);
+        return false;
+    }
+
+    stream_.setDevice(&file_);
+    stream_.setVersion(QDataStream::Qt_4_7);
+    stream_.setFloatingPointPrecision(QDataStream::SinglePrecision);
+    if(!ReadHeader())
+    {
+        LogError("[RocketOpenNIPlugin]: Not a skeleton stream file: " + filePath);
+        Close();
+        return false;
+    }
+    firstFramePos_ = file_.pos();
+    return true;
+}
+
+bool SkeletonStreamReader::ReadHeader()
+{
+    quint32 magic = 0, version = 0;
+    stream_ >> magic >> version;
+    return (stream_.status() == QDataStream::Ok && magic == StreamMagic && version == StreamVersion);
+}
+
+void SkeletonStreamReader::Close()
+{
+    if(!file_.isOpen())
+        return;
+
+    stream_.setDevice(0);
+    file_.close();
+}
+
+bool SkeletonStreamReader::IsOpen() const
+{
+    return file_.isOpen();
+}
+
+bool SkeletonStreamReader::Read(SensorFrame &frame, bool loop)
+{
+    if(!file_.isOpen())
+        return false;
+
+    if(stream_.atEnd())
+    {
+        if(!loop || !file_.seek(firstFramePos_))
+            return false;
+        stream_.resetStatus();
+    }
+
+    qint32 numUsers = 0;
+    stream_ >> frame.frameId >> frame.sensorTimestamp >> frame.captureUsecs >> numUsers;
+    frame.numUsers = qBound(0, static_cast<int>(numUsers), MAX_TRACKED_USERS);
+    for(int u = 0; u < frame.numUsers; ++u)
+    {
+        SkeletonSnapshot &user = frame.users[u];
+        qint32 userId = 0;
+        stream_ >> userId >> user.tracking >> user.centerOfMass;
+        user.userId = userId;
+        if(!user.tracking)
+            continue;
+        for(int i = 0; i < MAX_BONE_COUNT; ++i)
+            stream_ >> user.positions[i] >> user.projectivePositions[i] >> user.confidence[i];
+    }
+    return (stream_.status() == QDataStream::Ok);
+}
@@ -0,0 +1,147 @@
+/**
+    @author Admino Technologies Ltd.
+
+    Copyright 2013 Admino Technologies Ltd.
+    All rights reserved.
+
+    @file   SkeletonStream.h
+    @brief  Skeleton snapshots, latest value buffer and record/replay streams. */
+
+#pragma once
+
+#include "RocketOpenNIApi.h"
+
+#include "Math/float3.h"
+#include "SkeletonFilterStats.h"
+
+#include <QAtomicInt>
+#include <QDataStream>
+#include <QFile>
+#include <QString>
+
+#define MAX_BONE_COUNT 24
+#define MAX_TRACKED_USERS 6
+
+/// Skeleton of a single user at one sensor frame.
+struct SkeletonSnapshot
+{
+    int userId;
+    bool tracking;                                  ///< Skeleton is calibrated and tracked.
+    float3 centerOfMass;                            ///< Real world millimeters.
+    float3 positions[MAX_BONE_COUNT];               ///< Real world millimeters.
+    float3 projectivePositions[MAX_BONE_COUNT];     ///< Depth map projective coordinates.
+    float confidence[MAX_BONE_COUNT];               ///< Joint confidence [0,1].
+    float3 velocities[MAX_BONE_COUNT];              ///< Filtered real world velocity in mm/s, zero if not filtered. Not recorded.
+};
+
+/// All users seen by the sensor at one frame.
+struct SensorFrame
+{
+    quint32 frameId;
+    quint64 sensorTimestamp;    ///< Sensor timestamp in microseconds.
+    qint64 captureUsecs;        ///< OpenNIDevice clock time when the frame was acquired.
+    float acquireMsecs;         ///< Time spent reading the frame from the sensor, not recorded.
+    SkeletonFilterStats filterStats; ///< Filter statistics at the time of this frame, not recorded.
+    int numUsers;
+    SkeletonSnapshot users[MAX_TRACKED_USERS];
+
+    SensorFrame() : frameId(0), sensorTimestamp(0), captureUsecs(0), acquireMsecs(0.f), numUsers(0) {}
+
+    /// Returns snapshot for @c userId or null if the user is not in this frame.
+    const SkeletonSnapshot *User(int userId) const
+    {
+        for(int i = 0; i < numUsers; ++i)
+            if(users[i].userId == userId)
+                return &users[i];
+        return 0;
+    }
+};
+
+/// Single producer, single consumer latest value buffer.
+/** Triple buffer where the producer always has a slot to write to and the consumer
+    always reads the most recently published value. Neither side ever blocks,
+    values not consumed before the next Publish are overwritten. */
+template <typename T>
+class LatestValueBuffer
+{
+public:
+    LatestValueBuffer() : back_(0), middle_(1), front_(2), overwritten_(0) {}
+
+    /// Producer: returns the slot to write the next value to.
+    T &WriteSlot() { return slots_[back_]; }
+
+    /// Producer: publishes the value written to WriteSlot.
+    void Publish()
+    {
+        const int previous = middle_.fetchAndStoreOrdered(back_ | FreshBit);
+        if(previous & FreshBit)
+            overwritten_.fetchAndAddRelaxed(1);
+        back_ = previous & IndexMask;
+    }
+
+    /// Consumer: makes the latest published value available in ReadSlot.
+    /** @return True if a new value was published since the last call. */
+    bool Consume()
+    {
+        if(!(static_cast<int>(middle_) & FreshBit))
+            return false;
+        front_ = middle_.fetchAndStoreOrdered(front_) & IndexMask;
+        return true;
+    }
+
+    /// Consumer: returns the latest consumed value.
+    const T &ReadSlot() const { return slots_[front_]; }
+
+    /// Returns number of values that were overwritten before being consumed.
+    int Overwritten() const { return static_cast<int>(overwritten_); }
+
+private:
+    enum { IndexMask = 3, FreshBit = 4 };
+
+    T slots_[3];
+    int back_;          ///< Producer owned.
+    QAtomicInt middle_; ///< Shared, slot index and fresh bit.
+    int front_;         ///< Consumer owned.
+    QAtomicInt overwritten_;
+};
+
+/// Writes sensor frames to a file for later replay.
+class OPENNI_MODULE_API SkeletonStreamWriter
+{
+public:
+    SkeletonStreamWriter();
+    ~SkeletonStreamWriter();
+
+    bool Open(const QString &filePath);
+    void Close();
+    bool IsOpen() const;
+
+    void Write(const SensorFrame &frame);
+
+private:
+    QFile file_;
+    QDataStream stream_;
+};
+
+/// Reads sensor frames recorded with SkeletonStreamWriter.
+class OPENNI_MODULE_API SkeletonStreamReader
+{
+public:
+    SkeletonStreamReader();
+    ~SkeletonStreamReader();
+
+    bool Open(const QString &filePath);
+    void Close();
+    bool IsOpen() const;
+
+    /// Reads the next frame. If @c loop is true, rewinds to the first frame at the end of the stream.
+    /** @return False if there are no more frames. */
+    bool Read(SensorFrame &frame, bool loop);
+
+private:
+    bool ReadHeader();
+
+    QFile file_;
+    QDataStream stream_;
+    qint64 firstFramePos_;
+};
@@ -7,6 +7,7 @@
 TrackingSkeleton::TrackingSkeleton(OpenNIDevice *device) :
     device_(device),
     treshold_(10),
+    useProjective_(false),
     clearChanged_(false)
 {
     InitializeBones();
@@ -31,7 +32,7 @@ void TrackingSkeleton::SetTreshold(float treshold, BoneCoordinateScale scale)
         treshold_ = treshold * 1000.0;
 }
 
-bool TrackingSkeleton::Update()
+bool TrackingSkeleton::Update(const SkeletonSnapshot &snapshot, float predictionSecs)
 {   
     if(!device_)
         return false;
@@ -41,19 +42,12 @@ bool TrackingSkeleton::Update()
 
     bool updated = true;
 
-    XnSkeletonJointPosition joints[24];
-
     bool moved = false;
 
-    for(int i = 0; i < 24; ++i)
-    {
-        int boneIndex = i + 1;
-
-        device_->userGenerator_.GetSkeletonCap().GetSkeletonJointPosition(1, (XnSkeletonJoint)boneIndex, joints[i]);
-
-        XnPoint3D xnPos;
-        xnPos = joints[i].position;
+    snapshot_ = snapshot;
 
+    for(int i = 0; i < MAX_BONE_COUNT; ++i)
+    {
         if(lastBonePositions_.size() > 0)
         {
             if((bonePositions_[i] - lastBonePositions_[i]).Length() > treshold_)
@@ -67,15 +61,11 @@ bool TrackingSkeleton::Update()
         if(lastBonePositions_.empty())
             moved = true;
 
+        // Projective coordinates are converted in the acquisition thread and not predicted.
         if(useProjective_)
-            device_->depthGenerator_.ConvertRealWorldToProjective(1, &xnPos, &xnPos);
-
-        float3 pos;
-        pos.x = xnPos.X;
-        pos.y = xnPos.Y;
-        pos.z = xnPos.Z;
-
-        bonePositions_[i] = pos;
+            bonePositions_[i] = snapshot.projectivePositions[i];
+        else
+            bonePositions_[i] = snapshot.positions[i] + snapshot.velocities[i] * predictionSecs;
     }
 
     if(moved)
@@ -157,8 +147,7 @@ QList<TrackingBone> TrackingSkeleton::AvailableBones()
 
     for(int i = 0; i < MAX_BONE_COUNT; ++i)
     {
-        int boneIndex = i + 1;
-        if(device_->userGenerator_.GetSkeletonCap().IsJointAvailable((XnSkeletonJoint)boneIndex))
+        if(device_->IsJointAvailable(i + 1))
             result.push_back(bones_[i]);
     }
 
@@ -3,6 +3,7 @@
 
 #include "RocketOpenNIApi.h"
 #include "RocketOpenNIPlugin.h"
+#include "SkeletonStream.h"
 
 #include "Math/float3.h"
 
@@ -35,8 +36,6 @@ enum BoneCoordinateScale
     METERS
 };
 
-#define MAX_BONE_COUNT 24
-
 class OPENNI_MODULE_API TrackingSkeleton : public QObject
 {
     Q_OBJECT
@@ -45,7 +44,12 @@ public:
     TrackingSkeleton(OpenNIDevice *device);
     ~TrackingSkeleton();
     
-    bool Update();
+    /// Applies joint positions of @c snapshot.
+    /** Real world positions are extrapolated @c predictionSecs ahead with the filtered joint velocities. */
+    bool Update(const SkeletonSnapshot &snapshot, float predictionSecs = 0.f);
+
+    /// Returns the snapshot last applied with Update.
+    const SkeletonSnapshot &Snapshot() const { return snapshot_; }
 
 public slots:
     bool Treshold() { return treshold_; }
@@ -79,6 +83,7 @@ private:
     QList<float3> lastBonePositions_;
 
     OpenNIDevice *device_;
+    SkeletonSnapshot snapshot_;
 
     bool useProjective_;
     bool clearChanged_;
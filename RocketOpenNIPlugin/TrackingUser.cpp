@@ -8,15 +8,10 @@ TrackingUser::TrackingUser(int id, OpenNIDevice *device) :
     id_(id),
     device_(device),
     tracking_(false),
-    skeleton_(new TrackingSkeleton(device_))
+    skeleton_(new TrackingSkeleton(device_)),
+    centerOfMass_(float3(0.0f))
 {
-    if(!device_)
-        return;
-
-    if(device_->NeedPose())
-        device_->userGenerator_.GetPoseDetectionCap().StartPoseDetection(device_->strPose_, id_);
-    else
-       device_->userGenerator_.GetSkeletonCap().RequestCalibration(id_, true);
+    // Pose detection and calibration are requested by OpenNIDevice when the sensor reports the user.
 }
 
 TrackingUser::~TrackingUser()
@@ -30,14 +25,19 @@ void TrackingUser::StartTracking()
     tracking_ = true;
 }
 
-void TrackingUser::Update()
+void TrackingUser::Update(const SkeletonSnapshot &snapshot, float predictionSecs)
 {
-    if(!device_ || !tracking_)
+    if(!device_)
         return;
 
-    if(device_->userGenerator_.GetSkeletonCap().IsTracking(id_))
+    centerOfMass_ = snapshot.centerOfMass;
+
+    if(!tracking_)
+        return;
+
+    if(snapshot.tracking)
     {
-        if(skeleton_->Update())
+        if(skeleton_->Update(snapshot, predictionSecs))
             emit Updated(id_, skeleton_);
     }
 }
@@ -47,13 +47,5 @@ float3 TrackingUser::CenterOfMass()
     if(!device_ || !tracking_)
         return float3(0.0f);
 
-    XnPoint3D com;
-    device_->userGenerator_.GetCoM(id_, com);
-
-    float3 pos;
-    pos.x = com.X;
-    pos.y = com.Y;
-    pos.z = com.Z;
-
-    return pos;
+    return centerOfMass_;
 }
@@ -17,8 +17,10 @@ public:
     ~TrackingUser();
 
     void StartTracking();
+    bool IsTracking() const { return tracking_; }
 
-    void Update();
+    /// Applies @c snapshot acquired by OpenNIDevice, predicted @c predictionSecs ahead.
+    void Update(const SkeletonSnapshot &snapshot, float predictionSecs);
 
 signals:
     void Updated(int id, TrackingSkeleton *skeleton);
@@ -36,4 +38,5 @@ private:
 
     TrackingSkeleton *skeleton_;
     int id_;
+    float3 centerOfMass_;
 };
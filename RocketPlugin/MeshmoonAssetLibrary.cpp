@@ -26,9 +26,13 @@
 #include "MeshmoonAssetLibrary.h"
 #include "RocketPlugin.h"
 #include "RocketNotifications.h"
+#include "MeshmoonAssetSelectionModel.h"
+#include "MeshmoonAssetPreviewLoader.h"
 
 #include <QUuid>
 #include <QGridLayout>
+#include <QScrollBar>
+#include <QListView>
 
 // MeshmoonAssetLibrary
 
@@ -99,6 +103,7 @@ void MeshmoonAssetLibrary::UpdateLibrary()
 
 void MeshmoonAssetLibrary::ClearLibrary()
 {
+    searchIndex_.Clear();
     foreach (MeshmoonAsset *asset, assets_)
         SAFE_DELETE(asset);
     assets_.clear();
@@ -197,6 +202,11 @@ MeshmoonAsset *MeshmoonAssetLibrary::FindAsset(const QString &ref) const
     return (it != assetsByRef_.end() ? it.value() : 0);
 }
 
+const MeshmoonAssetSearchIndex &MeshmoonAssetLibrary::SearchIndex() const
+{
+    return searchIndex_;
+}
+
 MeshmoonAssetSelectionDialog *MeshmoonAssetLibrary::ShowSelectionDialog(MeshmoonAsset::Type type, const MeshmoonLibrarySource &source, const QString &forcedTag, QWidget *parent)
 {
     if (!dialog_.isNull())
@@ -429,6 +439,7 @@ void MeshmoonAssetLibrary::DeserializeAssetLibrary(const QString &sourceUrl, con
             {
                 assets_.push_back(asset);
                 assetsByRef_.insert(asset->assetRef, asset);
+                searchIndex_.Add(asset);
             }
         }
     }
@@ -444,6 +455,7 @@ void MeshmoonAssetLibrary::DeserializeAssetLibrary(const QString &sourceUrl, con
             {
                 assets_.push_back(asset);
                 assetsByRef_.insert(asset->assetRef, asset);
+                searchIndex_.Add(asset);
             }
         }
     }
@@ -459,6 +471,7 @@ void MeshmoonAssetLibrary::DeserializeAssetLibrary(const QString &sourceUrl, con
             {
                 assets_.push_back(asset);
                 assetsByRef_.insert(asset->assetRef, asset);
+                searchIndex_.Add(asset);
             }
         }
     }
@@ -575,25 +588,53 @@ void MeshmoonAssetLibrary::EmitUpdated()
 
 // MeshmoonAssetSelectionDialog
 
+static const int cCellSize = 200;
+static const int cCellSpacing = 6;
+
 MeshmoonAssetSelectionDialog::MeshmoonAssetSelectionDialog(RocketPlugin *plugin, const MeshmoonAssetList &_assets, const QString &forcedTag, QWidget *parent) :
     QDialog(parent),
     plugin_(plugin),
     framework_(plugin->GetFramework()),
     assets(_assets),
     selected_(0),
-    grid_(0)
+    model_(0),
+    previewLoader_(0),
+    index_(0),
+    itemsPerRow_(1)
 {
     ui_.setupUi(this);
-    ui_.scrollArea->setHorizontalScrollBarPolicy(Qt::ScrollBarAlwaysOff);
     ui_.lineEditFilter->installEventFilter(this);
 
     ui_.buttonSelect->setAutoDefault(false);
     ui_.buttonCancel->setAutoDefault(false);
 
+    // Assets are painted by the delegate, widgets are not created per asset and only visible cells are painted.
+    model_ = new MeshmoonAssetListModel(this);
+    ui_.listViewAssets->setViewMode(QListView::IconMode);
+    ui_.listViewAssets->setMovement(QListView::Static);
+    ui_.listViewAssets->setResizeMode(QListView::Adjust);
+    ui_.listViewAssets->setUniformItemSizes(true);
+    ui_.listViewAssets->setSpacing(cCellSpacing / 2);
+    ui_.listViewAssets->setSelectionMode(QAbstractItemView::SingleSelection);
+    ui_.listViewAssets->setVerticalScrollMode(QAbstractItemView::ScrollPerPixel);
+    ui_.listViewAssets->verticalScrollBar()->setSingleStep(cCellSize / 4);
+    ui_.listViewAssets->setMouseTracking(true);
+    ui_.listViewAssets->setItemDelegate(new MeshmoonAssetItemDelegate(QSize(cCellSize, cCellSize), ui_.listViewAssets));
+    ui_.listViewAssets->setModel(model_);
+
+    // Preview images are decoded and scaled in a worker thread.
+    previewLoader_ = new MeshmoonAssetPreviewLoader(QSize(cCellSize - 4, cCellSize - 4));
+    connect(previewLoader_, SIGNAL(PreviewLoaded(const QString&, const QImage&)), SLOT(OnPreviewLoaded(const QString&, const QImage&)), Qt::QueuedConnection);
+    previewLoader_->start(QThread::LowPriority);
+
     connect(ui_.buttonSelect, SIGNAL(clicked()), SLOT(OnSelect()), Qt::QueuedConnection);
     connect(ui_.buttonCancel, SIGNAL(clicked()), SLOT(reject()), Qt::QueuedConnection);
     connect(this, SIGNAL(rejected()), SLOT(OnCancel()));
     connect(ui_.lineEditFilter, SIGNAL(textChanged(const QString&)), SLOT(OnFilterChanged(const QString&)));
+    connect(ui_.listViewAssets->selectionModel(), SIGNAL(currentChanged(const QModelIndex&, const QModelIndex&)), SLOT(OnSelectionChanged(const QModelIndex&)));
+    connect(ui_.listViewAssets, SIGNAL(doubleClicked(const QModelIndex&)), SLOT(OnItemDoubleClicked(const QModelIndex&)));
+    // Queued as the request is made while the view is painting.
+    connect(model_, SIGNAL(PreviewRequested(MeshmoonAsset*)), SLOT(OnPreviewRequested(MeshmoonAsset*)), Qt::QueuedConnection);
     
     ui_.comboBoxCategory->addItem("all");
     if (!forcedTag.trimmed().isEmpty() && forcedTag.trimmed().toLower() != "all")
@@ -649,144 +690,63 @@ MeshmoonAssetSelectionDialog::MeshmoonAssetSelectionDialog(RocketPlugin *plugin,
         showAnim->start();
     }
 
-    CreateAssetWidgets();
+    InitializeAssets();
     UpdateGeometry();
     UpdateFiltering();
 }
 
+MeshmoonAssetSelectionDialog::~MeshmoonAssetSelectionDialog()
+{
+    if (previewLoader_)
+        previewLoader_->Stop();
+    SAFE_DELETE(previewLoader_);
+}
+
 MeshmoonAsset *MeshmoonAssetSelectionDialog::Selected() const
 {
     return selected_;
 }
 
-void MeshmoonAssetSelectionDialog::CreateAssetWidgets()
+void MeshmoonAssetSelectionDialog::InitializeAssets()
 {    
     itemsPerRow_ = Min<int>(FloorInt((float)width() / 220.0f), 4); // Max items per row == 4
     if (itemsPerRow_ <= 0) itemsPerRow_ = 1;
 
-    grid_ = new QGridLayout(ui_.scrollAreaWidgetContents);
-    grid_->setHorizontalSpacing(6);
-    grid_->setVerticalSpacing(6);
-    ui_.scrollAreaWidgetContents->setLayout(grid_);
-    
-    int row = 0;
-    int col = 0;
+    // Use the prebuilt library index if it knows all the assets, otherwise index the assets of this dialog.
+    const MeshmoonAssetSearchIndex &libraryIndex = plugin_->AssetLibrary()->SearchIndex();
+    index_ = &libraryIndex;
+
+    QSet<QString> addedTags;
     foreach(MeshmoonAsset *asset, assets)
     {
+        assetSet_.insert(asset);
+        if (index_ == &libraryIndex && !libraryIndex.Contains(asset))
+            index_ = &localIndex_;
+
         // Add selectable tags
         foreach(const QString &tag, asset->tags)
         {
             QString trimmedLower = tag.trimmed().toLower();
+            if (addedTags.contains(trimmedLower))
+                continue;
+            addedTags.insert(trimmedLower);
             if (ui_.comboBoxCategory->findText(trimmedLower, Qt::MatchExactly) == -1)
                 ui_.comboBoxCategory->addItem(trimmedLower);
         }
-        
-        QString id = QUuid::createUuid().toString().replace("{", "").replace("}", "");
-        
-        QPushButton *button = new QPushButton();
-        button->setObjectName("assetButton" + id);
-        button->setFixedSize(200, 200);
-        button->setCheckable(true);
-        button->setAutoExclusive(true);
-        
-        button->setProperty("assetId", id);
-        button->setProperty("asset", QVariant::fromValue<MeshmoonAsset*>(asset));
-
-        button->installEventFilter(this);
-        
-        connect(button, SIGNAL(toggled(bool)), SLOT(OnSelectionChanged()));
-
-        QVBoxLayout *frameL = new QVBoxLayout();
-        frameL->setContentsMargins(9,2,9,2);
-        frameL->setSpacing(2);
-
-        // Info container
-        QFrame *frame = new QFrame(button, Qt::Widget);
-        frame->setLayout(frameL);
-        frame->setObjectName("assetFrame" + id);
-        frame->setFixedSize(200 - 4, 40);
-        frame->move(2, 200 - frame->height() - 2);
-
-        // Name
-        QLabel *label = new QLabel(asset->name);
-        label->setStyleSheet("color: rgb(70,70,70); font-size: 16px;");
-        frameL->addWidget(label);
-
-        // Description
-        QString descStr = asset->description;
-        if (descStr.length() > 35)
-            descStr = descStr.left(32) + "...";
-
-        QLabel *desc = new QLabel(descStr);
-        desc->setIndent(0);
-        desc->setStyleSheet("color: rgb(90,90,90); font-size: 11px; padding: 0px; padding-left: 1px;");
-        frameL->addWidget(desc);
-        
-        // Preview image
-        QString imagePath = ":/images/asset-library-no-preview.png";
-        if (!asset->previewImageUrl.isEmpty())
-        {
-            QString diskSource = framework_->Asset()->Cache()->FindInCache(asset->previewImageUrl);
-            if (diskSource.isEmpty())
-            {
-                AssetTransferPtr imageTransfer = framework_->Asset()->RequestAsset(asset->previewImageUrl, "Binary");
-                connect(imageTransfer.get(), SIGNAL(Succeeded(AssetPtr)), this, SLOT(OnPreviewImageCompleted(AssetPtr)), Qt::UniqueConnection);
-            }
-            else
-                imagePath = diskSource;
-        }
-        else
-        {
-            // Look for rgba color in metadata
-            if (asset->metadata.contains("rgba"))
-            {
-                QVariantList rgbaParts = asset->metadata["rgba"].toList();
-                if (rgbaParts.size() >= 3)
-                {
-                    QString outputPath = QDir(framework_->Asset()->Cache()->CacheDirectory())
-                        .absoluteFilePath(QString("asset-library-rgba_%1-%2-%3-%4_200x200.png")
-                        .arg(rgbaParts[0].toInt()).arg(rgbaParts[1].toInt()).arg(rgbaParts[2].toInt()).arg(rgbaParts.size() >= 4 ? rgbaParts[3].toInt() : 255));
-
-                    if (!QFile::exists(outputPath))
-                    {
-                        QPixmap pixmap(200,200);
-                        pixmap.fill(QColor(rgbaParts[0].toInt(), rgbaParts[1].toInt(), rgbaParts[2].toInt(), rgbaParts.size() >= 4 ? rgbaParts[3].toInt() : 255));
-                        if (pixmap.save(outputPath, "PNG"))
-                            imagePath = outputPath;
-                    }
-                    else
-                        imagePath = outputPath;
-                }
-            }
-        }
-        
-        UpdateButtonStyle(button, imagePath);
-
-        grid_->addWidget(button, row, col);
-        buttons_ << button;
-        
-        col++;
-        if (col >= itemsPerRow_)
-        {
-            col = 0;
-            row++;
-        }
     }
+    if (index_ == &localIndex_)
+        localIndex_.Add(assets);
 }
 
 void MeshmoonAssetSelectionDialog::UpdateGeometry()
 {
-    if (!grid_)
-        return;
-        
-    int maxRows = (framework_->Ui()->MainWindow()->size().height() < 3 * 200 + 125 ? 2 : 3);
+    int maxRows = (framework_->Ui()->MainWindow()->size().height() < 3 * cCellSize + 125 ? 2 : 3);
 
-    int rows = Min<int>(grid_->rowCount(), maxRows); // max rows to show == 3
-    int cols = grid_->columnCount();
-    QMargins margins = grid_->contentsMargins();
+    int cols = Max<int>(Min<int>(itemsPerRow_, assets.size()), 1);
+    int rows = Max<int>(Min<int>((assets.size() + cols - 1) / cols, maxRows), 1); // max rows to show == 3
 
-    int dynHeight = (rows * 200) + (rows-1 * grid_->verticalSpacing()) + margins.top() + margins.bottom() + ui_.controlsFrame->height() + 30; // last is extra padding
-    int dynWidth = (cols * 200) + (cols-1 * grid_->horizontalSpacing()) + margins.left() + margins.right() + 35; // last is extra padding
+    int dynHeight = rows * (cCellSize + cCellSpacing) + ui_.controlsFrame->height() + 30; // last is extra padding
+    int dynWidth = cols * (cCellSize + cCellSpacing) + 35; // last is extra padding
 
     if (dynHeight != height() || dynWidth != width())
     {
@@ -801,33 +761,37 @@ void MeshmoonAssetSelectionDialog::UpdateGeometry()
     }
 }
 
-void MeshmoonAssetSelectionDialog::UpdateButtonStyle(QPushButton *button, const QString &imagePath)
+void MeshmoonAssetSelectionDialog::OnPreviewRequested(MeshmoonAsset *asset)
 {
-    if (!button)
+    if (!asset || !assetSet_.contains(asset))
         return;
 
-    QString id = button->property("assetId").toString();
-
-    QString backgroundImageProp = imagePath.isEmpty() ? "" : "background-image: url('" + imagePath + "');";
-    QString backgroundProp = "background-color: rgba(200,200,200,200); ";
+    QString key = MeshmoonAssetListModel::PreviewKey(asset);
+    if (key.isEmpty())
+        return;
 
-    button->setStyleSheet(
-        // Normal
-        QString("QPushButton#%1 { ").arg(button->objectName()) +
-        QString("border: 2px solid rgb(207, 207, 207, 200); border-radius: 6px;") +
-        QString(backgroundImageProp + " }") +
-        // Hover
-        QString("QPushButton#%1:hover { ").arg(button->objectName()) +
-        QString("border: 2px solid rgb(170, 170, 170, 200); border-radius: 6px;") +
-        QString(backgroundImageProp + " }") +
-        // Selected
-        QString("QPushButton#%1:checked { ").arg(button->objectName()) +
-        QString("border: 2px solid rgb(243, 154, 41); border-radius: 6px;") +
-        QString(backgroundImageProp + " }") +
-        // Frame
-        QString("QFrame#assetFrame%1 { " + backgroundProp).arg(id) +
-        QString("border: 0px; border-top: 1px solid rgb(150, 150, 150); border-radius: 0px; }")
-    );
+    if (!asset->previewImageUrl.isEmpty())
+    {
+        QString diskSource = framework_->Asset()->Cache()->FindInCache(asset->previewImageUrl);
+        if (diskSource.isEmpty())
+        {
+            if (pendingDownloads_.contains(asset->previewImageUrl))
+                return;
+            pendingDownloads_[asset->previewImageUrl] = key;
+            AssetTransferPtr imageTransfer = framework_->Asset()->RequestAsset(asset->previewImageUrl, "Binary");
+            connect(imageTransfer.get(), SIGNAL(Succeeded(AssetPtr)), this, SLOT(OnPreviewImageCompleted(AssetPtr)), Qt::UniqueConnection);
+        }
+        else
+            previewLoader_->Load(key, diskSource);
+    }
+    else
+    {
+        // Solid color from rgba metadata
+        QVariantList rgbaParts = asset->metadata["rgba"].toList();
+        QPixmap pixmap(cCellSize, cCellSize);
+        pixmap.fill(QColor(rgbaParts[0].toInt(), rgbaParts[1].toInt(), rgbaParts[2].toInt(), rgbaParts.size() >= 4 ? rgbaParts[3].toInt() : 255));
+        model_->SetPreview(key, pixmap);
+    }
 }
 
 void MeshmoonAssetSelectionDialog::OnPreviewImageCompleted(AssetPtr asset)
@@ -836,17 +800,18 @@ void MeshmoonAssetSelectionDialog::OnPreviewImageCompleted(AssetPtr asset)
     QString diskSource = asset->DiskSource();
     if (!QFile::exists(diskSource))
         return;
-    
-    // Note: Don't break when first is found, many buttons can potentially have same preview image.
-    foreach(QPushButton *button, buttons_)
-    {
-        if (!button)
-            continue;
-        
-        MeshmoonAsset *asset = qvariant_cast<MeshmoonAsset*>(button->property("asset"));
-        if (asset && asset->previewImageUrl == completedImage)
-            UpdateButtonStyle(button, diskSource);
-    }
+
+    QHash<QString, QString>::iterator iter = pendingDownloads_.find(completedImage);
+    if (iter == pendingDownloads_.end())
+        return;
+    previewLoader_->Load(iter.value(), diskSource);
+    pendingDownloads_.erase(iter);
+}
+
+void MeshmoonAssetSelectionDialog::OnPreviewLoaded(const QString &key, const QImage &image)
+{
+    if (!image.isNull())
+        model_->SetPreview(key, QPixmap::fromImage(image));
 }
 
 void MeshmoonAssetSelectionDialog::OnFilterChanged(const QString &term)
@@ -863,104 +828,61 @@ void MeshmoonAssetSelectionDialog::OnCategoryChanged(const QString &category)
 
 void MeshmoonAssetSelectionDialog::UpdateFiltering()
 {
-    if (!grid_)
+    if (!index_)
         return;
 
-    foreach(QPushButton *button, buttons_)
-    {
-        if (button->layout())
-            grid_->removeWidget(button);
-        button->hide();
-    }
-       
-    int row = 0;
-    int col = 0;
-
     bool doingFiltering = (!currentTerm_.isEmpty() || (!currentTag_.isEmpty() && currentTag_.toLower() != "all"));
 
-    // Always show any selected asset as the first, if filtering is done
-    bool selectedAdded = false;
-    if (selected_ && doingFiltering)
+    MeshmoonAssetList shown;
+    if (doingFiltering)
     {
-        foreach(QPushButton *button, buttons_)
+        MeshmoonAssetList results = index_->Search(currentTerm_, currentTag_);
+        shown.reserve(results.size() + 1);
+
+        // Always show any selected asset as the first, if filtering is done
+        if (selected_)
+            shown << selected_;
+
+        // The library index can contain assets that are not part of this dialog.
+        const bool checkMembership = (index_ != &localIndex_);
+        foreach(MeshmoonAsset *asset, results)
         {
-            MeshmoonAsset *asset = qvariant_cast<MeshmoonAsset*>(button->property("asset"));
-            if (asset && asset == selected_)
-            {
-                selectedAdded = true;
-                
-                button->show();
-                grid_->addWidget(button, row, col);
-                
-                col++;
-                if (col >= itemsPerRow_)
-                {
-                    col = 0;
-                    row++;
-                }
-                break;
-            }
+            if (asset == selected_ || (checkMembership && !assetSet_.contains(asset)))
+                continue;
+            shown << asset;
         }
     }
-    
-    foreach(QPushButton *button, buttons_)
-    {
-        if (!button)
-            continue;
-        MeshmoonAsset *asset = qvariant_cast<MeshmoonAsset*>(button->property("asset"));
-        if (!asset)
-            continue;
+    else
+        shown = assets;
 
-        bool showAsset = true;
-        
-        // Search term
-        if (!currentTerm_.isEmpty())
-        {
-            if (!asset->name.contains(currentTerm_, Qt::CaseInsensitive) && !asset->description.contains(currentTerm_, Qt::CaseInsensitive))
-                showAsset = false;       
-        }
+    model_->SetAssets(shown);
 
-        // Category tag
-        if (!currentTag_.isEmpty() && currentTag_ != "all")
-        {
-            if (!asset->ContainsTag(currentTag_))
-                showAsset = false;
-        }
+    QModelIndex selectedIndex = model_->IndexOf(selected_);
+    if (selectedIndex.isValid())
+        ui_.listViewAssets->selectionModel()->setCurrentIndex(selectedIndex, QItemSelectionModel::ClearAndSelect);
+    ui_.listViewAssets->scrollToTop();
+}
 
-        // Asset is already added
-        if (showAsset && asset == selected_ && selectedAdded)
-            showAsset = false; 
-            
-        if (showAsset)
-        {
-            button->show();
-            grid_->addWidget(button, row, col);
-            
-            col++;
-            if (col >= itemsPerRow_)
-            {
-                col = 0;
-                row++;
-            }
-        }
+void MeshmoonAssetSelectionDialog::OnSelectionChanged(const QModelIndex &current)
+{
+    MeshmoonAsset *asset = model_->AssetAt(current);
+    if (asset)
+    {
+        selected_ = asset;
+        ui_.infoLabel->setText("");
+        //ui_.infoLabel->setText(asset->name + " <span style='color:rgb(150, 150, 150); font-size: 8pt;'>" + asset->description + "</span>");
     }
 }
 
-void MeshmoonAssetSelectionDialog::OnSelectionChanged()
+void MeshmoonAssetSelectionDialog::OnItemDoubleClicked(const QModelIndex &index)
 {
-    foreach(QPushButton *button, buttons_)
+    // Double clicking an asset == selecting and closing dialog
+    MeshmoonAsset *asset = model_->AssetAt(index);
+    if (asset)
     {
-        if (!button || !button->isChecked())
-            continue;
-
-        MeshmoonAsset *asset = qvariant_cast<MeshmoonAsset*>(button->property("asset"));
-        if (asset)
-        {
-            selected_ = asset;
-            ui_.infoLabel->setText("");
-            //ui_.infoLabel->setText(asset->name + " <span style='color:rgb(150, 150, 150); font-size: 8pt;'>" + asset->description + "</span>");
-            break;
-        }
+        selected_ = asset;
+        ui_.infoLabel->setText(asset->name + " <span style='color:rgb(150, 150, 150); font-size: 11px;'>" + asset->description + "</span>");
+        ui_.buttonSelect->click();
     }
 }
 
@@ -1000,21 +922,6 @@ bool MeshmoonAssetSelectionDialog::eventFilter(QObject *obj, QEvent *event)
                 return true;
             }
         }
-        return false;
-    }
-    
-    // Double clicking an asset button == selecting and closing dialog
-    QPushButton *button = dynamic_cast<QPushButton*>(obj);
-    if (button && event->type() == QEvent::MouseButtonDblClick)
-    {
-        MeshmoonAsset *asset = qvariant_cast<MeshmoonAsset*>(button->property("asset"));
-        if (asset)
-        {
-            selected_ = asset;
-            ui_.infoLabel->setText(asset->name + " <span style='color:rgb(150, 150, 150); font-size: 11px;'>" + asset->description + "</span>");
-            ui_.buttonSelect->click();
-            return true;
-        }
     }
     return false;
 }
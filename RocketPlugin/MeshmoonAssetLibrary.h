@@ -12,6 +12,7 @@
 #include "RocketFwd.h"
 #include "AssetFwd.h"
 #include "MeshmoonAsset.h"
+#include "MeshmoonAssetSearchIndex.h"
 
 #include <QObject>
 #include <QString>
@@ -22,6 +23,10 @@
 #include <QDialog>
 #include <QSize>
 #include <QPushButton>
+#include <QModelIndex>
+#include <QSet>
+#include <QHash>
+#include <QImage>
 
 #include "ui_RocketAssetSelectionDialog.h"
 
@@ -80,6 +85,10 @@ public slots:
     /// Searches for an asset in the library. Returns null if asset not found.
     MeshmoonAsset *FindAsset(const QString &ref) const;
 
+    /// Returns the search index of all known assets.
+    /** The index is updated as library sources are loaded. */
+    const MeshmoonAssetSearchIndex &SearchIndex() const;
+
     /// Show selection dialog for certain type of assets from certain source.
     /** @note Can return null ptr if a dialog is already open, there can only be one application modal dialog at a time!
         @param Type of the assets the dialog should present to the user.
@@ -129,6 +138,7 @@ private:
     RocketPlugin *plugin_;
     QList<MeshmoonAsset*> assets_; ///< The authorative list of assets in the library.
     QHash<QString, QPointer<MeshmoonAsset> > assetsByRef_; ///< The hash map of assets for fast lookup.
+    MeshmoonAssetSearchIndex searchIndex_; ///< Search index of assets_.
 
     MeshmoonLibrarySourceList sources_;
     MeshmoonLibrarySourceList pendingSources_;
@@ -149,32 +159,34 @@ public:
     /// All assets that were available for the user in this dialog.
     MeshmoonAssetList assets;
 
+    ~MeshmoonAssetSelectionDialog();
+
 public slots:   
     /// Get the selected asset.
     /** @return MeshmoonAsset ptr or null if nothing was selected. */
     MeshmoonAsset *Selected() const;
 
 private slots:
-    // Creates widgets.
-    void CreateAssetWidgets();
+    // Populates the category list and search index.
+    void InitializeAssets();
 
     // Updates geometry to the current dynamic content.
     void UpdateGeometry();
     
     // Updates the view with the current user selected filtering options.
     void UpdateFiltering();
-    
-    // Updates button style.
-    void UpdateButtonStyle(QPushButton *button, const QString &imagePath = ":/images/asset-libary-no-preview.png");
 
     void OnSelect();
     void OnCancel();
     
     void OnFilterChanged(const QString &term);
     void OnCategoryChanged(const QString &category);
-    void OnSelectionChanged();
+    void OnSelectionChanged(const QModelIndex &current);
+    void OnItemDoubleClicked(const QModelIndex &index);
     
+    void OnPreviewRequested(MeshmoonAsset *asset);
     void OnPreviewImageCompleted(AssetPtr asset);
+    void OnPreviewLoaded(const QString &key, const QImage &image);
 
 signals:
     /// Emitted when a asset is selected.
@@ -192,8 +204,16 @@ private:
     MeshmoonAsset *selected_;
     
     Ui::RocketAssetSelectionDialog ui_;
-    QGridLayout *grid_;
-    QList<QPushButton*> buttons_;
+    MeshmoonAssetListModel *model_;
+    MeshmoonAssetPreviewLoader *previewLoader_;
+
+    /// Library search index if it contains all assets, otherwise localIndex_.
+    const MeshmoonAssetSearchIndex *index_;
+    MeshmoonAssetSearchIndex localIndex_;
+    QSet<MeshmoonAsset*> assetSet_;
+
+    /// Preview keys of assets by preview image URL, while the image is being downloaded.
+    QHash<QString, QString> pendingDownloads_;
     
     int itemsPerRow_;
     
@@ -0,0 +1,109 @@
+/**
+    @author Adminotech Ltd.
+
+    Copyright Adminotech Ltd.
+    All rights reserved.
+
+    @file   MeshmoonAssetPreviewLoader.cpp
+    @brief  Worker thread that decodes and scales asset library preview images. */
+
+#include "StableHeaders.h"
+#include "DebugOperatorNew.h"
+
+#include "MeshmoonAssetPreviewLoader.h"
+#include "utils/RocketTextureDecoder.h"
+
+#include <QMutexLocker>
+#include <QImageReader>
+#include <QFileInfo>
+#include <QFile>
+
+#include "MemoryLeakCheck.h"
+
+MeshmoonAssetPreviewLoader::MeshmoonAssetPreviewLoader(const QSize &size, QObject *parent) :
+    QThread(parent),
+    size_(size),
+    stopping_(false)
+{
+}
+
+MeshmoonAssetPreviewLoader::~MeshmoonAssetPreviewLoader()
+{
+    Stop();
+}
+
+void MeshmoonAssetPreviewLoader::Load(const QString &key, const QString &filePath)
+{
+    QMutexLocker lock(&mutex_);
+    queue_.push_back(qMakePair(key, filePath));
+    condition_.wakeOne();
+}
+
+void MeshmoonAssetPreviewLoader::Stop()
+{
+    {
+        QMutexLocker lock(&mutex_);
+        stopping_ = true;
+        queue_.clear();
+        condition_.wakeAll();
+    }
+    if (isRunning())
+        wait();
+}
+
+void MeshmoonAssetPreviewLoader::run()
+{
+    forever
+    {
+        QPair<QString, QString> request;
+        {
+            QMutexLocker lock(&mutex_);
+            while(queue_.isEmpty() && !stopping_)
+                condition_.wait(&mutex_);
+            if (stopping_)
+                return;
+            request = queue_.takeLast();
+        }
+
+        QImage image = Decode(request.second);
+        {
+            QMutexLocker lock(&mutex_);
+            if (stopping_)
+                return;
+        }
+        emit PreviewLoaded(request.first, image);
+    }
+}
+
+QImage MeshmoonAssetPreviewLoader::Decode(const QString &filePath) const
+{
+    QImage image;
+    if (RocketTextureDecoder::IsSupportedSuffix(QFileInfo(filePath).suffix()))
+    {
+        // Decode the smallest mipmap that still covers the preview size.
+        QFile file(filePath);
+        if (!file.open(QIODevice::ReadOnly))
+            return image;
+        const QByteArray data = file.readAll();
+        file.close();
+
+        RocketTextureDecoder::Info info;
+        if (!RocketTextureDecoder::ReadInfo(data, info) || !RocketTextureDecoder::CanDecodePixels(info))
+            return image;
+        image = RocketTextureDecoder::Decode(data, RocketTextureDecoder::MipLevelFor(info, size_));
+    }
+    else
+    {
+        // Let the reader scale while decoding where the format supports it, eg. JPEG.
+        QImageReader reader(filePath);
+        QSize imageSize = reader.size();
+        if (imageSize.isValid() && (imageSize.width() > size_.width() || imageSize.height() > size_.height()))
+            reader.setScaledSize(imageSize.scaled(size_, Qt::KeepAspectRatio));
+        image = reader.read();
+    }
+    if (image.isNull())
+        return image;
+    if (image.width() > size_.width() || image.height() > size_.height())
+        image = image.scaled(size_, Qt::KeepAspectRatio, Qt::SmoothTransformation);
+    return image.convertToFormat(QImage::Format_ARGB32_Premultiplied);
+}
@@ -0,0 +1,63 @@
+/**
+    @author Adminotech Ltd.
+
+    Copyright Adminotech Ltd.
+    All rights reserved.
+
+    @file   MeshmoonAssetPreviewLoader.h
+    @brief  Worker thread that decodes and scales asset library preview images. */
+
+#pragma once
+
+#include <QThread>
+#include <QMutex>
+#include <QWaitCondition>
+#include <QString>
+#include <QImage>
+#include <QSize>
+#include <QList>
+#include <QPair>
+
+/// @cond PRIVATE
+
+/// Worker thread that decodes and scales preview images from disk.
+/** Requests are processed newest first, so the images for the cells that were most
+    recently scrolled into view are decoded before stale requests. */
+class MeshmoonAssetPreviewLoader : public QThread
+{
+Q_OBJECT
+
+public:
+    /// Images are scaled to fit @c size keeping the aspect ratio.
+    explicit MeshmoonAssetPreviewLoader(const QSize &size, QObject *parent = 0);
+    virtual ~MeshmoonAssetPreviewLoader();
+
+    /// Queues @c filePath for decoding. Thread safe.
+    /** @param Key that is passed back in PreviewLoaded.
+        @param Disk path of the image. */
+    void Load(const QString &key, const QString &filePath);
+
+    /// Stops processing and waits for the thread to exit. Pending requests are discarded.
+    void Stop();
+
+signals:
+    /// Emitted in the worker thread when an image has been decoded.
+    /** @note Connect your slot with Qt::QueuedConnection so
+        you will receive the callback in your thread. Image is null if decoding failed. */
+    void PreviewLoaded(const QString &key, const QImage &image);
+
+protected:
+    /// QThread override.
+    void run();
+
+private:
+    QImage Decode(const QString &filePath) const;
+
+    const QSize size_;
+    bool stopping_;
+    QList<QPair<QString, QString> > queue_;
+    QMutex mutex_;
+    QWaitCondition condition_;
+};
+
+/// @endcond
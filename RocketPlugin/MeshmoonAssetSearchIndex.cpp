@@ -0,0 +1,179 @@
+/**
+    @author Adminotech Ltd.
+
+    Copyright Adminotech Ltd.
+    All rights reserved.
+
+    @file   MeshmoonAssetSearchIndex.cpp
+    @brief  Trigram index over asset library name, description and tags. */
+
+#include "StableHeaders.h"
+#include "DebugOperatorNew.h"
+
+#include "MeshmoonAssetSearchIndex.h"
+#include "MeshmoonAsset.h"
+
+#include <algorithm>
+#include <iterator>
+
+#include "MemoryLeakCheck.h"
+
+MeshmoonAssetSearchIndex::MeshmoonAssetSearchIndex()
+{
+}
+
+void MeshmoonAssetSearchIndex::Add(MeshmoonAsset *asset)
+{
+    if (!asset || ids_.contains(asset))
+        return;
+
+    const int id = assets_.size();
+    assets_.push_back(asset);
+    ids_[asset] = id;
+
+    QString text = asset->name.toLower() + "\n" + asset->description.toLower();
+    foreach(const QString &tag, asset->tags)
+    {
+        QString trimmedLower = tag.trimmed().toLower();
+        if (trimmedLower.isEmpty())
+            continue;
+        text += "\n" + trimmedLower;
+        Append(tags_[trimmedLower], id);
+    }
+    texts_.push_back(text);
+
+    // Ids are added in increasing order, Append only needs to check the last id for duplicates.
+    const QChar *data = text.constData();
+    for(int i = 0; i + 2 < text.length(); ++i)
+        Append(trigrams_[Trigram(data + i)], id);
+}
+
+void MeshmoonAssetSearchIndex::Add(const MeshmoonAssetList &assets)
+{
+    foreach(MeshmoonAsset *asset, assets)
+        Add(asset);
+}
+
+void MeshmoonAssetSearchIndex::Clear()
+{
+    assets_.clear();
+    texts_.clear();
+    ids_.clear();
+    trigrams_.clear();
+    tags_.clear();
+}
+
+bool MeshmoonAssetSearchIndex::Contains(MeshmoonAsset *asset) const
+{
+    return ids_.contains(asset);
+}
+
+int MeshmoonAssetSearchIndex::Size() const
+{
+    return assets_.size();
+}
+
+MeshmoonAssetList MeshmoonAssetSearchIndex::Search(const QString &term, const QString &tag) const
+{
+    const QStringList words = term.toLower().split(QRegExp("\\s+"), QString::SkipEmptyParts);
+    const QString trimmedTag = tag.trimmed().toLower();
+    const bool filterTag = (!trimmedTag.isEmpty() && trimmedTag != "all");
+
+    MeshmoonAssetList result;
+    if (words.isEmpty() && !filterTag)
+    {
+        result.reserve(assets_.size());
+        foreach(MeshmoonAsset *asset, assets_)
+            result << asset;
+        return result;
+    }
+
+    PostingList ids;
+    bool first = true;
+    if (filterTag)
+    {
+        ids = tags_.value(trimmedTag);
+        first = false;
+    }
+    foreach(const QString &word, words)
+    {
+        if (!first && ids.isEmpty())
+            break;
+        ids = (first ? Match(word) : Intersect(ids, Match(word)));
+        first = false;
+    }
+
+    result.reserve(ids.size());
+    foreach(int id, ids)
+        result << assets_[id];
+    return result;
+}
+
+MeshmoonAssetSearchIndex::PostingList MeshmoonAssetSearchIndex::Match(const QString &word) const
+{
+    PostingList ids;
+    if (word.length() >= 3)
+    {
+        // Intersect the trigram lists starting from the shortest one, then verify the candidates.
+        QList<const PostingList*> lists;
+        const QChar *data = word.constData();
+        for(int i = 0; i + 2 < word.length(); ++i)
+        {
+            QHash<quint64, PostingList>::const_iterator iter = trigrams_.find(Trigram(data + i));
+            if (iter == trigrams_.end())
+                return PostingList();
+            lists << &iter.value();
+        }
+        const PostingList *shortest = lists.first();
+        foreach(const PostingList *list, lists)
+            if (list->size() < shortest->size())
+                shortest = list;
+
+        ids = *shortest;
+        foreach(const PostingList *list, lists)
+        {
+            if (ids.isEmpty())
+                break;
+            if (list != shortest)
+                ids = Intersect(ids, *list);
+        }
+
+        // Trigrams can match in different positions, check for the actual substring.
+        if (word.length() > 3)
+        {
+            PostingList verified;
+            verified.reserve(ids.size());
+            foreach(int id, ids)
+                if (texts_[id].contains(word))
+                    verified.push_back(id);
+            ids = verified;
+        }
+    }
+    else
+    {
+        // Too short for trigrams, scan the texts so that short words still match anywhere like longer ones.
+        for(int id = 0; id < texts_.size(); ++id)
+            if (texts_[id].contains(word))
+                ids.push_back(id);
+    }
+    return ids;
+}
+
+quint64 MeshmoonAssetSearchIndex::Trigram(const QChar *str)
+{
+    return (quint64(str[0].unicode()) << 32) | (quint64(str[1].unicode()) << 16) | quint64(str[2].unicode());
+}
+
+void MeshmoonAssetSearchIndex::Append(PostingList &list, int id)
+{
+    if (list.isEmpty() || list.last() != id)
+        list.push_back(id);
+}
+
+MeshmoonAssetSearchIndex::PostingList MeshmoonAssetSearchIndex::Intersect(const PostingList &a, const PostingList &b)
+{
+    PostingList result;
+    result.reserve(qMin(a.size(), b.size()));
+    std::set_intersection(a.begin(), a.end(), b.begin(), b.end(), std::back_inserter(result));
+    return result;
+}
@@ -0,0 +1,62 @@
+/**
+    @author Adminotech Ltd.
+
+    Copyright Adminotech Ltd.
+    All rights reserved.
+
+    @file   MeshmoonAssetSearchIndex.h
+    @brief  Trigram index over asset library name, description and tags. */
+
+#pragma once
+
+#include "RocketFwd.h"
+
+#include <QString>
+#include <QStringList>
+#include <QVector>
+#include <QHash>
+
+/// Search index over asset name, description and tags.
+/** Each asset is indexed once when added. Words of three or more characters are looked up
+    from a trigram index and verified with a substring match, shorter words are matched by
+    scanning the indexed texts. A query matches an asset if all of its words match.
+    @ingroup MeshmoonRocket */
+class MeshmoonAssetSearchIndex
+{
+public:
+    MeshmoonAssetSearchIndex();
+
+    /// Adds @c asset to the index. Already indexed assets are ignored.
+    void Add(MeshmoonAsset *asset);
+    void Add(const MeshmoonAssetList &assets); /**< @overload */
+
+    /// Removes all assets from the index.
+    void Clear();
+
+    /// Returns if @c asset is indexed.
+    bool Contains(MeshmoonAsset *asset) const;
+
+    /// Returns number of indexed assets.
+    int Size() const;
+
+    /// Returns assets that match all whitespace separated words of @c term and contain @c tag.
+    /** Empty @c term and @c tag, or tag "all", match everything. Results are in the order the assets were added. */
+    MeshmoonAssetList Search(const QString &term, const QString &tag = QString()) const;
+
+private:
+    typedef QVector<int> PostingList;
+
+    static quint64 Trigram(const QChar *str);
+    static void Append(PostingList &list, int id);
+    static PostingList Intersect(const PostingList &a, const PostingList &b);
+
+    /// Returns sorted ids of assets that match @c word.
+    PostingList Match(const QString &word) const;
+
+    QVector<MeshmoonAsset*> assets_;
+    QVector<QString> texts_;                ///< Lower case name, description and tags per asset.
+    QHash<MeshmoonAsset*, int> ids_;
+
+    QHash<quint64, PostingList> trigrams_;
+    QHash<QString, PostingList> tags_;
+};
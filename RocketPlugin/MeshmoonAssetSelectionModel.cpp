@@ -0,0 +1,209 @@
+/**
+    @author Adminotech Ltd.
+
+    Copyright Adminotech Ltd.
+    All rights reserved.
+
+    @file   MeshmoonAssetSelectionModel.cpp
+    @brief  Item model and delegate for the asset library selection dialog. */
+
+#include "StableHeaders.h"
+#include "DebugOperatorNew.h"
+
+#include "MeshmoonAssetSelectionModel.h"
+#include "MeshmoonAsset.h"
+
+#include <QPainter>
+#include <QPainterPath>
+#include <QFontMetrics>
+
+#include "MemoryLeakCheck.h"
+
+// MeshmoonAssetListModel
+
+MeshmoonAssetListModel::MeshmoonAssetListModel(QObject *parent) :
+    QAbstractListModel(parent)
+{
+}
+
+void MeshmoonAssetListModel::SetAssets(const MeshmoonAssetList &assets)
+{
+    beginResetModel();
+    assets_ = assets;
+    endResetModel();
+}
+
+MeshmoonAsset *MeshmoonAssetListModel::AssetAt(const QModelIndex &index) const
+{
+    if (!index.isValid() || index.row() >= assets_.size())
+        return 0;
+    return assets_[index.row()];
+}
+
+QModelIndex MeshmoonAssetListModel::IndexOf(MeshmoonAsset *asset) const
+{
+    int row = (asset ? assets_.indexOf(asset) : -1);
+    return (row >= 0 ? index(row) : QModelIndex());
+}
+
+void MeshmoonAssetListModel::SetPreview(const QString &key, const QPixmap &pixmap)
+{
+    if (key.isEmpty())
+        return;
+    previews_[key] = pixmap;
+
+    // Note: Don't break when first is found, many assets can potentially have same preview image.
+    for(int row = 0; row < assets_.size(); ++row)
+    {
+        if (PreviewKey(assets_[row]) == key)
+        {
+            QModelIndex changed = index(row);
+            emit dataChanged(changed, changed);
+        }
+    }
+}
+
+QString MeshmoonAssetListModel::PreviewKey(MeshmoonAsset *asset)
+{
+    if (!asset)
+        return "";
+    if (!asset->previewImageUrl.isEmpty())
+        return asset->previewImageUrl;
+
+    // Look for rgba color in metadata
+    if (asset->metadata.contains("rgba"))
+    {
+        QVariantList rgbaParts = asset->metadata["rgba"].toList();
+        if (rgbaParts.size() >= 3)
+            return QString("rgba:%1-%2-%3-%4").arg(rgbaParts[0].toInt()).arg(rgbaParts[1].toInt()).arg(rgbaParts[2].toInt())
+                .arg(rgbaParts.size() >= 4 ? rgbaParts[3].toInt() : 255);
+    }
+    return "";
+}
+
+int MeshmoonAssetListModel::rowCount(const QModelIndex &parent) const
+{
+    return (parent.isValid() ? 0 : assets_.size());
+}
+
+QVariant MeshmoonAssetListModel::data(const QModelIndex &index, int role) const
+{
+    MeshmoonAsset *asset = AssetAt(index);
+    if (!asset)
+        return QVariant();
+
+    switch(role)
+    {
+        case Qt::DisplayRole:
+            return asset->name;
+        case Qt::ToolTipRole:
+            return asset->description.isEmpty() ? asset->name : asset->name + "\n" + asset->description;
+        case DescriptionRole:
+            return asset->description;
+        case AssetRole:
+            return QVariant::fromValue<MeshmoonAsset*>(asset);
+        case Qt::DecorationRole:
+        {
+            QString key = PreviewKey(asset);
+            if (key.isEmpty())
+                return QVariant();
+            QHash<QString, QPixmap>::const_iterator iter = previews_.find(key);
+            if (iter != previews_.end())
+                return iter.value();
+            if (!requested_.contains(key))
+            {
+                requested_.insert(key);
+                emit const_cast<MeshmoonAssetListModel*>(this)->PreviewRequested(asset);
+            }
+            return QVariant();
+        }
+        default:
+            return QVariant();
+    }
+}
+
+// MeshmoonAssetItemDelegate
+
+MeshmoonAssetItemDelegate::MeshmoonAssetItemDelegate(const QSize &cellSize, QObject *parent) :
+    QStyledItemDelegate(parent),
+    cellSize_(cellSize),
+    noPreview_(":/images/asset-library-no-preview.png")
+{
+}
+
+QSize MeshmoonAssetItemDelegate::sizeHint(const QStyleOptionViewItem &/*option*/, const QModelIndex &/*index*/) const
+{
+    return cellSize_;
+}
+
+void MeshmoonAssetItemDelegate::paint(QPainter *painter, const QStyleOptionViewItem &option, const QModelIndex &index) const
+{
+    const int infoHeight = 40;
+    const QRect rect = option.rect.adjusted(1, 1, -1, -1);
+
+    painter->save();
+    painter->setRenderHint(QPainter::Antialiasing, true);
+    painter->setRenderHint(QPainter::SmoothPixmapTransform, true);
+
+    QPainterPath clip;
+    clip.addRoundedRect(rect, 6, 6);
+    painter->setClipPath(clip);
+
+    // Preview image
+    QPixmap preview = qvariant_cast<QPixmap>(index.data(Qt::DecorationRole));
+    if (preview.isNull())
+        preview = noPreview_;
+    painter->fillRect(rect, QColor(200, 200, 200, 200));
+    if (!preview.isNull())
+    {
+        QSize previewSize = preview.size();
+        if (previewSize.width() > rect.width() || previewSize.height() > rect.height())
+            previewSize.scale(rect.size(), Qt::KeepAspectRatio);
+        QRect previewRect(QPoint(0, 0), previewSize);
+        previewRect.moveCenter(rect.center());
+        painter->drawPixmap(previewRect, preview);
+    }
+
+    // Info container
+    QRect infoRect(rect.left(), rect.bottom() - infoHeight + 1, rect.width(), infoHeight);
+    painter->fillRect(infoRect, QColor(200, 200, 200, 200));
+    painter->setPen(QColor(150, 150, 150));
+    painter->drawLine(infoRect.topLeft(), infoRect.topRight());
+
+    QRect textRect = infoRect.adjusted(9, 2, -9, -2);
+
+    // Name
+    QFont nameFont("Arial");
+    nameFont.setPixelSize(16);
+    QFontMetrics nameMetrics(nameFont);
+    painter->setFont(nameFont);
+    painter->setPen(QColor(70, 70, 70));
+    painter->drawText(QRect(textRect.left(), textRect.top(), textRect.width(), nameMetrics.height()), Qt::AlignLeft | Qt::AlignVCenter,
+        nameMetrics.elidedText(index.data(Qt::DisplayRole).toString(), Qt::ElideRight, textRect.width()));
+
+    // Description
+    QString descStr = index.data(MeshmoonAssetListModel::DescriptionRole).toString();
+    if (descStr.length() > 35)
+        descStr = descStr.left(32) + "...";
+
+    QFont descFont("Arial");
+    descFont.setPixelSize(11);
+    QFontMetrics descMetrics(descFont);
+    painter->setFont(descFont);
+    painter->setPen(QColor(90, 90, 90));
+    painter->drawText(QRect(textRect.left() + 1, textRect.top() + nameMetrics.height(), textRect.width() - 1, descMetrics.height()), Qt::AlignLeft | Qt::AlignVCenter,
+        descMetrics.elidedText(descStr, Qt::ElideRight, textRect.width() - 1));
+
+    // Border: normal, hover and selected
+    painter->setClipping(false);
+    QColor borderColor(207, 207, 207, 200);
+    if (option.state & QStyle::State_Selected)
+        borderColor = QColor(243, 154, 41);
+    else if (option.state & QStyle::State_MouseOver)
+        borderColor = QColor(170, 170, 170, 200);
+    painter->setPen(QPen(borderColor, 2));
+    painter->setBrush(Qt::NoBrush);
+    painter->drawRoundedRect(rect, 6, 6);
+
+    painter->restore();
+}
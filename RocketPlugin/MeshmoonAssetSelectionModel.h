@@ -0,0 +1,94 @@
+/**
+    @author Adminotech Ltd.
+
+    Copyright Adminotech Ltd.
+    All rights reserved.
+
+    @file   MeshmoonAssetSelectionModel.h
+    @brief  Item model and delegate for the asset library selection dialog. */
+
+#pragma once
+
+#include "RocketFwd.h"
+
+#include <QAbstractListModel>
+#include <QStyledItemDelegate>
+#include <QPixmap>
+#include <QHash>
+#include <QSet>
+
+/// @cond PRIVATE
+
+/// List model of assets shown in MeshmoonAssetSelectionDialog.
+/** Preview images are requested lazily with PreviewRequested when the view first asks for
+    the decoration of an asset, so only assets that have been scrolled into view are loaded. */
+class MeshmoonAssetListModel : public QAbstractListModel
+{
+    Q_OBJECT
+
+public:
+    enum Roles
+    {
+        AssetRole = Qt::UserRole + 1,   ///< MeshmoonAsset*
+        DescriptionRole                 ///< Asset description
+    };
+
+    explicit MeshmoonAssetListModel(QObject *parent = 0);
+
+    /// Replaces the shown assets. Loaded previews are kept.
+    void SetAssets(const MeshmoonAssetList &assets);
+
+    /// Returns the shown assets.
+    const MeshmoonAssetList &Assets() const { return assets_; }
+
+    /// Returns asset for @c index or null if invalid.
+    MeshmoonAsset *AssetAt(const QModelIndex &index) const;
+
+    /// Returns index for @c asset or invalid index if it is not shown.
+    QModelIndex IndexOf(MeshmoonAsset *asset) const;
+
+    /// Sets the preview for all assets with preview @c key.
+    void SetPreview(const QString &key, const QPixmap &pixmap);
+
+    /// Returns the preview key of @c asset, empty if asset has no preview.
+    /** Assets can share preview images, previews are loaded and cached once per key. */
+    static QString PreviewKey(MeshmoonAsset *asset);
+
+    /// QAbstractListModel override.
+    int rowCount(const QModelIndex &parent = QModelIndex()) const;
+
+    /// QAbstractListModel override.
+    QVariant data(const QModelIndex &index, int role = Qt::DisplayRole) const;
+
+signals:
+    /// Emitted once per preview key when the view first needs the preview of @c asset.
+    void PreviewRequested(MeshmoonAsset *asset);
+
+private:
+    MeshmoonAssetList assets_;
+    QHash<QString, QPixmap> previews_;
+    mutable QSet<QString> requested_;
+};
+
+/// Paints asset cells of MeshmoonAssetSelectionDialog.
+/** Replaces the per asset button, frame and label widgets with painting, so the cost of
+    the view does not depend on the number of assets in the library. */
+class MeshmoonAssetItemDelegate : public QStyledItemDelegate
+{
+    Q_OBJECT
+
+public:
+    explicit MeshmoonAssetItemDelegate(const QSize &cellSize, QObject *parent = 0);
+
+    /// QStyledItemDelegate override.
+    void paint(QPainter *painter, const QStyleOptionViewItem &option, const QModelIndex &index) const;
+
+    /// QStyledItemDelegate override.
+    QSize sizeHint(const QStyleOptionViewItem &option, const QModelIndex &index) const;
+
+private:
+    QSize cellSize_;
+    QPixmap noPreview_;
+};
+
+/// @endcond
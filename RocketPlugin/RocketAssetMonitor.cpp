@@ -25,11 +25,45 @@
 #include "AssetCache.h"
 #include "IAsset.h"
 #include "IAssetTransfer.h"
+#include "LoggingFunctions.h"
+#include "Math/MathFunc.h"
+
+#include <QFileInfo>
+
+namespace
+{
+    /// Progress weight of downloaded bytes, the rest is given to completed asset loads.
+    const qreal BytesProgressWeight = 0.7;
+
+    /// Expected size for asset types we have not seen yet.
+    const uint DefaultExpectedBytes = 64 * 1024;
+
+    /// Assumed throughput in bytes per second until we have measured one.
+    const float DefaultBytesPerSecond = 512.f * 1024.f;
+
+    /// Returns if transfers of @c type are needed for the world to be usable.
+    /** Binary assets are commonly used for polling REST APIs and have little to do with the 3D world. */
+    bool IsCriticalType(const QString &type)
+    {
+        return (type != "Binary");
+    }
+}
 
 RocketAssetMonitor::RocketAssetMonitor(RocketPlugin *plugin) :
     plugin_(plugin),
     lastKnownAssetTransferCount_(0),
-    transferCountPeak_(0)
+    pendingCritical_(0),
+    syncDirty_(false),
+    progressDirty_(false),
+    sessionActive_(false),
+    worldUsableEmitted_(false),
+    sessionAssets_(0),
+    sessionCompleted_(0),
+    sessionExpectedBytes_(0),
+    sessionDownloadedBytes_(0),
+    progress_(0.0),
+    estimate_(0.f),
+    lastEmittedEstimate_(0.f)
 {
     connect(plugin_->GetFramework()->Frame(), SIGNAL(Updated(float)), this, SLOT(OnUpdate(float)), Qt::UniqueConnection);
 }
@@ -48,11 +82,43 @@ bool RocketAssetMonitor::AllTransfersCompleted() const
     return (NumCurrentTransfers() == 0);
 }
 
+qreal RocketAssetMonitor::LoadProgress() const
+{
+    return (sessionActive_ ? progress_ : 1.0);
+}
+
+float RocketAssetMonitor::EstimatedMsecsToWorldUsable() const
+{
+    return (pendingCritical_ > 0 ? estimate_ : 0.f);
+}
+
+QVariantMap RocketAssetMonitor::TypeTimings::ToVariantMap() const
+{
+    QVariantMap map;
+    map["count"] = count;
+    map["failed"] = failed;
+    map["bytes"] = bytes;
+    map["downloadMsecs"] = downloadMsecs;
+    map["loadMsecs"] = loadMsecs;
+    map["averageDownloadMsecs"] = (count > 0 ? downloadMsecs / count : 0.f);
+    map["averageLoadMsecs"] = (count > 0 ? loadMsecs / count : 0.f);
+    return map;
+}
+
+QVariantMap RocketAssetMonitor::AssetTypeTimings() const
+{
+    QVariantMap timings;
+    for (QHash<QString, TypeTimings>::const_iterator iter = typeTimings_.begin(); iter != typeTimings_.end(); ++iter)
+        timings[iter.key()] = iter->ToVariantMap();
+    return timings;
+}
+
 void RocketAssetMonitor::StartMonitoringForTaskbar(RocketTaskbar *taskbar)
 {
     taskbar_ = taskbar;    
     if (taskbar_)
         connect(&taskbarMonitoringDoneTimer_, SIGNAL(timeout()), taskbar_, SLOT(ClearMessageAndStopLoadAnimation()), Qt::UniqueConnection);
+    SyncTransfers();
     UpdateTaskbar(NumCurrentTransfers());
 }
 
@@ -69,19 +135,17 @@ void RocketAssetMonitor::StopMonitoringForTaskbar()
 void RocketAssetMonitor::OnUpdate(float frametime)
 {
     const uint transfers = NumCurrentTransfers();
+
+    // Only walk the pending transfers when something has started or finished.
+    if (syncDirty_ || lastKnownAssetTransferCount_ != transfers)
+        SyncTransfers();
+    if (progressDirty_)
+        UpdateProgress();
+
     if (lastKnownAssetTransferCount_ != transfers)
     {
         // Update tracking state
         lastKnownAssetTransferCount_ = transfers;
-        if (transfers > transferCountPeak_)
-            transferCountPeak_ = transfers;
-    
-        // Update loading screen completion percent
-        if (plugin_->Lobby() && plugin_->Lobby()->IsLoaderVisible() && plugin_->IsConnectedToServer())
-        {
-            qreal progress = 100.0 - ((static_cast<qreal>(transfers) / static_cast<qreal>(transferCountPeak_)) * 100.0);
-            plugin_->Lobby()->GetLoader()->SetCompletion(progress);
-        }
 
         // Update taskbar
         UpdateTaskbar(lastKnownAssetTransferCount_);
@@ -90,36 +154,230 @@ void RocketAssetMonitor::OnUpdate(float frametime)
         emit AssetTransfersRemainingChanged(lastKnownAssetTransferCount_);
         if (lastKnownAssetTransferCount_ == 0)
         {
-            transferCountPeak_ = 0;
+            if (sessionActive_)
+                LogDebug(QString("[RocketAssetMonitor]: Loaded %1 assets, %2 kb in %3 msecs").arg(sessionAssets_)
+                    .arg(static_cast<qreal>(sessionDownloadedBytes_) / 1024.0, 0, 'f', 1).arg(sessionTimer_.MSecsElapsed(), 0, 'f', 0));
+            ResetSession();
             emit TransfersCompleted();
         }
     }
 }
 
-void RocketAssetMonitor::UpdateTaskbar(uint transfers)
+void RocketAssetMonitor::SyncTransfers()
 {
-    if (!taskbar_)
-        return;
+    syncDirty_ = false;
 
-    // There are worlds that do polling via BinaryAsset to REST APIs etc.
-    // If there are less than 5 transfers, check if all are binary,
-    // meaning they have very little to do with the 3D world and can be ignored.
-    if (transfers < 5)
+    std::vector<AssetTransferPtr> pending = plugin_->GetFramework()->Asset()->PendingTransfers();
+    QHash<IAssetTransfer*, TrackedTransfer> previous;
+    previous.swap(tracked_);
+    tracked_.reserve(static_cast<int>(pending.size()));
+
+    for (std::vector<AssetTransferPtr>::const_iterator iter = pending.begin(), end = pending.end(); iter != end; ++iter)
     {
-        bool allBinary = true;
-        std::vector<AssetTransferPtr> pending = plugin_->GetFramework()->Asset()->PendingTransfers();
-        for (std::vector<AssetTransferPtr>::const_iterator iter = pending.begin(), end = pending.end(); iter != end; ++iter)
+        IAssetTransfer *transfer = (*iter).get();
+        if (!transfer)
+            continue;
+
+        QHash<IAssetTransfer*, TrackedTransfer>::iterator existing = previous.find(transfer);
+        if (existing != previous.end() && existing->transfer.lock().get() == transfer)
         {
-            if ((*iter)->AssetType() != "Binary")
-            {
-                allBinary = false;
-                break;
-            }
+            tracked_.insert(transfer, existing.value());
+            previous.erase(existing);
+            continue;
         }
-        if (allBinary)
-            transfers = 0;
+
+        // New transfer, possibly a dependency discovered by a completed asset.
+        if (!sessionActive_)
+        {
+            ResetSession();
+            sessionActive_ = true;
+            sessionTimer_.Start();
+        }
+
+        TrackedTransfer &t = tracked_[transfer];
+        t.transfer = *iter;
+        t.type = transfer->AssetType();
+        t.critical = IsCriticalType(t.type);
+        t.expectedBytes = ExpectedBytes(transfer, t.type);
+        t.timer.Start();
+
+        sessionAssets_++;
+        sessionExpectedBytes_ += t.expectedBytes;
+        if (t.critical)
+            pendingCritical_++;
+
+        connect(transfer, SIGNAL(Downloaded(IAssetTransfer*)), this, SLOT(OnTransferDownloaded(IAssetTransfer*)), Qt::UniqueConnection);
+        connect(transfer, SIGNAL(Succeeded(AssetPtr)), this, SLOT(OnTransferSucceeded(AssetPtr)), Qt::UniqueConnection);
+        connect(transfer, SIGNAL(Failed(IAssetTransfer*, QString)), this, SLOT(OnTransferFailed(IAssetTransfer*, QString)), Qt::UniqueConnection);
+        progressDirty_ = true;
     }
 
+    // Transfers that went away without us seeing them finish, eg. AssetAPI was reset.
+    for (QHash<IAssetTransfer*, TrackedTransfer>::const_iterator iter = previous.begin(); iter != previous.end(); ++iter)
+    {
+        if (iter->critical && pendingCritical_ > 0)
+            pendingCritical_--;
+        sessionCompleted_++;
+        progressDirty_ = true;
+    }
+}
+
+uint RocketAssetMonitor::ExpectedBytes(IAssetTransfer *transfer, const QString &type) const
+{
+    // Assets in the cache will most likely be served from it, or re-downloaded with a similar size.
+    const QString diskSource = plugin_->GetFramework()->Asset()->GetAssetCache()->FindInCache(transfer->SourceUrl());
+    if (!diskSource.isEmpty())
+    {
+        QFileInfo info(diskSource);
+        if (info.exists() && info.size() > 0)
+            return static_cast<uint>(info.size());
+    }
+
+    // Otherwise use the average size of the type seen so far.
+    QHash<QString, TypeTimings>::const_iterator iter = typeTimings_.find(type);
+    if (iter != typeTimings_.end() && iter->count > 0 && iter->bytes > 0)
+        return static_cast<uint>(iter->bytes / iter->count);
+    return DefaultExpectedBytes;
+}
+
+void RocketAssetMonitor::OnTransferDownloaded(IAssetTransfer *transfer)
+{
+    QHash<IAssetTransfer*, TrackedTransfer>::iterator iter = tracked_.find(transfer);
+    if (iter == tracked_.end() || iter->downloaded)
+        return;
+
+    TrackedTransfer &t = iter.value();
+    t.downloaded = true;
+    t.downloadMsecs = t.timer.MSecsElapsed();
+
+    // Replace the estimate with the actual size.
+    const uint actualBytes = static_cast<uint>(transfer->rawAssetData.size());
+    if (actualBytes > 0)
+    {
+        sessionExpectedBytes_ = sessionExpectedBytes_ - t.expectedBytes + actualBytes;
+        t.expectedBytes = actualBytes;
+    }
+    sessionDownloadedBytes_ += t.expectedBytes;
+    progressDirty_ = true;
+}
+
+void RocketAssetMonitor::OnTransferSucceeded(AssetPtr /*asset*/)
+{
+    Complete(qobject_cast<IAssetTransfer*>(sender()), false);
+}
+
+void RocketAssetMonitor::OnTransferFailed(IAssetTransfer *transfer, QString /*reason*/)
+{
+    Complete(transfer, true);
+}
+
+void RocketAssetMonitor::Complete(IAssetTransfer *transfer, bool failed)
+{
+    QHash<IAssetTransfer*, TrackedTransfer>::iterator iter = tracked_.find(transfer);
+    if (iter == tracked_.end())
+        return;
+
+    TrackedTransfer &t = iter.value();
+    if (!t.downloaded)
+    {
+        // Failed or served without a download notification.
+        t.downloadMsecs = t.timer.MSecsElapsed();
+        sessionDownloadedBytes_ += t.expectedBytes;
+    }
+
+    TypeTimings &timings = typeTimings_[t.type];
+    if (failed)
+        timings.failed++;
+    else
+    {
+        timings.count++;
+        timings.bytes += t.expectedBytes;
+        timings.downloadMsecs += t.downloadMsecs;
+        timings.loadMsecs += Max(t.timer.MSecsElapsed() - t.downloadMsecs, 0.f);
+    }
+
+    if (t.critical && pendingCritical_ > 0)
+        pendingCritical_--;
+    sessionCompleted_++;
+
+    tracked_.erase(iter);
+    syncDirty_ = true;
+    progressDirty_ = true;
+}
+
+void RocketAssetMonitor::UpdateProgress()
+{
+    progressDirty_ = false;
+    if (!sessionActive_)
+        return;
+
+    // Progress never goes backwards when dependencies grow the expected total.
+    const qreal bytesProgress = (sessionExpectedBytes_ > 0 ? static_cast<qreal>(sessionDownloadedBytes_) / static_cast<qreal>(sessionExpectedBytes_) : 0.0);
+    const qreal loadProgress = (sessionAssets_ > 0 ? static_cast<qreal>(sessionCompleted_) / static_cast<qreal>(sessionAssets_) : 0.0);
+    const qreal progress = Clamp(BytesProgressWeight * bytesProgress + (1.0 - BytesProgressWeight) * loadProgress, 0.0, 1.0);
+    const bool progressChanged = (progress > progress_);
+    if (progressChanged)
+        progress_ = progress;
+
+    // Critical path estimate: remaining critical bytes at the measured throughput,
+    // followed by the slowest load of the pending critical types.
+    quint64 remainingBytes = 0;
+    float slowestLoadMsecs = 0.f;
+    for (QHash<IAssetTransfer*, TrackedTransfer>::const_iterator iter = tracked_.begin(); iter != tracked_.end(); ++iter)
+    {
+        if (!iter->critical)
+            continue;
+        if (!iter->downloaded)
+            remainingBytes += iter->expectedBytes;
+        QHash<QString, TypeTimings>::const_iterator timings = typeTimings_.find(iter->type);
+        if (timings != typeTimings_.end() && timings->count > 0)
+            slowestLoadMsecs = Max(slowestLoadMsecs, timings->loadMsecs / timings->count);
+    }
+    const float elapsedSecs = sessionTimer_.MSecsElapsed() / 1000.f;
+    const float bytesPerSecond = (sessionDownloadedBytes_ > 0 && elapsedSecs > 0.5f ? sessionDownloadedBytes_ / elapsedSecs : DefaultBytesPerSecond);
+    estimate_ = (pendingCritical_ > 0 ? (remainingBytes / bytesPerSecond) * 1000.f + slowestLoadMsecs : 0.f);
+
+    // Update loading screen completion percent
+    if (progressChanged && plugin_->Lobby() && plugin_->Lobby()->IsLoaderVisible() && plugin_->IsConnectedToServer())
+        plugin_->Lobby()->GetLoader()->SetCompletion(progress_ * 100.0);
+
+    if (progressChanged || Abs(estimate_ - lastEmittedEstimate_) > 100.f)
+    {
+        lastEmittedEstimate_ = estimate_;
+        emit LoadProgressChanged(progress_, estimate_);
+    }
+
+    if (pendingCritical_ == 0 && !worldUsableEmitted_)
+    {
+        worldUsableEmitted_ = true;
+        emit WorldUsable(sessionTimer_.MSecsElapsed());
+    }
+}
+
+void RocketAssetMonitor::ResetSession()
+{
+    sessionActive_ = false;
+    worldUsableEmitted_ = false;
+    sessionAssets_ = 0;
+    sessionCompleted_ = 0;
+    sessionExpectedBytes_ = 0;
+    sessionDownloadedBytes_ = 0;
+    progress_ = 0.0;
+    estimate_ = 0.f;
+    lastEmittedEstimate_ = 0.f;
+}
+
+void RocketAssetMonitor::UpdateTaskbar(uint transfers)
+{
+    if (!taskbar_)
+        return;
+
+    // There are worlds that do polling via BinaryAsset to REST APIs etc.
+    // If there are less than 5 transfers and none of them are needed for the world,
+    // they have very little to do with the 3D world and can be ignored.
+    if (transfers < 5 && pendingCritical_ == 0)
+        transfers = 0;
+
     if (transfers == 0)
     {
         if (!taskbarMonitoringDoneTimer_.isActive())
@@ -10,11 +10,16 @@
 #pragma once
 
 #include "RocketFwd.h"
+#include "AssetFwd.h"
 
 #include <QObject>
 #include <QString>
 #include <QPointer>
 #include <QTimer>
+#include <QHash>
+#include <QVariantMap>
+
+#include <kNet/PolledTimer.h>
 
 /// Provides asset monitoring.
 /** @ingroup MeshmoonRocket */
@@ -37,6 +42,22 @@ public slots:
     /// Returns if all AssetAPI transfers are completed.
     bool AllTransfersCompleted() const;
 
+    /// Returns current loading progress in the range [0,1].
+    /** Progress is weighted by downloaded bytes and completed asset loads. Dependencies
+        discovered during loading grow the expected total but never move the progress backwards. */
+    qreal LoadProgress() const;
+
+    /// Returns estimated milliseconds until all transfers needed to render and interact with the world have completed.
+    /** Returns 0 if the world is already usable. The estimate is based on remaining expected bytes,
+        measured download throughput and the average load time of the pending asset types. */
+    float EstimatedMsecsToWorldUsable() const;
+
+    /// Returns per asset type timing breakdown of completed transfers.
+    /** Each asset type maps to a QVariantMap with keys: count, failed, bytes, downloadMsecs,
+        loadMsecs, averageDownloadMsecs and averageLoadMsecs. Load time is the time from
+        download completion until the asset and its dependencies were loaded. */
+    QVariantMap AssetTypeTimings() const;
+
 signals:
     /// Emitted when number of ongoing asset transfers change.
     /** @note This includes when assets are loaded during runtime,
@@ -49,6 +70,15 @@ signals:
         not just on initial world loading. Expect multiple signals. */
     void TransfersCompleted();
 
+    /// Emitted when loading progress or the world usable estimate changes.
+    /** @param progress Progress in the range [0,1], see LoadProgress.
+        @param msecsToWorldUsable See EstimatedMsecsToWorldUsable. */
+    void LoadProgressChanged(qreal progress, float msecsToWorldUsable);
+
+    /// Emitted once per loading session when all transfers needed to render and interact with the world have completed.
+    /** @param msecs Time from the first transfer of the session. */
+    void WorldUsable(float msecs);
+
 private slots:   
     /// Invoked by RocketPlugin.
     void StartMonitoringForTaskbar(RocketTaskbar *taskbar);
@@ -64,16 +94,79 @@ private slots:
     /// Main update for transfer count monitoring.
     void OnUpdate(float frametime);
 
+    /// Transfer signal handlers.
+    void OnTransferDownloaded(IAssetTransfer *transfer);
+    void OnTransferSucceeded(AssetPtr asset);
+    void OnTransferFailed(IAssetTransfer *transfer, QString reason);
+
 private:   
+    struct TrackedTransfer
+    {
+        AssetTransferWeakPtr transfer;
+        QString type;
+        bool critical;          ///< Needed for the world to be usable.
+        bool downloaded;
+        uint expectedBytes;     ///< Cached file size or per type average until downloaded, then actual size.
+        float downloadMsecs;
+        kNet::PolledTimer timer;
+
+        TrackedTransfer() : critical(true), downloaded(false), expectedBytes(0), downloadMsecs(0.f) {}
+    };
+
+    struct TypeTimings
+    {
+        uint count;
+        uint failed;
+        quint64 bytes;
+        float downloadMsecs;
+        float loadMsecs;
+
+        TypeTimings() : count(0), failed(0), bytes(0), downloadMsecs(0.f), loadMsecs(0.f) {}
+        QVariantMap ToVariantMap() const;
+    };
+
     /// Invoked internally.
     void UpdateTaskbar(uint transfers);
 
+    /// Starts tracking new transfers and drops ones no longer pending in AssetAPI.
+    /** Only invoked when the AssetAPI transfer count differs from our tracked count. */
+    void SyncTransfers();
+
+    /// Completes tracking of @c transfer.
+    void Complete(IAssetTransfer *transfer, bool failed);
+
+    /// Returns expected size for a new transfer.
+    uint ExpectedBytes(IAssetTransfer *transfer, const QString &type) const;
+
+    /// Recalculates progress and emits signals.
+    void UpdateProgress();
+
+    /// Resets per session loading state.
+    void ResetSession();
+
     RocketPlugin *plugin_;
     QPointer<RocketTaskbar> taskbar_;
 
     QTimer taskbarMonitoringDoneTimer_;
 
     uint lastKnownAssetTransferCount_;
-    uint transferCountPeak_;
+
+    QHash<IAssetTransfer*, TrackedTransfer> tracked_;
+    QHash<QString, TypeTimings> typeTimings_;
+    uint pendingCritical_;
+    bool syncDirty_;
+    bool progressDirty_;
+
+    // Loading session state, reset when all transfers complete.
+    kNet::PolledTimer sessionTimer_;
+    bool sessionActive_;
+    bool worldUsableEmitted_;
+    uint sessionAssets_;
+    uint sessionCompleted_;
+    quint64 sessionExpectedBytes_;
+    quint64 sessionDownloadedBytes_;
+    qreal progress_;
+    float estimate_;
+    float lastEmittedEstimate_;
 };
 Q_DECLARE_METATYPE(RocketAssetMonitor*)
@@ -0,0 +1,587 @@
+/**
+    @author Adminotech Ltd.
+
+    Copyright Adminotech Ltd.
+    All rights reserved.
+
+    @file   RocketAssetRetention.cpp
+    @brief  Prefetches recently used world assets when connecting after a disconnect or teleport. */
+
+#include "StableHeaders.h"
+#include "DebugOperatorNew.h"
+
+#include "RocketAssetRetention.h"
+#include "RocketAssetMonitor.h"
+#include "RocketPlugin.h"
+
+#include "Framework.h"
+#include "CoreDefines.h"
+#include "LoggingFunctions.h"
+#include "ConfigAPI.h"
+#include "ConsoleAPI.h"
+#include "IRenderer.h"
+#include "AssetAPI.h"
+#include "IAsset.h"
+#include "IAssetTransfer.h"
+#include "IAttribute.h"
+#include "Scene.h"
+#include "Entity.h"
+#include "IComponent.h"
+#include "TundraLogicModule.h"
+#include "Client.h"
+
+#include "TextureAsset.h"
+#include "OgreMeshAsset.h"
+#include "OgreSkeletonAsset.h"
+
+#include <OgreTexture.h>
+#include <OgreMesh.h>
+#include <OgreSkeleton.h>
+
+#include <QFileInfo>
+
+#include <algorithm>
+
+#include "MemoryLeakCheck.h"
+
+/// @cond PRIVATE
+
+namespace
+{
+    /// Retained assets requested at the same time, leaves room for the world's own transfers.
+    const int MaxRetainedTransfers = 8;
+    /// Time the transfer count has to stay at zero after WorldUsable before the world is considered loaded.
+    /** The retained assets may finish before the world has started its own transfers. */
+    const int SettleMsecs = 1000;
+    /// Time limit of one benchmark step.
+    const int BenchmarkStepTimeoutMsecs = 180 * 1000;
+
+    bool IsAssetRefType(const QString &typeName)
+    {
+        return typeName == cAttributeAssetReferenceTypeName || typeName == cAttributeAssetReferenceListTypeName;
+    }
+
+    bool LessRecentlyUsed(const RocketAssetRetentionPolicy::Entry &e1, const RocketAssetRetentionPolicy::Entry &e2)
+    {
+        if (e1.lastUsed != e2.lastUsed)
+            return e1.lastUsed < e2.lastUsed;
+        return e1.bytes > e2.bytes;
+    }
+
+    bool MoreRecentlyUsed(const RocketAssetRetentionPolicy::Entry &e1, const RocketAssetRetentionPolicy::Entry &e2)
+    {
+        if (e1.lastUsed != e2.lastUsed)
+            return e1.lastUsed > e2.lastUsed;
+        return e1.bytes < e2.bytes;
+    }
+
+    QString FormatMegabytes(quint64 bytes)
+    {
+        return QString::number(bytes / (1024.0 * 1024.0), 'f', 1) + " MB";
+    }
+
+    qint64 Average(const QList<qint64> &values)
+    {
+        if (values.isEmpty())
+            return 0;
+        qint64 sum = 0;
+        foreach(qint64 value, values)
+            sum += value;
+        return sum / values.size();
+    }
+}
+
+// RocketAssetRetentionPolicy
+
+RocketAssetRetentionPolicy::RocketAssetRetentionPolicy(quint64 budgetBytes) :
+    budget_(budgetBytes),
+    total_(0)
+{
+}
+
+void RocketAssetRetentionPolicy::Touch(const QString &ref, const QString &type, quint64 bytes, uint stamp)
+{
+    Entry &entry = entries_[ref];
+    total_ -= entry.bytes;
+    entry.ref = ref;
+    entry.type = type;
+    entry.bytes = bytes;
+    entry.lastUsed = qMax(entry.lastUsed, stamp);
+    total_ += entry.bytes;
+}
+
+void RocketAssetRetentionPolicy::Remove(const QString &ref)
+{
+    QHash<QString, Entry>::iterator iter = entries_.find(ref);
+    if (iter == entries_.end())
+        return;
+    total_ -= iter.value().bytes;
+    entries_.erase(iter);
+}
+
+void RocketAssetRetentionPolicy::Clear()
+{
+    entries_.clear();
+    total_ = 0;
+}
+
+QStringList RocketAssetRetentionPolicy::Evict()
+{
+    QStringList evicted;
+    if (total_ <= budget_)
+        return evicted;
+
+    QList<Entry> entries = entries_.values();
+    std::sort(entries.begin(), entries.end(), LessRecentlyUsed);
+    for(int i = 0; i < entries.size() && total_ > budget_; ++i)
+    {
+        evicted << entries[i].ref;
+        Remove(entries[i].ref);
+    }
+    return evicted;
+}
+
+QList<RocketAssetRetentionPolicy::Entry> RocketAssetRetentionPolicy::MostRecentFirst() const
+{
+    QList<Entry> entries = entries_.values();
+    std::sort(entries.begin(), entries.end(), MoreRecentlyUsed);
+    return entries;
+}
+
+// RocketAssetRetention
+
+RocketAssetRetention::RocketAssetRetention(RocketPlugin *plugin) :
+    plugin_(plugin),
+    framework_(plugin->GetFramework()),
+    LC("[RocketAssetRetention]: "),
+    enabled_(!plugin->GetFramework()->HasCommandLineParameter("--rocketNoAssetRetention") &&
+        plugin->GetFramework()->Config()->Read("adminotech", "clientplugin", "assetretention", true).toBool()),
+    forgetting_(false),
+    connecting_(false),
+    session_(1)
+{
+    const int budgetMegabytes = framework_->Config()->Read("adminotech", "clientplugin", "assetretentionbudget", 256).toInt();
+    policy_.SetBudget(static_cast<quint64>(qMax(0, budgetMegabytes)) * 1024 * 1024);
+
+    connect(framework_->Asset(), SIGNAL(AssetAboutToBeRemoved(AssetPtr)), SLOT(OnAssetAboutToBeRemoved(AssetPtr)));
+    if (plugin_->GetTundraClient())
+    {
+        connect(plugin_->GetTundraClient(), SIGNAL(AboutToConnect()), SLOT(OnAboutToConnect()));
+        connect(plugin_->GetTundraClient(), SIGNAL(Disconnected()), SLOT(OnDisconnected()));
+    }
+    if (plugin_->AssetMonitor())
+        connect(plugin_->AssetMonitor(), SIGNAL(WorldUsable(float)), SLOT(OnWorldUsable(float)));
+
+    framework_->Console()->RegisterCommand("assetRetention", "Enables or disables prefetching recently used assets when connecting, prints its state without parameters. Usage: assetRetention(enabled)",
+        this, SLOT(SetEnabledCommand(const QString&)), SLOT(PrintStatus()));
+}
+
+RocketAssetRetention::~RocketAssetRetention()
+{
+}
+
+void RocketAssetRetention::SetEnabled(bool enabled)
+{
+    if (enabled_ == enabled)
+        return;
+    enabled_ = enabled;
+    if (!enabled_)
+    {
+        queue_.clear();
+        policy_.Clear();
+    }
+    LogInfo(LC + (enabled_ ? "Asset retention enabled" : "Asset retention disabled"));
+}
+
+void RocketAssetRetention::Clear()
+{
+    queue_.clear();
+    policy_.Clear();
+}
+
+quint64 RocketAssetRetention::ResidentBytes(IAsset *asset)
+{
+    if (!asset)
+        return 0;
+
+    TextureAsset *texture = dynamic_cast<TextureAsset*>(asset);
+    if (texture && !texture->ogreTexture.isNull())
+        return texture->ogreTexture->getSize();
+    OgreMeshAsset *mesh = dynamic_cast<OgreMeshAsset*>(asset);
+    if (mesh && !mesh->ogreMesh.isNull())
+        return mesh->ogreMesh->getSize();
+    OgreSkeletonAsset *skeleton = dynamic_cast<OgreSkeletonAsset*>(asset);
+    if (skeleton && !skeleton->ogreSkeleton.isNull())
+        return skeleton->ogreSkeleton->getSize();
+
+    // Materials, scripts, sounds etc. are about the size of their source.
+    QFileInfo source(asset->DiskSource());
+    return (source.exists() ? static_cast<quint64>(source.size()) : 1024);
+}
+
+void RocketAssetRetention::OnAssetAboutToBeRemoved(AssetPtr asset)
+{
+    if (!enabled_ || forgetting_ || !asset.get() || !asset->IsLoaded())
+        return;
+    // Binary assets are commonly used for polling REST APIs, they are not worth keeping.
+    if (asset->Type() == "Binary" || AssetAPI::ParseAssetRef(asset->Name()) != AssetAPI::AssetRefExternalUrl)
+        return;
+
+    policy_.Touch(asset->Name(), asset->Type(), ResidentBytes(asset.get()), session_);
+}
+
+void RocketAssetRetention::OnAboutToConnect()
+{
+    // Everything forgotten on the previous logout has been recorded.
+    const QStringList evicted = policy_.Evict();
+    if (!evicted.isEmpty())
+        LogDebug(LC + QString("Evicted %1 least recently used assets over the %2 budget").arg(evicted.size()).arg(FormatMegabytes(policy_.Budget())));
+    session_++;
+
+    queue_.clear();
+    pending_.clear();
+    requested_.clear();
+    stats_ = Stats();
+    connecting_ = true;
+
+    if (!enabled_ || policy_.Size() == 0)
+        return;
+
+    loadTimer_.start();
+    queue_ = policy_.MostRecentFirst();
+    LogInfo(LC + QString("Requesting %1 retained assets, %2").arg(queue_.size()).arg(FormatMegabytes(policy_.TotalBytes())));
+    RequestNext();
+}
+
+void RocketAssetRetention::OnDisconnected()
+{
+    // Transfers were aborted by the logout.
+    queue_.clear();
+    pending_.clear();
+    connecting_ = false;
+}
+
+void RocketAssetRetention::RequestNext()
+{
+    while(!queue_.isEmpty() && pending_.size() < MaxRetainedTransfers)
+    {
+        const RocketAssetRetentionPolicy::Entry entry = queue_.takeFirst();
+        AssetTransferPtr transfer = framework_->Asset()->RequestAsset(entry.ref, entry.type);
+        if (!transfer.get())
+        {
+            policy_.Remove(entry.ref);
+            continue;
+        }
+        requested_.insert(entry.ref);
+        stats_.requested++;
+        stats_.requestedBytes += entry.bytes;
+        pending_[transfer.get()] = entry.ref;
+        connect(transfer.get(), SIGNAL(Succeeded(AssetPtr)), SLOT(OnTransferSucceeded(AssetPtr)), Qt::UniqueConnection);
+        connect(transfer.get(), SIGNAL(Failed(IAssetTransfer*, QString)), SLOT(OnTransferFailed(IAssetTransfer*, QString)), Qt::UniqueConnection);
+    }
+    if (connecting_ && queue_.isEmpty() && pending_.isEmpty() && stats_.requested > 0 && stats_.loadMsecs < 0)
+        stats_.loadMsecs = loadTimer_.elapsed();
+}
+
+void RocketAssetRetention::OnTransferSucceeded(AssetPtr /*asset*/)
+{
+    IAssetTransfer *transfer = dynamic_cast<IAssetTransfer*>(sender());
+    if (!transfer || !pending_.contains(transfer))
+        return;
+    pending_.remove(transfer);
+    RequestNext();
+}
+
+void RocketAssetRetention::OnTransferFailed(IAssetTransfer *transfer, QString /*reason*/)
+{
+    QHash<IAssetTransfer*, QString>::iterator iter = pending_.find(transfer);
+    if (iter == pending_.end())
+        return;
+
+    // Not available anymore, do not try again.
+    policy_.Remove(iter.value());
+    requested_.remove(iter.value());
+    stats_.failed++;
+    pending_.erase(iter);
+    RequestNext();
+}
+
+void RocketAssetRetention::OnWorldUsable(float /*msecs*/)
+{
+    if (connecting_ && plugin_->IsConnectedToServer())
+        QTimer::singleShot(SettleMsecs, this, SLOT(OnSettle()));
+}
+
+void RocketAssetRetention::OnSettle()
+{
+    // New transfers were started, wait for the next WorldUsable.
+    if (!connecting_ || !plugin_->IsConnectedToServer() || !plugin_->AssetMonitor() || !plugin_->AssetMonitor()->AllTransfersCompleted())
+        return;
+    connecting_ = false;
+    Revalidate();
+}
+
+void RocketAssetRetention::Revalidate()
+{
+    queue_.clear();
+    if (requested_.isEmpty())
+    {
+        emit Revalidated(stats_);
+        return;
+    }
+
+    const QSet<QString> references = SceneReferences(framework_->Renderer()->MainCameraScene());
+
+    forgetting_ = true;
+    foreach(const QString &ref, requested_)
+    {
+        AssetPtr asset = framework_->Asset()->GetAsset(ref);
+        if (!asset.get())
+            continue;
+
+        // AssetAPI and this function hold a reference, anything more is someone using the asset outside the scene.
+        if (references.contains(ref) || !framework_->Asset()->FindDependents(ref).empty() || asset.use_count() > 2)
+        {
+            stats_.used++;
+            stats_.usedBytes += ResidentBytes(asset.get());
+            continue;
+        }
+        stats_.releasedBytes += ResidentBytes(asset.get());
+        framework_->Asset()->ForgetAsset(asset, false);
+        stats_.released++;
+    }
+    forgetting_ = false;
+    requested_.clear();
+
+    LogInfo(LC + QString("Retained assets revalidated: %1 requested (%2) loaded in %3 msecs, %4 used (%5), %6 released (%7), %8 failed")
+        .arg(stats_.requested).arg(FormatMegabytes(stats_.requestedBytes)).arg(stats_.loadMsecs)
+        .arg(stats_.used).arg(FormatMegabytes(stats_.usedBytes)).arg(stats_.released).arg(FormatMegabytes(stats_.releasedBytes)).arg(stats_.failed));
+    emit Revalidated(stats_);
+}
+
+QSet<QString> RocketAssetRetention::SceneReferences(Scene *scene) const
+{
+    QSet<QString> references;
+    if (!scene)
+        return references;
+
+    const Scene::EntityMap &entities = scene->Entities();
+    for(Scene::EntityMap::const_iterator iter = entities.begin(); iter != entities.end(); ++iter)
+    {
+        if (!iter->second.get())
+            continue;
+        const Entity::ComponentMap &components = iter->second->Components();
+        for(Entity::ComponentMap::const_iterator compIter = components.begin(); compIter != components.end(); ++compIter)
+        {
+            if (!compIter->second.get())
+                continue;
+            const AttributeVector &attributes = compIter->second->Attributes();
+            for(size_t i = 0; i < attributes.size(); ++i)
+            {
+                if (!attributes[i] || !IsAssetRefType(attributes[i]->TypeName()))
+                    continue;
+                foreach(const QString &ref, attributes[i]->ToString().split(";", QString::SkipEmptyParts))
+                {
+                    if (!ref.trimmed().isEmpty())
+                        references.insert(framework_->Asset()->ResolveAssetRef("", ref.trimmed()));
+                }
+            }
+        }
+    }
+    return references;
+}
+
+void RocketAssetRetention::SetEnabledCommand(const QString &enabled)
+{
+    const QString value = enabled.trimmed().toLower();
+    SetEnabled(value == "1" || value == "true" || value == "on");
+}
+
+void RocketAssetRetention::PrintStatus()
+{
+    LogInfo(LC + QString("%1, %2 assets retained, %3 of %4 budget")
+        .arg(enabled_ ? "Enabled" : "Disabled").arg(policy_.Size())
+        .arg(FormatMegabytes(policy_.TotalBytes())).arg(FormatMegabytes(policy_.Budget())));
+    LogInfo(LC + QString("Latest connection: %1 requested (%2) loaded in %3 msecs, %4 used (%5), %6 released (%7), %8 failed")
+        .arg(stats_.requested).arg(FormatMegabytes(stats_.requestedBytes)).arg(stats_.loadMsecs)
+        .arg(stats_.used).arg(FormatMegabytes(stats_.usedBytes)).arg(stats_.released).arg(FormatMegabytes(stats_.releasedBytes)).arg(stats_.failed));
+}
+
+// RocketTeleportBenchmark
+
+RocketTeleportBenchmark::RocketTeleportBenchmark(RocketPlugin *plugin, const QUrl &loginUrlA, const QUrl &loginUrlB, int rounds) :
+    plugin_(plugin),
+    LC("[RocketTeleportBenchmark]: "),
+    urlA_(loginUrlA),
+    urlB_(loginUrlB),
+    rounds_(qMax(1, rounds)),
+    retentionWasEnabled_(plugin->AssetRetention() ? plugin->AssetRetention()->IsEnabled() : false),
+    current_(-1),
+    usableMsecs_(-1),
+    requestedAssets_(0),
+    usedAssets_(0),
+    releasedAssets_(0),
+    requestedBytes_(0),
+    releasedBytes_(0)
+{
+    timeout_.setSingleShot(true);
+    connect(&timeout_, SIGNAL(timeout()), SLOT(OnTimeout()));
+}
+
+void RocketTeleportBenchmark::Start()
+{
+    TundraLogic::Client *client = plugin_->GetTundraClient();
+    if (!client || !plugin_->AssetMonitor() || !plugin_->AssetRetention())
+    {
+        Finish("Client, asset monitor or asset retention not available");
+        return;
+    }
+    if (!urlA_.isValid() || !urlB_.isValid())
+    {
+        Finish("Invalid login url");
+        return;
+    }
+
+    connect(plugin_->AssetMonitor(), SIGNAL(WorldUsable(float)), SLOT(OnWorldUsable(float)));
+    connect(plugin_->AssetRetention(), SIGNAL(Revalidated(const RocketAssetRetention::Stats&)), SLOT(OnRevalidated(const RocketAssetRetention::Stats&)));
+    connect(client, SIGNAL(LoginFailed(const QString&)), SLOT(OnLoginFailed(const QString&)));
+
+    // Warm the disk cache, then one unmeasured round per mode so both start from the same state.
+    AddRound(false, false);
+    AddRound(false, false);
+    for(int i = 0; i < rounds_; ++i)
+        AddRound(false, true);
+    AddRound(true, false);
+    for(int i = 0; i < rounds_; ++i)
+        AddRound(true, true);
+
+    LogInfo(LC + QString("Teleporting %1 times between %2 and %3").arg(steps_.size()).arg(urlA_.toString()).arg(urlB_.toString()));
+    current_ = 0;
+    RunStep();
+}
+
+void RocketTeleportBenchmark::AddRound(bool retention, bool measured)
+{
+    Step a = { urlA_, retention, measured };
+    Step b = { urlB_, retention, measured };
+    steps_ << a << b;
+}
+
+void RocketTeleportBenchmark::RunStep()
+{
+    if (current_ >= steps_.size())
+    {
+        Finish();
+        return;
+    }
+
+    const Step &step = steps_[current_];
+    RocketAssetRetention *retention = plugin_->AssetRetention();
+    if (retention->IsEnabled() != step.retention)
+        retention->SetEnabled(step.retention);
+
+    usableMsecs_ = -1;
+    timeout_.start(BenchmarkStepTimeoutMsecs);
+    timer_.start();
+
+    // Same as a teleport: logout forgets all assets, then login to the next world.
+    TundraLogic::Client *client = plugin_->GetTundraClient();
+    if (client->IsConnected())
+        client->DoLogout();
+    client->Login(step.url);
+}
+
+void RocketTeleportBenchmark::OnWorldUsable(float /*msecs*/)
+{
+    if (current_ < 0 || current_ >= steps_.size() || !plugin_->IsConnectedToServer())
+        return;
+    usableMsecs_ = timer_.elapsed();
+    QTimer::singleShot(SettleMsecs, this, SLOT(OnSettle()));
+}
+
+void RocketTeleportBenchmark::OnSettle()
+{
+    if (current_ < 0 || current_ >= steps_.size() || usableMsecs_ < 0)
+        return;
+    // Retained assets finished before the world started loading, wait for the next WorldUsable.
+    if (!plugin_->IsConnectedToServer() || !plugin_->AssetMonitor()->AllTransfersCompleted())
+        return;
+
+    const Step &step = steps_[current_];
+    LogInfo(LC + QString("%1 usable in %2 msecs, retention %3%4").arg(step.url.host() + ":" + QString::number(step.url.port()))
+        .arg(usableMsecs_).arg(step.retention ? "on" : "off").arg(step.measured ? "" : " (warm-up)"));
+    if (step.measured)
+    {
+        if (step.retention)
+            withMsecs_ << usableMsecs_;
+        else
+            withoutMsecs_ << usableMsecs_;
+    }
+
+    timeout_.stop();
+    usableMsecs_ = -1;
+    current_++;
+    RunStep();
+}
+
+void RocketTeleportBenchmark::OnRevalidated(const RocketAssetRetention::Stats &stats)
+{
+    if (current_ >= 0 && current_ < steps_.size() && steps_[current_].measured && steps_[current_].retention)
+    {
+        requestedAssets_ += stats.requested;
+        usedAssets_ += stats.used;
+        releasedAssets_ += stats.released;
+        requestedBytes_ += stats.requestedBytes;
+        releasedBytes_ += stats.releasedBytes;
+        if (stats.loadMsecs >= 0)
+            loadMsecs_ << stats.loadMsecs;
+    }
+}
+
+void RocketTeleportBenchmark::OnLoginFailed(const QString &reason)
+{
+    Finish("Login failed: " + reason);
+}
+
+void RocketTeleportBenchmark::OnTimeout()
+{
+    Finish(QString("World was not usable in %1 seconds").arg(BenchmarkStepTimeoutMsecs / 1000));
+}
+
+void RocketTeleportBenchmark::Finish(const QString &error)
+{
+    timeout_.stop();
+    current_ = -1;
+    if (plugin_->AssetMonitor())
+        disconnect(plugin_->AssetMonitor(), 0, this, 0);
+    if (plugin_->AssetRetention())
+        disconnect(plugin_->AssetRetention(), 0, this, 0);
+    if (plugin_->GetTundraClient())
+        disconnect(plugin_->GetTundraClient(), 0, this, 0);
+    if (plugin_->AssetRetention())
+        plugin_->AssetRetention()->SetEnabled(retentionWasEnabled_);
+
+    QString report;
+    if (error.isEmpty())
+    {
+        const qint64 without = Average(withoutMsecs_);
+        const qint64 with = Average(withMsecs_);
+        report = QString("Time-to-interactive over %1 teleports per mode: without retention %2 msecs, with retention %3 msecs (%4%). "
+            "Retained assets requested %5 (%6) and loaded in %7 msecs on average, used %8, released %9 (%10).")
+            .arg(withoutMsecs_.size()).arg(without).arg(with)
+            .arg(without > 0 ? QString::number(100.0 * (with - without) / without, 'f', 1) : QString("n/a"))
+            .arg(requestedAssets_).arg(FormatMegabytes(requestedBytes_)).arg(Average(loadMsecs_))
+            .arg(usedAssets_).arg(releasedAssets_).arg(FormatMegabytes(releasedBytes_));
+        LogInfo(LC + report);
+    }
+    else
+    {
+        report = error;
+        LogError(LC + report);
+    }
+
+    emit Finished(report);
+    deleteLater();
+}
+
+/// @endcond
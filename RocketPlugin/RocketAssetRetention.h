@@ -0,0 +1,216 @@
+/**
+    @author Adminotech Ltd.
+
+    Copyright Adminotech Ltd.
+    All rights reserved.
+
+    @file   RocketAssetRetention.h
+    @brief  Prefetches recently used world assets when connecting after a disconnect or teleport. */
+
+#pragma once
+
+#include "RocketFwd.h"
+#include "FrameworkFwd.h"
+#include "AssetFwd.h"
+#include "SceneFwd.h"
+
+#include <QObject>
+#include <QString>
+#include <QStringList>
+#include <QHash>
+#include <QSet>
+#include <QList>
+#include <QUrl>
+#include <QElapsedTimer>
+#include <QTimer>
+
+/// @cond PRIVATE
+
+/// Least recently used bookkeeping of retained assets within a memory budget.
+/** Has no framework dependencies. Assets are stamped with the world session they were last used in,
+    eviction removes the oldest sessions first and the largest assets first within a session.
+    The budget bounds the estimated resident size of the assets prefetched on the next connect. */
+class RocketAssetRetentionPolicy
+{
+public:
+    struct Entry
+    {
+        QString ref;
+        QString type;
+        quint64 bytes;      ///< Resident memory estimate.
+        uint lastUsed;      ///< Session stamp.
+
+        Entry() : bytes(0), lastUsed(0) {}
+    };
+
+    explicit RocketAssetRetentionPolicy(quint64 budgetBytes = 0);
+
+    /// Sets the budget, does not evict. Call Evict after changing.
+    void SetBudget(quint64 bytes) { budget_ = bytes; }
+    quint64 Budget() const { return budget_; }
+
+    /// Records @c ref as used in session @c stamp.
+    void Touch(const QString &ref, const QString &type, quint64 bytes, uint stamp);
+
+    void Remove(const QString &ref);
+    void Clear();
+
+    bool Contains(const QString &ref) const { return entries_.contains(ref); }
+    int Size() const { return entries_.size(); }
+    quint64 TotalBytes() const { return total_; }
+
+    /// Evicts least recently used entries until the total fits the budget.
+    /** @return Evicted refs. */
+    QStringList Evict();
+
+    /// Returns the entries most recently used first.
+    QList<Entry> MostRecentFirst() const;
+
+private:
+    QHash<QString, Entry> entries_;
+    quint64 budget_;
+    quint64 total_;
+};
+
+/// Prefetches recently used world assets when connecting after a disconnect or teleport.
+/** TundraLogic::Client forgets and unloads every asset on logout, which cannot be prevented from here.
+    Loaded web assets are recorded as they are forgotten and ranked with RocketAssetRetentionPolicy within
+    the "assetretentionbudget" config value in megabytes. When the next connection starts the retained
+    assets are requested again from the disk cache, most recently used first, so loading overlaps the login
+    and scene replication instead of waiting for the entities that reference them. Once the new world is usable
+    the retained assets are revalidated against its references: assets that nothing references or depends on
+    are forgotten, the rest stay loaded. Stats and RocketTeleportBenchmark report what the prefetch cost and
+    how much of it the new world used. --rocketNoAssetRetention disables retention. */
+class RocketAssetRetention : public QObject
+{
+    Q_OBJECT
+
+public:
+    struct Stats
+    {
+        uint requested;     ///< Retained assets requested on connect.
+        uint used;          ///< Requested assets referenced by the new world.
+        uint released;      ///< Requested assets forgotten as unused.
+        uint failed;        ///< Requested assets that failed to load.
+        quint64 requestedBytes;
+        quint64 usedBytes;
+        quint64 releasedBytes;
+        qint64 loadMsecs;   ///< Time from connect until the last requested asset finished loading, -1 if none were requested.
+
+        Stats() : requested(0), used(0), released(0), failed(0), requestedBytes(0), usedBytes(0), releasedBytes(0), loadMsecs(-1) {}
+    };
+
+    explicit RocketAssetRetention(RocketPlugin *plugin);
+    ~RocketAssetRetention();
+
+    void SetEnabled(bool enabled);
+    bool IsEnabled() const { return enabled_; }
+
+    /// Forgets all retained bookkeeping, loaded assets are not touched.
+    void Clear();
+
+    const RocketAssetRetentionPolicy &Policy() const { return policy_; }
+
+    /// Statistics of the latest connection.
+    const Stats &LastStats() const { return stats_; }
+
+    /// Returns estimated resident bytes of @c asset.
+    static quint64 ResidentBytes(IAsset *asset);
+
+signals:
+    /// Emitted when the retained assets have been revalidated against a new world.
+    void Revalidated(const RocketAssetRetention::Stats &stats);
+
+private slots:
+    void OnAboutToConnect();
+    void OnDisconnected();
+    void OnAssetAboutToBeRemoved(AssetPtr asset);
+    void OnWorldUsable(float msecs);
+    void OnSettle();
+    void OnTransferSucceeded(AssetPtr asset);
+    void OnTransferFailed(IAssetTransfer *transfer, QString reason);
+
+    /// Console commands.
+    void SetEnabledCommand(const QString &enabled);
+    void PrintStatus();
+
+private:
+    void RequestNext();
+    void Revalidate();
+    QSet<QString> SceneReferences(Scene *scene) const;
+
+    RocketPlugin *plugin_;
+    Framework *framework_;
+    const QString LC;
+
+    RocketAssetRetentionPolicy policy_;
+    bool enabled_;
+    bool forgetting_;           ///< Revalidation is forgetting assets, do not record them.
+    bool connecting_;           ///< Between AboutToConnect and revalidation.
+    uint session_;
+
+    QList<RocketAssetRetentionPolicy::Entry> queue_;
+    QHash<IAssetTransfer*, QString> pending_;
+    QSet<QString> requested_;
+    QElapsedTimer loadTimer_;
+    Stats stats_;
+};
+
+/// Teleports between two worlds and compares time-to-interactive with and without RocketAssetRetention.
+/** Meant to be run against two local test servers. Each world is loaded once to warm the disk cache, then
+    @c rounds round trips are measured with retention disabled and enabled. Time-to-interactive is measured
+    from the login until RocketAssetMonitor::WorldUsable. Logs the report and deletes itself after Finished has been emitted. */
+class RocketTeleportBenchmark : public QObject
+{
+    Q_OBJECT
+
+public:
+    RocketTeleportBenchmark(RocketPlugin *plugin, const QUrl &loginUrlA, const QUrl &loginUrlB, int rounds);
+
+    void Start();
+
+signals:
+    void Finished(const QString &report);
+
+private slots:
+    void OnWorldUsable(float msecs);
+    void OnSettle();
+    void OnRevalidated(const RocketAssetRetention::Stats &stats);
+    void OnLoginFailed(const QString &reason);
+    void OnTimeout();
+
+private:
+    struct Step
+    {
+        QUrl url;
+        bool retention;
+        bool measured;
+    };
+
+    void AddRound(bool retention, bool measured);
+    void RunStep();
+    void Finish(const QString &error = QString());
+
+    RocketPlugin *plugin_;
+    const QString LC;
+    QUrl urlA_;
+    QUrl urlB_;
+    int rounds_;
+    bool retentionWasEnabled_;
+
+    QList<Step> steps_;
+    int current_;
+    QElapsedTimer timer_;
+    QTimer timeout_;
+    qint64 usableMsecs_;
+    QList<qint64> withoutMsecs_;
+    QList<qint64> withMsecs_;
+    uint requestedAssets_;
+    uint usedAssets_;
+    uint releasedAssets_;
+    quint64 requestedBytes_;
+    quint64 releasedBytes_;
+    QList<qint64> loadMsecs_;
+};
+
+/// @endcond
@@ -16,6 +16,8 @@
 #include <QString>
 #include <QMetaType>
 
+#include "CoreTypes.h"
+
 /** @defgroup MeshmoonRocket Meshmoon Rocket
     Meshmoon Rocket classes and functionality.
 */
@@ -26,6 +28,7 @@
 class RocketPlugin;
 class RocketNetworking;
 class RocketAssetMonitor;
+class RocketAssetRetention;
 class RocketTaskbar;
 class RocketAuthObject;
 class RocketUpdater;
@@ -42,7 +45,11 @@ class RocketBlockPlacer;
 class RocketComponentConfigurationDialog;
 class RocketScenePackager;
 class RocketZipWorker;
+class RocketTextureDecoder;
+class RocketTextureDecodeWorker;
 class RocketOcclusionManager;
+class RocketInstancingManager;
+class RocketQualityGovernor;
 class RocketReporter;
 class RocketNotifications;
 class RocketFileSystem;
@@ -60,17 +67,26 @@ struct MeshmoonStorageItem;
 class MeshmoonAssetLibrary;
 class MeshmoonAsset;
 class MeshmoonAssetSelectionDialog;
+class MeshmoonAssetSearchIndex;
+class MeshmoonAssetListModel;
+class MeshmoonAssetPreviewLoader;
 
 // Storage
 class MeshmoonStorage;
 class MeshmoonStorageAuthenticationMonitor;
 class MeshmoonStorageOperationMonitor;
+class MeshmoonStorageBatchOperation;
+class MeshmoonStorageBatchDelete;
+class MeshmoonStorageCopyQueue;
+class MeshmoonStorageBatchBenchmark;
+struct MeshmoonS3Endpoint;
 class MeshmoonStorageItemWidget;
 class RocketStorageSelectionDialog;
 class RocketStorageInfoDialog;
 class RocketStorageFileDialog;
 class RocketStorageAuthDialog;
 class RocketStorageSceneImporter;
+class RocketStorageImportAnalyzer;
 
 // Asset editors
 class IRocketAssetEditor;
@@ -133,3 +149,4 @@ typedef QList<RocketPromotionWidget*> PromotedWidgetList;
 typedef QPair<QString, QString> MeshmoonLibrarySource; ///< Meshmoon library source. Maps name to library source url.
 Q_DECLARE_METATYPE(MeshmoonLibrarySource)
 typedef QList<MeshmoonLibrarySource > MeshmoonLibrarySourceList; ///< Meshmoon library source list.
+typedef QHash<QString, entity_id_t> ImportEntityIdMap; ///< Imported scene file entity id to the existing scene entity it was matched to.
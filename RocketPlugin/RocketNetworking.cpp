@@ -12,6 +12,8 @@
 #include "RocketNetworking.h"
 #include "RocketPlugin.h"
 #include "common/MeshmoonCommon.h"
+#include "common/MeshmoonAssetReloader.h"
+#include "MeshmoonCommonPlugin.h"
 
 #include "Framework.h"
 #include "LoggingFunctions.h"
@@ -34,10 +36,24 @@ RocketNetworking::~RocketNetworking()
 
 void RocketNetworking::SendAssetReloadMsg(const QString &assetReference)
 {
+    SendAssetReloadMsg(QStringList() << assetReference);
 }
 
 void RocketNetworking::SendAssetReloadMsg(const QStringList &assetReferences)
 {
+    Meshmoon::Network::AssetReloadEntryList assets;
+    foreach(const QString &assetReference, assetReferences)
+        assets.push_back(Meshmoon::Network::AssetReloadEntry(assetReference));
+    SendAssetReloadMsg(assets);
+}
+
+void RocketNetworking::SendAssetReloadMsg(const Meshmoon::Network::AssetReloadEntryList &assets)
+{
+    MeshmoonCommonPlugin *common = plugin_->GetFramework()->Module<MeshmoonCommonPlugin>();
+    if (common && common->AssetReloader())
+        common->AssetReloader()->RequestReload(assets);
+    else
+        LogError(LC + "SendAssetReloadMsg: MeshmoonCommonPlugin not available.");
 }
 
 void RocketNetworking::SendLayerUpdateMsg(u32 layerId, bool visible)
@@ -12,6 +12,7 @@
 #include "RocketFwd.h"
 #include "FrameworkFwd.h"
 #include "TundraProtocolModuleFwd.h"
+#include "common/MeshmoonCommon.h"
 
 #include <QObject>
 #include <QString>
@@ -31,6 +32,10 @@ public slots:
     /// Server and clients will force re-request them from the original source.
     void SendAssetReloadMsg(const QString &assetReference);
     void SendAssetReloadMsg(const QStringList &assetReferences);
+
+    /// Send assets with the content hash and size of their new source data.
+    /// Server and clients skip the assets their cached copy already matches.
+    void SendAssetReloadMsg(const Meshmoon::Network::AssetReloadEntryList &assets);
     
     /// Send a layer visibility request to the server.
     void SendLayerUpdateMsg(u32 layerId, bool visible);
@@ -25,6 +25,7 @@
 #include "RocketAvatarEditor.h"
 #include "RocketSounds.h"
 #include "RocketAssetMonitor.h"
+#include "RocketAssetRetention.h"
 #include "RocketSettings.h"
 #include "RocketReporter.h"
 #include "RocketNotifications.h"
@@ -35,10 +36,16 @@
 #include "cave/RocketCaveManager.h"
 #include "updater/RocketUpdater.h"
 #include "storage/MeshmoonStorage.h"
+#include "storage/MeshmoonStorageBatch.h"
 #include "occlusion/RocketOcclusionManager.h"
 #include "oculus/RocketOculusManager.h"
 #include "utils/RocketFileSystem.h"
 #include "rendering/RocketGPUProgramGenerator.h"
+#include "rendering/RocketInstancingManager.h"
+#include "rendering/RocketQualityGovernor.h"
+#include "utils/RocketTextureDecoder.h"
+#include "editors/RocketParticleProfiler.h"
+#include "editors/RocketSyntaxHighlighters.h"
 
 #include "common/script/MeshmoonScriptTypeDefines.h"
 #include "RocketScriptTypeDefines.h"
@@ -69,6 +76,7 @@
 #include "EC_MeshmoonTeleport.h"
 #include "InputAPI.h"
 #include "ConsoleAPI.h"
+#include "ConfigAPI.h"
 #include "Math/float3.h"
 #include "Renderer.h"
 #include "OgreRenderingModule.h"
@@ -115,6 +123,7 @@ RocketPlugin::RocketPlugin() :
     sounds_(0),
     settings_(0),
     assetMonitor_(0),
+    assetRetention_(0),
     updater_(0),
     storage_(0),
     networking_(0),
@@ -125,15 +134,20 @@ RocketPlugin::RocketPlugin() :
     reporter_(0),
     notifications_(0),
     occlusionManager_(0),
+    instancingManager_(0),
+    qualityGovernor_(0),
+    textureDecodeWorker_(0),
     oculusManager_(0),
     fileSystem_(0),
     currentView_(MainView)
 {
     // Register custom types
     qRegisterMetaType<MeshmoonLibrarySource>("MeshmoonLibrarySource");
+    qRegisterMetaType<MeshmoonAsset*>("MeshmoonAsset*");
     qRegisterMetaType<Meshmoon::SceneLayer>("Meshmoon::SceneLayer");
     qRegisterMetaType<QList<Meshmoon::SceneLayer> >("QList<Meshmoon::SceneLayer>"); /// @todo Remove once all script facing stuff is using Meshmoon::SceneLayerList?
     qRegisterMetaType<Meshmoon::SceneLayerList >("Meshmoon::SceneLayerList");
+    qRegisterMetaType<RocketCloneArray>("RocketCloneArray");
 }
 
 RocketPlugin::~RocketPlugin()
@@ -196,14 +210,36 @@ void RocketPlugin::Initialize()
     avatarEditor_   = new RocketAvatarEditor(this);
     layersWidget_   = new RocketLayersWidget(this);
     assetMonitor_   = new RocketAssetMonitor(this);
+    assetRetention_ = new RocketAssetRetention(this);
     buildEditor_    = new RocketBuildEditor(this);
     caveManager_    = new RocketCaveManager(this);
     updater_        = new RocketUpdater(this);
     fileSystem_     = new RocketFileSystem(this);
     
     occlusionManager_ = new RocketOcclusionManager(this);
+    instancingManager_ = new RocketInstancingManager(this);
+    qualityGovernor_  = new RocketQualityGovernor(this);
     oculusManager_    = new RocketOculusManager(this);
 
+    if (!framework_->IsHeadless() && framework_->HasCommandLineParameter("--rocketDevCommands"))
+        framework_->Console()->RegisterCommand("benchmarkSyntaxHighlighting", "Highlights a script or material file with and without compiled highlight rules and prints timings. Usage: benchmarkSyntaxHighlighting(filePath)",
+            this, SLOT(BenchmarkSyntaxHighlighting(const QString &)));
+    framework_->Console()->RegisterCommand("profileParticles", "Simulates every template in ';' separated particle asset refs without rendering and ranks them by cost. "
+        "sortBy is fill, update or particles. Usage: profileParticles(particleRefs,sortBy=fill)",
+        this, SLOT(ProfileParticles(const QString &, const QString &)), SLOT(ProfileParticles(const QString &)));
+    if (framework_->HasCommandLineParameter("--rocketDevCommands"))
+    {
+        framework_->Console()->RegisterCommand("benchmarkTextureDecoding", "Decodes all DDS and CRN textures in a directory and prints decode speed per format. Usage: benchmarkTextureDecoding(directory)",
+            this, SLOT(BenchmarkTextureDecoding(const QString &)));
+        framework_->Console()->RegisterCommand("benchmarkStorageBatch", "Uploads test objects to a S3 compatible endpoint and compares per-object delete requests to multi-object delete. "
+            "Credentials are read from the MESHMOON_S3_ACCESS_KEY and MESHMOON_S3_SECRET_KEY environment variables or the storagebenchmarkaccesskey "
+            "and storagebenchmarksecretkey config values. Usage: benchmarkStorageBatch(endpointUrl,bucket,count=2000)",
+            this, SLOT(BenchmarkStorageBatch(const QString &, const QString &, const QString &)), SLOT(BenchmarkStorageBatch(const QString &, const QString &)));
+        framework_->Console()->RegisterCommand("benchmarkTeleport", "Teleports between two worlds and compares time-to-interactive with and without asset retention. "
+            "Usage: benchmarkTeleport(loginUrlA,loginUrlB,rounds=3)",
+            this, SLOT(BenchmarkTeleport(const QString &, const QString &, const QString &)), SLOT(BenchmarkTeleport(const QString &, const QString &)));
+    }
+
     // Portal widget
     connect(lobby_, SIGNAL(LogoutRequest()), backend_, SLOT(Unauthenticate()));
     connect(lobby_, SIGNAL(LogoutRequest()), storage_, SLOT(Unauthenticate()));
@@ -549,6 +585,7 @@ void RocketPlugin::Uninitialize()
     SAFE_DELETE(lobby_);
     SAFE_DELETE(offlineLobby_);
     SAFE_DELETE(backend_);
+    SAFE_DELETE(assetRetention_);
     SAFE_DELETE(assetMonitor_);
     SAFE_DELETE(updater_);
     SAFE_DELETE(menu_);
@@ -563,7 +600,12 @@ void RocketPlugin::Uninitialize()
     SAFE_DELETE(library_);
     SAFE_DELETE(fileSystem_);
     SAFE_DELETE(occlusionManager_);
+    SAFE_DELETE(instancingManager_);
+    SAFE_DELETE(qualityGovernor_);
     SAFE_DELETE(oculusManager_);
+    if (textureDecodeWorker_)
+        textureDecodeWorker_->Stop();
+    SAFE_DELETE(textureDecodeWorker_);
 }
 
 // Public slots
@@ -729,6 +771,122 @@ RocketSettings *RocketPlugin::Settings() const
     return settings_;
 }
 
+void RocketPlugin::BenchmarkSyntaxHighlighting(const QString &filePath)
+{
+    IRocketSyntaxHighlighter::Benchmark(filePath.trimmed());
+}
+
+void RocketPlugin::BenchmarkTextureDecoding(const QString &directory)
+{
+    RocketTextureDecoder::Benchmark(directory.trimmed());
+}
+
+void RocketPlugin::BenchmarkStorageBatch(const QString &endpointUrl, const QString &bucket)
+{
+    BenchmarkStorageBatch(endpointUrl, bucket, "2000");
+}
+
+void RocketPlugin::BenchmarkStorageBatch(const QString &endpointUrl, const QString &bucket, const QString &count)
+{
+    MeshmoonS3Endpoint endpoint;
+    endpoint.url = QUrl(endpointUrl.trimmed());
+    endpoint.bucket = bucket.trimmed();
+    // Keep secrets out of the console history and logs.
+    endpoint.accessKey = QString::fromUtf8(qgetenv("MESHMOON_S3_ACCESS_KEY")).trimmed();
+    endpoint.secretKey = QString::fromUtf8(qgetenv("MESHMOON_S3_SECRET_KEY")).trimmed();
+    if (endpoint.accessKey.isEmpty())
+        endpoint.accessKey = framework_->Config()->Read("adminotech", "clientplugin", "storagebenchmarkaccesskey", "").toString().trimmed();
+    if (endpoint.secretKey.isEmpty())
+        endpoint.secretKey = framework_->Config()->Read("adminotech", "clientplugin", "storagebenchmarksecretkey", "").toString().trimmed();
+    if (endpoint.accessKey.isEmpty() || endpoint.secretKey.isEmpty())
+    {
+        LogError(LC + "benchmarkStorageBatch credentials not found, set MESHMOON_S3_ACCESS_KEY and MESHMOON_S3_SECRET_KEY environment variables");
+        return;
+    }
+
+    bool ok = false;
+    int objects = count.trimmed().toInt(&ok);
+    if (!ok || objects <= 0)
+    {
+        LogError(LC + "benchmarkStorageBatch count must be a positive number: " + count);
+        return;
+    }
+
+    // Results are logged when done, the benchmark deletes itself.
+    MeshmoonStorageBatchBenchmark *benchmark = new MeshmoonStorageBatchBenchmark(endpoint, objects);
+    benchmark->Start();
+}
+
+void RocketPlugin::BenchmarkTeleport(const QString &loginUrlA, const QString &loginUrlB)
+{
+    BenchmarkTeleport(loginUrlA, loginUrlB, "3");
+}
+
+void RocketPlugin::BenchmarkTeleport(const QString &loginUrlA, const QString &loginUrlB, const QString &rounds)
+{
+    bool ok = false;
+    int count = rounds.trimmed().toInt(&ok);
+    if (!ok || count <= 0)
+    {
+        LogError(LC + "benchmarkTeleport rounds must be a positive number: " + rounds);
+        return;
+    }
+
+    // Results are logged when done, the benchmark deletes itself.
+    RocketTeleportBenchmark *benchmark = new RocketTeleportBenchmark(this, QUrl(loginUrlA.trimmed()), QUrl(loginUrlB.trimmed()), count);
+    benchmark->Start();
+}
+
+void RocketPlugin::ProfileParticles(const QString &particleRefs)
+{
+    ProfileParticles(particleRefs, "fill");
+}
+
+void RocketPlugin::ProfileParticles(const QString &particleRefs, const QString &sortBy)
+{
+    QStringList refs;
+    foreach(const QString &ref, particleRefs.split(";", QString::SkipEmptyParts))
+        if (!ref.trimmed().isEmpty())
+            refs << ref.trimmed();
+    if (refs.isEmpty())
+    {
+        LogError(LC + "profileParticles requires at least one particle asset reference");
+        return;
+    }
+
+    const QString order = sortBy.trimmed().toLower();
+    RocketParticleProfiler::SortOrder sortOrder = RocketParticleProfiler::SortByFill;
+    if (order == "update")
+        sortOrder = RocketParticleProfiler::SortByUpdateTime;
+    else if (order == "particles")
+        sortOrder = RocketParticleProfiler::SortByParticles;
+
+    // Results are logged when all assets have loaded, the batch deletes itself.
+    RocketParticleProfileBatch *batch = new RocketParticleProfileBatch(framework_, refs, RocketParticleProfiler::Settings(), sortOrder);
+    batch->Start();
+}
+
+RocketInstancingManager *RocketPlugin::InstancingManager() const
+{
+    return instancingManager_;
+}
+
+RocketQualityGovernor *RocketPlugin::QualityGovernor() const
+{
+    return qualityGovernor_;
+}
+
+RocketTextureDecodeWorker *RocketPlugin::TextureDecodeWorker()
+{
+    // Started on first use, most sessions never open a texture preview.
+    if (!textureDecodeWorker_ && !framework_->IsHeadless())
+    {
+        textureDecodeWorker_ = new RocketTextureDecodeWorker();
+        textureDecodeWorker_->start(QThread::LowPriority);
+    }
+    return textureDecodeWorker_;
+}
+
 MeshmoonAssetLibrary *RocketPlugin::AssetLibrary() const
 {
     return library_;
@@ -744,6 +902,11 @@ RocketAssetMonitor *RocketPlugin::AssetMonitor() const
     return assetMonitor_;
 }
 
+RocketAssetRetention *RocketPlugin::AssetRetention() const
+{
+    return assetRetention_;
+}
+
 RocketFileSystem *RocketPlugin::FileSystem() const
 {
     return fileSystem_;
@@ -84,6 +84,19 @@ public:
     /// Rocket settings.
     RocketSettings *Settings() const;
 
+    /// Automatic static mesh instancing.
+    RocketInstancingManager *InstancingManager() const;
+
+    /// Runtime rendering quality governor.
+    RocketQualityGovernor *QualityGovernor() const;
+
+    /// Keeps recently used assets warm across disconnects and teleports.
+    RocketAssetRetention *AssetRetention() const;
+
+    /// Background DDS and CRN texture decoding for editors and previews.
+    /** The worker thread is started on the first call. Returns null in headless mode. */
+    RocketTextureDecodeWorker *TextureDecodeWorker();
+
     /// Ogre resource group for Meshmoon assets.
     static const std::string MESHMOON_RESOURCE_GROUP;
 
@@ -232,6 +245,24 @@ private slots:
     /// @todo Remove this once clean co-op with Renderer has been implemented.
     void RenderingCreateInstancingShaders();
 
+    // Console command for IRocketSyntaxHighlighter::Benchmark.
+    void BenchmarkSyntaxHighlighting(const QString &filePath);
+
+    // Console command for RocketTextureDecoder::Benchmark.
+    void BenchmarkTextureDecoding(const QString &directory);
+
+    // Console command for MeshmoonStorageBatchBenchmark. Credentials are read from the environment or config, never from the console.
+    void BenchmarkStorageBatch(const QString &endpointUrl, const QString &bucket, const QString &count);
+    void BenchmarkStorageBatch(const QString &endpointUrl, const QString &bucket);
+
+    // Console command for RocketTeleportBenchmark.
+    void BenchmarkTeleport(const QString &loginUrlA, const QString &loginUrlB, const QString &rounds);
+    void BenchmarkTeleport(const QString &loginUrlA, const QString &loginUrlB);
+
+    // Console command for RocketParticleProfileBatch.
+    void ProfileParticles(const QString &particleRefs, const QString &sortBy);
+    void ProfileParticles(const QString &particleRefs);
+
     // Meshmoon backend API response.
     void OnBackendResponse(const QUrl &url, const QByteArray &data, int httpStatusCode, const QString &error);
 
@@ -382,9 +413,13 @@ private:
     RocketBuildEditor *buildEditor_;
     RocketAvatarEditor *avatarEditor_;
     RocketAssetMonitor *assetMonitor_;
+    RocketAssetRetention *assetRetention_;
     RocketLayersWidget *layersWidget_;
     RocketCaveManager *caveManager_;
     RocketOcclusionManager *occlusionManager_;
+    RocketInstancingManager *instancingManager_;
+    RocketQualityGovernor *qualityGovernor_;
+    RocketTextureDecodeWorker *textureDecodeWorker_;
     RocketOculusManager* oculusManager_;
     RocketFileSystem *fileSystem_;
 
@@ -12,6 +12,8 @@
 
 #include "RocketReporter.h"
 #include "RocketPlugin.h"
+#include "rendering/RocketInstancingManager.h"
+#include "rendering/RocketQualityGovernor.h"
 #include "RocketMenu.h"
 #include "RocketNotifications.h"
 #include "RocketSettings.h"
@@ -299,7 +301,10 @@ void RocketReporter::OnUpdate(float frametime)
                 {
                     int numFrames = std::max<int>(processFrameNode->num_called_custom_, 1);
                     float fps = (float)(numFrames * 1000.f / msecsOccurred);
-                    if (fps < 25.0f)
+                    // The quality governor reacts first, only warn once it has nothing left to lower.
+                    RocketQualityGovernor *governor = plugin_->QualityGovernor();
+                    bool governorActive = (governor && governor->IsEnabled() && !governor->IsExhausted());
+                    if (fps < 25.0f && !governorActive)
                     {
                         numFpsLow_++;
                         if (numFpsLow_ >= 60)
@@ -724,6 +729,11 @@ void RocketReporter::DumpOgreSceneComplexity(QTextStream &stream)
            << QString("  %1").arg("# of total triangles rendered last frame ", -45) << triangles << endl
            << QString("  %1").arg("# of avg. triangles per batch ", -45) << triangles / (batches ? batches : 1) << endl
            << endl;
+
+    if (plugin_->InstancingManager())
+        plugin_->InstancingManager()->DumpStatistics(stream);
+    if (plugin_->QualityGovernor())
+        plugin_->QualityGovernor()->DumpStatistics(stream);
     
     uint entities = 0;
     uint prims = 0;
@@ -0,0 +1,98 @@
+/**
+    @author Adminotech Ltd.
+
+    Copyright Adminotech Ltd.
+    All rights reserved.
+
+    @file   RocketAttributeEditCommand.h
+    @brief  Undoable attribute edit whose new value can be updated after being pushed to the undo stack. */
+
+#pragma once
+
+#include "SceneFwd.h"
+#include "IComponent.h"
+#include "IAttribute.h"
+
+#include <QUndoCommand>
+
+/// @cond PRIVATE
+
+/// Base for RocketAttributeEditCommand, allows RocketBuildEditor to track the command without knowing the value type.
+class RocketAttributeEditCommandBase : public QUndoCommand
+{
+public:
+    explicit RocketAttributeEditCommandBase(IAttribute *attribute, QUndoCommand *parent = 0) :
+        QUndoCommand(parent),
+        attributeId_(attribute->Id()),
+        applied_(false),
+        alive_(MAKE_SHARED(bool, true))
+    {
+        if (attribute->Owner())
+            component_ = attribute->Owner()->shared_from_this();
+        setText("Edit " + attribute->Name());
+    }
+
+    /// Returns the edited attribute or null if the component has been removed.
+    IAttribute *EditedAttribute() const
+    {
+        ComponentPtr component = component_.lock();
+        return component ? component->AttributeById(attributeId_) : 0;
+    }
+
+    /// Returns if the new value is currently applied, ie. the command has not been undone.
+    bool IsApplied() const { return applied_; }
+
+    /// Returns a handle that expires when this command is destroyed by the undo stack.
+    weak_ptr<bool> AliveHandle() const { return alive_; }
+
+protected:
+    ComponentWeakPtr component_;
+    QString attributeId_;
+    bool applied_;
+
+private:
+    shared_ptr<bool> alive_;
+};
+
+/// Attribute edit command used by RocketBuildEditor::SetAttribute.
+/** Unlike EditAttributeCommand the new value can be updated with SetNewValue while the command is
+    on top of the undo stack, so continuous edits of the same attribute form a single undo step. */
+template <typename T>
+class RocketAttributeEditCommand : public RocketAttributeEditCommandBase
+{
+public:
+    RocketAttributeEditCommand(Attribute<T> *attribute, const T &newValue, QUndoCommand *parent = 0) :
+        RocketAttributeEditCommandBase(attribute, parent),
+        oldValue_(attribute->Get()),
+        newValue_(newValue)
+    {
+    }
+
+    /// Sets the value applied by redo. Does not apply it.
+    void SetNewValue(const T &value) { newValue_ = value; }
+
+    void undo()
+    {
+        Apply(oldValue_);
+        applied_ = false;
+    }
+
+    void redo()
+    {
+        Apply(newValue_);
+        applied_ = true;
+    }
+
+private:
+    void Apply(const T &value)
+    {
+        Attribute<T> *attribute = dynamic_cast<Attribute<T> *>(EditedAttribute());
+        if (attribute)
+            attribute->Set(value, AttributeChange::Default);
+    }
+
+    T oldValue_;
+    T newValue_;
+};
+
+/// @endcond
@@ -23,9 +23,17 @@
 #include "Framework.h"
 #include "Application.h"
 #include "UiAPI.h"
+#include "UiMainWindow.h"
 #include "Entity.h"
 #include "EC_Name.h"
 
+#include <QDialog>
+#include <QDialogButtonBox>
+#include <QFormLayout>
+#include <QSpinBox>
+#include <QDoubleSpinBox>
+#include <QCheckBox>
+
 #include "MemoryLeakCheck.h"
 
 namespace
@@ -67,6 +75,13 @@ RocketBuildContextWidget::RocketBuildContextWidget(RocketPlugin *plugin) :
     mainWidget.undoLayout->addWidget(undoButton);
     mainWidget.undoLayout->addWidget(redoButton);
 
+    // Clone array, next to delete
+    cloneArrayButton = new QToolButton();
+    cloneArrayButton->setToolTip("Clone selection to an array");
+    cloneArrayButton->setDisabled(true);
+    cloneArrayButton->setIcon(QIcon(":/images/icon-clone-32x32.png"));
+    mainWidget.horizontalLayout->insertWidget(mainWidget.horizontalLayout->indexOf(mainWidget.deleteButton) + 1, cloneArrayButton);
+
     mainWidget.entityNameLineEdit->setPlaceholderText(cNoNameId);
     mainWidget.groupComboBox->lineEdit()->setPlaceholderText(cNoGroupId);
 
@@ -75,6 +90,7 @@ RocketBuildContextWidget::RocketBuildContextWidget(RocketPlugin *plugin) :
     connect(mainWidget.groupComboBox, SIGNAL(currentIndexChanged(int)), SLOT(SetEntityGroup()));
     connect(mainWidget.selectGroupsButton, SIGNAL(toggled(bool)), rocket->BuildEditor(), SLOT(SetSelectGroupsEnabled(bool)));
     connect(mainWidget.deleteButton, SIGNAL(clicked()), rocket->BuildEditor(), SLOT(DeleteSelection()));
+    connect(cloneArrayButton, SIGNAL(clicked()), SLOT(ShowCloneArrayDialog()));
 
     connect(rocket->BuildEditor(), SIGNAL(SelectionChanged(const EntityList &)), SLOT(Refresh(const EntityList &)));
 
@@ -88,6 +104,7 @@ RocketBuildContextWidget::RocketBuildContextWidget(RocketPlugin *plugin) :
 RocketBuildContextWidget::~RocketBuildContextWidget()
 {
     Fw()->Ui()->GraphicsScene()->removeItem(this);
+    SAFE_DELETE(cloneArrayButton);
     SAFE_DELETE(redoButton);
     SAFE_DELETE(undoButton);
 }
@@ -144,6 +161,7 @@ void RocketBuildContextWidget::Refresh(const EntityList &selection)
     // Group possible to edit if one or more entities selected.
     // Setting a new group for a mixed group will show a confirmation dialog later on.
     mainWidget.groupComboBox->setEnabled(!selection.empty());
+    cloneArrayButton->setEnabled(!selection.empty());
 
     const QStringList groupNames = FindUniqueGroupNames(selection);
     if (groupNames.size() == 1)
@@ -325,3 +343,62 @@ void RocketBuildContextWidget::PopulateGroups()
 
     mainWidget.groupComboBox->blockSignals(false);
 }
+
+void RocketBuildContextWidget::ShowCloneArrayDialog()
+{
+    if (rocket->BuildEditor()->Selection().empty())
+        return;
+
+    QDialog dialog(Fw()->Ui()->MainWindow());
+    dialog.setWindowTitle(tr("Clone Selection to Array"));
+    QFormLayout *form = new QFormLayout(&dialog);
+
+    QSpinBox *counts[3];
+    QDoubleSpinBox *spacings[3];
+    const char *axes[3] = { "X", "Y", "Z" };
+    for(int i = 0; i < 3; ++i)
+    {
+        counts[i] = new QSpinBox(&dialog);
+        counts[i]->setRange(1, 100);
+        counts[i]->setValue(i == 0 ? 2 : 1);
+        counts[i]->setToolTip(tr("Number of copies along the axis, including the original"));
+        form->addRow(tr("Count %1").arg(axes[i]), counts[i]);
+    }
+    QCheckBox *autoSpacing = new QCheckBox(tr("Use selection size"), &dialog);
+    autoSpacing->setChecked(true);
+    form->addRow(tr("Spacing"), autoSpacing);
+    for(int i = 0; i < 3; ++i)
+    {
+        spacings[i] = new QDoubleSpinBox(&dialog);
+        spacings[i]->setRange(-10000.0, 10000.0);
+        spacings[i]->setDecimals(3);
+        spacings[i]->setValue(1.0);
+        spacings[i]->setEnabled(false);
+        connect(autoSpacing, SIGNAL(toggled(bool)), spacings[i], SLOT(setDisabled(bool)));
+        form->addRow(tr("Spacing %1").arg(axes[i]), spacings[i]);
+    }
+    QCheckBox *clonePhysics = new QCheckBox(tr("Clone physics"), &dialog);
+    clonePhysics->setChecked(true);
+    form->addRow(clonePhysics);
+    QCheckBox *cloneFunctionality = new QCheckBox(tr("Clone functionality"), &dialog);
+    cloneFunctionality->setChecked(true);
+    form->addRow(cloneFunctionality);
+
+    QDialogButtonBox *buttons = new QDialogButtonBox(QDialogButtonBox::Ok | QDialogButtonBox::Cancel, Qt::Horizontal, &dialog);
+    connect(buttons, SIGNAL(accepted()), &dialog, SLOT(accept()));
+    connect(buttons, SIGNAL(rejected()), &dialog, SLOT(reject()));
+    form->addRow(buttons);
+
+    if (dialog.exec() != QDialog::Accepted)
+        return;
+
+    RocketCloneArray array;
+    array.countX = static_cast<uint>(counts[0]->value());
+    array.countY = static_cast<uint>(counts[1]->value());
+    array.countZ = static_cast<uint>(counts[2]->value());
+    array.autoSpacing = autoSpacing->isChecked();
+    array.spacing = float3(static_cast<float>(spacings[0]->value()), static_cast<float>(spacings[1]->value()), static_cast<float>(spacings[2]->value()));
+    array.clonePhysics = clonePhysics->isChecked();
+    array.cloneFunctionality = cloneFunctionality->isChecked();
+    rocket->BuildEditor()->CloneSelection(array);
+}
@@ -29,6 +29,7 @@ public:
 
     QToolButton *undoButton;
     QToolButton *redoButton;
+    QToolButton *cloneArrayButton;
 
     Ui::RocketBuildContextWidget mainWidget;
     /// @endcond
@@ -60,5 +61,7 @@ private slots:
     /// Listens to external changes of the Name component of the edited entity.
     void UpdateEntityName(IAttribute *);
     void PopulateGroups();
+    /// Asks the array dimensions and clones the selection with RocketBuildEditor::CloneSelection.
+    void ShowCloneArrayDialog();
 };
 Q_DECLARE_METATYPE(RocketBuildContextWidget*)
@@ -53,6 +53,9 @@
 #include "TransformEditor.h"
 #include "IAttribute.h"
 #include "UndoCommands.h"
+#include "ConsoleAPI.h"
+#include "RocketCloneEntitiesCommand.h"
+#include "Geometry/AABB.h"
 
 #include "EC_Placeable.h"
 #include "EC_Mesh.h"
@@ -63,6 +66,10 @@
 
 #include <OgreMesh.h>
 
+#include <QTimer>
+#include <QDomDocument>
+#include <kNet/PolledTimer.h>
+
 #include "MemoryLeakCheck.h"
 
 int StringToRigidBodyShapeType(const QString &str)
@@ -106,8 +113,28 @@ RocketBuildEditor::RocketBuildEditor(RocketPlugin *plugin) :
     undoManager(0),
     blockPlacer(0),
     originalTm(float3x4::nan),
-    selectGroups(false)
+    selectGroups(false),
+    editSessionTimer(0),
+    editReplicationRate(10.f),
+    editSessionTimeoutMsecs(750),
+    editCheckTimer(0)
 {
+    editClock.start();
+    editSessionTimer = new QTimer(this);
+    connect(editSessionTimer, SIGNAL(timeout()), SLOT(OnEditSessionTimer()));
+    editCheckTimer = new QTimer(this);
+    connect(editCheckTimer, SIGNAL(timeout()), SLOT(OnEditSessionCheckStep()));
+
+    if (framework->HasCommandLineParameter("--rocketDevCommands"))
+    {
+        framework->Console()->RegisterCommand("benchmarkCloneSelection", "Clones the build mode selection per block and batched, prints timings and undoes the clones. Usage: benchmarkCloneSelection(copies=10)",
+            this, SLOT(BenchmarkCloneSelection(QString)), SLOT(BenchmarkCloneSelection()));
+        framework->Console()->RegisterCommand("checkEditSession", "Drags the first selected build mode entity with transform edits and checks that they form one undo command and are rate limited when replicated. Usage: checkEditSession(edits=60)",
+            this, SLOT(CheckEditSession(QString)), SLOT(CheckEditSession()));
+        framework->Console()->RegisterCommand("benchmarkLightRemoval", "Adds and removes local lights with immediate and coalesced build mode refreshes, prints the number of refreshes and timings of both. Usage: benchmarkLightRemoval(count=50)",
+            this, SLOT(BenchmarkLightRemoval(QString)), SLOT(BenchmarkLightRemoval()));
+    }
+
     connect(rocket->Backend(), SIGNAL(AuthReset()), SLOT(OnAuthReset()));
     connect(framework->Module<OgreRenderingModule>()->Renderer().get(), SIGNAL(MainCameraChanged(Entity *)),
         SLOT(OnActiveCameraChanged(Entity *)));
@@ -128,6 +155,7 @@ RocketBuildEditor::RocketBuildEditor(RocketPlugin *plugin) :
 
 RocketBuildEditor::~RocketBuildEditor()
 {
+    EndEditSession();
 //    SAFE_DELETE(contextWidget);
     SAFE_DELETE(buildWidget);
     SAFE_DELETE(undoManager);
@@ -182,10 +210,7 @@ void RocketBuildEditor::SetSelection(const EntityList &entities)
 {
     EntityList oldSelection = Selection();
 
-    activeSelection.clear();
-
-    foreach(const EntityPtr &e, entities)
-        AppendSelectionInternal(e);
+    activeSelection = ExpandGroups(entities);
 
     if (oldSelection != Selection())
         emit SelectionChanged(Selection());
@@ -207,8 +232,8 @@ void RocketBuildEditor::AppendSelection(const EntityList &entities)
 {
     EntityList oldSelection = Selection();
 
-    foreach(const EntityPtr &e, entities)
-        AppendSelectionInternal(e);
+    const std::set<EntityPtr> expanded = ExpandGroups(entities);
+    activeSelection.insert(expanded.begin(), expanded.end());
 
     if (oldSelection != Selection())
         emit SelectionChanged(Selection());
@@ -220,8 +245,15 @@ void RocketBuildEditor::RemoveFromSelection(const EntityList &entities)
 {
     EntityList oldSelection = Selection();
 
-    foreach(const EntityPtr e, entities)
-        RemoveFromSelectionInternal(e);
+    // Only entities that are selected expand to their groups.
+    EntityList selected;
+    foreach(const EntityPtr &e, entities)
+        if (activeSelection.find(e) != activeSelection.end())
+            selected.push_back(e);
+
+    const std::set<EntityPtr> expanded = ExpandGroups(selected);
+    for(std::set<EntityPtr>::const_iterator it = expanded.begin(); it != expanded.end(); ++it)
+        activeSelection.erase(*it);
 
     emit SelectionChanged(Selection());
     CheckForGroupChange(oldSelection);
@@ -238,6 +270,130 @@ void RocketBuildEditor::RemoveFromSelection(const EntityPtr &entity)
     }
 }
 
+void RocketBuildEditor::SelectGroup(const QString &groupName)
+{
+    SetSelection(EntitiesOfGroup(groupName));
+}
+
+void RocketBuildEditor::AppendGroupToSelection(const QString &groupName)
+{
+    AppendSelection(EntitiesOfGroup(groupName));
+}
+
+EntityList RocketBuildEditor::EntitiesOfGroup(const QString &groupName) const
+{
+    EntityList entities;
+    ScenePtr scene = Scene();
+    if (!scene || groupName.isEmpty())
+        return entities;
+
+    QHash<QString, QSet<entity_id_t> >::const_iterator group = groupIndex.find(groupName);
+    if (group == groupIndex.end())
+        return entities;
+
+    foreach(entity_id_t id, group.value())
+    {
+        EntityPtr entity = scene->EntityById(id);
+        if (entity)
+            entities.push_back(entity);
+    }
+    return entities;
+}
+
+std::set<EntityPtr> RocketBuildEditor::ExpandGroups(const EntityList &entities) const
+{
+    std::set<EntityPtr> expanded;
+    QSet<QString> expandedGroups;
+    foreach(const EntityPtr &e, entities)
+    {
+        if (!e)
+            continue;
+        expanded.insert(e);
+        if (!selectGroups)
+            continue;
+
+        const QString groupName = e->Group();
+        if (groupName.isEmpty() || expandedGroups.contains(groupName))
+            continue;
+        expandedGroups.insert(groupName);
+
+        const EntityList group = EntitiesOfGroup(groupName);
+        expanded.insert(group.begin(), group.end());
+    }
+    return expanded;
+}
+
+void RocketBuildEditor::RebuildGroupIndex()
+{
+    groupIndex.clear();
+    entityGroups.clear();
+
+    ScenePtr scene = Scene();
+    if (!scene)
+        return;
+
+    for(Scene::EntityMap::const_iterator it = scene->begin(); it != scene->end(); ++it)
+        IndexEntityGroup(it->second.get());
+}
+
+void RocketBuildEditor::IndexEntityGroup(Entity *entity)
+{
+    if (!entity)
+        return;
+
+    const entity_id_t id = entity->Id();
+    const QString groupName = entity->Group();
+
+    QHash<entity_id_t, QString>::iterator existing = entityGroups.find(id);
+    if (existing != entityGroups.end())
+    {
+        if (existing.value() == groupName)
+            return;
+        UnindexEntity(id);
+    }
+
+    if (groupName.isEmpty())
+        return;
+
+    groupIndex[groupName].insert(id);
+    entityGroups[id] = groupName;
+}
+
+void RocketBuildEditor::UnindexEntity(entity_id_t id)
+{
+    QHash<entity_id_t, QString>::iterator existing = entityGroups.find(id);
+    if (existing == entityGroups.end())
+        return;
+
+    QHash<QString, QSet<entity_id_t> >::iterator group = groupIndex.find(existing.value());
+    if (group != groupIndex.end())
+    {
+        group->remove(id);
+        if (group->isEmpty())
+            groupIndex.erase(group);
+    }
+    entityGroups.erase(existing);
+}
+
+void RocketBuildEditor::OnComponentAdded(Entity *entity, IComponent *comp, AttributeChange::Type /*change*/)
+{
+    if (comp && comp->TypeId() == EC_Name::ComponentTypeId)
+        IndexEntityGroup(entity);
+}
+
+void RocketBuildEditor::OnComponentRemoved(Entity *entity, IComponent *comp, AttributeChange::Type /*change*/)
+{
+    // The component is still attached to the entity when this is emitted.
+    if (entity && comp && comp->TypeId() == EC_Name::ComponentTypeId)
+        UnindexEntity(entity->Id());
+}
+
+void RocketBuildEditor::OnEntityRemoved(Entity *entity, AttributeChange::Type /*change*/)
+{
+    if (entity)
+        UnindexEntity(entity->Id());
+}
+
 void RocketBuildEditor::ClearSelection()
 {
     const bool changed = !activeSelection.empty();
@@ -314,13 +470,14 @@ void RocketBuildEditor::ClearSelection()
 void RocketBuildEditor::SetScene(const ScenePtr &scene)
 {
     if (!currentScene.expired())
-        disconnect(currentScene.lock().get());
+        disconnect(currentScene.lock().get(), 0, this, 0);
 
+    EndEditSession();
     currentScene = scene;
 
     SAFE_DELETE(undoManager);
     transformEditor.reset();
-//    entityGroups.clear();
+    RebuildGroupIndex();
 
     if (scene)
     {
@@ -350,14 +507,13 @@ void RocketBuildEditor::SetScene(const ScenePtr &scene)
         connect(scene.get(), SIGNAL(AttributeChanged(IComponent *, IAttribute *, AttributeChange::Type)),
             SLOT(CheckForGroupChange(IComponent *, IAttribute *)), Qt::UniqueConnection);
 
-        /*
-        for(Scene::EntityMap::const_iterator it = scene->begin(); it != scene->end(); ++it)
-        {
-            const QString groupName = it->second->Group();
-            if (!groupName.isEmpty())
-                entityGroups[groupName].push_back(it->second);
-        }
-        */
+        // Keep the group index up to date
+        connect(scene.get(), SIGNAL(ComponentAdded(Entity *, IComponent *, AttributeChange::Type)),
+            SLOT(OnComponentAdded(Entity *, IComponent *, AttributeChange::Type)), Qt::UniqueConnection);
+        connect(scene.get(), SIGNAL(ComponentRemoved(Entity *, IComponent *, AttributeChange::Type)),
+            SLOT(OnComponentRemoved(Entity *, IComponent *, AttributeChange::Type)), Qt::UniqueConnection);
+        connect(scene.get(), SIGNAL(EntityRemoved(Entity *, AttributeChange::Type)),
+            SLOT(OnEntityRemoved(Entity *, AttributeChange::Type)), Qt::UniqueConnection);
     }
 }
 
@@ -446,6 +602,100 @@ void RocketBuildEditor::CopyAttributeValues(const shared_ptr<T> &source, const s
         CopyAttributeValue(sourceAttributes[i], destAttributes[i], parent);
 }
 
+void RocketBuildEditor::SetEditReplicationRate(float updatesPerSecond)
+{
+    editReplicationRate = Max(updatesPerSecond, 0.f);
+}
+
+void RocketBuildEditor::SetEditSessionTimeout(int msecs)
+{
+    editSessionTimeoutMsecs = Max(msecs, 0);
+}
+
+RocketAttributeEditCommandBase *RocketBuildEditor::ContinueEditSession(IAttribute *attribute)
+{
+    if (editSession.command && editSession.attribute == attribute && !editSession.commandAlive.expired() &&
+        editSession.command->IsApplied() && editSession.command->EditedAttribute() == attribute &&
+        editClock.elapsed() - editSession.lastEdit <= editSessionTimeoutMsecs)
+    {
+        editSession.lastEdit = editClock.elapsed();
+        ++editSession.edits;
+        return editSession.command;
+    }
+
+    EndEditSession();
+    return 0;
+}
+
+void RocketBuildEditor::BeginEditSession(RocketAttributeEditCommandBase *command)
+{
+    EndEditSession();
+
+    // Pushing the command applied and replicated the first value.
+    editSession.command = command;
+    editSession.commandAlive = command->AliveHandle();
+    editSession.attribute = command->EditedAttribute();
+    editSession.lastEdit = editClock.elapsed();
+    editSession.lastReplicated = editSession.lastEdit;
+    editSession.edits = 1;
+    editSession.replications = 1;
+
+    const int interval = editReplicationRate > 0.f ? static_cast<int>(1000.f / editReplicationRate) : editSessionTimeoutMsecs;
+    editSessionTimer->start(Clamp(interval, 1, Max(editSessionTimeoutMsecs, 1)));
+}
+
+void RocketBuildEditor::ReplicateEditSession(bool force)
+{
+    if (!editSession.command || editSession.commandAlive.expired())
+        return;
+
+    const qint64 now = editClock.elapsed();
+    const qint64 interval = editReplicationRate > 0.f ? static_cast<qint64>(1000.f / editReplicationRate) : 0;
+    if (!force && now - editSession.lastReplicated < interval)
+    {
+        editSession.replicationPending = true;
+        return;
+    }
+
+    IAttribute *attribute = editSession.command->EditedAttribute();
+    if (attribute && editSession.command->IsApplied())
+    {
+        // Value has already been applied locally, only signal it for replication.
+        attribute->Changed(AttributeChange::Default);
+        ++editSession.replications;
+    }
+    editSession.lastReplicated = now;
+    editSession.replicationPending = false;
+}
+
+void RocketBuildEditor::EndEditSession()
+{
+    if (!editSession.command)
+        return;
+
+    if (editSession.replicationPending)
+        ReplicateEditSession(true);
+
+    editSession = AttributeEditSession();
+    if (editSessionTimer)
+        editSessionTimer->stop();
+}
+
+void RocketBuildEditor::OnEditSessionTimer()
+{
+    if (!editSession.command || editSession.commandAlive.expired())
+    {
+        editSession = AttributeEditSession();
+        editSessionTimer->stop();
+        return;
+    }
+
+    if (editSession.replicationPending)
+        ReplicateEditSession(false);
+    if (editClock.elapsed() - editSession.lastEdit > editSessionTimeoutMsecs)
+        EndEditSession();
+}
+
 void RocketBuildEditor::CopyAttributeValue(IAttribute *source, IAttribute *dest, QUndoCommand *parent)
 {
     if (!source || !dest)
@@ -581,6 +831,23 @@ EntityPtr RocketBuildEditor::CreateBlock(const std::vector<ComponentPtr> &compon
 }
 
 EntityPtr RocketBuildEditor::CloneBlock(const EntityPtr &source, bool applyPhysics, bool cloneFunctionality)
+{
+    if (!source || !blockPlacer || blockPlacer->placerPlaceable.expired())
+        return EntityPtr();
+
+    EntityPtr block = CloneEntity(source, applyPhysics, cloneFunctionality, blockPlacer->placerPlaceable.lock()->WorldTransform());
+    if (!block)
+        return EntityPtr();
+
+    // Force activation of the newly created block.
+    blockPlacer->SetActiveBlock(block);
+
+    //currentBlockGroup.push_back(block);
+
+    return block;
+}
+
+EntityPtr RocketBuildEditor::CloneEntity(const EntityPtr &source, bool applyPhysics, bool cloneFunctionality, const float3x4 &worldTransform)
 {
     if (!source)
         return EntityPtr();
@@ -595,13 +862,13 @@ EntityPtr RocketBuildEditor::CloneBlock(const EntityPtr &source, bool applyPhysi
     EntityPtr block = scene->EntityById(cmdCreate->entityId_);
     if (!block)
     {
-        LogError("RocketBuildEditor::CloneBlock: UndoManager failed to create a block entity.");
+        LogError("RocketBuildEditor::CloneEntity: UndoManager failed to create a block entity.");
         return EntityPtr();
     }
 
     if (!source->Component<EC_Placeable>() || !source->Component<EC_Mesh>())
     {
-        LogError("RocketBuildEditor::CloneBlock: source entity is missing some of the required components.");
+        LogError("RocketBuildEditor::CloneEntity: source entity is missing some of the required components.");
         return EntityPtr();
     }
 
@@ -612,7 +879,7 @@ EntityPtr RocketBuildEditor::CloneBlock(const EntityPtr &source, bool applyPhysi
 
     // Set transform of the clone and push the current value to the undo stack.
     shared_ptr<EC_Placeable> placeable = static_pointer_cast<EC_Placeable>(undo.first);
-    placeable->SetWorldTransform(blockPlacer->placerPlaceable.lock()->WorldTransform());
+    placeable->SetWorldTransform(worldTransform);
     SetAttribute(placeable->transform, placeable->transform.Get(), undo.second);
 
     sourceComponent = source->Component(EC_Mesh::ComponentTypeId);
@@ -653,12 +920,327 @@ EntityPtr RocketBuildEditor::CloneBlock(const EntityPtr &source, bool applyPhysi
         }
     }
 
-    // Force activation of the newly created block.
-    blockPlacer->SetActiveBlock(block);
+    return block;
+}
 
-    //currentBlockGroup.push_back(block);
+EntityList RocketBuildEditor::CloneSelection(const RocketCloneArray &array)
+{
+    ScenePtr scene = Scene();
+    if (!scene || !undoManager || activeSelection.empty())
+        return EntityList();
+
+    const uint cells = Max(array.countX, 1u) * Max(array.countY, 1u) * Max(array.countZ, 1u);
+    if (cells < 2)
+        return EntityList();
+
+    // Entities whose parent is also selected move with their parent and are not offset themselves.
+    std::vector<EntityPtr> sources;
+    std::set<EntityPtr> roots;
+    AABB bounds;
+    bounds.SetNegativeInfinity();
+    for(std::set<EntityPtr>::const_iterator it = activeSelection.begin(); it != activeSelection.end(); ++it)
+    {
+        EC_Placeable *placeable = (*it)->Component<EC_Placeable>().get();
+        if (!placeable)
+        {
+            LogWarning("RocketBuildEditor::CloneSelection: Skipping " + (*it)->ToString() + " without EC_Placeable.");
+            continue;
+        }
+        sources.push_back(*it);
 
-    return block;
+        EC_Placeable *parent = placeable->ParentPlaceableComponent();
+        if (!parent || !parent->ParentEntity() || activeSelection.find(parent->ParentEntity()->shared_from_this()) == activeSelection.end())
+        {
+            roots.insert(*it);
+            EC_Mesh *mesh = (*it)->Component<EC_Mesh>().get();
+            if (mesh && mesh->HasMesh())
+                bounds.Enclose(mesh->WorldAABB());
+            else
+                bounds.Enclose(placeable->WorldPosition());
+        }
+    }
+    if (sources.empty())
+        return EntityList();
+    // The original cell is not copied.
+    const uint copies = (cells - 1) * static_cast<uint>(sources.size());
+    if (copies > 10000)
+    {
+        LogError(QString("RocketBuildEditor::CloneSelection: Refusing to create %1 entities, maximum is 10000.").arg(copies));
+        return EntityList();
+    }
+
+    const float3 spacing = (array.autoSpacing && bounds.IsFinite() ? bounds.Size() : array.spacing);
+
+    // Components cloned in addition to EC_Placeable, EC_Mesh and EC_Name, same rules as in CloneBlock.
+    const QList<u32> alwaysCloned(QList<u32>() << EC_Name::ComponentTypeId << EC_Placeable::ComponentTypeId << EC_Mesh::ComponentTypeId);
+
+    QDomDocument content("Scene");
+    QDomElement sceneElem = content.createElement("scene");
+    content.appendChild(sceneElem);
+
+    // CreateContentFromXml assigns the real ids. Placeholders only skip the ids of existing entities,
+    // so that parentRefs to parents outside the selection are not mistaken for clones.
+    entity_id_t nextPlaceholder = 1;
+
+    for(uint z = 0; z < Max(array.countZ, 1u); ++z)
+        for(uint y = 0; y < Max(array.countY, 1u); ++y)
+            for(uint x = 0; x < Max(array.countX, 1u); ++x)
+            {
+                if (x == 0 && y == 0 && z == 0)
+                    continue;
+
+                const float3 offset(spacing.x * x, spacing.y * y, spacing.z * z);
+
+                // Each copy gets distinct placeholder ids so that CreateContentFromXml can map
+                // the parentRefs of this copy to the new parents of this copy.
+                std::map<entity_id_t, entity_id_t> placeholders;
+                for(std::vector<EntityPtr>::const_iterator it = sources.begin(); it != sources.end(); ++it)
+                {
+                    while(scene->EntityById(nextPlaceholder).get())
+                        nextPlaceholder++;
+                    placeholders[(*it)->Id()] = nextPlaceholder++;
+                }
+
+                for(std::vector<EntityPtr>::const_iterator it = sources.begin(); it != sources.end(); ++it)
+                {
+                    const EntityPtr &source = *it;
+                    QDomElement entityElem = content.createElement("entity");
+                    entityElem.setAttribute("id", QString::number(placeholders[source->Id()]));
+                    entityElem.setAttribute("sync", source->IsReplicated() ? "1" : "0");
+
+                    const Entity::ComponentMap &components = source->Components();
+                    for(Entity::ComponentMap::const_iterator cIt = components.begin(); cIt != components.end(); ++cIt)
+                    {
+                        const u32 typeId = cIt->second->TypeId();
+                        if (alwaysCloned.contains(typeId) || (typeId == EC_RigidBody::ComponentTypeId && array.clonePhysics) ||
+                            (typeId != EC_RigidBody::ComponentTypeId && array.cloneFunctionality))
+                        {
+                            cIt->second->SerializeTo(content, entityElem, false);
+                        }
+                    }
+
+                    EC_Placeable *placeable = source->Component<EC_Placeable>().get();
+                    EC_Placeable *parent = placeable->ParentPlaceableComponent();
+                    const bool isRoot = (roots.find(source) != roots.end());
+
+                    QDomNodeList componentElems = entityElem.elementsByTagName("component");
+                    for(int i = 0; i < componentElems.count(); ++i)
+                    {
+                        QDomElement componentElem = componentElems.at(i).toElement();
+                        if (componentElem.attribute("type") != EC_Placeable::TypeNameStatic())
+                            continue;
+                        QDomNodeList attributeElems = componentElem.elementsByTagName("attribute");
+                        for(int j = 0; j < attributeElems.count(); ++j)
+                        {
+                            QDomElement attributeElem = attributeElems.at(j).toElement();
+                            if (isRoot && attributeElem.attribute("id") == placeable->transform.Id())
+                            {
+                                // Offset is in world space, convert it to the parent space of the placeable.
+                                Transform t = placeable->transform.Get();
+                                t.pos += (parent ? parent->WorldTransform().Inverted().TransformDir(offset) : offset);
+                                attributeElem.setAttribute("value", QString("%1,%2,%3,%4,%5,%6,%7,%8,%9")
+                                    .arg(t.pos.x, 0, 'g', 9).arg(t.pos.y, 0, 'g', 9).arg(t.pos.z, 0, 'g', 9)
+                                    .arg(t.rot.x, 0, 'g', 9).arg(t.rot.y, 0, 'g', 9).arg(t.rot.z, 0, 'g', 9)
+                                    .arg(t.scale.x, 0, 'g', 9).arg(t.scale.y, 0, 'g', 9).arg(t.scale.z, 0, 'g', 9));
+                            }
+                            else if (!isRoot && parent && attributeElem.attribute("id") == placeable->parentRef.Id())
+                            {
+                                // Parent is cloned in the same copy, point to its placeholder.
+                                std::map<entity_id_t, entity_id_t>::const_iterator pIt = placeholders.find(parent->ParentEntity()->Id());
+                                if (pIt != placeholders.end())
+                                    attributeElem.setAttribute("value", QString::number(pIt->second));
+                            }
+                        }
+                    }
+                    sceneElem.appendChild(entityElem);
+                }
+            }
+
+    RocketCloneEntitiesCommand *command = new RocketCloneEntitiesCommand(scene, content);
+    undoManager->Push(command);
+
+    const EntityList clones = command->CreatedEntities();
+    SetSelection(clones);
+    return clones;
+}
+
+void RocketBuildEditor::BenchmarkCloneSelection()
+{
+    BenchmarkCloneSelection("10");
+}
+
+void RocketBuildEditor::BenchmarkCloneSelection(const QString &copies)
+{
+    const uint count = Max(copies.trimmed().toUInt(), 1u);
+    const EntityList selection = Selection();
+    if (selection.empty() || !undoManager)
+    {
+        LogError("RocketBuildEditor::BenchmarkCloneSelection: Select the entities to clone in build mode first.");
+        return;
+    }
+
+    // Per block cloning, one undo command chain per clone.
+    kNet::PolledTimer timer;
+    timer.Start();
+    uint perBlockCommands = 0;
+    for(uint i = 1; i <= count; ++i)
+        for(EntityList::const_iterator it = selection.begin(); it != selection.end(); ++it)
+        {
+            EC_Placeable *placeable = (*it)->Component<EC_Placeable>().get();
+            if (!placeable || !(*it)->Component<EC_Mesh>())
+                continue;
+            float3x4 tm = placeable->WorldTransform();
+            tm.SetTranslatePart(tm.TranslatePart() + float3(0.f, 0.f, static_cast<float>(i)));
+            if (CloneEntity(*it, true, true, tm))
+                ++perBlockCommands;
+        }
+    const float perBlockMsecs = timer.MSecsElapsed();
+    for(uint i = 0; i < perBlockCommands; ++i)
+        undoManager->Undo();
+
+    // Batched cloning, one command for all clones.
+    RocketCloneArray array;
+    array.countZ = count + 1;
+    array.countX = 1;
+    array.autoSpacing = false;
+    array.spacing = float3(0.f, 0.f, 1.f);
+    timer.Start();
+    const EntityList clones = CloneSelection(array);
+    const float batchedMsecs = timer.MSecsElapsed();
+    if (!clones.empty())
+        undoManager->Undo();
+
+    SetSelection(selection);
+
+    LogInfo(QString("RocketBuildEditor::BenchmarkCloneSelection: %1 copies of %2 entities").arg(count).arg(selection.size()));
+    LogInfo(QString("    Per block: %1 msecs, %2 undo commands").arg(perBlockMsecs, 0, 'f', 2).arg(perBlockCommands));
+    LogInfo(QString("    Batched:   %1 msecs, %2 entities, 1 undo command").arg(batchedMsecs, 0, 'f', 2).arg(clones.size()));
+}
+
+void RocketBuildEditor::CheckEditSession()
+{
+    CheckEditSession("60");
+}
+
+void RocketBuildEditor::CheckEditSession(const QString &edits)
+{
+    if (editCheckTimer->isActive())
+    {
+        LogError("RocketBuildEditor::CheckEditSession: A check is already running.");
+        return;
+    }
+    const EntityList selection = Selection();
+    EntityPtr entity = (!selection.empty() ? selection.front() : EntityPtr());
+    shared_ptr<EC_Placeable> placeable = (entity ? entity->Component<EC_Placeable>() : shared_ptr<EC_Placeable>());
+    if (!placeable || !undoManager)
+    {
+        LogError("RocketBuildEditor::CheckEditSession: Select an entity with EC_Placeable in build mode first.");
+        return;
+    }
+
+    EndEditSession();
+    editCheck = EditSessionCheck();
+    editCheck.entity = entity;
+    editCheck.original = placeable->transform.Get();
+    editCheck.edits = Max(edits.trimmed().toUInt(), 2u);
+    editCheck.remaining = editCheck.edits;
+    editCheck.started = editClock.elapsed();
+    connect(placeable.get(), SIGNAL(AttributeChanged(IAttribute*, AttributeChange::Type)),
+        SLOT(OnEditSessionCheckAttributeChanged(IAttribute*, AttributeChange::Type)), Qt::UniqueConnection);
+    editCheckTimer->start(16);
+}
+
+void RocketBuildEditor::OnEditSessionCheckStep()
+{
+    EntityPtr entity = editCheck.entity.lock();
+    EC_Placeable *placeable = (entity ? entity->Component<EC_Placeable>().get() : 0);
+    if (!placeable)
+    {
+        editCheckTimer->stop();
+        LogError("RocketBuildEditor::CheckEditSession: FAILED, the entity was removed during the check.");
+        return;
+    }
+
+    if (editCheck.remaining == 0)
+    {
+        FinishEditSessionCheck();
+        return;
+    }
+
+    editCheck.last = placeable->transform.Get();
+    editCheck.last.pos.x += 0.05f;
+    SetAttribute(placeable->transform, editCheck.last);
+
+    if (!editCheck.command)
+        editCheck.command = editSession.command;
+    else if (editSession.command != editCheck.command)
+        editCheck.commandChanged = true;
+    --editCheck.remaining;
+}
+
+void RocketBuildEditor::OnEditSessionCheckAttributeChanged(IAttribute *attribute, AttributeChange::Type change)
+{
+    EC_Placeable *placeable = dynamic_cast<EC_Placeable*>(sender());
+    if (placeable && attribute == &placeable->transform && change != AttributeChange::LocalOnly)
+        ++editCheck.replicated;
+}
+
+void RocketBuildEditor::FinishEditSessionCheck()
+{
+    editCheckTimer->stop();
+    EndEditSession();
+
+    EntityPtr entity = editCheck.entity.lock();
+    shared_ptr<EC_Placeable> placeable = (entity ? entity->Component<EC_Placeable>() : shared_ptr<EC_Placeable>());
+    if (!placeable)
+    {
+        LogError("RocketBuildEditor::CheckEditSession: FAILED, the entity was removed during the check.");
+        return;
+    }
+    disconnect(placeable.get(), SIGNAL(AttributeChanged(IAttribute*, AttributeChange::Type)),
+        this, SLOT(OnEditSessionCheckAttributeChanged(IAttribute*, AttributeChange::Type)));
+
+    // The first edit and the last value are always replicated, in between at most EditReplicationRate per second.
+    const float seconds = static_cast<float>(editClock.elapsed() - editCheck.started) / 1000.f;
+    const uint maxReplicated = (editReplicationRate > 0.f ? static_cast<uint>(seconds * editReplicationRate) + 2 : editCheck.edits);
+    const bool finalApplied = placeable->transform.Get().pos.Equals(editCheck.last.pos);
+
+    // A single undo must restore the original transform.
+    undoManager->Undo();
+    const bool undoRestored = placeable->transform.Get().pos.Equals(editCheck.original.pos);
+
+    QStringList failures;
+    if (editCheck.commandChanged)
+        failures << "edits created several undo commands";
+    if (!undoRestored)
+        failures << "one undo did not restore the original transform";
+    if (!finalApplied)
+        failures << "last edited value was not applied";
+    if (editCheck.replicated < 2 || editCheck.replicated > maxReplicated)
+        failures << QString("%1 replicated updates, expected 2-%2").arg(editCheck.replicated).arg(maxReplicated);
+
+    const QString summary = QString("%1 edits in %2 secs, 1 undo command expected, %3 replicated updates at %4 per second")
+        .arg(editCheck.edits).arg(seconds, 0, 'f', 2).arg(editCheck.replicated).arg(editReplicationRate);
+    if (failures.isEmpty())
+        LogInfo("RocketBuildEditor::CheckEditSession: PASSED, " + summary);
+    else
+        LogError("RocketBuildEditor::CheckEditSession: FAILED, " + summary + ": " + failures.join(", "));
+    editCheck = EditSessionCheck();
+}
+
+void RocketBuildEditor::BenchmarkLightRemoval()
+{
+    BenchmarkLightRemoval("50");
+}
+
+void RocketBuildEditor::BenchmarkLightRemoval(const QString &count)
+{
+    if (!buildWidget)
+    {
+        LogError("RocketBuildEditor::BenchmarkLightRemoval: Open build mode first.");
+        return;
+    }
+    buildWidget->BenchmarkLightRemoval(Max(count.trimmed().toUInt(), 1u));
 }
 
 void RocketBuildEditor::DeleteBlock()
@@ -691,6 +1273,7 @@ void RocketBuildEditor::DeleteSelection(bool showConfirmationDialog)
 
 bool RocketBuildEditor::Undo()
 {
+    EndEditSession();
     if (undoManager)
     {
         undoManager->Undo();
@@ -701,6 +1284,7 @@ bool RocketBuildEditor::Undo()
 
 bool RocketBuildEditor::Redo()
 {
+    EndEditSession();
     if (undoManager)
     {
         undoManager->Redo();
@@ -733,11 +1317,15 @@ void RocketBuildEditor::OnActiveCameraChanged(Entity *entity)
 
 void RocketBuildEditor::CheckForGroupChange(IComponent *comp, IAttribute *attr)
 {
-    if (comp->TypeId() == EC_Name::ComponentTypeId && attr->Id().compare("group", Qt::CaseInsensitive) == 0 &&
-        ActiveEntity().get() == comp->ParentEntity())
+    if (comp->TypeId() == EC_Name::ComponentTypeId && attr->Id().compare("group", Qt::CaseInsensitive) == 0)
     {
-        const QString newGroup = attr->ToString();
-        emit ActiveGroupChanged(newGroup, Scene()->EntitiesOfGroup(newGroup));
+        IndexEntityGroup(comp->ParentEntity());
+
+        if (ActiveEntity().get() == comp->ParentEntity())
+        {
+            const QString newGroup = attr->ToString();
+            emit ActiveGroupChanged(newGroup, EntitiesOfGroup(newGroup));
+        }
     }
 }
 
@@ -754,7 +1342,7 @@ void RocketBuildEditor::CheckForGroupChange(const EntityList &oldSelection)
     if (oldGroups != newGroups)
     {
         const QString newGroupName = entity ? entity->Group() : "";
-        emit ActiveGroupChanged(newGroupName, Scene()->EntitiesOfGroup(newGroupName));
+        emit ActiveGroupChanged(newGroupName, EntitiesOfGroup(newGroupName));
     }
 
     /// @todo Better place for this.
@@ -821,7 +1409,7 @@ bool RocketBuildEditor::AppendSelectionInternal(const EntityPtr &entity)
     {
         if (selectGroups)
         {
-            const EntityList group = Scene()->EntitiesOfGroup(entity->Group());
+            const EntityList group = EntitiesOfGroup(entity->Group());
             if (group.empty())
                 activeSelection.insert(entity);
             else
@@ -843,7 +1431,7 @@ bool RocketBuildEditor::RemoveFromSelectionInternal(const EntityPtr &entity)
     {
         if (selectGroups)
         {
-            const EntityList entitiesOfTheSameGroup = Scene()->EntitiesOfGroup(entity->Group());
+            const EntityList entitiesOfTheSameGroup = EntitiesOfGroup(entity->Group());
             if (entitiesOfTheSameGroup.empty())
                 activeSelection.erase(entity);
             else
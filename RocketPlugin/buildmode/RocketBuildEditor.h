@@ -25,15 +25,20 @@
 #include "UndoCommands.h"
 #include "UndoManager.h"
 #include "Scene.h"
+#include "RocketAttributeEditCommand.h"
 #include "Math/float3x4.h"
+#include "Transform.h"
+#include "Math/float3.h"
 
 #include <QPointer>
 #include <QString>
+#include <QHash>
+#include <QSet>
+#include <QElapsedTimer>
 
 class TransformEditor;
 class QUndoCommand;
-
-//typedef std::map<QString, std::vector<EntityWeakPtr > > EntityGroupMap;
+class QTimer;
 
 /// Represents a group of entities that can be considered as a single object.
 /*
@@ -49,6 +54,22 @@ struct EntityGroup
 };
 */
 
+/// Array/grid placement for RocketBuildEditor::CloneSelection.
+/** The selection is repeated countX * countY * countZ times, the original selection being the first cell of the grid. */
+struct RocketCloneArray
+{
+    RocketCloneArray() : countX(2), countY(1), countZ(1), spacing(float3::zero), autoSpacing(true), clonePhysics(true), cloneFunctionality(true) {}
+
+    uint countX; ///< Number of grid cells along world X axis, including the original.
+    uint countY; ///< Number of grid cells along world Y axis, including the original.
+    uint countZ; ///< Number of grid cells along world Z axis, including the original.
+    float3 spacing; ///< World space offset between grid cells.
+    bool autoSpacing; ///< If true, @c spacing is the size of the selection's world bounding box.
+    bool clonePhysics; ///< Clone EC_RigidBody.
+    bool cloneFunctionality; ///< Clone components other than EC_Name, EC_Placeable, EC_Mesh and EC_RigidBody.
+};
+Q_DECLARE_METATYPE(RocketCloneArray)
+
 /// Defaults to tri mesh (4).
 int StringToRigidBodyShapeType(const QString &str);
 
@@ -107,6 +128,12 @@ public:
     void RemoveFromSelection(const EntityList &entities);
     void RemoveFromSelection(const EntityPtr &entity); /**< @overload */
 
+    /// Sets selection to all entities of @c groupName. Clears selection if the group is empty.
+    void SelectGroup(const QString &groupName);
+
+    /// Appends all entities of @c groupName to the selection.
+    void AppendGroupToSelection(const QString &groupName);
+
     /// Clears current selection.
     void ClearSelection();
 
@@ -132,9 +159,21 @@ public:
         const QString &name = "", bool replicated = true, bool temporary = false);
 
     /// Sets value of an attribute in a way that it can be undoed and redoed by using Undo and Redo.
+    /** If @c parent is null the edit is part of an edit session: continuous edits of the same attribute,
+        eg. while dragging a slider, update a single undo command and are replicated at most
+        EditReplicationRate times per second. The last value is always replicated when the session ends.
+        A session ends when another attribute is edited, after EditSessionTimeout of inactivity or by calling EndEditSession. */
     template <typename T>
     void SetAttribute(Attribute<T> &attribute, const T &value, QUndoCommand *parent = 0);
 
+    /// Sets maximum number of replicated updates per second during an edit session. 0 replicates every edit.
+    void SetEditReplicationRate(float updatesPerSecond);
+    float EditReplicationRate() const { return editReplicationRate; }
+
+    /// Sets milliseconds of inactivity after which an edit session ends.
+    void SetEditSessionTimeout(int msecs);
+    int EditSessionTimeout() const { return editSessionTimeoutMsecs; }
+
     /// Copies all attribute values of an component in a way that it can be undoed and redoed by using Undo and Redo.
     /** This function is templated to ensure that the two components are of same type at compile time.
         If you are using shared_ptr<IComponent> this wont work, but the function will not do anything in that case. */
@@ -148,8 +187,13 @@ public:
 
     void UpdateBuildWidgetAnimationsState(int mouseX, bool forceShow = false);
 
-    /// Returns all known entity groups in the current Scene.
-//    const EntityGroupMap &EntityGroups() const { return entityGroups; }
+    /// Returns names of all known entity groups in the current Scene.
+    QStringList EntityGroups() const { return groupIndex.keys(); }
+
+    /// Returns all entities of @c groupName in the current Scene.
+    /** Uses an index that is kept up to date incrementally, unlike Scene::EntitiesOfGroup this does not scan the scene.
+        @note Returns an empty list for an empty @c groupName. */
+    EntityList EntitiesOfGroup(const QString &groupName) const;
 
 public slots:
     /// Creates a new block using current settings and block placer's position.
@@ -162,6 +206,12 @@ public slots:
     /// Creates a new block by cloning an existing entity.
     EntityPtr CloneBlock(const EntityPtr &source, bool clonePhysics, bool cloneFunctionality);
 
+    /// Clones the whole current selection to an array/grid.
+    /** All clones are created in a single batch as one undo command. Entities parented to other selected
+        entities keep their parent relation within each copy. The clones become the new selection.
+        @return Created entities. */
+    EntityList CloneSelection(const RocketCloneArray &array);
+
     /// Deletes a block that is currently selected (under mouse).
     void DeleteBlock();
     /// Deletes the whole current active selection.
@@ -178,6 +228,10 @@ public slots:
     void SetSelectGroupsEnabled(bool select);
     bool IsSelectGroupsEnabled() const { return selectGroups; }
 
+    /// Ends the current attribute edit session, replicating its last value if needed.
+    /** Call when a continuous edit is known to be finished, eg. on slider release. */
+    void EndEditSession();
+
 signals:
     /// @note @c entities can can be an empty list.
     void SelectionChanged(const EntityList &entities);
@@ -193,6 +247,25 @@ private:
     bool AppendSelectionInternal(const EntityPtr &entity);
     bool RemoveFromSelectionInternal(const EntityPtr &entity);
 
+    /// Returns @c entities and, if group selection is enabled, all entities of their groups.
+    /** Each group is expanded only once regardless of how many of its entities are in @c entities. */
+    std::set<EntityPtr> ExpandGroups(const EntityList &entities) const;
+
+    /// Clones @c source with the chain of entity, component and attribute undo commands and places it at @c worldTransform.
+    EntityPtr CloneEntity(const EntityPtr &source, bool clonePhysics, bool cloneFunctionality, const float3x4 &worldTransform);
+
+    /// Returns command of the current edit session if it can be continued with an edit of @c attribute.
+    /** Ends the current session and returns null otherwise. */
+    RocketAttributeEditCommandBase *ContinueEditSession(IAttribute *attribute);
+    void BeginEditSession(RocketAttributeEditCommandBase *command);
+    /// Replicates the latest edit session value now or schedules it according to EditReplicationRate.
+    void ReplicateEditSession(bool force);
+
+    /// Group index maintenance.
+    void RebuildGroupIndex();
+    void IndexEntityGroup(Entity *entity);
+    void UnindexEntity(entity_id_t id);
+
     RocketPlugin *rocket;
     Framework *framework;
     RocketBuildWidget *buildWidget;
@@ -208,16 +281,75 @@ private:
     UndoManager *undoManager;
     RocketBlockPlacer *blockPlacer;
     float3x4 originalTm;
-    //EntityGroupMap entityGroups;
+    QHash<QString, QSet<entity_id_t> > groupIndex; ///< Group name to entities of the group.
+    QHash<entity_id_t, QString> entityGroups; ///< Entity to its indexed group name.
     std::set<EntityPtr> activeSelection;
     bool selectGroups;
 
+    /// Continuous edit of a single attribute.
+    struct AttributeEditSession
+    {
+        RocketAttributeEditCommandBase *command;
+        weak_ptr<bool> commandAlive;
+        IAttribute *attribute;
+        qint64 lastEdit;
+        qint64 lastReplicated;
+        bool replicationPending;
+        uint edits;
+        uint replications;
+
+        AttributeEditSession() : command(0), attribute(0), lastEdit(0), lastReplicated(0), replicationPending(false), edits(0), replications(0) {}
+    };
+    AttributeEditSession editSession;
+    QElapsedTimer editClock;
+    QTimer *editSessionTimer;
+    float editReplicationRate;
+    int editSessionTimeoutMsecs;
+
+    /// Simulated drag of the checkEditSession console command.
+    struct EditSessionCheck
+    {
+        EntityWeakPtr entity;
+        Transform original;
+        Transform last;
+        RocketAttributeEditCommandBase *command; ///< Command of the first edit, every edit must update it.
+        qint64 started;
+        uint edits;
+        uint remaining;
+        uint replicated;        ///< Non local changes of the edited attribute.
+        bool commandChanged;
+
+        EditSessionCheck() : command(0), started(0), edits(0), remaining(0), replicated(0), commandChanged(false) {}
+    };
+    EditSessionCheck editCheck;
+    QTimer *editCheckTimer;
+
+    void FinishEditSessionCheck();
+
 private slots:
     void OnAuthenticated(int permissionLevel);
     void OnAuthReset();
     void OnActiveCameraChanged(Entity *);
     void CheckForGroupChange(IComponent *comp, IAttribute *attr);
     void CheckForGroupChange(const EntityList &oldSelection);
+    void OnComponentAdded(Entity *entity, IComponent *comp, AttributeChange::Type change);
+    void OnComponentRemoved(Entity *entity, IComponent *comp, AttributeChange::Type change);
+    void OnEntityRemoved(Entity *entity, AttributeChange::Type change);
+    void OnEditSessionTimer();
+
+    void BenchmarkCloneSelection(const QString &copies);
+    void BenchmarkCloneSelection();
+
+    /// Drags the first selected entity with @c edits transform edits at 60 Hz and checks that they
+    /// form one undo command and are replicated at most EditReplicationRate times per second.
+    void CheckEditSession(const QString &edits);
+    void CheckEditSession();
+    void OnEditSessionCheckStep();
+    void OnEditSessionCheckAttributeChanged(IAttribute *attribute, AttributeChange::Type change);
+
+    /// Runs RocketBuildWidget::BenchmarkLightRemoval with @c count lights.
+    void BenchmarkLightRemoval(const QString &count);
+    void BenchmarkLightRemoval();
 
     void OnBuildWidgetVisibilityChanged(bool visible);
     void OnContextWidgetVisibilityChanged(bool visible);
@@ -250,9 +382,24 @@ QPair<T*, QUndoCommand*> RocketBuildEditor::CreateComponent(const EntityPtr &blo
 template <typename T>
 void RocketBuildEditor::SetAttribute(Attribute<T> &attribute, const T &value, QUndoCommand *parent)
 {
-    EditAttributeCommand<T> *action = new EditAttributeCommand<T>(&attribute, value, parent);
-    if (!parent)
-        undoManager->Push(action);
-    else
+    if (parent)
+    {
+        EditAttributeCommand<T> *action = new EditAttributeCommand<T>(&attribute, value, parent);
         action->redo();
+        return;
+    }
+
+    RocketAttributeEditCommand<T> *session = dynamic_cast<RocketAttributeEditCommand<T> *>(ContinueEditSession(&attribute));
+    if (session)
+    {
+        // Update the existing undo command, apply locally and replicate when the rate allows.
+        session->SetNewValue(value);
+        attribute.Set(value, AttributeChange::LocalOnly);
+        ReplicateEditSession(false);
+        return;
+    }
+
+    RocketAttributeEditCommand<T> *action = new RocketAttributeEditCommand<T>(&attribute, value);
+    undoManager->Push(action);
+    BeginEditSession(action);
 }
@@ -93,6 +93,9 @@
 #include <QMessageBox>
 #include <QMouseEvent>
 #include <QSignalMapper>
+#include <QTimer>
+
+#include <kNet/PolledTimer.h>
 
 #include <Ogre.h>
 #include <OgreCommon.h>
@@ -148,6 +151,9 @@ RocketBuildWidget::RocketBuildWidget(RocketPlugin *plugin) :
     prevFogMode(EC_Fog::None),
     physicsDebugEnabled(false),
     lastClickedListItem(0),
+    pendingRefreshes(RefreshNothing),
+    coalesceRefreshes(true),
+    refreshCount(0),
     scenePackager(0),
     buildingComponentMenu(0)
 {
@@ -219,6 +225,9 @@ RocketBuildWidget::RocketBuildWidget(RocketPlugin *plugin) :
     connect(mainWidget.skyTimeSlider, SIGNAL(valueChanged(int)), this, SLOT(SetSkyTime(int)));
     connect(mainWidget.skyDirSlider, SIGNAL(valueChanged(int)), this, SLOT(SetSkyDirection(int)));
     connect(mainWidget.skySpeedSlider, SIGNAL(valueChanged(int)), this, SLOT(SetSkySpeed(int)));
+    connect(mainWidget.skyTimeSlider, SIGNAL(sliderReleased()), owner, SLOT(EndEditSession()));
+    connect(mainWidget.skyDirSlider, SIGNAL(sliderReleased()), owner, SLOT(EndEditSession()));
+    connect(mainWidget.skySpeedSlider, SIGNAL(sliderReleased()), owner, SLOT(EndEditSession()));
     connect(mainWidget.skyMaterialButton, SIGNAL(clicked()), this, SLOT(OpenMaterialPickerForSky()));   
     connect(mainWidget.skyDateEdit, SIGNAL(editingFinished()), this, SLOT(SetSkyDate()));
 
@@ -914,18 +923,13 @@ void RocketBuildWidget::SetScene(const ScenePtr &scene)
 
 void RocketBuildWidget::OnEntityRemoved(Entity *entity)
 {
-    ComponentPtr comp = entity->Component(EC_Light::ComponentTypeId);
-    if (comp)
-        RemoveLight(comp, false);
-        
-    comp = entity->Component(EC_MeshmoonTeleport::ComponentTypeId);
-    if (comp)
-        RemoveTeleport(comp, false);
+    const Entity::ComponentMap &components = entity->Components();
+    for(Entity::ComponentMap::const_iterator it = components.begin(); it != components.end(); ++it)
+        HandleComponentChange(entity, it->second.get());
 }
 
-void RocketBuildWidget::OnComponentAdded(Entity * /*entity*/, IComponent *component)
+void RocketBuildWidget::OnComponentAdded(Entity *entity, IComponent *component)
 {
-    /// @todo For now simply re-using code of OnComponentRemoved instead of copy-pasting it here.
     switch(component->TypeId())
     {
     case EC_Light::ComponentTypeId:
@@ -934,15 +938,30 @@ void RocketBuildWidget::OnComponentAdded(Entity * /*entity*/, IComponent *compon
     case EC_MeshmoonTeleport::ComponentTypeId:
         AddTeleport(component->shared_from_this());
         break;
+    case EC_RigidBody::ComponentTypeId:
+    {
+        shared_ptr<EC_RigidBody> rigidBody = static_pointer_cast<EC_RigidBody>(component->shared_from_this());
+        rigidBodies[rigidBody.get()] = rigidBody;
+        break;
+    }
     default:
-        OnComponentRemoved(0/*entity*/, component);
+        // Environment components are (re)discovered the same way on addition and removal.
+        HandleComponentChange(entity, component);
         break;
     }
 }
 
-void RocketBuildWidget::OnComponentRemoved(Entity * /*entity*/, IComponent *component)
+void RocketBuildWidget::OnComponentRemoved(Entity *entity, IComponent *component)
 {
-    /// @todo More fine-grained handling for others than Lights too.
+    HandleComponentChange(entity, component);
+}
+
+void RocketBuildWidget::HandleComponentChange(Entity *entity, IComponent *component)
+{
+    if (!entity)
+        entity = component->ParentEntity();
+
+    // Only the page models are updated here, refreshes that need to scan the scene are coalesced to once per frame.
     switch(component->TypeId())
     {
     case EC_Sky::ComponentTypeId:
@@ -951,27 +970,78 @@ void RocketBuildWidget::OnComponentRemoved(Entity * /*entity*/, IComponent *comp
     case EC_Hydrax::ComponentTypeId:
     case EC_Fog::ComponentTypeId:
     case EC_OgreCompositor::ComponentTypeId:
-        RefreshEnvironmentPage();
+        ScheduleRefresh(RefreshEnvironment);
         break;
     case EC_Terrain::ComponentTypeId:
-        RefreshTerrainPage();
+        ScheduleRefresh(RefreshTerrain);
         break;
     case EC_MeshmoonTeleport::ComponentTypeId:
-        RemoveTeleport(component->shared_from_this(), false);
+        RemoveTeleportItem(entity);
         break;
     case EC_EnvironmentLight::ComponentTypeId:
-        RefreshLightsPage();
+        ScheduleRefresh(RefreshEnvironmentLight);
+        break;
     case EC_Light::ComponentTypeId:
-        RemoveLight(component->shared_from_this(), false);
+        RemoveLightItem(entity);
         break;
     case EC_RigidBody::ComponentTypeId:
-        RefreshPhysicsPage();
+        rigidBodies.erase(static_cast<EC_RigidBody *>(component));
+        if (activeRigidBody.lock().get() == component)
+            ScheduleRefresh(RefreshPhysicsOptions);
         break;
     default: // Not interested in these components.
         break;
     }
 }
 
+void RocketBuildWidget::ScheduleRefresh(int parts)
+{
+    if (!coalesceRefreshes)
+    {
+        pendingRefreshes |= parts;
+        ProcessPendingRefreshes();
+        return;
+    }
+    if (pendingRefreshes == RefreshNothing)
+        QTimer::singleShot(0, this, SLOT(ProcessPendingRefreshes()));
+    pendingRefreshes |= parts;
+}
+
+void RocketBuildWidget::ProcessPendingRefreshes()
+{
+    const int parts = pendingRefreshes;
+    pendingRefreshes = RefreshNothing;
+    if (parts == RefreshNothing || !Scene())
+        return;
+
+    if (parts & RefreshEnvironment)
+    {
+        RefreshEnvironmentPage();
+        ++refreshCount;
+    }
+    if (parts & RefreshTerrain)
+    {
+        RefreshTerrainPage();
+        ++refreshCount;
+    }
+    if (parts & RefreshEnvironmentLight)
+    {
+        FindEnvironmentLight();
+        RefreshEnvironmentLightSettings();
+        ++refreshCount;
+    }
+    if (parts & RefreshPhysicsOptions)
+    {
+        RefreshPhysicsEntityOptions();
+        ++refreshCount;
+    }
+    if (parts & RefreshObjectSelection)
+    {
+        RefreshCurrentObjectSelection();
+        ++refreshCount;
+    }
+}
+
 void RocketBuildWidget::SetWaterMode(int mode)
 {
     if (!water.expired())
@@ -1112,9 +1182,9 @@ void RocketBuildWidget::SetPhysicsDebugEnabled(bool enabled)
     if (w)
         w->SetDebugGeometryEnabled(physicsDebugEnabled);
 
-    for(std::list<weak_ptr<EC_RigidBody> >::iterator it = rigidBodies.begin(); it != rigidBodies.end(); ++it)
-        if (!(*it).expired())
-            (*it).lock()->drawDebug.Set(physicsDebugEnabled, AttributeChange::LocalOnly);
+    for(std::map<EC_RigidBody *, weak_ptr<EC_RigidBody> >::iterator it = rigidBodies.begin(); it != rigidBodies.end(); ++it)
+        if (!it->second.expired())
+            it->second.lock()->drawDebug.Set(physicsDebugEnabled, AttributeChange::LocalOnly);
 
     if (mainWidget.physicsDebugButton)
         mainWidget.physicsDebugButton->setText(tr("Draw Debug: %1").arg(physicsDebugEnabled ? tr("Enabled") : tr("Disabled")));
@@ -1448,6 +1518,26 @@ void RocketBuildWidget::RefreshLightsPage()
     DisconnectFromScene(scene);
 
     // 1) Environment light
+    FindEnvironmentLight();
+    RefreshEnvironmentLightSettings();
+
+    // 2) Other lights
+    ClearLightItems();
+    Entity::ComponentVector existing = scene->Components(EC_Light::TypeIdStatic());
+    for(size_t i = 0; i < existing.size(); ++i)
+        AddLight(existing[i]);
+
+    RefreshActiveLightSettings();
+
+    ConnectToScene(scene);
+}
+
+void RocketBuildWidget::FindEnvironmentLight()
+{
+    ScenePtr scene = Scene();
+    if (!scene)
+        return;
+
     Entity::ComponentVector existing;
     if (environmentLight.expired())
     {
@@ -1473,18 +1563,6 @@ void RocketBuildWidget::RefreshLightsPage()
             SetEnvironmentLightComponent(existing[0]);
         }
     }
-
-    RefreshEnvironmentLightSettings();
-
-    // 2) Other lights
-    ClearLightItems();
-    existing = scene->Components(EC_Light::TypeIdStatic());
-    for(size_t i = 0; i < existing.size(); ++i)
-        AddLight(existing[i]);
-
-    RefreshActiveLightSettings();
-
-    ConnectToScene(scene);
 }
 
 void RocketBuildWidget::RefreshBlocksPage()
@@ -2177,8 +2255,8 @@ void RocketBuildWidget::RefreshPhysicsPage()
 
     rigidBodies.clear();
     std::vector<shared_ptr<EC_RigidBody> > existing = scene->Components<EC_RigidBody>();
-
-    rigidBodies.insert(rigidBodies.begin(), existing.begin(), existing.end());
+    for(size_t i = 0; i < existing.size(); ++i)
+        rigidBodies[existing[i].get()] = existing[i];
 
     mainWidget.physicsDebugButton->setDisabled(bulletWorld.expired());
     PhysicsWorldPtr w = bulletWorld.lock();
@@ -2392,6 +2470,7 @@ void RocketBuildWidget::SetRigidBodySizeZ(double z)
 
 void RocketBuildWidget::ClearTeleportItems()
 {
+    teleportItems.clear();
     mainWidget.teleportsListWidget->clearSelection();
     while(mainWidget.teleportsListWidget->count() > 0)
     {
@@ -2402,6 +2481,7 @@ void RocketBuildWidget::ClearTeleportItems()
 
 void RocketBuildWidget::ClearLightItems()
 {
+    lightItems.clear();
     mainWidget.lightListWidget->clearSelection();
     while(mainWidget.lightListWidget->count() > 0)
     {
@@ -3055,21 +3135,13 @@ EntityListWidgetItem *RocketBuildWidget::AddTeleport(const ComponentPtr &tp, boo
     EntityPtr entity = tp->ParentEntity()->shared_from_this();
     
     // Check if already in list
-    EntityListWidgetItem *item = 0;
-    for(int i = 0; i < mainWidget.teleportsListWidget->count(); ++i)
-    {
-        EntityListWidgetItem *iter = static_cast<EntityListWidgetItem *>(mainWidget.teleportsListWidget->item(i));
-        if (iter && iter->Entity() == entity)
-        {
-            item = iter;
-            break;
-        }
-    }
+    EntityListWidgetItem *item = teleportItems.value(entity.get(), 0);
     if (!item)
     {
         EC_Name *name = tp->ParentEntity()->Component<EC_Name>().get();
         item = new EntityListWidgetItem(name->name.Get(), mainWidget.teleportsListWidget, entity);
         mainWidget.teleportsListWidget->addItem(item);
+        teleportItems[entity.get()] = item;
         
         // Listen to possible name changes.
         connect(name, SIGNAL(AttributeChanged(IAttribute *, AttributeChange::Type)), SLOT(UpdateEntityName(IAttribute *)), Qt::UniqueConnection);
@@ -3087,34 +3159,47 @@ void RocketBuildWidget::RemoveTeleport(const EntityPtr &teleportEntity, bool rem
     if (!teleportEntity)
         return;
 
-    for(int i = 0; i < mainWidget.teleportsListWidget->count(); ++i)
+    EntityListWidgetItem *item = teleportItems.take(teleportEntity.get());
+    if (!item)
+        return;
+
+    lastClickedListItem = 0;
+    mainWidget.teleportsListWidget->setCurrentItem(item, QItemSelectionModel::Deselect | QItemSelectionModel::Clear);          
+
+    owner->SetSelection(EntityPtr());
+    SetActiveTeleportEntity(EntityPtr());
+    SAFE_DELETE(item);
+
+    /// @todo undo stack
+    if (removeParentEntity)
     {
-        EntityListWidgetItem *item = static_cast<EntityListWidgetItem *>(mainWidget.teleportsListWidget->item(i));
-        if (item->Entity() == teleportEntity)
-        {
-            lastClickedListItem = 0;
-            mainWidget.teleportsListWidget->setCurrentItem(item, QItemSelectionModel::Deselect | QItemSelectionModel::Clear);          
+        ScenePtr scene = Scene();
+        if (scene)
+            scene->RemoveEntity(teleportEntity->Id());
+    }
+    else
+    {
+        teleportEntity->RemoveComponents(EC_MeshmoonTeleport::ComponentTypeId);
+    }
 
-            owner->SetSelection(EntityPtr());
-            SetActiveTeleportEntity(EntityPtr());
-            SAFE_DELETE(item);
+    RefreshCurrentObjectSelection();
+}
 
-            /// @todo undo stack
-            if (removeParentEntity)
-            {
-                ScenePtr scene = Scene();
-                if (scene)
-                    scene->RemoveEntity(teleportEntity->Id());
-            }
-            else
-            {
-                teleportEntity->RemoveComponents(EC_MeshmoonTeleport::ComponentTypeId);
-            }
+void RocketBuildWidget::RemoveTeleportItem(Entity *entity)
+{
+    EntityListWidgetItem *item = teleportItems.take(entity);
+    if (!item)
+        return;
 
-            RefreshCurrentObjectSelection();
-            break;
-        }
+    if (lastClickedListItem == item)
+        lastClickedListItem = 0;
+    if (activeTeleportEntity.lock().get() == entity)
+    {
+        owner->SetSelection(EntityPtr());
+        SetActiveTeleportEntity(EntityPtr());
+        ScheduleRefresh(RefreshObjectSelection);
     }
+    SAFE_DELETE(item);
 }
 
 void RocketBuildWidget::RemoveTeleport(const ComponentPtr &light, bool removeParentEntity)
@@ -3128,22 +3213,13 @@ EntityListWidgetItem *RocketBuildWidget::AddLight(const ComponentPtr &light, boo
     EntityPtr entity = light->ParentEntity()->shared_from_this();
     
     // Check if already in list
-    EntityListWidgetItem *item = 0;
-    for(int i = 0; i < mainWidget.lightListWidget->count(); ++i)
-    {
-        EntityListWidgetItem *iter = static_cast<EntityListWidgetItem *>(mainWidget.lightListWidget->item(i));
-        if (iter && iter->Entity() == entity)
-        {
-            item = iter;
-            break;
-        }
-    }
-
+    EntityListWidgetItem *item = lightItems.value(entity.get(), 0);
     if (!item)
     {
         EC_Name *name = light->ParentEntity()->Component<EC_Name>().get();
         item = new EntityListWidgetItem(name->name.Get(), mainWidget.lightListWidget, entity);
         mainWidget.lightListWidget->addItem(item);
+        lightItems[entity.get()] = item;
         
         // Listen to possible name changes.
         connect(name, SIGNAL(AttributeChanged(IAttribute *, AttributeChange::Type)), SLOT(UpdateEntityName(IAttribute *)), Qt::UniqueConnection);
@@ -3161,35 +3237,144 @@ void RocketBuildWidget::RemoveLight(const EntityPtr &lightEntity, bool removePar
     if (!lightEntity)
         return;
 
-    for(int i = 0; i < mainWidget.lightListWidget->count(); ++i)
+    EntityListWidgetItem *item = lightItems.take(lightEntity.get());
+    if (!item)
+        return;
+
+    lastClickedListItem = 0;
+    mainWidget.teleportsListWidget->setCurrentItem(item, QItemSelectionModel::Deselect | QItemSelectionModel::Clear);          
+
+    EntityPtr empty;
+    owner->SetSelection(empty);
+    SetActiveLightEntity(empty);
+    SAFE_DELETE(item);
+
+    /// @todo undo stack
+    if (removeParentEntity)
     {
-        EntityListWidgetItem *item = static_cast<EntityListWidgetItem *>(mainWidget.lightListWidget->item(i));
-        if (item->Entity() == lightEntity)
-        {
-            lastClickedListItem = 0;
-            mainWidget.teleportsListWidget->setCurrentItem(item, QItemSelectionModel::Deselect | QItemSelectionModel::Clear);          
+        ScenePtr scene = Scene();
+        if (scene)
+            scene->RemoveEntity(lightEntity->Id());
+    }
+    else
+    {
+        lightEntity->RemoveComponents(EC_Light::ComponentTypeId);
+    }
 
-            EntityPtr empty;
-            owner->SetSelection(empty);
-            SetActiveLightEntity(empty);
-            SAFE_DELETE(item);
+    RefreshCurrentObjectSelection();
+}
 
-            /// @todo undo stack
-            if (removeParentEntity)
-            {
-                ScenePtr scene = Scene();
-                if (scene)
-                    scene->RemoveEntity(lightEntity->Id());
-            }
-            else
-            {
-                lightEntity->RemoveComponents(EC_Light::ComponentTypeId);
-            }
+void RocketBuildWidget::RemoveLightItem(Entity *entity)
+{
+    EntityListWidgetItem *item = lightItems.take(entity);
+    if (!item)
+        return;
 
-            RefreshCurrentObjectSelection();
-            break;
-        }
+    if (lastClickedListItem == item)
+        lastClickedListItem = 0;
+    if (activeLightEntity.lock().get() == entity)
+    {
+        owner->SetSelection(EntityPtr());
+        SetActiveLightEntity(EntityPtr());
+        ScheduleRefresh(RefreshObjectSelection);
+    }
+    SAFE_DELETE(item);
+}
+
+bool RocketBuildWidget::BenchmarkLightRemoval(uint count)
+{
+    if (!Scene())
+    {
+        LogError("RocketBuildWidget::BenchmarkLightRemoval: FAILED, no scene.");
+        return false;
+    }
+
+    QStringList failures;
+    uint immediateRefreshes = 0, coalescedRefreshes = 0;
+    float immediateMsecs = 0.f, coalescedMsecs = 0.f;
+
+    coalesceRefreshes = false;
+    RunLightRemoval(count, failures, immediateRefreshes, immediateMsecs);
+    coalesceRefreshes = true;
+    RunLightRemoval(count, failures, coalescedRefreshes, coalescedMsecs);
+
+    const QString summary = QString("%1 lights, immediate refreshes: %2 refreshes in %3 msecs, coalesced refreshes: %4 refreshes in %5 msecs")
+        .arg(count).arg(immediateRefreshes).arg(immediateMsecs, 0, 'f', 2).arg(coalescedRefreshes).arg(coalescedMsecs, 0, 'f', 2);
+    if (!failures.isEmpty())
+    {
+        LogError("RocketBuildWidget::BenchmarkLightRemoval: FAILED, " + summary + ": " + failures.join(", "));
+        return false;
+    }
+    LogInfo("RocketBuildWidget::BenchmarkLightRemoval: " + summary);
+    return true;
+}
+
+void RocketBuildWidget::RunLightRemoval(uint count, QStringList &failures, uint &refreshes, float &msecs)
+{
+    ScenePtr scene = Scene();
+    const QStringList components = QStringList() << EC_Name::TypeNameStatic() << EC_Light::TypeNameStatic();
+    const QString mode = (coalesceRefreshes ? "coalesced" : "immediate");
+    const int itemsBefore = lightItems.size();
+    const int rowsBefore = mainWidget.lightListWidget->count();
+
+    // Refreshes left over from earlier scene changes are not part of the measurement.
+    ProcessPendingRefreshes();
+    refreshCount = 0;
+    kNet::PolledTimer timer;
+    timer.Start();
+
+    // Lights added outside the editor appear in the list as they are created.
+    EntityPtr selected = scene->CreateEntity(0, components, AttributeChange::LocalOnly, false, false, true);
+    if (!selected)
+    {
+        failures << mode + ": could not create test entities";
+        return;
     }
+    selected->SetName("BenchmarkLightRemovalSelected");
+    std::vector<EntityPtr> lights;
+    for(uint i = 0; i < count; ++i)
+    {
+        EntityPtr light = scene->CreateEntity(0, components, AttributeChange::LocalOnly, false, false, true);
+        if (!light)
+            continue;
+        light->SetName(QString("BenchmarkLightRemoval%1").arg(i));
+        lights.push_back(light);
+    }
+    if (lightItems.size() != itemsBefore + static_cast<int>(lights.size()) + 1)
+        failures << QString("%1: %2 light items after adding %3 lights to %4").arg(mode).arg(lightItems.size())
+            .arg(static_cast<int>(lights.size()) + 1).arg(itemsBefore);
+
+    EntityListWidgetItem *selectedItem = AddLight(selected->Component<EC_Light>(), true);
+    SetActiveLightEntity(selected);
+
+    // Removing unselected lights drops only their items.
+    const size_t unselected = lights.size() / 2;
+    for(size_t i = 0; i < unselected; ++i)
+        scene->RemoveEntity(lights[i]->Id(), AttributeChange::LocalOnly);
+    if (activeLightEntity.lock() != selected || mainWidget.lightListWidget->currentItem() != selectedItem)
+        failures << mode + ": selection was lost when removing unselected lights";
+
+    // Removing the selected light clears the selection and refreshes the object selection.
+    for(size_t i = unselected; i < lights.size(); ++i)
+    {
+        SetActiveLightEntity(lights[i]);
+        scene->RemoveEntity(lights[i]->Id(), AttributeChange::LocalOnly);
+    }
+    SetActiveLightEntity(selected);
+    scene->RemoveEntity(selected->Id(), AttributeChange::LocalOnly);
+    if (!activeLightEntity.expired())
+        failures << mode + ": removed selected light is still active";
+    selected.reset();
+    lights.clear();
+
+    // The coalesced refreshes would run on the next frame.
+    ProcessPendingRefreshes();
+    msecs = timer.MSecsElapsed();
+    refreshes = refreshCount;
+
+    if (lightItems.size() != itemsBefore || mainWidget.lightListWidget->count() != rowsBefore)
+        failures << QString("%1: %2 light items and %3 rows after removing the lights, expected %4 and %5").arg(mode)
+            .arg(lightItems.size()).arg(mainWidget.lightListWidget->count()).arg(itemsBefore).arg(rowsBefore);
 }
 
 void RocketBuildWidget::RemoveLight(const ComponentPtr &light, bool removeParentEntity)
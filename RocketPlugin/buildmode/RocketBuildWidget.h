@@ -30,6 +30,8 @@
 #include "InputFwd.h"
 
 #include <QPointer>
+#include <QHash>
+#include <QStringList>
 
 class EntityListWidgetItem;
 class AssetsWindow;
@@ -221,6 +223,42 @@ private:
 
     // Lights
     void ClearLightItems();
+
+    /// Removes list item of @c entity without touching the scene. Used when the scene is modified outside this editor.
+    void RemoveLightItem(Entity *entity);
+    void RemoveTeleportItem(Entity *entity); /**< @copydoc RemoveLightItem */
+
+    /// Runs RunLightRemoval with refreshes done immediately and coalesced, logs the number of refreshes and the time of both.
+    /** Used by the benchmarkLightRemoval console command of RocketBuildEditor.
+        @return False if any check of the light list and selection failed, the failures are logged. */
+    bool BenchmarkLightRemoval(uint count);
+
+    /// Adds @c count local lights and a selected one to the scene and removes them, half of them while each is selected.
+    /** Removing unselected lights must drop only their items and keep the selection, removing the selected light
+        must clear it. Pending refreshes are processed before returning.
+        @param refreshes Number of page refreshes done by ProcessPendingRefreshes.
+        @param msecs Time taken. */
+    void RunLightRemoval(uint count, QStringList &failures, uint &refreshes, float &msecs);
+
+    /// Parts of the UI that are refreshed by ProcessPendingRefreshes.
+    enum PendingRefresh
+    {
+        RefreshNothing = 0,
+        RefreshEnvironment = 1, ///< RefreshEnvironmentPage
+        RefreshTerrain = 2, ///< RefreshTerrainPage
+        RefreshEnvironmentLight = 4, ///< Environment light of the lights page.
+        RefreshPhysicsOptions = 8, ///< RefreshPhysicsEntityOptions
+        RefreshObjectSelection = 16 ///< RefreshCurrentObjectSelection
+    };
+
+    /// Schedules refresh of @c parts, combination of PendingRefresh flags, to be done once on the next frame.
+    void ScheduleRefresh(int parts);
+
+    /// Updates page models for a removed or added component and schedules needed refreshes.
+    void HandleComponentChange(Entity *entity, IComponent *component);
+
+    /// Finds the environment light component from the scene if not set.
+    void FindEnvironmentLight();
     void CreateSceneCamera();
     void FocusCameraToEntity(const EntityPtr &entity);
 
@@ -266,11 +304,19 @@ private:
     shared_ptr<TransformEditor> teleportTransformEditor;
 
     QListWidgetItem *lastClickedListItem;
+
+    // List items of the lights and teleports pages by entity.
+    QHash<Entity *, EntityListWidgetItem *> lightItems;
+    QHash<Entity *, EntityListWidgetItem *> teleportItems;
+
+    int pendingRefreshes; ///< PendingRefresh flags.
+    bool coalesceRefreshes; ///< If false, ScheduleRefresh refreshes immediately. Only turned off by RunLightRemoval.
+    uint refreshCount; ///< Number of page refreshes done by ProcessPendingRefreshes.
     std::list<weak_ptr<EC_Mesh> > activeGroup;
 
     // Physics-related:
     bool physicsDebugEnabled;
-    std::list<weak_ptr<EC_RigidBody> > rigidBodies;
+    std::map<EC_RigidBody *, weak_ptr<EC_RigidBody> > rigidBodies;
     ComponentWeakPtr activeRigidBody; ///< RigidBody of the currently active object.
 
     // Camera biz:
@@ -330,6 +376,7 @@ private slots:
     void OnEntityRemoved(Entity *entity);
     void OnComponentAdded(Entity *entity, IComponent *component);
     void OnComponentRemoved(Entity *entity, IComponent *component);
+    void ProcessPendingRefreshes();
 
     void SetMode(int modeIndex) { SetMode(static_cast<BuildMode>(modeIndex)); }
     void SetCameraMode(int modeIndex) { SetCameraMode(static_cast<BuildCameraMode>(modeIndex)); }
@@ -0,0 +1,65 @@
+/**
+    @author Adminotech Ltd.
+
+    Copyright Adminotech Ltd.
+    All rights reserved.
+
+    @file   RocketCloneEntitiesCommand.cpp
+    @brief  Undoable creation of many cloned entities in a single batch. */
+
+#include "StableHeaders.h"
+#include "DebugOperatorNew.h"
+
+#include "RocketCloneEntitiesCommand.h"
+
+#include "Scene.h"
+#include "Entity.h"
+
+#include "MemoryLeakCheck.h"
+
+RocketCloneEntitiesCommand::RocketCloneEntitiesCommand(const ScenePtr &scene, const QDomDocument &content, QUndoCommand *parent) :
+    QUndoCommand(parent),
+    scene_(scene),
+    content_(content)
+{
+    const int count = content_.documentElement().elementsByTagName("entity").count();
+    setText(count == 1 ? QString("Clone entity") : QString("Clone %1 entities").arg(count));
+}
+
+void RocketCloneEntitiesCommand::undo()
+{
+    ScenePtr scene = scene_.lock();
+    if (!scene)
+        return;
+
+    // Entities are tracked by pointer so that server side id changes of unacked entities don't matter.
+    for(std::vector<EntityWeakPtr>::const_iterator it = created_.begin(); it != created_.end(); ++it)
+    {
+        EntityPtr entity = it->lock();
+        if (entity)
+            scene->RemoveEntity(entity->Id(), AttributeChange::Replicate);
+    }
+    created_.clear();
+}
+
+void RocketCloneEntitiesCommand::redo()
+{
+    ScenePtr scene = scene_.lock();
+    if (!scene)
+        return;
+
+    created_.clear();
+    const QList<Entity *> entities = scene->CreateContentFromXml(content_, false, AttributeChange::Replicate);
+    created_.reserve(entities.size());
+    foreach(Entity *entity, entities)
+        created_.push_back(entity->shared_from_this());
+}
+
+EntityList RocketCloneEntitiesCommand::CreatedEntities() const
+{
+    EntityList entities;
+    for(std::vector<EntityWeakPtr>::const_iterator it = created_.begin(); it != created_.end(); ++it)
+        if (!it->expired())
+            entities.push_back(it->lock());
+    return entities;
+}
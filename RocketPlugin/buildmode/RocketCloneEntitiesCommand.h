@@ -0,0 +1,42 @@
+/**
+    @author Adminotech Ltd.
+
+    Copyright Adminotech Ltd.
+    All rights reserved.
+
+    @file   RocketCloneEntitiesCommand.h
+    @brief  Undoable creation of many cloned entities in a single batch. */
+
+#pragma once
+
+#include "SceneFwd.h"
+
+#include <QUndoCommand>
+#include <QDomDocument>
+
+#include <vector>
+
+/// @cond PRIVATE
+
+/// Creates all entities of a scene XML document in one batch, undo removes them.
+/** Entities are created with Scene::CreateContentFromXml so that all entities and components
+    exist before any creation signals are emitted and are replicated in a single pass, instead
+    of a chain of entity, component and attribute commands per entity. */
+class RocketCloneEntitiesCommand : public QUndoCommand
+{
+public:
+    RocketCloneEntitiesCommand(const ScenePtr &scene, const QDomDocument &content, QUndoCommand *parent = 0);
+
+    void undo();
+    void redo();
+
+    /// Returns entities created by the last redo.
+    EntityList CreatedEntities() const;
+
+private:
+    SceneWeakPtr scene_;
+    QDomDocument content_;
+    std::vector<EntityWeakPtr> created_;
+};
+
+/// @endcond
@@ -22,6 +22,7 @@
 #include "UiAPI.h"
 #include "InputAPI.h"
 #include "ConfigAPI.h"
+#include "ConsoleAPI.h"
 #include "UiMainWindow.h"
 #include "Entity.h"
 #include "EC_Camera.h"
@@ -41,6 +42,9 @@
 #include <OgreWorld.h>
 #include <OgreRenderWindow.h>
 #include <OgreHardwarePixelBuffer.h>
+#include <OgreViewport.h>
+
+#include <kNet/PolledTimer.h>
 
 #include <QKeySequence>
 #include <QMessageBox>
@@ -57,6 +61,8 @@ RocketCaveManager::RocketCaveManager(RocketPlugin* plugin) :
     widget_(0),
     caveAction_(0),
     caveEnabled(false),
+    sharedCulling_(true),
+    mainCameraCullingFrustum_(0),
     settingsLoadedFromCaveIni_(false),
 #ifdef ROCKET_OPENNI
     headTrackingEnabled(false),
@@ -66,6 +72,10 @@ RocketCaveManager::RocketCaveManager(RocketPlugin* plugin) :
     headTrackingEnabled(false)
 #endif
 {
+    if (framework_->HasCommandLineParameter("--rocketDevCommands"))
+        framework_->Console()->RegisterCommand("benchmarkCaveCulling", "Compares shared CAVE wall culling against per wall culling with random bounding boxes. Usage: benchmarkCaveCulling(boxes=20000)",
+            this, SLOT(BenchmarkCulling(const QString&)), SLOT(BenchmarkCulling()));
+
     if(framework_->IsHeadless())
         return;
 
@@ -182,6 +192,7 @@ RocketCaveManager::CAVEWindow::CAVEWindow() :
     window(0),
     rendertexture(0),
     camera(0),
+    cullingFrustum(0),
     nearClip(0.1f),
     farClip(2000.0f),
     type(TEXTURE),
@@ -331,9 +342,17 @@ void RocketCaveManager::CAVEWindow::CalculateProjection(RocketCaveManager *caveM
     camera->setOrientation(Ogre::Quaternion::IDENTITY);
     camera->setPosition(Ogre::Vector3::ZERO);
     camera->setNearClipDistance(nClip);
+
+    // Ogre::Camera delegates its frustum queries to the culling frustum, keep them identical.
+    if (cullingFrustum)
+    {
+        cullingFrustum->setCustomProjectionMatrix(true, final);
+        cullingFrustum->setNearClipDistance(nClip);
+        cullingFrustum->setFarClipDistance(fClip);
+    }
 }
 
-void RocketCaveManager::CAVEWindow::CreateCamera()
+void RocketCaveManager::CAVEWindow::CreateCamera(RocketCaveVisibility *visibility, int wall)
 {
     Ogre::Camera* original_cam = sceneData_.cameraEntity->GetComponent<EC_Camera>()->OgreCamera();
     if(!original_cam)
@@ -342,6 +361,13 @@ void RocketCaveManager::CAVEWindow::CreateCamera()
     camera = renderer_->GetActiveOgreWorld()->OgreSceneManager()->createCamera("CAVE_camera" + Ogre::StringConverter::toString(index));
     camera->setPosition(original_cam->getPosition());
     camera->setOrientation(Ogre::Quaternion::IDENTITY);
+
+    if(visibility)
+    {
+#include "DisableMemoryLeakCheck.h"
+        cullingFrustum = new RocketCaveCullingFrustum(visibility, wall);
+#include "EnableMemoryLeakCheck.h"
+    }
 }
 
 void RocketCaveManager::CAVEWindow::SetupViewport()
@@ -434,6 +460,14 @@ void RocketCaveManager::CAVEWindow::SetupCamera()
     farClip = ecCamera->farPlane.Get();
     camera->setNearClipDistance(nearClip);
     camera->setFarClipDistance(farClip);
+
+    if(cullingFrustum)
+    {
+        cullingFrustum->setCustomProjectionMatrix(false);
+        cullingFrustum->setNearClipDistance(nearClip);
+        cullingFrustum->setFarClipDistance(farClip);
+    }
+    camera->setCullingFrustum(cullingFrustum);
 }
 
 void RocketCaveManager::CAVEWindow::AttachCamera()
@@ -448,6 +482,15 @@ void RocketCaveManager::CAVEWindow::AttachCamera()
 
         if(sceneData_.cameraRoot)
             sceneData_.cameraRoot->attachObject(camera);
+
+        // Culling frustum follows the same node as the camera
+        if(cullingFrustum)
+        {
+            if(cullingFrustum->isAttached())
+                cullingFrustum->detachFromParent();
+            if(sceneData_.cameraRoot)
+                sceneData_.cameraRoot->attachObject(cullingFrustum);
+        }
     }
 }
 
@@ -490,6 +533,15 @@ void RocketCaveManager::CAVEWindow::DestroyViewport()
 
 void RocketCaveManager::CAVEWindow::DestroyCamera(Framework *framework)
 {
+    if(cullingFrustum)
+    {
+        if(camera)
+            camera->setCullingFrustum(0);
+        if(cullingFrustum->isAttached())
+            cullingFrustum->detachFromParent();
+        SAFE_DELETE(cullingFrustum);
+    }
+
     if(camera)
     {
         ScenePtr tundraScene = framework->Scene()->GetScene(sceneData_.sceneName);
@@ -689,6 +741,7 @@ void RocketCaveManager::LoadSettings()
     viewSettings_.viewportSize = framework_->Config()->Read(config, "viewport size").toSize();
     viewSettings_.viewCount = framework_->Config()->Read(config, "views").toInt();
     viewSettings_.fov = framework_->Config()->Read(config, "horizontal fov").toDouble();
+    sharedCulling_ = framework_->Config()->Read("rocketcave", "main", "shared culling", true).toBool();
 }
 
 #ifdef ROCKET_OPENNI
@@ -830,6 +883,9 @@ void RocketCaveManager::OnSceneAdded(const QString& sceneName)
 
 void RocketCaveManager::OnDestroyWindows(const QString& sceneName)
 {
+    // Stop listening to the render targets before they are destroyed
+    visibility_.Clear();
+
     foreach(CAVEWindow* window, CAVEWindows_)
     {
         window->DestroyViewport();
@@ -953,14 +1009,19 @@ void RocketCaveManager::SetCameraCulling()
     if(!ogreCamera)
         return;
 
+    // The main camera is not shown, cull everything with a degenerate frustum. Created once and
+    // intentionally never deleted as the main camera can outlive this manager.
+    if(!mainCameraCullingFrustum_)
+    {
 #include "DisableMemoryLeakCheck.h"
-    Ogre::Frustum *frustum = new Ogre::Frustum();
+        mainCameraCullingFrustum_ = new Ogre::Frustum();
 #include "EnableMemoryLeakCheck.h"
-    frustum->setNearClipDistance(0.1f);
-    frustum->setFarClipDistance(0.11f);
-    frustum->setFOVy(Ogre::Degree(45.f));
-    frustum->setAspectRatio(4.f/3.f);
-    ogreCamera->setCullingFrustum(frustum);
+        mainCameraCullingFrustum_->setNearClipDistance(0.1f);
+        mainCameraCullingFrustum_->setFarClipDistance(0.11f);
+        mainCameraCullingFrustum_->setFOVy(Ogre::Degree(45.f));
+        mainCameraCullingFrustum_->setAspectRatio(4.f/3.f);
+    }
+    ogreCamera->setCullingFrustum(mainCameraCullingFrustum_);
 }
 
 void RocketCaveManager::SetupViewports()
@@ -973,12 +1034,13 @@ void RocketCaveManager::SetupViewports()
     // Create root node for cameras
     sceneData_.CreateCameraRoot(framework_);
 
-    foreach(CAVEWindow* window, CAVEWindows_)
+    for(int i = 0; i < CAVEWindows_.size(); ++i)
     {
+        CAVEWindow *window = CAVEWindows_[i];
         if (window->viewportCreated)
             continue;
 
-        window->CreateCamera();
+        window->CreateCamera(sharedCulling_ ? &visibility_ : 0, i);
         window->SetupViewport();
         window->SetupCamera();
         window->CalculateProjection(this);
@@ -994,6 +1056,25 @@ void RocketCaveManager::SetupViewports()
         }
         window->CalculateProjection(this);
     }
+
+    SetupSharedCulling();
+}
+
+void RocketCaveManager::SetupSharedCulling()
+{
+    visibility_.Clear();
+    if (!sharedCulling_)
+        return;
+
+    QList<Ogre::Frustum*> frusta;
+    for(int i = 0; i < CAVEWindows_.size(); ++i)
+    {
+        CAVEWindow *window = CAVEWindows_[i];
+        frusta << window->cullingFrustum;
+        if (window->camera && window->camera->getViewport())
+            visibility_.RegisterViewport(window->camera->getViewport(), i);
+    }
+    visibility_.SetFrusta(frusta);
 }
 
 void RocketCaveManager::OnKeyPress(KeyEvent* e)
@@ -1006,3 +1087,84 @@ void RocketCaveManager::OnKeyPress(KeyEvent* e)
     if(e->Sequence() == showCaveSettings)
         widget_->Show();
 }
+
+void RocketCaveManager::BenchmarkCulling()
+{
+    BenchmarkCulling("20000");
+}
+
+void RocketCaveManager::BenchmarkCulling(const QString &boxes)
+{
+    const int numBoxes = qMax(boxes.trimmed().toInt(), 1);
+    const int numFrames = 10;
+    const float farClip = 500.f;
+
+    // Walls of the current CAVE setup in camera root space, or a 3x3x3 meter cube with front, side and floor walls.
+    QVector<RocketCaveVisibility::Wall> walls;
+    foreach(CAVEWindow *window, CAVEWindows_)
+        walls << RocketCaveVisibility::Wall::FromScreen(window->eye_position, window->top_left, window->bottom_left, window->bottom_right, window->nearClip, farClip);
+    if (walls.isEmpty())
+    {
+        const Ogre::Vector3 eye = Ogre::Vector3::ZERO;
+        walls << RocketCaveVisibility::Wall::FromScreen(eye, Ogre::Vector3(-1.5f, 1.5f, -1.5f), Ogre::Vector3(-1.5f, -1.5f, -1.5f), Ogre::Vector3(1.5f, -1.5f, -1.5f), 0.1f, farClip);
+        walls << RocketCaveVisibility::Wall::FromScreen(eye, Ogre::Vector3(-1.5f, 1.5f, 1.5f), Ogre::Vector3(-1.5f, -1.5f, 1.5f), Ogre::Vector3(-1.5f, -1.5f, -1.5f), 0.1f, farClip);
+        walls << RocketCaveVisibility::Wall::FromScreen(eye, Ogre::Vector3(1.5f, 1.5f, -1.5f), Ogre::Vector3(1.5f, -1.5f, -1.5f), Ogre::Vector3(1.5f, -1.5f, 1.5f), 0.1f, farClip);
+        walls << RocketCaveVisibility::Wall::FromScreen(eye, Ogre::Vector3(-1.5f, -1.5f, -1.5f), Ogre::Vector3(-1.5f, -1.5f, 1.5f), Ogre::Vector3(1.5f, -1.5f, 1.5f), 0.1f, farClip);
+    }
+
+    QVector<Ogre::AxisAlignedBox> bounds;
+    bounds.reserve(numBoxes);
+    const float range = farClip * 0.6f;
+    for(int i = 0; i < numBoxes; ++i)
+    {
+        Ogre::Vector3 center(Ogre::Math::RangeRandom(-range, range), Ogre::Math::RangeRandom(-range, range), Ogre::Math::RangeRandom(-range, range));
+        Ogre::Vector3 halfSize(Ogre::Math::RangeRandom(0.25f, 5.f), Ogre::Math::RangeRandom(0.25f, 5.f), Ogre::Math::RangeRandom(0.25f, 5.f));
+        bounds.push_back(Ogre::AxisAlignedBox(center - halfSize, center + halfSize));
+    }
+
+    // Per wall culling, each wall tests every box like a separate Ogre camera does.
+    QVector<quint32> perWallMasks(numBoxes, 0);
+    kNet::PolledTimer timer;
+    timer.Start();
+    for(int frame = 0; frame < numFrames; ++frame)
+        for(int w = 0; w < walls.size(); ++w)
+            for(int i = 0; i < numBoxes; ++i)
+                if (walls[w].IsVisible(bounds[i]))
+                    perWallMasks[i] |= (1u << w);
+    const float perWallMsecs = timer.MSecsElapsed();
+
+    // Shared culling, the first wall tests each box against all walls and the rest reuse the result.
+    RocketCaveVisibility shared;
+    QVector<quint32> sharedMasks(numBoxes, 0);
+    timer.Start();
+    for(int frame = 0; frame < numFrames; ++frame)
+    {
+        shared.BeginFrame(walls);
+        for(int w = 0; w < walls.size(); ++w)
+            for(int i = 0; i < numBoxes; ++i)
+                if (shared.IsVisible(w, bounds[i]))
+                    sharedMasks[i] |= (1u << w);
+    }
+    const float sharedMsecs = timer.MSecsElapsed();
+
+    int mismatches = 0;
+    int visible = 0;
+    for(int i = 0; i < numBoxes; ++i)
+    {
+        if (perWallMasks[i] != sharedMasks[i])
+            ++mismatches;
+        if (perWallMasks[i] != 0)
+            ++visible;
+    }
+
+    const RocketCaveVisibility::Stats &stats = shared.Statistics();
+    LogInfo(QString("[RocketCaveManager]: Culling %1 boxes on %2 walls for %3 frames, %4 boxes visible on any wall")
+        .arg(numBoxes).arg(walls.size()).arg(numFrames).arg(visible));
+    LogInfo(QString("    Per wall: %1 msecs").arg(perWallMsecs, 0, 'f', 2));
+    LogInfo(QString("    Shared:   %1 msecs, %2 tests, %3 union rejects, %4 ordered and %5 hashed reuses")
+        .arg(sharedMsecs, 0, 'f', 2).arg(stats.tests).arg(stats.unionRejects).arg(stats.orderedHits).arg(stats.hashedHits));
+    if (mismatches > 0)
+        LogError(QString("[RocketCaveManager]: Shared culling differs from per wall culling for %1 boxes").arg(mismatches));
+    else
+        LogInfo("    Visible sets are identical");
+}
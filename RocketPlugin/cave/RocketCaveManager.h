@@ -14,6 +14,7 @@
 #include "InputFwd.h"
 
 #include "RocketMenu.h"
+#include "RocketCaveVisibility.h"
 
 #ifdef ROCKET_OPENNI
 #include "RocketOpenNIPluginFwd.h"
@@ -84,6 +85,13 @@ private slots:
 
     void LoadSettings();
 
+    /// Shares the culling of all wall cameras, see RocketCaveVisibility.
+    void SetupSharedCulling();
+
+    /// Compares shared culling against per wall culling with random boxes, CPU only.
+    void BenchmarkCulling(const QString &boxes);
+    void BenchmarkCulling(); /**< @overload */
+
 #ifdef ROCKET_OPENNI
     void TrackingUserFound(TrackingUser *user);
     void TrackingUserLost(TrackingUser *user);
@@ -153,6 +161,9 @@ private:
         Ogre::RenderWindow *window;
 
         Ogre::Camera *camera;
+
+        // Culling frustum of camera if culling is shared between walls
+        RocketCaveCullingFrustum *cullingFrustum;
         
         int index;
         bool viewportCreated;
@@ -165,7 +176,7 @@ private:
         void CalculateViewDimensions();
         void CalculateProjection(RocketCaveManager *caveManager_);
 
-        void CreateCamera();
+        void CreateCamera(RocketCaveVisibility *visibility, int wall);
         void SetupViewport();
         void SetupCamera();
         void AttachCamera();
@@ -192,9 +203,13 @@ private:
 
     bool caveEnabled;
     bool headTrackingEnabled;
+    bool sharedCulling_;
 
     QList<CAVEWindow*> CAVEWindows_;
 
+    RocketCaveVisibility visibility_;
+    Ogre::Frustum *mainCameraCullingFrustum_;
+
     static ViewSettings viewSettings_;
     static SceneData sceneData_;
     static OgreRenderer::Renderer *renderer_;
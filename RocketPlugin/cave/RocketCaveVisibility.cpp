@@ -0,0 +1,301 @@
+/**
+    @author Adminotech Ltd.
+
+    Copyright Adminotech Ltd.
+    All rights reserved.
+
+    @file   RocketCaveVisibility.cpp
+    @brief  Shared frustum culling of all CAVE wall cameras. */
+
+#include "StableHeaders.h"
+#include "DebugOperatorNew.h"
+
+#include "RocketCaveVisibility.h"
+
+#include <OgreViewport.h>
+#include <OgreRenderTarget.h>
+
+#include "MemoryLeakCheck.h"
+
+// RocketCaveVisibility::Wall
+
+RocketCaveVisibility::Wall RocketCaveVisibility::Wall::FromFrustum(const Ogre::Frustum *frustum)
+{
+    Wall wall;
+    if (!frustum)
+        return wall;
+
+    const Ogre::Plane *planes = frustum->getFrustumPlanes();
+    for(int i = 0; i < 6; ++i)
+        wall.planes[i] = planes[i];
+
+    const Ogre::Vector3 *corners = frustum->getWorldSpaceCorners();
+    for(int i = 0; i < 8; ++i)
+        wall.corners[i] = corners[i];
+
+    wall.infiniteFar = (frustum->getFarClipDistance() == 0);
+    return wall;
+}
+
+RocketCaveVisibility::Wall RocketCaveVisibility::Wall::FromScreen(const Ogre::Vector3 &eye, const Ogre::Vector3 &topLeft, const Ogre::Vector3 &bottomLeft,
+    const Ogre::Vector3 &bottomRight, float nearClip, float farClip, const Ogre::Matrix4 &transform)
+{
+    Wall wall;
+
+    Ogre::Vector3 screenRight = (bottomRight - bottomLeft).normalisedCopy();
+    Ogre::Vector3 screenUp = (topLeft - bottomLeft).normalisedCopy();
+    Ogre::Vector3 screenNormal = screenUp.crossProduct(screenRight).normalisedCopy();
+
+    Ogre::Real dist = screenNormal.dotProduct(bottomLeft - eye);
+    if (Ogre::Math::Abs(dist) < 1e-6f)
+        dist = 1e-6f;
+
+    // Infinite far clip still needs far corners for the side planes.
+    const float cornerFar = (farClip > 0 ? farClip : nearClip * 100.f);
+
+    // Near and far corners in the same order as Ogre::Frustum::getWorldSpaceCorners.
+    const Ogre::Vector3 topRight = topLeft + (bottomRight - bottomLeft);
+    const Ogre::Vector3 screen[4] = { topRight, topLeft, bottomLeft, bottomRight };
+    for(int i = 0; i < 4; ++i)
+    {
+        wall.corners[i] = transform * (eye + (screen[i] - eye) * (nearClip / dist));
+        wall.corners[i + 4] = transform * (eye + (screen[i] - eye) * (cornerFar / dist));
+    }
+    const Ogre::Vector3 worldEye = transform * eye;
+
+    Ogre::Vector3 center = Ogre::Vector3::ZERO;
+    for(int i = 0; i < 8; ++i)
+        center += wall.corners[i];
+    center /= 8.f;
+
+    wall.planes[Ogre::FRUSTUM_PLANE_NEAR].redefine(wall.corners[0], wall.corners[1], wall.corners[2]);
+    wall.planes[Ogre::FRUSTUM_PLANE_FAR].redefine(wall.corners[4], wall.corners[5], wall.corners[6]);
+    wall.planes[Ogre::FRUSTUM_PLANE_LEFT].redefine(worldEye, wall.corners[5], wall.corners[6]);
+    wall.planes[Ogre::FRUSTUM_PLANE_RIGHT].redefine(worldEye, wall.corners[4], wall.corners[7]);
+    wall.planes[Ogre::FRUSTUM_PLANE_TOP].redefine(worldEye, wall.corners[4], wall.corners[5]);
+    wall.planes[Ogre::FRUSTUM_PLANE_BOTTOM].redefine(worldEye, wall.corners[6], wall.corners[7]);
+
+    // Make all planes face inwards.
+    for(int i = 0; i < 6; ++i)
+    {
+        if (wall.planes[i].getDistance(center) < 0)
+        {
+            wall.planes[i].normal = -wall.planes[i].normal;
+            wall.planes[i].d = -wall.planes[i].d;
+        }
+    }
+    wall.infiniteFar = (farClip == 0);
+    return wall;
+}
+
+bool RocketCaveVisibility::Wall::IsVisible(const Ogre::AxisAlignedBox &box) const
+{
+    if (box.isNull())
+        return false;
+    if (box.isInfinite())
+        return true;
+
+    const Ogre::Vector3 centre = box.getCenter();
+    const Ogre::Vector3 halfSize = box.getHalfSize();
+    for(int i = 0; i < 6; ++i)
+    {
+        if (i == Ogre::FRUSTUM_PLANE_FAR && infiniteFar)
+            continue;
+        if (planes[i].getSide(centre, halfSize) == Ogre::Plane::NEGATIVE_SIDE)
+            return false;
+    }
+    return true;
+}
+
+// RocketCaveVisibility
+
+RocketCaveVisibility::RocketCaveVisibility() :
+    updatedWalls_(0),
+    dirty_(true),
+    allWalls_(0)
+{
+    for(int i = 0; i < cMaxWalls; ++i)
+        cursors_[i] = 0;
+}
+
+RocketCaveVisibility::~RocketCaveVisibility()
+{
+    Clear();
+}
+
+void RocketCaveVisibility::SetFrusta(const QList<Ogre::Frustum*> &frusta)
+{
+    frusta_ = frusta.mid(0, cMaxWalls);
+    Invalidate();
+}
+
+void RocketCaveVisibility::RegisterViewport(Ogre::Viewport *viewport, int wall)
+{
+    if (!viewport || !viewport->getTarget() || wall < 0 || wall >= cMaxWalls)
+        return;
+
+    viewportWalls_[viewport] = wall;
+    Ogre::RenderTarget *target = viewport->getTarget();
+    if (!targets_.contains(target))
+    {
+        target->addListener(this);
+        targets_ << target;
+    }
+}
+
+void RocketCaveVisibility::Clear()
+{
+    foreach(Ogre::RenderTarget *target, targets_)
+        target->removeListener(this);
+    targets_.clear();
+    viewportWalls_.clear();
+    frusta_.clear();
+    walls_.clear();
+    updatedWalls_ = 0;
+    Invalidate();
+}
+
+void RocketCaveVisibility::BeginFrame(const QVector<Wall> &walls)
+{
+    ClearResults();
+    walls_ = walls.mid(0, cMaxWalls);
+    dirty_ = false;
+
+    allWalls_ = 0;
+    unionBounds_.setNull();
+    for(int w = 0; w < walls_.size(); ++w)
+    {
+        allWalls_ |= (1u << w);
+        // Frusta from the eye can be infinite, the union is then not bounded.
+        if (walls_[w].infiniteFar)
+            unionBounds_.setInfinite();
+        else if (!unionBounds_.isInfinite())
+            for(int i = 0; i < 8; ++i)
+                unionBounds_.merge(walls_[w].corners[i]);
+    }
+}
+
+void RocketCaveVisibility::Invalidate()
+{
+    ClearResults();
+    dirty_ = true;
+}
+
+void RocketCaveVisibility::ClearResults()
+{
+    entries_.clear();
+    index_.clear();
+    for(int i = 0; i < cMaxWalls; ++i)
+        cursors_[i] = 0;
+}
+
+void RocketCaveVisibility::RebuildWalls()
+{
+    QVector<Wall> walls;
+    walls.reserve(frusta_.size());
+    foreach(Ogre::Frustum *frustum, frusta_)
+        walls.push_back(Wall::FromFrustum(frustum));
+    BeginFrame(walls);
+}
+
+quint32 RocketCaveVisibility::WallMask(int wall, const Ogre::AxisAlignedBox &box)
+{
+    if (dirty_)
+        RebuildWalls();
+    if (box.isNull())
+        return 0;
+    if (box.isInfinite())
+        return allWalls_;
+    if (wall < 0 || wall >= cMaxWalls)
+        return Test(box);
+
+    // Same box as the next one in the visit order of the walls before.
+    int &cursor = cursors_[wall];
+    if (cursor < entries_.size())
+    {
+        const Entry &entry = entries_[cursor];
+        if (entry.box == &box && entry.minimum == box.getMinimum() && entry.maximum == box.getMaximum())
+        {
+            ++cursor;
+            ++stats_.orderedHits;
+            return entry.mask;
+        }
+    }
+
+    QHash<const Ogre::AxisAlignedBox*, int>::const_iterator iter = index_.find(&box);
+    if (iter != index_.end())
+    {
+        Entry &entry = entries_[iter.value()];
+        cursor = iter.value() + 1;
+        if (entry.minimum == box.getMinimum() && entry.maximum == box.getMaximum())
+        {
+            ++stats_.hashedHits;
+            return entry.mask;
+        }
+        // Box has moved since it was tested, eg. by an animation between the viewport updates.
+        entry.minimum = box.getMinimum();
+        entry.maximum = box.getMaximum();
+        entry.mask = Test(box);
+        return entry.mask;
+    }
+
+    Entry entry;
+    entry.box = &box;
+    entry.minimum = box.getMinimum();
+    entry.maximum = box.getMaximum();
+    entry.mask = Test(box);
+    index_[&box] = entries_.size();
+    entries_.push_back(entry);
+    cursor = entries_.size();
+    return entry.mask;
+}
+
+quint32 RocketCaveVisibility::Test(const Ogre::AxisAlignedBox &box)
+{
+    ++stats_.tests;
+    if (!unionBounds_.intersects(box))
+    {
+        ++stats_.unionRejects;
+        return 0;
+    }
+
+    quint32 mask = 0;
+    for(int w = 0; w < walls_.size(); ++w)
+        if (walls_[w].IsVisible(box))
+            mask |= (1u << w);
+    return mask;
+}
+
+void RocketCaveVisibility::preViewportUpdate(const Ogre::RenderTargetViewportEvent &evt)
+{
+    QHash<Ogre::Viewport*, int>::const_iterator iter = viewportWalls_.find(evt.source);
+    if (iter == viewportWalls_.end())
+        return;
+
+    // A wall is updated again, the cameras may have moved since the results were cached.
+    const quint32 bit = (1u << iter.value());
+    if (updatedWalls_ & bit)
+    {
+        Invalidate();
+        updatedWalls_ = 0;
+    }
+    updatedWalls_ |= bit;
+    cursors_[iter.value()] = 0;
+}
+
+// RocketCaveCullingFrustum
+
+RocketCaveCullingFrustum::RocketCaveCullingFrustum(RocketCaveVisibility *visibility, int wall) :
+    visibility_(visibility),
+    wall_(wall)
+{
+    // Only used for culling, never rendered.
+    setVisible(false);
+}
+
+bool RocketCaveCullingFrustum::isVisible(const Ogre::AxisAlignedBox &bound, Ogre::FrustumPlane *culledBy) const
+{
+    if (!visibility_)
+        return Ogre::Frustum::isVisible(bound, culledBy);
+    return visibility_->IsVisible(wall_, bound);
+}
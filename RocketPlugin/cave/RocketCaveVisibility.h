@@ -0,0 +1,146 @@
+/**
+    @author Adminotech Ltd.
+
+    Copyright Adminotech Ltd.
+    All rights reserved.
+
+    @file   RocketCaveVisibility.h
+    @brief  Shared frustum culling of all CAVE wall cameras. */
+
+#pragma once
+
+#include <OgrePlane.h>
+#include <OgreAxisAlignedBox.h>
+#include <OgreFrustum.h>
+#include <OgreMatrix4.h>
+#include <OgreRenderTargetListener.h>
+
+#include <QVector>
+#include <QHash>
+#include <QList>
+
+/// @cond PRIVATE
+
+/// Shared visibility of all CAVE walls for one frame.
+/** The first time a bounding box is tested in a frame it is tested against the bounds of the union
+    of all wall frusta, and if inside, against every wall at once. The remaining walls reuse the result.
+    Ogre visits the scene in the same order for each viewport, so the result is usually found from the
+    next slot of the previous wall's visit order without a hash lookup. */
+class RocketCaveVisibility : public Ogre::RenderTargetListener
+{
+public:
+    /// Culling volume of a single wall.
+    struct Wall
+    {
+        Ogre::Plane planes[6];      ///< Inward facing planes in Ogre::FrustumPlane order.
+        Ogre::Vector3 corners[8];   ///< Near corners followed by far corners.
+        bool infiniteFar;           ///< Far plane is not tested.
+
+        Wall() : infiniteFar(false) {}
+
+        /// Builds the wall from the world space planes and corners of @c frustum.
+        static Wall FromFrustum(const Ogre::Frustum *frustum);
+
+        /// Builds the off-axis frustum from @c eye through the screen corners, transformed with @c transform.
+        /** Uses the same geometry as RocketCaveManager::CAVEWindow::CalculateProjection. */
+        static Wall FromScreen(const Ogre::Vector3 &eye, const Ogre::Vector3 &topLeft, const Ogre::Vector3 &bottomLeft,
+            const Ogre::Vector3 &bottomRight, float nearClip, float farClip, const Ogre::Matrix4 &transform = Ogre::Matrix4::IDENTITY);
+
+        /// Returns if @c box is at least partially inside the wall, same test as Ogre::Frustum::isVisible.
+        bool IsVisible(const Ogre::AxisAlignedBox &box) const;
+    };
+
+    struct Stats
+    {
+        uint tests;         ///< Boxes tested against the walls.
+        uint unionRejects;  ///< Tested boxes rejected by the union bounds.
+        uint orderedHits;   ///< Results reused from the previous wall's visit order.
+        uint hashedHits;    ///< Results reused with a hash lookup.
+
+        Stats() : tests(0), unionRejects(0), orderedHits(0), hashedHits(0) {}
+    };
+
+    RocketCaveVisibility();
+    ~RocketCaveVisibility();
+
+    /// Sets the culling frusta of the walls, wall index is the index in @c frusta.
+    /** Walls are rebuilt from the frusta on the first test after each Invalidate. */
+    void SetFrusta(const QList<Ogre::Frustum*> &frusta);
+
+    /// Invalidates the results when any viewport of @c wall is updated the second time, ie. on the next frame.
+    void RegisterViewport(Ogre::Viewport *viewport, int wall);
+
+    /// Removes all frusta, viewports and cached results.
+    void Clear();
+
+    /// Starts a new frame with explicit @c walls instead of frusta. Clears cached results.
+    void BeginFrame(const QVector<Wall> &walls);
+
+    /// Clears cached results, walls are rebuilt from the frusta on the next test.
+    void Invalidate();
+
+    /// Returns if @c box is visible on @c wall.
+    bool IsVisible(int wall, const Ogre::AxisAlignedBox &box) { return (WallMask(wall, box) & (1u << wall)) != 0; }
+
+    /// Returns bitmask of the walls that see @c box.
+    /** @param Wall that is querying, used to track its visit order. */
+    quint32 WallMask(int wall, const Ogre::AxisAlignedBox &box);
+
+    const Stats &Statistics() const { return stats_; }
+    void ResetStatistics() { stats_ = Stats(); }
+
+    /// Ogre::RenderTargetListener override.
+    void preViewportUpdate(const Ogre::RenderTargetViewportEvent &evt);
+
+    /// Maximum number of walls.
+    static const int cMaxWalls = 32;
+
+private:
+    struct Entry
+    {
+        const Ogre::AxisAlignedBox *box;
+        Ogre::Vector3 minimum;
+        Ogre::Vector3 maximum;
+        quint32 mask;
+    };
+
+    void RebuildWalls();
+    void ClearResults();
+    quint32 Test(const Ogre::AxisAlignedBox &box);
+
+    QList<Ogre::Frustum*> frusta_;
+    QHash<Ogre::Viewport*, int> viewportWalls_;
+    QList<Ogre::RenderTarget*> targets_;
+    quint32 updatedWalls_;  ///< Walls whose viewports have been updated since the last Invalidate.
+    bool dirty_;
+
+    QVector<Wall> walls_;
+    Ogre::AxisAlignedBox unionBounds_;
+    quint32 allWalls_;
+
+    QVector<Entry> entries_;                        ///< Results in the order they were tested.
+    QHash<const Ogre::AxisAlignedBox*, int> index_; ///< Box to index in entries_.
+    int cursors_[cMaxWalls];                        ///< Next expected entry per wall.
+
+    Stats stats_;
+};
+
+/// Culling frustum of a CAVE wall camera that reads its results from RocketCaveVisibility.
+/** Must be attached to the same scene node and have the same projection as the camera,
+    Ogre::Camera delegates other frustum queries to the culling frustum as well. */
+class RocketCaveCullingFrustum : public Ogre::Frustum
+{
+public:
+    RocketCaveCullingFrustum(RocketCaveVisibility *visibility, int wall);
+
+    using Ogre::Frustum::isVisible;
+
+    /// Ogre::Frustum override.
+    bool isVisible(const Ogre::AxisAlignedBox &bound, Ogre::FrustumPlane *culledBy = 0) const;
+
+private:
+    RocketCaveVisibility *visibility_;
+    int wall_;
+};
+
+/// @endcond
@@ -10,6 +10,7 @@
 #include "StableHeaders.h"
 #include "RocketParticleEditor.h"
 #include "RocketMaterialEditor.h"
+#include "RocketParticleProfiler.h"
 
 #include "RocketPlugin.h"
 #include "RocketNotifications.h"
@@ -258,6 +259,9 @@ RocketParticleEditor::RocketParticleEditor(RocketPlugin *plugin, MeshmoonStorage
     connect(ui_.cullEachCheckBox, SIGNAL(clicked(bool)), SLOT(OnCullEachChanged(bool)));
     connect(ui_.localSpaceCheckBox, SIGNAL(clicked(bool)), SLOT(OnLocalSpaceChanged(bool)));
     connect(ui_.accurateFacingCheckBox, SIGNAL(clicked(bool)), SLOT(OnAccurateFacingChanged(bool)));
+
+    QAction *profileAction = ToolsMenu()->addAction("Profile Cost...");
+    connect(profileAction, SIGNAL(triggered()), SLOT(OnProfileCost()));
 }
 
 RocketParticleEditor::~RocketParticleEditor()
@@ -860,6 +864,36 @@ void RocketParticleEditor::WriteIndent(QTextStream &s, int indentLevel)
         s << "    ";
 }
 
+void RocketParticleEditor::OnProfileCost()
+{
+    Ogre::ParticleSystem *p = GetSystem();
+    if (!p)
+    {
+        ShowError("Profiling Failed", "Particle system is not loaded.");
+        return;
+    }
+
+    // Profiles the current unsaved state of the template.
+    RocketParticleProfiler::Settings settings;
+    RocketParticleProfiler::Result result;
+    QString error;
+    if (!RocketParticleProfiler::Profile(p, settings, result, &error))
+    {
+        ShowError("Profiling Failed", error);
+        return;
+    }
+    result.source = filename;
+
+    QString summary = QString("Peak %1 particles, update %2 ms").arg(result.peakParticles).arg(result.averageUpdateMsecs, 0, 'f', 3);
+    if (!result.fill.isEmpty())
+        summary += QString(", overdraw %1x at %2 m").arg(result.fill.first().averageOverdraw, 0, 'f', 1).arg(result.fill.first().distance, 0, 'f', 0);
+    SetMessage(summary);
+
+    RocketParticleProfiler::ShowReport("Particle Cost - " + filename, QString("Simulated %1 seconds at %2 fps, fill on a %3x%4 screen with %5 degree vertical FOV\n\n")
+        .arg(settings.seconds).arg(settings.frameRate).arg(settings.screenSize.width()).arg(settings.screenSize.height()).arg(settings.verticalFov)
+        + RocketParticleProfiler::FormatResult(result), this);
+}
+
 Ogre::ParticleSystem *RocketParticleEditor::GetSystem() const
 {
     if (particle_.expired() || !particle_.lock()->IsLoaded())
@@ -123,6 +123,9 @@ private slots:
     void OnBillboardRotationTypeChanged(int type, bool apply = true);
     
     void OnEmitterOrAffectorTouched() { Touched(); }
+
+    // Runs RocketParticleProfiler for the edited system and shows the report.
+    void OnProfileCost();
     
     /// Get the underlying Ogre::Particle system of OgreParticleAsset.
     Ogre::ParticleSystem *GetSystem() const;
@@ -0,0 +1,379 @@
+/**
+    @author Adminotech Ltd.
+
+    Copyright Adminotech Ltd.
+    All rights reserved.
+
+    @file   RocketParticleProfiler.cpp
+    @brief  Headless cost estimation for Ogre particle system templates. */
+
+#include "StableHeaders.h"
+#include "DebugOperatorNew.h"
+
+#include "RocketParticleProfiler.h"
+
+#include "Framework.h"
+#include "AssetAPI.h"
+#include "IAsset.h"
+#include "IAssetTransfer.h"
+#include "LoggingFunctions.h"
+
+#include "OgreParticleAsset.h"
+
+#include <OgreRoot.h>
+#include <OgreSceneManager.h>
+#include <OgreSceneNode.h>
+#include <OgreParticleSystemManager.h>
+#include <OgreParticleSystem.h>
+#include <OgreParticle.h>
+#include <OgreStringConverter.h>
+
+#include <QElapsedTimer>
+#include <QDialog>
+#include <QVBoxLayout>
+#include <QPlainTextEdit>
+#include <QTextStream>
+#include <QVector>
+
+#include <algorithm>
+#include <cmath>
+
+#include "MemoryLeakCheck.h"
+
+/// @cond PRIVATE
+
+namespace
+{
+    bool MoreFill(const RocketParticleProfiler::Result &a, const RocketParticleProfiler::Result &b)
+    {
+        return a.NearFillScreens() > b.NearFillScreens();
+    }
+
+    bool MoreUpdateTime(const RocketParticleProfiler::Result &a, const RocketParticleProfiler::Result &b)
+    {
+        return a.averageUpdateMsecs > b.averageUpdateMsecs;
+    }
+
+    bool MoreParticles(const RocketParticleProfiler::Result &a, const RocketParticleProfiler::Result &b)
+    {
+        return a.peakParticles > b.peakParticles;
+    }
+}
+
+RocketParticleProfiler::Settings::Settings() :
+    seconds(10.f),
+    frameRate(60.f),
+    screenSize(1920, 1080),
+    verticalFov(45.f)
+{
+    distances << 5.f << 15.f << 40.f;
+}
+
+bool RocketParticleProfiler::Profile(const QString &templateName, const Settings &settings, Result &result, QString *error)
+{
+    Ogre::ParticleSystem *particleTemplate = 0;
+    try
+    {
+        particleTemplate = Ogre::ParticleSystemManager::getSingleton().getTemplate(templateName.toStdString());
+    }
+    catch(Ogre::Exception &/*e*/) { }
+    if (!particleTemplate)
+    {
+        if (error)
+            *error = "Particle system template " + templateName + " does not exist";
+        return false;
+    }
+    return Profile(particleTemplate, settings, result, error);
+}
+
+bool RocketParticleProfiler::Profile(Ogre::ParticleSystem *particleTemplate, const Settings &settings, Result &result, QString *error)
+{
+    Ogre::Root *root = Ogre::Root::getSingletonPtr();
+    if (!particleTemplate || !root)
+    {
+        if (error)
+            *error = (!root ? "Ogre is not initialized" : "Particle system template is null");
+        return false;
+    }
+    if (settings.seconds <= 0.f || settings.frameRate <= 0.f || settings.screenSize.isEmpty())
+    {
+        if (error)
+            *error = "Invalid profiler settings";
+        return false;
+    }
+
+    result = Result();
+    result.name = QString::fromStdString(particleTemplate->getName());
+    result.quota = static_cast<int>(particleTemplate->getParticleQuota());
+
+    const float dt = 1.f / settings.frameRate;
+    const int frames = std::max(1, static_cast<int>(settings.seconds * settings.frameRate + 0.5f));
+    const float screenPixels = static_cast<float>(settings.screenSize.width()) * settings.screenSize.height();
+    // Pixels per world unit at distance 1.
+    const float focal = (settings.screenSize.height() * 0.5f) / std::tan(settings.verticalFov * 0.5f * 3.14159265f / 180.f);
+
+    const int numDistances = settings.distances.size();
+    QVector<double> fillSum(numDistances, 0.0), overdrawSum(numDistances, 0.0);
+    QVector<float> fillPeak(numDistances, 0.f);
+
+    static int profilerId = 0;
+    const std::string id = "RocketParticleProfiler_" + Ogre::StringConverter::toString(++profilerId);
+
+    Ogre::SceneManager *sceneManager = 0;
+    Ogre::ParticleSystem *system = 0;
+    Ogre::SceneNode *node = 0;
+    double particleSum = 0.0;
+    qint64 updateNsecs = 0, peakNsecs = 0;
+    try
+    {
+        sceneManager = root->createSceneManager(Ogre::ST_GENERIC, id);
+        system = sceneManager->createParticleSystem(id, particleTemplate->getParticleQuota());
+        *system = *particleTemplate;
+        // Updates are skipped when the system has not been rendered within the timeout.
+        system->setNonVisibleUpdateTimeout(0.f);
+        node = sceneManager->getRootSceneNode()->createChildSceneNode();
+        node->attachObject(system);
+
+        QElapsedTimer timer;
+        for(int frame = 0; frame < frames; ++frame)
+        {
+            timer.start();
+            system->_update(dt);
+            const qint64 nsecs = timer.nsecsElapsed();
+            updateNsecs += nsecs;
+            peakNsecs = std::max(peakNsecs, nsecs);
+
+            const size_t count = system->getNumParticles();
+            particleSum += count;
+            result.peakParticles = std::max(result.peakParticles, static_cast<int>(count));
+            if (count == 0 || numDistances == 0)
+                continue;
+
+            // World space areas and the extents seen by a camera looking along -Z.
+            const float defaultWidth = system->getDefaultWidth(), defaultHeight = system->getDefaultHeight();
+            float minX = 1e30f, minY = 1e30f, maxX = -1e30f, maxY = -1e30f;
+            QVector<float> widths(static_cast<int>(count)), heights(static_cast<int>(count));
+            for(size_t i = 0; i < count; ++i)
+            {
+                Ogre::Particle *particle = system->getParticle(i);
+                const float w = (particle->hasOwnDimensions() ? particle->getOwnWidth() : defaultWidth);
+                const float h = (particle->hasOwnDimensions() ? particle->getOwnHeight() : defaultHeight);
+                widths[static_cast<int>(i)] = w;
+                heights[static_cast<int>(i)] = h;
+                minX = std::min(minX, particle->position.x - w * 0.5f);
+                maxX = std::max(maxX, particle->position.x + w * 0.5f);
+                minY = std::min(minY, particle->position.y - h * 0.5f);
+                maxY = std::max(maxY, particle->position.y + h * 0.5f);
+            }
+
+            for(int d = 0; d < numDistances; ++d)
+            {
+                const float scale = focal / std::max(0.01f, settings.distances[d]);
+                double pixels = 0.0;
+                for(int i = 0; i < widths.size(); ++i)
+                    pixels += std::min(widths[i] * scale, static_cast<float>(settings.screenSize.width())) *
+                        std::min(heights[i] * scale, static_cast<float>(settings.screenSize.height()));
+                const float covered = std::min((maxX - minX) * scale, static_cast<float>(settings.screenSize.width())) *
+                    std::min((maxY - minY) * scale, static_cast<float>(settings.screenSize.height()));
+
+                const float screens = static_cast<float>(pixels / screenPixels);
+                fillSum[d] += screens;
+                fillPeak[d] = std::max(fillPeak[d], screens);
+                overdrawSum[d] += (covered > 0.f ? pixels / covered : 0.0);
+            }
+        }
+
+        node->detachObject(system);
+        sceneManager->destroyParticleSystem(system);
+        root->destroySceneManager(sceneManager);
+    }
+    catch(Ogre::Exception &e)
+    {
+        if (sceneManager)
+            root->destroySceneManager(sceneManager);
+        if (error)
+            *error = QString::fromStdString(e.getDescription());
+        return false;
+    }
+
+    result.frames = frames;
+    result.averageParticles = static_cast<float>(particleSum / frames);
+    result.averageUpdateMsecs = static_cast<float>(updateNsecs / 1000000.0 / frames);
+    result.peakUpdateMsecs = static_cast<float>(peakNsecs / 1000000.0);
+    for(int d = 0; d < numDistances; ++d)
+    {
+        Fill fill;
+        fill.distance = settings.distances[d];
+        fill.averageScreens = static_cast<float>(fillSum[d] / frames);
+        fill.peakScreens = fillPeak[d];
+        fill.averageOverdraw = static_cast<float>(overdrawSum[d] / frames);
+        result.fill << fill;
+    }
+    return true;
+}
+
+void RocketParticleProfiler::Sort(QList<Result> &results, SortOrder order)
+{
+    switch(order)
+    {
+    case SortByUpdateTime:
+        qStableSort(results.begin(), results.end(), MoreUpdateTime);
+        break;
+    case SortByParticles:
+        qStableSort(results.begin(), results.end(), MoreParticles);
+        break;
+    case SortByFill:
+    default:
+        qStableSort(results.begin(), results.end(), MoreFill);
+        break;
+    }
+}
+
+QString RocketParticleProfiler::FormatResult(const Result &result)
+{
+    QString report;
+    QTextStream s(&report);
+    s << result.name << endl;
+    if (!result.source.isEmpty())
+        s << "  Source          " << result.source << endl;
+    s << QString("  Particles       peak %1 / quota %2%3, average %4").arg(result.peakParticles).arg(result.quota)
+        .arg(result.QuotaReached() ? " (quota reached)" : "").arg(result.averageParticles, 0, 'f', 1) << endl;
+    s << QString("  Update          average %1 ms, peak %2 ms over %3 frames").arg(result.averageUpdateMsecs, 0, 'f', 3)
+        .arg(result.peakUpdateMsecs, 0, 'f', 3).arg(result.frames) << endl;
+    foreach(const Fill &fill, result.fill)
+    {
+        s << QString("  Fill at %1 m").arg(fill.distance, -7, 'f', 0)
+          << QString(" average %1 screens, peak %2 screens, overdraw %3x").arg(fill.averageScreens, 0, 'f', 2)
+            .arg(fill.peakScreens, 0, 'f', 2).arg(fill.averageOverdraw, 0, 'f', 1) << endl;
+    }
+    return report;
+}
+
+QString RocketParticleProfiler::FormatRanking(const QList<Result> &results)
+{
+    QString report;
+    QTextStream s(&report);
+    QString fillHeader = "Fill";
+    if (!results.isEmpty() && !results.first().fill.isEmpty())
+        fillHeader = QString("Fill@%1m").arg(results.first().fill.first().distance, 0, 'f', 0);
+
+    s << QString("%1 %2 %3 %4 %5 %6 %7").arg("#", -4).arg("Template", -32).arg("Peak", 7).arg("Quota", 7)
+        .arg("Update ms", 10).arg(fillHeader, 10).arg("Overdraw", 9) << endl;
+    for(int i = 0; i < results.size(); ++i)
+    {
+        const Result &r = results[i];
+        const float overdraw = (r.fill.isEmpty() ? 0.f : r.fill.first().averageOverdraw);
+        s << QString("%1 %2 %3 %4 %5 %6 %7").arg(i + 1, -4).arg(r.name.left(32), -32).arg(r.peakParticles, 7).arg(r.quota, 7)
+            .arg(r.averageUpdateMsecs, 10, 'f', 3).arg(r.NearFillScreens(), 10, 'f', 2).arg(overdraw, 8, 'f', 1) << "x";
+        if (r.QuotaReached())
+            s << " quota reached";
+        if (!r.source.isEmpty())
+            s << "  " << r.source;
+        s << endl;
+    }
+    return report;
+}
+
+void RocketParticleProfiler::ShowReport(const QString &title, const QString &report, QWidget *parent)
+{
+    QDialog *dialog = new QDialog(parent, Qt::Tool);
+    dialog->setAttribute(Qt::WA_DeleteOnClose, true);
+    dialog->setWindowTitle(title);
+    dialog->resize(760, 360);
+
+    QPlainTextEdit *text = new QPlainTextEdit(dialog);
+    text->setReadOnly(true);
+    text->setLineWrapMode(QPlainTextEdit::NoWrap);
+    QFont font("Courier New");
+    font.setStyleHint(QFont::Monospace);
+    font.setPixelSize(12);
+    text->setFont(font);
+    text->setPlainText(report);
+
+    QVBoxLayout *layout = new QVBoxLayout(dialog);
+    layout->setContentsMargins(4, 4, 4, 4);
+    layout->addWidget(text);
+    dialog->show();
+}
+
+// RocketParticleProfileBatch
+
+RocketParticleProfileBatch::RocketParticleProfileBatch(Framework *framework, const QStringList &particleRefs,
+                                                       const RocketParticleProfiler::Settings &settings, RocketParticleProfiler::SortOrder order) :
+    framework_(framework),
+    LC("[RocketParticleProfileBatch]: "),
+    settings_(settings),
+    order_(order),
+    refs_(particleRefs)
+{
+}
+
+void RocketParticleProfileBatch::Start()
+{
+    foreach(const QString &ref, refs_)
+    {
+        AssetTransferPtr transfer = framework_->Asset()->RequestAsset(ref, "OgreParticle");
+        if (!transfer)
+        {
+            failures_ << ref + ": Failed to request asset";
+            continue;
+        }
+        pending_[transfer.get()] = ref;
+        connect(transfer.get(), SIGNAL(Succeeded(AssetPtr)), SLOT(OnTransferSucceeded(AssetPtr)), Qt::UniqueConnection);
+        connect(transfer.get(), SIGNAL(Failed(IAssetTransfer*, QString)), SLOT(OnTransferFailed(IAssetTransfer*, QString)), Qt::UniqueConnection);
+    }
+    LogInfo(LC + QString("Profiling %1 particle assets for %2 seconds each").arg(refs_.size()).arg(settings_.seconds));
+    CheckFinished();
+}
+
+void RocketParticleProfileBatch::OnTransferSucceeded(AssetPtr asset)
+{
+    IAssetTransfer *transfer = dynamic_cast<IAssetTransfer*>(sender());
+    const QString ref = pending_.take(transfer);
+
+    OgreParticleAssetPtr particle = dynamic_pointer_cast<OgreParticleAsset>(asset);
+    if (!particle || particle->GetNumTemplates() == 0)
+        failures_ << (ref.isEmpty() ? asset->Name() : ref) + ": No particle system templates";
+    else
+    {
+        for(size_t i = 0; i < particle->GetNumTemplates(); ++i)
+        {
+            RocketParticleProfiler::Result result;
+            QString error;
+            if (RocketParticleProfiler::Profile(particle->GetTemplateName(static_cast<int>(i)), settings_, result, &error))
+            {
+                result.source = asset->Name();
+                results_ << result;
+            }
+            else
+                failures_ << particle->GetTemplateName(static_cast<int>(i)) + ": " + error;
+        }
+    }
+    CheckFinished();
+}
+
+void RocketParticleProfileBatch::OnTransferFailed(IAssetTransfer *transfer, QString reason)
+{
+    const QString ref = pending_.take(transfer);
+    failures_ << (ref.isEmpty() ? transfer->SourceUrl() : ref) + ": " + reason;
+    CheckFinished();
+}
+
+void RocketParticleProfileBatch::CheckFinished()
+{
+    if (!pending_.isEmpty())
+        return;
+
+    RocketParticleProfiler::Sort(results_, order_);
+    QString report = RocketParticleProfiler::FormatRanking(results_);
+    if (!failures_.isEmpty())
+        report += "\nFailed:\n  " + failures_.join("\n  ") + "\n";
+
+    foreach(const QString &line, report.split("\n", QString::SkipEmptyParts))
+        LogInfo(line);
+
+    emit Finished(report);
+    deleteLater();
+}
+
+/// @endcond
@@ -0,0 +1,145 @@
+/**
+    @author Adminotech Ltd.
+
+    Copyright Adminotech Ltd.
+    All rights reserved.
+
+    @file   RocketParticleProfiler.h
+    @brief  Headless cost estimation for Ogre particle system templates. */
+
+#pragma once
+
+#include "RocketFwd.h"
+#include "FrameworkFwd.h"
+#include "AssetFwd.h"
+
+#include <QObject>
+#include <QString>
+#include <QStringList>
+#include <QList>
+#include <QSize>
+#include <QHash>
+
+class QWidget;
+
+namespace Ogre
+{
+    class ParticleSystem;
+}
+
+/// @cond PRIVATE
+
+/// Simulates Ogre particle system templates without rendering and estimates their cost.
+/** A copy of the template is created to a private scene manager and updated with a fixed time step
+    for the configured duration. Only the CPU side update runs, nothing is sent to the GPU.
+    Screen space fill is estimated by projecting every live particle as a camera facing quad
+    to a reference screen at each reference distance, all particles at the same distance. */
+class RocketParticleProfiler
+{
+public:
+    struct Settings
+    {
+        float seconds;              ///< Simulated duration.
+        float frameRate;            ///< Fixed update rate.
+        QList<float> distances;     ///< Reference camera distances in world units.
+        QSize screenSize;           ///< Reference screen resolution.
+        float verticalFov;          ///< Reference vertical field of view in degrees.
+
+        Settings();
+    };
+
+    /// Estimated screen space cost at one reference distance.
+    struct Fill
+    {
+        float distance;
+        float averageScreens;       ///< Average particle pixel fill in full screens.
+        float peakScreens;          ///< Peak particle pixel fill in full screens.
+        float averageOverdraw;      ///< Average layers of particles over the covered screen area.
+
+        Fill() : distance(0.f), averageScreens(0.f), peakScreens(0.f), averageOverdraw(0.f) {}
+    };
+
+    struct Result
+    {
+        QString name;               ///< Template name.
+        QString source;             ///< Asset reference the template was loaded from, if known.
+        int quota;
+        int frames;
+        int peakParticles;
+        float averageParticles;
+        float averageUpdateMsecs;
+        float peakUpdateMsecs;
+        QList<Fill> fill;           ///< In Settings::distances order.
+
+        Result() : quota(0), frames(0), peakParticles(0), averageParticles(0.f), averageUpdateMsecs(0.f), peakUpdateMsecs(0.f) {}
+
+        /// Returns true if the quota limited emission at some point.
+        bool QuotaReached() const { return quota > 0 && peakParticles >= quota; }
+
+        /// Average fill at the nearest reference distance in screens, 0 if not measured.
+        float NearFillScreens() const { return fill.isEmpty() ? 0.f : fill.first().averageScreens; }
+    };
+
+    enum SortOrder
+    {
+        SortByFill = 0,             ///< Average fill at the nearest reference distance.
+        SortByUpdateTime,
+        SortByParticles
+    };
+
+    /// Simulates a copy of @c particleTemplate and fills @c result.
+    static bool Profile(Ogre::ParticleSystem *particleTemplate, const Settings &settings, Result &result, QString *error = 0);
+
+    /// Simulates the registered Ogre particle system template @c templateName and fills @c result.
+    static bool Profile(const QString &templateName, const Settings &settings, Result &result, QString *error = 0);
+
+    /// Sorts @c results, most expensive first.
+    static void Sort(QList<Result> &results, SortOrder order);
+
+    /// Returns a multi line report of @c result.
+    static QString FormatResult(const Result &result);
+
+    /// Returns one line per result in a table, in the given order.
+    static QString FormatRanking(const QList<Result> &results);
+
+    /// Shows @c report in a non-modal dialog with a fixed width font.
+    static void ShowReport(const QString &title, const QString &report, QWidget *parent = 0);
+};
+
+/// Loads particle assets and profiles every template in them with RocketParticleProfiler.
+/** Deletes itself after Finished has been emitted. */
+class RocketParticleProfileBatch : public QObject
+{
+    Q_OBJECT
+
+public:
+    RocketParticleProfileBatch(Framework *framework, const QStringList &particleRefs,
+                               const RocketParticleProfiler::Settings &settings = RocketParticleProfiler::Settings(),
+                               RocketParticleProfiler::SortOrder order = RocketParticleProfiler::SortByFill);
+
+    /// Requests the assets and starts profiling when they have loaded.
+    void Start();
+
+signals:
+    /// Emitted when all assets have been profiled or have failed.
+    /** @param Ranking of all templates, most expensive first, followed by failed assets. */
+    void Finished(const QString &report);
+
+private slots:
+    void OnTransferSucceeded(AssetPtr asset);
+    void OnTransferFailed(IAssetTransfer *transfer, QString reason);
+
+private:
+    void CheckFinished();
+
+    Framework *framework_;
+    const QString LC;
+    RocketParticleProfiler::Settings settings_;
+    RocketParticleProfiler::SortOrder order_;
+    QStringList refs_;
+    QHash<IAssetTransfer*, QString> pending_;
+    QList<RocketParticleProfiler::Result> results_;
+    QStringList failures_;
+};
+
+/// @endcond
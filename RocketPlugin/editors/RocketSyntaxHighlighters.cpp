@@ -10,10 +10,91 @@
 #include "StableHeaders.h"
 #include "RocketSyntaxHighlighters.h"
 
+#include "LoggingFunctions.h"
+
+#include <QTextDocument>
+#include <QTextBlock>
+#include <QTextLayout>
+#include <QFile>
+#include <QFileInfo>
+#include <QElapsedTimer>
+
+namespace
+{
+    const int STATE_MULTILINE_COMMENT = 1;
+}
+
+// RocketKeywordTrie
+
+RocketKeywordTrie::RocketKeywordTrie()
+{
+    nodes_.append(Node());
+}
+
+void RocketKeywordTrie::Insert(const QString &keyword, Anchor anchor, int order, const QTextCharFormat &format)
+{
+    int node = 0;
+    for(int i = 0; i < keyword.length(); ++i)
+    {
+        const ushort c = keyword[i].unicode();
+        QHash<ushort, int>::const_iterator child = nodes_[node].children.find(c);
+        if (child == nodes_[node].children.end())
+        {
+            nodes_.append(Node());
+            nodes_[node].children[c] = nodes_.size() - 1;
+            node = nodes_.size() - 1;
+        }
+        else
+            node = child.value();
+    }
+
+    Entry entry;
+    entry.anchor = anchor;
+    entry.order = order;
+    entry.format = format;
+    entries_.append(entry);
+    nodes_[node].entries.append(entries_.size() - 1);
+}
+
+const QTextCharFormat *RocketKeywordTrie::Match(const QString &text, int start, int end) const
+{
+    int node = 0;
+    for(int i = start; i < end; ++i)
+    {
+        QHash<ushort, int>::const_iterator child = nodes_[node].children.find(text[i].unicode());
+        if (child == nodes_[node].children.end())
+            return 0;
+        node = child.value();
+    }
+
+    const Entry *best = 0;
+    foreach(int index, nodes_[node].entries)
+    {
+        const Entry &entry = entries_[index];
+        bool matches = false;
+        switch(entry.anchor)
+        {
+        case AnyWord:
+            matches = true;
+            break;
+        case LineStart:
+            matches = (start == 0);
+            break;
+        case LineStartBeforeWord:
+            matches = (start == 0 && end + 1 < text.length() && text[end] == QChar(' ') && IsWordChar(text[end + 1]));
+            break;
+        }
+        if (matches && (!best || entry.order > best->order))
+            best = &entry;
+    }
+    return best ? &best->format : 0;
+}
+
 // IRocketSyntaxHighlighter
 
 IRocketSyntaxHighlighter::IRocketSyntaxHighlighter(QTextDocument *doc) :
     QSyntaxHighlighter(doc),
+    compiledRulesEnabled_(true),
     commentRulesEnabled_(false),
     doubleQuoteRulesEnabled_(false),
     doubleQuoteMultilineRulesEnabled_(false),
@@ -56,19 +137,79 @@ void IRocketSyntaxHighlighter::AddRule(const QRegExp &pattern, const QTextCharFo
     HighlightRule rule;
     rule.pattern = pattern;
     rule.format = format;
-    rules_ << rule;
+    AddRule(rule);
 }
 
 void IRocketSyntaxHighlighter::AddRule(const HighlightRule &rule)
 {
     rules_ << rule;
+    AddCompiledRule(rule);
+}
+
+void IRocketSyntaxHighlighter::AddCompiledRule(const HighlightRule &rule)
+{
+    // Keyword only rules are merged to the keyword trie of the previous rule if it is one too,
+    // this keeps the evaluation order and therefore the resulting formats the same.
+    QRegExp anyWordKeyword("^\\\\b\\((\\w+)\\)\\\\b$");
+    QRegExp lineStartKeyword("^\\^\\((\\w+)\\)\\\\b$");
+    QRegExp lineStartBeforeWordKeyword("^\\^\\((\\w+)\\) \\\\b$");
+
+    const QString pattern = rule.pattern.pattern();
+    RocketKeywordTrie::Anchor anchor = RocketKeywordTrie::AnyWord;
+    QString keyword;
+    if ((rule.pattern.patternSyntax() == QRegExp::RegExp || rule.pattern.patternSyntax() == QRegExp::RegExp2) &&
+        rule.pattern.caseSensitivity() == Qt::CaseSensitive)
+    {
+        if (anyWordKeyword.exactMatch(pattern))
+        {
+            anchor = RocketKeywordTrie::AnyWord;
+            keyword = anyWordKeyword.cap(1);
+        }
+        else if (lineStartKeyword.exactMatch(pattern))
+        {
+            anchor = RocketKeywordTrie::LineStart;
+            keyword = lineStartKeyword.cap(1);
+        }
+        else if (lineStartBeforeWordKeyword.exactMatch(pattern))
+        {
+            anchor = RocketKeywordTrie::LineStartBeforeWord;
+            keyword = lineStartBeforeWordKeyword.cap(1);
+        }
+    }
+
+    if (!keyword.isEmpty())
+    {
+        if (compiledRules_.isEmpty() || compiledRules_.last().type != CompiledRule::KeywordRule)
+        {
+            CompiledRule compiled;
+            compiled.type = CompiledRule::KeywordRule;
+            compiledRules_ << compiled;
+        }
+        compiledRules_.last().keywords.Insert(keyword, anchor, rules_.size(), rule.format);
+        return;
+    }
+
+    CompiledRule compiled;
+    compiled.type = CompiledRule::RegExpRule;
+    compiled.pattern = rule.pattern;
+    compiled.format = rule.format;
+    compiledRules_ << compiled;
 }
 
 void IRocketSyntaxHighlighter::AddQuotedStringRules(bool doubleQuotes, bool singleQuotes)
 {
     if (!doubleQuoteRulesEnabled_ && doubleQuotes)
     {
-        AddRule(QRegExp("(\"\")|(\\\"[^\"]*\\\")"), formatYellow_);
+        HighlightRule rule;
+        rule.pattern = QRegExp("(\"\")|(\\\"[^\"]*\\\")");
+        rule.format = formatYellow_;
+        rules_ << rule;
+
+        CompiledRule compiled;
+        compiled.type = CompiledRule::QuotedStringRule;
+        compiled.token = "\"";
+        compiled.format = formatYellow_;
+        compiledRules_ << compiled;
         doubleQuoteRulesEnabled_ = true;
         
         /* Figure this out...
@@ -82,7 +223,16 @@ void IRocketSyntaxHighlighter::AddQuotedStringRules(bool doubleQuotes, bool sing
     
     if (!singleQuoteRulesEnabled_ && singleQuotes)
     {
-        AddRule(QRegExp("('')|('[^']*')"), formatYellow_);
+        HighlightRule rule;
+        rule.pattern = QRegExp("('')|('[^']*')");
+        rule.format = formatYellow_;
+        rules_ << rule;
+
+        CompiledRule compiled;
+        compiled.type = CompiledRule::QuotedStringRule;
+        compiled.token = "'";
+        compiled.format = formatYellow_;
+        compiledRules_ << compiled;
         singleQuoteRulesEnabled_ = true;
 
         /* Figure this out...
@@ -98,108 +248,232 @@ void IRocketSyntaxHighlighter::AddCommentRules(bool includeHashSignComment)
         return;
     commentRulesEnabled_ = true;
 
-    AddRule(QRegExp("((?:\\s+)(\\/\\/[^\n]*)|^\\/\\/[^\n]*)"), formatLightGrey_);
-    if (includeHashSignComment)
-        AddRule(QRegExp("((?:\\s+)(#[^\n]*)|^#[^\n]*)"), formatLightGrey_);
+    HighlightRule rule;
+    rule.pattern = QRegExp("((?:\\s+)(\\/\\/[^\n]*)|^\\/\\/[^\n]*)");
+    rule.format = formatLightGrey_;
+    rules_ << rule;
+
+    CompiledRule compiled;
+    compiled.type = CompiledRule::LineCommentRule;
+    compiled.token = "//";
+    compiled.format = formatLightGrey_;
+    compiledRules_ << compiled;
 
-    commentStartExpression_ = QRegExp("/\\*");
-    commentEndExpression_   = QRegExp("\\*/");
+    if (includeHashSignComment)
+    {
+        rule.pattern = QRegExp("((?:\\s+)(#[^\n]*)|^#[^\n]*)");
+        rules_ << rule;
+        compiled.token = "#";
+        compiledRules_ << compiled;
+    }
 }
 
 void IRocketSyntaxHighlighter::highlightBlock(const QString &text)
 {
     if (text.trimmed().isEmpty())
+    {
+        // Carry a multiline comment over empty lines.
+        setCurrentBlockState(previousBlockState() == STATE_MULTILINE_COMMENT ? STATE_MULTILINE_COMMENT : 0);
         return;
+    }
 
-    foreach (const HighlightRule &rule, rules_)
+    if (compiledRulesEnabled_)
     {
-        QRegExp expression(rule.pattern);
-        int index = expression.indexIn(text);
-        while (index > -1)
+        for(int i = 0; i < compiledRules_.size(); ++i)
         {
-            int count = expression.captureCount();
-            int advance = expression.matchedLength();
-
-            if (advance > 0)
+            CompiledRule &rule = compiledRules_[i];
+            switch(rule.type)
             {
-                if (count > 0)
-                {
-                    for (int ci=1,ciLen=expression.captureCount(); ci<=ciLen; ++ci)
-                    {
-                        int len = expression.cap(ci).length();
-                        if (len > 0)
-                        {
-                            int pos = expression.pos(ci);
-                            setFormat(pos, len, rule.format);
-                        }
-                    }
-                }
-                else
-                    setFormat(index, advance, rule.format);
+            case CompiledRule::RegExpRule:
+                ApplyRegExp(rule.pattern, rule.format, text);
+                break;
+            case CompiledRule::KeywordRule:
+                ApplyKeywords(rule.keywords, text);
+                break;
+            case CompiledRule::QuotedStringRule:
+                ApplyQuotedStrings(rule.token, rule.format, text);
+                break;
+            case CompiledRule::LineCommentRule:
+                ApplyLineComment(rule.token, rule.format, text);
+                break;
             }
-            else
-                advance = 1;
-
-            index = expression.indexIn(text, index + advance);
+        }
+    }
+    else
+    {
+        foreach (const HighlightRule &rule, rules_)
+        {
+            QRegExp expression(rule.pattern);
+            ApplyRegExp(expression, rule.format, text);
         }
     }
     setCurrentBlockState(0);
     
     if (commentRulesEnabled_)
+        ApplyMultilineComments(text);
+}
+
+void IRocketSyntaxHighlighter::ApplyRegExp(QRegExp &expression, const QTextCharFormat &format, const QString &text)
+{
+    int index = expression.indexIn(text);
+    while (index > -1)
     {
-        int STATE_MULTILINE = 1;
-        int startIndex = 0;
-        if (previousBlockState() != STATE_MULTILINE)
-            startIndex = commentStartExpression_.indexIn(text);
+        int count = expression.captureCount();
+        int advance = expression.matchedLength();
 
-        while (startIndex >= 0)
+        if (advance > 0)
         {
-            int endIndex = commentEndExpression_.indexIn(text, startIndex);
-            int commentLength;
-            if (endIndex == -1)
+            if (count > 0)
             {
-                setCurrentBlockState(STATE_MULTILINE);
-                commentLength = text.length() - startIndex;
+                for (int ci=1,ciLen=expression.captureCount(); ci<=ciLen; ++ci)
+                {
+                    int len = expression.cap(ci).length();
+                    if (len > 0)
+                    {
+                        int pos = expression.pos(ci);
+                        setFormat(pos, len, format);
+                    }
+                }
             }
             else
-                commentLength = endIndex - startIndex + commentEndExpression_.matchedLength();
+                setFormat(index, advance, format);
+        }
+        else
+            advance = 1;
+
+        index = expression.indexIn(text, index + advance);
+    }
+}
 
-            setFormat(startIndex, commentLength, formatLightGrey_);
-            startIndex = commentStartExpression_.indexIn(text, startIndex + commentLength);
+void IRocketSyntaxHighlighter::ApplyKeywords(const RocketKeywordTrie &keywords, const QString &text)
+{
+    const int length = text.length();
+    int i = 0;
+    while (i < length)
+    {
+        if (!RocketKeywordTrie::IsWordChar(text[i]))
+        {
+            ++i;
+            continue;
         }
+
+        int end = i + 1;
+        while (end < length && RocketKeywordTrie::IsWordChar(text[end]))
+            ++end;
+
+        const QTextCharFormat *format = keywords.Match(text, i, end);
+        if (format)
+            setFormat(i, end - i, *format);
+        i = end;
     }
-    
-    /* Figure this out...
-    STATE_MULTILINE = 2;
-    
-    if (doubleQuoteMultilineRulesEnabled_)
+}
+
+void IRocketSyntaxHighlighter::ApplyQuotedStrings(const QString &quote, const QTextCharFormat &format, const QString &text)
+{
+    // Same as "('')|('[^']*')", a quote is highlighted up to the next quote on the same line.
+    int start = text.indexOf(quote);
+    while (start >= 0)
     {
-        int startIndex = 0;
-        if (previousBlockState() != STATE_MULTILINE)
-            startIndex = doubleQuoteStartExpression_.indexIn(text);
+        const int end = text.indexOf(quote, start + 1);
+        if (end < 0)
+            break;
+        setFormat(start, end - start + 1, format);
+        start = text.indexOf(quote, end + 1);
+    }
+}
 
-        while (startIndex >= 0)
-        {
-            int endIndex = doubleQuoteEndExpression_.indexIn(text, startIndex);
-            int stringLength;
-            if (endIndex == -1)
-            {
-                setCurrentBlockState(STATE_MULTILINE);
-                stringLength = text.length() - startIndex;
-                qDebug() << "CONTINUE" << text << text.mid(startIndex, stringLength);
-            }
-            else
-            {
-                stringLength = endIndex - startIndex + doubleQuoteEndExpression_.matchedLength();
-                qDebug() << "STRING  " << text << text.mid(startIndex, stringLength);
-            }
+void IRocketSyntaxHighlighter::ApplyLineComment(const QString &marker, const QTextCharFormat &format, const QString &text)
+{
+    // Same as "((?:\\s+)(//[^\n]*)|^//[^\n]*)": the marker must start the line or follow whitespace,
+    // the preceding whitespace is highlighted too.
+    int index = text.indexOf(marker);
+    while (index > 0 && !text[index - 1].isSpace())
+        index = text.indexOf(marker, index + 1);
+    if (index < 0)
+        return;
+
+    while (index > 0 && text[index - 1].isSpace())
+        --index;
+    setFormat(index, text.length() - index, format);
+}
+
+void IRocketSyntaxHighlighter::ApplyMultilineComments(const QString &text)
+{
+    int startIndex = 0;
+    if (previousBlockState() != STATE_MULTILINE_COMMENT)
+        startIndex = text.indexOf("/*");
 
-            setFormat(startIndex, stringLength, formatYellow_);
-            if (stringLength == 0)
-                stringLength = 1;
-            startIndex = doubleQuoteStartExpression_.indexIn(text, startIndex + stringLength);
+    while (startIndex >= 0)
+    {
+        int endIndex = text.indexOf("*/", startIndex);
+        int commentLength;
+        if (endIndex == -1)
+        {
+            setCurrentBlockState(STATE_MULTILINE_COMMENT);
+            commentLength = text.length() - startIndex;
         }
-    }*/
+        else
+            commentLength = endIndex - startIndex + 2;
+
+        setFormat(startIndex, commentLength, formatLightGrey_);
+        startIndex = text.indexOf("/*", startIndex + commentLength);
+    }
+}
+
+void IRocketSyntaxHighlighter::Benchmark(const QString &filePath)
+{
+    QFile file(filePath);
+    if (!file.open(QIODevice::ReadOnly))
+    {
+        LogError("[IRocketSyntaxHighlighter]: Failed to open benchmark file " + filePath);
+        return;
+    }
+
+    QTextDocument document;
+    document.setPlainText(QString::fromUtf8(file.readAll()));
+    file.close();
+
+    IRocketSyntaxHighlighter *highlighter = TryCreateHighlighter(QFileInfo(filePath).suffix(), &document);
+    if (!highlighter)
+    {
+        LogError("[IRocketSyntaxHighlighter]: No syntax highlighter for " + filePath);
+        return;
+    }
+
+    QList<QList<QTextLayout::FormatRange> > formats[2];
+    qint64 msecs[2];
+    for(int pass = 0; pass < 2; ++pass)
+    {
+        highlighter->SetCompiledRulesEnabled(pass == 1);
+
+        QElapsedTimer timer;
+        timer.start();
+        highlighter->rehighlight();
+        msecs[pass] = timer.elapsed();
+
+        for(QTextBlock block = document.begin(); block.isValid(); block = block.next())
+            formats[pass] << block.layout()->additionalFormats();
+    }
+
+    int mismatchingBlocks = 0;
+    for(int i = 0; i < formats[0].size() && i < formats[1].size(); ++i)
+    {
+        const QList<QTextLayout::FormatRange> &a = formats[0][i];
+        const QList<QTextLayout::FormatRange> &b = formats[1][i];
+        bool equal = (a.size() == b.size());
+        for(int r = 0; equal && r < a.size(); ++r)
+            equal = (a[r].start == b[r].start && a[r].length == b[r].length && a[r].format == b[r].format);
+        if (!equal)
+            ++mismatchingBlocks;
+    }
+
+    LogInfo(QString("[IRocketSyntaxHighlighter]: %1, %2 lines").arg(QFileInfo(filePath).fileName()).arg(document.blockCount()));
+    LogInfo(QString("    Regular expressions: %1 msecs").arg(msecs[0]));
+    LogInfo(QString("    Compiled rules:      %1 msecs").arg(msecs[1]));
+    if (mismatchingBlocks > 0)
+        LogWarning(QString("    Formats differ on %1 lines").arg(mismatchingBlocks));
+    else
+        LogInfo("    Formats are identical");
 }
 
 // RocketMaterialHighlighter
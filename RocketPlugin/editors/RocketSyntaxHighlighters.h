@@ -13,9 +13,55 @@
 #include <QSyntaxHighlighter>
 #include <QRegExp>
 #include <QTextCharFormat>
+#include <QHash>
+#include <QVector>
 
 /// @cond PRIVATE
 
+// RocketKeywordTrie
+
+/// Keyword trie used by IRocketSyntaxHighlighter to match all keyword rules with a single pass over a block.
+class RocketKeywordTrie
+{
+public:
+    /// Where a keyword is matched, corresponds to the rule patterns "\b(kw)\b", "^(kw)\b" and "^(kw) \b".
+    enum Anchor
+    {
+        AnyWord,
+        LineStart,
+        LineStartBeforeWord
+    };
+
+    RocketKeywordTrie();
+
+    /// Adds @c keyword. If a keyword matches multiple entries, the one with the highest @c order wins.
+    void Insert(const QString &keyword, Anchor anchor, int order, const QTextCharFormat &format);
+
+    /// Returns format for the word [start, end) of @c text or null if no keyword matches.
+    const QTextCharFormat *Match(const QString &text, int start, int end) const;
+
+    bool IsEmpty() const { return entries_.isEmpty(); }
+
+    /// Returns if @c c is a word character as in QRegExp "\w".
+    static bool IsWordChar(const QChar &c) { return c.isLetterOrNumber() || c.isMark() || c == QChar('_'); }
+
+private:
+    struct Entry
+    {
+        Anchor anchor;
+        int order;
+        QTextCharFormat format;
+    };
+    struct Node
+    {
+        QHash<ushort, int> children;
+        QVector<int> entries;
+    };
+
+    QVector<Node> nodes_;
+    QVector<Entry> entries_;
+};
+
 // IRocketSyntaxHighlighter
 
 class IRocketSyntaxHighlighter : public QSyntaxHighlighter
@@ -51,7 +97,17 @@ public:
         @param If line starting with "#" should be considered a comment.
         Disabled by default as this is not the common case. */
     void AddCommentRules(bool includeHashSignComment = false);
-    
+
+    /// Enables highlighting with the compiled rule set, enabled by default.
+    /** Rules are compiled as they are added: keyword rules are merged to keyword tries and quoted
+        string and comment rules to character scanners, other rules remain regular expressions.
+        When disabled every rule is evaluated with QRegExp over each block. Both produce identical formats. */
+    void SetCompiledRulesEnabled(bool enabled) { compiledRulesEnabled_ = enabled; }
+    bool CompiledRulesEnabled() const { return compiledRulesEnabled_; }
+
+    /// Highlights @c filePath with and without compiled rules, verifies the formats match and logs the timings.
+    static void Benchmark(const QString &filePath);
+
 protected:
     virtual void highlightBlock(const QString &text);
 
@@ -65,7 +121,34 @@ protected:
     QTextCharFormat formatPurple_;
 
 private:
+    /// Compiled rule, evaluated in the order the rules were added.
+    struct CompiledRule
+    {
+        enum Type
+        {
+            RegExpRule,
+            KeywordRule,
+            QuotedStringRule,
+            LineCommentRule
+        };
+
+        Type type;
+        QRegExp pattern; ///< RegExpRule
+        QTextCharFormat format; ///< RegExpRule, QuotedStringRule and LineCommentRule
+        QString token; ///< Quote character or line comment marker.
+        RocketKeywordTrie keywords; ///< KeywordRule
+    };
+
+    void AddCompiledRule(const HighlightRule &rule);
+    void ApplyRegExp(QRegExp &expression, const QTextCharFormat &format, const QString &text);
+    void ApplyKeywords(const RocketKeywordTrie &keywords, const QString &text);
+    void ApplyQuotedStrings(const QString &quote, const QTextCharFormat &format, const QString &text);
+    void ApplyLineComment(const QString &marker, const QTextCharFormat &format, const QString &text);
+    void ApplyMultilineComments(const QString &text);
+
     HighlightRuleList rules_;
+    QList<CompiledRule> compiledRules_;
+    bool compiledRulesEnabled_;
     
     bool commentRulesEnabled_;
     bool doubleQuoteRulesEnabled_;
@@ -73,9 +156,6 @@ private:
     bool singleQuoteRulesEnabled_;
     bool singleQuoteMultilineRulesEnabled_;
 
-    QRegExp commentStartExpression_;
-    QRegExp commentEndExpression_;
-    
     QRegExp doubleQuoteStartExpression_;
     QRegExp doubleQuoteEndExpression_;
 };
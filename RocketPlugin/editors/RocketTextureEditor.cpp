@@ -14,6 +14,7 @@
 #include "MeshmoonAsset.h"
 #include "storage/MeshmoonStorageItem.h"
 #include "utils/RocketFileSystem.h"
+#include "utils/RocketTextureDecoder.h"
 
 #include "Framework.h"
 #include "Application.h"
@@ -24,6 +25,8 @@ RocketTextureEditor::RocketTextureEditor(RocketPlugin *plugin, MeshmoonStorageIt
     IRocketAssetEditor(plugin, resource, "Texture Viewer", resource->suffix.toUpper()),
     scaleFactor_(1.0),
     mipmaps_(-1),
+    mipLevel_(0),
+    mipmapMenu_(0),
     firstResizeDone_(false),
     converterProcess_(0)
 {
@@ -36,6 +39,8 @@ RocketTextureEditor::RocketTextureEditor(RocketPlugin *plugin, MeshmoonAsset *re
     IRocketAssetEditor(plugin, resource, "Texture Viewer", QFileInfo(resource->filename).suffix().toUpper()),
     scaleFactor_(1.0),
     mipmaps_(-1),
+    mipLevel_(0),
+    mipmapMenu_(0),
     firstResizeDone_(false),
     converterProcess_(0)
 {
@@ -87,6 +92,16 @@ void RocketTextureEditor::InitUi()
     connect(zoomIn, SIGNAL(triggered()), SLOT(ZoomIn()));
     connect(zoomOut, SIGNAL(triggered()), SLOT(ZoomOut()));
     connect(zoomReset, SIGNAL(triggered()), SLOT(ZoomReset()));
+
+    // Populated once the DDS or CRN header has been read.
+    mipmapMenu_ = viewMenu->addMenu("Mipmaps");
+    mipmapMenu_->setEnabled(false);
+    connect(mipmapMenu_, SIGNAL(triggered(QAction*)), SLOT(OnMipmapSelected(QAction*)));
+
+    RocketTextureDecodeWorker *worker = plugin_->TextureDecodeWorker();
+    if (worker)
+        connect(worker, SIGNAL(Decoded(const QString&, int, const QImage&, const RocketTextureDecoder::Info&, const QString&)),
+            this, SLOT(OnTextureDecoded(const QString&, int, const QImage&, const RocketTextureDecoder::Info&, const QString&)), Qt::QueuedConnection);
 }
 
 QStringList RocketTextureEditor::SupportedSuffixes()
@@ -148,41 +163,123 @@ void RocketTextureEditor::ResourceDownloaded(QByteArray data)
         else
             SetError("Failed to load image");
     }
-    else if (suffix == "dds" || suffix == "crn")
+    else if (RocketTextureDecoder::IsSupportedSuffix(suffix))
     {
         CleanupConversion();
 
-        // This should be set to "DXT1" etc. if detection is possible.
-        formatOverride_ = "Unknown";
+        QString error;
+        if (!RocketTextureDecoder::ReadInfo(data, textureInfo_, &error))
+        {
+            SetError("Failed to load image: " + error);
+            return;
+        }
+        formatOverride_ = textureInfo_.formatName;
+        mipmaps_ = textureInfo_.mipmaps;
+        PopulateMipmapMenu();
 
         SetMessage("Loading texture...");
 
-        /// @todo Enable png when crunch support writing it.
-        tempInPath_ = plugin_->GetFramework()->Asset()->GenerateTemporaryNonexistingAssetFilename(filename);
-        tempOutPath_ = plugin_->GetFramework()->Asset()->GenerateTemporaryNonexistingAssetFilename(filename + ".bmp");
-
-        // Store storage data to disk.
-        QFile file(tempInPath_);
-        if (!file.open(QFile::WriteOnly))
+        // Decode in process if possible, crunch is used for CRN when built without crn_decomp.h.
+        if (RocketTextureDecoder::CanDecodePixels(textureInfo_) && plugin_->TextureDecodeWorker())
         {
-            SetError("Failed to load image");
-            return;        
+            imageData_ = data;
+            RequestDecode(0);
         }
-        file.write(data);
-        file.close();
-
-        // Conversion params
-        QStringList params;
-        params << "-noprogress";
-        params << "-fileformat" << "bmp";
-        params << "-file" << QDir::toNativeSeparators(tempInPath_);
-        params << "-out"  << QDir::toNativeSeparators(tempOutPath_);
-
-        // Run the process
-        converterProcess_ = new QProcess();
-        connect(converterProcess_, SIGNAL(finished(int, QProcess::ExitStatus)), SLOT(OnCrunchProcessFinished(int, QProcess::ExitStatus)));
-        converterProcess_->start(QDir::toNativeSeparators(RocketFileSystem::InternalToolpath(RocketFileSystem::Crunch)), params);
+        else
+            StartConversion(data);
+    }
+}
+
+void RocketTextureEditor::StartConversion(const QByteArray &data)
+{
+    /// @todo Enable png when crunch support writing it.
+    tempInPath_ = plugin_->GetFramework()->Asset()->GenerateTemporaryNonexistingAssetFilename(filename);
+    tempOutPath_ = plugin_->GetFramework()->Asset()->GenerateTemporaryNonexistingAssetFilename(filename + ".bmp");
+
+    // Store storage data to disk.
+    QFile file(tempInPath_);
+    if (!file.open(QFile::WriteOnly))
+    {
+        SetError("Failed to load image");
+        return;        
+    }
+    file.write(data);
+    file.close();
+
+    // Conversion params
+    QStringList params;
+    params << "-noprogress";
+    params << "-fileformat" << "bmp";
+    params << "-file" << QDir::toNativeSeparators(tempInPath_);
+    params << "-out"  << QDir::toNativeSeparators(tempOutPath_);
+
+    // Run the process
+    converterProcess_ = new QProcess();
+    connect(converterProcess_, SIGNAL(finished(int, QProcess::ExitStatus)), SLOT(OnCrunchProcessFinished(int, QProcess::ExitStatus)));
+    converterProcess_->start(QDir::toNativeSeparators(RocketFileSystem::InternalToolpath(RocketFileSystem::Crunch)), params);
+}
+
+void RocketTextureEditor::RequestDecode(int level)
+{
+    RocketTextureDecodeWorker *worker = plugin_->TextureDecodeWorker();
+    if (!worker || imageData_.isEmpty())
+        return;
+
+    mipLevel_ = level;
+    if (mipmapMenu_)
+        mipmapMenu_->setEnabled(false);
+    worker->Decode(QString::number(reinterpret_cast<quintptr>(this)), imageData_, level);
+}
+
+void RocketTextureEditor::OnTextureDecoded(const QString &key, int level, const QImage &image, const RocketTextureDecoder::Info & /*info*/, const QString &error)
+{
+    if (key != QString::number(reinterpret_cast<quintptr>(this)) || level != mipLevel_)
+        return;
+
+    if (mipmapMenu_)
+        mipmapMenu_->setEnabled(mipmaps_ > 1);
+    if (image.isNull())
+    {
+        SetError("Failed to load image: " + error);
+        return;
+    }
+    ShowImage(image);
+}
+
+void RocketTextureEditor::OnMipmapSelected(QAction *action)
+{
+    if (!action)
+        return;
+    const int level = action->data().toInt();
+    if (level != mipLevel_)
+        RequestDecode(level);
+}
+
+void RocketTextureEditor::PopulateMipmapMenu()
+{
+    if (!mipmapMenu_)
+        return;
+
+    mipmapMenu_->clear();
+    QActionGroup *group = new QActionGroup(mipmapMenu_);
+    for(int level = 0; level < textureInfo_.mipmaps; ++level)
+    {
+        const QSize size = RocketTextureDecoder::MipSize(textureInfo_, level);
+        QAction *action = mipmapMenu_->addAction(QString("Level %1 (%2 x %3)").arg(level).arg(size.width()).arg(size.height()));
+        action->setData(level);
+        action->setCheckable(true);
+        action->setChecked(level == 0);
+        group->addAction(action);
     }
+    // Mipmaps can only be viewed when decoded in process.
+    mipmapMenu_->setEnabled(textureInfo_.mipmaps > 1 && RocketTextureDecoder::CanDecodePixels(textureInfo_));
+}
+
+void RocketTextureEditor::ShowImage(const QImage &image)
+{
+    image_ = image;
+    imageLabel_->setPixmap(QPixmap::fromImage(image_));
+    ZoomReset();
 }
 
 void RocketTextureEditor::OnCrunchProcessFinished(int exitCode, QProcess::ExitStatus status)
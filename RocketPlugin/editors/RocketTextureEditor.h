@@ -10,10 +10,13 @@
 #pragma once
 
 #include "IRocketAssetEditor.h"
+#include "utils/RocketTextureDecoder.h"
 
 #include <QProcess>
 
 class QLabel;
+class QMenu;
+class QAction;
 class QScrollArea;
 class QScrollBar;
 
@@ -57,6 +60,8 @@ protected:
 
 private slots:
     void OnCrunchProcessFinished(int exitCode, QProcess::ExitStatus status);
+    void OnTextureDecoded(const QString &key, int level, const QImage &image, const RocketTextureDecoder::Info &info, const QString &error);
+    void OnMipmapSelected(QAction *action);
 
     void RefreshInformation();
 
@@ -73,6 +78,10 @@ private slots:
 private:
     void InitUi();
     void CleanupConversion();
+    void StartConversion(const QByteArray &data);
+    void RequestDecode(int level);
+    void ShowImage(const QImage &image);
+    void PopulateMipmapMenu();
     
     QLabel *imageLabel_;
     QScrollArea *scrollArea_;
@@ -82,6 +91,9 @@ private:
     
     QString formatOverride_;
     int mipmaps_;
+    int mipLevel_;
+    RocketTextureDecoder::Info textureInfo_;
+    QMenu *mipmapMenu_;
     
     QProcess *converterProcess_;
     
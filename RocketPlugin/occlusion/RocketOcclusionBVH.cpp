@@ -0,0 +1,187 @@
+/**
+    @author Adminotech Ltd.
+
+    Copyright Adminotech Ltd.
+    All rights reserved.
+
+    @file
+    @brief   */
+
+#include "StableHeaders.h"
+
+#include "RocketOcclusionBVH.h"
+
+#include "Math/float3.h"
+
+#include <algorithm>
+
+/// @cond PRIVATE
+
+namespace
+{
+    /// Max items in a leaf.
+    const uint LeafSize = 4;
+
+    /// Orders item indices by the box center on one axis.
+    struct CenterLess
+    {
+        const std::vector<AABB> *bounds;
+        int axis;
+
+        bool operator()(uint a, uint b) const
+        {
+            return (*bounds)[a].CenterPoint()[axis] < (*bounds)[b].CenterPoint()[axis];
+        }
+    };
+}
+
+RocketOcclusionBVH::RocketOcclusionBVH() :
+    depth_(0)
+{
+}
+
+void RocketOcclusionBVH::Build(const std::vector<AABB> &bounds)
+{
+    bounds_ = bounds;
+    nodes_.clear();
+    items_.resize(bounds_.size());
+    for(uint i = 0; i < items_.size(); ++i)
+        items_[i] = i;
+    depth_ = 0;
+
+    if(items_.empty())
+        return;
+
+    nodes_.reserve(2 * items_.size() / LeafSize + 1);
+    nodes_.push_back(Node());
+    BuildNode(0, 0, static_cast<uint>(items_.size()), 1);
+}
+
+void RocketOcclusionBVH::BuildNode(uint index, uint first, uint count, uint depth)
+{
+    depth_ = std::max(depth_, depth);
+
+    AABB bounds = bounds_[items_[first]];
+    AABB centers(bounds.CenterPoint(), bounds.CenterPoint());
+    for(uint i = first + 1; i < first + count; ++i)
+    {
+        const AABB &b = bounds_[items_[i]];
+        bounds.Enclose(b);
+        centers.Enclose(b.CenterPoint());
+    }
+    nodes_[index].bounds = bounds;
+
+    if(count <= LeafSize)
+    {
+        nodes_[index].first = first;
+        nodes_[index].count = count;
+        return;
+    }
+
+    // Median split on the longest axis of the centers.
+    const float3 size = centers.Size();
+    CenterLess less;
+    less.bounds = &bounds_;
+    less.axis = (size.x >= size.y && size.x >= size.z ? 0 : (size.y >= size.z ? 1 : 2));
+    const uint half = count / 2;
+    std::nth_element(items_.begin() + first, items_.begin() + first + half, items_.begin() + first + count, less);
+
+    // Children are allocated next to each other. Don't hold node references over push_back.
+    const uint left = static_cast<uint>(nodes_.size());
+    nodes_.push_back(Node());
+    nodes_.push_back(Node());
+    nodes_[index].first = left;
+    nodes_[index].count = 0;
+
+    BuildNode(left, first, half, depth + 1);
+    BuildNode(left + 1, first + half, count - half, depth + 1);
+}
+
+void RocketOcclusionBVH::QueryContained(const AABB &box, std::vector<uint> &out) const
+{
+    if(nodes_.empty())
+        return;
+
+    std::vector<uint> stack;
+    stack.reserve(depth_ * 2 + 2);
+    stack.push_back(0);
+    while(!stack.empty())
+    {
+        const uint index = stack.back();
+        stack.pop_back();
+
+        const Node &node = nodes_[index];
+        if(!box.Intersects(node.bounds))
+            continue;
+
+        // Everything below is inside, no need to test the items.
+        if(box.Contains(node.bounds))
+        {
+            AppendSubtree(index, out);
+            continue;
+        }
+
+        if(node.count > 0)
+        {
+            for(uint i = node.first; i < node.first + node.count; ++i)
+                if(box.Contains(bounds_[items_[i]]))
+                    out.push_back(items_[i]);
+        }
+        else
+        {
+            stack.push_back(node.first);
+            stack.push_back(node.first + 1);
+        }
+    }
+}
+
+void RocketOcclusionBVH::QueryOverlapping(const AABB &box, std::vector<uint> &out) const
+{
+    if(nodes_.empty())
+        return;
+
+    std::vector<uint> stack;
+    stack.reserve(depth_ * 2 + 2);
+    stack.push_back(0);
+    while(!stack.empty())
+    {
+        const uint index = stack.back();
+        stack.pop_back();
+
+        const Node &node = nodes_[index];
+        if(!box.Intersects(node.bounds))
+            continue;
+
+        if(box.Contains(node.bounds))
+        {
+            AppendSubtree(index, out);
+            continue;
+        }
+
+        if(node.count > 0)
+        {
+            for(uint i = node.first; i < node.first + node.count; ++i)
+                if(box.Intersects(bounds_[items_[i]]))
+                    out.push_back(items_[i]);
+        }
+        else
+        {
+            stack.push_back(node.first);
+            stack.push_back(node.first + 1);
+        }
+    }
+}
+
+void RocketOcclusionBVH::AppendSubtree(uint index, std::vector<uint> &out) const
+{
+    const Node &node = nodes_[index];
+    if(node.count > 0)
+    {
+        out.insert(out.end(), items_.begin() + node.first, items_.begin() + node.first + node.count);
+        return;
+    }
+    AppendSubtree(node.first, out);
+    AppendSubtree(node.first + 1, out);
+}
+
+/// @endcond
@@ -0,0 +1,60 @@
+/**
+    @author Adminotech Ltd.
+
+    Copyright Adminotech Ltd.
+    All rights reserved.
+
+    @file
+    @brief   */
+
+#pragma once
+
+#include "Geometry/AABB.h"
+
+#include <QtGlobal>
+
+#include <vector>
+
+/// @cond PRIVATE
+
+/// Static bounding volume hierarchy over axis aligned boxes.
+/** Built once with a median split on the longest axis. Containment and overlap
+    queries prune whole subtrees, which makes them logarithmic for typical scenes. */
+class RocketOcclusionBVH
+{
+public:
+    RocketOcclusionBVH();
+
+    /// Builds the hierarchy. Indices returned by queries refer to @c bounds.
+    void Build(const std::vector<AABB> &bounds);
+
+    /// Appends indices of items whose bounds are fully inside @c box.
+    void QueryContained(const AABB &box, std::vector<uint> &out) const;
+
+    /// Appends indices of items whose bounds intersect @c box.
+    void QueryOverlapping(const AABB &box, std::vector<uint> &out) const;
+
+    /// Returns number of nodes.
+    uint NumNodes() const { return static_cast<uint>(nodes_.size()); }
+
+    /// Returns depth of the deepest leaf.
+    uint Depth() const { return depth_; }
+
+private:
+    struct Node
+    {
+        AABB bounds;
+        uint first;     ///< First item index for leaves, left child index for inner nodes.
+        uint count;     ///< Item count for leaves, 0 for inner nodes. Right child is left + 1.
+    };
+
+    void BuildNode(uint index, uint first, uint count, uint depth);
+    void AppendSubtree(uint node, std::vector<uint> &out) const;
+
+    std::vector<AABB> bounds_;
+    std::vector<uint> items_;
+    std::vector<Node> nodes_;
+    uint depth_;
+};
+
+/// @endcond
@@ -10,6 +10,7 @@
 #include "StableHeaders.h"
 
 #include "RocketOcclusionManager.h"
+#include "RocketOcclusionBVH.h"
 
 #include "RocketPlugin.h"
 #include "Framework.h"
@@ -26,6 +27,53 @@
 #include "SceneAPI.h"
 #include "ConsoleAPI.h"
 #include "AssetAPI.h"
+#include "LoggingFunctions.h"
+
+#include "Geometry/OBB.h"
+#include "Geometry/AABB.h"
+
+#include <kNet/PolledTimer.h>
+
+#include <OgreEntity.h>
+#include <OgreSubEntity.h>
+#include <OgreMesh.h>
+#include <OgreSubMesh.h>
+#include <OgreMaterial.h>
+#include <OgreTechnique.h>
+#include <OgrePass.h>
+
+/// @cond PRIVATE
+
+namespace
+{
+    /// Meshes smaller than this on any axis are never considered containers.
+    const float MinContainerExtent = 10.f;
+
+    /// Min area of the largest bounding box face for a mesh to be a useful occluder, in square meters.
+    const float MinOccluderArea = 4.f;
+
+    /// Max triangles for an occluder, more expensive ones are only targets.
+    const uint MaxOccluderTriangles = 50000;
+
+    /// Max triangles per square meter of bounding box surface. Denser meshes are usually foliage or detail props.
+    const float MaxOccluderTriangleDensity = 250.f;
+
+    /// Returns area of the largest face of @c obb.
+    float SilhouetteArea(const OBB &obb)
+    {
+        const float3 size = obb.Size();
+        return Max(Max(size.x * size.y, size.y * size.z), size.x * size.z);
+    }
+
+    /// Returns surface area of @c obb.
+    float SurfaceArea(const OBB &obb)
+    {
+        const float3 size = obb.Size();
+        return 2.f * (size.x * size.y + size.y * size.z + size.x * size.z);
+    }
+}
+
+/// @endcond
 
 RocketOcclusionManager::RocketOcclusionManager(RocketPlugin *plugin) :
     plugin_(plugin),
@@ -34,6 +82,9 @@ RocketOcclusionManager::RocketOcclusionManager(RocketPlugin *plugin) :
 {
 #ifdef ROCKET_UMBRA_ENABLED
     framework_->Console()->RegisterCommand("generateOcclusion", "Creates EC_MeshmoonOccluder component for every entity that has meshes. This will remove all existing EC_MeshmoonOccluder components. After creating components, tome will be generated.", this, SLOT(GenerateOcclusion()));
+    if (framework_->HasCommandLineParameter("--rocketDevCommands"))
+        framework_->Console()->RegisterCommand("benchmarkOccluderSelection", "Runs occluder selection for a generated test scene, compares it to a brute force selection and prints timings and mismatches. Usage: benchmarkOccluderSelection(meshCount=20000)",
+            this, SLOT(BenchmarkOccluderSelection(QString)), SLOT(BenchmarkOccluderSelection()));
 #endif
 }
 
@@ -56,6 +107,11 @@ void RocketOcclusionManager::CreateOcclusionComponents()
     if(!tundraScene)
         return;
 
+    kNet::PolledTimer totalTimer;
+    kNet::PolledTimer phaseTimer;
+    totalTimer.Start();
+    phaseTimer.Start();
+
     // Create EC_MeshmoonCulling
     EntityList cullingEntities = tundraScene->EntitiesWithComponent(EC_MeshmoonCulling::TypeIdStatic());
     if(!cullingEntities.empty())
@@ -91,93 +147,292 @@ void RocketOcclusionManager::CreateOcclusionComponents()
 
     EntityList entities = tundraScene->EntitiesWithComponent(EC_Mesh::TypeIdStatic());
 
-    unsigned int occluderId = 0;
-
-    LogInfo(LC + "Creating EC_MeshmoonOccluders...");
+    // Gather bounds of all meshes and the meshes that can get an occluder.
+    std::vector<OBB> obbs;
+    std::vector<OccluderCandidate> candidates;
+    obbs.reserve(entities.size());
+    candidates.reserve(entities.size());
     for(EntityList::iterator it = entities.begin(); it != entities.end(); ++it)
     {
         EntityPtr entity = (*it);
 
+        Entity::ComponentVector meshes = entity->ComponentsOfType(EC_Mesh::TypeIdStatic());
+        bool eligible = true;
+
         EC_Placeable *placeable = entity->Component<EC_Placeable>().get();
         if(!placeable)
-            continue;
-
-        EntityPtr parent = placeable->getparentRef().Lookup(tundraScene);
-        if(parent.get())
+            eligible = false;
+        else
         {
-            Entity::ComponentVector parentScripts = entity->ComponentsOfType(EC_Script::TypeIdStatic());
-            if(!parentScripts.empty())
-                continue;
-        }
+            EntityPtr parent = placeable->getparentRef().Lookup(tundraScene);
+            if(parent.get())
+            {
+                Entity::ComponentVector parentScripts = entity->ComponentsOfType(EC_Script::TypeIdStatic());
+                if(!parentScripts.empty())
+                    eligible = false;
+            }
 
-        Entity::ComponentVector scripts = entity->ComponentsOfType(EC_Script::TypeIdStatic());
-        if(!scripts.empty())
-            continue;
+            Entity::ComponentVector scripts = entity->ComponentsOfType(EC_Script::TypeIdStatic());
+            if(!scripts.empty())
+                eligible = false;
+        }
 
-        Entity::ComponentVector meshes = entity->ComponentsOfType(EC_Mesh::TypeIdStatic());
-        Entity::ComponentVector occluders = entity->ComponentsOfType(EC_MeshmoonOccluder::TypeIdStatic());
-        if(!occluders.empty())
+        if(eligible)
         {
-            for(size_t i = 0; i < occluders.size(); ++i)
-                entity->RemoveComponent(occluders[i], AttributeChange::LocalOnly);
+            Entity::ComponentVector occluders = entity->ComponentsOfType(EC_MeshmoonOccluder::TypeIdStatic());
+            if(!occluders.empty())
+            {
+                for(size_t i = 0; i < occluders.size(); ++i)
+                    entity->RemoveComponent(occluders[i], AttributeChange::LocalOnly);
+            }
         }
 
         for(size_t i = 0; i < meshes.size(); ++i)
         {
-            QString componentName = "(" + QString::number(i) + ")";
-
             EC_Mesh *mesh = dynamic_cast<EC_Mesh*>(meshes[i].get());
             if(!mesh)
                 continue;
 
-            if(CheckBoundingBoxIncludes(mesh, entities))
+            obbs.push_back(mesh->WorldOBB());
+            if(!eligible || mesh->meshRef.Get().ref.isEmpty())
                 continue;
 
-            if(mesh->meshRef.Get().ref.isEmpty())
-                continue;
+            OccluderCandidate candidate;
+            candidate.entity = entity.get();
+            candidate.mesh = mesh;
+            candidate.meshIndex = static_cast<uint>(i);
+            candidate.boundsIndex = static_cast<uint>(obbs.size() - 1);
+            candidate.occluder = IsUsefulOccluder(mesh, obbs.back());
+            candidates.push_back(candidate);
+        }
+    }
+    const float gatherMsecs = phaseTimer.MSecsElapsed();
+
+    // Skip meshes that contain other meshes, they are not solid.
+    phaseTimer.Start();
+    RocketOcclusionBVH bvh;
+    BuildBVH(obbs, bvh);
+    const float bvhMsecs = phaseTimer.MSecsElapsed();
+
+    phaseTimer.Start();
+    std::vector<uint> candidateBounds(candidates.size());
+    for(size_t i = 0; i < candidates.size(); ++i)
+        candidateBounds[i] = candidates[i].boundsIndex;
+    std::vector<bool> containers;
+    FindContainers(obbs, bvh, candidateBounds, containers);
+    const float selectMsecs = phaseTimer.MSecsElapsed();
+
+    phaseTimer.Start();
+    unsigned int occluderId = 0;
+    uint numContainers = 0, numTargetsOnly = 0;
+
+    LogInfo(LC + "Creating EC_MeshmoonOccluders...");
+    for(size_t i = 0; i < candidates.size(); ++i)
+    {
+        const OccluderCandidate &candidate = candidates[i];
+        if(containers[i])
+        {
+            ++numContainers;
+            continue;
+        }
 
-            EC_MeshmoonOccluder* occluder = dynamic_cast<EC_MeshmoonOccluder*>(entity->CreateComponent(EC_MeshmoonOccluder::TypeIdStatic(), componentName, AttributeChange::LocalOnly, false).get());
+        QString componentName = "(" + QString::number(candidate.meshIndex) + ")";
+        EC_MeshmoonOccluder* occluder = dynamic_cast<EC_MeshmoonOccluder*>(candidate.entity->CreateComponent(EC_MeshmoonOccluder::TypeIdStatic(), componentName, AttributeChange::LocalOnly, false).get());
+        if(!occluder)
+            continue;
 
-            occluder->id.Set(occluderId, AttributeChange::LocalOnly);
-            occluder->meshRef.Set(mesh->meshRef.Get(), AttributeChange::LocalOnly);
-            occluder->tomeId.Set(1, AttributeChange::LocalOnly);
+        occluder->id.Set(occluderId, AttributeChange::LocalOnly);
+        occluder->meshRef.Set(candidate.mesh->meshRef.Get(), AttributeChange::LocalOnly);
+        occluder->tomeId.Set(1, AttributeChange::LocalOnly);
 
-            // Set object to be both occluder and target
-            occluder->occluder.Set(true, AttributeChange::LocalOnly);
-            occluder->target.Set(true, AttributeChange::LocalOnly);
+        // Every mesh is a target, only useful ones occlude others.
+        occluder->occluder.Set(candidate.occluder, AttributeChange::LocalOnly);
+        occluder->target.Set(true, AttributeChange::LocalOnly);
+        if(!candidate.occluder)
+            ++numTargetsOnly;
 
-            ++occluderId;
-        }
+        ++occluderId;
     }
+    const float createMsecs = phaseTimer.MSecsElapsed();
+
+    LogInfo(LC + QString("Created %1 occlusion components for %2 meshes: %3 occluders, %4 targets only, %5 containers skipped.")
+        .arg(occluderId).arg(obbs.size()).arg(occluderId - numTargetsOnly).arg(numTargetsOnly).arg(numContainers));
+    LogInfo(LC + QString("Occluder selection took %1 msecs: gather %2, bvh %3 (%4 nodes, depth %5), select %6, create %7.")
+        .arg(totalTimer.MSecsElapsed(), 0, 'f', 1).arg(gatherMsecs, 0, 'f', 1).arg(bvhMsecs, 0, 'f', 1)
+        .arg(bvh.NumNodes()).arg(bvh.Depth()).arg(selectMsecs, 0, 'f', 1).arg(createMsecs, 0, 'f', 1));
+}
+
+void RocketOcclusionManager::BuildBVH(const std::vector<OBB> &obbs, RocketOcclusionBVH &bvh) const
+{
+    std::vector<AABB> bounds(obbs.size());
+    for(size_t i = 0; i < obbs.size(); ++i)
+        bounds[i] = obbs[i].MinimalEnclosingAABB();
+    bvh.Build(bounds);
 }
 
-bool RocketOcclusionManager::CheckBoundingBoxIncludes(EC_Mesh *targetMesh, const EntityList& entities)
+void RocketOcclusionManager::FindContainers(const std::vector<OBB> &obbs, const RocketOcclusionBVH &bvh,
+    const std::vector<uint> &targets, std::vector<bool> &containers) const
 {
-    OBB targetOBB = targetMesh->WorldOBB();
+    containers.assign(targets.size(), false);
 
-    if(targetOBB.Size().x < 10 || targetOBB.Size().y < 10 || targetOBB.Size().z < 10)
+    std::vector<uint> contained;
+    for(size_t i = 0; i < targets.size(); ++i)
+    {
+        const uint target = targets[i];
+        const OBB &targetOBB = obbs[target];
+        const float3 size = targetOBB.Size();
+        if(size.x < MinContainerExtent || size.y < MinContainerExtent || size.z < MinContainerExtent)
+            continue;
+
+        // An OBB can only contain boxes inside its enclosing AABB, test the exact OBBs for those only.
+        contained.clear();
+        bvh.QueryContained(targetOBB.MinimalEnclosingAABB(), contained);
+        for(size_t c = 0; c < contained.size(); ++c)
+        {
+            if(contained[c] != target && targetOBB.Contains(obbs[contained[c]]))
+            {
+                containers[i] = true;
+                break;
+            }
+        }
+    }
+}
+
+bool RocketOcclusionManager::IsUsefulOccluder(EC_Mesh *mesh, const OBB &obb) const
+{
+    // Small objects hide little, regardless of how close the camera gets.
+    if(SilhouetteArea(obb) < MinOccluderArea)
         return false;
 
-    for(EntityList::const_iterator it = entities.begin(); it != entities.end(); ++it)
+    // Mesh not loaded, can't judge solidity or complexity. Keep it as an occluder.
+    Ogre::Entity *ogreEntity = mesh->OgreEntity();
+    if(!ogreEntity || ogreEntity->getMesh().isNull())
+        return true;
+
+    // Transparent and alpha rejected materials (foliage, fences, glass) don't occlude.
+    for(uint i = 0; i < ogreEntity->getNumSubEntities(); ++i)
     {
-        EntityPtr entity = (*it);
+        Ogre::MaterialPtr material = ogreEntity->getSubEntity(i)->getMaterial();
+        if(material.isNull())
+            continue;
+        if(material->isTransparent())
+            return false;
+        Ogre::Technique *technique = material->getBestTechnique();
+        if(technique && technique->getNumPasses() > 0 && technique->getPass(0)->getAlphaRejectFunction() != Ogre::CMPF_ALWAYS_PASS)
+            return false;
+    }
 
-        Entity::ComponentVector meshes = entity->ComponentsOfType(EC_Mesh::TypeIdStatic());
-        for(size_t i = 0; i < meshes.size(); ++i)
-        {
-            EC_Mesh *mesh = dynamic_cast<EC_Mesh*>(meshes[i].get());
-            if(!mesh)
-                continue;
+    Ogre::MeshPtr ogreMesh = ogreEntity->getMesh();
+    uint triangles = 0;
+    for(ushort i = 0; i < ogreMesh->getNumSubMeshes(); ++i)
+    {
+        Ogre::SubMesh *submesh = ogreMesh->getSubMesh(i);
+        if(submesh->indexData)
+            triangles += static_cast<uint>(submesh->indexData->indexCount / 3);
+    }
+    if(triangles > MaxOccluderTriangles)
+        return false;
 
-            if(mesh == targetMesh)
-                continue;
+    const float area = SurfaceArea(obb);
+    if(area > 0.f && static_cast<float>(triangles) / area > MaxOccluderTriangleDensity)
+        return false;
+
+    return true;
+}
+
+void RocketOcclusionManager::BenchmarkOccluderSelection()
+{
+    BenchmarkOccluderSelection("20000");
+}
+
+void RocketOcclusionManager::BenchmarkOccluderSelection(QString count)
+{
+    const uint numMeshes = Max(count.toUInt(), 1u);
+
+    // Generate a city like test scene: mostly small props, some buildings and a few large containers.
+    qsrand(1);
+    const float extent = sqrtf(static_cast<float>(numMeshes)) * 10.f;
+    std::vector<OBB> obbs;
+    obbs.reserve(numMeshes);
+    for(uint i = 0; i < numMeshes; ++i)
+    {
+        const float r = static_cast<float>(qrand()) / RAND_MAX;
+        const float scale = (r < 0.8f ? 1.f : (r < 0.99f ? 15.f : 60.f));
+        const float3 center(extent * qrand() / RAND_MAX, scale * 0.5f, extent * qrand() / RAND_MAX);
+        const float3 halfSize(scale * (0.5f + static_cast<float>(qrand()) / RAND_MAX) * 0.5f, scale * 0.5f, scale * (0.5f + static_cast<float>(qrand()) / RAND_MAX) * 0.5f);
+        const float angle = static_cast<float>(qrand()) / RAND_MAX * pi;
+
+        OBB obb;
+        obb.pos = center;
+        obb.r = halfSize;
+        obb.axis[0] = float3(cosf(angle), 0.f, -sinf(angle));
+        obb.axis[1] = float3::unitY;
+        obb.axis[2] = float3(sinf(angle), 0.f, cosf(angle));
+        obbs.push_back(obb);
+    }
+    std::vector<uint> targets(numMeshes);
+    for(uint i = 0; i < numMeshes; ++i)
+        targets[i] = i;
+
+    kNet::PolledTimer timer;
+    timer.Start();
+    RocketOcclusionBVH bvh;
+    BuildBVH(obbs, bvh);
+    const float bvhMsecs = timer.MSecsElapsed();
+
+    timer.Start();
+    std::vector<bool> containers;
+    FindContainers(obbs, bvh, targets, containers);
+    const float selectMsecs = timer.MSecsElapsed();
+
+    uint numContainers = 0;
+    for(size_t i = 0; i < containers.size(); ++i)
+        if(containers[i])
+            ++numContainers;
+
+    // Brute force reference over the same population, O(n^2) but only for meshes large enough to contain others.
+    timer.Start();
+    std::vector<bool> bruteContainers(numMeshes, false);
+    for(uint i = 0; i < numMeshes; ++i)
+    {
+        const float3 size = obbs[i].Size();
+        if(size.x < MinContainerExtent || size.y < MinContainerExtent || size.z < MinContainerExtent)
+            continue;
+        for(uint j = 0; j < numMeshes; ++j)
+        {
+            if(i != j && obbs[i].Contains(obbs[j]))
+            {
+                bruteContainers[i] = true;
+                break;
+            }
+        }
+    }
+    const float bruteMsecs = timer.MSecsElapsed();
 
-            OBB testOBB = mesh->WorldOBB();
-            if(targetOBB.Contains(testOBB))
-                return true;
+    uint numBruteContainers = 0;
+    QStringList mismatches;
+    uint numMismatches = 0;
+    for(uint i = 0; i < numMeshes; ++i)
+    {
+        if(bruteContainers[i])
+            ++numBruteContainers;
+        if(bruteContainers[i] != containers[i])
+        {
+            ++numMismatches;
+            if(mismatches.size() < 10)
+                mismatches << QString("%1 (bvh %2, brute force %3)").arg(i).arg(containers[i] ? "container" : "-").arg(bruteContainers[i] ? "container" : "-");
         }
     }
-    return false;
+
+    LogInfo(LC + QString("Occluder selection benchmark with %1 generated meshes:").arg(numMeshes));
+    LogInfo(LC + QString("  bvh build %1 msecs (%2 nodes, depth %3), container selection %4 msecs, %5 containers")
+        .arg(bvhMsecs, 0, 'f', 2).arg(bvh.NumNodes()).arg(bvh.Depth()).arg(selectMsecs, 0, 'f', 2).arg(numContainers));
+    LogInfo(LC + QString("  brute force %1 msecs, %2 containers").arg(bruteMsecs, 0, 'f', 2).arg(numBruteContainers));
+    if(numMismatches == 0)
+        LogInfo(LC + "  bvh and brute force selections match");
+    else
+        LogError(LC + QString("  bvh and brute force selections differ for %1 meshes: %2%3")
+            .arg(numMismatches).arg(mismatches.join(", ")).arg(numMismatches > static_cast<uint>(mismatches.size()) ? ", ..." : ""));
 }
 
 void RocketOcclusionManager::StartTomeGeneration()
@@ -233,9 +488,11 @@ void RocketOcclusionManager::GenerateOcclusion()
 void RocketOcclusionManager::CreateOcclusionComponents()
 {
 }
-bool RocketOcclusionManager::CheckBoundingBoxIncludes(EC_Mesh * /*targetMesh*/, const EntityList& /*entities*/)
+void RocketOcclusionManager::BenchmarkOccluderSelection()
+{
+}
+void RocketOcclusionManager::BenchmarkOccluderSelection(QString /*count*/)
 {
-    return false;
 }
 void RocketOcclusionManager::StartTomeGeneration()
 {
@@ -15,6 +15,12 @@
 #include "EC_MeshmoonOccluder.h"
 #include "EC_MeshmoonCulling.h"
 
+#include "Geometry/OBB.h"
+
+#include <vector>
+
+class RocketOcclusionBVH;
+
 class RocketOcclusionManager : public QObject
 {
     Q_OBJECT
@@ -26,13 +32,34 @@ public:
 private slots:
     void GenerateOcclusion();
 
-    bool CheckBoundingBoxIncludes(EC_Mesh *targetMesh, const EntityList& entities);
+    /// Runs occluder selection for a generated scene of @c count meshes and logs timings.
+    void BenchmarkOccluderSelection();
+    void BenchmarkOccluderSelection(QString count);
 
     void TomeGenerated(const QString& fileName);
 
 private:
+    struct OccluderCandidate
+    {
+        Entity *entity;
+        EC_Mesh *mesh;
+        uint meshIndex;     ///< Index of the mesh in its entity.
+        uint boundsIndex;   ///< Index to the bounds of all meshes.
+        bool occluder;      ///< Passes occluder heuristics.
+    };
+
     void CreateOcclusionComponents();
 
+    /// Builds @c bvh over the enclosing AABBs of @c obbs.
+    void BuildBVH(const std::vector<OBB> &obbs, RocketOcclusionBVH &bvh) const;
+
+    /// Sets @c containers[i] true if obbs[targets[i]] contains any other box.
+    void FindContainers(const std::vector<OBB> &obbs, const RocketOcclusionBVH &bvh,
+        const std::vector<uint> &targets, std::vector<bool> &containers) const;
+
+    /// Returns if @c mesh is big, solid and simple enough to be worth using as an occluder.
+    bool IsUsefulOccluder(EC_Mesh *mesh, const OBB &obb) const;
+
     void StartTomeGeneration();
 
     RocketPlugin* plugin_;
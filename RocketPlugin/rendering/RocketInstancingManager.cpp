@@ -0,0 +1,474 @@
+/**
+    @author Adminotech Ltd.
+
+    Copyright Adminotech Ltd.
+    All rights reserved.
+
+    @file
+    @brief   */
+
+#include "StableHeaders.h"
+
+#include "RocketInstancingManager.h"
+#include "RocketPlugin.h"
+
+#include "Framework.h"
+#include "FrameAPI.h"
+#include "SceneAPI.h"
+#include "IRenderer.h"
+#include "AssetAPI.h"
+#include "LoggingFunctions.h"
+#include "Scene.h"
+#include "Entity.h"
+#include "IAttribute.h"
+
+#include "EC_Mesh.h"
+#include "EC_Placeable.h"
+#include "EC_Script.h"
+
+#include "OgreRenderingModule.h"
+#include "Renderer.h"
+
+#include <OgreEntity.h>
+
+/// @cond PRIVATE
+
+namespace
+{
+    /// How often dirty meshes and groups are processed, in seconds.
+    const float UpdateInterval = 0.5f;
+    /// Transform changes within one detection window that mark an entity dynamic.
+    const uint DynamicTransformChanges = 3;
+    /// Length of the dynamic detection window, in seconds.
+    const float DynamicWindow = 5.f;
+    /// How long a dynamic entity is excluded from batching after it stops moving, in seconds.
+    const float DynamicCooldown = 30.f;
+}
+
+const uint RocketInstancingManager::MinInstances = 8;
+
+RocketInstancingManager::RocketInstancingManager(RocketPlugin *plugin) :
+    plugin_(plugin),
+    framework_(plugin->GetFramework()),
+    LC("[RocketInstancingManager]: "),
+    enabled_(!plugin->GetFramework()->HasCommandLineParameter("--rocketNoAutoInstancing")),
+    settingAttribute_(false),
+    tUpdate_(0.f),
+    tDynamicWindow_(DynamicWindow)
+{
+    connect(framework_->Scene(), SIGNAL(SceneAboutToBeRemoved(Scene*, AttributeChange::Type)), SLOT(OnSceneRemoved(Scene*)));
+
+    // The scene that is being rendered is batched.
+    OgreRenderingModule *renderingModule = framework_->Module<OgreRenderingModule>();
+    if (renderingModule && renderingModule->Renderer())
+        connect(renderingModule->Renderer().get(), SIGNAL(MainCameraChanged(Entity *)), SLOT(OnMainCameraChanged(Entity *)));
+    if (framework_->Renderer())
+        SetScene(framework_->Renderer()->MainCameraScene());
+}
+
+RocketInstancingManager::~RocketInstancingManager()
+{
+    if (scene_.lock().get())
+        Clear();
+}
+
+void RocketInstancingManager::SetEnabled(bool enabled)
+{
+    if (enabled_ == enabled)
+        return;
+    enabled_ = enabled;
+
+    // Re-evaluate all groups. Disabled state reverts every automatically instanced mesh.
+    foreach(const QString &key, groups_.keys())
+        UpdateGroup(key);
+    LogInfo(LC + (enabled_ ? "Automatic instancing enabled" : "Automatic instancing disabled"));
+}
+
+bool RocketInstancingManager::IsEnabled() const
+{
+    return enabled_;
+}
+
+void RocketInstancingManager::OnMainCameraChanged(Entity * /*cameraEntity*/)
+{
+    SetScene(framework_->Renderer() ? framework_->Renderer()->MainCameraScene() : 0);
+}
+
+void RocketInstancingManager::SetScene(Scene *newScene)
+{
+    ScenePtr current = scene_.lock();
+    if (current.get() == newScene)
+        return;
+
+    // Revert the previous scene, it stays alive when the camera moves to another scene.
+    if (current.get())
+    {
+        Clear();
+        disconnect(current.get(), 0, this, 0);
+        disconnect(framework_->Frame(), SIGNAL(Updated(float)), this, SLOT(OnUpdate(float)));
+        scene_.reset();
+    }
+    if (!newScene)
+        return;
+
+    ScenePtr scene = newScene->shared_from_this();
+    scene_ = scene;
+    connect(scene.get(), SIGNAL(ComponentAdded(Entity*, IComponent*, AttributeChange::Type)),
+        SLOT(OnComponentAdded(Entity*, IComponent*, AttributeChange::Type)), Qt::UniqueConnection);
+    connect(scene.get(), SIGNAL(ComponentRemoved(Entity*, IComponent*, AttributeChange::Type)),
+        SLOT(OnComponentRemoved(Entity*, IComponent*, AttributeChange::Type)), Qt::UniqueConnection);
+    connect(scene.get(), SIGNAL(AttributeChanged(IComponent*, IAttribute*, AttributeChange::Type)),
+        SLOT(OnAttributeChanged(IComponent*, IAttribute*, AttributeChange::Type)), Qt::UniqueConnection);
+    connect(framework_->Frame(), SIGNAL(Updated(float)), SLOT(OnUpdate(float)), Qt::UniqueConnection);
+
+    // Most of the scene has usually replicated before the main camera is set.
+    EntityList entities = scene->EntitiesWithComponent(EC_Mesh::TypeIdStatic());
+    for (EntityList::const_iterator iter = entities.begin(); iter != entities.end(); ++iter)
+    {
+        std::vector<shared_ptr<EC_Mesh> > meshes = (*iter)->ComponentsOfType<EC_Mesh>();
+        for (size_t i=0; i<meshes.size(); ++i)
+            Track(meshes[i].get());
+    }
+}
+
+void RocketInstancingManager::OnSceneRemoved(Scene *removed)
+{
+    ScenePtr scene = scene_.lock();
+    if (!scene.get() || scene.get() != removed)
+        return;
+
+    disconnect(scene.get(), 0, this, 0);
+    disconnect(framework_->Frame(), SIGNAL(Updated(float)), this, SLOT(OnUpdate(float)));
+    meshes_.clear();
+    groups_.clear();
+    dirtyGroups_.clear();
+    dirtyMeshes_.clear();
+    scene_.reset();
+}
+
+void RocketInstancingManager::Clear()
+{
+    // Revert our local changes, the scene might outlive us.
+    for (QHash<EC_Mesh*, MeshState>::iterator iter = meshes_.begin(); iter != meshes_.end(); ++iter)
+        if (iter->instanced)
+            SetInstancing(iter.key(), false);
+    meshes_.clear();
+    groups_.clear();
+    dirtyGroups_.clear();
+    dirtyMeshes_.clear();
+}
+
+void RocketInstancingManager::OnComponentAdded(Entity *entity, IComponent *component, AttributeChange::Type /*change*/)
+{
+    if (!component)
+        return;
+    if (component->TypeId() == EC_Mesh::TypeIdStatic())
+        Track(static_cast<EC_Mesh*>(component));
+    else if (entity)
+    {
+        // Components that affect eligibility, eg. EC_Script or EC_Placeable.
+        std::vector<shared_ptr<EC_Mesh> > meshes = entity->ComponentsOfType<EC_Mesh>();
+        for (size_t i=0; i<meshes.size(); ++i)
+            dirtyMeshes_ << meshes[i].get();
+    }
+}
+
+void RocketInstancingManager::OnComponentRemoved(Entity *entity, IComponent *component, AttributeChange::Type /*change*/)
+{
+    if (!component)
+        return;
+    if (component->TypeId() == EC_Mesh::TypeIdStatic())
+        Untrack(static_cast<EC_Mesh*>(component));
+    else if (entity)
+    {
+        std::vector<shared_ptr<EC_Mesh> > meshes = entity->ComponentsOfType<EC_Mesh>();
+        for (size_t i=0; i<meshes.size(); ++i)
+            dirtyMeshes_ << meshes[i].get();
+    }
+}
+
+void RocketInstancingManager::OnAttributeChanged(IComponent *component, IAttribute *attribute, AttributeChange::Type /*change*/)
+{
+    if (settingAttribute_ || !component || !attribute)
+        return;
+
+    const u32 typeId = component->TypeId();
+    if (typeId == EC_Mesh::TypeIdStatic())
+    {
+        EC_Mesh *mesh = static_cast<EC_Mesh*>(component);
+        QHash<EC_Mesh*, MeshState>::iterator iter = meshes_.find(mesh);
+        if (iter == meshes_.end())
+            return;
+
+        if (attribute == &mesh->meshRef || attribute == &mesh->meshMaterial || attribute == &mesh->skeletonRef)
+            dirtyMeshes_ << mesh;
+        else if (attribute->Id() == "useInstancing")
+        {
+            const bool value = static_cast<Attribute<bool>*>(attribute)->Get();
+            if (value && !iter->instanced)
+            {
+                // The scene wants instancing for this mesh, leave it to the scene from now on.
+                iter->sceneManaged = true;
+                dirtyMeshes_ << mesh;
+            }
+            else if (!value && iter->instanced)
+            {
+                // Our local change was overwritten eg. by a full component update from the server.
+                iter->instanced = false;
+                if (!iter->key.isEmpty())
+                    dirtyGroups_ << iter->key;
+            }
+        }
+    }
+    else if (typeId == EC_Placeable::TypeIdStatic())
+    {
+        EC_Placeable *placeable = static_cast<EC_Placeable*>(component);
+        Entity *entity = placeable->ParentEntity();
+        if (!entity)
+            return;
+        const bool transformChanged = (attribute == &placeable->transform);
+        if (!transformChanged && attribute != &placeable->parentRef)
+            return;
+
+        std::vector<shared_ptr<EC_Mesh> > meshes = entity->ComponentsOfType<EC_Mesh>();
+        for (size_t i=0; i<meshes.size(); ++i)
+        {
+            QHash<EC_Mesh*, MeshState>::iterator iter = meshes_.find(meshes[i].get());
+            if (iter == meshes_.end())
+                continue;
+            if (transformChanged)
+            {
+                iter->transformChanges++;
+                if (iter->transformChanges >= DynamicTransformChanges)
+                {
+                    if (iter->dynamicCooldown <= 0.f)
+                        dirtyMeshes_ << iter.key();
+                    iter->dynamicCooldown = DynamicCooldown;
+                }
+            }
+            else
+                dirtyMeshes_ << iter.key();
+        }
+    }
+}
+
+void RocketInstancingManager::OnUpdate(float frametime)
+{
+    tDynamicWindow_ -= frametime;
+    const bool resetWindow = (tDynamicWindow_ <= 0.f);
+    if (resetWindow)
+        tDynamicWindow_ = DynamicWindow;
+
+    for (QHash<EC_Mesh*, MeshState>::iterator iter = meshes_.begin(); iter != meshes_.end(); ++iter)
+    {
+        if (resetWindow)
+            iter->transformChanges = 0;
+        if (iter->dynamicCooldown > 0.f)
+        {
+            iter->dynamicCooldown -= frametime;
+            if (iter->dynamicCooldown <= 0.f)
+                dirtyMeshes_ << iter.key();
+        }
+    }
+
+    tUpdate_ -= frametime;
+    if (tUpdate_ > 0.f)
+        return;
+    tUpdate_ = UpdateInterval;
+
+    if (!dirtyMeshes_.isEmpty())
+    {
+        QSet<EC_Mesh*> dirty = dirtyMeshes_;
+        dirtyMeshes_.clear();
+        foreach(EC_Mesh *mesh, dirty)
+            Rekey(mesh);
+    }
+    if (!dirtyGroups_.isEmpty())
+    {
+        QSet<QString> dirty = dirtyGroups_;
+        dirtyGroups_.clear();
+        foreach(const QString &key, dirty)
+            UpdateGroup(key);
+    }
+}
+
+void RocketInstancingManager::Track(EC_Mesh *mesh)
+{
+    if (!mesh || meshes_.contains(mesh))
+        return;
+
+    MeshState state;
+    Attribute<bool> *useInstancing = dynamic_cast<Attribute<bool>*>(mesh->AttributeById("useInstancing"));
+    if (!useInstancing)
+        return; // Tundra build without instancing support.
+    state.sceneManaged = useInstancing->Get();
+
+    meshes_[mesh] = state;
+    dirtyMeshes_ << mesh;
+}
+
+void RocketInstancingManager::Untrack(EC_Mesh *mesh)
+{
+    QHash<EC_Mesh*, MeshState>::iterator iter = meshes_.find(mesh);
+    if (iter == meshes_.end())
+        return;
+
+    if (!iter->key.isEmpty())
+    {
+        groups_[iter->key].remove(mesh);
+        if (groups_[iter->key].isEmpty())
+            groups_.remove(iter->key);
+        dirtyGroups_ << iter->key;
+    }
+    dirtyMeshes_.remove(mesh);
+    meshes_.erase(iter);
+}
+
+void RocketInstancingManager::Rekey(EC_Mesh *mesh)
+{
+    QHash<EC_Mesh*, MeshState>::iterator iter = meshes_.find(mesh);
+    if (iter == meshes_.end())
+        return;
+
+    const QString key = GroupKey(mesh);
+    if (key == iter->key)
+    {
+        if (!key.isEmpty())
+            dirtyGroups_ << key;
+        return;
+    }
+
+    if (!iter->key.isEmpty())
+    {
+        groups_[iter->key].remove(mesh);
+        if (groups_[iter->key].isEmpty())
+            groups_.remove(iter->key);
+        dirtyGroups_ << iter->key;
+    }
+    if (iter->instanced)
+        SetInstancing(mesh, false);
+
+    iter->key = key;
+    if (!key.isEmpty())
+    {
+        groups_[key].insert(mesh);
+        dirtyGroups_ << key;
+    }
+}
+
+void RocketInstancingManager::UpdateGroup(const QString &key)
+{
+    QHash<QString, QSet<EC_Mesh*> >::const_iterator group = groups_.find(key);
+    if (group == groups_.end())
+        return;
+
+    const bool instance = (enabled_ && static_cast<uint>(group->size()) >= MinInstances);
+    foreach(EC_Mesh *mesh, group.value())
+        SetInstancing(mesh, instance);
+}
+
+QString RocketInstancingManager::GroupKey(EC_Mesh *mesh) const
+{
+    QHash<EC_Mesh*, MeshState>::const_iterator iter = meshes_.find(mesh);
+    if (iter == meshes_.end() || iter->sceneManaged || iter->dynamicCooldown > 0.f)
+        return "";
+
+    Entity *entity = mesh->ParentEntity();
+    if (!entity)
+        return "";
+
+    // Skip anything that is animated or might be moved around.
+    const QString meshRef = mesh->meshRef.Get().ref.trimmed();
+    if (meshRef.isEmpty() || !mesh->skeletonRef.Get().ref.trimmed().isEmpty())
+        return "";
+    if (entity->Component("EC_AnimationController").get() || !entity->ComponentsOfType<EC_Script>().empty())
+        return "";
+    IComponent *rigidBody = entity->Component("EC_RigidBody").get();
+    if (rigidBody)
+    {
+        IAttribute *mass = rigidBody->AttributeById("mass");
+        if (mass && mass->ToString().toFloat() > 0.f)
+            return "";
+    }
+    EC_Placeable *placeable = entity->Component<EC_Placeable>().get();
+    if (!placeable || !placeable->parentRef.Get().ref.trimmed().isEmpty())
+        return "";
+
+    QStringList materials;
+    const AssetReferenceList &materialRefs = mesh->meshMaterial.Get();
+    for (int i=0; i<materialRefs.Size(); ++i)
+        materials << framework_->Asset()->ResolveAssetRef("", materialRefs[i].ref.trimmed());
+
+    return framework_->Asset()->ResolveAssetRef("", meshRef) + "|" + materials.join(";");
+}
+
+void RocketInstancingManager::SetInstancing(EC_Mesh *mesh, bool enabled)
+{
+    QHash<EC_Mesh*, MeshState>::iterator iter = meshes_.find(mesh);
+    if (iter == meshes_.end() || iter->sceneManaged)
+        return;
+
+    Attribute<bool> *useInstancing = dynamic_cast<Attribute<bool>*>(mesh->AttributeById("useInstancing"));
+    if (!useInstancing)
+        return;
+
+    iter->instanced = enabled;
+    if (useInstancing->Get() == enabled)
+        return;
+
+    settingAttribute_ = true;
+    useInstancing->Set(enabled, AttributeChange::LocalOnly);
+    settingAttribute_ = false;
+}
+
+uint RocketInstancingManager::NumSubmeshes(EC_Mesh *mesh) const
+{
+    Ogre::Entity *ogreEntity = mesh->OgreEntity();
+    return (ogreEntity ? static_cast<uint>(ogreEntity->getNumSubEntities()) : 0);
+}
+
+RocketInstancingManager::Stats RocketInstancingManager::Statistics() const
+{
+    Stats stats;
+    stats.meshes = static_cast<uint>(meshes_.size());
+    stats.groups = static_cast<uint>(groups_.size());
+
+    for (QHash<EC_Mesh*, MeshState>::const_iterator iter = meshes_.begin(); iter != meshes_.end(); ++iter)
+    {
+        const uint submeshes = NumSubmeshes(iter.key());
+        stats.batchesBefore += submeshes;
+        if (iter->instanced)
+            stats.instancedMeshes++;
+        else
+            stats.batchesAfter += submeshes;
+    }
+
+    // Each instanced group is drawn with one batch per submesh.
+    for (QHash<QString, QSet<EC_Mesh*> >::const_iterator iter = groups_.begin(); iter != groups_.end(); ++iter)
+    {
+        if (iter->isEmpty())
+            continue;
+        EC_Mesh *first = *iter->begin();
+        QHash<EC_Mesh*, MeshState>::const_iterator state = meshes_.find(first);
+        if (state == meshes_.end() || !state->instanced)
+            continue;
+        stats.instancedGroups++;
+        stats.batchesAfter += NumSubmeshes(first);
+    }
+    return stats;
+}
+
+void RocketInstancingManager::DumpStatistics(QTextStream &stream) const
+{
+    const Stats stats = Statistics();
+    stream << "Automatic instancing" << (!enabled_ ? "    (disabled)" : "") << endl
+           << QString("  %1").arg("# of tracked meshes ", -45) << stats.meshes << endl
+           << QString("  %1").arg("# of unique mesh and material groups ", -45) << stats.groups << endl
+           << QString("  %1").arg("# of instanced groups ", -45) << stats.instancedGroups << endl
+           << QString("  %1").arg("# of instanced meshes ", -45) << stats.instancedMeshes << endl
+           << QString("  %1").arg("# of est. mesh batches before instancing ", -45) << stats.batchesBefore << endl
+           << QString("  %1").arg("# of est. mesh batches after instancing ", -45) << stats.batchesAfter << endl
+           << endl;
+}
+
+/// @endcond
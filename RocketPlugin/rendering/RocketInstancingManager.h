@@ -0,0 +1,125 @@
+/**
+    @author Adminotech Ltd.
+
+    Copyright Adminotech Ltd.
+    All rights reserved.
+
+    @file
+    @brief   */
+
+#pragma once
+
+#include "RocketFwd.h"
+#include "SceneFwd.h"
+#include "OgreModuleFwd.h"
+#include "AttributeChangeType.h"
+
+#include <QObject>
+#include <QHash>
+#include <QSet>
+#include <QString>
+#include <QTextStream>
+
+/// @cond PRIVATE
+
+/// Automatically enables hardware instancing for static meshes that share mesh and materials.
+/** Tracks EC_Mesh components of the main camera scene and groups them by mesh and material refs.
+    Groups with at least MinInstances static members get EC_Mesh 'useInstancing' enabled as a local
+    only change, so the instanced shaders created by RocketPlugin::RenderingCreateInstancingShaders are used.
+    Entities that are animated, parented, scripted or whose transform keeps changing are never batched.
+    Meshes where the scene itself sets 'useInstancing' are left alone. */
+class RocketInstancingManager : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit RocketInstancingManager(RocketPlugin *plugin);
+    ~RocketInstancingManager();
+
+    /// Batching statistics.
+    struct Stats
+    {
+        uint meshes;            ///< Tracked meshes.
+        uint groups;            ///< Unique mesh + material combinations.
+        uint instancedGroups;   ///< Groups rendered with instancing.
+        uint instancedMeshes;   ///< Meshes rendered with instancing.
+        uint batchesBefore;     ///< Estimated draw batches without automatic instancing (one per submesh).
+        uint batchesAfter;      ///< Estimated draw batches with automatic instancing.
+
+        Stats() : meshes(0), groups(0), instancedGroups(0), instancedMeshes(0), batchesBefore(0), batchesAfter(0) {}
+    };
+
+    /// Returns current batching statistics.
+    Stats Statistics() const;
+
+    /// Writes statistics to @c stream, used by RocketReporter.
+    void DumpStatistics(QTextStream &stream) const;
+
+    /// Enables or disables automatic instancing. Disabling reverts all automatically enabled meshes.
+    void SetEnabled(bool enabled);
+    bool IsEnabled() const;
+
+    /// Minimum group size before instancing is enabled.
+    static const uint MinInstances;
+
+private slots:
+    void OnMainCameraChanged(Entity *cameraEntity);
+    void OnSceneRemoved(Scene *scene);
+
+    void OnComponentAdded(Entity *entity, IComponent *component, AttributeChange::Type change);
+    void OnComponentRemoved(Entity *entity, IComponent *component, AttributeChange::Type change);
+    void OnAttributeChanged(IComponent *component, IAttribute *attribute, AttributeChange::Type change);
+
+    void OnUpdate(float frametime);
+
+private:
+    struct MeshState
+    {
+        QString key;            ///< Current group key, empty if not grouped.
+        bool instanced;         ///< If we have enabled instancing.
+        bool sceneManaged;      ///< Scene sets 'useInstancing' itself, don't touch.
+        uint transformChanges;  ///< Transform changes during the current dynamic detection window.
+        float dynamicCooldown;  ///< Seconds until the entity is considered static again.
+
+        MeshState() : instanced(false), sceneManaged(false), transformChanges(0), dynamicCooldown(0.f) {}
+    };
+
+    /// Starts batching @c scene, reverting the previous scene. Null stops batching.
+    void SetScene(Scene *scene);
+
+    void Track(EC_Mesh *mesh);
+    void Untrack(EC_Mesh *mesh);
+    void Clear();
+
+    /// Re-evaluates group key of @c mesh and marks affected groups dirty.
+    void Rekey(EC_Mesh *mesh);
+
+    /// Applies instancing state for all meshes of group @c key.
+    void UpdateGroup(const QString &key);
+
+    /// Returns group key or empty string if @c mesh can't be batched.
+    QString GroupKey(EC_Mesh *mesh) const;
+
+    /// Sets 'useInstancing' of @c mesh as a local change.
+    void SetInstancing(EC_Mesh *mesh, bool enabled);
+
+    /// Returns submesh count of the currently loaded mesh.
+    uint NumSubmeshes(EC_Mesh *mesh) const;
+
+    RocketPlugin *plugin_;
+    Framework *framework_;
+    QString LC;
+
+    SceneWeakPtr scene_;
+    bool enabled_;
+    bool settingAttribute_;
+    float tUpdate_;
+    float tDynamicWindow_;
+
+    QHash<EC_Mesh*, MeshState> meshes_;
+    QHash<QString, QSet<EC_Mesh*> > groups_;
+    QSet<QString> dirtyGroups_;
+    QSet<EC_Mesh*> dirtyMeshes_;
+};
+
+/// @endcond
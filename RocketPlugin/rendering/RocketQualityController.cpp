@@ -0,0 +1,204 @@
+/**
+    @author Adminotech Ltd.
+
+    Copyright Adminotech Ltd.
+    All rights reserved.
+
+    @file   RocketQualityController.cpp
+    @brief  Frame time driven controller for individual rendering quality knobs. */
+
+#include "StableHeaders.h"
+
+#include "RocketQualityController.h"
+
+#include <cmath>
+
+/// @cond PRIVATE
+
+namespace
+{
+    const int MaxLevels = 5;
+
+    /// Quality factors per level, rows in RocketQualityController::Knob order. Zero terminated.
+    const float Factors[RocketQualityController::NumKnobs][MaxLevels] =
+    {
+        { 1.f, 0.6f, 0.35f, 0.2f, 0.f },    // ParticleQuota
+        { 1.f, 0.5f, 0.25f, 0.f, 0.f },     // ReflectionResolution
+        { 1.f, 0.6f, 0.35f, 0.f, 0.f },     // ShadowDistance
+        { 1.f, 0.7f, 0.45f, 0.3f, 0.f },    // LodBias
+        { 1.f, 0.8f, 0.65f, 0.5f, 0.4f },   // ViewDistance
+        { 1.f, 0.6f, 0.3f, 0.f, 0.f }       // BrowserProcesses
+    };
+
+    /// Rough share of frame time each knob affects in a typical Meshmoon scene.
+    const float FrameShares[RocketQualityController::NumKnobs] = { 0.1f, 0.1f, 0.15f, 0.1f, 0.2f, 0.05f };
+}
+
+RocketQualityController::Settings::Settings() :
+    targetMsecs(1000.f / 30.f),
+    degradeRatio(1.1f),
+    upgradeRatio(0.75f),
+    smoothingSeconds(0.5f),
+    degradeHoldSeconds(1.f),
+    upgradeHoldSeconds(4.f),
+    maxUpgradeHoldSeconds(60.f),
+    cooldownSeconds(1.5f),
+    reversalSeconds(10.f),
+    maxSampleRatio(4.f)
+{
+}
+
+RocketQualityController::RocketQualityController()
+{
+    Reset();
+}
+
+void RocketQualityController::Reset()
+{
+    for(int i = 0; i < NumKnobs; ++i)
+        levels_[i] = 0;
+    history_.clear();
+    time_ = 0.f;
+    smoothed_ = -1.f;
+    overTime_ = 0.f;
+    underTime_ = 0.f;
+    cooldown_ = 0.f;
+    upgradeHold_ = settings_.upgradeHoldSeconds;
+    lastUpgradeTime_ = -1e6f;
+    lastReversalTime_ = 0.f;
+    exhausted_ = false;
+}
+
+bool RocketQualityController::Update(float frameMsecs, float dt, Decision &decision)
+{
+    if (dt <= 0.f || frameMsecs < 0.f)
+        return false;
+
+    time_ += dt;
+    stats_.seconds += dt;
+
+    const float sample = std::min(frameMsecs, settings_.targetMsecs * settings_.maxSampleRatio);
+    if (smoothed_ < 0.f)
+        smoothed_ = sample;
+    else
+        smoothed_ += (sample - smoothed_) * (1.f - std::exp(-dt / settings_.smoothingSeconds));
+
+    if (cooldown_ > 0.f)
+        cooldown_ -= dt;
+
+    if (smoothed_ > settings_.targetMsecs * settings_.degradeRatio)
+    {
+        overTime_ += dt;
+        underTime_ = 0.f;
+        stats_.overSeconds += dt;
+    }
+    else if (smoothed_ < settings_.targetMsecs * settings_.upgradeRatio)
+    {
+        underTime_ += dt;
+        overTime_ = 0.f;
+        exhausted_ = false;
+    }
+    else
+    {
+        overTime_ = 0.f;
+        underTime_ = 0.f;
+        exhausted_ = false;
+    }
+
+    // Relax the upgrade back off after a long stable period.
+    if (upgradeHold_ > settings_.upgradeHoldSeconds && time_ - lastReversalTime_ > settings_.maxUpgradeHoldSeconds)
+    {
+        upgradeHold_ = std::max(upgradeHold_ * 0.5f, settings_.upgradeHoldSeconds);
+        lastReversalTime_ = time_;
+    }
+
+    if (cooldown_ > 0.f)
+        return false;
+
+    if (overTime_ >= settings_.degradeHoldSeconds)
+    {
+        int knob = 0;
+        while(knob < NumKnobs && levels_[knob] >= MaxLevel(static_cast<Knob>(knob)))
+            ++knob;
+        if (knob >= NumKnobs)
+        {
+            exhausted_ = true;
+            return false;
+        }
+
+        decision.time = time_;
+        decision.knob = static_cast<Knob>(knob);
+        decision.from = levels_[knob];
+        decision.to = ++levels_[knob];
+        decision.frameMsecs = smoothed_;
+        history_.push_back(decision.knob);
+
+        stats_.degrades++;
+        if (time_ - lastUpgradeTime_ < settings_.reversalSeconds)
+        {
+            stats_.reversals++;
+            upgradeHold_ = std::min(upgradeHold_ * 2.f, settings_.maxUpgradeHoldSeconds);
+            lastReversalTime_ = time_;
+        }
+    }
+    else if (underTime_ >= upgradeHold_ && !history_.isEmpty())
+    {
+        const Knob knob = history_.back();
+        history_.pop_back();
+
+        decision.time = time_;
+        decision.knob = knob;
+        decision.from = levels_[knob];
+        decision.to = --levels_[knob];
+        decision.frameMsecs = smoothed_;
+
+        stats_.upgrades++;
+        lastUpgradeTime_ = time_;
+    }
+    else
+        return false;
+
+    overTime_ = 0.f;
+    underTime_ = 0.f;
+    cooldown_ = settings_.cooldownSeconds;
+    return true;
+}
+
+int RocketQualityController::MaxLevel(Knob knob)
+{
+    if (knob < 0 || knob >= NumKnobs)
+        return 0;
+    int level = 1;
+    while(level < MaxLevels && Factors[knob][level] > 0.f)
+        ++level;
+    return level - 1;
+}
+
+float RocketQualityController::Factor(Knob knob, int level)
+{
+    if (knob < 0 || knob >= NumKnobs)
+        return 1.f;
+    level = std::max(0, std::min(level, MaxLevel(knob)));
+    return Factors[knob][level];
+}
+
+float RocketQualityController::FrameShare(Knob knob)
+{
+    return (knob >= 0 && knob < NumKnobs ? FrameShares[knob] : 0.f);
+}
+
+QString RocketQualityController::KnobName(Knob knob)
+{
+    switch(knob)
+    {
+    case ParticleQuota: return "particle quota";
+    case ReflectionResolution: return "reflection resolution";
+    case ShadowDistance: return "shadow distance";
+    case LodBias: return "LOD bias";
+    case ViewDistance: return "view distance";
+    case BrowserProcesses: return "browser processes";
+    default: return "unknown";
+    }
+}
+
+/// @endcond
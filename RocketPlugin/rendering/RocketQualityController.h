@@ -0,0 +1,133 @@
+/**
+    @author Adminotech Ltd.
+
+    Copyright Adminotech Ltd.
+    All rights reserved.
+
+    @file   RocketQualityController.h
+    @brief  Frame time driven controller for individual rendering quality knobs. */
+
+#pragma once
+
+#include <QVector>
+#include <QString>
+
+/// @cond PRIVATE
+
+/// Decides rendering quality knob levels from measured frame times.
+/** Frame times are smoothed and compared against a frame time budget. When the smoothed frame time
+    stays over the budget for a while one knob is lowered by one level, in the Knob enum order.
+    When it stays well under the budget for a longer while the most recently lowered knob is raised
+    again. The gap between the degrade and upgrade thresholds, the hold times and a cooldown after
+    each change form the hysteresis. If raising a knob quickly causes a degrade again the upgrade hold
+    time is doubled, so the controller settles instead of oscillating. Does not touch the renderer,
+    see RocketQualityGovernor. */
+class RocketQualityController
+{
+public:
+    /// Quality knobs in the order they are lowered.
+    enum Knob
+    {
+        ParticleQuota = 0,
+        ReflectionResolution,
+        ShadowDistance,
+        LodBias,
+        ViewDistance,
+        BrowserProcesses,
+        NumKnobs
+    };
+
+    struct Settings
+    {
+        float targetMsecs;          ///< Frame time budget.
+        float degradeRatio;         ///< Degrade when the smoothed frame time is over targetMsecs * degradeRatio.
+        float upgradeRatio;         ///< Upgrade when the smoothed frame time is under targetMsecs * upgradeRatio.
+        float smoothingSeconds;     ///< Time constant of the frame time smoothing.
+        float degradeHoldSeconds;   ///< Time over budget before degrading.
+        float upgradeHoldSeconds;   ///< Time under budget before upgrading.
+        float maxUpgradeHoldSeconds;///< Upper limit for the backed off upgrade hold.
+        float cooldownSeconds;      ///< Time after a change before the next one, lets its effect show up in the frame times.
+        float reversalSeconds;      ///< A degrade this soon after an upgrade is a reversal and backs off upgrades.
+        float maxSampleRatio;       ///< Single frame times are clamped to targetMsecs * maxSampleRatio, hitches do not dominate.
+
+        Settings();
+    };
+
+    /// One knob change.
+    struct Decision
+    {
+        float time;         ///< Controller time in seconds.
+        Knob knob;
+        int from;
+        int to;
+        float frameMsecs;   ///< Smoothed frame time that caused the change.
+
+        Decision() : time(0.f), knob(ParticleQuota), from(0), to(0), frameMsecs(0.f) {}
+    };
+
+    struct Stats
+    {
+        uint degrades;
+        uint upgrades;
+        uint reversals;         ///< Degrades soon after an upgrade.
+        float seconds;          ///< Total fed frame time.
+        float overSeconds;      ///< Time the smoothed frame time was over the degrade threshold.
+
+        Stats() : degrades(0), upgrades(0), reversals(0), seconds(0.f), overSeconds(0.f) {}
+    };
+
+    RocketQualityController();
+
+    void SetSettings(const Settings &settings) { settings_ = settings; upgradeHold_ = settings.upgradeHoldSeconds; }
+    const Settings &CurrentSettings() const { return settings_; }
+
+    /// Feeds one frame of @c frameMsecs that took @c dt seconds.
+    /** @return True if a knob level was changed, @c decision is filled then. */
+    bool Update(float frameMsecs, float dt, Decision &decision);
+
+    /// Current level of @c knob, 0 is full quality.
+    int Level(Knob knob) const { return levels_[knob]; }
+
+    /// Returns true if any knob is lowered.
+    bool IsDegraded() const { return !history_.isEmpty(); }
+
+    /// Returns true if every knob is at its lowest level and frame time is still over budget.
+    bool IsExhausted() const { return exhausted_; }
+
+    float SmoothedMsecs() const { return smoothed_ < 0.f ? 0.f : smoothed_; }
+    float UpgradeHoldSeconds() const { return upgradeHold_; }
+
+    /// Raises all knobs back to full quality and forgets the frame time history.
+    void Reset();
+
+    const Stats &Statistics() const { return stats_; }
+    void ResetStatistics() { stats_ = Stats(); }
+
+    /// Lowest level of @c knob.
+    static int MaxLevel(Knob knob);
+
+    /// Quality factor of @c knob at @c level, 1.0 at level 0.
+    static float Factor(Knob knob, int level);
+
+    /// Estimated fraction of frame time affected by @c knob, used by simulations.
+    static float FrameShare(Knob knob);
+
+    static QString KnobName(Knob knob);
+
+private:
+    Settings settings_;
+    Stats stats_;
+    int levels_[NumKnobs];
+    QVector<Knob> history_;     ///< Lowered knobs, the last one is raised first.
+    float time_;
+    float smoothed_;
+    float overTime_;
+    float underTime_;
+    float cooldown_;
+    float upgradeHold_;
+    float lastUpgradeTime_;
+    float lastReversalTime_;
+    bool exhausted_;
+};
+
+/// @endcond
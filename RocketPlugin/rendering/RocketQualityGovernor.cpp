@@ -0,0 +1,514 @@
+/**
+    @author Adminotech Ltd.
+
+    Copyright Adminotech Ltd.
+    All rights reserved.
+
+    @file   RocketQualityGovernor.cpp
+    @brief  Adjusts rendering quality at runtime to keep frame time within a budget. */
+
+#include "StableHeaders.h"
+
+#include "RocketQualityGovernor.h"
+#include "RocketPlugin.h"
+#include "RocketSettings.h"
+
+#include "MeshmoonComponents.h"
+#include "EC_MeshmoonWater.h"
+
+#include "Framework.h"
+#include "Application.h"
+#include "FrameAPI.h"
+#include "ConsoleAPI.h"
+#include "ConfigAPI.h"
+#include "IRenderer.h"
+#include "LoggingFunctions.h"
+#include "Math/MathFunc.h"
+#include "Scene.h"
+#include "Entity.h"
+#include "EC_Camera.h"
+#include "OgreWorld.h"
+#include "OgreRenderingModule.h"
+#include "Renderer.h"
+#include "TundraLogicModule.h"
+#include "Client.h"
+
+#include <OgreCamera.h>
+#include <OgreSceneManager.h>
+#include <OgreParticleSystem.h>
+#include <OgreParticleSystemManager.h>
+
+#include <QFile>
+#include <QFileInfo>
+
+/// @cond PRIVATE
+
+namespace
+{
+    /// How often lowered knobs are applied again to catch new cameras, particle systems and water, in seconds.
+    const float ReapplyInterval = 2.f;
+    /// Number of decisions kept for reporting.
+    const int MaxDecisions = 32;
+    /// Full reflection map resolution of EC_MeshmoonWater.
+    const uint FullReflectionResolution = 1024;
+
+    RocketQualityController::Settings ConfiguredSettings(Framework *framework)
+    {
+        RocketQualityController::Settings settings;
+        const float fps = framework->Config()->Read("adminotech", "clientplugin", "qualitygovernortargetfps", 30).toFloat();
+        settings.targetMsecs = 1000.f / qBound(10.f, fps, 240.f);
+        return settings;
+    }
+
+    /// Deterministic noise for the synthetic traces.
+    struct TraceRandom
+    {
+        explicit TraceRandom(uint seed) : state(seed) {}
+        float Next() { state = state * 1664525u + 1013904223u; return static_cast<float>(state >> 8) / static_cast<float>(1 << 24); }
+        uint state;
+    };
+
+    QVector<float> SyntheticTrace(float seconds, float baseMsecs, float noiseMsecs, float hitchMsecs, float hitchInterval, uint seed)
+    {
+        QVector<float> trace;
+        TraceRandom random(seed);
+        float time = 0.f, nextHitch = hitchInterval;
+        while(time < seconds)
+        {
+            float msecs = baseMsecs + (random.Next() * 2.f - 1.f) * noiseMsecs;
+            if (hitchInterval > 0.f && time >= nextHitch)
+            {
+                msecs = hitchMsecs;
+                nextHitch += hitchInterval;
+            }
+            msecs = std::max(msecs, 1.f);
+            trace.push_back(msecs);
+            time += msecs / 1000.f;
+        }
+        return trace;
+    }
+}
+
+RocketQualityGovernor::RocketQualityGovernor(RocketPlugin *plugin) :
+    plugin_(plugin),
+    framework_(plugin->GetFramework()),
+    LC("[RocketQualityGovernor]: "),
+    enabled_(!plugin->GetFramework()->HasCommandLineParameter("--rocketNoQualityGovernor") &&
+        plugin->GetFramework()->Config()->Read("adminotech", "clientplugin", "qualitygovernor", true).toBool()),
+    tReapply_(ReapplyInterval),
+    shadowBaseDistance_(-1.f),
+    shadowAppliedDistance_(-1.f)
+{
+    for(int i = 0; i < RocketQualityController::NumKnobs; ++i)
+        overridden_[i] = false;
+
+    controller_.SetSettings(ConfiguredSettings(framework_));
+
+    connect(framework_->Frame(), SIGNAL(Updated(float)), SLOT(OnUpdate(float)));
+    if (plugin_->Settings())
+        connect(plugin_->Settings(), SIGNAL(SettingsApplied(const ClientSettings*)), SLOT(OnSettingsApplied(const ClientSettings*)));
+    if (plugin_->GetTundraClient())
+        connect(plugin_->GetTundraClient(), SIGNAL(Disconnected()), SLOT(OnDisconnected()));
+
+    OgreRenderingModule *renderingModule = framework_->Module<OgreRenderingModule>();
+    if (renderingModule && renderingModule->Renderer())
+        connect(renderingModule->Renderer().get(), SIGNAL(MainCameraChanged(Entity *)), SLOT(OnMainCameraChanged(Entity *)));
+
+    framework_->Console()->RegisterCommand("qualityGovernor", "Enables or disables the rendering quality governor, prints its state without parameters. Usage: qualityGovernor(enabled)",
+        this, SLOT(SetEnabledCommand(const QString&)), SLOT(PrintStatus()));
+    if (framework_->HasCommandLineParameter("--rocketDevCommands"))
+        framework_->Console()->RegisterCommand("simulateQualityGovernor", "Replays a frame time trace, one frame time in milliseconds per line, through the quality governor and prints its decisions. Runs synthetic traces without parameters. Usage: simulateQualityGovernor(traceFile)",
+            this, SLOT(SimulateTraceCommand(const QString&)), SLOT(SimulateTraceCommand()));
+}
+
+RocketQualityGovernor::~RocketQualityGovernor()
+{
+}
+
+void RocketQualityGovernor::SetEnabled(bool enabled)
+{
+    if (enabled_ == enabled)
+        return;
+    enabled_ = enabled;
+    Reset();
+    LogInfo(LC + (enabled_ ? "Quality governor enabled" : "Quality governor disabled"));
+}
+
+bool RocketQualityGovernor::IsEnabled() const
+{
+    return enabled_;
+}
+
+bool RocketQualityGovernor::IsExhausted() const
+{
+    return controller_.IsExhausted();
+}
+
+void RocketQualityGovernor::Reset()
+{
+    controller_.Reset();
+    ApplyAll();
+}
+
+void RocketQualityGovernor::OnUpdate(float frametime)
+{
+    if (!enabled_ || !ActiveScene())
+        return;
+    // Inactive application drops the main loop rate, the frame times cannot be trusted.
+    if (!framework_->App()->IsActive())
+        return;
+
+    RocketQualityController::Decision decision;
+    if (controller_.Update(frametime * 1000.f, frametime, decision))
+    {
+        decisions_.push_back(decision);
+        while(decisions_.size() > MaxDecisions)
+            decisions_.pop_front();
+
+        const float factor = RocketQualityController::Factor(decision.knob, decision.to);
+        LogInfo(LC + QString("Frame time %1 msecs, budget %2 msecs: %3 %4% -> %5%")
+            .arg(decision.frameMsecs, 0, 'f', 1).arg(controller_.CurrentSettings().targetMsecs, 0, 'f', 1)
+            .arg(RocketQualityController::KnobName(decision.knob))
+            .arg(qRound(RocketQualityController::Factor(decision.knob, decision.from) * 100.f)).arg(qRound(factor * 100.f)));
+
+        Apply(decision.knob);
+        emit QualityChanged(static_cast<int>(decision.knob), decision.to, factor);
+    }
+
+    if (controller_.IsDegraded())
+    {
+        tReapply_ -= frametime;
+        if (tReapply_ <= 0.f)
+        {
+            tReapply_ = ReapplyInterval;
+            ApplyAll();
+        }
+    }
+}
+
+void RocketQualityGovernor::OnSettingsApplied(const ClientSettings * /*settings*/)
+{
+    // New baseline from the settings, start over from full quality.
+    controller_.SetSettings(ConfiguredSettings(framework_));
+    Reset();
+}
+
+void RocketQualityGovernor::OnDisconnected()
+{
+    Reset();
+    camera_ = 0;
+    shadowBaseDistance_ = -1.f;
+    particleQuotas_.clear();
+}
+
+void RocketQualityGovernor::OnMainCameraChanged(Entity * /*cameraEntity*/)
+{
+    // Restore the previous camera, the new one gets the current levels.
+    if (camera_ && camera_ != ActiveCamera())
+    {
+        if (overridden_[RocketQualityController::ViewDistance] && plugin_->Settings())
+            camera_->farPlane.Set(static_cast<float>(plugin_->Settings()->ViewDistance()), AttributeChange::LocalOnly);
+        if (overridden_[RocketQualityController::LodBias] && camera_->OgreCamera())
+            camera_->OgreCamera()->setLodBias(1.f);
+    }
+    camera_ = ActiveCamera();
+    Apply(RocketQualityController::ViewDistance);
+    Apply(RocketQualityController::LodBias);
+}
+
+void RocketQualityGovernor::Apply(RocketQualityController::Knob knob)
+{
+    const int level = controller_.Level(knob);
+    if (level == 0 && !overridden_[knob])
+        return;
+
+    const float factor = RocketQualityController::Factor(knob, level);
+    switch(knob)
+    {
+    case RocketQualityController::ParticleQuota: ApplyParticleQuota(factor); break;
+    case RocketQualityController::ReflectionResolution: ApplyReflectionResolution(factor); break;
+    case RocketQualityController::ShadowDistance: ApplyShadowDistance(factor); break;
+    case RocketQualityController::LodBias: ApplyLodBias(factor); break;
+    case RocketQualityController::ViewDistance: ApplyViewDistance(factor); break;
+    case RocketQualityController::BrowserProcesses: ApplyBrowserProcesses(factor); break;
+    default: break;
+    }
+    overridden_[knob] = (level > 0);
+}
+
+void RocketQualityGovernor::ApplyAll()
+{
+    for(int knob = 0; knob < RocketQualityController::NumKnobs; ++knob)
+        Apply(static_cast<RocketQualityController::Knob>(knob));
+}
+
+void RocketQualityGovernor::ApplyViewDistance(float factor)
+{
+    EC_Camera *camera = ActiveCamera();
+    if (!camera || !plugin_->Settings())
+        return;
+    camera_ = camera;
+
+    const float farPlane = static_cast<float>(plugin_->Settings()->ViewDistance()) * factor;
+    if (!EqualAbs(camera->farPlane.Get(), farPlane))
+        camera->farPlane.Set(farPlane, AttributeChange::LocalOnly);
+}
+
+void RocketQualityGovernor::ApplyShadowDistance(float factor)
+{
+    Scene *scene = ActiveScene();
+    OgreWorld *world = (scene ? scene->Subsystem<OgreWorld>().get() : 0);
+    Ogre::SceneManager *sceneManager = (world ? world->OgreSceneManager() : 0);
+    if (!sceneManager)
+        return;
+
+    // Pick up changes made by the scene, eg. EC_SceneShadowSetup, as the new base.
+    const float current = sceneManager->getShadowFarDistance();
+    if (shadowBaseDistance_ < 0.f || !EqualAbs(current, shadowAppliedDistance_))
+        shadowBaseDistance_ = current;
+    if (factor >= 1.f)
+    {
+        sceneManager->setShadowFarDistance(shadowBaseDistance_);
+        shadowBaseDistance_ = -1.f;
+        shadowAppliedDistance_ = -1.f;
+        return;
+    }
+
+    // Zero means no limit, scale the view distance instead.
+    float base = shadowBaseDistance_;
+    if (base <= 0.f && plugin_->Settings())
+        base = static_cast<float>(plugin_->Settings()->ViewDistance());
+    shadowAppliedDistance_ = base * factor;
+    sceneManager->setShadowFarDistance(shadowAppliedDistance_);
+}
+
+void RocketQualityGovernor::ApplyLodBias(float factor)
+{
+    EC_Camera *camera = ActiveCamera();
+    if (camera && camera->OgreCamera())
+        camera->OgreCamera()->setLodBias(factor);
+}
+
+void RocketQualityGovernor::ApplyParticleQuota(float factor)
+{
+    Scene *scene = ActiveScene();
+    OgreWorld *world = (scene ? scene->Subsystem<OgreWorld>().get() : 0);
+    Ogre::SceneManager *sceneManager = (world ? world->OgreSceneManager() : 0);
+    if (!sceneManager)
+        return;
+
+    QHash<QString, size_t> seen;
+    Ogre::SceneManager::MovableObjectIterator iter = sceneManager->getMovableObjectIterator(Ogre::ParticleSystemFactory::FACTORY_TYPE_NAME);
+    while(iter.hasMoreElements())
+    {
+        Ogre::ParticleSystem *system = static_cast<Ogre::ParticleSystem*>(iter.getNext());
+        const QString name = QString::fromStdString(system->getName());
+        const size_t original = particleQuotas_.value(name, system->getParticleQuota());
+        seen[name] = original;
+
+        const size_t quota = (factor >= 1.f ? original : std::max<size_t>(1, static_cast<size_t>(original * factor)));
+        if (system->getParticleQuota() != quota)
+            system->setParticleQuota(quota);
+    }
+    // Forget destroyed systems, and all of them once restored.
+    if (factor >= 1.f)
+        particleQuotas_.clear();
+    else
+        particleQuotas_ = seen;
+}
+
+void RocketQualityGovernor::ApplyReflectionResolution(float factor)
+{
+    Scene *scene = ActiveScene();
+    if (!scene)
+        return;
+
+    const uint resolution = static_cast<uint>(FullReflectionResolution * factor);
+    EntityList ents = scene->EntitiesWithComponent(EC_MeshmoonWater::TypeIdStatic());
+    for(EntityList::const_iterator iter = ents.begin(); iter != ents.end(); ++iter)
+    {
+        EC_MeshmoonWater *water = (*iter)->Component<EC_MeshmoonWater>().get();
+        if (water)
+            water->SetReflectionResolution(resolution);
+    }
+}
+
+void RocketQualityGovernor::ApplyBrowserProcesses(float factor)
+{
+    MeshmoonComponents *components = framework_->Module<MeshmoonComponents>();
+    if (components)
+        components->SetBrowserProcessScale(factor);
+}
+
+Scene *RocketQualityGovernor::ActiveScene() const
+{
+    return (framework_->Renderer() ? framework_->Renderer()->MainCameraScene() : 0);
+}
+
+EC_Camera *RocketQualityGovernor::ActiveCamera() const
+{
+    Entity *cameraEntity = (framework_->Renderer() ? framework_->Renderer()->MainCamera() : 0);
+    return (cameraEntity ? cameraEntity->Component<EC_Camera>().get() : 0);
+}
+
+void RocketQualityGovernor::DumpStatistics(QTextStream &stream) const
+{
+    const RocketQualityController::Settings &settings = controller_.CurrentSettings();
+    const RocketQualityController::Stats &stats = controller_.Statistics();
+
+    stream << "Quality governor" << (!enabled_ ? "    (disabled)" : (controller_.IsExhausted() ? "    (all knobs at lowest level)" : "")) << endl
+           << QString("  %1").arg("Frame time budget ", -45) << QString::number(settings.targetMsecs, 'f', 1) << " msecs" << endl
+           << QString("  %1").arg("Smoothed frame time ", -45) << QString::number(controller_.SmoothedMsecs(), 'f', 1) << " msecs" << endl
+           << QString("  %1").arg("# of degrades/upgrades/reversals ", -45) << stats.degrades << "/" << stats.upgrades << "/" << stats.reversals << endl
+           << QString("  %1").arg("Upgrade hold ", -45) << QString::number(controller_.UpgradeHoldSeconds(), 'f', 1) << " seconds" << endl;
+    for(int knob = 0; knob < RocketQualityController::NumKnobs; ++knob)
+    {
+        const RocketQualityController::Knob k = static_cast<RocketQualityController::Knob>(knob);
+        stream << QString("  %1").arg(RocketQualityController::KnobName(k) + " ", -45)
+               << qRound(RocketQualityController::Factor(k, controller_.Level(k)) * 100.f) << "%" << endl;
+    }
+    if (!decisions_.isEmpty())
+    {
+        stream << "  Recent decisions" << endl;
+        foreach(const RocketQualityController::Decision &decision, decisions_)
+        {
+            stream << QString("    %1s %2 msecs %3 %4% -> %5%").arg(decision.time, 0, 'f', 1).arg(decision.frameMsecs, 0, 'f', 1)
+                .arg(RocketQualityController::KnobName(decision.knob))
+                .arg(qRound(RocketQualityController::Factor(decision.knob, decision.from) * 100.f))
+                .arg(qRound(RocketQualityController::Factor(decision.knob, decision.to) * 100.f)) << endl;
+        }
+    }
+    stream << endl;
+}
+
+void RocketQualityGovernor::Simulate(const QString &name, const QVector<float> &frameMsecs, const RocketQualityController::Settings &settings, QTextStream &stream)
+{
+    RocketQualityController controller;
+    controller.SetSettings(settings);
+
+    const float overMsecs = settings.targetMsecs * settings.degradeRatio;
+    float seconds = 0.f;
+    for(int i = 0; i < frameMsecs.size(); ++i)
+        seconds += frameMsecs[i] / 1000.f;
+    stream << name << QString(": %1 frames, %2 seconds, budget %3 msecs").arg(frameMsecs.size()).arg(seconds, 0, 'f', 1).arg(settings.targetMsecs, 0, 'f', 1) << endl;
+
+    float time = 0.f, rawOver = 0.f, governedSeconds = 0.f, governedOver = 0.f;
+    uint lateChanges = 0;
+    RocketQualityController::Decision decision;
+    for(int i = 0; i < frameMsecs.size(); ++i)
+    {
+        // Scale the full quality frame time by the savings of the current levels.
+        float cost = 1.f;
+        for(int knob = 0; knob < RocketQualityController::NumKnobs; ++knob)
+        {
+            const RocketQualityController::Knob k = static_cast<RocketQualityController::Knob>(knob);
+            cost -= RocketQualityController::FrameShare(k) * (1.f - RocketQualityController::Factor(k, controller.Level(k)));
+        }
+        const float msecs = frameMsecs[i] * cost;
+        const float dt = msecs / 1000.f;
+
+        if (frameMsecs[i] > overMsecs)
+            rawOver += frameMsecs[i] / 1000.f;
+        if (msecs > overMsecs)
+            governedOver += dt;
+        governedSeconds += dt;
+
+        if (controller.Update(msecs, dt, decision))
+        {
+            if (time > seconds * 0.75f)
+                ++lateChanges;
+            stream << QString("    %1s %2 msecs %3 %4% -> %5%").arg(decision.time, 0, 'f', 1).arg(decision.frameMsecs, 0, 'f', 1)
+                .arg(RocketQualityController::KnobName(decision.knob))
+                .arg(qRound(RocketQualityController::Factor(decision.knob, decision.from) * 100.f))
+                .arg(qRound(RocketQualityController::Factor(decision.knob, decision.to) * 100.f)) << endl;
+        }
+        time += frameMsecs[i] / 1000.f;
+    }
+
+    const RocketQualityController::Stats &stats = controller.Statistics();
+    QStringList levels;
+    for(int knob = 0; knob < RocketQualityController::NumKnobs; ++knob)
+    {
+        const RocketQualityController::Knob k = static_cast<RocketQualityController::Knob>(knob);
+        levels << QString("%1 %2%").arg(RocketQualityController::KnobName(k)).arg(qRound(RocketQualityController::Factor(k, controller.Level(k)) * 100.f));
+    }
+    stream << QString("    Over budget  : %1% without, %2% with the governor")
+                .arg(seconds > 0.f ? rawOver * 100.f / seconds : 0.f, 0, 'f', 1).arg(governedSeconds > 0.f ? governedOver * 100.f / governedSeconds : 0.f, 0, 'f', 1) << endl
+           << QString("    Changes      : %1 degrades, %2 upgrades, %3 reversals, %4 in the last quarter")
+                .arg(stats.degrades).arg(stats.upgrades).arg(stats.reversals).arg(lateChanges) << endl
+           << "    Final levels : " << levels.join(", ") << endl;
+}
+
+void RocketQualityGovernor::SetEnabledCommand(const QString &enabled)
+{
+    const QString value = enabled.trimmed().toLower();
+    SetEnabled(value == "true" || value == "1" || value == "on");
+}
+
+void RocketQualityGovernor::PrintStatus()
+{
+    QString status;
+    QTextStream stream(&status);
+    DumpStatistics(stream);
+    stream.flush();
+    foreach(const QString &line, status.split("\n", QString::SkipEmptyParts))
+        LogInfo(line);
+}
+
+void RocketQualityGovernor::SimulateTraceCommand(const QString &traceFile)
+{
+    QFile file(traceFile.trimmed());
+    if (!file.open(QIODevice::ReadOnly | QIODevice::Text))
+    {
+        LogError(LC + "Failed to open frame time trace " + traceFile.trimmed());
+        return;
+    }
+
+    // One frame per line. With multiple columns, eg. "time,msecs", the last one is the frame time.
+    QVector<float> trace;
+    while(!file.atEnd())
+    {
+        const QString line = QString::fromUtf8(file.readLine()).trimmed();
+        if (line.isEmpty() || line.startsWith("#"))
+            continue;
+        bool ok = false;
+        const float msecs = line.split(QRegExp("[,;\\s]+"), QString::SkipEmptyParts).last().toFloat(&ok);
+        if (ok && msecs > 0.f)
+            trace.push_back(msecs);
+    }
+    if (trace.isEmpty())
+    {
+        LogError(LC + "No frame times found in " + traceFile.trimmed());
+        return;
+    }
+
+    QString report;
+    QTextStream stream(&report);
+    Simulate(QFileInfo(file.fileName()).fileName(), trace, controller_.CurrentSettings(), stream);
+    stream.flush();
+    foreach(const QString &line, report.split("\n", QString::SkipEmptyParts))
+        LogInfo(line);
+}
+
+void RocketQualityGovernor::SimulateTraceCommand()
+{
+    const RocketQualityController::Settings &settings = controller_.CurrentSettings();
+    const float target = settings.targetMsecs;
+
+    QString report;
+    QTextStream stream(&report);
+    Simulate("Steady overload", SyntheticTrace(120.f, target * 1.6f, target * 0.2f, 0.f, 0.f, 1), settings, stream);
+    Simulate("Loading hitches", SyntheticTrace(120.f, target * 0.6f, target * 0.1f, 400.f, 3.f, 2), settings, stream);
+    Simulate("Borderline", SyntheticTrace(600.f, target * 1.05f, target * 0.3f, 0.f, 0.f, 3), settings, stream);
+
+    // Heavy scene, then a light one, eg. after a teleport.
+    QVector<float> teleport = SyntheticTrace(60.f, target * 2.f, target * 0.2f, 0.f, 0.f, 4);
+    teleport += SyntheticTrace(180.f, target * 0.4f, target * 0.1f, 0.f, 0.f, 5);
+    Simulate("Overload then light scene", teleport, settings, stream);
+    stream.flush();
+
+    foreach(const QString &line, report.split("\n", QString::SkipEmptyParts))
+        LogInfo(line);
+}
+
+/// @endcond
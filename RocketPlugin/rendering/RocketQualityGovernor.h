@@ -0,0 +1,113 @@
+/**
+    @author Adminotech Ltd.
+
+    Copyright Adminotech Ltd.
+    All rights reserved.
+
+    @file   RocketQualityGovernor.h
+    @brief  Adjusts rendering quality at runtime to keep frame time within a budget. */
+
+#pragma once
+
+#include "RocketFwd.h"
+#include "FrameworkFwd.h"
+#include "SceneFwd.h"
+#include "rendering/RocketQualityController.h"
+
+#include <QObject>
+#include <QHash>
+#include <QList>
+#include <QString>
+#include <QTextStream>
+
+class EC_Camera;
+
+/// @cond PRIVATE
+
+/// Adjusts individual rendering quality knobs at runtime to keep frame time within a budget.
+/** Feeds the frame times of the main loop to a RocketQualityController and applies its decisions:
+    camera far plane relative to RocketSettings::ViewDistance, shadow far distance, camera LOD bias,
+    particle system quotas, EC_MeshmoonWater reflection resolution and the browser process budget of
+    MeshmoonComponents. The changes are local and never persisted, the graphics mode picked in RocketSettings
+    stays the baseline and applying settings restores it. The target frame rate is read from the
+    "qualitygovernortargetfps" config key, --rocketNoQualityGovernor disables the governor. */
+class RocketQualityGovernor : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit RocketQualityGovernor(RocketPlugin *plugin);
+    ~RocketQualityGovernor();
+
+    /// Enables or disables the governor. Disabling restores full quality.
+    void SetEnabled(bool enabled);
+    bool IsEnabled() const;
+
+    /// Returns true if all knobs are at their lowest level and frame time is still over budget.
+    bool IsExhausted() const;
+
+    /// Returns the controller deciding the knob levels.
+    const RocketQualityController &Controller() const { return controller_; }
+
+    /// Returns the most recent decisions, oldest first.
+    const QList<RocketQualityController::Decision> &Decisions() const { return decisions_; }
+
+    /// Writes the current state and recent decisions to @c stream, used by RocketReporter.
+    void DumpStatistics(QTextStream &stream) const;
+
+    /// Replays @c frameMsecs, recorded at full quality, through a controller with @c settings.
+    /** Frame times are scaled by the estimated savings of the simulated knob levels.
+        Prints the decisions and over budget time before and after to @c stream. */
+    static void Simulate(const QString &name, const QVector<float> &frameMsecs, const RocketQualityController::Settings &settings, QTextStream &stream);
+
+signals:
+    /// Emitted when the governor changes @c knob to @c level, see RocketQualityController::Knob.
+    void QualityChanged(int knob, int level, float factor);
+
+public slots:
+    /// Restores full quality and restarts the frame time measurement.
+    void Reset();
+
+private slots:
+    void OnUpdate(float frametime);
+    void OnSettingsApplied(const ClientSettings *settings);
+    void OnDisconnected();
+    void OnMainCameraChanged(Entity *cameraEntity);
+
+    /// Console commands.
+    void SetEnabledCommand(const QString &enabled);
+    void PrintStatus();
+    void SimulateTraceCommand(const QString &traceFile);
+    void SimulateTraceCommand();
+
+private:
+    void Apply(RocketQualityController::Knob knob);
+    void ApplyAll();
+
+    void ApplyViewDistance(float factor);
+    void ApplyShadowDistance(float factor);
+    void ApplyLodBias(float factor);
+    void ApplyParticleQuota(float factor);
+    void ApplyReflectionResolution(float factor);
+    void ApplyBrowserProcesses(float factor);
+
+    Scene *ActiveScene() const;
+    EC_Camera *ActiveCamera() const;
+
+    RocketPlugin *plugin_;
+    Framework *framework_;
+    const QString LC;
+
+    RocketQualityController controller_;
+    QList<RocketQualityController::Decision> decisions_;
+    bool enabled_;
+    bool overridden_[RocketQualityController::NumKnobs]; ///< Knob has been changed from the scene's own value.
+    float tReapply_;
+
+    QPointer<EC_Camera> camera_;
+    float shadowBaseDistance_;      ///< Shadow far distance before the governor, negative if not overridden.
+    float shadowAppliedDistance_;
+    QHash<QString, size_t> particleQuotas_; ///< Original quotas of particle systems by Ogre name.
+};
+
+/// @endcond
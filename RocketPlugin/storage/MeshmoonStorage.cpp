@@ -15,6 +15,7 @@
 #include "MeshmoonStorageWidget.h"
 #include "MeshmoonStorageDialogs.h"
 #include "RocketStorageSceneImporter.h"
+#include "RocketStorageImportAnalyzer.h"
 #include "MeshmoonUser.h"
 
 #include "qts3/QS3Client.h"
@@ -24,6 +25,7 @@
 #include "RocketTaskbar.h"
 #include "RocketNotifications.h"
 #include "editors/IRocketAssetEditor.h"
+#include "editors/RocketParticleProfiler.h"
 #include "utils/RocketFileSystem.h"
 #include "utils/RocketAnimations.h"
 #include "utils/RocketZipWorker.h"
@@ -49,6 +51,8 @@
 #include "Scene.h"
 #include "SceneDesc.h"
 #include "Entity.h"
+#include "IComponent.h"
+#include "IAttribute.h"
 
 #include "EC_Mesh.h"
 #include "EC_Placeable.h"
@@ -70,6 +74,8 @@
 #include <QTextStream>
 #include <QRegExp>
 
+#include <set>
+
 #include "MemoryLeakCheck.h"
 
 const QString MeshmoonStorage::Schema = "meshmoonstorage://";
@@ -104,6 +110,7 @@ MeshmoonStorage::State::State() :
     infoDialog(0),
     ui(None),
     folderOperationOngoing(false),
+    importAnalysisOngoing(false),
     closeOnEditorsClosed(false),
     headless(true)
 {
@@ -320,6 +327,7 @@ void MeshmoonStorage::Reset()
 {
     state_.folderOperationOngoing = false;
     SAFE_DELETE(s3_);
+    s3Endpoint_ = MeshmoonS3Endpoint();
 }
 
 void MeshmoonStorage::ResetUi()
@@ -571,6 +579,8 @@ void MeshmoonStorage::AuthenticateContinue(int level)
     connect(storageWidget_, SIGNAL(UploadRequest(bool)), SLOT(OnUploadRequest(bool)));
     connect(storageWidget_, SIGNAL(UploadRequest(const QStringList&, bool)), SLOT(UploadFiles(const QStringList&, bool)));
     connect(storageWidget_, SIGNAL(DeleteRequest(MeshmoonStorageItemWidgetList)), SLOT(OnDeleteRequest(MeshmoonStorageItemWidgetList)));
+    connect(storageWidget_, SIGNAL(ProfileParticlesRequest(MeshmoonStorageItemWidgetList)), SLOT(OnProfileParticlesRequest(MeshmoonStorageItemWidgetList)));
+    connect(storageWidget_, SIGNAL(CopyFolderRequest(MeshmoonStorageItemWidget*, bool)), SLOT(OnCopyFolderRequest(MeshmoonStorageItemWidget*, bool)));
     connect(storageWidget_, SIGNAL(CreateFolderRequest()), SLOT(OnCreateFolderRequest()));
     connect(storageWidget_, SIGNAL(UploadFilesRequest()), SLOT(OnUploadFilesRequest()));
     
@@ -787,6 +797,11 @@ void MeshmoonStorage::OnStorageAuthenticated(QString accessKey, QString secretKe
     SAFE_DELETE(s3_);
     s3_ = new QS3Client(QS3Config(accessKey, secretKey, state_.storageBucket, QS3Config::EU_WEST_1));
 
+    s3Endpoint_.url = MeshmoonS3Endpoint::DefaultUrl();
+    s3Endpoint_.bucket = state_.storageBucket;
+    s3Endpoint_.accessKey = accessKey;
+    s3Endpoint_.secretKey = secretKey;
+
     RefreshFolderContent(state_.storageBasePath);
     
     // Storage is now open and authenticated. Disable drag and drop from core.
@@ -1194,27 +1209,37 @@ void MeshmoonStorage::OnOperationFinished(MeshmoonStorageOperationMonitor *opera
         }
         case MeshmoonStorageOperationMonitor::UploadFiles:
         {
-            if (plugin_->Networking() && !operation->changedAssetRefs.isEmpty())
-                plugin_->Networking()->SendAssetReloadMsg(operation->changedAssetRefs);
+            if (plugin_->Networking() && !operation->changedAssets.empty())
+                plugin_->Networking()->SendAssetReloadMsg(operation->changedAssets);
 
             RefreshCurrentFolderContent();
             
-            if (!state_.pendingSceneCreation.IsEmpty())
+            if (!state_.pendingSceneCreation.IsEmpty() || !state_.pendingSceneRemovals.isEmpty())
             {
                 Scene *activeScene = framework_->Renderer()->MainCameraScene();
                 if (activeScene)
                 {
-                    LogInfo(LC + QString("Scene assets uploaded, creating %1 entities.").arg(state_.pendingSceneCreation.entities.size()));
-                    activeScene->CreateContentFromSceneDesc(state_.pendingSceneCreation, false, AttributeChange::Replicate);
+                    ApplySceneImport(activeScene, state_.pendingSceneCreation, state_.pendingSceneRemovals, state_.pendingSceneExisting);
                 }
                 
                 state_.pendingSceneCreation.entities.clear();
                 state_.pendingSceneCreation.assets.clear();
+                state_.pendingSceneRemovals.clear();
+                state_.pendingSceneExisting.clear();
             }
             break;
         }
         case MeshmoonStorageOperationMonitor::DeleteFiles:
+        case MeshmoonStorageOperationMonitor::CopyFiles:
         {
+            if (!operation->errors.isEmpty())
+            {
+                foreach(const QString &error, operation->errors)
+                    LogError(LC + error);
+                plugin_->Notifications()->ShowSplashDialog(QString("<b>Storage %1 operation failed for %2 %3</b><br>See the console for details")
+                    .arg(operation->type == MeshmoonStorageOperationMonitor::CopyFiles ? "copy" : "delete")
+                    .arg(operation->errors.size()).arg(operation->errors.size() == 1 ? "file" : "files"), ":/images/icon-exit.png");
+            }
             RefreshCurrentFolderContent();
             break;
         }
@@ -1659,7 +1684,7 @@ void MeshmoonStorage::OnUploadSceneRequest(const QString &filepath)
         plugin_->Notifications()->ShowSplashDialog("<b>Cannot upload scene file content right now</b><br>Wait for current operation to finish", ":/images/icon-update.png");
         return;
     }
-    if (!state_.pendingSceneCreation.IsEmpty())
+    if (!state_.pendingSceneCreation.IsEmpty() || !state_.pendingSceneRemovals.isEmpty() || state_.importAnalysisOngoing)
     {
         plugin_->Notifications()->ShowSplashDialog("<b>Cannot upload scene file content right now</b><br>Wait for current operation to finish", ":/images/icon-update.png");
         return;
@@ -1673,10 +1698,6 @@ void MeshmoonStorage::OnUploadSceneRequest(const QString &filepath)
         return;
     }
     
-    QString txmlFolder = QFileInfo(filepath).dir().path();
-    if (!txmlFolder.endsWith("/"))
-        txmlFolder += "/";
-    
     Scene *scene = framework_->Renderer()->MainCameraScene();
     if (!scene)
     {
@@ -1684,94 +1705,44 @@ void MeshmoonStorage::OnUploadSceneRequest(const QString &filepath)
         return;
     }
 
-    SceneDesc sceneDesc = scene->CreateSceneDescFromXml(filepath);
-    
-    ImportEntityItemList entities;
-    foreach(const EntityDesc &entDesc, sceneDesc.entities)
-    {
-        RocketStorageImportEntityItem item;
-        item.desc = entDesc;
-        item.existsScene = !entDesc.name.trimmed().isEmpty() ? (scene->EntityByName(entDesc.name) ? true : false) : false;
-        
-        entities.push_back(item);
-    }
-    
     QString storageRootPath = state_.storageRoot->data.key;
     QString currentFolderPath = state_.currentFolder->data.key;
     QString destinationPrefix = (storageRootPath == currentFolderPath ? "" : currentFolderPath.remove(0, storageRootPath.length()));
 
-    ImportAssetItemList assets;
-    foreach (AssetDesc assetDesc, sceneDesc.assets.values())
-    {
-        if (assetDesc.source.trimmed().isEmpty() || assetDesc.destinationName.trimmed().isEmpty())
-            continue;
-        QString lower = assetDesc.source.toLower();
-        if (lower.startsWith("http://") || lower.startsWith("https://") || lower.startsWith("local://") || lower.startsWith("generated://"))
-            continue;
-        QFileInfo info(assetDesc.source);
-        if (info.isDir())
-            continue;
-        
-        QString fullRelPath = destinationPrefix + assetDesc.destinationName;
-        assetDesc.destinationName = fullRelPath;
-
-        // Any asset
-        RocketStorageImportAssetItem item;
-        item.desc = assetDesc;
-        item.pathAbsolute = info.absoluteFilePath();
-        item.existsDisk = QFile::exists(item.pathAbsolute);
-        item.existsStorage = GetFile(state_.storageRoot->data.key + assetDesc.destinationName) != 0 ? true : false;
-        item.pathRelative = info.fileName();
+    // Parsing, hashing and diffing large scenes is done in a background thread.
+    state_.importAnalysisOngoing = true;
+    RocketStorageImportAnalyzer *analyzer = new RocketStorageImportAnalyzer(framework_, scene, state_.storageRoot, filepath, destinationPrefix);
+    connect(analyzer, SIGNAL(Completed(RocketStorageImportAnalyzer*)), SLOT(OnUploadSceneAnalyzed(RocketStorageImportAnalyzer*)));
+    analyzer->Start();
 
-        if (item.pathRelative.contains(" "))
-        {
-            plugin_->Notifications()->ShowSplashDialog("Spaces are not allowed in filenames. Found in filename: \"" + item.pathRelative + "\", full path: \"" + item.pathAbsolute + "\"");
-            return;
-        }
-        if (item.pathAbsolute.startsWith(txmlFolder))
-            item.pathRelative = item.pathAbsolute.mid(txmlFolder.length());
-
-        assets.push_back(item);
-        
-        // Material?
-        if (assetDesc.typeName == "Mesh materials" || assetDesc.typeName == "Material")
-        {
-            // Find referenced textures
-            QStringList textureFiles = ParseTextures(info);
-            foreach(const QString textureFile, textureFiles)
-            {
-                QFileInfo texInfo(textureFile);
-
-                AssetDesc texDesc;
-                texDesc.source = texInfo.absoluteFilePath();
-                texDesc.destinationName = destinationPrefix + texInfo.fileName();
-                if (texDesc.destinationName.contains(" "))
-                {
-                    plugin_->Notifications()->ShowSplashDialog("Spaces are not allowed in filenames. Found in filename: \"" + texDesc.destinationName + "\", full path: \"" + texDesc.source + "\"");
-                    return;
-                }
+    storageWidget_->SetProgressMessage("Analyzing " + QFileInfo(filepath).fileName() + ", please wait...");
+}
 
-                // Texture
-                RocketStorageImportAssetItem texItem;
-                texItem.desc = texDesc;
-                texItem.pathAbsolute = texInfo.absoluteFilePath();
-                texItem.existsDisk = QFile::exists(texItem.pathAbsolute);
-                texItem.existsStorage = GetFile(state_.storageRoot->data.key + texDesc.destinationName) != 0 ? true : false;
-                texItem.pathRelative = texItem.pathAbsolute;
+void MeshmoonStorage::OnUploadSceneAnalyzed(RocketStorageImportAnalyzer *analyzer)
+{
+    state_.importAnalysisOngoing = false;
+    if (storageWidget_)
+        storageWidget_->HideProgress();
+    if (!analyzer)
+        return;
 
-                if (texItem.pathRelative.startsWith(txmlFolder))
-                    texItem.pathRelative = texItem.pathRelative.mid(txmlFolder.length());
-                    
-                assets.push_back(texItem);
-            }
-        }
+    const RocketStorageImportAnalysis &result = analyzer->Result();
+    if (!result.error.isEmpty())
+    {
+        LogError(LC + result.error);
+        plugin_->Notifications()->ShowSplashDialog(result.error);
+        return;
     }
+    if (!state_.storageRoot || !state_.currentFolder)
+        return;
 
-    RocketStorageSceneImporter *importer = new RocketStorageSceneImporter(framework_->Ui()->MainWindow(), plugin_, destinationPrefix, sceneDesc, entities, assets);
-    connect(importer, SIGNAL(ImportScene(const QStringList&, const SceneDesc &)), SLOT(OnUploadSceneRequestContinue(const QStringList&, SceneDesc)));
+    RocketStorageSceneImporter *importer = new RocketStorageSceneImporter(framework_->Ui()->MainWindow(), plugin_, analyzer->DestinationPrefix(),
+        result.sceneDesc, result.entities, result.assets);
+    connect(importer, SIGNAL(ImportScene(const QStringList&, const SceneDesc &, const QList<entity_id_t> &, const ImportEntityIdMap &)),
+        SLOT(OnUploadSceneRequestContinue(const QStringList&, const SceneDesc &, const QList<entity_id_t> &, const ImportEntityIdMap &)));
 }
 
-void MeshmoonStorage::OnUploadSceneRequestContinue(const QStringList &uploadFiles, const SceneDesc &sceneDesc)
+void MeshmoonStorage::OnUploadSceneRequestContinue(const QStringList &uploadFiles, const SceneDesc &sceneDesc, const QList<entity_id_t> &removeEntities, const ImportEntityIdMap &existingEntities)
 {
     if (!state_.storageRoot || !state_.currentFolder)
         return;
@@ -1779,18 +1750,151 @@ void MeshmoonStorage::OnUploadSceneRequestContinue(const QStringList &uploadFile
     if (!uploadFiles.isEmpty())
     {
         state_.pendingSceneCreation = sceneDesc;
+        state_.pendingSceneRemovals = removeEntities;
+        state_.pendingSceneExisting = existingEntities;
         UploadFiles(uploadFiles, false);
     }
-    else if (uploadFiles.isEmpty() && !sceneDesc.entities.isEmpty())
+    else if (!sceneDesc.entities.isEmpty() || !removeEntities.isEmpty())
     {
         Scene *activeScene = framework_->Renderer()->MainCameraScene();
         if (activeScene)
-            activeScene->CreateContentFromSceneDesc(sceneDesc, false, AttributeChange::Replicate);
+            ApplySceneImport(activeScene, sceneDesc, removeEntities, existingEntities);
         else
             LogError(LC + "Failed to get current scene to create entities from scene file import.");
     }
 }
 
+namespace
+{
+    /// Returns the scene entity id for entity reference @c ref of an imported file, or @c ref itself if it is not a matched id.
+    QString MapImportedEntityRef(const QString &ref, const ImportEntityIdMap &fileToScene)
+    {
+        ImportEntityIdMap::const_iterator iter = fileToScene.find(ref.trimmed());
+        return (iter != fileToScene.end() ? QString::number(iter.value()) : ref);
+    }
+
+    /// Applies the components and attribute values of @c desc to @c entity, keeping its id.
+    /** Components that are not in @c desc are removed. Returns the number of changed attributes. */
+    int UpdateEntityFromDesc(Entity *entity, const EntityDesc &desc, const ImportEntityIdMap &fileToScene)
+    {
+        int changed = 0;
+        std::set<IComponent*> imported;
+        foreach(const ComponentDesc &componentDesc, desc.components)
+        {
+            ComponentPtr component = entity->GetOrCreateComponent(componentDesc.typeName, componentDesc.name, AttributeChange::Replicate);
+            if (!component)
+                continue;
+            imported.insert(component.get());
+
+            const bool isPlaceable = (component->TypeId() == EC_Placeable::ComponentTypeId);
+            foreach(const AttributeDesc &attributeDesc, componentDesc.attributes)
+            {
+                IAttribute *attribute = (!attributeDesc.id.isEmpty() ? component->AttributeById(attributeDesc.id) : 0);
+                if (!attribute && !attributeDesc.name.isEmpty())
+                    attribute = component->AttributeByName(attributeDesc.name);
+                if (!attribute && component->SupportsDynamicAttributes())
+                    attribute = component->CreateAttribute(attributeDesc.typeName, !attributeDesc.id.isEmpty() ? attributeDesc.id : attributeDesc.name, AttributeChange::Replicate);
+                if (!attribute)
+                    continue;
+
+                const QString value = (isPlaceable && attribute->Id() == "parentRef" ? MapImportedEntityRef(attributeDesc.value, fileToScene) : attributeDesc.value);
+                if (attribute->ToString() != value)
+                {
+                    attribute->FromString(value, AttributeChange::Replicate);
+                    changed++;
+                }
+            }
+        }
+
+        std::vector<ComponentPtr> removed;
+        const Entity::ComponentMap &existing = entity->Components();
+        for(Entity::ComponentMap::const_iterator iter = existing.begin(); iter != existing.end(); ++iter)
+            if (imported.find(iter->second.get()) == imported.end())
+                removed.push_back(iter->second);
+        for(size_t i = 0; i < removed.size(); ++i)
+        {
+            entity->RemoveComponent(removed[i], AttributeChange::Replicate);
+            changed++;
+        }
+        return changed;
+    }
+}
+
+void MeshmoonStorage::ApplySceneImport(Scene *scene, const SceneDesc &sceneDesc, const QList<entity_id_t> &removeEntities, const ImportEntityIdMap &existingEntities)
+{
+    if (!scene)
+        return;
+
+    // Entities removed from the file
+    int removed = 0;
+    foreach(entity_id_t id, removeEntities)
+    {
+        if (scene->RemoveEntity(id, AttributeChange::Replicate))
+            removed++;
+    }
+
+    // Matched entities are updated in place so that their ids, and references and undo history using them, stay valid.
+    SceneDesc createDesc = sceneDesc;
+    createDesc.entities.clear();
+    QList<QPair<EntityPtr, int> > updates;
+    for(int i = 0; i < sceneDesc.entities.size(); ++i)
+    {
+        const entity_id_t existingId = existingEntities.value(sceneDesc.entities[i].id, 0);
+        EntityPtr existing = (existingId != 0 ? scene->EntityById(existingId) : EntityPtr());
+        if (existing)
+            updates << qMakePair(existing, i);
+        else
+            createDesc.entities << sceneDesc.entities[i];
+    }
+
+    QList<Entity*> created;
+    if (!createDesc.entities.isEmpty())
+        created = scene->CreateContentFromSceneDesc(createDesc, false, AttributeChange::Replicate);
+
+    // File ids of all matched and created entities to scene ids. Created entities are returned in file order.
+    ImportEntityIdMap fileToScene = existingEntities;
+    if (created.size() == createDesc.entities.size())
+    {
+        for(int i = 0; i < created.size(); ++i)
+            if (created[i])
+                fileToScene[createDesc.entities[i].id] = created[i]->Id();
+    }
+    else
+        LogWarning(LC + "Scene import created a different number of entities than requested, parent references to them are not resolved.");
+
+    int updated = 0;
+    for(int i = 0; i < updates.size(); ++i)
+    {
+        if (UpdateEntityFromDesc(updates[i].first.get(), sceneDesc.entities[updates[i].second], fileToScene) > 0)
+            updated++;
+    }
+
+    // Created entities that are parented to matched scene entities. Parents within the created entities are mapped on creation.
+    if (created.size() == createDesc.entities.size())
+    {
+        for(int i = 0; i < created.size(); ++i)
+        {
+            EC_Placeable *placeable = (created[i] ? created[i]->Component<EC_Placeable>().get() : 0);
+            if (!placeable)
+                continue;
+            foreach(const ComponentDesc &componentDesc, createDesc.entities[i].components)
+            {
+                if (componentDesc.typeName != EC_Placeable::TypeNameStatic())
+                    continue;
+                foreach(const AttributeDesc &attributeDesc, componentDesc.attributes)
+                {
+                    if (attributeDesc.id != placeable->parentRef.Id() && attributeDesc.name != placeable->parentRef.Name())
+                        continue;
+                    if (existingEntities.contains(attributeDesc.value.trimmed()))
+                        placeable->parentRef.Set(EntityReference(MapImportedEntityRef(attributeDesc.value, existingEntities)), AttributeChange::Replicate);
+                }
+            }
+        }
+    }
+
+    LogInfo(LC + QString("Scene import removed %1, updated %2 and created %3 entities.").arg(removed).arg(updated).arg(created.size()));
+}
+
 void MeshmoonStorage::OnUploadRequest(bool confirmOverwrite)
 {
     if (!s3_)
@@ -2082,6 +2186,7 @@ MeshmoonStorageOperationMonitor *MeshmoonStorage::UploadFiles(const QStringList
             key += fileInfo.fileName();
             
             state_.highlightKeys << key;
+            monitor->SetUploadSource(key, fileInfo.absoluteFilePath());
             monitor->AddOperation(s3_->put(key, &file, metadata, QS3::PublicRead), fileInfo.size());
         }
 
@@ -2149,6 +2254,7 @@ MeshmoonStorageOperationMonitor *MeshmoonStorage::UploadData(const MeshmoonStora
     QS3FileMetadata metadata;
     metadata.contentType = ContentMimeType(fileInfo.suffix(), fileInfo.completeSuffix());
 
+    monitor->SetUploadSource(file.path, data);
     monitor->AddOperation(s3_->put(file.path, data, metadata, QS3::PublicRead), data.size());
 
     if (monitor->total == 0)
@@ -2199,6 +2305,7 @@ void MeshmoonStorage::OnUploadRequestContinue()
         key += fileInfo.fileName();
 
         state_.highlightKeys << key;
+        monitor->SetUploadSource(key, fileInfo.absoluteFilePath());
         monitor->AddOperation(s3_->put(key, &file, metadata, QS3::PublicRead), fileInfo.size());
     }
 
@@ -2211,6 +2318,14 @@ void MeshmoonStorage::OnUploadRequestContinue()
     DestroyInfoDialog();
 }
 
+void MeshmoonStorage::OnBatchOperationProgress(qint64 complete, qint64 total)
+{
+    MeshmoonStorageOperationMonitor *monitor = qobject_cast<MeshmoonStorageOperationMonitor*>(sender());
+    if (monitor && storageWidget_->ui.labelProgressTitle->text().isEmpty())
+        storageWidget_->ui.labelProgressTitle->setText(monitor->type == MeshmoonStorageOperationMonitor::CopyFiles ? "Copying" : "Deleting");
+    storageWidget_->SetProgress(complete, total);
+}
+
 void MeshmoonStorage::OnUploadOperationProgress(QS3PutObjectResponse *response, qint64 complete, qint64 total, MeshmoonStorageOperationMonitor *operation)
 {
     if (response && !response->succeeded)
@@ -2230,11 +2345,8 @@ void MeshmoonStorage::OnUploadOperationProgress(QS3PutObjectResponse *response,
         AssetPtr loadedAsset = framework_->Asset()->GetAsset(relativeRef);        
         if (loadedAsset.get() && loadedAsset->IsLoaded())
         {
-            if (!operation->changedAssetRefs.contains(loadedAsset->Name()))
-            {
-                operation->changedAssetRefs << loadedAsset->Name();
+            if (operation->AddChangedAsset(loadedAsset->Name(), response->key))
                 clientNeeds = true;
-            }
         }
         else if (!loadedAsset.get())
         {
@@ -2250,11 +2362,8 @@ void MeshmoonStorage::OnUploadOperationProgress(QS3PutObjectResponse *response,
                     loadedAsset = framework_->Asset()->GetAsset(storageFullRef); 
                     if (loadedAsset.get() && loadedAsset->IsLoaded())
                     {
-                        if (!operation->changedAssetRefs.contains(loadedAsset->Name()))
-                        {
-                            operation->changedAssetRefs << loadedAsset->Name();
+                        if (operation->AddChangedAsset(loadedAsset->Name(), response->key))
                             clientNeeds = true;
-                        }
                     }
                 }
             }
@@ -2265,7 +2374,7 @@ void MeshmoonStorage::OnUploadOperationProgress(QS3PutObjectResponse *response,
         // This is nice when developing scripts with Server only execution, to make server reload it once you hit save
         // in the rocket editor - Do we have other situations where this might be needed?
         if (!clientNeeds && (relativeRef.endsWith(".js", Qt::CaseInsensitive) || relativeRef.endsWith(".webrocketjs", Qt::CaseInsensitive)))
-            operation->changedAssetRefs << framework_->Asset()->ResolveAssetRef("", relativeRef);
+            operation->AddChangedAsset(framework_->Asset()->ResolveAssetRef("", relativeRef), response->key);
     }
 }
 
@@ -2683,6 +2792,34 @@ void MeshmoonStorage::OnDeleteRequest(MeshmoonStorageItemWidget *item)
     OnDeleteRequest(files);
 }
 
+void MeshmoonStorage::OnProfileParticlesRequest(MeshmoonStorageItemWidgetList files)
+{
+    QStringList refs;
+    foreach(MeshmoonStorageItemWidget *file, files)
+        if (file && !file->data.isDir)
+            refs << UrlForItem(file->data.key);
+    refs.removeDuplicates();
+    if (refs.isEmpty())
+        return;
+
+    if (storageWidget_)
+    {
+        storageWidget_->HideProgressBar();
+        storageWidget_->SetProgressMessage(QString("Profiling %1 particle assets...").arg(refs.size()));
+    }
+
+    RocketParticleProfileBatch *batch = new RocketParticleProfileBatch(framework_, refs);
+    connect(batch, SIGNAL(Finished(const QString&)), SLOT(OnProfileParticlesFinished(const QString&)));
+    batch->Start();
+}
+
+void MeshmoonStorage::OnProfileParticlesFinished(const QString &report)
+{
+    if (storageWidget_)
+        storageWidget_->HideProgress();
+    RocketParticleProfiler::ShowReport("Particle Cost Ranking", report, framework_->Ui()->MainWindow());
+}
+
 MeshmoonStorageItemWidgetList MeshmoonStorage::GetAllSubfiles(MeshmoonStorageItemWidget *item)
 {
     MeshmoonStorageItemWidgetList list;
@@ -2905,7 +3042,9 @@ void MeshmoonStorage::OnDeleteRequestContinue()
 
     MeshmoonStorageOperationMonitor *monitor = new MeshmoonStorageOperationMonitor(MeshmoonStorageOperationMonitor::DeleteFiles);
     connect(monitor, SIGNAL(Finished(MeshmoonStorageOperationMonitor*)), SLOT(OnOperationFinished(MeshmoonStorageOperationMonitor*)));
+    connect(monitor, SIGNAL(BatchProgress(qint64, qint64)), SLOT(OnBatchOperationProgress(qint64, qint64)));
     
+    QStringList keys;
     foreach(MeshmoonStorageItemWidget *file, state_.infoDialog->items)
     {
         bool acceptedFile = true;
@@ -2918,7 +3057,20 @@ void MeshmoonStorage::OnDeleteRequestContinue()
             }
         }
         if (acceptedFile)
-            monitor->AddOperation(s3_->remove(file->data.key));
+            keys << file->data.key;
+    }
+
+    // Multi-object delete removes up to 1000 keys per request, fall back to a request per key without the endpoint.
+    if (!keys.isEmpty() && s3Endpoint_.IsValid())
+    {
+        MeshmoonStorageBatchDelete *remover = new MeshmoonStorageBatchDelete(s3Endpoint_, keys);
+        monitor->AddOperation(remover);
+        remover->Start();
+    }
+    else
+    {
+        foreach(const QString &key, keys)
+            monitor->AddOperation(s3_->remove(key));
     }
     
     if (monitor->total == 0)
@@ -2930,6 +3082,151 @@ void MeshmoonStorage::OnDeleteRequestContinue()
     DestroyInfoDialog();
 }
 
+void MeshmoonStorage::OnCopyFolderRequest(MeshmoonStorageItemWidget *folder, bool move)
+{
+    if (!s3_ || !folder || !folder->data.isDir)
+        return;
+    if (state_.infoDialog)
+        return;
+    if (state_.folderOperationOngoing)
+    {
+        plugin_->Notifications()->ShowSplashDialog("<b>Cannot copy folder right now</b><br>Wait for current operation to finish", ":/images/icon-update.png");
+        return;
+    }
+    if (move && folder->IsProtected())
+    {
+        plugin_->Notifications()->ShowSplashDialog("<b>Cannot rename a protected folder</b>", ":/images/icon-update.png");
+        return;
+    }
+
+    // Suggest a unique name for duplicates
+    QString suggestion = folder->filename;
+    if (!move)
+    {
+        for(int i=0; i<100; ++i)
+        {
+            QString candidate = QString("%1-copy%2").arg(folder->filename).arg((i == 0 ? "" : QString::number(i)));
+            if (!FileExistsInCurrentFolder(candidate))
+            {
+                suggestion = candidate;
+                break;
+            }
+        }
+    }
+
+    state_.infoDialog = new RocketStorageInfoDialog(plugin_, (move ? "Rename folder " : "Duplicate folder ") + folder->filename);
+    connect(state_.infoDialog, SIGNAL(AcceptClicked()), SLOT(OnCopyFolderRequestContinue()));
+    connect(state_.infoDialog, SIGNAL(Rejected()), SLOT(DestroyInfoDialog()));
+
+    state_.infoDialog->items << folder;
+    state_.infoDialog->setProperty("moveFolder", move);
+    state_.infoDialog->EnableInputMode("", suggestion);
+    state_.infoDialog->ui.buttonOk->setText(move ? "Rename" : "Duplicate");
+    state_.infoDialog->Open();
+}
+
+void MeshmoonStorage::OnCopyFolderRequestContinue()
+{
+    if (!state_.infoDialog || state_.infoDialog->items.isEmpty())
+        return;
+
+    QString folderName = ValidateInfoDialogFilename(true);
+    if (folderName.isEmpty())
+        return;
+
+    MeshmoonStorageItemWidget *folder = state_.infoDialog->items.first();
+    bool move = state_.infoDialog->property("moveFolder").toBool();
+
+    QString destinationKey = folder->data.key;
+    if (destinationKey.endsWith("/"))
+        destinationKey.chop(1);
+    destinationKey = destinationKey.left(destinationKey.lastIndexOf("/") + 1) + folderName + "/";
+
+    if (!CopyFolder(folder->data.key, destinationKey, move))
+    {
+        state_.infoDialog->ui.labelError->setText("Failed to start the operation");
+        return;
+    }
+
+    state_.infoDialog->Close();
+    DestroyInfoDialog();
+}
+
+MeshmoonStorageOperationMonitor *MeshmoonStorage::CopyFolder(const QString &sourceKey, const QString &destinationKey, bool removeSource)
+{
+    if (!s3_)
+    {
+        LogError(LC + "Cannot copy folder. Storage client is null.");
+        return 0;
+    }
+    if (state_.folderOperationOngoing)
+    {
+        LogError(LC + "Cannot copy folder. Another folder operation is ongoing.");
+        return 0;
+    }
+
+    QString source = (sourceKey.endsWith("/") ? sourceKey : sourceKey + "/");
+    QString destination = (destinationKey.endsWith("/") ? destinationKey : destinationKey + "/");
+    if (destination.startsWith(source) || source == "/" || destination == "/")
+    {
+        LogError(LC + QString("Cannot copy folder %1 to %2.").arg(source).arg(destination));
+        return 0;
+    }
+    MeshmoonStorageItemWidget *folder = GetFolder(source);
+    if (!folder)
+    {
+        LogError(LC + QString("Cannot copy folder. Source folder %1 does not exist in storage.").arg(source));
+        return 0;
+    }
+    if (GetFolder(destination) || GetFile(destination.left(destination.length() - 1)))
+    {
+        LogError(LC + QString("Cannot copy folder. Destination %1 already exists in storage.").arg(destination));
+        return 0;
+    }
+    if (removeSource && folder->IsProtected())
+    {
+        LogError(LC + QString("Cannot move protected folder %1.").arg(source));
+        return 0;
+    }
+    if (removeSource && !s3Endpoint_.IsValid())
+    {
+        LogError(LC + "Cannot move folder. Storage endpoint is not configured.");
+        return 0;
+    }
+
+    MeshmoonStorageItemWidgetList folders;
+    folders << folder;
+    for(int i=0; i<folders.size(); ++i)
+        folders << folders[i]->Folders();
+
+    // Folders without files only exist as placeholder objects, create them to the destination.
+    QStringList folderKeys;
+    foreach(MeshmoonStorageItemWidget *sourceFolder, folders)
+    {
+        folderKeys << sourceFolder->data.key;
+        if (sourceFolder == folder || sourceFolder->Files(true).isEmpty())
+            s3_->createFolder(destination + sourceFolder->data.key.mid(source.length()), QS3::PublicRead);
+    }
+
+    MeshmoonStorageCopyQueue::KeyPairList copies;
+    foreach(MeshmoonStorageItemWidget *file, folder->Files(true))
+        copies << qMakePair(file->data.key, destination + file->data.key.mid(source.length()));
+
+    MeshmoonStorageOperationMonitor *monitor = new MeshmoonStorageOperationMonitor(MeshmoonStorageOperationMonitor::CopyFiles);
+    connect(monitor, SIGNAL(Finished(MeshmoonStorageOperationMonitor*)), SLOT(OnOperationFinished(MeshmoonStorageOperationMonitor*)));
+    connect(monitor, SIGNAL(BatchProgress(qint64, qint64)), SLOT(OnBatchOperationProgress(qint64, qint64)));
+
+    MeshmoonStorageCopyQueue *queue = new MeshmoonStorageCopyQueue(s3_, copies);
+    // Removing placeholder keys that do not exist is not an error.
+    if (removeSource)
+        queue->SetRemoveSources(s3Endpoint_, folderKeys);
+    monitor->AddOperation(queue);
+
+    state_.folderOperationOngoing = true;
+    queue->Start();
+    return monitor;
+}
+
 void MeshmoonStorage::OnCreateFolderRequest()
 {
     if (!s3_)
@@ -3292,37 +3589,6 @@ void MeshmoonStorage::ShowFolder(MeshmoonStorageItemWidget *folder)
     state_.currentFolder = folder;
 }
 
-QStringList MeshmoonStorage::ParseTextures(const QFileInfo &materialFile)
-{
-    QFile file(materialFile.absoluteFilePath());
-    if (!file.exists() || !file.open(QIODevice::ReadOnly))
-        return QStringList();
-
-    QByteArray data = file.readAll();
-    file.close();
-    QSet<QString> textures = OgreRenderer::ProcessMaterialForTextures(QString(data));
-
-    QStringList textureFiles;
-    foreach(QString texture, textures)
-    {
-        texture = texture.trimmed();
-        if (texture.startsWith("http://") || texture.startsWith("https://"))
-        {
-            LogDebug("Found web texture ref, not modifying: " + texture);
-            continue;
-        }
-        if (texture.startsWith("Ogre Media:", Qt::CaseInsensitive))
-        {
-            LogDebug("Found 'Ogre Media:' texture ref, not modifying: " + texture);
-            continue;
-        }
-        /// @todo Resolve local:// from local storages and what?
-        QString path = materialFile.dir().absoluteFilePath(texture);
-        textureFiles << path;
-    }
-    return textureFiles;
-}
-
 QStringList MeshmoonStorage::ParseStorageSchemaReferences(const QMimeData *mime)
 {
     QStringList refs;
@@ -15,7 +15,10 @@
 #include "qts3/QS3Fwd.h"
 
 #include "MeshmoonStorageItem.h"
+#include "MeshmoonStorageBatch.h"
+#include "SceneFwd.h"
 #include "SceneDesc.h"
+#include "CoreTypes.h"
 
 #include <QObject>
 #include <QAction>
@@ -74,6 +77,9 @@ public:
         // or leave the current folder.
         bool folderOperationOngoing;
         
+        // If a scene file import is being analyzed.
+        bool importAnalysisOngoing;
+        
         // If storage is operating in headless mode.
         bool headless;
         
@@ -99,6 +105,12 @@ public:
         // Pending scene desc creation after upload.
         SceneDesc pendingSceneCreation;
         
+        // Pending removed entities after upload.
+        QList<entity_id_t> pendingSceneRemovals;
+
+        // Pending scene entities matched to imported entities after upload.
+        ImportEntityIdMap pendingSceneExisting;
+        
         // Ui state
         UiState ui;
     };
@@ -229,6 +241,15 @@ public slots:
         @return The copy operation ptr, null if source file does not exist or destination already exists. */
     QS3CopyObjectResponse *CreateFileCopy(const QString &sourceKey, const QString &destinationKey, bool refreshCurrentFolderWhenDone = true, QS3::CannedAcl acl = QS3::PublicRead);
 
+    /// Copies all files of a folder server side to another folder.
+    /** Copies run in parallel with a bounded number of requests in flight. Progress is reported with
+        MeshmoonStorageOperationMonitor::BatchProgress, one step per copied and removed file.
+        @param Source folder storage key.
+        @param Destination folder storage key, must not be inside the source folder.
+        @param If the source files are removed after all of them have been copied, which moves or renames the folder.
+        @return Operation monitor or null ptr if the copy cannot be started. */
+    MeshmoonStorageOperationMonitor *CopyFolder(const QString &sourceKey, const QString &destinationKey, bool removeSource = false);
+
     /// Makes a copy of the main txml to the default Meshmoon /backup folder with optional file postfix.
     QS3CopyObjectResponse *BackupTxml(bool openBackupFolderWhenDone = false, QString postfix = "");
     
@@ -356,8 +377,15 @@ private slots:
     void OnDeleteRequest(MeshmoonStorageItemWidgetList files);
     void OnDeleteRequestContinue();
 
+    void OnCopyFolderRequest(MeshmoonStorageItemWidget *folder, bool move);
+    void OnCopyFolderRequestContinue();
+
+    void OnProfileParticlesRequest(MeshmoonStorageItemWidgetList files);
+    void OnProfileParticlesFinished(const QString &report);
+
     void OnUploadSceneRequest(const QString &filepath);
-    void OnUploadSceneRequestContinue(const QStringList &uploadFiles, const SceneDesc &sceneDesc);
+    void OnUploadSceneAnalyzed(RocketStorageImportAnalyzer *analyzer);
+    void OnUploadSceneRequestContinue(const QStringList &uploadFiles, const SceneDesc &sceneDesc, const QList<entity_id_t> &removeEntities, const ImportEntityIdMap &existingEntities);
 
     void OnUploadRequest(bool confirmOverwrite);
     void OnUploadRequestContinue();
@@ -393,6 +421,7 @@ private slots:
     void OnListSceneFolderObjectsResponse(QS3ListObjectsResponse *response);
     void OnDownloadOperationProgress(QS3GetObjectResponse *response, qint64 complete, qint64 total);
     void OnUploadOperationProgress(QS3PutObjectResponse *response, qint64 complete, qint64 total, MeshmoonStorageOperationMonitor *operation);
+    void OnBatchOperationProgress(qint64 complete, qint64 total);
 
     // Main finished handler
     void OnOperationFinished(MeshmoonStorageOperationMonitor *operation);
@@ -431,8 +460,6 @@ private slots:
     MeshmoonStorageItemWidgetList GetAllSubfiles(MeshmoonStorageItemWidget * item);
     MeshmoonStorageItemWidgetList GetAllParents(MeshmoonStorageItemWidget * item);
 
-    QStringList ParseTextures(const QFileInfo &materialFile);
-
     /// @todo Remove this and unify toggling tool key sequences to RocketPlugin (build mode Ctrl+B, storage Ctrl+S).
     /// @see inputCtx
     void OnKeyEvent(KeyEvent *e);
@@ -444,12 +471,16 @@ private:
     void Reset();
     void ResetUi();
 
+    // Removes entities, updates matched entities in place and creates the rest of the imported scene content.
+    void ApplySceneImport(Scene *scene, const SceneDesc &sceneDesc, const QList<entity_id_t> &removeEntities, const ImportEntityIdMap &existingEntities);
+
     RocketPlugin *plugin_;
     Framework *framework_;
     MeshmoonStorageAuthenticationMonitor *authenticator_;
     
     QString LC;
     QS3Client *s3_;
+    MeshmoonS3Endpoint s3Endpoint_; ///< For batch requests that QS3Client does not provide.
     QAction *toggleAction_;
     State state_;
     
@@ -0,0 +1,511 @@
+/**
+    @author Adminotech Ltd.
+
+    Copyright Adminotech Ltd.
+    All rights reserved.
+
+    @file   MeshmoonStorageBatch.cpp
+    @brief  Batched delete and bounded parallel copy operations for Meshmoon storage. */
+
+#include "StableHeaders.h"
+#include "DebugOperatorNew.h"
+
+#include "MeshmoonStorageBatch.h"
+
+#include "qts3/QS3Client.h"
+
+#include "LoggingFunctions.h"
+
+#include <QNetworkAccessManager>
+#include <QNetworkReply>
+#include <QCryptographicHash>
+#include <QXmlStreamReader>
+#include <QXmlStreamWriter>
+#include <QDateTime>
+#include <QLocale>
+
+#include "MemoryLeakCheck.h"
+
+/// @cond PRIVATE
+
+// MeshmoonS3Endpoint
+
+QUrl MeshmoonS3Endpoint::DefaultUrl()
+{
+    return QUrl("https://s3-eu-west-1.amazonaws.com");
+}
+
+QByteArray MeshmoonS3Endpoint::HmacSha1(QByteArray key, const QByteArray &message)
+{
+    const int blockSize = 64;
+    if (key.size() > blockSize)
+        key = QCryptographicHash::hash(key, QCryptographicHash::Sha1);
+    key.append(QByteArray(blockSize - key.size(), '\0'));
+
+    QByteArray innerPad(blockSize, char(0x36)), outerPad(blockSize, char(0x5c));
+    for(int i = 0; i < blockSize; ++i)
+    {
+        innerPad[i] = innerPad[i] ^ key[i];
+        outerPad[i] = outerPad[i] ^ key[i];
+    }
+    return QCryptographicHash::hash(outerPad + QCryptographicHash::hash(innerPad + message, QCryptographicHash::Sha1), QCryptographicHash::Sha1);
+}
+
+QNetworkRequest MeshmoonS3Endpoint::CreateRequest(const QByteArray &verb, const QString &key, const QString &subresource,
+                                                  const QByteArray &contentMd5, const QByteArray &contentType) const
+{
+    QByteArray resource = "/" + QUrl::toPercentEncoding(bucket) + "/";
+    if (!key.isEmpty())
+        resource += QUrl::toPercentEncoding(key.startsWith("/") ? key.mid(1) : key, "/");
+
+    QByteArray basePath = url.encodedPath();
+    if (basePath.endsWith("/"))
+        basePath.chop(1);
+
+    QUrl requestUrl = url;
+    requestUrl.setEncodedPath(basePath + resource);
+    if (!subresource.isEmpty())
+        requestUrl.setEncodedQuery(subresource.toUtf8());
+
+    const QByteArray date = QLocale::c().toString(QDateTime::currentDateTimeUtc(), "ddd, dd MMM yyyy hh:mm:ss").toAscii() + " GMT";
+    QByteArray stringToSign = verb + "\n" + contentMd5 + "\n" + contentType + "\n" + date + "\n" + resource;
+    if (!subresource.isEmpty())
+        stringToSign += "?" + subresource.toUtf8();
+
+    QNetworkRequest request(requestUrl);
+    request.setRawHeader("Date", date);
+    if (!contentMd5.isEmpty())
+        request.setRawHeader("Content-MD5", contentMd5);
+    if (!contentType.isEmpty())
+        request.setHeader(QNetworkRequest::ContentTypeHeader, contentType);
+    request.setRawHeader("Authorization", "AWS " + accessKey.toUtf8() + ":" + HmacSha1(secretKey.toUtf8(), stringToSign).toBase64());
+    return request;
+}
+
+// MeshmoonStorageBatchOperation
+
+void MeshmoonStorageBatchOperation::Advance(qint64 steps)
+{
+    completed_ = qMin(completed_ + steps, total_);
+    emit Progress(this, completed_, total_);
+}
+
+// MeshmoonStorageBatchDelete
+
+MeshmoonStorageBatchDelete::MeshmoonStorageBatchDelete(const MeshmoonS3Endpoint &endpoint, const QStringList &keys, int keysPerRequest) :
+    endpoint_(endpoint),
+    network_(new QNetworkAccessManager(this))
+{
+    maxConcurrent_ = 2;
+    keysPerRequest = qBound(1, keysPerRequest, static_cast<int>(MaxKeysPerRequest));
+
+    QStringList unique = keys;
+    unique.removeDuplicates();
+    total_ = unique.size();
+    for(int i = 0; i < unique.size(); i += keysPerRequest)
+        batches_ << unique.mid(i, keysPerRequest);
+}
+
+MeshmoonStorageBatchDelete::~MeshmoonStorageBatchDelete()
+{
+    foreach(QNetworkReply *reply, pending_.keys())
+    {
+        reply->disconnect(this);
+        reply->abort();
+        reply->deleteLater();
+    }
+    pending_.clear();
+}
+
+void MeshmoonStorageBatchDelete::Start()
+{
+    if (started_)
+        return;
+    started_ = true;
+
+    if (!endpoint_.IsValid() && total_ > 0)
+    {
+        errors_ << "Storage endpoint is not configured";
+        batches_.clear();
+        completed_ = total_;
+    }
+    if (batches_.isEmpty())
+    {
+        emit Finished(this);
+        return;
+    }
+    while(!batches_.isEmpty() && pending_.size() < maxConcurrent_)
+        SendNext();
+}
+
+void MeshmoonStorageBatchDelete::SendNext()
+{
+    if (batches_.isEmpty())
+        return;
+
+    QStringList keys = batches_.takeFirst();
+    const QByteArray body = CreateRequestBody(keys);
+    const QByteArray md5 = QCryptographicHash::hash(body, QCryptographicHash::Md5).toBase64();
+    QNetworkRequest request = endpoint_.CreateRequest("POST", "", "delete", md5, "application/xml");
+
+    QNetworkReply *reply = network_->post(request, body);
+    pending_[reply] = keys;
+    connect(reply, SIGNAL(finished()), SLOT(OnReplyFinished()));
+}
+
+void MeshmoonStorageBatchDelete::OnReplyFinished()
+{
+    QNetworkReply *reply = qobject_cast<QNetworkReply*>(sender());
+    if (!reply || !pending_.contains(reply))
+        return;
+
+    QStringList keys = pending_.take(reply);
+    const QByteArray response = reply->readAll();
+    const int status = reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt();
+    if (reply->error() != QNetworkReply::NoError || status < 200 || status >= 300)
+    {
+        // The whole request failed.
+        const QString reason = QString("HTTP %1 %2").arg(status).arg(reply->errorString());
+        foreach(const QString &key, keys)
+            errors_ << key + ": " + reason;
+    }
+    else
+    {
+        QStringList failedKeys;
+        errors_ << ParseErrors(response, failedKeys);
+        foreach(const QString &key, keys)
+            if (!failedKeys.contains(key))
+                deleted_ << key;
+    }
+    reply->deleteLater();
+
+    Advance(keys.size());
+    if (!batches_.isEmpty())
+        SendNext();
+    else if (pending_.isEmpty())
+    {
+        if (!errors_.isEmpty())
+            LogWarning(QString("[MeshmoonStorageBatchDelete]: %1 of %2 keys could not be deleted").arg(errors_.size()).arg(total_));
+        emit Finished(this);
+    }
+}
+
+QByteArray MeshmoonStorageBatchDelete::CreateRequestBody(const QStringList &keys)
+{
+    QByteArray body;
+    QXmlStreamWriter writer(&body);
+    writer.writeStartDocument();
+    writer.writeStartElement("Delete");
+    // Only report errors.
+    writer.writeTextElement("Quiet", "true");
+    foreach(const QString &key, keys)
+    {
+        writer.writeStartElement("Object");
+        writer.writeTextElement("Key", key.startsWith("/") ? key.mid(1) : key);
+        writer.writeEndElement();
+    }
+    writer.writeEndElement();
+    writer.writeEndDocument();
+    return body;
+}
+
+QStringList MeshmoonStorageBatchDelete::ParseErrors(const QByteArray &response, QStringList &failedKeys)
+{
+    QStringList errors;
+    QXmlStreamReader reader(response);
+    QString key, code, message;
+    bool inError = false;
+    while(!reader.atEnd())
+    {
+        reader.readNext();
+        if (reader.isStartElement())
+        {
+            if (reader.name() == "Error")
+            {
+                inError = true;
+                key.clear(); code.clear(); message.clear();
+            }
+            else if (inError && reader.name() == "Key")
+                key = reader.readElementText();
+            else if (inError && reader.name() == "Code")
+                code = reader.readElementText();
+            else if (inError && reader.name() == "Message")
+                message = reader.readElementText();
+        }
+        else if (reader.isEndElement() && reader.name() == "Error")
+        {
+            inError = false;
+            failedKeys << key;
+            errors << key + ": " + code + " " + message;
+        }
+    }
+    return errors;
+}
+
+// MeshmoonStorageCopyQueue
+
+MeshmoonStorageCopyQueue::MeshmoonStorageCopyQueue(QS3Client *s3, const KeyPairList &copies, QS3::CannedAcl acl) :
+    s3_(s3),
+    acl_(acl),
+    queue_(copies),
+    removeSources_(false),
+    deleteCompleted_(0)
+{
+    maxConcurrent_ = 8;
+    total_ = queue_.size();
+}
+
+void MeshmoonStorageCopyQueue::SetRemoveSources(const MeshmoonS3Endpoint &endpoint, const QStringList &additionalKeys)
+{
+    if (started_)
+        return;
+    removeSources_ = true;
+    removeAdditional_ = additionalKeys;
+    endpoint_ = endpoint;
+    // Copy and delete step for each key.
+    total_ = queue_.size() * 2 + removeAdditional_.size();
+}
+
+void MeshmoonStorageCopyQueue::Start()
+{
+    if (started_)
+        return;
+    started_ = true;
+
+    if (!s3_)
+    {
+        errors_ << "Storage client is null";
+        completed_ = total_;
+        emit Finished(this);
+        return;
+    }
+    if (queue_.isEmpty())
+    {
+        RemoveSources();
+        return;
+    }
+    while(!queue_.isEmpty() && pending_.size() < maxConcurrent_)
+        SendNext();
+}
+
+void MeshmoonStorageCopyQueue::SendNext()
+{
+    while(!queue_.isEmpty())
+    {
+        QPair<QString, QString> copy = queue_.takeFirst();
+        QS3CopyObjectResponse *response = s3_->copy(copy.first, copy.second, acl_);
+        if (!response)
+        {
+            errors_ << copy.first + ": Failed to start copy";
+            Advance(1);
+            continue;
+        }
+        pending_[response] = copy;
+        connect(response, SIGNAL(finished(QS3CopyObjectResponse*)), SLOT(OnCopyFinished(QS3CopyObjectResponse*)));
+        return;
+    }
+    // Every remaining copy failed to start and nothing is in flight to finish the queue.
+    if (pending_.isEmpty())
+        RemoveSources();
+}
+
+void MeshmoonStorageCopyQueue::OnCopyFinished(QS3CopyObjectResponse *response)
+{
+    if (!pending_.contains(response))
+        return;
+
+    QPair<QString, QString> copy = pending_.take(response);
+    if (response->succeeded)
+        copied_ << copy.first;
+    else
+        errors_ << copy.first + ": " + response->error.toString();
+    Advance(1);
+
+    if (!queue_.isEmpty())
+        SendNext();
+    else if (pending_.isEmpty())
+        RemoveSources();
+}
+
+void MeshmoonStorageCopyQueue::RemoveSources()
+{
+    // Only remove when every copy succeeded so that a partial move can be retried.
+    QStringList keys = copied_ + removeAdditional_;
+    if (!removeSources_ || keys.isEmpty() || !errors_.isEmpty())
+    {
+        completed_ = total_;
+        emit Progress(this, completed_, total_);
+        emit Finished(this);
+        return;
+    }
+
+    MeshmoonStorageBatchDelete *remover = new MeshmoonStorageBatchDelete(endpoint_, keys);
+    remover->setParent(this);
+    connect(remover, SIGNAL(Progress(MeshmoonStorageBatchOperation*, qint64, qint64)), SLOT(OnDeleteProgress(MeshmoonStorageBatchOperation*, qint64, qint64)));
+    connect(remover, SIGNAL(Finished(MeshmoonStorageBatchOperation*)), SLOT(OnDeleteFinished(MeshmoonStorageBatchOperation*)));
+    remover->Start();
+}
+
+void MeshmoonStorageCopyQueue::OnDeleteProgress(MeshmoonStorageBatchOperation * /*operation*/, qint64 completed, qint64 /*total*/)
+{
+    Advance(completed - deleteCompleted_);
+    deleteCompleted_ = completed;
+}
+
+void MeshmoonStorageCopyQueue::OnDeleteFinished(MeshmoonStorageBatchOperation *operation)
+{
+    errors_ << operation->Errors();
+    completed_ = total_;
+    emit Progress(this, completed_, total_);
+    emit Finished(this);
+    operation->deleteLater();
+}
+
+// MeshmoonStorageBatchBenchmark
+
+MeshmoonStorageBatchBenchmark::MeshmoonStorageBatchBenchmark(const MeshmoonS3Endpoint &endpoint, int count, int maxConcurrent) :
+    endpoint_(endpoint),
+    network_(new QNetworkAccessManager(this)),
+    LC("[MeshmoonStorageBatchBenchmark]: "),
+    phase_(UploadForSingleDelete),
+    maxConcurrent_(qMax(1, maxConcurrent)),
+    pending_(0),
+    failures_(0),
+    singleMsecs_(0),
+    batchMsecs_(0),
+    singleFailures_(0),
+    batchFailures_(0),
+    uploadFailures_(0)
+{
+    const QString prefix = QString("meshmoon-batch-benchmark/%1/").arg(QDateTime::currentDateTimeUtc().toString("yyyyMMdd-hhmmss"));
+    for(int i = 0; i < qMax(1, count); ++i)
+        keys_ << prefix + QString("object-%1.txt").arg(i, 6, 10, QChar('0'));
+}
+
+void MeshmoonStorageBatchBenchmark::Start()
+{
+    if (!endpoint_.IsValid())
+    {
+        LogError(LC + "Endpoint url, bucket, access key and secret key are required");
+        Finish();
+        return;
+    }
+    LogInfo(LC + QString("Running against %1 bucket %2 with %3 objects").arg(endpoint_.url.toString()).arg(endpoint_.bucket).arg(keys_.size()));
+    StartPhase(UploadForSingleDelete);
+}
+
+void MeshmoonStorageBatchBenchmark::StartPhase(Phase phase)
+{
+    phase_ = phase;
+    failures_ = 0;
+    timer_.start();
+
+    if (phase_ == BatchDelete)
+    {
+        MeshmoonStorageBatchDelete *remover = new MeshmoonStorageBatchDelete(endpoint_, keys_);
+        remover->setParent(this);
+        connect(remover, SIGNAL(Finished(MeshmoonStorageBatchOperation*)), SLOT(OnBatchDeleteFinished(MeshmoonStorageBatchOperation*)));
+        remover->Start();
+        return;
+    }
+    if (phase_ == Done)
+    {
+        Finish();
+        return;
+    }
+
+    queue_ = keys_;
+    SendNext();
+}
+
+void MeshmoonStorageBatchBenchmark::SendNext()
+{
+    while(!queue_.isEmpty() && pending_ < maxConcurrent_)
+    {
+        const QString key = queue_.takeFirst();
+        QNetworkReply *reply = 0;
+        if (phase_ == SingleDelete)
+            reply = network_->deleteResource(endpoint_.CreateRequest("DELETE", key));
+        else
+            reply = network_->put(endpoint_.CreateRequest("PUT", key, QString(), QByteArray(), "text/plain"), key.toUtf8());
+        connect(reply, SIGNAL(finished()), SLOT(OnReplyFinished()));
+        pending_++;
+    }
+}
+
+void MeshmoonStorageBatchBenchmark::OnReplyFinished()
+{
+    QNetworkReply *reply = qobject_cast<QNetworkReply*>(sender());
+    if (!reply)
+        return;
+
+    const int status = reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt();
+    if (reply->error() != QNetworkReply::NoError || status < 200 || status >= 300)
+    {
+        if (failures_ == 0)
+            LogWarning(LC + QString("Request failed: HTTP %1 %2").arg(status).arg(reply->errorString()));
+        failures_++;
+    }
+    reply->deleteLater();
+    pending_--;
+
+    if (!queue_.isEmpty())
+    {
+        SendNext();
+        return;
+    }
+    if (pending_ > 0)
+        return;
+
+    switch(phase_)
+    {
+        case UploadForSingleDelete:
+            uploadFailures_ += failures_;
+            StartPhase(SingleDelete);
+            break;
+        case SingleDelete:
+            singleMsecs_ = timer_.elapsed();
+            singleFailures_ = failures_;
+            StartPhase(UploadForBatchDelete);
+            break;
+        case UploadForBatchDelete:
+            uploadFailures_ += failures_;
+            StartPhase(BatchDelete);
+            break;
+        default:
+            break;
+    }
+}
+
+void MeshmoonStorageBatchBenchmark::OnBatchDeleteFinished(MeshmoonStorageBatchOperation *operation)
+{
+    batchMsecs_ = timer_.elapsed();
+    batchFailures_ = operation->Errors().size();
+    operation->deleteLater();
+    StartPhase(Done);
+}
+
+void MeshmoonStorageBatchBenchmark::Finish()
+{
+    QString report;
+    if (endpoint_.IsValid())
+    {
+        const int count = keys_.size();
+        report += QString("Per-object DELETE   : %1 keys in %2 msec, %3 keys/sec, %4 failed\n").arg(count).arg(singleMsecs_)
+            .arg(singleMsecs_ > 0 ? count * 1000.0 / singleMsecs_ : 0.0, 0, 'f', 1).arg(singleFailures_);
+        report += QString("Multi-object delete : %1 keys in %2 msec, %3 keys/sec, %4 failed\n").arg(count).arg(batchMsecs_)
+            .arg(batchMsecs_ > 0 ? count * 1000.0 / batchMsecs_ : 0.0, 0, 'f', 1).arg(batchFailures_);
+        if (batchMsecs_ > 0)
+            report += QString("Speedup             : %1x\n").arg(static_cast<double>(singleMsecs_) / batchMsecs_, 0, 'f', 1);
+        if (uploadFailures_ > 0)
+            report += QString("%1 test uploads failed, timings include missing keys\n").arg(uploadFailures_);
+
+        foreach(const QString &line, report.split("\n", QString::SkipEmptyParts))
+            LogInfo(LC + line);
+    }
+
+    emit Finished(report);
+    deleteLater();
+}
+
+/// @endcond
@@ -0,0 +1,217 @@
+/**
+    @author Adminotech Ltd.
+
+    Copyright Adminotech Ltd.
+    All rights reserved.
+
+    @file   MeshmoonStorageBatch.h
+    @brief  Batched delete and bounded parallel copy operations for Meshmoon storage. */
+
+#pragma once
+
+#include "RocketFwd.h"
+#include "qts3/QS3Fwd.h"
+#include "qts3/QS3Defines.h"
+
+#include <QObject>
+#include <QString>
+#include <QStringList>
+#include <QList>
+#include <QPair>
+#include <QHash>
+#include <QUrl>
+#include <QNetworkRequest>
+#include <QElapsedTimer>
+
+class QNetworkAccessManager;
+class QNetworkReply;
+
+/// @cond PRIVATE
+
+/// S3 compatible service endpoint and credentials for requests that QS3Client does not provide.
+/** Requests are signed with AWS signature version 2 and use path style addressing, so a local
+    S3 compatible server can be used by pointing @c url to it. */
+struct MeshmoonS3Endpoint
+{
+    QUrl url;               ///< Service root, eg. https://s3-eu-west-1.amazonaws.com
+    QString bucket;
+    QString accessKey;
+    QString secretKey;
+
+    bool IsValid() const { return url.isValid() && !bucket.isEmpty() && !accessKey.isEmpty() && !secretKey.isEmpty(); }
+
+    /// Returns a signed request for @c key in the bucket.
+    /** @param subresource Signed query without the '?', eg. "delete". */
+    QNetworkRequest CreateRequest(const QByteArray &verb, const QString &key, const QString &subresource = QString(),
+                                  const QByteArray &contentMd5 = QByteArray(), const QByteArray &contentType = QByteArray()) const;
+
+    /// Endpoint of the Meshmoon storage region.
+    static QUrl DefaultUrl();
+
+    /// HMAC-SHA1 of @c message with @c key.
+    static QByteArray HmacSha1(QByteArray key, const QByteArray &message);
+};
+
+/// Common progress reporting of batched storage operations, see MeshmoonStorageOperationMonitor.
+class MeshmoonStorageBatchOperation : public QObject
+{
+    Q_OBJECT
+
+public:
+    MeshmoonStorageBatchOperation() : completed_(0), total_(0), maxConcurrent_(1), started_(false) {}
+
+    /// Number of steps, one per key.
+    qint64 Total() const { return total_; }
+    qint64 Completed() const { return completed_; }
+
+    /// Sets the maximum number of requests in flight. Must be set before Start.
+    void SetMaxConcurrent(int requests) { maxConcurrent_ = qMax(1, requests); }
+
+    /// Keys that failed and the reasons, "key: reason".
+    const QStringList &Errors() const { return errors_; }
+
+    virtual void Start() = 0;
+
+signals:
+    void Progress(MeshmoonStorageBatchOperation *operation, qint64 completed, qint64 total);
+    void Finished(MeshmoonStorageBatchOperation *operation);
+
+protected:
+    void Advance(qint64 steps);
+
+    qint64 completed_;
+    qint64 total_;
+    int maxConcurrent_;
+    bool started_;
+    QStringList errors_;
+};
+
+/// Deletes keys with S3 multi-object delete requests, up to 1000 keys per request.
+class MeshmoonStorageBatchDelete : public MeshmoonStorageBatchOperation
+{
+    Q_OBJECT
+
+public:
+    /// S3 limit of keys per delete request.
+    static const int MaxKeysPerRequest = 1000;
+
+    MeshmoonStorageBatchDelete(const MeshmoonS3Endpoint &endpoint, const QStringList &keys, int keysPerRequest = MaxKeysPerRequest);
+    ~MeshmoonStorageBatchDelete();
+
+    void Start();
+
+    /// Keys that were deleted. Keys that did not exist are reported deleted by S3.
+    const QStringList &DeletedKeys() const { return deleted_; }
+
+    /// Returns the request body deleting @c keys.
+    static QByteArray CreateRequestBody(const QStringList &keys);
+
+    /// Parses failed keys from a multi-object delete response to "key: code message" strings.
+    static QStringList ParseErrors(const QByteArray &response, QStringList &failedKeys);
+
+private slots:
+    void OnReplyFinished();
+
+private:
+    void SendNext();
+
+    MeshmoonS3Endpoint endpoint_;
+    QNetworkAccessManager *network_;
+    QList<QStringList> batches_;
+    QHash<QNetworkReply*, QStringList> pending_;
+    QStringList deleted_;
+};
+
+/// Copies objects server side with a bounded number of parallel QS3Client copy requests.
+/** Optionally removes the sources with MeshmoonStorageBatchDelete afterwards, which moves them.
+    The sources are kept if any copy failed. */
+class MeshmoonStorageCopyQueue : public MeshmoonStorageBatchOperation
+{
+    Q_OBJECT
+
+public:
+    typedef QList<QPair<QString, QString> > KeyPairList;
+
+    /// @param copies Source key to destination key pairs.
+    MeshmoonStorageCopyQueue(QS3Client *s3, const KeyPairList &copies, QS3::CannedAcl acl = QS3::PublicRead);
+
+    /// Removes the copied sources when all copies are done.
+    /** @param additionalKeys Keys removed together with the sources, eg. folder placeholder objects. */
+    void SetRemoveSources(const MeshmoonS3Endpoint &endpoint, const QStringList &additionalKeys = QStringList());
+
+    void Start();
+
+    const QStringList &CopiedKeys() const { return copied_; }
+
+private slots:
+    void OnCopyFinished(QS3CopyObjectResponse *response);
+    void OnDeleteProgress(MeshmoonStorageBatchOperation *operation, qint64 completed, qint64 total);
+    void OnDeleteFinished(MeshmoonStorageBatchOperation *operation);
+
+private:
+    void SendNext();
+    void RemoveSources();
+
+    QS3Client *s3_;
+    QS3::CannedAcl acl_;
+    KeyPairList queue_;
+    QHash<QS3CopyObjectResponse*, QPair<QString, QString> > pending_;
+    QStringList copied_;    ///< Successfully copied source keys.
+    bool removeSources_;
+    QStringList removeAdditional_;
+    MeshmoonS3Endpoint endpoint_;
+    qint64 deleteCompleted_;
+};
+
+/// Compares deleting objects one request per key to MeshmoonStorageBatchDelete.
+/** Uploads @c count small objects under a temporary prefix, deletes them with a DELETE request per key,
+    uploads them again and deletes them with multi-object delete requests. Meant to be run against
+    a local S3 compatible server. Logs the report and deletes itself after Finished has been emitted. */
+class MeshmoonStorageBatchBenchmark : public QObject
+{
+    Q_OBJECT
+
+public:
+    MeshmoonStorageBatchBenchmark(const MeshmoonS3Endpoint &endpoint, int count, int maxConcurrent = 8);
+
+    void Start();
+
+signals:
+    void Finished(const QString &report);
+
+private slots:
+    void OnReplyFinished();
+    void OnBatchDeleteFinished(MeshmoonStorageBatchOperation *operation);
+
+private:
+    enum Phase
+    {
+        UploadForSingleDelete = 0,
+        SingleDelete,
+        UploadForBatchDelete,
+        BatchDelete,
+        Done
+    };
+
+    void StartPhase(Phase phase);
+    void SendNext();
+    void Finish();
+
+    MeshmoonS3Endpoint endpoint_;
+    QNetworkAccessManager *network_;
+    const QString LC;
+    Phase phase_;
+    int maxConcurrent_;
+    int pending_;
+    int failures_;
+    QStringList keys_;
+    QStringList queue_;
+    QElapsedTimer timer_;
+    qint64 singleMsecs_;
+    qint64 batchMsecs_;
+    int singleFailures_;
+    int batchFailures_;
+    int uploadFailures_;
+};
+
+/// @endcond
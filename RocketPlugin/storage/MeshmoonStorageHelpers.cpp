@@ -9,8 +9,10 @@
 
 #include "StableHeaders.h"
 #include "MeshmoonStorageHelpers.h"
+#include "MeshmoonStorageBatch.h"
 
 #include "qts3/QS3Defines.h"
+#include "common/MeshmoonAssetReloader.h"
 
 // MeshmoonStorageOperationMonitor
 
@@ -21,6 +23,40 @@ MeshmoonStorageOperationMonitor::MeshmoonStorageOperationMonitor(Type type_) :
 {
 }
 
+bool MeshmoonStorageOperationMonitor::AddChangedAsset(const QString &assetRef, const QString &key)
+{
+    if (changedAssetRefs.contains(assetRef))
+        return false;
+    changedAssetRefs << assetRef;
+
+    // Unknown content is sent without a hash, which makes everyone reload it.
+    Meshmoon::Network::AssetReloadEntry asset(assetRef);
+    QHash<QString, QPair<QByteArray, qint64> >::const_iterator hashed = uploadHashes.find(key);
+    if (hashed != uploadHashes.end())
+    {
+        asset.hash = hashed.value().first;
+        asset.size = (u32)hashed.value().second;
+    }
+    else if (uploadFiles.contains(key))
+    {
+        qint64 size = 0;
+        if (MeshmoonAssetReloader::ContentHash(uploadFiles[key], asset.hash, size))
+            asset.size = (u32)size;
+    }
+    changedAssets.push_back(asset);
+    return true;
+}
+
+void MeshmoonStorageOperationMonitor::SetUploadSource(const QString &key, const QString &filePath)
+{
+    uploadFiles[key] = filePath;
+}
+
+void MeshmoonStorageOperationMonitor::SetUploadSource(const QString &key, const QByteArray &data)
+{
+    uploadHashes[key] = QPair<QByteArray, qint64>(MeshmoonAssetReloader::ContentHash(data), data.size());
+}
+
 ProgressPair MeshmoonStorageOperationMonitor::CalculateGetProgress()
 {
     ProgressPair result;
@@ -125,4 +161,40 @@ void MeshmoonStorageOperationMonitor::OnRemoveFinished(QS3RemoveObjectResponse *
     emit Progress(response, completed, total);
     if (completed >= total)
         emit Finished(this);        
-}
\ No newline at end of file
+}
+
+void MeshmoonStorageOperationMonitor::AddOperation(MeshmoonStorageBatchOperation *operation)
+{
+    if (!operation || batches.contains(operation))
+        return;
+
+    batches[operation] = 0;
+    total += operation->Total();
+    connect(operation, SIGNAL(Progress(MeshmoonStorageBatchOperation*, qint64, qint64)), SLOT(OnBatchProgress(MeshmoonStorageBatchOperation*, qint64, qint64)));
+    connect(operation, SIGNAL(Finished(MeshmoonStorageBatchOperation*)), SLOT(OnBatchFinished(MeshmoonStorageBatchOperation*)));
+}
+
+void MeshmoonStorageOperationMonitor::OnBatchProgress(MeshmoonStorageBatchOperation *operation, qint64 operationCompleted, qint64 /*operationTotal*/)
+{
+    if (!batches.contains(operation))
+        return;
+
+    completed += operationCompleted - batches[operation];
+    batches[operation] = operationCompleted;
+    emit BatchProgress(completed, total);
+}
+
+void MeshmoonStorageOperationMonitor::OnBatchFinished(MeshmoonStorageBatchOperation *operation)
+{
+    if (!batches.contains(operation))
+        return;
+
+    // Steps that did not report progress, eg. when the operation could not be started.
+    completed += operation->Total() - batches.take(operation);
+    errors << operation->Errors();
+    operation->deleteLater();
+
+    emit BatchProgress(completed, total);
+    if (batches.isEmpty() && completed >= total)
+        emit Finished(this);
+}
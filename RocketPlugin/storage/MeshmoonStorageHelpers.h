@@ -11,6 +11,7 @@
 
 #include "RocketFwd.h"
 #include "qts3/QS3Fwd.h"
+#include "common/MeshmoonCommon.h"
 
 #include <QString>
 #include <QStringList>
@@ -30,7 +31,8 @@ public:
     {
         UploadFiles = 0,
         DownloadFiles,
-        DeleteFiles
+        DeleteFiles,
+        CopyFiles
     };
 
     MeshmoonStorageOperationMonitor(Type type_);
@@ -44,9 +46,25 @@ public:
     /// Total operations.
     quint64 total;
 
+    /// Failed keys of batch operations and the reasons, "key: reason".
+    QStringList errors;
+
     /// List of asset references that were affected by the operations.
     QStringList changedAssetRefs;
 
+    /// Affected assets with the content hash and size of the uploaded data.
+    Meshmoon::Network::AssetReloadEntryList changedAssets;
+
+    /// Marks @c assetRef uploaded to storage @c key as changed.
+    /** @return False if already marked. */
+    bool AddChangedAsset(const QString &assetRef, const QString &key);
+
+    /// Local source file of an upload to storage @c key, hashed if the upload changes a loaded asset.
+    void SetUploadSource(const QString &key, const QString &filePath);
+
+    /// In-memory source data of an upload to storage @c key.
+    void SetUploadSource(const QString &key, const QByteArray &data);
+
     /// Add download operation.
     void AddOperation(QS3GetObjectResponse *response, qint64 size);
 
@@ -56,6 +74,10 @@ public:
     /// Add remove operation.
     void AddOperation(QS3RemoveObjectResponse *response);
 
+    /// Add batched delete or copy operation.
+    /** Call before MeshmoonStorageBatchOperation::Start. Each key of the operation counts as one operation. */
+    void AddOperation(MeshmoonStorageBatchOperation *operation);
+
     /// Combined download operation progress. @see ProgressPair.
     ProgressPair CalculateGetProgress();
 
@@ -66,6 +88,9 @@ public:
 private:
     QHash<QS3GetObjectResponse*, ProgressPair > gets;
     QHash<QS3PutObjectResponse*, ProgressPair > puts;
+    QHash<QString, QString> uploadFiles;
+    QHash<QString, QPair<QByteArray, qint64> > uploadHashes;
+    QHash<MeshmoonStorageBatchOperation*, qint64> batches;
 
 private slots:
     void OnDownloadProgress(QS3GetObjectResponse *response, qint64 completed, qint64 total);
@@ -73,6 +98,8 @@ private slots:
     void OnUploadProgress(QS3PutObjectResponse *response, qint64 completed, qint64 total);
     void OnUploadFinished(QS3PutObjectResponse *response);
     void OnRemoveFinished(QS3RemoveObjectResponse *response);
+    void OnBatchProgress(MeshmoonStorageBatchOperation *operation, qint64 completed, qint64 total);
+    void OnBatchFinished(MeshmoonStorageBatchOperation *operation);
     /// @endcond
 
 signals:
@@ -90,6 +117,9 @@ signals:
     /// Progress signal for remove operations.
     /** @note The first parameter is null until the last progress signal. */
     void Progress(QS3RemoveObjectResponse *response, qint64 completed, qint64 total);
+
+    /// Progress signal for batch operations, combined over all monitored operations.
+    void BatchProgress(qint64 completed, qint64 total);
 };
 
 /// Provides monitoring signals for the %Meshmoon storage authentication step.
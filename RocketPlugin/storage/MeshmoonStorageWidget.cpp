@@ -79,6 +79,9 @@ RocketStorageWidget::RocketStorageWidget(RocketPlugin *plugin, MeshmoonStorage *
     connect(listWidget_, SIGNAL(itemDoubleClicked(QListWidgetItem*)), SLOT(OnItemDoubleClicked(QListWidgetItem*)));
     connect(listWidget_, SIGNAL(DownloadRequest()), SLOT(OnDownloadClicked()));
     connect(listWidget_, SIGNAL(DownloadAsZipRequest()), SLOT(OnDownloadAsZipClicked()));
+    connect(listWidget_, SIGNAL(ProfileParticlesRequest()), SLOT(OnProfileParticlesClicked()));
+    connect(listWidget_, SIGNAL(DuplicateFolderRequest()), SLOT(OnDuplicateFolderClicked()));
+    connect(listWidget_, SIGNAL(RenameFolderRequest()), SLOT(OnRenameFolderClicked()));
     connect(listWidget_, SIGNAL(CreateFolderRequest()), SIGNAL(CreateFolderRequest()));
     connect(listWidget_, SIGNAL(UploadFilesRequest()), SIGNAL(UploadFilesRequest()));
     
@@ -566,6 +569,43 @@ void RocketStorageWidget::OnDownloadAsZipClicked()
         emit DownloadRequest(items, true);
 }
 
+void RocketStorageWidget::OnProfileParticlesClicked()
+{
+    MeshmoonStorageItemWidgetList items;
+    foreach(QListWidgetItem *selection, listWidget_->selectedItems())
+    {
+        MeshmoonStorageItemWidget *storageItem = dynamic_cast<MeshmoonStorageItemWidget*>(selection);
+        if (!storageItem)
+            continue;
+        MeshmoonStorageItemWidgetList candidates;
+        if (storageItem->data.isDir)
+            candidates = storageItem->Files(true);
+        else
+            candidates << storageItem;
+        foreach(MeshmoonStorageItemWidget *candidate, candidates)
+            if (candidate->suffix == "particle")
+                items << candidate;
+    }
+    if (!items.isEmpty())
+        emit ProfileParticlesRequest(items);
+}
+
+void RocketStorageWidget::OnDuplicateFolderClicked()
+{
+    QList<QListWidgetItem*> selected = listWidget_->selectedItems();
+    MeshmoonStorageItemWidget *folder = (selected.size() == 1 ? dynamic_cast<MeshmoonStorageItemWidget*>(selected.first()) : 0);
+    if (folder && folder->data.isDir)
+        emit CopyFolderRequest(folder, false);
+}
+
+void RocketStorageWidget::OnRenameFolderClicked()
+{
+    QList<QListWidgetItem*> selected = listWidget_->selectedItems();
+    MeshmoonStorageItemWidget *folder = (selected.size() == 1 ? dynamic_cast<MeshmoonStorageItemWidget*>(selected.first()) : 0);
+    if (folder && folder->data.isDir && !folder->IsProtected())
+        emit CopyFolderRequest(folder, true);
+}
+
 void RocketStorageWidget::OnDeleteClicked()
 {
     if (!ListView())
@@ -1250,6 +1290,15 @@ bool RocketStorageListWidget::ShowContextMenu(const QPoint &pos)
         {
             act = contextMenu_->addAction(QIcon(":/images/icon-download-64x64.png"), "Download as zip...");
             connect(act, SIGNAL(triggered()), this, SIGNAL(DownloadAsZipRequest()));
+
+            act = contextMenu_->addAction(QIcon(MeshmoonStorageItemWidget::IconImagePath("particle")), "Profile Particles...");
+            connect(act, SIGNAL(triggered()), this, SIGNAL(ProfileParticlesRequest()));
+
+            act = contextMenu_->addAction(QIcon(":/images/icon-clone-32x32.png"), "Duplicate Folder...");
+            connect(act, SIGNAL(triggered()), this, SIGNAL(DuplicateFolderRequest()));
+
+            act = contextMenu_->addAction("Rename Folder...");
+            connect(act, SIGNAL(triggered()), this, SIGNAL(RenameFolderRequest()));
         }
 
         // Delete item
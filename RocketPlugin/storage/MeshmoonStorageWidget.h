@@ -172,6 +172,8 @@ signals:
     
     void DownloadRequest(MeshmoonStorageItemWidgetList items, bool zip);
     void DeleteRequest(MeshmoonStorageItemWidgetList items);
+    void ProfileParticlesRequest(MeshmoonStorageItemWidgetList items);
+    void CopyFolderRequest(MeshmoonStorageItemWidget *folder, bool move);
     
     void UploadSceneRequest(const QString &filepath);
     void UploadRequest(bool confirmOverwrite);
@@ -193,6 +195,9 @@ private slots:
     void OnDownloadClicked();
     void OnDownloadAsZipClicked();
     void OnDeleteClicked();
+    void OnProfileParticlesClicked();
+    void OnDuplicateFolderClicked();
+    void OnRenameFolderClicked();
 
     void OnShowMenu();
     void OnHandleDragEnterEvent(QDragEnterEvent *e, QGraphicsItem *widget);
@@ -247,6 +252,9 @@ signals:
     void UploadFilesRequest();
     void DownloadRequest();
     void DownloadAsZipRequest();
+    void ProfileParticlesRequest();
+    void DuplicateFolderRequest();
+    void RenameFolderRequest();
 
 private slots:
     void CreateNewFileSubMenu(QMenu *menu);
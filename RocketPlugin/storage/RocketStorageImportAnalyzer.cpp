@@ -0,0 +1,791 @@
+/**
+    @author Adminotech Ltd.
+
+    Copyright Adminotech Ltd.
+    All rights reserved.
+
+    @file   RocketStorageImportAnalyzer.cpp
+    @brief  Background scene file import analysis and diffing against the scene and storage. */
+
+#include "StableHeaders.h"
+#include "DebugOperatorNew.h"
+
+#include "RocketStorageImportAnalyzer.h"
+#include "MeshmoonStorageItem.h"
+#include "common/MeshmoonAssetReloader.h"
+
+#include "Framework.h"
+#include "LoggingFunctions.h"
+#include "SceneAPI.h"
+#include "Scene.h"
+#include "Entity.h"
+#include "IComponent.h"
+#include "IAttribute.h"
+#include "AssetAPI.h"
+#include "AssetCache.h"
+#include "OgreMaterialUtils.h"
+
+#include <QFile>
+#include <QDir>
+#include <QSet>
+#include <QXmlStreamReader>
+#include <QCryptographicHash>
+#include <QElapsedTimer>
+
+#include "MemoryLeakCheck.h"
+
+/// @cond PRIVATE
+
+namespace
+{
+    bool IsAssetRefType(const QString &typeName)
+    {
+        return typeName.compare(cAttributeAssetReferenceTypeName, Qt::CaseInsensitive) == 0 ||
+               typeName.compare(cAttributeAssetReferenceListTypeName, Qt::CaseInsensitive) == 0;
+    }
+
+    bool XmlBool(const QStringRef &value, bool defaultValue)
+    {
+        if (value.isEmpty())
+            return defaultValue;
+        return (value == "1" || value.compare(QLatin1String("true"), Qt::CaseInsensitive) == 0);
+    }
+}
+
+// RocketStorageImportTypeInfo
+
+const RocketStorageImportTypeInfo::Attribute *RocketStorageImportTypeInfo::FindAttribute(const QString &componentTypeName, const QString &idOrName) const
+{
+    QHash<QString, QList<Attribute> >::const_iterator iter = attributes.find(componentTypeName);
+    if (iter == attributes.end())
+        return 0;
+    for(int i = 0; i < iter.value().size(); ++i)
+    {
+        const Attribute &attribute = iter.value()[i];
+        if (attribute.id.compare(idOrName, Qt::CaseInsensitive) == 0 || attribute.name.compare(idOrName, Qt::CaseInsensitive) == 0)
+            return &attribute;
+    }
+    return 0;
+}
+
+RocketStorageImportTypeInfo RocketStorageImportTypeInfo::Capture(Framework *framework, const QSet<QString> &typeNames, const QSet<u32> &typeIds)
+{
+    RocketStorageImportTypeInfo info;
+    if (!framework || !framework->Scene())
+        return info;
+
+    std::vector<ComponentPtr> prototypes;
+    foreach(const QString &typeName, typeNames)
+        prototypes.push_back(framework->Scene()->CreateComponentByName(0, typeName));
+    foreach(u32 typeId, typeIds)
+        prototypes.push_back(framework->Scene()->CreateComponentById(0, typeId));
+
+    for(size_t p = 0; p < prototypes.size(); ++p)
+    {
+        ComponentPtr prototype = prototypes[p];
+        if (!prototype.get())
+            continue;
+
+        const QString fullTypeName = IComponent::EnsureTypeNameWithPrefix(prototype->TypeName());
+        info.typeNames[prototype->TypeId()] = fullTypeName;
+        if (info.attributes.contains(fullTypeName))
+            continue;
+
+        QList<Attribute> &attributes = info.attributes[fullTypeName];
+        const AttributeVector &prototypeAttributes = prototype->Attributes();
+        for(size_t i = 0; i < prototypeAttributes.size(); ++i)
+        {
+            IAttribute *prototypeAttribute = prototypeAttributes[i];
+            if (!prototypeAttribute)
+                continue;
+            Attribute attribute;
+            attribute.id = prototypeAttribute->Id();
+            attribute.name = prototypeAttribute->Name();
+            attribute.typeName = prototypeAttribute->TypeName();
+            attributes << attribute;
+        }
+    }
+    return info;
+}
+
+// RocketStorageImportSceneIndex
+
+RocketStorageImportSceneIndex RocketStorageImportSceneIndex::Capture(Scene *scene, MeshmoonStorageItemWidget *storageRoot)
+{
+    RocketStorageImportSceneIndex index;
+    if (scene)
+    {
+        const Scene::EntityMap &entities = scene->Entities();
+        for(Scene::EntityMap::const_iterator iter = entities.begin(); iter != entities.end(); ++iter)
+        {
+            Entity *entity = iter->second.get();
+            if (!entity || entity->Name().trimmed().isEmpty())
+                continue;
+
+            Entry entry;
+            entry.id = entity->Id();
+            entry.components = RocketStorageImportAnalyzer::ComponentStrings(entity);
+
+            const Entity::ComponentMap &components = entity->Components();
+            for(Entity::ComponentMap::const_iterator compIter = components.begin(); compIter != components.end(); ++compIter)
+            {
+                if (!compIter->second.get())
+                    continue;
+                const AttributeVector &attributes = compIter->second->Attributes();
+                for(size_t i = 0; i < attributes.size(); ++i)
+                    if (attributes[i] && IsAssetRefType(attributes[i]->TypeName()))
+                        entry.assetRefs << attributes[i]->ToString();
+            }
+            index.entities[entity->Name().trimmed()] << entry;
+        }
+    }
+
+    if (storageRoot)
+    {
+        QString rootKey = storageRoot->data.key;
+        foreach(MeshmoonStorageItemWidget *file, storageRoot->Files(true))
+        {
+            QString relativeRef = file->data.key.mid(rootKey.length());
+            if (relativeRef.startsWith("/"))
+                relativeRef = relativeRef.mid(1);
+            index.storageFiles[relativeRef] = static_cast<qint64>(file->data.size);
+        }
+    }
+    return index;
+}
+
+void RocketStorageImportSceneIndex::Index(const QString &destinationPrefix)
+{
+    for(QHash<QString, QList<Entry> >::iterator iter = entities.begin(); iter != entities.end(); ++iter)
+    {
+        for(int e = 0; e < iter.value().size(); ++e)
+        {
+            Entry &entry = iter.value()[e];
+            entry.hash = RocketStorageImportAnalyzer::HashComponents(entry.components);
+            entry.components.clear();
+
+            if (!destinationPrefix.isEmpty())
+            {
+                int localRefs = 0, outsideRefs = 0;
+                foreach(const QString &value, entry.assetRefs)
+                {
+                    foreach(QString ref, value.split(";", QString::SkipEmptyParts))
+                    {
+                        ref = ref.trimmed();
+                        if (ref.isEmpty() || AssetAPI::ParseAssetRef(ref) != AssetAPI::AssetRefRelativePath)
+                            continue;
+                        localRefs++;
+                        if (!ref.startsWith(destinationPrefix, Qt::CaseInsensitive))
+                            outsideRefs++;
+                    }
+                }
+                entry.ownedByPrefix = (localRefs > 0 && outsideRefs == 0);
+            }
+            entry.assetRefs.clear();
+        }
+    }
+}
+
+// RocketStorageImportAnalysis
+
+int RocketStorageImportAnalysis::EntityCount(RocketStorageImportState state) const
+{
+    int count = 0;
+    for(size_t i = 0; i < entities.size(); ++i)
+        if (entities[i].state == state)
+            count++;
+    return count;
+}
+
+int RocketStorageImportAnalysis::AssetCount(RocketStorageImportState state) const
+{
+    int count = 0;
+    for(size_t i = 0; i < assets.size(); ++i)
+        if (assets[i].existsDisk && assets[i].state == state)
+            count++;
+    return count;
+}
+
+QString RocketStorageImportAnalysis::Summary() const
+{
+    return QString("Entities %1 new, %2 changed, %3 unchanged, %4 removed. Assets %5 new, %6 changed, %7 unchanged.")
+        .arg(EntityCount(ImportNew)).arg(EntityCount(ImportChanged)).arg(EntityCount(ImportUnchanged)).arg(EntityCount(ImportRemoved))
+        .arg(AssetCount(ImportNew)).arg(AssetCount(ImportChanged)).arg(AssetCount(ImportUnchanged));
+}
+
+// RocketStorageImportAnalyzer
+
+RocketStorageImportAnalyzer::RocketStorageImportAnalyzer(Framework *framework, Scene *scene, MeshmoonStorageItemWidget *storageRoot,
+                                                         const QString &filePath, const QString &destinationPrefix) :
+    framework_(framework),
+    LC("[RocketStorageImportAnalyzer]: "),
+    filePath_(filePath),
+    destinationPrefix_(destinationPrefix),
+    phase_(ParsePhase)
+{
+    // Only a snapshot here, hashing is done in the analysis thread.
+    QElapsedTimer timer;
+    timer.start();
+    index_ = RocketStorageImportSceneIndex::Capture(scene, storageRoot);
+    result_.diffMsecs = timer.elapsed();
+
+    connect(this, SIGNAL(finished()), SLOT(OnThreadFinished()), Qt::QueuedConnection);
+}
+
+RocketStorageImportAnalyzer::~RocketStorageImportAnalyzer()
+{
+    wait();
+}
+
+void RocketStorageImportAnalyzer::Start()
+{
+    phase_ = ParsePhase;
+    start(QThread::LowPriority);
+}
+
+void RocketStorageImportAnalyzer::run()
+{
+    if (phase_ == ParsePhase)
+        Parse();
+    else if (phase_ == AnalyzePhase)
+        Analyze();
+    else if (phase_ == CacheHashPhase)
+        HashCachedCopies();
+}
+
+void RocketStorageImportAnalyzer::OnThreadFinished()
+{
+    if (phase_ == ParsePhase && result_.error.isEmpty())
+    {
+        // Components are created in the main thread, one prototype per component type used by the file.
+        QElapsedTimer timer;
+        timer.start();
+        types_ = RocketStorageImportTypeInfo::Capture(framework_, usedTypeNames_, usedTypeIds_);
+        result_.parseMsecs += timer.elapsed();
+
+        phase_ = AnalyzePhase;
+        start(QThread::LowPriority);
+        return;
+    }
+    if (phase_ == AnalyzePhase && result_.error.isEmpty())
+    {
+        // AssetCache is not thread safe, look up the cached copies of assets that have the same size in storage here.
+        AssetCache *cache = (framework_ && framework_->Asset() ? framework_->Asset()->Cache() : 0);
+        for(size_t i = 0; i < result_.assets.size() && cache; ++i)
+        {
+            const RocketStorageImportAssetItem &asset = result_.assets[i];
+            if (!asset.existsDisk || !asset.existsStorage || asset.size != index_.storageFiles.value(asset.desc.destinationName, -1))
+                continue;
+            QString cachePath = cache->FindInCache(framework_->Asset()->ResolveAssetRef("", asset.desc.destinationName));
+            if (!cachePath.isEmpty())
+                cachedCopies_[static_cast<int>(i)] = cachePath;
+        }
+        if (!cachedCopies_.isEmpty())
+        {
+            phase_ = CacheHashPhase;
+            start(QThread::LowPriority);
+            return;
+        }
+    }
+
+    phase_ = DonePhase;
+    if (result_.error.isEmpty())
+        LogInfo(LC + QString("%1 analyzed in %2 msec: %3").arg(QFileInfo(filePath_).fileName())
+            .arg(result_.parseMsecs + result_.diffMsecs + result_.hashMsecs).arg(result_.Summary()));
+
+    emit Completed(this);
+    deleteLater();
+}
+
+void RocketStorageImportAnalyzer::Parse()
+{
+    QElapsedTimer timer;
+    timer.start();
+
+    QFile file(filePath_);
+    if (!file.open(QIODevice::ReadOnly))
+    {
+        result_.error = "Failed to open scene file " + filePath_;
+        return;
+    }
+    const QByteArray data = file.readAll();
+    file.close();
+
+    QString error;
+    if (!ParseSceneXml(data, result_.sceneDesc, &error))
+    {
+        result_.error = "Failed to parse scene file " + QFileInfo(filePath_).fileName() + ": " + error;
+        return;
+    }
+    result_.sceneDesc.filename = filePath_;
+    foreach(const EntityDesc &entity, result_.sceneDesc.entities)
+    {
+        foreach(const ComponentDesc &component, entity.components)
+        {
+            if (!component.typeName.isEmpty())
+                usedTypeNames_.insert(component.typeName);
+            else if (component.typeId != InvalidTypeId)
+                usedTypeIds_.insert(component.typeId);
+        }
+    }
+    result_.parseMsecs = timer.restart();
+
+    index_.Index(destinationPrefix_);
+    result_.diffMsecs += timer.elapsed();
+}
+
+void RocketStorageImportAnalyzer::Analyze()
+{
+    QElapsedTimer timer;
+    timer.start();
+
+    ResolveTypes(result_.sceneDesc, types_);
+    result_.parseMsecs += timer.restart();
+
+    QString txmlFolder = QFileInfo(filePath_).dir().path();
+    if (!txmlFolder.endsWith("/"))
+        txmlFolder += "/";
+    CollectAssets(txmlFolder);
+    if (!result_.error.isEmpty())
+        return;
+    RewriteAssetRefs(result_.sceneDesc, destinationPrefix_, result_.assets);
+    DiffEntities();
+    result_.diffMsecs += timer.restart();
+
+    // Hash disk sources. Assets with a different size than the storage file have changed.
+    for(size_t i = 0; i < result_.assets.size(); ++i)
+    {
+        RocketStorageImportAssetItem &asset = result_.assets[i];
+        if (asset.existsDisk)
+            asset.existsDisk = MeshmoonAssetReloader::ContentHash(asset.pathAbsolute, asset.contentHash, asset.size);
+        if (!asset.existsDisk || !asset.existsStorage)
+            asset.state = ImportNew;
+        else
+            // Unchanged if the cached copy of the storage file matches, see OnThreadFinished.
+            asset.state = ImportChanged;
+    }
+    result_.hashMsecs = timer.elapsed();
+}
+
+void RocketStorageImportAnalyzer::HashCachedCopies()
+{
+    QElapsedTimer timer;
+    timer.start();
+
+    for(QHash<int, QString>::const_iterator iter = cachedCopies_.begin(); iter != cachedCopies_.end(); ++iter)
+    {
+        RocketStorageImportAssetItem &asset = result_.assets[static_cast<size_t>(iter.key())];
+        QByteArray hash;
+        qint64 size = 0;
+        if (MeshmoonAssetReloader::ContentHash(iter.value(), hash, size) && size == asset.size && hash == asset.contentHash)
+            asset.state = ImportUnchanged;
+    }
+    result_.hashMsecs += timer.elapsed();
+}
+
+void RocketStorageImportAnalyzer::CollectAssets(const QString &txmlFolder)
+{
+    QSet<QString> sources;
+    QStringList materials;
+
+    foreach(const EntityDesc &entity, result_.sceneDesc.entities)
+    {
+        foreach(const ComponentDesc &component, entity.components)
+        {
+            foreach(const AttributeDesc &attribute, component.attributes)
+            {
+                if (!IsAssetRefType(attribute.typeName) || attribute.value.trimmed().isEmpty())
+                    continue;
+
+                foreach(QString ref, attribute.value.split(";", QString::SkipEmptyParts))
+                {
+                    ref = ref.trimmed();
+                    QString pathFilename, filename;
+                    AssetAPI::AssetRefType refType = AssetAPI::ParseAssetRef(ref, 0, 0, 0, 0, &pathFilename, 0, &filename);
+                    if (refType != AssetAPI::AssetRefRelativePath && refType != AssetAPI::AssetRefLocalPath)
+                        continue;
+
+                    QFileInfo info(refType == AssetAPI::AssetRefRelativePath ? QDir(txmlFolder).absoluteFilePath(pathFilename) : pathFilename);
+                    if (info.isDir() || sources.contains(info.absoluteFilePath()))
+                        continue;
+                    sources.insert(info.absoluteFilePath());
+
+                    RocketStorageImportAssetItem item;
+                    item.desc.source = info.absoluteFilePath();
+                    item.desc.destinationName = destinationPrefix_ + filename;
+                    item.desc.typeName = (!attribute.name.isEmpty() ? attribute.name : attribute.id);
+                    item.pathAbsolute = info.absoluteFilePath();
+                    item.existsDisk = info.exists();
+                    item.existsStorage = index_.storageFiles.contains(item.desc.destinationName);
+                    item.pathRelative = info.fileName();
+
+                    if (item.pathRelative.contains(" "))
+                    {
+                        result_.error = "Spaces are not allowed in filenames. Found in filename: \"" + item.pathRelative + "\", full path: \"" + item.pathAbsolute + "\"";
+                        return;
+                    }
+                    if (item.pathAbsolute.startsWith(txmlFolder))
+                        item.pathRelative = item.pathAbsolute.mid(txmlFolder.length());
+
+                    result_.assets.push_back(item);
+                    if (info.suffix().compare("material", Qt::CaseInsensitive) == 0)
+                        materials << item.pathAbsolute;
+                }
+            }
+        }
+    }
+
+    // Find referenced textures
+    foreach(const QString &material, materials)
+    {
+        foreach(const QString &textureFile, ParseTextures(QFileInfo(material)))
+        {
+            QFileInfo texInfo(textureFile);
+            if (sources.contains(texInfo.absoluteFilePath()))
+                continue;
+            sources.insert(texInfo.absoluteFilePath());
+
+            RocketStorageImportAssetItem texItem;
+            texItem.desc.source = texInfo.absoluteFilePath();
+            texItem.desc.destinationName = destinationPrefix_ + texInfo.fileName();
+            if (texItem.desc.destinationName.contains(" "))
+            {
+                result_.error = "Spaces are not allowed in filenames. Found in filename: \"" + texItem.desc.destinationName + "\", full path: \"" + texItem.desc.source + "\"";
+                return;
+            }
+            texItem.pathAbsolute = texInfo.absoluteFilePath();
+            texItem.existsDisk = texInfo.exists();
+            texItem.existsStorage = index_.storageFiles.contains(texItem.desc.destinationName);
+            texItem.pathRelative = texItem.pathAbsolute;
+            if (texItem.pathRelative.startsWith(txmlFolder))
+                texItem.pathRelative = texItem.pathRelative.mid(txmlFolder.length());
+
+            result_.assets.push_back(texItem);
+        }
+    }
+}
+
+void RocketStorageImportAnalyzer::DiffEntities()
+{
+    // Number of file entities matched so far per name, the n:th one is matched to the n:th scene entity.
+    QHash<QString, int> matched;
+    QList<const RocketStorageImportSceneIndex::Entry*> matches;
+    ImportEntityIdMap fileToScene;
+    foreach(const EntityDesc &entity, result_.sceneDesc.entities)
+    {
+        const RocketStorageImportSceneIndex::Entry *match = 0;
+        const QString name = entity.name.trimmed();
+        if (!name.isEmpty())
+        {
+            const int occurrence = matched[name]++;
+            QHash<QString, QList<RocketStorageImportSceneIndex::Entry> >::const_iterator existing = index_.entities.find(name);
+            if (existing != index_.entities.end() && occurrence < existing.value().size())
+                match = &existing.value()[occurrence];
+        }
+        if (match && !entity.id.trimmed().isEmpty())
+            fileToScene[entity.id.trimmed()] = match->id;
+        matches << match;
+    }
+
+    // Parent refs are hashed as the ids of the matched scene entities.
+    for(int i = 0; i < result_.sceneDesc.entities.size(); ++i)
+    {
+        const EntityDesc &entity = result_.sceneDesc.entities[i];
+
+        RocketStorageImportEntityItem item;
+        item.index = i;
+        item.desc = entity;
+        item.contentHash = EntityHash(entity, fileToScene);
+        if (matches[i])
+        {
+            item.existsScene = true;
+            item.existingId = matches[i]->id;
+            item.state = (matches[i]->hash == item.contentHash ? ImportUnchanged : ImportChanged);
+        }
+        result_.entities.push_back(item);
+    }
+
+    // Scene entities that were created from this destination folder but are no longer in the file.
+    for(QHash<QString, QList<RocketStorageImportSceneIndex::Entry> >::const_iterator iter = index_.entities.begin(); iter != index_.entities.end(); ++iter)
+    {
+        const QList<RocketStorageImportSceneIndex::Entry> &entries = iter.value();
+        for(int i = matched.value(iter.key(), 0); i < entries.size(); ++i)
+        {
+            if (!entries[i].ownedByPrefix)
+                continue;
+
+            RocketStorageImportEntityItem item;
+            item.desc.name = iter.key();
+            item.existsScene = true;
+            item.existingId = entries[i].id;
+            item.contentHash = entries[i].hash;
+            item.state = ImportRemoved;
+            result_.entities.push_back(item);
+        }
+    }
+}
+
+bool RocketStorageImportAnalyzer::ParseSceneXml(const QByteArray &data, SceneDesc &sceneDesc, QString *error)
+{
+    QXmlStreamReader reader(data);
+    QList<EntityDesc> openEntities;
+    ComponentDesc component;
+    bool inComponent = false;
+    bool sceneFound = false;
+
+    while(!reader.atEnd())
+    {
+        reader.readNext();
+        if (reader.isStartElement())
+        {
+            const QXmlStreamAttributes xmlAttributes = reader.attributes();
+            if (reader.name() == "scene")
+                sceneFound = true;
+            else if (reader.name() == "entity" && sceneFound)
+            {
+                // Child entities are flattened to the scene description.
+                EntityDesc entity;
+                entity.id = xmlAttributes.value("id").toString();
+                entity.local = !XmlBool(xmlAttributes.value("sync"), true);
+                entity.temporary = XmlBool(xmlAttributes.value("temporary"), false);
+                openEntities << entity;
+            }
+            else if (reader.name() == "component" && !openEntities.isEmpty())
+            {
+                component = ComponentDesc();
+                bool ok = false;
+                const u32 typeId = xmlAttributes.value("typeId").toString().toUInt(&ok);
+                const QString typeName = xmlAttributes.value("type").toString();
+                component.typeId = (ok ? typeId : InvalidTypeId);
+                component.typeName = (!typeName.isEmpty() ? IComponent::EnsureTypeNameWithPrefix(typeName) : QString());
+                component.name = xmlAttributes.value("name").toString();
+                component.sync = XmlBool(xmlAttributes.value("sync"), true);
+                inComponent = true;
+            }
+            else if (reader.name() == "attribute" && inComponent)
+            {
+                AttributeDesc attribute;
+                attribute.id = xmlAttributes.value("id").toString();
+                attribute.name = xmlAttributes.value("name").toString();
+                attribute.value = xmlAttributes.value("value").toString();
+                attribute.typeName = xmlAttributes.value("type").toString();
+                component.attributes << attribute;
+            }
+        }
+        else if (reader.isEndElement())
+        {
+            if (reader.name() == "component" && inComponent)
+            {
+                EntityDesc &entity = openEntities.last();
+                if (component.typeName == "EC_Name" && entity.name.isEmpty())
+                {
+                    foreach(const AttributeDesc &attribute, component.attributes)
+                        if (attribute.id == "name")
+                            entity.name = attribute.value;
+                }
+                entity.components << component;
+                inComponent = false;
+            }
+            else if (reader.name() == "entity" && !openEntities.isEmpty())
+                sceneDesc.entities << openEntities.takeLast();
+        }
+    }
+
+    if (reader.hasError())
+    {
+        if (error)
+            *error = QString("Line %1: %2").arg(reader.lineNumber()).arg(reader.errorString());
+        return false;
+    }
+    if (!sceneFound)
+    {
+        if (error)
+            *error = "No scene element";
+        return false;
+    }
+    return true;
+}
+
+void RocketStorageImportAnalyzer::ResolveTypes(SceneDesc &sceneDesc, const RocketStorageImportTypeInfo &types)
+{
+    QMutableListIterator<EntityDesc> edIt(sceneDesc.entities);
+    while(edIt.hasNext())
+    {
+        EntityDesc &entity = edIt.next();
+        QMutableListIterator<ComponentDesc> cdIt(entity.components);
+        while(cdIt.hasNext())
+        {
+            ComponentDesc &component = cdIt.next();
+            if (component.typeName.isEmpty() && component.typeId != InvalidTypeId)
+                component.typeName = types.typeNames.value(component.typeId);
+
+            QMutableListIterator<AttributeDesc> adIt(component.attributes);
+            while(adIt.hasNext())
+            {
+                // Static attributes, older files only have the human readable name.
+                AttributeDesc &attribute = adIt.next();
+                const RocketStorageImportTypeInfo::Attribute *known = types.FindAttribute(component.typeName, !attribute.id.isEmpty() ? attribute.id : attribute.name);
+                if (!known)
+                    continue;
+                if (attribute.typeName.isEmpty())
+                    attribute.typeName = known->typeName;
+                if (attribute.id.isEmpty())
+                    attribute.id = known->id;
+                if (attribute.name.isEmpty())
+                    attribute.name = known->name;
+            }
+
+            // Name component stored by type id only, or without attribute ids.
+            if (component.typeName == "EC_Name" && entity.name.isEmpty())
+            {
+                foreach(const AttributeDesc &attribute, component.attributes)
+                    if (attribute.id == "name")
+                        entity.name = attribute.value;
+            }
+        }
+    }
+}
+
+QStringList RocketStorageImportAnalyzer::ParseTextures(const QFileInfo &materialFile)
+{
+    QFile file(materialFile.absoluteFilePath());
+    if (!file.exists() || !file.open(QIODevice::ReadOnly))
+        return QStringList();
+
+    QByteArray data = file.readAll();
+    file.close();
+    QSet<QString> textures = OgreRenderer::ProcessMaterialForTextures(QString(data));
+
+    QStringList textureFiles;
+    foreach(QString texture, textures)
+    {
+        texture = texture.trimmed();
+        // Leave web and 'Ogre Media:' texture refs alone.
+        if (texture.startsWith("http://") || texture.startsWith("https://") || texture.startsWith("Ogre Media:", Qt::CaseInsensitive))
+            continue;
+        /// @todo Resolve local:// from local storages and what?
+        textureFiles << materialFile.dir().absoluteFilePath(texture);
+    }
+    return textureFiles;
+}
+
+void RocketStorageImportAnalyzer::RewriteAssetRefs(SceneDesc &sceneDesc, const QString &destinationPrefix, const ImportAssetItemList &assets)
+{
+    // Rewrite all asset refs to be relative "file.extension" from "local://file.extension" etc.
+    QMutableListIterator<EntityDesc> edIt(sceneDesc.entities);
+    while(edIt.hasNext())
+    {
+        QMutableListIterator<ComponentDesc> cdIt(edIt.next().components);
+        while(cdIt.hasNext())
+        {
+            QMutableListIterator<AttributeDesc> adIt(cdIt.next().attributes);
+            while(adIt.hasNext())
+            {
+                adIt.next();
+                if (!IsAssetRefType(adIt.value().typeName))
+                    continue;
+
+                QString trimmed = adIt.value().value.trimmed();
+                if (trimmed.isEmpty() || trimmed == "RexSkyBox")
+                    continue;
+
+                QStringList newValues;
+                QStringList valueParts = adIt.value().value.split(";", QString::KeepEmptyParts);
+                for(int i=0; i<valueParts.size(); ++i)
+                {
+                    QString &value = valueParts[i];
+                    if (value.trimmed().isEmpty())
+                        newValues << "";
+                    // Leave http refs alone
+                    else if (!value.startsWith("http://") && !value.startsWith("https://"))
+                    {
+                        QString filename, subasset;
+                        AssetAPI::ParseAssetRef(value, 0, 0, 0, 0, 0, 0, &filename, &subasset);
+                        newValues << destinationPrefix + filename + (!subasset.isEmpty() ? "#" + subasset : "");
+                    }
+                    else
+                        newValues << value;
+                }
+
+                if (!newValues.isEmpty())
+                {
+                    QString newValue = newValues.join(";");
+                    if (adIt.value().value != newValue)
+                    {
+                        for(size_t i = 0; i < assets.size(); ++i)
+                        {
+                            if (newValue == assets[i].pathRelative)
+                            {
+                                newValue = assets[i].desc.destinationName;
+                                break;
+                            }
+                        }
+                        adIt.value().value = newValue;
+                    }
+                }
+            }
+        }
+    }
+}
+
+QByteArray RocketStorageImportAnalyzer::HashComponents(QStringList components)
+{
+    components.sort();
+    return QCryptographicHash::hash(components.join("\n").toUtf8(), QCryptographicHash::Sha1);
+}
+
+QByteArray RocketStorageImportAnalyzer::EntityHash(const EntityDesc &entity, const ImportEntityIdMap &fileToScene)
+{
+    QStringList components;
+    foreach(const ComponentDesc &component, entity.components)
+    {
+        const bool isPlaceable = (component.typeName == "EC_Placeable");
+        QStringList attributes;
+        foreach(const AttributeDesc &attribute, component.attributes)
+        {
+            const QString id = (!attribute.id.isEmpty() ? attribute.id : attribute.name);
+            QString value = attribute.value;
+            if (isPlaceable && id == "parentRef")
+            {
+                // File ids are not scene ids.
+                ImportEntityIdMap::const_iterator parent = fileToScene.find(value.trimmed());
+                if (parent != fileToScene.end())
+                    value = QString::number(parent.value());
+            }
+            attributes << id + "=" + value;
+        }
+        attributes.sort();
+        components << component.typeName + "|" + component.name + "\n" + attributes.join("\n");
+    }
+    return HashComponents(components);
+}
+
+QByteArray RocketStorageImportAnalyzer::EntityHash(Entity *entity)
+{
+    return HashComponents(ComponentStrings(entity));
+}
+
+QStringList RocketStorageImportAnalyzer::ComponentStrings(Entity *entity)
+{
+    QStringList components;
+    if (!entity)
+        return components;
+
+    const Entity::ComponentMap &componentMap = entity->Components();
+    for(Entity::ComponentMap::const_iterator iter = componentMap.begin(); iter != componentMap.end(); ++iter)
+    {
+        IComponent *component = iter->second.get();
+        if (!component)
+            continue;
+        QStringList attributes;
+        const AttributeVector &attributeVector = component->Attributes();
+        for(size_t i = 0; i < attributeVector.size(); ++i)
+            if (attributeVector[i])
+                attributes << attributeVector[i]->Id() + "=" + attributeVector[i]->ToString();
+        attributes.sort();
+        components << IComponent::EnsureTypeNameWithPrefix(component->TypeName()) + "|" + component->Name() + "\n" + attributes.join("\n");
+    }
+    return components;
+}
+
+/// @endcond
@@ -0,0 +1,203 @@
+/**
+    @author Adminotech Ltd.
+
+    Copyright Adminotech Ltd.
+    All rights reserved.
+
+    @file   RocketStorageImportAnalyzer.h
+    @brief  Background scene file import analysis and diffing against the scene and storage. */
+
+#pragma once
+
+#include "RocketFwd.h"
+#include "FrameworkFwd.h"
+#include "SceneFwd.h"
+#include "CoreTypes.h"
+
+#include "RocketStorageSceneImporter.h"
+
+#include <QThread>
+#include <QString>
+#include <QStringList>
+#include <QHash>
+#include <QSet>
+#include <QList>
+#include <QFileInfo>
+
+/// @cond PRIVATE
+
+/// Attribute types of the component types used by an imported file, captured on the main thread.
+/** Scene files do not store the types of static attributes. Capturing them once per component type
+    that appears in the file replaces creating a throwaway component for every component in the file. */
+struct RocketStorageImportTypeInfo
+{
+    struct Attribute
+    {
+        QString id;
+        QString name;
+        QString typeName;
+    };
+
+    /// Component type name with prefix to its static attributes.
+    QHash<QString, QList<Attribute> > attributes;
+
+    /// Component type id to type name with prefix.
+    QHash<u32, QString> typeNames;
+
+    /// Returns attribute @c idOrName of @c componentTypeName, null if not known.
+    const Attribute *FindAttribute(const QString &componentTypeName, const QString &idOrName) const;
+
+    /// Creates one prototype of each of @c typeNames and @c typeIds.
+    static RocketStorageImportTypeInfo Capture(Framework *framework, const QSet<QString> &typeNames, const QSet<u32> &typeIds);
+};
+
+/// Existing scene entities and storage files.
+/** Names, ids and attribute strings are captured on the main thread, hashing and ownership are resolved by Index in the analysis thread. */
+struct RocketStorageImportSceneIndex
+{
+    struct Entry
+    {
+        entity_id_t id;
+        QStringList components; ///< RocketStorageImportAnalyzer::ComponentStrings of the entity, cleared by Index.
+        QStringList assetRefs;  ///< Values of the asset reference attributes, cleared by Index.
+        QByteArray hash;        ///< RocketStorageImportAnalyzer::EntityHash of the entity.
+        bool ownedByPrefix;     ///< Has local asset references and all of them point inside the import destination folder.
+
+        Entry() : id(0), ownedByPrefix(false) {}
+    };
+
+    /// Entity name to the entities with that name in id order.
+    /** Imported entities that share a name are matched to these in file order. */
+    QHash<QString, QList<Entry> > entities;
+
+    /// Storage file size by asset reference relative to the storage root.
+    QHash<QString, qint64> storageFiles;
+
+    static RocketStorageImportSceneIndex Capture(Scene *scene, MeshmoonStorageItemWidget *storageRoot);
+
+    /// Hashes the captured entities and resolves their ownership, safe to call outside the main thread.
+    void Index(const QString &destinationPrefix);
+};
+
+/// Result of RocketStorageImportAnalyzer.
+struct RocketStorageImportAnalysis
+{
+    /// Parsed scene with asset references rewritten to the destination folder.
+    SceneDesc sceneDesc;
+
+    /// Imported entities and removed scene entities.
+    ImportEntityItemList entities;
+
+    /// Referenced assets and material textures.
+    ImportAssetItemList assets;
+
+    /// Error that prevents the import, empty on success.
+    QString error;
+
+    /// Parse, diff and hash times.
+    qint64 parseMsecs;
+    qint64 diffMsecs;
+    qint64 hashMsecs;
+
+    RocketStorageImportAnalysis() : parseMsecs(0), diffMsecs(0), hashMsecs(0) {}
+
+    int EntityCount(RocketStorageImportState state) const;
+    int AssetCount(RocketStorageImportState state) const;
+
+    /// One line summary of the diff.
+    QString Summary() const;
+};
+
+/// Parses a scene file and diffs it against the active scene and storage in a background thread.
+/** Entities are matched by name, in order when several share a name, and compared by a hash of their components and attribute values.
+    Assets are compared by size to the storage file, and by SHA-1 to the locally cached copy of it when
+    the sizes match. Scene entities are reported removed when they are missing from the file and all of their
+    local asset references point inside the destination folder. Deletes itself after Completed has been emitted. */
+class RocketStorageImportAnalyzer : public QThread
+{
+    Q_OBJECT
+
+public:
+    /// Captures the scene and storage state, call in the main thread.
+    /** @param destinationPrefix Destination folder relative to the storage root, empty or ends with '/'. */
+    RocketStorageImportAnalyzer(Framework *framework, Scene *scene, MeshmoonStorageItemWidget *storageRoot,
+                                const QString &filePath, const QString &destinationPrefix);
+    ~RocketStorageImportAnalyzer();
+
+    /// Starts the analysis.
+    void Start();
+
+    const QString &FilePath() const { return filePath_; }
+    const QString &DestinationPrefix() const { return destinationPrefix_; }
+
+    /// Valid after Completed.
+    const RocketStorageImportAnalysis &Result() const { return result_; }
+
+    /// Parses a scene XML document to @c sceneDesc.
+    /** Types of static attributes and of components stored by type id only are left empty, see ResolveTypes. */
+    static bool ParseSceneXml(const QByteArray &data, SceneDesc &sceneDesc, QString *error = 0);
+
+    /// Fills in the component and static attribute types of @c sceneDesc from @c types.
+    static void ResolveTypes(SceneDesc &sceneDesc, const RocketStorageImportTypeInfo &types);
+
+    /// Returns absolute paths of the textures referenced by @c materialFile.
+    static QStringList ParseTextures(const QFileInfo &materialFile);
+
+    /// Rewrites local asset references to be relative to the storage root with @c destinationPrefix.
+    static void RewriteAssetRefs(SceneDesc &sceneDesc, const QString &destinationPrefix, const ImportAssetItemList &assets);
+
+    /// Returns SHA-1 of the components and attribute values, independent of component and attribute order.
+    /** EC_Placeable::parentRef is mapped through @c fileToScene, so that it compares equal to the scene entity's parent id. */
+    static QByteArray EntityHash(const EntityDesc &entity, const ImportEntityIdMap &fileToScene);
+    static QByteArray EntityHash(Entity *entity);
+
+    /// Returns type, name and sorted attribute values of each component of @c entity, hashed by EntityHash.
+    static QStringList ComponentStrings(Entity *entity);
+
+    /// Returns SHA-1 of @c components, independent of their order.
+    static QByteArray HashComponents(QStringList components);
+
+signals:
+    /// Emitted in the main thread when the analysis is done, check RocketStorageImportAnalysis::error.
+    void Completed(RocketStorageImportAnalyzer *analyzer);
+
+protected:
+    /// QThread override.
+    void run();
+
+private slots:
+    void OnThreadFinished();
+
+private:
+    enum Phase
+    {
+        ParsePhase = 0,
+        AnalyzePhase,
+        CacheHashPhase,
+        DonePhase
+    };
+
+    void Parse();
+    void Analyze();
+    void CollectAssets(const QString &txmlFolder);
+    void DiffEntities();
+    void HashCachedCopies();
+
+    Framework *framework_;
+    const QString LC;
+    QString filePath_;
+    QString destinationPrefix_;
+    RocketStorageImportTypeInfo types_;
+    RocketStorageImportSceneIndex index_;
+    RocketStorageImportAnalysis result_;
+    Phase phase_;
+
+    /// Component types used by the file, captured to types_ after ParsePhase.
+    QSet<QString> usedTypeNames_;
+    QSet<u32> usedTypeIds_;
+
+    /// Asset index to cached copy path, hashed in CacheHashPhase.
+    QHash<int, QString> cachedCopies_;
+};
+
+/// @endcond
@@ -16,8 +16,6 @@
 #include "RocketNotifications.h"
 
 #include "Framework.h"
-#include "IAttribute.h"
-#include "AssetAPI.h"
 #include "UiAPI.h"
 #include "UiMainWindow.h"
 
@@ -25,14 +23,25 @@
 
 // Item comparing
 
+static int ImportStateRank(RocketStorageImportState state)
+{
+    switch(state)
+    {
+        case ImportNew: return 0;
+        case ImportChanged: return 1;
+        case ImportRemoved: return 2;
+        default: return 3;
+    }
+}
+
 static bool ImportEntityItemCompare(const RocketStorageImportEntityItem &e1, const RocketStorageImportEntityItem &e2)
 {
-    return (!e1.existsScene && e2.existsScene);
+    return ImportStateRank(e1.state) < ImportStateRank(e2.state);
 }
 
 static bool ImportAssetItemCompare(const RocketStorageImportAssetItem &a1, const RocketStorageImportAssetItem &a2)
 {
-    return (a1.existsDisk && a2.existsDisk) ? (!a1.existsStorage && a2.existsStorage) : (a1.existsDisk && !a2.existsDisk);
+    return (a1.existsDisk && a2.existsDisk) ? (ImportStateRank(a1.state) < ImportStateRank(a2.state)) : (a1.existsDisk && !a2.existsDisk);
 }
 
 // RocketStorageSceneImporter
@@ -67,79 +76,14 @@ RocketStorageSceneImporter::RocketStorageSceneImporter(QWidget *parent, RocketPl
     ui.assets->setVisible(false);
     ui.entities->setVisible(false);
 
-    // Rewrite all asset refs to be relative "file.extension" from "local://file.extension" etc.
-    QMutableListIterator<EntityDesc> edIt(sceneDesc.entities);
-    while(edIt.hasNext())
-    {
-        QMutableListIterator<ComponentDesc> cdIt(edIt.next().components);
-        while(cdIt.hasNext())
-        {
-            QMutableListIterator<AttributeDesc> adIt(cdIt.next().attributes);
-            while(adIt.hasNext())
-            {
-                adIt.next();
-                if ((adIt.value().typeName.compare(cAttributeAssetReferenceTypeName, Qt::CaseInsensitive) == 0) ||
-                    (adIt.value().typeName.compare(cAttributeAssetReferenceListTypeName, Qt::CaseInsensitive) == 0))
-                {
-                    QString trimmed = adIt.value().value.trimmed();
-                    if (trimmed.isEmpty() || trimmed == "RexSkyBox")
-                        continue;
-
-                    QStringList newValues;
-                    QStringList valueParts = adIt.value().value.split(";", QString::KeepEmptyParts);
-                    for(int i=0; i<valueParts.size(); ++i)
-                    {
-                        QString &value = valueParts[i];
-                        if (value.trimmed().isEmpty())
-                            newValues << "";
-                        else
-                        {
-                            // Leave http refs alone
-                            if (!value.startsWith("http://") && !value.startsWith("https://"))
-                            {
-                                QString filename, subasset;
-                                AssetAPI::ParseAssetRef(value, 0, 0, 0, 0, 0, 0, &filename, &subasset);
-                                newValues << destinationPrefix_ + filename + (!subasset.isEmpty() ? "#" + subasset : "");
-                            }
-                            else
-                            {
-                                LogDebug("Found web ref, leaving alone: " + value);
-                                newValues << value;
-                            }
-                           
-                        }
-                    }
-
-                    if (!newValues.isEmpty())
-                    {
-                        QString newValue = newValues.join(";");
-                        if (adIt.value().value != newValue)
-                        {
-                            foreach(const RocketStorageImportAssetItem &item, assets)
-                            {
-                                if (newValue == item.pathRelative)
-                                {
-                                    newValue = item.desc.destinationName;
-                                    break;
-                                }
-                            }
-
-                            //LogInfo("[RocketSceneImporter]: Rewriting asset reference from " + adIt.value().value + " to " + newValue);
-                            adIt.value().value = newValue;
-                        }
-                    }
-                }
-            }
-        }
-    }
-
     QString checkBoxStyle = "padding: 0px; padding-left: 45px; min-width: 40px;";
     QString labelStyle = "padding: 0px; padding-left: 0px; padding-right: 10px;";
     QString colorYellow = "background-color: rgb(248, 248, 0);";
     QString colorRed = "background-color: rgb(225,0,0); color: white;";
+    QString colorGray = "color: rgb(150,150,150);";
 
-    std::sort(entities.begin(), entities.end(), ImportEntityItemCompare);
-    std::sort(assets.begin(), assets.end(), ImportAssetItemCompare);
+    std::stable_sort(entities.begin(), entities.end(), ImportEntityItemCompare);
+    std::stable_sort(assets.begin(), assets.end(), ImportAssetItemCompare);
 
     // Entities
     int row = 0;
@@ -157,18 +101,28 @@ RocketStorageSceneImporter::RocketStorageSceneImporter(QWidget *parent, RocketPl
         
         ui.entities->insertRow(ui.entities->rowCount());
         
-        if (!warnRocketEnvironment && e.desc.name.compare(envEntityName, Qt::CaseSensitive) == 0 && e.existsScene)
+        // Auto deselect a changed environment, creating a second one can break it.
+        if (!warnRocketEnvironment && e.desc.name.compare(envEntityName, Qt::CaseSensitive) == 0 && e.state == ImportChanged)
             warnRocketEnvironment = true;
-        
+
+        QString color = (e.state == ImportChanged ? colorYellow : (e.state == ImportRemoved ? colorRed : (e.state == ImportUnchanged ? colorGray : "")));
+        bool checked = (e.state == ImportNew || (e.state == ImportChanged && e.desc.name.compare(envEntityName, Qt::CaseSensitive) != 0));
+
         QCheckBox *create = new QCheckBox(); 
-        create->setChecked(!e.existsScene);
-        create->setStyleSheet(!e.existsScene ? checkBoxStyle : checkBoxStyle + colorYellow);
+        create->setChecked(checked);
+        create->setStyleSheet(checkBoxStyle + color);
+        create->setToolTip(e.state == ImportRemoved ? "Remove from the scene" : (e.existsScene ? "Update the existing entity" : "Create"));
         connect(create, SIGNAL(clicked()), SLOT(UpdateActionButton()), Qt::QueuedConnection);
-        if (e.existsScene)
+        if (!checked)
             allChecked = false;
         
-        QLabel *name = new QLabel(e.desc.name.trimmed().isEmpty() ? "(no name)" : e.desc.name);
-        name->setStyleSheet(!e.existsScene ? labelStyle : labelStyle + colorYellow);
+        QString text = (e.desc.name.trimmed().isEmpty() ? "(no name)" : e.desc.name);
+        if (e.state == ImportRemoved)
+            text += " (removed)";
+        else if (e.state == ImportUnchanged)
+            text += " (unchanged)";
+        QLabel *name = new QLabel(text);
+        name->setStyleSheet(labelStyle + color);
         
         ui.entities->setCellWidget(row, 0, create);
         ui.entities->setCellWidget(row, 1, name);
@@ -193,21 +147,24 @@ RocketStorageSceneImporter::RocketStorageSceneImporter(QWidget *parent, RocketPl
         
         ui.assets->insertRow(ui.assets->rowCount());
         
+        QString color = (a.existsDisk ? (a.state == ImportChanged ? colorYellow : (a.state == ImportUnchanged ? colorGray : "")) : colorRed);
+        bool checked = (a.existsDisk && a.state != ImportUnchanged);
+
         QCheckBox *upload = new QCheckBox(); 
-        upload->setChecked(a.existsDisk);
+        upload->setChecked(checked);
         upload->setEnabled(a.existsDisk);
-        upload->setStyleSheet(a.existsDisk ? (!a.existsStorage ? checkBoxStyle : checkBoxStyle + colorYellow) : checkBoxStyle + colorRed);
+        upload->setStyleSheet(checkBoxStyle + color);
         upload->setProperty("existsDisk", a.existsDisk);
         upload->setProperty("existsStorage", a.existsStorage);
         connect(upload, SIGNAL(clicked()), SLOT(UpdateActionButton()), Qt::QueuedConnection);
-        if (!a.existsDisk)
+        if (!checked)
             allChecked = false;
             
         QLabel *source = new QLabel(a.pathRelative);
-        source->setStyleSheet(a.existsDisk ? (!a.existsStorage ? labelStyle : labelStyle + colorYellow) : labelStyle + colorRed);
+        source->setStyleSheet(labelStyle + color);
         
         QLabel *dest = new QLabel(a.existsDisk ? a.desc.destinationName : "");
-        dest->setStyleSheet(a.existsDisk ? (!a.existsStorage ? labelStyle : labelStyle + colorYellow) : labelStyle + colorRed);
+        dest->setStyleSheet(labelStyle + color);
         
         ui.assets->setCellWidget(row, 0, upload);
         ui.assets->setCellWidget(row, 1, source);
@@ -250,7 +207,7 @@ RocketStorageSceneImporter::RocketStorageSceneImporter(QWidget *parent, RocketPl
     if (warnRocketEnvironment)
     {
         plugin_->Notifications()->ShowSplashDialog(
-            QString("%1 is already in the space. Creating multiple can break the environment. \
+            QString("%1 is already in the space and differs from the imported one. Creating multiple can break the environment. \
                      Your imports %1 has been auto deselected.<br><br>If you wish you can enable \
                      it and merge the two Entities manually after import completes.").arg(envEntityName),
                      QPixmap(":images/icon-sky.png"), QMessageBox::Ok, QMessageBox::Ok, this);    
@@ -297,24 +254,38 @@ void RocketStorageSceneImporter::OnAssetWidgetClicked(int row, int column)
 
 void RocketStorageSceneImporter::OnUploadClicked()
 {
-    // Entities
+    // Entities without an id in the file get one past the largest id, so that matched ones can be told apart.
+    uint nextFileId = 1;
+    for(int i=0; i<sceneDesc.entities.size(); ++i)
+        nextFileId = qMax(nextFileId, sceneDesc.entities[i].id.toUInt() + 1);
+    for(int i=0; i<sceneDesc.entities.size(); ++i)
+        if (sceneDesc.entities[i].id.trimmed().isEmpty())
+            sceneDesc.entities[i].id = QString::number(nextFileId++);
+
+    // Entities. Checked entities that exist in the scene are updated in place, checked removed entities are removed.
+    // All matched entities are passed on so that parent references to them can be resolved.
+    QList<EntityDesc> createEntities;
+    QList<entity_id_t> removeEntities;
+    ImportEntityIdMap existingEntities;
+    std::vector<bool> create(sceneDesc.entities.size(), false);
     foreach(const RocketStorageImportEntityItem &e, entities)
     {
+        const bool inFile = (e.index >= 0 && e.index < sceneDesc.entities.size());
+        if (inFile && e.existingId != 0)
+            existingEntities[sceneDesc.entities[e.index].id] = e.existingId;
+
         QCheckBox *createCheckBox = qobject_cast<QCheckBox*>(ui.entities->cellWidget(e.row, 0));
-        bool create = createCheckBox != 0 ? createCheckBox->isChecked() : false;
-        if (!create)
-        {
-            for(int k=0; k<sceneDesc.entities.size(); ++k)
-            {
-                EntityDesc &existing = sceneDesc.entities[k];
-                if (e.desc == existing)
-                {
-                    sceneDesc.entities.removeAt(k);
-                    break;
-                }
-            }
-        }
+        if (!createCheckBox || !createCheckBox->isChecked())
+            continue;
+        if (inFile)
+            create[e.index] = true;
+        else if (e.state == ImportRemoved && e.existingId != 0)
+            removeEntities << e.existingId;
     }
+    for(int i=0; i<sceneDesc.entities.size(); ++i)
+        if (create[i])
+            createEntities << sceneDesc.entities[i];
+    sceneDesc.entities = createEntities;
     sceneDesc.assets.clear();
     
     QStringList uploadFilenames;
@@ -326,10 +297,10 @@ void RocketStorageSceneImporter::OnUploadClicked()
             uploadFilenames << a.pathAbsolute;
     }
     
-    if (uploadFilenames.isEmpty() && sceneDesc.entities.isEmpty())
+    if (uploadFilenames.isEmpty() && sceneDesc.entities.isEmpty() && removeEntities.isEmpty())
         return;
 
-    emit ImportScene(uploadFilenames, sceneDesc);
+    emit ImportScene(uploadFilenames, sceneDesc, removeEntities, existingEntities);
     close();
 }
 
@@ -11,6 +11,7 @@
 
 #include "RocketFwd.h"
 #include "SceneDesc.h"
+#include "CoreTypes.h"
 
 #include <QDialog>
 
@@ -18,12 +19,27 @@
 
 /// @cond PRIVATE
 
+/// Import diff state of an entity or asset, see RocketStorageImportAnalyzer.
+enum RocketStorageImportState
+{
+    ImportNew = 0,      ///< Does not exist in the scene or storage.
+    ImportChanged,      ///< Exists with different content.
+    ImportUnchanged,    ///< Exists with identical content.
+    ImportRemoved       ///< Exists in the scene but not in the imported file.
+};
+
 struct RocketStorageImportEntityItem
 {
     int row;
+    int index;                  ///< Index in the imported scene description, -1 for removed entities.
     bool existsScene;
+    RocketStorageImportState state;
+    entity_id_t existingId;     ///< Scene entity with the same name, 0 if none.
+    QByteArray contentHash;
 
     EntityDesc desc;
+
+    RocketStorageImportEntityItem() : row(-1), index(-1), existsScene(false), state(ImportNew), existingId(0) {}
 };
 typedef std::vector<RocketStorageImportEntityItem> ImportEntityItemList;
 
@@ -34,8 +50,13 @@ struct RocketStorageImportAssetItem
     QString pathRelative;
     bool existsStorage;
     bool existsDisk;
+    RocketStorageImportState state;
+    QByteArray contentHash;     ///< SHA-1 of the disk source.
+    qint64 size;
 
     AssetDesc desc;
+
+    RocketStorageImportAssetItem() : row(-1), existsStorage(false), existsDisk(false), state(ImportNew), size(0) {}
 };
 typedef std::vector<RocketStorageImportAssetItem> ImportAssetItemList;
 
@@ -59,7 +80,10 @@ public:
     Ui::RocketStorageSceneImportWidget ui;
 
 signals:
-    void ImportScene(const QStringList &uploadFiles, const SceneDesc &sceneDesc);
+    /// @param removeEntities Existing entities that were removed from the imported file.
+    /// @param existingEntities Matched scene entities by file entity id. Entities of @c sceneDesc found here
+    ///        are updated in place, the rest are created.
+    void ImportScene(const QStringList &uploadFiles, const SceneDesc &sceneDesc, const QList<entity_id_t> &removeEntities, const ImportEntityIdMap &existingEntities);
 
 private slots:
     void OnUploadClicked();
@@ -0,0 +1,846 @@
+/**
+    @author Adminotech Ltd.
+
+    Copyright Adminotech Ltd.
+    All rights reserved.
+
+    @file   RocketTextureDecoder.cpp
+    @brief  In-process DDS and CRN texture decoding for previews. */
+
+#include "StableHeaders.h"
+#include "DebugOperatorNew.h"
+
+#include "RocketTextureDecoder.h"
+#include "RocketFileSystem.h"
+
+#include "LoggingFunctions.h"
+
+#include <QMutexLocker>
+#include <QCryptographicHash>
+#include <QElapsedTimer>
+#include <QDirIterator>
+#include <QFileInfo>
+#include <QFile>
+#include <QDir>
+#include <QProcess>
+#include <QMap>
+
+#include <algorithm>
+#include <cmath>
+
+#ifdef ROCKET_CRUNCH_DECOMP
+#include <crn_decomp.h>
+#endif
+
+#include "MemoryLeakCheck.h"
+
+/// @cond PRIVATE
+
+namespace
+{
+    // DDS header flags, see DDS_HEADER and DDS_PIXELFORMAT.
+    const uint DDSD_MIPMAPCOUNT     = 0x20000;
+    const uint DDPF_ALPHAPIXELS     = 0x1;
+    const uint DDPF_ALPHA           = 0x2;
+    const uint DDPF_FOURCC          = 0x4;
+    const uint DDPF_RGB             = 0x40;
+    const uint DDPF_LUMINANCE       = 0x20000;
+    const uint DDSCAPS2_CUBEMAP     = 0x200;
+    const uint DDSCAPS2_CUBEMAP_ALL = 0xFC00;
+    const uint DDSCAPS2_VOLUME      = 0x200000;
+
+    const int DDSHeaderSize = 128;      ///< Magic and DDS_HEADER.
+    const int DX10HeaderSize = 20;      ///< DDS_HEADER_DXT10.
+    const int CRNHeaderMinSize = 21;    ///< crn_header up to m_flags.
+
+    inline uint FourCC(char a, char b, char c, char d)
+    {
+        return static_cast<uint>(static_cast<uchar>(a)) | (static_cast<uint>(static_cast<uchar>(b)) << 8) |
+            (static_cast<uint>(static_cast<uchar>(c)) << 16) | (static_cast<uint>(static_cast<uchar>(d)) << 24);
+    }
+
+    inline uint ReadU32(const uchar *p)
+    {
+        return static_cast<uint>(p[0]) | (static_cast<uint>(p[1]) << 8) | (static_cast<uint>(p[2]) << 16) | (static_cast<uint>(p[3]) << 24);
+    }
+
+    /// CRN header fields are big endian.
+    inline uint ReadBigEndian(const uchar *p, int bytes)
+    {
+        uint value = 0;
+        for(int i = 0; i < bytes; ++i)
+            value = (value << 8) | p[i];
+        return value;
+    }
+
+    inline int BlockBytes(RocketTextureDecoder::Format format)
+    {
+        return (format == RocketTextureDecoder::BC1 || format == RocketTextureDecoder::BC4 ? 8 : 16);
+    }
+
+    inline bool IsBlockCompressed(RocketTextureDecoder::Format format)
+    {
+        return (format >= RocketTextureDecoder::BC1 && format <= RocketTextureDecoder::BC5);
+    }
+
+    /// Size of one level of one face in bytes.
+    int LevelBytes(const RocketTextureDecoder::Info &info, int width, int height)
+    {
+        if (IsBlockCompressed(info.format))
+            return std::max(1, (width + 3) / 4) * std::max(1, (height + 3) / 4) * BlockBytes(info.format);
+        return ((width * static_cast<int>(info.bitCount) + 7) / 8) * height;
+    }
+
+    inline uint Rgb565(quint16 c)
+    {
+        const uint r = (c >> 11) & 31, g = (c >> 5) & 63, b = c & 31;
+        return 0xff000000 | (((r << 3) | (r >> 2)) << 16) | (((g << 2) | (g >> 4)) << 8) | ((b << 3) | (b >> 2));
+    }
+
+    inline uint Mix(uint c0, uint c1, uint w0, uint w1, uint div)
+    {
+        uint out = 0xff000000;
+        for(int shift = 0; shift < 24; shift += 8)
+            out |= ((((c0 >> shift) & 0xff) * w0 + ((c1 >> shift) & 0xff) * w1) / div) << shift;
+        return out;
+    }
+
+    /// Decodes a BC1 color block. @c punchThrough enables the three color mode with transparent black, BC1 only.
+    void DecodeColorBlock(const uchar *block, bool punchThrough, uint out[16])
+    {
+        const quint16 c0 = static_cast<quint16>(block[0] | (block[1] << 8));
+        const quint16 c1 = static_cast<quint16>(block[2] | (block[3] << 8));
+        uint colors[4];
+        colors[0] = Rgb565(c0);
+        colors[1] = Rgb565(c1);
+        if (c0 > c1 || !punchThrough)
+        {
+            colors[2] = Mix(colors[0], colors[1], 2, 1, 3);
+            colors[3] = Mix(colors[0], colors[1], 1, 2, 3);
+        }
+        else
+        {
+            colors[2] = Mix(colors[0], colors[1], 1, 1, 2);
+            colors[3] = 0;
+        }
+        const uint indices = ReadU32(block + 4);
+        for(int i = 0; i < 16; ++i)
+            out[i] = colors[(indices >> (i * 2)) & 3];
+    }
+
+    /// Decodes a BC3 alpha or BC4/BC5 channel block into [0,255].
+    void DecodeChannelBlock(const uchar *block, bool isSigned, uchar out[16])
+    {
+        int values[8];
+        int a0, a1, minValue, maxValue;
+        if (isSigned)
+        {
+            a0 = std::max(-127, static_cast<int>(static_cast<signed char>(block[0])));
+            a1 = std::max(-127, static_cast<int>(static_cast<signed char>(block[1])));
+            minValue = -127;
+            maxValue = 127;
+        }
+        else
+        {
+            a0 = block[0];
+            a1 = block[1];
+            minValue = 0;
+            maxValue = 255;
+        }
+        values[0] = a0;
+        values[1] = a1;
+        if (a0 > a1)
+        {
+            for(int i = 1; i < 7; ++i)
+                values[i + 1] = ((7 - i) * a0 + i * a1) / 7;
+        }
+        else
+        {
+            for(int i = 1; i < 5; ++i)
+                values[i + 1] = ((5 - i) * a0 + i * a1) / 5;
+            values[6] = minValue;
+            values[7] = maxValue;
+        }
+
+        quint64 indices = 0;
+        for(int i = 0; i < 6; ++i)
+            indices |= static_cast<quint64>(block[2 + i]) << (8 * i);
+        for(int i = 0; i < 16; ++i)
+        {
+            const int value = values[(indices >> (3 * i)) & 7];
+            out[i] = static_cast<uchar>(isSigned ? ((value + 127) * 255) / 254 : value);
+        }
+    }
+
+    /// Decodes block compressed @c src into ARGB32 @c dst.
+    void DecodeBlocks(const uchar *src, RocketTextureDecoder::Format format, bool isSigned, int width, int height, uint *dst, int dstStride)
+    {
+        const int blocksX = std::max(1, (width + 3) / 4);
+        const int blocksY = std::max(1, (height + 3) / 4);
+        const int blockBytes = BlockBytes(format);
+
+        uint pixels[16];
+        uchar channel[16], channel2[16];
+        for(int by = 0; by < blocksY; ++by)
+        {
+            for(int bx = 0; bx < blocksX; ++bx, src += blockBytes)
+            {
+                switch(format)
+                {
+                case RocketTextureDecoder::BC1:
+                    DecodeColorBlock(src, true, pixels);
+                    break;
+                case RocketTextureDecoder::BC2:
+                    DecodeColorBlock(src + 8, false, pixels);
+                    for(int i = 0; i < 16; ++i)
+                    {
+                        const uint alpha = (src[i / 2] >> ((i & 1) * 4)) & 0xf;
+                        pixels[i] = (pixels[i] & 0x00ffffff) | ((alpha * 17) << 24);
+                    }
+                    break;
+                case RocketTextureDecoder::BC3:
+                    DecodeColorBlock(src + 8, false, pixels);
+                    DecodeChannelBlock(src, false, channel);
+                    for(int i = 0; i < 16; ++i)
+                        pixels[i] = (pixels[i] & 0x00ffffff) | (static_cast<uint>(channel[i]) << 24);
+                    break;
+                case RocketTextureDecoder::BC4:
+                    DecodeChannelBlock(src, isSigned, channel);
+                    for(int i = 0; i < 16; ++i)
+                        pixels[i] = 0xff000000 | (channel[i] << 16) | (channel[i] << 8) | channel[i];
+                    break;
+                case RocketTextureDecoder::BC5:
+                {
+                    // Two channel normal maps, reconstruct Z into blue.
+                    DecodeChannelBlock(src, isSigned, channel);
+                    DecodeChannelBlock(src + 8, isSigned, channel2);
+                    for(int i = 0; i < 16; ++i)
+                    {
+                        const float x = channel[i] / 127.5f - 1.f, y = channel2[i] / 127.5f - 1.f;
+                        const float z = std::sqrt(std::max(0.f, 1.f - x * x - y * y));
+                        const uint blue = static_cast<uint>((z * 0.5f + 0.5f) * 255.f + 0.5f);
+                        pixels[i] = 0xff000000 | (channel[i] << 16) | (channel2[i] << 8) | std::min(blue, 255u);
+                    }
+                    break;
+                }
+                default:
+                    return;
+                }
+
+                for(int y = 0; y < 4 && by * 4 + y < height; ++y)
+                {
+                    uint *line = dst + (by * 4 + y) * dstStride + bx * 4;
+                    for(int x = 0; x < 4 && bx * 4 + x < width; ++x)
+                        line[x] = pixels[y * 4 + x];
+                }
+            }
+        }
+    }
+
+    inline uint ClampByte(int value)
+    {
+        return static_cast<uint>(std::min(255, std::max(0, value)));
+    }
+
+    /// Restores RGBA channel order of a decoded swizzled CRN image.
+    void Unswizzle(RocketTextureDecoder::Swizzle swizzle, int width, int height, uint *dst, int dstStride)
+    {
+        if (swizzle == RocketTextureDecoder::NoSwizzle)
+            return;
+
+        for(int y = 0; y < height; ++y)
+        {
+            uint *line = dst + y * dstStride;
+            for(int x = 0; x < width; ++x)
+            {
+                const uint p = line[x];
+                const int a = (p >> 24) & 0xff, r = (p >> 16) & 0xff, g = (p >> 8) & 0xff, b = p & 0xff;
+                switch(swizzle)
+                {
+                case RocketTextureDecoder::SwizzleCCxY:
+                {
+                    const int co = r - 128, cg = g - 128;
+                    line[x] = 0xff000000 | (ClampByte(a + co - cg) << 16) | (ClampByte(a + cg) << 8) | ClampByte(a - co - cg);
+                    break;
+                }
+                case RocketTextureDecoder::SwizzleXGXR:
+                {
+                    const float nx = a / 127.5f - 1.f, ny = g / 127.5f - 1.f;
+                    const float nz = std::sqrt(std::max(0.f, 1.f - nx * nx - ny * ny));
+                    line[x] = 0xff000000 | (static_cast<uint>(a) << 16) | (static_cast<uint>(g) << 8) | ClampByte(static_cast<int>((nz * 0.5f + 0.5f) * 255.f + 0.5f));
+                    break;
+                }
+                case RocketTextureDecoder::SwizzleXGBR:
+                    line[x] = 0xff000000 | (static_cast<uint>(a) << 16) | (static_cast<uint>(g) << 8) | static_cast<uint>(b);
+                    break;
+                case RocketTextureDecoder::SwizzleAGBR:
+                    line[x] = (static_cast<uint>(r) << 24) | (static_cast<uint>(a) << 16) | (static_cast<uint>(g) << 8) | static_cast<uint>(b);
+                    break;
+                case RocketTextureDecoder::SwizzleYX:
+                    line[x] = (p & 0xff0000ff) | (static_cast<uint>(g) << 16) | (static_cast<uint>(r) << 8);
+                    break;
+                default:
+                    return;
+                }
+            }
+        }
+    }
+
+    struct ChannelMask
+    {
+        uint mask;
+        uint shift;
+        uint max;
+
+        explicit ChannelMask(uint mask_) : mask(mask_), shift(0), max(0)
+        {
+            if (!mask)
+                return;
+            while(!((mask >> shift) & 1))
+                ++shift;
+            max = mask >> shift;
+        }
+        uint Expand(uint pixel, uint fallback) const
+        {
+            return (max ? (((pixel & mask) >> shift) * 255 + max / 2) / max : fallback);
+        }
+    };
+
+    /// Decodes uncompressed @c src described by the bit masks of @c info into ARGB32 @c dst.
+    void DecodeUncompressed(const uchar *src, const RocketTextureDecoder::Info &info, int width, int height, uint *dst, int dstStride)
+    {
+        const ChannelMask r(info.masks[0]), g(info.masks[1]), b(info.masks[2]), a(info.masks[3]);
+        const int bytesPerPixel = static_cast<int>(info.bitCount / 8);
+        const int pitch = (width * static_cast<int>(info.bitCount) + 7) / 8;
+        for(int y = 0; y < height; ++y)
+        {
+            const uchar *p = src + y * pitch;
+            uint *line = dst + y * dstStride;
+            for(int x = 0; x < width; ++x, p += bytesPerPixel)
+            {
+                uint pixel = 0;
+                for(int i = 0; i < bytesPerPixel; ++i)
+                    pixel |= static_cast<uint>(p[i]) << (8 * i);
+                const uint red = r.Expand(pixel, 0);
+                const uint green = (info.luminance ? red : g.Expand(pixel, 0));
+                const uint blue = (info.luminance ? red : b.Expand(pixel, 0));
+                line[x] = (a.Expand(pixel, 255) << 24) | (red << 16) | (green << 8) | blue;
+            }
+        }
+    }
+
+    void SetMasks(RocketTextureDecoder::Info &info, uint bitCount, uint r, uint g, uint b, uint a)
+    {
+        info.format = RocketTextureDecoder::Uncompressed;
+        info.bitCount = bitCount;
+        info.masks[0] = r;
+        info.masks[1] = g;
+        info.masks[2] = b;
+        info.masks[3] = a;
+    }
+
+    bool ReadDDSInfo(const uchar *p, int size, RocketTextureDecoder::Info &info, QString &error)
+    {
+        info.container = "DDS";
+        if (size < DDSHeaderSize)
+        {
+            error = "DDS header is truncated";
+            return false;
+        }
+
+        const uint flags = ReadU32(p + 8);
+        info.height = static_cast<int>(ReadU32(p + 12));
+        info.width = static_cast<int>(ReadU32(p + 16));
+        info.mipmaps = (flags & DDSD_MIPMAPCOUNT) ? std::max(1, static_cast<int>(ReadU32(p + 28))) : 1;
+        info.dataOffset = DDSHeaderSize;
+
+        const uint caps2 = ReadU32(p + 112);
+        if (caps2 & DDSCAPS2_VOLUME)
+        {
+            error = "Volume textures are not supported";
+            return false;
+        }
+        if (caps2 & DDSCAPS2_CUBEMAP)
+        {
+            info.faces = 0;
+            for(uint bit = 0x400; bit & DDSCAPS2_CUBEMAP_ALL; bit <<= 1)
+                if (caps2 & bit)
+                    ++info.faces;
+            info.faces = std::max(info.faces, 1);
+        }
+
+        const uint pfFlags = ReadU32(p + 80);
+        const uint fourCC = ReadU32(p + 84);
+        const uint bitCount = ReadU32(p + 88);
+        if (pfFlags & DDPF_FOURCC)
+        {
+            if (fourCC == FourCC('D','X','T','1'))      { info.format = RocketTextureDecoder::BC1; info.formatName = "DXT1"; }
+            else if (fourCC == FourCC('D','X','T','2')) { info.format = RocketTextureDecoder::BC2; info.formatName = "DXT2"; }
+            else if (fourCC == FourCC('D','X','T','3')) { info.format = RocketTextureDecoder::BC2; info.formatName = "DXT3"; }
+            else if (fourCC == FourCC('D','X','T','4')) { info.format = RocketTextureDecoder::BC3; info.formatName = "DXT4"; }
+            else if (fourCC == FourCC('D','X','T','5')) { info.format = RocketTextureDecoder::BC3; info.formatName = "DXT5"; }
+            else if (fourCC == FourCC('A','T','I','1') || fourCC == FourCC('B','C','4','U')) { info.format = RocketTextureDecoder::BC4; info.formatName = "BC4"; }
+            else if (fourCC == FourCC('B','C','4','S')) { info.format = RocketTextureDecoder::BC4; info.signedFormat = true; info.formatName = "BC4 SNORM"; }
+            else if (fourCC == FourCC('A','T','I','2') || fourCC == FourCC('B','C','5','U')) { info.format = RocketTextureDecoder::BC5; info.formatName = "BC5"; }
+            else if (fourCC == FourCC('B','C','5','S')) { info.format = RocketTextureDecoder::BC5; info.signedFormat = true; info.formatName = "BC5 SNORM"; }
+            else if (fourCC == FourCC('D','X','1','0'))
+            {
+                if (size < DDSHeaderSize + DX10HeaderSize)
+                {
+                    error = "DDS DX10 header is truncated";
+                    return false;
+                }
+                info.dataOffset += DX10HeaderSize;
+                const uint dxgiFormat = ReadU32(p + DDSHeaderSize);
+                switch(dxgiFormat)
+                {
+                case 71: case 72: info.format = RocketTextureDecoder::BC1; info.formatName = "BC1"; break;
+                case 74: case 75: info.format = RocketTextureDecoder::BC2; info.formatName = "BC2"; break;
+                case 77: case 78: info.format = RocketTextureDecoder::BC3; info.formatName = "BC3"; break;
+                case 80: info.format = RocketTextureDecoder::BC4; info.formatName = "BC4"; break;
+                case 81: info.format = RocketTextureDecoder::BC4; info.signedFormat = true; info.formatName = "BC4 SNORM"; break;
+                case 83: info.format = RocketTextureDecoder::BC5; info.formatName = "BC5"; break;
+                case 84: info.format = RocketTextureDecoder::BC5; info.signedFormat = true; info.formatName = "BC5 SNORM"; break;
+                case 28: case 29: SetMasks(info, 32, 0xff, 0xff00, 0xff0000, 0xff000000); info.formatName = "R8G8B8A8"; break;
+                case 87: case 91: SetMasks(info, 32, 0xff0000, 0xff00, 0xff, 0xff000000); info.formatName = "B8G8R8A8"; break;
+                case 88: case 93: SetMasks(info, 32, 0xff0000, 0xff00, 0xff, 0); info.formatName = "B8G8R8X8"; break;
+                default:
+                    error = QString("Unsupported DXGI format %1").arg(dxgiFormat);
+                    return false;
+                }
+            }
+            else
+            {
+                error = "Unsupported DDS format " + QString::fromAscii(reinterpret_cast<const char*>(p + 84), 4);
+                return false;
+            }
+        }
+        else if ((pfFlags & (DDPF_RGB | DDPF_LUMINANCE | DDPF_ALPHA)) && (bitCount == 8 || bitCount == 16 || bitCount == 24 || bitCount == 32))
+        {
+            const uint alphaMask = (pfFlags & (DDPF_ALPHAPIXELS | DDPF_ALPHA)) ? ReadU32(p + 104) : 0;
+            SetMasks(info, bitCount, (pfFlags & DDPF_ALPHA) ? 0 : ReadU32(p + 92), ReadU32(p + 96), ReadU32(p + 100), alphaMask);
+            info.luminance = (pfFlags & DDPF_LUMINANCE) != 0;
+            if (info.luminance)
+                info.formatName = alphaMask ? QString("A%1L%1").arg(bitCount / 2) : QString("L%1").arg(bitCount);
+            else if (pfFlags & DDPF_ALPHA)
+                info.formatName = QString("A%1").arg(bitCount);
+            else
+                info.formatName = QString(alphaMask ? "ARGB %1 bit" : "RGB %1 bit").arg(bitCount);
+        }
+        else
+        {
+            error = "Unsupported DDS pixel format";
+            return false;
+        }
+        return true;
+    }
+
+    bool ReadCRNInfo(const uchar *p, int size, RocketTextureDecoder::Info &info, QString &error)
+    {
+        info.container = "CRN";
+        if (size < CRNHeaderMinSize || static_cast<int>(ReadBigEndian(p + 2, 2)) > size)
+        {
+            error = "CRN header is truncated";
+            return false;
+        }
+
+        info.width = static_cast<int>(ReadBigEndian(p + 12, 2));
+        info.height = static_cast<int>(ReadBigEndian(p + 14, 2));
+        info.mipmaps = std::max(1, static_cast<int>(p[16]));
+        info.faces = std::max(1, static_cast<int>(p[17]));
+
+        // crn_format
+        switch(p[18])
+        {
+        case 0: info.format = RocketTextureDecoder::BC1; info.formatName = "DXT1"; break;
+        case 1: info.format = RocketTextureDecoder::BC2; info.formatName = "DXT3"; break;
+        case 2: info.format = RocketTextureDecoder::BC3; info.formatName = "DXT5"; break;
+        case 3: info.format = RocketTextureDecoder::BC3; info.formatName = "DXT5 CCxY"; info.swizzle = RocketTextureDecoder::SwizzleCCxY; break;
+        case 4: info.format = RocketTextureDecoder::BC3; info.formatName = "DXT5 xGxR"; info.swizzle = RocketTextureDecoder::SwizzleXGXR; break;
+        case 5: info.format = RocketTextureDecoder::BC3; info.formatName = "DXT5 xGBR"; info.swizzle = RocketTextureDecoder::SwizzleXGBR; break;
+        case 6: info.format = RocketTextureDecoder::BC3; info.formatName = "DXT5 AGBR"; info.swizzle = RocketTextureDecoder::SwizzleAGBR; break;
+        case 7: info.format = RocketTextureDecoder::BC5; info.formatName = "DXN XY"; break;
+        case 8: info.format = RocketTextureDecoder::BC5; info.formatName = "DXN YX"; info.swizzle = RocketTextureDecoder::SwizzleYX; break;
+        case 9: info.format = RocketTextureDecoder::BC4; info.formatName = "DXT5A"; break;
+        default:
+            error = QString("Unsupported CRN format %1").arg(p[18]);
+            return false;
+        }
+        return true;
+    }
+
+    struct BenchmarkTotals
+    {
+        int files;
+        qint64 pixels;
+        qint64 nsecs;
+        qint64 crunchMsecs;
+        int crunchFiles;
+
+        BenchmarkTotals() : files(0), pixels(0), nsecs(0), crunchMsecs(0), crunchFiles(0) {}
+    };
+}
+
+RocketTextureDecoder::Info::Info() :
+    format(UnknownFormat),
+    signedFormat(false),
+    width(0),
+    height(0),
+    mipmaps(1),
+    faces(1),
+    dataOffset(0),
+    bitCount(0),
+    luminance(false),
+    swizzle(NoSwizzle)
+{
+    masks[0] = masks[1] = masks[2] = masks[3] = 0;
+}
+
+bool RocketTextureDecoder::IsSupportedSuffix(const QString &suffix)
+{
+    return (suffix.compare("dds", Qt::CaseInsensitive) == 0 || suffix.compare("crn", Qt::CaseInsensitive) == 0);
+}
+
+bool RocketTextureDecoder::ReadInfo(const QByteArray &data, Info &info, QString *error)
+{
+    info = Info();
+    QString err;
+    const uchar *p = reinterpret_cast<const uchar*>(data.constData());
+    bool ok = false;
+    if (data.size() >= 4 && ReadU32(p) == FourCC('D','D','S',' '))
+        ok = ReadDDSInfo(p, data.size(), info, err);
+    else if (data.size() >= 2 && p[0] == 'H' && p[1] == 'x')
+        ok = ReadCRNInfo(p, data.size(), info, err);
+    else
+        err = "Not a DDS or CRN texture";
+
+    if (ok && (info.width <= 0 || info.height <= 0 || info.width > 16384 || info.height > 16384))
+    {
+        err = QString("Invalid texture size %1x%2").arg(info.width).arg(info.height);
+        ok = false;
+    }
+    if (ok)
+    {
+        // The header mipmap count is not trusted, a full chain has floor(log2(max(w,h))) + 1 levels.
+        int fullChain = 1;
+        while((std::max(info.width, info.height) >> fullChain) > 0)
+            ++fullChain;
+        info.mipmaps = qBound(1, info.mipmaps, fullChain);
+    }
+    if (!ok)
+    {
+        info.format = UnknownFormat;
+        if (error)
+            *error = err;
+    }
+    return ok;
+}
+
+bool RocketTextureDecoder::CanDecodePixels(const Info &info)
+{
+    if (!info.IsValid())
+        return false;
+#ifndef ROCKET_CRUNCH_DECOMP
+    if (info.container == "CRN")
+        return false;
+#endif
+    return true;
+}
+
+QSize RocketTextureDecoder::MipSize(const Info &info, int level)
+{
+    level = qBound(0, level, std::max(0, info.mipmaps - 1));
+    return QSize(std::max(1, info.width >> level), std::max(1, info.height >> level));
+}
+
+int RocketTextureDecoder::MipLevelFor(const Info &info, const QSize &size)
+{
+    int level = 0;
+    while(level + 1 < info.mipmaps)
+    {
+        const QSize next = MipSize(info, level + 1);
+        if (next.width() < size.width() && next.height() < size.height())
+            break;
+        ++level;
+    }
+    return level;
+}
+
+QImage RocketTextureDecoder::Decode(const QByteArray &data, int level, Info *infoOut, QString *error)
+{
+    Info info;
+    if (!ReadInfo(data, info, error))
+        return QImage();
+    if (infoOut)
+        *infoOut = info;
+    if (level < 0 || level >= info.mipmaps)
+    {
+        if (error)
+            *error = QString("Mipmap level %1 does not exist, the texture has %2 levels").arg(level).arg(info.mipmaps);
+        return QImage();
+    }
+
+    const QSize size = MipSize(info, level);
+    QImage image(size, QImage::Format_ARGB32);
+    if (image.isNull())
+    {
+        if (error)
+            *error = "Out of memory";
+        return QImage();
+    }
+    uint *dst = reinterpret_cast<uint*>(image.bits());
+    const int dstStride = image.bytesPerLine() / 4;
+
+    if (info.container == "DDS")
+    {
+        // Levels of the first face are stored first.
+        qint64 offset = info.dataOffset;
+        for(int i = 0; i < level; ++i)
+        {
+            const QSize levelSize = MipSize(info, i);
+            offset += LevelBytes(info, levelSize.width(), levelSize.height());
+        }
+        if (offset + LevelBytes(info, size.width(), size.height()) > static_cast<qint64>(data.size()))
+        {
+            if (error)
+                *error = "DDS data is truncated";
+            return QImage();
+        }
+
+        const uchar *src = reinterpret_cast<const uchar*>(data.constData()) + offset;
+        if (IsBlockCompressed(info.format))
+            DecodeBlocks(src, info.format, info.signedFormat, size.width(), size.height(), dst, dstStride);
+        else
+            DecodeUncompressed(src, info, size.width(), size.height(), dst, dstStride);
+        return image;
+    }
+
+#ifdef ROCKET_CRUNCH_DECOMP
+    // Transcode the CRN level to DXT blocks and decode them.
+    const crn_uint32 dataSize = static_cast<crn_uint32>(data.size());
+    crnd::crnd_unpack_context context = crnd::crnd_unpack_begin(data.constData(), dataSize);
+    if (!context)
+    {
+        if (error)
+            *error = "Failed to read CRN data";
+        return QImage();
+    }
+    // crnd_unpack_level writes every face of the level, only the first one is decoded.
+    if (info.faces > static_cast<int>(cCRNMaxFaces))
+    {
+        crnd::crnd_unpack_end(context);
+        if (error)
+            *error = QString("Unsupported CRN face count %1").arg(info.faces);
+        return QImage();
+    }
+    const int blocksX = std::max(1, (size.width() + 3) / 4);
+    const int blocksY = std::max(1, (size.height() + 3) / 4);
+    const int rowPitch = blocksX * BlockBytes(info.format);
+    const int faceBytes = rowPitch * blocksY;
+    QByteArray blocks(faceBytes * info.faces, 0);
+    void *faces[cCRNMaxFaces];
+    for(int i = 0; i < info.faces; ++i)
+        faces[i] = blocks.data() + i * faceBytes;
+    const bool unpacked = crnd::crnd_unpack_level(context, faces, static_cast<crn_uint32>(faceBytes), static_cast<crn_uint32>(rowPitch), static_cast<crn_uint32>(level));
+    crnd::crnd_unpack_end(context);
+    if (!unpacked)
+    {
+        if (error)
+            *error = "Failed to unpack CRN data";
+        return QImage();
+    }
+    DecodeBlocks(reinterpret_cast<const uchar*>(blocks.constData()), info.format, false, size.width(), size.height(), dst, dstStride);
+    Unswizzle(info.swizzle, size.width(), size.height(), dst, dstStride);
+    return image;
+#else
+    if (error)
+        *error = "CRN decoding is not available in this build";
+    return QImage();
+#endif
+}
+
+void RocketTextureDecoder::Benchmark(const QString &directory)
+{
+    if (!QDir(directory).exists())
+    {
+        LogError("[RocketTextureDecoder]: Benchmark directory does not exist: " + directory);
+        return;
+    }
+
+    const QString crunchPath = QDir::toNativeSeparators(RocketFileSystem::InternalToolpath(RocketFileSystem::Crunch));
+    const bool crunchAvailable = QFile::exists(crunchPath);
+    const QString tempDir = QDir::tempPath();
+    const int iterations = 5;
+
+    QMap<QString, BenchmarkTotals> totals;
+    QDirIterator it(directory, QStringList() << "*.dds" << "*.crn", QDir::Files, QDirIterator::Subdirectories);
+    while(it.hasNext())
+    {
+        const QString path = it.next();
+        QFile file(path);
+        if (!file.open(QIODevice::ReadOnly))
+            continue;
+        const QByteArray data = file.readAll();
+        file.close();
+
+        Info info;
+        QString error;
+        if (!ReadInfo(data, info, &error) || !CanDecodePixels(info))
+        {
+            LogWarning(QString("    %1: %2").arg(QFileInfo(path).fileName()).arg(error.isEmpty() ? "Pixel decoding not available" : error));
+            continue;
+        }
+
+        // Full mip chain, repeated to get stable timings.
+        qint64 pixels = 0;
+        QElapsedTimer timer;
+        timer.start();
+        for(int i = 0; i < iterations; ++i)
+        {
+            for(int level = 0; level < info.mipmaps; ++level)
+            {
+                QImage image = Decode(data, level, 0, &error);
+                if (image.isNull())
+                    break;
+                pixels += image.width() * image.height();
+            }
+        }
+        BenchmarkTotals &total = totals[info.container + " " + info.formatName];
+        total.nsecs += timer.nsecsElapsed() / iterations;
+        total.pixels += pixels / iterations;
+        total.files++;
+
+        if (crunchAvailable)
+        {
+            const QString outPath = QDir(tempDir).absoluteFilePath(QString("rocket_texture_benchmark_%1.bmp").arg(total.files));
+            QElapsedTimer crunchTimer;
+            crunchTimer.start();
+            QProcess crunch;
+            crunch.start(crunchPath, QStringList() << "-noprogress" << "-fileformat" << "bmp" << "-file" << QDir::toNativeSeparators(path) << "-out" << QDir::toNativeSeparators(outPath));
+            if (crunch.waitForFinished(60000) && crunch.exitCode() == 0)
+            {
+                total.crunchMsecs += crunchTimer.elapsed();
+                total.crunchFiles++;
+            }
+            QFile::remove(outPath);
+        }
+    }
+
+    if (totals.isEmpty())
+    {
+        LogInfo("[RocketTextureDecoder]: No decodable DDS or CRN textures found in " + directory);
+        return;
+    }
+
+    LogInfo("[RocketTextureDecoder]: Decode speed, all mipmap levels, average of " + QString::number(iterations) + " runs");
+    for(QMap<QString, BenchmarkTotals>::const_iterator iter = totals.begin(); iter != totals.end(); ++iter)
+    {
+        const BenchmarkTotals &total = iter.value();
+        const double msecs = total.nsecs / 1000000.0;
+        QString line = QString("    %1: %2 files, %3 Mpixels in %4 msecs, %5 Mpixels/sec")
+            .arg(iter.key(), -16).arg(total.files).arg(total.pixels / 1000000.0, 0, 'f', 2).arg(msecs, 0, 'f', 1)
+            .arg(msecs > 0.0 ? (total.pixels / 1000.0) / msecs : 0.0, 0, 'f', 1);
+        if (total.crunchFiles > 0)
+            line += QString(", crunch tool %1 msecs per file").arg(total.crunchMsecs / total.crunchFiles);
+        LogInfo(line);
+    }
+}
+
+// RocketTextureDecodeWorker
+
+RocketTextureDecodeWorker::RocketTextureDecodeWorker(QObject *parent) :
+    QThread(parent),
+    stopping_(false),
+    cache_(32 * 1024)
+{
+    qRegisterMetaType<RocketTextureDecoder::Info>("RocketTextureDecoder::Info");
+}
+
+RocketTextureDecodeWorker::~RocketTextureDecodeWorker()
+{
+    Stop();
+}
+
+void RocketTextureDecodeWorker::Decode(const QString &key, const QByteArray &data, int level)
+{
+    Request request;
+    request.key = key;
+    request.data = data;
+    request.level = level;
+
+    QMutexLocker lock(&mutex_);
+    // A newer request with the same key replaces a pending one, eg. when switching mipmaps quickly.
+    for(int i = queue_.size() - 1; i >= 0; --i)
+        if (queue_[i].key == key)
+            queue_.removeAt(i);
+    queue_.push_back(request);
+    condition_.wakeOne();
+}
+
+void RocketTextureDecodeWorker::SetCacheSize(int kilobytes)
+{
+    QMutexLocker lock(&mutex_);
+    cache_.setMaxCost(std::max(0, kilobytes));
+}
+
+void RocketTextureDecodeWorker::Stop()
+{
+    {
+        QMutexLocker lock(&mutex_);
+        stopping_ = true;
+        queue_.clear();
+        condition_.wakeAll();
+    }
+    if (isRunning())
+        wait();
+}
+
+void RocketTextureDecodeWorker::run()
+{
+    forever
+    {
+        Request request;
+        QByteArray cacheKey;
+        CacheEntry cached;
+        bool hit = false;
+        {
+            QMutexLocker lock(&mutex_);
+            while(queue_.isEmpty() && !stopping_)
+                condition_.wait(&mutex_);
+            if (stopping_)
+                return;
+            request = queue_.takeFirst();
+        }
+
+        cacheKey = QCryptographicHash::hash(request.data, QCryptographicHash::Sha1) + QByteArray::number(request.level);
+        {
+            QMutexLocker lock(&mutex_);
+            CacheEntry *entry = cache_.object(cacheKey);
+            if (entry)
+            {
+                cached = *entry;
+                hit = true;
+            }
+        }
+
+        if (!hit)
+        {
+            QString error;
+            cached.image = RocketTextureDecoder::Decode(request.data, request.level, &cached.info, &error);
+            if (cached.image.isNull())
+            {
+                emit Decoded(request.key, request.level, QImage(), cached.info, error);
+                continue;
+            }
+
+            QMutexLocker lock(&mutex_);
+            if (stopping_)
+                return;
+            CacheEntry *entry = new CacheEntry(cached);
+            cache_.insert(cacheKey, entry, std::max(1, cached.image.byteCount() / 1024));
+        }
+        emit Decoded(request.key, request.level, cached.image, cached.info, QString());
+    }
+}
+
+/// @endcond
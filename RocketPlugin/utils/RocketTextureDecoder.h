@@ -0,0 +1,156 @@
+/**
+    @author Adminotech Ltd.
+
+    Copyright Adminotech Ltd.
+    All rights reserved.
+
+    @file   RocketTextureDecoder.h
+    @brief  In-process DDS and CRN texture decoding for previews. */
+
+#pragma once
+
+#include <QThread>
+#include <QMutex>
+#include <QWaitCondition>
+#include <QCache>
+#include <QImage>
+#include <QString>
+#include <QByteArray>
+#include <QList>
+#include <QSize>
+#include <QMetaType>
+
+/// @cond PRIVATE
+
+/// Decodes DDS and CRN textures into QImage.
+/** Supports DXT1/BC1, DXT3/BC2, DXT5/BC3, BC4, BC5 and uncompressed DDS textures, including DX10 headers.
+    Format and mipmap information is read directly from the DDS and CRN headers. CRN pixel data is
+    decoded when built with crunch's crn_decomp.h (ROCKET_CRUNCH_DECOMP), otherwise CanDecodePixels
+    returns false for CRN and the crunch tool has to be used. Swizzled CRN formats are restored to RGBA.
+    Only the first face of cube maps is decoded. All functions are thread safe. */
+class RocketTextureDecoder
+{
+public:
+    enum Format
+    {
+        UnknownFormat = 0,
+        BC1,
+        BC2,
+        BC3,
+        BC4,
+        BC5,
+        Uncompressed
+    };
+
+    /// Channel layout of swizzled CRN formats, undone after block decoding.
+    enum Swizzle
+    {
+        NoSwizzle = 0,
+        SwizzleCCxY,            ///< YCoCg, Co in red, Cg in green and luma in alpha.
+        SwizzleXGXR,            ///< Normal map, X in alpha and Y in green.
+        SwizzleXGBR,            ///< Red in alpha.
+        SwizzleAGBR,            ///< Red and alpha swapped.
+        SwizzleYX               ///< Two channel normal map, Y in the first and X in the second channel.
+    };
+
+    struct Info
+    {
+        QString container;      ///< "DDS" or "CRN".
+        QString formatName;     ///< Format as shown to the user, eg. "DXT5" or "A8R8G8B8".
+        Format format;
+        bool signedFormat;      ///< BC4 and BC5 SNORM variants.
+        int width;
+        int height;
+        int mipmaps;            ///< Number of levels, including the full size level. At most a full mip chain.
+        int faces;
+
+        // Internal layout.
+        int dataOffset;         ///< Offset of the first level in DDS data.
+        uint bitCount;          ///< Uncompressed bits per pixel.
+        uint masks[4];          ///< Uncompressed RGBA bit masks.
+        bool luminance;         ///< Uncompressed red mask is luminance.
+        Swizzle swizzle;        ///< CRN channel swizzle.
+
+        Info();
+        bool IsValid() const { return format != UnknownFormat && width > 0 && height > 0; }
+    };
+
+    /// Returns true if @c suffix, without the dot, is decoded by this class.
+    static bool IsSupportedSuffix(const QString &suffix);
+
+    /// Reads format and mipmap information from DDS or CRN @c data.
+    static bool ReadInfo(const QByteArray &data, Info &info, QString *error = 0);
+
+    /// Returns true if the pixels of a texture described by @c info can be decoded.
+    static bool CanDecodePixels(const Info &info);
+
+    /// Returns the size of mipmap @c level.
+    static QSize MipSize(const Info &info, int level);
+
+    /// Returns the smallest mipmap level that still covers @c size.
+    static int MipLevelFor(const Info &info, const QSize &size);
+
+    /// Decodes mipmap @c level of DDS or CRN @c data.
+    /** @param info Filled with the header information if not null.
+        @return Image in QImage::Format_ARGB32, null on failure. */
+    static QImage Decode(const QByteArray &data, int level = 0, Info *info = 0, QString *error = 0);
+
+    /// Decodes every DDS and CRN file found in @c directory and prints decode speed per format.
+    /** The time of converting each file with the crunch tool is printed for comparison if it is available. */
+    static void Benchmark(const QString &directory);
+};
+Q_DECLARE_METATYPE(RocketTextureDecoder::Info)
+
+/// Worker thread that decodes DDS and CRN textures with RocketTextureDecoder.
+/** Decoded levels are kept in a small cache keyed by content, so reopening a texture or
+    switching back to a viewed mipmap does not decode again. */
+class RocketTextureDecodeWorker : public QThread
+{
+Q_OBJECT
+
+public:
+    explicit RocketTextureDecodeWorker(QObject *parent = 0);
+    virtual ~RocketTextureDecodeWorker();
+
+    /// Queues decoding of mipmap @c level of @c data. Thread safe.
+    /** @param Key that is passed back in Decoded. */
+    void Decode(const QString &key, const QByteArray &data, int level = 0);
+
+    /// Sets the size of the decoded image cache in kilobytes. Default is 32 megabytes.
+    void SetCacheSize(int kilobytes);
+
+    /// Stops processing and waits for the thread to exit. Pending requests are discarded.
+    void Stop();
+
+signals:
+    /// Emitted in the worker thread when a texture has been decoded.
+    /** @note Connect your slot with Qt::QueuedConnection so you will receive the callback in your thread.
+        Image is null and @c error is set if decoding failed. */
+    void Decoded(const QString &key, int level, const QImage &image, const RocketTextureDecoder::Info &info, const QString &error);
+
+protected:
+    /// QThread override.
+    void run();
+
+private:
+    struct Request
+    {
+        QString key;
+        QByteArray data;
+        int level;
+    };
+
+    struct CacheEntry
+    {
+        QImage image;
+        RocketTextureDecoder::Info info;
+    };
+
+    bool stopping_;
+    QList<Request> queue_;
+    QCache<QByteArray, CacheEntry> cache_;
+    QMutex mutex_;
+    QWaitCondition condition_;
+};
+
+/// @endcond
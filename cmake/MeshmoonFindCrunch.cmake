@@ -7,3 +7,18 @@ macro (find_crunch_executable)
         endif ()
     endif ()
 endmacro ()
+
+# Optional in-process CRN decoding with crunch's header only crn_decomp.h, see RocketTextureDecoder.
+macro (use_crunch_decomp)
+    if (NOT "$ENV{CRUNCH_HOME}" STREQUAL "" AND EXISTS "$ENV{CRUNCH_HOME}/inc/crn_decomp.h")
+        file (TO_CMAKE_PATH "$ENV{CRUNCH_HOME}/inc" CRUNCH_INCLUDE_DIR)
+    elseif (EXISTS "${AdminoPlugins_Deps_DIR}/crunch/inc/crn_decomp.h")
+        set (CRUNCH_INCLUDE_DIR "${AdminoPlugins_Deps_DIR}/crunch/inc")
+    endif ()
+    if (CRUNCH_INCLUDE_DIR)
+        include_directories (${CRUNCH_INCLUDE_DIR})
+        add_definitions (-DROCKET_CRUNCH_DECOMP)
+    else ()
+        message (STATUS "crn_decomp.h not found, CRN textures are previewed with the crunch tool")
+    endif ()
+endmacro ()